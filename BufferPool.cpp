@@ -0,0 +1,391 @@
+#include "BufferPool.h"
+#include "Interface/Mutex.h"
+#include <new>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	//Power of two classes from 4KB to 4MB. 32769 (the file server's
+	//READSIZE+1 send buffers) and 524301 (512KB chunk buffers plus
+	//padding) are exact classes, because rounding them up would waste
+	//almost half of each buffer
+	const size_t c_class_sizes[]={4096, 8192, 16384, 32768, 32769, 65536, 131072,
+		262144, 524288, 524301, 1048576, 2097152, 4194304};
+	const unsigned int c_huge_page_size=2*1024*1024;
+	//Bytes of one size class a thread may keep for itself
+	const size_t c_thread_cache_class_bytes=8*1024*1024;
+	const size_t c_thread_cache_max_items=16;
+	const int64 c_thread_cache_max_bytes=16*1024*1024;
+	const int64 c_shared_max_free_bytes=64*1024*1024;
+	//Thread local counters are folded into the pool statistics at least
+	//every this many operations
+	const unsigned int c_thread_cache_report_ops=256;
+
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+	bool useHugePages(size_t bsize)
+	{
+		return bsize>=c_huge_page_size;
+	}
+#else
+	bool useHugePages(size_t bsize)
+	{
+		return false;
+	}
+#endif
+}
+
+struct SBufferPoolThreadCache
+{
+	SBufferPoolThreadCache(void)
+		: cached_bytes(0), reported_cached_bytes(0), allocations(0),
+		  hits(0), ops(0)
+	{
+		for(unsigned int i=0;i<CBufferPool::n_size_classes;++i)
+		{
+			outstanding[i]=0;
+		}
+	}
+
+	std::vector<char*> bufs[CBufferPool::n_size_classes];
+	//Buffers allocated by other threads and released by this one
+	std::vector<char*> remote_bufs[CBufferPool::n_size_classes];
+	//Buffers allocated by this thread and not released by it yet
+	int64 outstanding[CBufferPool::n_size_classes];
+	int64 cached_bytes;
+	int64 reported_cached_bytes;
+	int64 allocations;
+	int64 hits;
+	unsigned int ops;
+};
+
+CBufferPool::CBufferPool(IMutex* mutex)
+	: mutex(mutex)
+{
+}
+
+CBufferPool::~CBufferPool(void)
+{
+	for(unsigned int i=0;i<n_size_classes;++i)
+	{
+		for(size_t j=0;j<free_lists[i].size();++j)
+		{
+			freeOS(free_lists[i][j], classSize(i));
+		}
+	}
+	mutex->Remove();
+}
+
+unsigned int CBufferPool::sizeClass(size_t bsize)
+{
+	unsigned int sclass=0;
+	while(sclass<n_size_classes && classSize(sclass)<bsize)
+	{
+		++sclass;
+	}
+	return sclass;
+}
+
+size_t CBufferPool::classSize(unsigned int sclass)
+{
+	return c_class_sizes[sclass];
+}
+
+size_t CBufferPool::threadCacheItems(unsigned int sclass)
+{
+	size_t items=c_thread_cache_class_bytes/classSize(sclass);
+	if(items>c_thread_cache_max_items)
+	{
+		items=c_thread_cache_max_items;
+	}
+	return items;
+}
+
+char* CBufferPool::allocate(size_t bsize, SBufferPoolThreadCache* cache)
+{
+	unsigned int sclass=sizeClass(bsize);
+	if(sclass>=n_size_classes)
+	{
+		{
+			IScopedLock lock(mutex);
+			++stats.allocations;
+		}
+		return allocateOS(bsize);
+	}
+
+	size_t csize=classSize(sclass);
+
+	if(cache!=NULL)
+	{
+		++cache->allocations;
+		++cache->outstanding[sclass];
+		std::vector<char*>& bufs=cache->bufs[sclass].empty() ? cache->remote_bufs[sclass] : cache->bufs[sclass];
+		if(!bufs.empty())
+		{
+			char* ret=bufs[bufs.size()-1];
+			bufs.pop_back();
+			cache->cached_bytes-=csize;
+			++cache->hits;
+			reportThreadCache(cache);
+			return ret;
+		}
+	}
+
+	{
+		IScopedLock lock(mutex);
+		if(cache!=NULL)
+		{
+			reportThreadCacheInt(cache);
+		}
+		else
+		{
+			++stats.allocations;
+		}
+
+		std::vector<char*>& bufs=free_lists[sclass];
+		if(!bufs.empty())
+		{
+			char* ret=bufs[bufs.size()-1];
+			bufs.pop_back();
+			stats.free_bytes-=csize;
+			++stats.shared_hits;
+			return ret;
+		}
+	}
+
+	return allocateOS(csize);
+}
+
+void CBufferPool::release(char* buf, size_t bsize, SBufferPoolThreadCache* cache)
+{
+	if(buf==NULL)
+	{
+		return;
+	}
+
+	unsigned int sclass=sizeClass(bsize);
+	if(sclass>=n_size_classes)
+	{
+		freeOS(buf, bsize);
+		return;
+	}
+
+	size_t csize=classSize(sclass);
+
+	if(cache!=NULL)
+	{
+		if(cache->outstanding[sclass]<=0)
+		{
+			//Allocated by another thread, e.g. a block filled by a backup
+			//thread and released by the image writer. This thread would
+			//not allocate it again, so it goes to the shared free list
+			std::vector<char*>& remote_bufs=cache->remote_bufs[sclass];
+			remote_bufs.push_back(buf);
+			cache->cached_bytes+=csize;
+			if(remote_bufs.size()>=threadCacheItems(sclass))
+			{
+				flushRemoteFrees(cache, sclass);
+			}
+			else
+			{
+				reportThreadCache(cache);
+			}
+			return;
+		}
+
+		--cache->outstanding[sclass];
+		std::vector<char*>& bufs=cache->bufs[sclass];
+		if(bufs.size()<threadCacheItems(sclass)
+			&& cache->cached_bytes+static_cast<int64>(csize)<=c_thread_cache_max_bytes)
+		{
+			bufs.push_back(buf);
+			cache->cached_bytes+=csize;
+			reportThreadCache(cache);
+			return;
+		}
+	}
+
+	{
+		IScopedLock lock(mutex);
+		if(cache!=NULL)
+		{
+			reportThreadCacheInt(cache);
+		}
+
+		if(stats.free_bytes+static_cast<int64>(csize)<=c_shared_max_free_bytes)
+		{
+			free_lists[sclass].push_back(buf);
+			stats.free_bytes+=csize;
+			return;
+		}
+	}
+
+	freeOS(buf, csize);
+}
+
+SBufferPoolThreadCache* CBufferPool::createThreadCache(void)
+{
+	return new SBufferPoolThreadCache;
+}
+
+void CBufferPool::destroyThreadCache(SBufferPoolThreadCache* cache)
+{
+	std::vector<std::pair<char*, size_t> > to_free;
+
+	{
+		IScopedLock lock(mutex);
+		reportThreadCacheInt(cache);
+		stats.thread_cached_bytes-=cache->reported_cached_bytes;
+
+		for(unsigned int i=0;i<n_size_classes;++i)
+		{
+			size_t csize=classSize(i);
+			cache->bufs[i].insert(cache->bufs[i].end(), cache->remote_bufs[i].begin(), cache->remote_bufs[i].end());
+			for(size_t j=0;j<cache->bufs[i].size();++j)
+			{
+				if(stats.free_bytes+static_cast<int64>(csize)<=c_shared_max_free_bytes)
+				{
+					free_lists[i].push_back(cache->bufs[i][j]);
+					stats.free_bytes+=csize;
+				}
+				else
+				{
+					to_free.push_back(std::make_pair(cache->bufs[i][j], csize));
+				}
+			}
+		}
+	}
+
+	for(size_t i=0;i<to_free.size();++i)
+	{
+		freeOS(to_free[i].first, to_free[i].second);
+	}
+
+	delete cache;
+}
+
+void CBufferPool::flushRemoteFrees(SBufferPoolThreadCache* cache, unsigned int sclass)
+{
+	std::vector<char*>& bufs=cache->remote_bufs[sclass];
+	size_t csize=classSize(sclass);
+	cache->cached_bytes-=static_cast<int64>(bufs.size()*csize);
+
+	size_t nshared=0;
+	{
+		IScopedLock lock(mutex);
+		reportThreadCacheInt(cache);
+		for(;nshared<bufs.size()
+			&& stats.free_bytes+static_cast<int64>(csize)<=c_shared_max_free_bytes;++nshared)
+		{
+			free_lists[sclass].push_back(bufs[nshared]);
+			stats.free_bytes+=csize;
+		}
+	}
+
+	for(size_t i=nshared;i<bufs.size();++i)
+	{
+		freeOS(bufs[i], csize);
+	}
+	bufs.clear();
+}
+
+SBufferPoolStats CBufferPool::getStats(void)
+{
+	IScopedLock lock(mutex);
+	return stats;
+}
+
+void CBufferPool::reportThreadCache(SBufferPoolThreadCache* cache)
+{
+	if(++cache->ops>=c_thread_cache_report_ops)
+	{
+		IScopedLock lock(mutex);
+		reportThreadCacheInt(cache);
+	}
+}
+
+void CBufferPool::reportThreadCacheInt(SBufferPoolThreadCache* cache)
+{
+	stats.allocations+=cache->allocations;
+	stats.thread_cache_hits+=cache->hits;
+	stats.thread_cached_bytes+=cache->cached_bytes-cache->reported_cached_bytes;
+	cache->allocations=0;
+	cache->hits=0;
+	cache->reported_cached_bytes=cache->cached_bytes;
+	cache->ops=0;
+}
+
+char* CBufferPool::allocateOS(size_t bsize)
+{
+	char* ret=NULL;
+	bool huge=useHugePages(bsize);
+
+#ifdef _WIN32
+	ret=static_cast<char*>(_aligned_malloc(bsize, BUFFER_POOL_ALIGNMENT));
+#else
+	if(huge)
+	{
+		void* mem=mmap(NULL, bsize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(mem!=MAP_FAILED)
+		{
+#ifdef MADV_HUGEPAGE
+			madvise(mem, bsize, MADV_HUGEPAGE);
+#endif
+			ret=static_cast<char*>(mem);
+		}
+	}
+	else
+	{
+		void* mem;
+		if(posix_memalign(&mem, BUFFER_POOL_ALIGNMENT, bsize)==0)
+		{
+			ret=static_cast<char*>(mem);
+		}
+	}
+#endif
+
+	if(ret==NULL)
+	{
+		throw std::bad_alloc();
+	}
+
+	IScopedLock lock(mutex);
+	stats.reserved_bytes+=bsize;
+	if(huge)
+	{
+		stats.huge_page_bytes+=bsize;
+	}
+	++stats.os_allocations;
+
+	return ret;
+}
+
+void CBufferPool::freeOS(char* buf, size_t bsize)
+{
+	bool huge=useHugePages(bsize);
+
+#ifdef _WIN32
+	_aligned_free(buf);
+#else
+	if(huge)
+	{
+		munmap(buf, bsize);
+	}
+	else
+	{
+		free(buf);
+	}
+#endif
+
+	IScopedLock lock(mutex);
+	stats.reserved_bytes-=bsize;
+	if(huge)
+	{
+		stats.huge_page_bytes-=bsize;
+	}
+	++stats.os_frees;
+}
@@ -0,0 +1,53 @@
+#include "Interface/BufferPool.h"
+#include <vector>
+
+class IMutex;
+
+struct SBufferPoolThreadCache;
+
+/**
+* Process wide pool of block buffers (network, image and chunk buffers).
+* Requests are rounded up to power of two size classes between 4KB and
+* 4MB, plus exact classes for the common odd sizes, and kept in a small
+* per thread cache and a shared free list on release, so the steady
+* state of a backup does not allocate at all.
+* A buffer released by the thread that allocated it is handed out to
+* the same thread next, which keeps its pages on the NUMA node of the
+* thread that first touched it. Buffers released by other threads go
+* back to the shared free list in batches. Blocks of 2MB and up are mapped separately and advised to
+* use transparent huge pages where available. Larger requests bypass
+* the size classes.
+*/
+class CBufferPool
+{
+public:
+	CBufferPool(IMutex* mutex);
+	~CBufferPool(void);
+
+	char* allocate(size_t bsize, SBufferPoolThreadCache* cache);
+	void release(char* buf, size_t bsize, SBufferPoolThreadCache* cache);
+
+	SBufferPoolThreadCache* createThreadCache(void);
+	void destroyThreadCache(SBufferPoolThreadCache* cache);
+
+	SBufferPoolStats getStats(void);
+
+	static const unsigned int n_size_classes=13;
+
+private:
+	static unsigned int sizeClass(size_t bsize);
+	static size_t classSize(unsigned int sclass);
+	static size_t threadCacheItems(unsigned int sclass);
+
+	char* allocateOS(size_t bsize);
+	void freeOS(char* buf, size_t bsize);
+
+	void flushRemoteFrees(SBufferPoolThreadCache* cache, unsigned int sclass);
+
+	void reportThreadCache(SBufferPoolThreadCache* cache);
+	void reportThreadCacheInt(SBufferPoolThreadCache* cache);
+
+	IMutex* mutex;
+	std::vector<char*> free_lists[n_size_classes];
+	SBufferPoolStats stats;
+};
@@ -0,0 +1,36 @@
+#ifndef INTERFACE_BUFFERPOOL_H
+#define INTERFACE_BUFFERPOOL_H
+
+#include "Types.h"
+
+//Buffers from IServer::allocateBuffer are rounded up to a size class
+//and aligned to BUFFER_POOL_ALIGNMENT. They have to be given
+//back via IServer::releaseBuffer with the size they were requested with
+const size_t BUFFER_POOL_ALIGNMENT=4096;
+
+struct SBufferPoolStats
+{
+	SBufferPoolStats(void)
+		: reserved_bytes(0), huge_page_bytes(0), free_bytes(0),
+		  thread_cached_bytes(0), allocations(0), thread_cache_hits(0),
+		  shared_hits(0), os_allocations(0), os_frees(0)
+	{
+	}
+
+	//Memory currently allocated from the operating system
+	int64 reserved_bytes;
+	//Part of reserved_bytes mapped with the transparent huge page advice
+	int64 huge_page_bytes;
+	//Unused buffers in the shared free lists
+	int64 free_bytes;
+	//Unused buffers in the per thread caches (as of the last time
+	//the threads reported to the pool)
+	int64 thread_cached_bytes;
+	int64 allocations;
+	int64 thread_cache_hits;
+	int64 shared_hits;
+	int64 os_allocations;
+	int64 os_frees;
+};
+
+#endif //INTERFACE_BUFFERPOOL_H
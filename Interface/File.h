@@ -18,6 +18,24 @@ const int MODE_READ_SEQUENTIAL_BACKUP=8;
 const int MODE_RW_SEQUENTIAL=9;
 //Linux only
 const int MODE_RW_READNONE=10;
+//Like MODE_RW/MODE_RW_CREATE. On Linux aligned positional writes
+//bypass the page cache (O_DIRECT), everything else is buffered
+const int MODE_RW_DIRECT=11;
+const int MODE_RW_CREATE_DIRECT=12;
+
+//Offset, size and buffer alignment needed for unbuffered writes
+const _u32 FILE_DIRECT_ALIGNMENT=4096;
+
+struct SFileSegment
+{
+	SFileSegment(void)
+		: buffer(NULL), bsize(0) {}
+	SFileSegment(char* buffer, _u32 bsize)
+		: buffer(buffer), bsize(bsize) {}
+
+	char* buffer;
+	_u32 bsize;
+};
 
 class IFile : public IObject
 {
@@ -31,6 +49,47 @@ public:
 	
 	virtual std::string getFilename(void)=0;
 	virtual std::wstring getFilenameW(void)=0;
+
+	/**
+	* Positional and scatter/gather I/O. Files implementing these natively
+	* (pread/pwritev) leave the file pointer untouched, the defaults below
+	* seek, so callers must not rely on the file pointer afterwards.
+	*/
+	virtual _u32 ReadAt(_i64 spos, char* buffer, _u32 bsize)
+	{
+		if(!Seek(spos)) return 0;
+		return Read(buffer, bsize);
+	}
+
+	virtual _u32 WriteAt(_i64 spos, const char* buffer, _u32 bsize)
+	{
+		if(!Seek(spos)) return 0;
+		return Write(buffer, bsize);
+	}
+
+	virtual _u32 ReadAtV(_i64 spos, const SFileSegment* segments, size_t nsegments)
+	{
+		_u32 ret=0;
+		for(size_t i=0;i<nsegments;++i)
+		{
+			_u32 r=ReadAt(spos+ret, segments[i].buffer, segments[i].bsize);
+			ret+=r;
+			if(r<segments[i].bsize) break;
+		}
+		return ret;
+	}
+
+	virtual _u32 WriteAtV(_i64 spos, const SFileSegment* segments, size_t nsegments)
+	{
+		_u32 ret=0;
+		for(size_t i=0;i<nsegments;++i)
+		{
+			_u32 w=WriteAt(spos+ret, segments[i].buffer, segments[i].bsize);
+			ret+=w;
+			if(w<segments[i].bsize) break;
+		}
+		return ret;
+	}
 };
 
 class ScopedDeleteFile
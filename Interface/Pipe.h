@@ -2,6 +2,7 @@
 #define IPIPE_H
 
 #include <string>
+#include <vector>
 
 #include "Object.h"
 #include "Types.h"
@@ -19,6 +20,33 @@ public:
 	virtual size_t Read(std::string *ret, int timeoutms=-1)=0;
 	virtual bool Write(const std::string &str, int timeoutms=-1)=0;
 
+	/**
+	* Moves the contents of str into the pipe, leaving str empty. Memory
+	* pipes pass the buffer on to the reader without copying it
+	*/
+	virtual bool WriteOwned(std::string &str, int timeoutms=-1)
+	{
+		bool ret=Write(str, timeoutms);
+		str.clear();
+		return ret;
+	}
+
+	/**
+	* Appends all messages available after waiting (see Read) to ret.
+	* Returns the number of messages read.
+	*/
+	virtual size_t ReadAll(std::vector<std::string>& ret, int timeoutms=-1)
+	{
+		std::string msg;
+		if(Read(&msg, timeoutms)==0)
+		{
+			return 0;
+		}
+		ret.push_back(std::string());
+		ret.back().swap(msg);
+		return 1;
+	}
+
 	/**
 	* @param timeoutms -1 for blocking >=0 to block only for x ms. Default: nonblocking
 	*/
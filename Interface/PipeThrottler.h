@@ -4,11 +4,17 @@
 #include "Object.h"
 #include <string>
 
+//Throttlers may be nested (e.g. global -> internet/local -> per client).
+//Bytes added to a throttler also count against all its parents and each
+//child gets a share of its parent's limit proportional to its weight
+//while the parent is saturated. A child keeps its parent alive, so
+//parents may be destroyed before their children
 class IPipeThrottler : public IObject
 {
 public:
 	virtual bool addBytes(size_t n_bytes, bool wait)=0;
 	virtual void changeThrottleLimit(size_t bps)=0;
+	virtual void changeParent(IPipeThrottler* parent, unsigned int weight)=0;
 };
 
 
@@ -3,6 +3,7 @@
 
 #include <string>
 #include "Types.h"
+#include "BufferPool.h"
 
 #define LL_DEBUG -1
 #define LL_INFO 0
@@ -98,7 +99,11 @@ public:
 	virtual ISettingsReader* createDBSettingsReader(THREAD_ID tid, DATABASE_ID pIdentifier, const std::string &pTable, const std::string &pSQL="")=0;
 	virtual ISettingsReader* createDBSettingsReader(IDatabase *db, const std::string &pTable, const std::string &pSQL="")=0;
 	virtual ISettingsReader* createMemorySettingsReader(const std::string &pData)=0;
-	virtual IPipeThrottler* createPipeThrottler(size_t bps)=0;
+	virtual IPipeThrottler* createPipeThrottler(size_t bps, IPipeThrottler* parent=NULL, unsigned int weight=1)=0;
+
+	virtual char* allocateBuffer(size_t bsize)=0;
+	virtual void releaseBuffer(char* buf, size_t bsize)=0;
+	virtual SBufferPoolStats getBufferPoolStats(void)=0;
 
 	virtual bool openDatabase(std::string pFile, DATABASE_ID pIdentifier, std::string pEngine="sqlite")=0;
 	virtual IDatabase* getDatabase(THREAD_ID tid, DATABASE_ID pIdentifier)=0;
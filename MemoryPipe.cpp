@@ -22,7 +22,14 @@
 #include <memory.h>
 #endif
 
+namespace
+{
+	const size_t max_pooled_buffers=64;
+	const size_t max_pooled_buffer_size=512*1024;
+}
+
 CMemoryPipe::CMemoryPipe(void)
+	: front_offset(0)
 {
     mutex=Server->createMutex();
     cond=Server->createCondition();
@@ -34,9 +41,8 @@ CMemoryPipe::~CMemoryPipe(void)
     Server->destroy(cond);
 }
 
-size_t CMemoryPipe::Read(char *buffer, size_t bsize, int timeoutms)
+bool CMemoryPipe::waitForData(IScopedLock& lock, int timeoutms)
 {
-	IScopedLock lock(mutex);
 	if( timeoutms>0 )
 	{
 		int64 starttime=Server->getTimeMS();
@@ -51,12 +57,12 @@ size_t CMemoryPipe::Read(char *buffer, size_t bsize, int timeoutms)
 		}
 
 		if(queue.empty())
-			return 0;
+			return false;
 	}	
 	else if( timeoutms==0 )
 	{
 		if( queue.size()==0 )
-			return 0;
+			return false;
 	}
 	else
 	{
@@ -65,86 +71,107 @@ size_t CMemoryPipe::Read(char *buffer, size_t bsize, int timeoutms)
 			cond->wait(&lock);		
 		}
 	}
+	return true;
+}
+
+void CMemoryPipe::popFront(void)
+{
+	std::string& front=queue.front();
+	if(free_bufs.size()<max_pooled_buffers
+		&& front.capacity()>0
+		&& front.capacity()<=max_pooled_buffer_size)
+	{
+		front.clear();
+		free_bufs.push_back(std::string());
+		free_bufs.back().swap(front);
+	}
+	queue.pop_front();
+	front_offset=0;
+}
+
+size_t CMemoryPipe::Read(char *buffer, size_t bsize, int timeoutms)
+{
+	IScopedLock lock(mutex);
+	if(!waitForData(lock, timeoutms))
+		return 0;
 	
-	std::string *cstr=&queue[0];
+	std::string *cstr=&queue.front();
 	
-	size_t psize=cstr->size();
+	size_t psize=cstr->size()-front_offset;
 	
 	if( psize<=bsize )
 	{
-		memcpy( buffer, cstr->c_str(), psize );
-		queue.erase( queue.begin() );
+		memcpy( buffer, cstr->data()+front_offset, psize );
+		popFront();
 		return psize;
 	}
 	else
 	{
-		memcpy( buffer, cstr->c_str(), bsize );
-		cstr->erase(0, bsize );
+		memcpy( buffer, cstr->data()+front_offset, bsize );
+		front_offset+=bsize;
 		return bsize;
 	}
 }
 
 bool CMemoryPipe::Write(const char *buffer, size_t bsize, int timeoutms)
+{
+	std::string nstr;
+	{
+		IScopedLock lock(mutex);
+		if(!free_bufs.empty())
+		{
+			nstr.swap(free_bufs.back());
+			free_bufs.pop_back();
+		}
+	}
+
+	nstr.assign(buffer, bsize);
+	
+	return WriteOwned(nstr, timeoutms);
+}
+
+size_t CMemoryPipe::Read(std::string *str, int timeoutms )
 {
 	IScopedLock lock(mutex);
+	if(!waitForData(lock, timeoutms))
+		return 0;
 	
-	queue.push_back("");
-	std::deque<std::string>::iterator iter=queue.end();
-	--iter;
-	std::string *nstr=&(*iter);
+	std::string& fs=queue.front();
+	if(front_offset>0)
+	{
+		fs.erase(0, front_offset);
+	}
 	
-	nstr->resize( bsize );
-	memcpy( (char*)nstr->c_str(), buffer, bsize );
+	str->swap(fs);
 	
-	cond->notify_one();
+	popFront();
 	
-	return true;
+	return str->size();
 }
 
-size_t CMemoryPipe::Read(std::string *str, int timeoutms )
+size_t CMemoryPipe::ReadAll(std::vector<std::string>& ret, int timeoutms)
 {
 	IScopedLock lock(mutex);
-	
-	if( timeoutms>0 )
-	{
-		int64 starttime=Server->getTimeMS();
-		int64 currtime=starttime;
-		while( queue.empty() && starttime+timeoutms>currtime)
-		{
-			cond->wait( &lock, timeoutms- static_cast<int>(currtime-starttime) );
-			if(queue.empty())
-			{
-				currtime=Server->getTimeMS();
-			}
-		}
+	if(!waitForData(lock, timeoutms))
+		return 0;
 
-		if(queue.empty())
-			return 0;
-	}	
-	else if( timeoutms==0 )
+	size_t n=queue.size();
+	size_t start=ret.size();
+	ret.resize(start+n);
+
+	if(front_offset>0)
 	{
-		if( queue.size()==0 )
-			return 0;
+		queue.front().erase(0, front_offset);
+		front_offset=0;
 	}
-	else
+
+	for(size_t i=0;i<n;++i)
 	{
-		while( queue.size()==0 )
-		{
-			cond->wait(&lock);		
-		}
+		ret[start+i].swap(queue[i]);
 	}
-	
-	std::string *fs=&queue[0];
-	
-	size_t fsize=fs->size();
-	
-	str->resize( fsize );
-	 
-	memcpy( (char*) str->c_str(), fs->c_str(), fsize );
-	
-	queue.erase( queue.begin() );
-	
-	return fsize;		
+	queue.clear();
+
+	return n;
 }
 
 bool CMemoryPipe::Write(const std::string &str, int timeoutms)
@@ -158,6 +185,17 @@ bool CMemoryPipe::Write(const std::string &str, int timeoutms)
 	return true;
 }
 
+bool CMemoryPipe::WriteOwned(std::string &str, int timeoutms)
+{
+	IScopedLock lock(mutex);
+	
+	queue.push_back( std::string() );
+	queue.back().swap(str);
+	
+	cond->notify_one();
+	
+	return true;
+}
 bool CMemoryPipe::isWritable(int timeoutms)
 {
 	return true;
@@ -4,6 +4,7 @@
 #include "Interface/Pipe.h"
 #include <deque>
 #include <string>
+#include <vector>
 #include "Interface/Mutex.h"
 #include "Interface/Condition.h"
 
@@ -17,6 +18,8 @@ public:
 	virtual bool Write(const char *buffer, size_t bsize, int timeoutms);
 	virtual size_t Read(std::string *ret, int timeoutms);
 	virtual bool Write(const std::string &str, int timeoutms);
+	virtual bool WriteOwned(std::string &str, int timeoutms);
+	virtual size_t ReadAll(std::vector<std::string>& ret, int timeoutms);
 
 	virtual bool isWritable(int timeoutms);
 	virtual bool isReadable(int timeoutms);
@@ -35,7 +38,14 @@ public:
 	virtual void resetTransferedBytes(void);
 	
 private:
+	bool waitForData(IScopedLock& lock, int timeoutms);
+	void popFront(void);
+
 	std::deque<std::string> queue;
+	//Bytes of the first message already consumed by partial reads
+	size_t front_offset;
+	//Consumed message buffers kept for reuse by Write
+	std::vector<std::string> free_bufs;
 	
 	IMutex *mutex;
 	ICondition *cond;
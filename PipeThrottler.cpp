@@ -2,77 +2,242 @@
 #include "Server.h"
 #include "Interface/Mutex.h"
 #include "stringtools.h"
+#include <algorithm>
 
 #define DLOG(x) //x
 
-PipeThrottler::PipeThrottler(size_t bps)
-	: throttle_bps(bps), curr_bytes(0), lastresettime(0)
+namespace
+{
+	//Children that passed bytes within this time get a share of the parent's bandwidth
+	const int64 c_active_window=1000;
+	//Shares are multiplied by borrow_factor/c_borrow_unit
+	const int64 c_borrow_unit=1000;
+	const int64 c_max_borrow_factor=64*c_borrow_unit;
+	const int64 c_borrow_adjust_interval=100;
+
+	void refill(int64& tokens, int64& lastrefill, size_t bps, int64 ctime)
+	{
+		int64 missing=static_cast<int64>(bps)-tokens;
+		if(missing<=0 || ctime<=lastrefill)
+		{
+			lastrefill=(std::max)(lastrefill, ctime);
+			return;
+		}
+
+		int64 passed_time=ctime-lastrefill;
+		if(passed_time>missing*1000/static_cast<int64>(bps))
+		{
+			tokens=bps;
+			lastrefill=ctime;
+			return;
+		}
+
+		int64 add=passed_time*static_cast<int64>(bps)/1000;
+		if(add>0)
+		{
+			tokens+=add;
+			lastrefill=ctime;
+		}
+	}
+}
+
+PipeThrottler::PipeThrottler(size_t bps, PipeThrottler* parent, unsigned int weight)
+	: throttle_bps(bps), tokens(bps), lastrefill(Server->getTimeMS()),
+	  borrow_factor(c_borrow_unit), lastadjust(lastrefill), parent(NULL), refcount(1)
 {
 	mutex=Server->createMutex();
+
+	changeParent(parent, weight);
 }
 
 PipeThrottler::~PipeThrottler(void)
 {
+	changeParent(NULL, 0);
+
 	Server->destroy(mutex);
 }
 
-bool PipeThrottler::addBytes(size_t new_bytes, bool wait)
+void PipeThrottler::Remove(void)
+{
+	release();
+}
+
+void PipeThrottler::addRef(void)
 {
 	IScopedLock lock(mutex);
+	++refcount;
+}
+
+void PipeThrottler::release(void)
+{
+	bool do_delete;
+	{
+		IScopedLock lock(mutex);
+		--refcount;
+		do_delete=(refcount==0);
+	}
+
+	if(do_delete)
+	{
+		delete this;
+	}
+}
+
+void PipeThrottler::changeParent(IPipeThrottler* pParent, unsigned int weight)
+{
+	PipeThrottler* new_parent=static_cast<PipeThrottler*>(pParent);
+
+	{
+		IScopedLock lock(mutex);
+		if(new_parent==parent)
+		{
+			return;
+		}
+	}
+
+	if(new_parent!=NULL)
+	{
+		new_parent->addRef();
+		new_parent->addChild(this, weight);
+	}
+
+	PipeThrottler* old_parent;
+	{
+		IScopedLock lock(mutex);
+		old_parent=parent;
+		parent=new_parent;
+	}
+
+	if(old_parent!=NULL)
+	{
+		old_parent->removeChild(this);
+		old_parent->release();
+	}
+}
+
+bool PipeThrottler::addBytes(size_t new_bytes, bool wait)
+{
+	size_t child_bps;
+	int64 wait_ms=consume(new_bytes, Server->getTimeMS(), NULL, child_bps);
+
+	if(wait_ms<=0)
+	{
+		return true;
+	}
 
-	if(throttle_bps==0) return true;
+	if(wait)
+	{
+		DLOG(Server->Log("Throttler: Sleeping for " + nconvert(wait_ms)+ "ms", LL_DEBUG));
+		Server->wait(static_cast<unsigned int>(wait_ms));
+	}
 
-	int64 ctime=Server->getTimeMS();
+	return false;
+}
 
-	if(ctime-lastresettime>1000)
+/**
+* Charges the bytes to this throttler and all its parents (from the top down)
+* and returns how long the caller has to wait. child_bps is set to the bandwidth
+* share of child or zero if it is unlimited.
+*/
+int64 PipeThrottler::consume(size_t new_bytes, int64 ctime, PipeThrottler* child, size_t& child_bps)
+{
+	int64 wait_ms=0;
+	size_t parent_bps=0;
+
+	//The parent may be changed concurrently
+	PipeThrottler* curr_parent;
 	{
-		lastresettime=ctime;
-		curr_bytes=0;
+		IScopedLock lock(mutex);
+		curr_parent=parent;
+		if(curr_parent!=NULL)
+		{
+			curr_parent->addRef();
+		}
 	}
 
-	curr_bytes+=new_bytes;
+	if(curr_parent!=NULL)
+	{
+		wait_ms=curr_parent->consume(new_bytes, ctime, this, parent_bps);
+		curr_parent->release();
+	}
+
+	IScopedLock lock(mutex);
+
+	child_bps=0;
 
-	int64 passed_time=ctime-lastresettime;
+	size_t effective_bps=throttle_bps;
+	if(parent_bps>0 && (effective_bps==0 || parent_bps<effective_bps))
+	{
+		effective_bps=parent_bps;
+	}
 
-	size_t maxRateTime=(size_t)(((_i64)curr_bytes*1000)/throttle_bps);
-	if(passed_time>0)
+	if(throttle_bps>0)
 	{
-		size_t bps=(size_t)(((_i64)curr_bytes*1000)/passed_time);
-		if(bps>throttle_bps)
-		{		
-			unsigned int sleepTime=(unsigned int)(maxRateTime-passed_time);
+		refill(tokens, lastrefill, throttle_bps, ctime);
 
-			if(sleepTime>0)
+		//Let the children borrow bandwidth if it is unused (bucket stays full),
+		//give it back if they start waiting on this throttler
+		if(ctime-lastadjust>=c_borrow_adjust_interval)
+		{
+			lastadjust=ctime;
+			if(tokens>static_cast<int64>(throttle_bps/2))
+			{
+				borrow_factor=(std::min)(borrow_factor+borrow_factor/4, c_max_borrow_factor);
+			}
+			else if(tokens<static_cast<int64>(throttle_bps/4))
 			{
-				if(wait)
-				{
-					DLOG(Server->Log("Throttler: Sleeping for " + nconvert(sleepTime)+ "ms", LL_DEBUG));
-					Server->wait(sleepTime);
-
-					if(Server->getTimeMS()-lastresettime>1000)
-					{
-						curr_bytes=0;
-						lastresettime=Server->getTimeMS();
-					}
-				}
-
-				return false;
+				borrow_factor=(std::max)(borrow_factor-borrow_factor/4, c_borrow_unit);
 			}
 		}
+
+		tokens-=new_bytes;
+
+		if(tokens<0)
+		{
+			wait_ms=(std::max)(wait_ms, (-tokens*1000)/static_cast<int64>(throttle_bps));
+		}
+	}
+
+	if(child==NULL || effective_bps==0)
+	{
+		return wait_ms;
+	}
+
+	std::map<PipeThrottler*, SChildShare>::iterator it=children.find(child);
+	if(it==children.end())
+	{
+		return wait_ms;
 	}
-	else if(curr_bytes>=throttle_bps)
+
+	it->second.lastactive=ctime;
+
+	int64 active_weight=0;
+	for(std::map<PipeThrottler*, SChildShare>::iterator it_child=children.begin();it_child!=children.end();++it_child)
 	{
-		if(wait)
+		if(ctime-it_child->second.lastactive<=c_active_window)
 		{
-			DLOG(Server->Log("Throttler: Sleeping for " + nconvert(maxRateTime)+ "ms", LL_DEBUG));
-			Server->wait(static_cast<unsigned int>(maxRateTime));
+			active_weight+=it_child->second.weight;
 		}
-		curr_bytes=0;
-		lastresettime=Server->getTimeMS();
-		return false;
 	}
 
-	return true;
+	int64 factor=throttle_bps>0?borrow_factor:c_borrow_unit;
+	child_bps=static_cast<size_t>((std::max)(static_cast<int64>(effective_bps)*factor/c_borrow_unit*it->second.weight/active_weight, (int64)1));
+
+	refill(it->second.tokens, it->second.lastrefill, child_bps, ctime);
+
+	if(it->second.tokens>static_cast<int64>(child_bps))
+	{
+		it->second.tokens=child_bps;
+	}
+
+	it->second.tokens-=new_bytes;
+
+	if(it->second.tokens<0)
+	{
+		wait_ms=(std::max)(wait_ms, (-it->second.tokens*1000)/static_cast<int64>(child_bps));
+	}
+
+	return wait_ms;
 }
 
 void PipeThrottler::changeThrottleLimit(size_t bps)
@@ -80,4 +245,29 @@ void PipeThrottler::changeThrottleLimit(size_t bps)
 	IScopedLock lock(mutex);
 
 	throttle_bps=bps;
+
+	if(tokens>static_cast<int64>(throttle_bps))
+	{
+		tokens=throttle_bps;
+	}
+}
+
+void PipeThrottler::addChild(PipeThrottler* child, unsigned int weight)
+{
+	IScopedLock lock(mutex);
+
+	SChildShare share;
+	share.weight=(std::max)(weight, 1U);
+	share.lastactive=0;
+	share.tokens=0;
+	share.lastrefill=Server->getTimeMS();
+
+	children[child]=share;
+}
+
+void PipeThrottler::removeChild(PipeThrottler* child)
+{
+	IScopedLock lock(mutex);
+
+	children.erase(child);
 }
\ No newline at end of file
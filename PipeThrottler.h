@@ -1,21 +1,47 @@
 #include "Interface/PipeThrottler.h"
+#include <map>
 
 class IMutex;
 
 class PipeThrottler : public IPipeThrottler
 {
 public:
-	PipeThrottler(size_t bps);
+	PipeThrottler(size_t bps, PipeThrottler* parent, unsigned int weight);
 	~PipeThrottler(void);
 
 	virtual bool addBytes(size_t new_bytes, bool wait);
 
 	virtual void changeThrottleLimit(size_t bps);
 
+	virtual void changeParent(IPipeThrottler* parent, unsigned int weight);
+
+	virtual void Remove(void);
+
 private:
+	struct SChildShare
+	{
+		unsigned int weight;
+		int64 lastactive;
+		int64 tokens;
+		int64 lastrefill;
+	};
+
+	int64 consume(size_t new_bytes, int64 ctime, PipeThrottler* child, size_t& child_bps);
+	void addChild(PipeThrottler* child, unsigned int weight);
+	void removeChild(PipeThrottler* child);
+	void addRef(void);
+	void release(void);
+
 	size_t throttle_bps;
-	size_t curr_bytes;
-	int64 lastresettime;
+	int64 tokens;
+	int64 lastrefill;
+
+	int64 borrow_factor;
+	int64 lastadjust;
+
+	PipeThrottler* parent;
+	std::map<PipeThrottler*, SChildShare> children;
+	size_t refcount;
 
 	IMutex *mutex;
 };
\ No newline at end of file
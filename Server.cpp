@@ -53,6 +53,7 @@
 #include "Database.h"
 #include "SQLiteFactory.h"
 #include "PipeThrottler.h"
+#include "BufferPool.h"
 #include "mt19937ar.h"
 #include "Query.h"
 
@@ -111,6 +112,9 @@ namespace
 extern bool run;
 
 CServer::CServer()
+#ifdef THREAD_BOOST
+	: thread_state(destroyThreadState)
+#endif
 {	
 	curr_thread_id=0;
 	curr_pluginid=0;
@@ -130,6 +134,9 @@ CServer::CServer()
 	outputs_mutex=createMutex();
 	db_mutex=createMutex();
 	thread_mutex=createMutex();
+#ifndef THREAD_BOOST
+	pthread_key_create(&thread_state_key, destroyThreadStateKey);
+#endif
 	plugin_mutex=createMutex();
 	rps_mutex=createMutex();
 	postfiles_mutex=createMutex();
@@ -137,6 +144,7 @@ CServer::CServer()
 	startup_complete_mutex=createMutex();
 	startup_complete_cond=createCondition();
 	rnd_mutex=createMutex();
+	buffer_pool=new CBufferPool(createMutex());
 
 	initRandom(static_cast<unsigned int>(time(0)));
 	initRandom(getSecureRandomNumber());
@@ -188,6 +196,14 @@ void CServer::destroyAllDatabases(void)
 		}
 		i->second.tmap.clear();
 	}
+
+	IScopedLock lock_threads(thread_mutex);
+	for(std::map<THREAD_ID, SThreadLocalState*>::iterator it=thread_states.begin();
+		it!=thread_states.end();++it)
+	{
+		IScopedLock lock_state(it->second->mutex);
+		it->second->databases.clear();
+	}
 }
 
 void CServer::destroyDatabases(THREAD_ID tid)
@@ -204,10 +220,23 @@ void CServer::destroyDatabases(THREAD_ID tid)
 			i->second.tmap.erase(iter);
 		}
 	}
+
+	IScopedLock lock_threads(thread_mutex);
+	std::map<THREAD_ID, SThreadLocalState*>::iterator it=thread_states.find(tid);
+	if(it!=thread_states.end())
+	{
+		IScopedLock lock_state(it->second->mutex);
+		it->second->databases.clear();
+	}
 }
 
 CServer::~CServer()
 {
+#ifdef THREAD_BOOST
+	//Only clean up thread states on thread exit
+	thread_state.release();
+#endif
+
 	if(getServerParameter("leak_check")!="true") //minimal cleanup
 	{
 		return;
@@ -223,6 +252,19 @@ CServer::~CServer()
 		delete stream_services[i];
 	}
 
+#ifndef THREAD_BOOST
+	pthread_key_delete(thread_state_key);
+#endif
+	{
+		IScopedLock lock(thread_mutex);
+		for(std::map<THREAD_ID, SThreadLocalState*>::iterator it=thread_states.begin();
+			it!=thread_states.end();++it)
+		{
+			IScopedLock lock_state(it->second->mutex);
+			it->second->plugins.clear();
+		}
+	}
+
 	Log("deleting plugins...");
 	//delete Plugins
 	for(std::map<PLUGIN_ID, std::pair<IPluginMgr*,str_map> >::iterator iter1=perthread_pluginparams.begin();
@@ -289,6 +331,9 @@ CServer::~CServer()
 
 	Log("unloading dlls...");
 	UnloadDLLs();	
+
+	Log("deleting buffer pool...");
+	delete buffer_pool;
 	
 	Log("Destroying mutexes");
 	
@@ -811,47 +856,100 @@ ITemplate* CServer::createTemplate(std::string pFile)
 
 
 THREAD_ID CServer::getThreadID(void)
+{
+	return getThreadState()->tid;
+}
+
+SThreadLocalState* CServer::getThreadState(void)
 {
 #ifdef THREAD_BOOST
-	IScopedLock lock(thread_mutex);
-	
-	boost::thread::id ct=boost::this_thread::get_id();
-	std::map<boost::thread::id, THREAD_ID>::iterator iter=threads.find(ct);
-	
-	if(iter!=threads.end() )
+	SThreadLocalState* state=thread_state.get();
+#else
+	SThreadLocalState* state=static_cast<SThreadLocalState*>(pthread_getspecific(thread_state_key));
+#endif
+
+	if(state!=NULL)
 	{
-	    return iter->second;
+		return state;
 	}
 
-	++curr_thread_id;
-	if( curr_thread_id>=MAX_THREAD_ID )
-		curr_thread_id=0;
+	state=new SThreadLocalState;
+	state->mutex=createMutex();
+	state->buffer_cache=NULL;
 
-	threads.insert( std::pair<boost::thread::id, THREAD_ID>( ct, curr_thread_id) );
+	{
+		IScopedLock lock(thread_mutex);
+
+		++curr_thread_id;
+		if( curr_thread_id>=MAX_THREAD_ID )
+			curr_thread_id=0;
+
+		state->tid=curr_thread_id;
+		thread_states[state->tid]=state;
+	}
 
-	return curr_thread_id;
+#ifdef THREAD_BOOST
+	thread_state.reset(state);
 #else
-#ifndef _WIN32
-	IScopedLock lock(thread_mutex);
-	
-	pthread_t ct=pthread_self();
-	std::map<pthread_t, THREAD_ID>::iterator iter=threads.find(ct);
-	
-	if(iter!=threads.end() )
+	pthread_setspecific(thread_state_key, state);
+#endif
+
+	return state;
+}
+
+void CServer::cleanupThreadState(SThreadLocalState* state)
+{
+	destroyDatabases(state->tid);
+	destroyThreadPlugins(state->tid);
+
+	if(state->buffer_cache!=NULL)
 	{
-	    return iter->second;
+		buffer_pool->destroyThreadCache(state->buffer_cache);
 	}
 
-	++curr_thread_id;
-	if( curr_thread_id>=MAX_THREAD_ID )
-		curr_thread_id=0;
+	{
+		IScopedLock lock(thread_mutex);
+		thread_states.erase(state->tid);
+	}
 
-	threads.insert( std::pair<pthread_t, THREAD_ID>( ct, curr_thread_id) );
+	destroy(state->mutex);
+	delete state;
+}
 
-	return curr_thread_id;
-#endif
-#endif //THREAD_BOOST
+void CServer::destroyThreadPlugins(THREAD_ID tid)
+{
+	IScopedLock lock(plugin_mutex);
+
+	for(std::map<PLUGIN_ID, std::map<THREAD_ID, IPlugin*> >::iterator iter1=perthread_plugins.begin();
+		iter1!=perthread_plugins.end();++iter1)
+	{
+		std::map<THREAD_ID, IPlugin*>::iterator iter2=iter1->second.find(tid);
+		if(iter2!=iter1->second.end())
+		{
+			std::map<PLUGIN_ID, std::pair<IPluginMgr*,str_map> >::iterator iter3=perthread_pluginparams.find( iter1->first );
+			if(iter3!=perthread_pluginparams.end())
+			{
+				iter3->second.first->destroyPluginInstance(iter2->second);
+			}
+			iter1->second.erase(iter2);
+		}
+	}
+}
+
+void CServer::destroyThreadState(SThreadLocalState* state)
+{
+	if(Server!=NULL)
+	{
+		Server->cleanupThreadState(state);
+	}
+}
+
+#ifndef THREAD_BOOST
+void CServer::destroyThreadStateKey(void* state)
+{
+	destroyThreadState(static_cast<SThreadLocalState*>(state));
 }
+#endif
 
 bool CServer::openDatabase(std::string pFile, DATABASE_ID pIdentifier, std::string pEngine)
 {
@@ -879,6 +977,21 @@ bool CServer::openDatabase(std::string pFile, DATABASE_ID pIdentifier, std::stri
 
 IDatabase* CServer::getDatabase(THREAD_ID tid, DATABASE_ID pIdentifier)
 {
+	SThreadLocalState* state=getThreadState();
+	if(state->tid!=tid)
+	{
+		state=NULL;
+	}
+	else
+	{
+		IScopedLock lock_state(state->mutex);
+		std::map<DATABASE_ID, IDatabaseInt*>::iterator it=state->databases.find(pIdentifier);
+		if(it!=state->databases.end())
+		{
+			return it->second;
+		}
+	}
+
 	IScopedLock lock(db_mutex);
 
 	std::map<DATABASE_ID, SDatabase >::iterator database_iter=databases.find(pIdentifier);
@@ -902,10 +1015,22 @@ IDatabase* CServer::getDatabase(THREAD_ID tid, DATABASE_ID pIdentifier)
 
 		database_iter->second.tmap.insert( std::pair< THREAD_ID, IDatabaseInt* >( tid, db ) );
 
+		if(state!=NULL)
+		{
+			IScopedLock lock_state(state->mutex);
+			state->databases[pIdentifier]=db;
+		}
+
 		return db;
 	}
 	else
 	{
+		if(state!=NULL)
+		{
+			IScopedLock lock_state(state->mutex);
+			state->databases[pIdentifier]=thread_iter->second;
+		}
+
 		return thread_iter->second;
 	}
 }
@@ -1241,12 +1366,36 @@ bool CServer::RestartPlugin(PLUGIN_ID pIdentifier)
 
 IPlugin* CServer::getPlugin(THREAD_ID tid, PLUGIN_ID pIdentifier)
 {
+	SThreadLocalState* state=getThreadState();
+	if(state->tid!=tid)
+	{
+		state=NULL;
+	}
+	else
+	{
+		IScopedLock lock_state(state->mutex);
+		std::map<PLUGIN_ID, std::pair<IPlugin*, bool> >::iterator it=state->plugins.find(pIdentifier);
+		if(it!=state->plugins.end())
+		{
+			if(it->second.second)
+			{
+				it->second.first->Reset();
+			}
+			return it->second.first;
+		}
+	}
+
 	IScopedLock lock(plugin_mutex);
 	{
 		std::map<PLUGIN_ID, IPlugin*>::iterator iter1=threadsafe_plugins.find( pIdentifier );
 		
 		if( iter1!=threadsafe_plugins.end() )
 		{
+			if(state!=NULL)
+			{
+				IScopedLock lock_state(state->mutex);
+				state->plugins[pIdentifier]=std::make_pair(iter1->second, false);
+			}
 			return iter1->second;
 		}
 	}
@@ -1265,11 +1414,21 @@ IPlugin* CServer::getPlugin(THREAD_ID tid, PLUGIN_ID pIdentifier)
 				IPlugin* newplugin=iter1->second.first->createPluginInstance( iter1->second.second);
 				pmap->insert( std::pair<THREAD_ID, IPlugin*>( tid, newplugin) );
 				newplugin->Reset();
+				if(state!=NULL)
+				{
+					IScopedLock lock_state(state->mutex);
+					state->plugins[pIdentifier]=std::make_pair(newplugin, true);
+				}
 				return newplugin;
 			}
 			else
 			{
 				iter2->second->Reset();
+				if(state!=NULL)
+				{
+					IScopedLock lock_state(state->mutex);
+					state->plugins[pIdentifier]=std::make_pair(iter2->second, true);
+				}
 				return iter2->second;
 			}
 		}
@@ -1689,9 +1848,34 @@ void CServer::startupComplete(void)
 	startup_complete_cond->notify_all();
 }
 
-IPipeThrottler* CServer::createPipeThrottler(size_t bps)
+IPipeThrottler* CServer::createPipeThrottler(size_t bps, IPipeThrottler* parent, unsigned int weight)
+{
+	return new PipeThrottler(bps, static_cast<PipeThrottler*>(parent), weight);
+}
+
+char* CServer::allocateBuffer(size_t bsize)
+{
+	SThreadLocalState* state=getThreadState();
+	if(state->buffer_cache==NULL)
+	{
+		state->buffer_cache=buffer_pool->createThreadCache();
+	}
+	return buffer_pool->allocate(bsize, state->buffer_cache);
+}
+
+void CServer::releaseBuffer(char* buf, size_t bsize)
+{
+	SThreadLocalState* state=getThreadState();
+	if(state->buffer_cache==NULL)
+	{
+		state->buffer_cache=buffer_pool->createThreadCache();
+	}
+	buffer_pool->release(buf, bsize, state->buffer_cache);
+}
+
+SBufferPoolStats CServer::getBufferPoolStats(void)
 {
-	return new PipeThrottler(bps);
+	return buffer_pool->getStats();
 }
 
 
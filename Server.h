@@ -3,6 +3,7 @@
 
 #ifdef THREAD_BOOST
 #	include <boost/thread/thread.hpp>
+#	include <boost/thread/tss.hpp>
 #else
 #ifdef _WIN32
 #else
@@ -31,6 +32,8 @@ class CSessionMgr;
 class CServiceAcceptor;
 class CThreadPool;
 class IOutputStream;
+class CBufferPool;
+struct SBufferPoolThreadCache;
 
 struct SDatabase
 {
@@ -41,6 +44,23 @@ struct SDatabase
 	std::vector<std::pair<std::string,std::string> > attach;
 };
 
+/**
+* Per thread state kept in thread local storage. Caches the thread id as
+* well as the database connections and plugins handed out to the thread,
+* so the common Server->getDatabase(Server->getThreadID(), ...) does not
+* have to take the global locks. mutex is only contended if another
+* thread destroys this thread's databases. buffer_cache is only touched
+* by the owning thread.
+*/
+struct SThreadLocalState
+{
+	THREAD_ID tid;
+	IMutex* mutex;
+	std::map<DATABASE_ID, IDatabaseInt*> databases;
+	std::map<PLUGIN_ID, std::pair<IPlugin*, bool> > plugins;
+	SBufferPoolThreadCache* buffer_cache;
+};
+
 
 class CServer : public IServer
 {
@@ -93,7 +113,11 @@ public:
 	virtual ISettingsReader* createDBSettingsReader(THREAD_ID tid, DATABASE_ID pIdentifier, const std::string &pTable, const std::string &pSQL="");
 	virtual ISettingsReader* createDBSettingsReader(IDatabase *db, const std::string &pTable, const std::string &pSQL="");
 	virtual ISettingsReader* createMemorySettingsReader(const std::string &pData);
-	virtual IPipeThrottler* createPipeThrottler(size_t bps);
+	virtual IPipeThrottler* createPipeThrottler(size_t bps, IPipeThrottler* parent=NULL, unsigned int weight=1);
+
+	virtual char* allocateBuffer(size_t bsize);
+	virtual void releaseBuffer(char* buf, size_t bsize);
+	virtual SBufferPoolStats getBufferPoolStats(void);
 
 	virtual bool openDatabase(std::string pFile, DATABASE_ID pIdentifier, std::string pEngine="sqlite");
 	virtual IDatabase* getDatabase(THREAD_ID tid, DATABASE_ID pIdentifier);
@@ -192,6 +216,14 @@ private:
 
 	void rotateLogfile();
 
+	SThreadLocalState* getThreadState(void);
+	void cleanupThreadState(SThreadLocalState* state);
+	void destroyThreadPlugins(THREAD_ID tid);
+	static void destroyThreadState(SThreadLocalState* state);
+#ifndef THREAD_BOOST
+	static void destroyThreadStateKey(void* state);
+#endif
+
 
 	int loglevel;
 	bool logfile_a;
@@ -223,18 +255,18 @@ private:
 
 	THREAD_ID curr_thread_id;
 #ifdef THREAD_BOOST
-	std::map<boost::thread::id, THREAD_ID> threads;
-#else
-#ifdef _WIN32
+	boost::thread_specific_ptr<SThreadLocalState> thread_state;
 #else
-	std::map<pthread_t, THREAD_ID> threads;
-#endif
+	pthread_key_t thread_state_key;
 #endif
+	std::map<THREAD_ID, SThreadLocalState*> thread_states;
 
 	std::map<DATABASE_ID, SDatabase > databases;
 
 	CSessionMgr *sessmgr;
 
+	CBufferPool *buffer_pool;
+
 	std::vector<CServiceAcceptor*> stream_services;
 
 	std::map<PLUGIN_ID, std::map<THREAD_ID, IPlugin*> > perthread_plugins;
@@ -0,0 +1,69 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2014 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "AESGCMDecryption.h"
+#include <algorithm>
+
+namespace
+{
+	void makeNonce(const CryptoPP::SecByteBlock& iv, uint64 counter, byte* nonce)
+	{
+		memcpy(nonce, iv.BytePtr(), aes_gcm_iv_size);
+		for(size_t i=0;i<sizeof(uint64);++i)
+		{
+			nonce[aes_gcm_iv_size-1-i]^=static_cast<byte>(counter>>(8*i));
+		}
+	}
+}
+
+AESGCMDecryption::AESGCMDecryption(const std::string &password, bool hash_password)
+	: counter(0)
+{
+	if(hash_password)
+	{
+		m_sbbKey.resize(CryptoPP::SHA256::DIGESTSIZE);
+		CryptoPP::SHA256().CalculateDigest(m_sbbKey, (byte*)password.c_str(), password.size() );
+	}
+	else
+	{
+		m_sbbKey.resize(password.size());
+		memcpy(m_sbbKey.BytePtr(), password.c_str(), password.size());
+	}
+
+	m_IV.resize(aes_gcm_iv_size);
+	memset(m_IV.BytePtr(), 0, aes_gcm_iv_size);
+
+	dec.SetKeyWithIV(m_sbbKey.begin(), m_sbbKey.size(), m_IV.begin(), m_IV.size());
+}
+
+void AESGCMDecryption::setIV(const std::string &iv)
+{
+	memset(m_IV.BytePtr(), 0, aes_gcm_iv_size);
+	memcpy(m_IV.BytePtr(), iv.c_str(), (std::min)(iv.size(), aes_gcm_iv_size));
+	counter=0;
+}
+
+bool AESGCMDecryption::decrypt(char *data, size_t data_size, const char *aad, size_t aad_size, const char *tag)
+{
+	byte nonce[aes_gcm_iv_size];
+	makeNonce(m_IV, counter, nonce);
+	++counter;
+
+	return dec.DecryptAndVerify((byte*)data, (const byte*)tag, aes_gcm_tag_size, nonce, aes_gcm_iv_size,
+		(const byte*)aad, aad_size, (const byte*)data, data_size);
+}
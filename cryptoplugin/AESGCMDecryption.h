@@ -0,0 +1,21 @@
+#include <string>
+#include "cryptopp_inc.h"
+
+#include "IAESGCMDecryption.h"
+#include "../Interface/Types.h"
+
+class AESGCMDecryption : public IAESGCMDecryption
+{
+public:
+	AESGCMDecryption(const std::string &password, bool hash_password);
+
+	virtual void setIV(const std::string &iv);
+	virtual bool decrypt(char *data, size_t data_size, const char *aad, size_t aad_size, const char *tag);
+
+private:
+	CryptoPP::SecByteBlock m_sbbKey;
+	CryptoPP::SecByteBlock m_IV;
+	uint64 counter;
+
+	CryptoPP::GCM<CryptoPP::AES>::Decryption dec;
+};
\ No newline at end of file
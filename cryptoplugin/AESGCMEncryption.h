@@ -0,0 +1,21 @@
+#include <string>
+#include "cryptopp_inc.h"
+
+#include "IAESGCMEncryption.h"
+#include "../Interface/Types.h"
+
+class AESGCMEncryption : public IAESGCMEncryption
+{
+public:
+	AESGCMEncryption(const std::string &password, bool hash_password);
+
+	virtual std::string getIV(void);
+	virtual void encrypt(char *data, size_t data_size, const char *aad, size_t aad_size, char *tag);
+
+private:
+	CryptoPP::SecByteBlock m_sbbKey;
+	CryptoPP::SecByteBlock m_IV;
+	uint64 counter;
+
+	CryptoPP::GCM<CryptoPP::AES>::Encryption enc;
+};
\ No newline at end of file
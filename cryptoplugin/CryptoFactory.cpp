@@ -23,6 +23,8 @@
 
 #include "AESEncryption.h"
 #include "AESDecryption.h"
+#include "AESGCMEncryption.h"
+#include "AESGCMDecryption.h"
 #include "ZlibCompression.h"
 #include "ZlibDecompression.h"
 
@@ -48,6 +50,16 @@ IAESDecryption* CryptoFactory::createAESDecryptionNoDerivation(const std::string
 	return new AESDecryption(password, false);
 }
 
+IAESGCMEncryption* CryptoFactory::createAESGCMEncryption(const std::string &password)
+{
+	return new AESGCMEncryption(password, true);
+}
+
+IAESGCMDecryption* CryptoFactory::createAESGCMDecryption(const std::string &password)
+{
+	return new AESGCMDecryption(password, true);
+}
+
 bool CryptoFactory::generatePrivatePublicKeyPair(const std::string &keybasename)
 {
 	CryptoPP::AutoSeededRandomPool rnd;
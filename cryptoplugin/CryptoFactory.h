@@ -7,6 +7,8 @@ public:
 	virtual IAESDecryption* createAESDecryption(const std::string &password);
 	virtual IAESEncryption* createAESEncryptionNoDerivation(const std::string &password);
 	virtual IAESDecryption* createAESDecryptionNoDerivation(const std::string &password);
+	virtual IAESGCMEncryption* createAESGCMEncryption(const std::string &password);
+	virtual IAESGCMDecryption* createAESGCMDecryption(const std::string &password);
 	virtual IZlibCompression* createZlibCompression(int compression_level);
 	virtual IZlibDecompression* createZlibDecompression(void);
 	virtual bool generatePrivatePublicKeyPair(const std::string &keybasename);
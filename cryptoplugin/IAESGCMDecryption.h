@@ -0,0 +1,20 @@
+#ifndef IAESGCMDECRYPTION_H
+#define IAESGCMDECRYPTION_H
+
+#include <string>
+
+#include "../Interface/Object.h"
+
+class IAESGCMDecryption : public IObject
+{
+public:
+	virtual void setIV(const std::string &iv)=0;
+
+	/**
+	* Decrypts data in place. Returns false if the tag does not match,
+	* in which case the contents of data are undefined
+	*/
+	virtual bool decrypt(char *data, size_t data_size, const char *aad, size_t aad_size, const char *tag)=0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef IAESGCMENCRYPTION_H
+#define IAESGCMENCRYPTION_H
+
+#include <string>
+
+#include "../Interface/Object.h"
+
+const size_t aes_gcm_iv_size=12;
+const size_t aes_gcm_tag_size=16;
+
+class IAESGCMEncryption : public IObject
+{
+public:
+	/**
+	* Random base nonce. Every encrypt call uses it with the message
+	* counter mixed in, so the peer needs it once before the first message
+	*/
+	virtual std::string getIV(void)=0;
+
+	/**
+	* Encrypts data in place and writes aes_gcm_tag_size bytes
+	* authenticating data and aad to tag
+	*/
+	virtual void encrypt(char *data, size_t data_size, const char *aad, size_t aad_size, char *tag)=0;
+};
+
+#endif
\ No newline at end of file
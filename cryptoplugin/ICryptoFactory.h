@@ -1,6 +1,8 @@
 #include <string>
 #include "IAESEncryption.h"
 #include "IAESDecryption.h"
+#include "IAESGCMEncryption.h"
+#include "IAESGCMDecryption.h"
 #include "IZlibCompression.h"
 #include "IZlibDecompression.h"
 #include "../Interface/Plugin.h"
@@ -12,6 +14,8 @@ public:
 	virtual IAESDecryption* createAESDecryption(const std::string &password)=0;
 	virtual IAESEncryption* createAESEncryptionNoDerivation(const std::string &password)=0;
 	virtual IAESDecryption* createAESDecryptionNoDerivation(const std::string &password)=0;
+	virtual IAESGCMEncryption* createAESGCMEncryption(const std::string &password)=0;
+	virtual IAESGCMDecryption* createAESGCMDecryption(const std::string &password)=0;
 	virtual IZlibCompression* createZlibCompression(int compression_level)=0;
 	virtual IZlibDecompression* createZlibDecompression(void)=0;
 	virtual bool generatePrivatePublicKeyPair(const std::string &name)=0;
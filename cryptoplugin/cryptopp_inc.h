@@ -2,6 +2,7 @@
 #include <aes.h>
 #include <sha.h>
 #include <modes.h>
+#include <gcm.h>
 #include <zlib.h>
 #include <dsa.h>
 #include <osrng.h>
@@ -13,6 +14,7 @@
 #define CRYPTOPP_INCLUDE_AES <CRYPTOPP_INCLUDE_PREFIX/aes.h>
 #define CRYPTOPP_INCLUDE_SHA <CRYPTOPP_INCLUDE_PREFIX/sha.h>
 #define CRYPTOPP_INCLUDE_MODES <CRYPTOPP_INCLUDE_PREFIX/modes.h>
+#define CRYPTOPP_INCLUDE_GCM <CRYPTOPP_INCLUDE_PREFIX/gcm.h>
 #define CRYPTOPP_INCLUDE_ZLIB <CRYPTOPP_INCLUDE_PREFIX/zlib.h>
 #define CRYPTOPP_INCLUDE_DSA <CRYPTOPP_INCLUDE_PREFIX/dsa.h>
 #define CRYPTOPP_INCLUDE_OSRNG <CRYPTOPP_INCLUDE_PREFIX/osrng.h>
@@ -23,6 +25,7 @@
 #include CRYPTOPP_INCLUDE_AES
 #include CRYPTOPP_INCLUDE_SHA
 #include CRYPTOPP_INCLUDE_MODES
+#include CRYPTOPP_INCLUDE_GCM
 #include CRYPTOPP_INCLUDE_ZLIB
 #include CRYPTOPP_INCLUDE_DSA
 #include CRYPTOPP_INCLUDE_OSRNG
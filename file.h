@@ -49,6 +49,15 @@ public:
 	_i64 Size(void);
 	void Close();
 
+#if defined(MODE_LIN) || defined(MODE_WIN)
+	_u32 ReadAt(_i64 spos, char* buffer, _u32 bsize);
+	_u32 WriteAt(_i64 spos, const char* buffer, _u32 bsize);
+#endif
+#ifdef MODE_LIN
+	_u32 ReadAtV(_i64 spos, const SFileSegment* segments, size_t nsegments);
+	_u32 WriteAtV(_i64 spos, const SFileSegment* segments, size_t nsegments);
+#endif
+
 #ifdef _WIN32
 	static void init_mutex();
 	static void destroy_mutex();
@@ -64,7 +73,11 @@ private:
 	HANDLE hfile;
 #endif
 #ifdef MODE_LIN
+	bool isDirectAligned(_i64 spos, const char* buffer, _u32 bsize);
+	void closeDirect(void);
+
 	int fd;
+	int fd_direct;
 #endif
 	std::wstring fn;
 
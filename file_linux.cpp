@@ -38,11 +38,19 @@
 
 #include <errno.h>
 #include <stdint.h>
+#include <limits.h>
+#include <vector>
+#include <algorithm>
 
 #include <sys/fcntl.h>
+#include <sys/uio.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 
 File::File()
-	: fd(-1)
+	: fd(-1), fd_direct(-1)
 {
 
 }
@@ -71,10 +79,13 @@ bool File::Open(std::wstring pfn, int mode)
 	else if( mode==MODE_RW
 		|| mode==MODE_RW_SEQUENTIAL
 		|| mode==MODE_RW_CREATE
-		|| mode==MODE_RW_READNONE )
+		|| mode==MODE_RW_READNONE
+		|| mode==MODE_RW_DIRECT
+		|| mode==MODE_RW_CREATE_DIRECT )
 	{
 		flags=O_RDWR;
-		if( mode==MODE_RW_CREATE )
+		if( mode==MODE_RW_CREATE
+			|| mode==MODE_RW_CREATE_DIRECT )
 		{
 			flags|=O_CREAT;
 		}
@@ -103,6 +114,18 @@ bool File::Open(std::wstring pfn, int mode)
 		posix_fadvise64(fd, 0, 0, POSIX_FADV_DONTNEED);
 	}
 #endif
+
+#ifdef O_DIRECT
+	if( fd!=-1
+		&& (mode==MODE_RW_DIRECT || mode==MODE_RW_CREATE_DIRECT) )
+	{
+		fd_direct=open64(Server->ConvertToUTF8(fn).c_str(), O_RDWR|O_DIRECT|O_LARGEFILE);
+		if(fd_direct==-1)
+		{
+			Server->Log("Opening file with O_DIRECT failed. Using buffered writes. errno="+nconvert(errno), LL_DEBUG);
+		}
+	}
+#endif
 	
 	if( fd!=-1 )
 	{
@@ -176,6 +199,124 @@ _u32 File::Write(const char* buffer, _u32 bsize)
 	return (_u32)w;
 }
 
+_u32 File::ReadAt(_i64 spos, char* buffer, _u32 bsize)
+{
+	ssize_t r=pread(fd, buffer, bsize, spos);
+	if( r<0 )
+		r=0;
+
+	return (_u32)r;
+}
+
+_u32 File::WriteAt(_i64 spos, const char* buffer, _u32 bsize)
+{
+	if(fd_direct!=-1 && isDirectAligned(spos, buffer, bsize))
+	{
+		ssize_t w=pwrite(fd_direct, buffer, bsize, spos);
+		if(w>=0)
+		{
+			return (_u32)w;
+		}
+		if(errno!=EINVAL)
+		{
+			Server->Log("Write failed. errno="+nconvert(errno), LL_DEBUG);
+			return 0;
+		}
+		closeDirect();
+	}
+
+	ssize_t w=pwrite(fd, buffer, bsize, spos);
+	if( w<0 )
+	{
+		Server->Log("Write failed. errno="+nconvert(errno), LL_DEBUG);
+		w=0;
+	}
+	return (_u32)w;
+}
+
+_u32 File::ReadAtV(_i64 spos, const SFileSegment* segments, size_t nsegments)
+{
+	_u32 ret=0;
+	std::vector<struct iovec> iov;
+	while(nsegments>0)
+	{
+		size_t n=(std::min)(nsegments, (size_t)IOV_MAX);
+		iov.resize(n);
+		size_t want=0;
+		for(size_t i=0;i<n;++i)
+		{
+			iov[i].iov_base=segments[i].buffer;
+			iov[i].iov_len=segments[i].bsize;
+			want+=segments[i].bsize;
+		}
+
+		ssize_t r=preadv(fd, &iov[0], (int)n, spos+ret);
+		if( r<=0 )
+			break;
+
+		ret+=(_u32)r;
+		if((size_t)r<want)
+			break;
+
+		segments+=n;
+		nsegments-=n;
+	}
+	return ret;
+}
+
+_u32 File::WriteAtV(_i64 spos, const SFileSegment* segments, size_t nsegments)
+{
+	_u32 ret=0;
+	std::vector<struct iovec> iov;
+	while(nsegments>0)
+	{
+		size_t n=(std::min)(nsegments, (size_t)IOV_MAX);
+		iov.resize(n);
+		size_t want=0;
+		bool aligned=fd_direct!=-1;
+		for(size_t i=0;i<n;++i)
+		{
+			iov[i].iov_base=segments[i].buffer;
+			iov[i].iov_len=segments[i].bsize;
+			want+=segments[i].bsize;
+			if(aligned && !isDirectAligned(spos+ret+want-segments[i].bsize, segments[i].buffer, segments[i].bsize))
+			{
+				aligned=false;
+			}
+		}
+
+		ssize_t w=-1;
+		if(aligned)
+		{
+			w=pwritev(fd_direct, &iov[0], (int)n, spos+ret);
+			if(w<0 && errno==EINVAL)
+			{
+				closeDirect();
+				aligned=false;
+			}
+		}
+
+		if(!aligned)
+		{
+			w=pwritev(fd, &iov[0], (int)n, spos+ret);
+		}
+
+		if( w<0 )
+		{
+			Server->Log("Write failed. errno="+nconvert(errno), LL_DEBUG);
+			break;
+		}
+
+		ret+=(_u32)w;
+		if((size_t)w<want)
+			break;
+
+		segments+=n;
+		nsegments-=n;
+	}
+	return ret;
+}
+
 bool File::Seek(_i64 spos)
 {
 	off64_t ot=lseek64(fd, spos, SEEK_SET);
@@ -199,6 +340,7 @@ _i64 File::Size(void)
 
 void File::Close()
 {
+	closeDirect();
 	if( fd!=-1 )
 	{
 		close( fd );
@@ -206,4 +348,20 @@ void File::Close()
 	}
 }
 
+bool File::isDirectAligned(_i64 spos, const char* buffer, _u32 bsize)
+{
+	return spos%FILE_DIRECT_ALIGNMENT==0
+		&& bsize%FILE_DIRECT_ALIGNMENT==0
+		&& ((uintptr_t)buffer)%FILE_DIRECT_ALIGNMENT==0;
+}
+
+void File::closeDirect(void)
+{
+	if( fd_direct!=-1 )
+	{
+		close( fd_direct );
+		fd_direct=-1;
+	}
+}
+
 #endif
@@ -37,6 +37,14 @@ File::File()
 bool File::Open(std::wstring pfn, int mode)
 {
 	fn=pfn;
+	if(mode==MODE_RW_DIRECT)
+	{
+		mode=MODE_RW;
+	}
+	else if(mode==MODE_RW_CREATE_DIRECT)
+	{
+		mode=MODE_RW_CREATE;
+	}
 	DWORD dwCreationDisposition;
 	DWORD dwDesiredAccess;
 	DWORD dwShareMode=FILE_SHARE_READ;
@@ -234,6 +242,39 @@ _u32 File::Write(const char* buffer, _u32 bsize)
 	return written;
 }
 
+_u32 File::ReadAt(_i64 spos, char* buffer, _u32 bsize)
+{
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = static_cast<DWORD>(spos & 0xFFFFFFFF);
+	overlapped.OffsetHigh = static_cast<DWORD>((spos >> 32) & 0xFFFFFFFF);
+
+	DWORD read;
+	BOOL b=ReadFile(hfile, buffer, bsize, &read, &overlapped);
+	if(b==FALSE)
+	{
+#ifdef _DEBUG
+		int err=GetLastError();
+		Server->Log("Read error: "+nconvert(err));
+#endif
+		return 0;
+	}
+	return (_u32)read;
+}
+
+_u32 File::WriteAt(_i64 spos, const char* buffer, _u32 bsize)
+{
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = static_cast<DWORD>(spos & 0xFFFFFFFF);
+	overlapped.OffsetHigh = static_cast<DWORD>((spos >> 32) & 0xFFFFFFFF);
+
+	DWORD written;
+	if(WriteFile(hfile, buffer, bsize, &written, &overlapped)==FALSE)
+	{
+		return 0;
+	}
+	return written;
+}
+
 bool File::Seek(_i64 spos)
 {
 	LARGE_INTEGER tmp;
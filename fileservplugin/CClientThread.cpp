@@ -646,7 +646,7 @@ bool CClientThread::ProcessPacket(CRData *data)
 					}
 				}
 
-				char *buf=new char[s_bsize];
+				char *buf=Server->allocateBuffer(s_bsize);
 
 				bool has_error=false;
 				
@@ -660,7 +660,7 @@ bool CClientThread::ProcessPacket(CRData *data)
 						{
 							Log("Error: Reading and sending from file failed", LL_DEBUG);
 							CloseHandle(hFile);
-							delete []buf;
+							Server->releaseBuffer(buf, s_bsize);
 							return false;
 						}
 					}
@@ -674,7 +674,7 @@ bool CClientThread::ProcessPacket(CRData *data)
 							{
 								Log("Error: Sending data failed");
 								CloseHandle(hFile);
-								delete []buf;
+								Server->releaseBuffer(buf, s_bsize);
 								return false;
 							}
 							else if(id==ID_GET_FILE_RESUME_HASH)
@@ -688,7 +688,7 @@ bool CClientThread::ProcessPacket(CRData *data)
 						{
 							Log("Error: Reading from file failed", LL_DEBUG);
 							CloseHandle(hFile);
-							delete []buf;
+							Server->releaseBuffer(buf, s_bsize);
 							return false;
 						}
 						
@@ -710,7 +710,7 @@ bool CClientThread::ProcessPacket(CRData *data)
 				}
 				
 				CloseHandle(hFile);
-				delete []buf;
+				Server->releaseBuffer(buf, s_bsize);
 				hFile=INVALID_HANDLE_VALUE;
 #endif
 
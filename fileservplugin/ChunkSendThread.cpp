@@ -11,16 +11,21 @@
 #include "../Interface/Server.h"
 #include "../common/adler32.h"
 
+namespace
+{
+	const size_t c_chunk_buf_size=(c_checkpoint_dist/c_chunk_size)*(c_chunk_size)+c_chunk_padding;
+}
+
 
 ChunkSendThread::ChunkSendThread(CClientThread *parent)
 	: parent(parent), file(NULL), has_error(false)
 {
-	chunk_buf=new char[(c_checkpoint_dist/c_chunk_size)*(c_chunk_size)+c_chunk_padding];
+	chunk_buf=Server->allocateBuffer(c_chunk_buf_size);
 }
 
 ChunkSendThread::~ChunkSendThread(void)
 {
-	delete []chunk_buf;
+	Server->releaseBuffer(chunk_buf, c_chunk_buf_size);
 }
 
 void ChunkSendThread::operator()(void)
@@ -18,54 +18,43 @@
 
 #include "../vld.h"
 #include "bufmgr.h"
+#include "../Interface/Server.h"
 #include "log.h"
 
 CBufMgr::CBufMgr(unsigned int nbuf, unsigned int bsize)
+	: nbuf(nbuf), bsize(bsize+1)
 {
-	for(unsigned int i=0;i<nbuf;++i)
-	{
-		SBuffer buf;
-		buf.buffer=new char[bsize+1];
-		buf.used=false;
-		buffers.push_back( buf );
-	}
-	freebufs=nbuf;
+	used_buffers.reserve(nbuf);
 }
 
 CBufMgr::~CBufMgr(void)
 {
-	for(size_t i=0;i<buffers.size();++i)
+	for(size_t i=0;i<used_buffers.size();++i)
 	{
-		if( buffers[i].used==true )
-		{
-			Log("Warning: Deleting used Buffer!");
-		}
-		delete[] buffers[i].buffer;
+		Log("Warning: Deleting used Buffer!");
+		Server->releaseBuffer(used_buffers[i], bsize);
 	}
 }
 
 char* CBufMgr::getBuffer(void)
 {
-	for(size_t i=0;i<buffers.size();++i)
+	if(used_buffers.size()>=nbuf)
 	{
-		if( buffers[i].used==false )
-		{
-			buffers[i].used=true;
-			--freebufs;
-			return buffers[i].buffer;
-		}
+		return NULL;
 	}
-	return NULL;
+	char* ret=Server->allocateBuffer(bsize);
+	used_buffers.push_back(ret);
+	return ret;
 }
 
 void CBufMgr::releaseBuffer(char* buf)
 {
-	for(size_t i=0;i<buffers.size();++i)
+	for(size_t i=0;i<used_buffers.size();++i)
 	{
-		if( buffers[i].buffer==buf )
+		if( used_buffers[i]==buf )
 		{
-			++freebufs;
-			buffers[i].used=false;
+			used_buffers.erase(used_buffers.begin()+i);
+			Server->releaseBuffer(buf, bsize);
 			return;
 		}		
 	}
@@ -74,5 +63,5 @@ void CBufMgr::releaseBuffer(char* buf)
 
 unsigned int CBufMgr::nfreeBufffer(void)
 {
-	return freebufs;
+	return nbuf-static_cast<unsigned int>(used_buffers.size());
 }
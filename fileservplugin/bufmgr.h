@@ -1,11 +1,7 @@
 #include <vector>
 
-struct SBuffer
-{
-	char* buffer;
-	bool used;
-};
-
+//Non blocking quota of nbuf buffers of bsize bytes. The memory comes
+//from the process wide buffer pool and is returned to it on release
 class CBufMgr
 {
 public:
@@ -18,8 +14,9 @@ public:
 
 private:
 
-	std::vector<SBuffer> buffers;
-	unsigned int freebufs;
+	std::vector<char*> used_buffers;
+	unsigned int nbuf;
+	unsigned int bsize;
 
 };
 
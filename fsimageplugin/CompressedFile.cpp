@@ -91,15 +91,9 @@ bool CompressedFile::hasError()
 
 void CompressedFile::readHeader()
 {	
-	if(!uncompressedFile->Seek(0))
-	{
-		Server->Log("Error while seeking to header", LL_ERROR);
-		error=true;
-		return;
-	}
 	std::string header;
 	header.resize(c_header_size);
-	if(readFromFile(&header[0], c_header_size)!=c_header_size)
+	if(readFromFile(0, &header[0], c_header_size)!=c_header_size)
 	{
 		Server->Log("Error while reading compressed file header", LL_ERROR);
 		error=true;
@@ -129,13 +123,6 @@ void CompressedFile::readHeader()
 
 void CompressedFile::readIndex()
 {
-	if(!uncompressedFile->Seek(index_offset))
-	{
-		Server->Log("Error while seeking to compressed file block index", LL_ERROR);
-		error=true;
-		return;
-	}
-
 	size_t nOffsetItems = filesize/blocksize + ((filesize%blocksize!=0)?1:0);
 
 	if(nOffsetItems==0)
@@ -147,7 +134,7 @@ void CompressedFile::readIndex()
 
 	blockOffsets.resize(nOffsetItems);
 
-	if(readFromFile(reinterpret_cast<char*>(&blockOffsets[0]), static_cast<_u32>(sizeof(__int64)*nOffsetItems))
+	if(readFromFile(index_offset, reinterpret_cast<char*>(&blockOffsets[0]), static_cast<_u32>(sizeof(__int64)*nOffsetItems))
 		!=sizeof(__int64)*nOffsetItems)
 	{
 		Server->Log("Error while reading block offsets", LL_ERROR);
@@ -256,14 +243,8 @@ bool CompressedFile::fillCache( __int64 offset, bool errorMsg)
 
 	const __int64 blockDataOffset = blockOffsets[block];	
 
-	if(!uncompressedFile->Seek(blockDataOffset))
-	{
-		Server->Log("Error while seeking to offset "+nconvert(blockDataOffset)+" to read compressed data", LL_ERROR);
-		return false;
-	}
-
 	char blockheaderBuf[2*sizeof(_u32)];
-	if(readFromFile(blockheaderBuf, sizeof(blockheaderBuf))!=sizeof(blockheaderBuf))
+	if(readFromFile(blockDataOffset, blockheaderBuf, sizeof(blockheaderBuf))!=sizeof(blockheaderBuf))
 	{
 		Server->Log("Error while reading block header", LL_ERROR);
 		return false;
@@ -283,7 +264,7 @@ bool CompressedFile::fillCache( __int64 offset, bool errorMsg)
 			return false;
 		}
 
-		if(readFromFile(buf, compressedSize)!=compressedSize)
+		if(readFromFile(blockDataOffset+sizeof(blockheaderBuf), buf, compressedSize)!=compressedSize)
 		{
 			Server->Log("Error while reading uncompressed data from "+nconvert(blockDataOffset)+" ("+nconvert(compressedSize)+" bytes)", LL_ERROR);
 			return false;
@@ -298,7 +279,7 @@ bool CompressedFile::fillCache( __int64 offset, bool errorMsg)
 			compressedBuffer.resize(compressedSize);
 		}	
 
-		if(readFromFile(&compressedBuffer[0], compressedSize)!=compressedSize)
+		if(readFromFile(blockDataOffset+sizeof(blockheaderBuf), &compressedBuffer[0], compressedSize)!=compressedSize)
 		{
 			Server->Log("Error while reading compressed data from "+nconvert(blockDataOffset)+" ("+nconvert(compressedSize)+" bytes)", LL_ERROR);
 			return false;
@@ -387,12 +368,6 @@ void CompressedFile::evictFromLruCache( const SCacheItem& item )
 		return;
 
 	__int64 blockOffset = uncompressedFile->Size();
-	if(!uncompressedFile->Seek(blockOffset))
-	{
-		error=true;
-		Server->Log("Error while seeking to end of file while before writing compressed data", LL_ERROR);
-		return;
-	}
 
 	mz_ulong compBytes = static_cast<mz_ulong>(compressedBuffer.size());
 	int rc = mz_compress(reinterpret_cast<unsigned char*>(compressedBuffer.data()), &compBytes,
@@ -413,14 +388,14 @@ void CompressedFile::evictFromLruCache( const SCacheItem& item )
 	memcpy(blockheaderBuf, &compBytesEndian, sizeof(compBytesEndian));
 	memcpy(blockheaderBuf+sizeof(compBytesEndian), &modeEndian, sizeof(modeEndian));
 
-	if(writeToFile(blockheaderBuf, sizeof(blockheaderBuf))!=sizeof(blockheaderBuf))
+	if(writeToFile(blockOffset, blockheaderBuf, sizeof(blockheaderBuf))!=sizeof(blockheaderBuf))
 	{
 		error=true;
 		Server->Log("Error while writing blockheader to compressed file", LL_ERROR);
 		return;
 	}
 
-	if(writeToFile(compressedBuffer.data(), static_cast<_u32>(compBytes))!=static_cast<_u32>(compBytes))
+	if(writeToFile(blockOffset+sizeof(blockheaderBuf), compressedBuffer.data(), static_cast<_u32>(compBytes))!=static_cast<_u32>(compBytes))
 	{
 		error=true;
 		Server->Log("Error while writing compressed data to file", LL_ERROR);
@@ -458,9 +433,7 @@ void CompressedFile::writeHeader()
 	_u32 blocksizeEndian = little_endian(blocksize);
 	memcpy(cptr, &blocksize, sizeof(blocksizeEndian));
 
-	uncompressedFile->Seek(0);
-
-	if(writeToFile(header, c_header_size)!=c_header_size)
+	if(writeToFile(0, header, c_header_size)!=c_header_size)
 	{
 		Server->Log("Error writing header to compressed file");
 		error=true;
@@ -470,15 +443,9 @@ void CompressedFile::writeHeader()
 void CompressedFile::writeIndex()
 {
 	index_offset = uncompressedFile->Size();
-	if(!uncompressedFile->Seek(index_offset))
-	{
-		error=true;
-		Server->Log("Error while seeking to end of file while before writing index", LL_ERROR);
-		return;
-	}
 
 	_u32 nOffsetBytes = static_cast<_u32>(sizeof(__int64)*blockOffsets.size());
-	if(writeToFile(reinterpret_cast<char*>(&blockOffsets[0]), nOffsetBytes)!=nOffsetBytes)
+	if(writeToFile(index_offset, reinterpret_cast<char*>(&blockOffsets[0]), nOffsetBytes)!=nOffsetBytes)
 	{
 		error=true;
 		Server->Log("Error while writing compressed file index", LL_ERROR);
@@ -529,12 +496,12 @@ std::wstring CompressedFile::getFilenameW( void )
 	return uncompressedFile->getFilenameW();
 }
 
-_u32 CompressedFile::readFromFile(char* buffer, _u32 bsize)
+_u32 CompressedFile::readFromFile(__int64 offset, char* buffer, _u32 bsize)
 {
 	_u32 read = 0;
 	do 
 	{
-		_u32 rc = uncompressedFile->Read(buffer+read, bsize-read);
+		_u32 rc = uncompressedFile->ReadAt(offset+read, buffer+read, bsize-read);
 		if(rc<=0)
 		{
 			return read;
@@ -545,12 +512,12 @@ _u32 CompressedFile::readFromFile(char* buffer, _u32 bsize)
 	return read;
 }
 
-_u32 CompressedFile::writeToFile(const char* buffer, _u32 bsize)
+_u32 CompressedFile::writeToFile(__int64 offset, const char* buffer, _u32 bsize)
 {
 	_u32 written = 0;
 	do
 	{
-		_u32 w = uncompressedFile->Write(buffer + written, bsize-written);
+		_u32 w = uncompressedFile->WriteAt(offset + written, buffer + written, bsize-written);
 		if(w<=0)
 		{
 			return written;
@@ -39,8 +39,8 @@ private:
 	void writeHeader();
 	void writeIndex();
 
-	_u32 readFromFile(char* buffer, _u32 bsize);
-	_u32 writeToFile(const char* buffer, _u32 bsize);
+	_u32 readFromFile(__int64 offset, char* buffer, _u32 bsize);
+	_u32 writeToFile(__int64 offset, const char* buffer, _u32 bsize);
 
 	__int64 filesize;
 	__int64 index_offset;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../Interface/Types.h"
+#include "../Interface/File.h"
 
 class IVHDFile
 {
@@ -8,6 +9,8 @@ public:
 	virtual bool Seek(_i64 offset)=0;
 	virtual bool Read(char* buffer, size_t bsize, size_t &read)=0;
 	virtual _u32 Write(const char *buffer, _u32 bsize)=0;
+	//Writes the segments back to back at the current position
+	virtual _u32 WriteV(const SFileSegment* segments, size_t nsegments)=0;
 	virtual bool isOpen(void)=0;
 	virtual uint64 getSize(void)=0;
 	virtual uint64 usedSize(void)=0;
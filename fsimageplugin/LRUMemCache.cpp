@@ -1,4 +1,5 @@
 #include "LRUMemCache.h"
+#include "../Interface/Server.h"
 #include <string.h>
 
 
@@ -91,7 +92,7 @@ void LRUMemCache::evict( SCacheItem& item, bool deleteBuffer )
 	}
 	if(deleteBuffer)
 	{
-		delete item.buffer;
+		Server->releaseBuffer(item.buffer, buffersize);
 	}
 }
 
@@ -118,7 +119,7 @@ SCacheItem LRUMemCache::createInt( __int64 offset )
 	}
 	else
 	{
-		newItem.buffer=new char[buffersize];
+		newItem.buffer=Server->allocateBuffer(buffersize);
 	}
 	newItem.offset=offset - offset % buffersize;
 
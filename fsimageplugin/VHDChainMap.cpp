@@ -0,0 +1,405 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2014 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "VHDChainMap.h"
+#include "vhdfile.h"
+#include "../Interface/Server.h"
+#include "../Interface/File.h"
+#include "../stringtools.h"
+#include <memory>
+#include <algorithm>
+#include <memory.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace
+{
+	const char chainMapMagic[] = "URBACKUP VHD CHAIN MAP#1.0";
+	const unsigned int sector_size=512;
+	const size_t c_extent_size=2*sizeof(uint64)+2*sizeof(_u32);
+	const size_t c_extent_io_batch=4096;
+	//Do not merge extents beyond this size, so that len fits into 32bit
+	const _u32 c_max_extent_len=1024*1024*1024;
+}
+
+VHDChainMap::VHDChainMap(VHDFile* top)
+	: dstsize(top->dstsize), ok(false)
+{
+	for(VHDFile* curr=top;curr!=NULL;curr=curr->parent)
+	{
+		chain.push_back(curr);
+	}
+
+	std::wstring fn=top->backing_file->getFilenameW()+L".chainmap";
+
+	if(load(fn))
+	{
+		ok=true;
+		return;
+	}
+
+	Server->Log(L"Building block map of VHD chain \""+top->backing_file->getFilenameW()+L"\" with "+convert(chain.size())+L" images...", LL_INFO);
+
+	int64 starttime=Server->getTimeMS();
+	if(!build())
+	{
+		extents.clear();
+		return;
+	}
+
+	Server->Log("Built VHD chain block map with "+nconvert(extents.size())+" extents in "+nconvert(Server->getTimeMS()-starttime)+" ms", LL_INFO);
+
+	ok=true;
+
+	if(!save(fn))
+	{
+		Server->Log(L"Could not cache VHD chain block map in \""+fn+L"\"", LL_DEBUG);
+	}
+}
+
+bool VHDChainMap::isOk(void)
+{
+	return ok;
+}
+
+size_t VHDChainMap::getNumExtents(void)
+{
+	return extents.size();
+}
+
+bool VHDChainMap::build(void)
+{
+	unsigned int blocksize=chain[0]->blocksize;
+	unsigned int bitmap_size=chain[0]->bitmap_size;
+	for(size_t i=1;i<chain.size();++i)
+	{
+		if(chain[i]->blocksize!=blocksize)
+		{
+			Server->Log("VHD chain has different block sizes. Not using block map.", LL_DEBUG);
+			return false;
+		}
+	}
+
+	unsigned int sectors_per_block=blocksize/sector_size;
+	std::vector<_u32> owner(sectors_per_block);
+	std::vector<uint64> dataoffsets(chain.size());
+	std::vector<unsigned char> bitmap(bitmap_size);
+
+	for(unsigned int block=0;block<chain[0]->batsize;++block)
+	{
+		std::fill(owner.begin(), owner.end(), 0);
+		size_t missing=sectors_per_block;
+
+		for(size_t level=0;level<chain.size() && missing>0;++level)
+		{
+			VHDFile* vhd=chain[level];
+			if(block>=vhd->batsize)
+				continue;
+
+			unsigned int bat_off=big_endian(vhd->bat[block]);
+			if(bat_off==0xFFFFFFFF)
+				continue;
+
+			uint64 dataoffset=(uint64)bat_off*(uint64)sector_size;
+			dataoffsets[level]=dataoffset+bitmap_size;
+
+			if(vhd->file->ReadAt(dataoffset, (char*)&bitmap[0], bitmap_size)!=bitmap_size)
+			{
+				Server->Log(L"Error reading bitmap of \""+vhd->getFilenameW()+L"\" while building block map", LL_ERROR);
+				return false;
+			}
+
+			for(unsigned int s=0;s<sectors_per_block;++s)
+			{
+				if(owner[s]==0
+					&& (bitmap[s/8] & (1<<(7-s%8)))!=0 )
+				{
+					owner[s]=(_u32)level+1;
+					--missing;
+				}
+			}
+		}
+
+		uint64 blockstart=(uint64)block*blocksize;
+		for(unsigned int s=0;s<sectors_per_block;)
+		{
+			if(owner[s]==0)
+			{
+				++s;
+				continue;
+			}
+
+			unsigned int e=s+1;
+			while(e<sectors_per_block && owner[e]==owner[s])
+				++e;
+
+			SExtent ext;
+			ext.offset=blockstart+(uint64)s*sector_size;
+			if(ext.offset>=dstsize)
+				break;
+
+			ext.level=owner[s]-1;
+			ext.len=(e-s)*sector_size;
+			if(ext.offset+ext.len>dstsize)
+				ext.len=(_u32)(dstsize-ext.offset);
+			ext.file_offset=dataoffsets[ext.level]+(uint64)s*sector_size;
+
+			if(!extents.empty())
+			{
+				SExtent& last=extents[extents.size()-1];
+				if(last.level==ext.level
+					&& last.offset+last.len==ext.offset
+					&& last.file_offset+last.len==ext.file_offset
+					&& last.len<c_max_extent_len)
+				{
+					last.len+=ext.len;
+					s=e;
+					continue;
+				}
+			}
+
+			extents.push_back(ext);
+			s=e;
+		}
+	}
+
+	return true;
+}
+
+std::string VHDChainMap::chainSignature(void)
+{
+	std::string ret;
+	uint64 dstsize_le=little_endian(dstsize);
+	ret.append((char*)&dstsize_le, sizeof(dstsize_le));
+	for(size_t i=0;i<chain.size();++i)
+	{
+		ret.append(chain[i]->getUID(), 16);
+		unsigned int timestamp=little_endian(chain[i]->getTimestamp());
+		ret.append((char*)&timestamp, sizeof(timestamp));
+		uint64 size=little_endian((uint64)chain[i]->backing_file->Size());
+		ret.append((char*)&size, sizeof(size));
+	}
+	return ret;
+}
+
+bool VHDChainMap::load(const std::wstring& fn)
+{
+	std::auto_ptr<IFile> f(Server->openFile(fn, MODE_READ));
+	if(f.get()==NULL)
+	{
+		return false;
+	}
+
+	std::string sig=chainSignature();
+	size_t header_size=sizeof(chainMapMagic)+sizeof(_u32)+sig.size()+sizeof(uint64);
+	std::string header=f->Read((_u32)header_size);
+	if(header.size()!=header_size
+		|| memcmp(header.data(), chainMapMagic, sizeof(chainMapMagic))!=0)
+	{
+		return false;
+	}
+
+	_u32 sig_size;
+	memcpy(&sig_size, &header[sizeof(chainMapMagic)], sizeof(sig_size));
+	if(little_endian(sig_size)!=sig.size()
+		|| header.compare(sizeof(chainMapMagic)+sizeof(_u32), sig.size(), sig)!=0)
+	{
+		Server->Log(L"VHD chain changed. Rebuilding block map \""+fn+L"\"", LL_DEBUG);
+		return false;
+	}
+
+	uint64 n_extents;
+	memcpy(&n_extents, &header[header_size-sizeof(uint64)], sizeof(n_extents));
+	n_extents=little_endian(n_extents);
+
+	if((uint64)f->Size()!=header_size+n_extents*c_extent_size)
+	{
+		return false;
+	}
+
+	extents.resize((size_t)n_extents);
+	std::vector<char> buf(c_extent_io_batch*c_extent_size);
+	for(size_t i=0;i<extents.size();)
+	{
+		size_t n=(std::min)(c_extent_io_batch, extents.size()-i);
+		if(f->Read(&buf[0], (_u32)(n*c_extent_size))!=n*c_extent_size)
+		{
+			extents.clear();
+			return false;
+		}
+
+		char* ptr=&buf[0];
+		for(size_t j=0;j<n;++j,++i)
+		{
+			SExtent& ext=extents[i];
+			memcpy(&ext.offset, ptr, sizeof(uint64)); ptr+=sizeof(uint64);
+			memcpy(&ext.file_offset, ptr, sizeof(uint64)); ptr+=sizeof(uint64);
+			memcpy(&ext.len, ptr, sizeof(_u32)); ptr+=sizeof(_u32);
+			memcpy(&ext.level, ptr, sizeof(_u32)); ptr+=sizeof(_u32);
+			ext.offset=little_endian(ext.offset);
+			ext.file_offset=little_endian(ext.file_offset);
+			ext.len=little_endian(ext.len);
+			ext.level=little_endian(ext.level);
+
+			if(ext.level>=chain.size())
+			{
+				extents.clear();
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool VHDChainMap::save(const std::wstring& fn)
+{
+	std::wstring tmp_fn=fn+L"."+convert(Server->getRandomNumber())+L".new";
+	IFile* f=Server->openFile(tmp_fn, MODE_WRITE);
+	if(f==NULL)
+	{
+		return false;
+	}
+
+	std::string sig=chainSignature();
+	std::string header(chainMapMagic, sizeof(chainMapMagic));
+	_u32 sig_size=little_endian((_u32)sig.size());
+	header.append((char*)&sig_size, sizeof(sig_size));
+	header+=sig;
+	uint64 n_extents=little_endian((uint64)extents.size());
+	header.append((char*)&n_extents, sizeof(n_extents));
+
+	bool ret=f->Write(header)==header.size();
+
+	std::vector<char> buf(c_extent_io_batch*c_extent_size);
+	for(size_t i=0;i<extents.size() && ret;)
+	{
+		size_t n=(std::min)(c_extent_io_batch, extents.size()-i);
+		char* ptr=&buf[0];
+		for(size_t j=0;j<n;++j,++i)
+		{
+			const SExtent& ext=extents[i];
+			uint64 offset=little_endian(ext.offset);
+			uint64 file_offset=little_endian(ext.file_offset);
+			_u32 len=little_endian(ext.len);
+			_u32 level=little_endian(ext.level);
+			memcpy(ptr, &offset, sizeof(uint64)); ptr+=sizeof(uint64);
+			memcpy(ptr, &file_offset, sizeof(uint64)); ptr+=sizeof(uint64);
+			memcpy(ptr, &len, sizeof(_u32)); ptr+=sizeof(_u32);
+			memcpy(ptr, &level, sizeof(_u32)); ptr+=sizeof(_u32);
+		}
+		ret=f->Write(&buf[0], (_u32)(n*c_extent_size))==n*c_extent_size;
+	}
+
+	Server->destroy(f);
+
+	if(ret)
+	{
+#ifdef _WIN32
+		ret=MoveFileExW(tmp_fn.c_str(), fn.c_str(), MOVEFILE_REPLACE_EXISTING)==TRUE;
+#else
+		ret=rename(Server->ConvertToUTF8(tmp_fn).c_str(), Server->ConvertToUTF8(fn).c_str())==0;
+#endif
+	}
+
+	if(!ret)
+	{
+		Server->deleteFile(tmp_fn);
+	}
+
+	return ret;
+}
+
+size_t VHDChainMap::findExtent(uint64 offset)
+{
+	//First extent ending after offset
+	size_t lo=0;
+	size_t hi=extents.size();
+	while(lo<hi)
+	{
+		size_t mid=lo+(hi-lo)/2;
+		if(extents[mid].offset+extents[mid].len<=offset)
+		{
+			lo=mid+1;
+		}
+		else
+		{
+			hi=mid;
+		}
+	}
+	return lo;
+}
+
+bool VHDChainMap::hasData(uint64 offset, uint64 len)
+{
+	size_t idx=findExtent(offset);
+	return idx<extents.size() && extents[idx].offset<offset+len;
+}
+
+bool VHDChainMap::Read(uint64 offset, char* buffer, size_t bsize, size_t &read)
+{
+	read=0;
+
+	if(offset>=dstsize)
+	{
+		return false;
+	}
+
+	if(offset+bsize>dstsize)
+	{
+		bsize=(size_t)(dstsize-offset);
+	}
+
+	size_t idx=findExtent(offset);
+	while(read<bsize)
+	{
+		uint64 curr=offset+read;
+
+		if(idx>=extents.size() || extents[idx].offset>=offset+bsize)
+		{
+			memset(&buffer[read], 0, bsize-read);
+			read=bsize;
+			break;
+		}
+
+		const SExtent& ext=extents[idx];
+		if(ext.offset>curr)
+		{
+			size_t zeros=(size_t)(ext.offset-curr);
+			memset(&buffer[read], 0, zeros);
+			read+=zeros;
+			continue;
+		}
+
+		uint64 ext_off=curr-ext.offset;
+		_u32 toread=(_u32)(std::min)((uint64)(ext.len-ext_off), (uint64)(bsize-read));
+		_u32 rc=chain[ext.level]->file->ReadAt(ext.file_offset+ext_off, &buffer[read], toread);
+		read+=rc;
+		if(rc!=toread)
+		{
+			Server->Log(L"Reading from \""+chain[ext.level]->getFilenameW()+L"\" failed", LL_ERROR);
+			return false;
+		}
+		++idx;
+	}
+
+	return true;
+}
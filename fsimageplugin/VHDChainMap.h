@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../Interface/Types.h"
+#include <string>
+#include <vector>
+
+class VHDFile;
+class IFile;
+
+/**
+* Flattened block map of a read-only differencing VHD chain.
+* Maps every allocated sector run of the virtual disk to the chain member
+* and file offset holding its newest data, so reads of deep incremental
+* chains do not have to check the sector bitmaps of every parent.
+* The map is cached in a ".chainmap" file next to the top image and
+* rebuilt if any chain member changed.
+*/
+class VHDChainMap
+{
+public:
+	VHDChainMap(VHDFile* top);
+
+	bool isOk(void);
+
+	bool Read(uint64 offset, char* buffer, size_t bsize, size_t &read);
+
+	bool hasData(uint64 offset, uint64 len);
+
+	size_t getNumExtents(void);
+
+private:
+	struct SExtent
+	{
+		uint64 offset;
+		uint64 file_offset;
+		_u32 len;
+		_u32 level;
+	};
+
+	bool build(void);
+	bool load(const std::wstring& fn);
+	bool save(const std::wstring& fn);
+	std::string chainSignature(void);
+	size_t findExtent(uint64 offset);
+
+	std::vector<VHDFile*> chain;
+	std::vector<SExtent> extents;
+	uint64 dstsize;
+	bool ok;
+};
@@ -21,8 +21,10 @@
 #include "../Interface/Types.h"
 #include "../stringtools.h"
 #include "CompressedFile.h"
+#include "VHDChainMap.h"
 #include <memory.h>
 #include <stdlib.h>
+#include <vector>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -40,7 +42,7 @@ const unsigned int sector_size=512;
 
 VHDFile::VHDFile(const std::wstring &fn, bool pRead_only, uint64 pDstsize, unsigned int pBlocksize, bool fast_mode, bool compress)
 	: dstsize(pDstsize), blocksize(pBlocksize), fast_mode(fast_mode), bitmap_offset(0), bitmap_dirty(false), volume_offset(0), finished(false),
-	file(NULL)
+	file(NULL), chain_map(NULL), chain_map_checked(false)
 {
 	compressed_file=NULL;
 	parent=NULL;
@@ -50,14 +52,14 @@ VHDFile::VHDFile(const std::wstring &fn, bool pRead_only, uint64 pDstsize, unsig
 	bitmap=NULL;
 	currblock=0xFFFFFFFF;
 
-	backing_file=Server->openFile(fn, (read_only?MODE_READ:MODE_RW) );
+	backing_file=Server->openFile(fn, (read_only?MODE_READ:MODE_RW_DIRECT) );
 	bool openedExisting = true;
 
 	if(!backing_file)
 	{
 		if(read_only==false)
 		{
-			backing_file=Server->openFile(fn, MODE_RW_CREATE);
+			backing_file=Server->openFile(fn, MODE_RW_CREATE_DIRECT);
 			openedExisting=false;
 		}
 		if(backing_file==NULL)
@@ -134,7 +136,8 @@ VHDFile::VHDFile(const std::wstring &fn, bool pRead_only, uint64 pDstsize, unsig
 }
 
 VHDFile::VHDFile(const std::wstring &fn, const std::wstring &parent_fn, bool pRead_only, bool fast_mode, bool compress)
-	: fast_mode(fast_mode), bitmap_offset(0), bitmap_dirty(false), volume_offset(0), finished(false), file(NULL)
+	: fast_mode(fast_mode), bitmap_offset(0), bitmap_dirty(false), volume_offset(0), finished(false), file(NULL),
+	chain_map(NULL), chain_map_checked(false)
 {
 	compressed_file=NULL;
 	curr_offset=0;
@@ -145,13 +148,13 @@ VHDFile::VHDFile(const std::wstring &fn, const std::wstring &parent_fn, bool pRe
 	bitmap=NULL;
 	currblock=0xFFFFFFFF;
 
-	backing_file=Server->openFile(fn, (read_only?MODE_READ:MODE_RW) );
+	backing_file=Server->openFile(fn, (read_only?MODE_READ:MODE_RW_DIRECT) );
 	bool openedExisting = true;
 	if(!backing_file)
 	{
 		if(read_only==false)
 		{
-			backing_file=Server->openFile(fn, MODE_RW_CREATE);
+			backing_file=Server->openFile(fn, MODE_RW_CREATE_DIRECT);
 			openedExisting=false;
 		}
 		if(backing_file==NULL)
@@ -238,6 +241,7 @@ VHDFile::~VHDFile()
 	{
 		finish();
 	}
+	delete chain_map;
 	delete file;
 	delete parent;
 }
@@ -664,6 +668,13 @@ bool VHDFile::Read(char* buffer, size_t bsize, size_t &read)
 		return false;
 	}
 
+	if(useChainMap())
+	{
+		bool b=chain_map->Read(curr_offset, buffer, bsize, read);
+		curr_offset+=read;
+		return b;
+	}
+
 	while(true)
 	{
 		unsigned int bat_off=big_endian(bat[block]);
@@ -704,15 +715,13 @@ bool VHDFile::Read(char* buffer, size_t bsize, size_t &read)
 		{
 			switchBitmap(dataoffset);
 
-			file->Seek(dataoffset);
-
 			if(dataoffset+bitmap_size+blockoffset+bsize>(uint64)file->Size() )
 			{
 				Server->Log("Wrong dataoffset: "+nconvert(dataoffset), LL_ERROR);
 				return false;
 			}
 
-			if(file->Read((char*)bitmap, bitmap_size)!=bitmap_size)
+			if(file->ReadAt(dataoffset, (char*)bitmap, bitmap_size)!=bitmap_size)
 			{
 				Server->Log("Error reading bitmap", LL_ERROR);
 				return false;
@@ -720,10 +729,6 @@ bool VHDFile::Read(char* buffer, size_t bsize, size_t &read)
 			currblock=block;
 		}
 
-		bool b=file->Seek(dataoffset+bitmap_size+blockoffset);
-		if(!b)
-			Server->Log("Seeking failed!- 1", LL_ERROR);
-
 		while( blockoffset<blocksize )
 		{
 			size_t wantread=(std::min)((size_t)sector_size, toread);
@@ -746,7 +751,16 @@ bool VHDFile::Read(char* buffer, size_t bsize, size_t &read)
 
 			if( isBitmapSet((unsigned int)blockoffset) )
 			{
-				wantread=(size_t)file->Read(&buffer[read], (_u32)wantread );
+				//Coalesce following allocated sectors into one positional read
+				while(wantread<toread && wantread<remaining
+					&& isBitmapSet((unsigned int)(blockoffset+wantread)) )
+				{
+					size_t next=(std::min)((size_t)sector_size, (std::min)(toread, remaining)-wantread);
+					if(curr_offset+wantread+next>dstsize)
+						break;
+					wantread+=next;
+				}
+				wantread=(size_t)file->ReadAt(dataoffset+bitmap_size+blockoffset, &buffer[read], (_u32)wantread );
 			}
 			else
 			{
@@ -763,7 +777,6 @@ bool VHDFile::Read(char* buffer, size_t bsize, size_t &read)
 				{
 					memset(&buffer[read], 0, wantread );
 				}
-				file->Seek(dataoffset+bitmap_size+blockoffset+wantread);
 			}
 			read+=wantread;
 			curr_offset+=wantread;
@@ -798,6 +811,18 @@ bool VHDFile::Read(char* buffer, size_t bsize, size_t &read)
 
 _u32 VHDFile::Write(const char *buffer, _u32 bsize)
 {
+	SFileSegment segment(const_cast<char*>(buffer), bsize);
+	return WriteV(&segment, 1);
+}
+
+_u32 VHDFile::WriteV(const SFileSegment* segments, size_t nsegments)
+{
+	_u32 bsize=0;
+	for(size_t i=0;i<nsegments;++i)
+	{
+		bsize+=segments[i].bsize;
+	}
+
 	if(read_only)
 	{
 		Server->Log("VHD file is read only", LL_ERROR);
@@ -815,8 +840,13 @@ _u32 VHDFile::Write(const char *buffer, _u32 bsize)
 	size_t blockoffset=curr_offset%blocksize;
 	size_t remaining=blocksize-blockoffset;
 	size_t towrite=bsize;
-	size_t bufferoffset=0;
-	bool firstw=true;
+	size_t seg_idx=0;
+	size_t seg_off=0;
+	std::vector<SFileSegment> block_segments;
+
+	//Uncompressed block data starts on a page boundary, so full block
+	//writes from aligned buffers can bypass the page cache
+	uint64 data_alignment=(compressed_file==NULL && file==backing_file) ? FILE_DIRECT_ALIGNMENT : sector_size;
 
 	while(true)
 	{
@@ -826,7 +856,11 @@ _u32 VHDFile::Write(const char *buffer, _u32 bsize)
 		if(bat_ref==0xFFFFFFFF)
 		{
 			dataoffset=nextblock_offset;
-			nextblock_offset+=blocksize+bitmap_size;
+			if((dataoffset+bitmap_size)%data_alignment!=0)
+			{
+				dataoffset+=data_alignment-(dataoffset+bitmap_size)%data_alignment;
+			}
+			nextblock_offset=dataoffset+blocksize+bitmap_size;
 			nextblock_offset=nextblock_offset+(sector_size-nextblock_offset%sector_size);
 			dwrite_footer=true;
 			new_block=true;
@@ -840,16 +874,12 @@ _u32 VHDFile::Write(const char *buffer, _u32 bsize)
 		{
 			switchBitmap(dataoffset);
 
-			bool b=file->Seek(dataoffset);
-			if(!b)
-				Server->Log("Seeking failed", LL_ERROR);
-
 			if(!new_block)
-				file->Read((char*)bitmap, bitmap_size);
+				file->ReadAt(dataoffset, (char*)bitmap, bitmap_size);
 			else
 			{
 				memset(bitmap, 0, bitmap_size );
-				_u32 rc=file->Write((char*)bitmap, bitmap_size);
+				_u32 rc=file->WriteAt(dataoffset, (char*)bitmap, bitmap_size);
 				if(rc!=bitmap_size)
 				{
 					Server->Log("Writing bitmap failed", LL_ERROR);
@@ -860,56 +890,53 @@ _u32 VHDFile::Write(const char *buffer, _u32 bsize)
 			currblock=block;
 		}
 
-		bool b=file->Seek(dataoffset+bitmap_size+blockoffset);
-		if(!b)
+		size_t wantwrite=(std::min)(towrite, remaining);
+
+		for(size_t sector_off=blockoffset;sector_off<blockoffset+wantwrite;
+			sector_off+=sector_size-sector_off%sector_size)
 		{
-			Server->Log("Seeking in file failed", LL_ERROR);
-			return 0;
+			setBitmapBit((unsigned int)sector_off, true);
 		}
 
-		while( blockoffset<blocksize )
+		block_segments.clear();
+		size_t left=wantwrite;
+		while(left>0)
 		{
-			size_t wantwrite=(std::min)((size_t)sector_size, towrite);
-			if(remaining<wantwrite)
-				wantwrite=remaining;
-			if(firstw && blockoffset%sector_size!=0 && wantwrite>sector_size-blockoffset%sector_size )
-			{
-				wantwrite=sector_size-blockoffset%sector_size;
-				firstw=false;
-			}
-			else
-			{
-				firstw=false;
-			}
-
-			setBitmapBit((unsigned int)blockoffset, true);
-
-			_u32 rc=file->Write(&buffer[bufferoffset], (_u32)wantwrite);
-			if(rc!=wantwrite)
+			if(seg_off==segments[seg_idx].bsize)
 			{
-				Server->Log("Writing to file failed", LL_ERROR);
-				print_last_error();
-				return 0;
+				++seg_idx;
+				seg_off=0;
+				continue;
 			}
+			size_t n=(std::min)(left, (size_t)segments[seg_idx].bsize-seg_off);
+			block_segments.push_back(SFileSegment(segments[seg_idx].buffer+seg_off, (_u32)n));
+			seg_off+=n;
+			left-=n;
+		}
 
-			bufferoffset+=wantwrite;
-			blockoffset+=wantwrite;
-			remaining-=wantwrite;
-			towrite-=wantwrite;
-			if(towrite==0)
-			{
-				break;
-			}
-			if(remaining==0)
-			{
-				break;
-			}
+		_u32 rc;
+		if(block_segments.size()==1)
+		{
+			rc=file->WriteAt(dataoffset+bitmap_size+blockoffset, block_segments[0].buffer, block_segments[0].bsize);
+		}
+		else
+		{
+			rc=file->WriteAtV(dataoffset+bitmap_size+blockoffset, &block_segments[0], block_segments.size());
+		}
+		if(rc!=wantwrite)
+		{
+			Server->Log("Writing to file failed", LL_ERROR);
+			print_last_error();
+			return 0;
 		}
 
+		blockoffset+=wantwrite;
+		remaining-=wantwrite;
+		towrite-=wantwrite;
+
 		if(!fast_mode)
 		{
-			file->Seek(dataoffset);
-			_u32 rc=file->Write((char*)bitmap, bitmap_size);
+			_u32 rc=file->WriteAt(dataoffset, (char*)bitmap, bitmap_size);
 			if(rc!=bitmap_size)
 			{
 				Server->Log("Writing bitmap failed", LL_ERROR);
@@ -955,6 +982,11 @@ bool VHDFile::has_block(void)
 		return false;
 	}
 
+	if(useChainMap())
+	{
+		return chain_map->hasData(curr_offset-curr_offset%sector_size, sector_size);
+	}
+
 	unsigned int bat_off=big_endian(bat[block]);
 	if(bat_off==0xFFFFFFFF)
 	{
@@ -974,15 +1006,13 @@ bool VHDFile::has_block(void)
 	{
 		switchBitmap(dataoffset);
 
-		file->Seek(dataoffset);
-
 		if(dataoffset+bitmap_size+blockoffset>(uint64)file->Size() )
 		{
 			Server->Log("Wrong dataoffset: "+nconvert(dataoffset), LL_ERROR);
 			return false;
 		}
 
-		if(file->Read((char*)bitmap, bitmap_size)!=bitmap_size)
+		if(file->ReadAt(dataoffset, (char*)bitmap, bitmap_size)!=bitmap_size)
 		{
 			Server->Log("Error reading bitmap", LL_ERROR);
 			return false;
@@ -1012,8 +1042,7 @@ void VHDFile::switchBitmap(uint64 new_offset)
 {
 	if(fast_mode && !read_only && bitmap_dirty && bitmap_offset!=0)
 	{
-		file->Seek(bitmap_offset);
-		_u32 rc=file->Write((char*)bitmap, bitmap_size);
+		_u32 rc=file->WriteAt(bitmap_offset, (char*)bitmap, bitmap_size);
 		if(rc!=bitmap_size)
 		{
 			Server->Log("Writing bitmap failed", LL_ERROR);
@@ -1057,6 +1086,11 @@ uint64 VHDFile::usedSize(void)
 
 bool VHDFile::has_sector(void)
 {
+	if(useChainMap())
+	{
+		return chain_map->hasData(curr_offset-curr_offset%blocksize, blocksize);
+	}
+
 	unsigned int block=(unsigned int)(curr_offset/blocksize);
 	unsigned int bat_ref=big_endian(bat[block]);
 	if(bat_ref==0xFFFFFFFF)
@@ -1227,3 +1261,23 @@ bool VHDFile::isCompressed()
 {
 	return compressed_file!=NULL;
 }
+
+bool VHDFile::useChainMap(void)
+{
+	if(!chain_map_checked)
+	{
+		chain_map_checked=true;
+
+		if(read_only && parent!=NULL && is_open)
+		{
+			chain_map=new VHDChainMap(this);
+			if(!chain_map->isOk())
+			{
+				delete chain_map;
+				chain_map=NULL;
+			}
+		}
+	}
+
+	return chain_map!=NULL;
+}
@@ -60,9 +60,11 @@ struct VHDDynamicHeader
 #endif
 
 class CompressedFile;
+class VHDChainMap;
 
 class VHDFile : public IVHDFile, public IFile
 {
+	friend class VHDChainMap;
 public:
 	VHDFile(const std::wstring &fn, bool pRead_only, uint64 pDstsize, unsigned int pBlocksize=2*1024*1024, bool fast_mode=false, bool compress=false);
 	VHDFile(const std::wstring &fn, const std::wstring &parent_fn, bool pRead_only, bool fast_mode=false, bool compress=false);
@@ -72,6 +74,7 @@ public:
 	virtual _u32 Read(char* buffer, _u32 bsize);
 	virtual _u32 Write(const std::string &tw);
 	virtual _u32 Write(const char* buffer, _u32 bsize);
+	virtual _u32 WriteV(const SFileSegment* segments, size_t nsegments);
 	virtual _i64 Size(void);
 	
 	bool Seek(_i64 offset);
@@ -105,6 +108,8 @@ private:
 
 	bool check_if_compressed();
 
+	bool useChainMap(void);
+
 	bool write_header(bool diff);
 	bool write_dynamicheader(char *parent_uid, unsigned int parent_timestamp, std::wstring parentfn);
 	bool write_bat(void);
@@ -166,4 +171,7 @@ private:
 	_i64 volume_offset;
 
 	bool finished;
+
+	VHDChainMap* chain_map;
+	bool chain_map_checked;
 };
\ No newline at end of file
@@ -0,0 +1,324 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2014 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#include "ClientHash.h"
+#include "client.h"
+#include "../Interface/Server.h"
+#include "../Interface/File.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Database.h"
+#include "../Interface/Query.h"
+#include "../Interface/Thread.h"
+#include "../Interface/ThreadPool.h"
+#include "../urbackupcommon/sha2/sha2.h"
+#include "../urbackupcommon/os_functions.h"
+#include "../stringtools.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#if defined(__FreeBSD__)
+#define stat64 stat
+#endif
+
+namespace
+{
+	//Files changed within this time may be changed again without
+	//the modification time changing, so they are not cached
+	const int64 c_racy_time=2;
+
+	//Entries not used for this time belong to files which were removed
+	//from the index. Used entries are refreshed once a day
+	const int64 c_hash_cache_max_unused=7*24*60*60;
+	const int64 c_hash_cache_refresh_interval=24*60*60;
+
+	class HashWorker : public IThread
+	{
+	public:
+		HashWorker(ClientHashPool* pool)
+			: pool(pool)
+		{
+		}
+
+		void operator()(void)
+		{
+			SHashJob* job;
+			while((job=pool->nextJob())!=NULL)
+			{
+				ClientHashPool::hashFile(*job);
+			}
+		}
+
+	private:
+		ClientHashPool* pool;
+	};
+}
+
+bool getFileIdentity(const std::wstring& fn, SFileIdentity& identity)
+{
+#ifdef _WIN32
+	//Shadow copies get a new volume each backup, so there is
+	//no stable identity. The files table caches hashes instead.
+	return false;
+#else
+	struct stat64 f_info;
+	if(stat64(Server->ConvertToUTF8(fn).c_str(), &f_info)!=0)
+	{
+		return false;
+	}
+
+	identity.dev=f_info.st_dev;
+	identity.inode=f_info.st_ino;
+	identity.size=f_info.st_size;
+	identity.mtime=f_info.st_mtime;
+	identity.ctime=f_info.st_ctime;
+
+	int64 ctime=Server->getTimeSeconds();
+	if(identity.mtime>=ctime-c_racy_time
+		|| identity.ctime>=ctime-c_racy_time)
+	{
+		return false;
+	}
+
+	return true;
+#endif
+}
+
+ClientHashCache::ClientHashCache(IDatabase* db)
+	: db(db)
+{
+	q_get_hashes=db->Prepare("SELECT sha512, sha256, last_used FROM filehash_cache WHERE dev=? AND inode=? AND filesize=? AND modifytime=? AND changetime=?", false);
+	q_add_hashes=db->Prepare("INSERT OR REPLACE INTO filehash_cache (dev, inode, filesize, modifytime, changetime, sha512, sha256, last_used) VALUES (?, ?, ?, ?, ?, ?, ?, ?)", false);
+	q_remove_unused=db->Prepare("DELETE FROM filehash_cache WHERE last_used<?", false);
+}
+
+ClientHashCache::~ClientHashCache(void)
+{
+	db->destroyQuery(q_get_hashes);
+	db->destroyQuery(q_add_hashes);
+	db->destroyQuery(q_remove_unused);
+}
+
+bool ClientHashCache::getHashes(const SFileIdentity& identity, std::string& sha512, std::string& sha256, bool& needs_refresh)
+{
+	if(q_get_hashes==NULL)
+		return false;
+
+	q_get_hashes->Bind(identity.dev);
+	q_get_hashes->Bind(identity.inode);
+	q_get_hashes->Bind(identity.size);
+	q_get_hashes->Bind(identity.mtime);
+	q_get_hashes->Bind(identity.ctime);
+	db_nresults res=q_get_hashes->ReadN();
+	q_get_hashes->Reset();
+
+	if(res.empty())
+		return false;
+
+	sha512=res[0]["sha512"];
+	sha256=res[0]["sha256"];
+	needs_refresh=os_atoi64(res[0]["last_used"])<Server->getTimeSeconds()-c_hash_cache_refresh_interval;
+	return true;
+}
+
+void ClientHashCache::addHashes(const SFileIdentity& identity, const std::string& sha512, const std::string& sha256)
+{
+	if(q_add_hashes==NULL)
+		return;
+
+	q_add_hashes->Bind(identity.dev);
+	q_add_hashes->Bind(identity.inode);
+	q_add_hashes->Bind(identity.size);
+	q_add_hashes->Bind(identity.mtime);
+	q_add_hashes->Bind(identity.ctime);
+	q_add_hashes->Bind(sha512.c_str(), static_cast<_u32>(sha512.size()));
+	q_add_hashes->Bind(sha256);
+	q_add_hashes->Bind(Server->getTimeSeconds());
+	q_add_hashes->Write();
+	q_add_hashes->Reset();
+}
+
+void ClientHashCache::removeUnused(void)
+{
+	if(q_remove_unused==NULL)
+		return;
+
+	q_remove_unused->Bind(Server->getTimeSeconds()-c_hash_cache_max_unused);
+	q_remove_unused->Write();
+	q_remove_unused->Reset();
+
+	int removed=db->getLastChanges();
+	if(removed>0)
+	{
+		Server->Log("Removed "+nconvert(removed)+" unused entries from file hash cache", LL_DEBUG);
+	}
+}
+
+ClientHashPool::ClientHashPool(size_t nthreads)
+	: nthreads(nthreads), curr_jobs(NULL), curr_idx(0)
+{
+	mutex=Server->createMutex();
+}
+
+ClientHashPool::~ClientHashPool(void)
+{
+	Server->destroy(mutex);
+}
+
+void ClientHashPool::hashFiles(std::vector<SHashJob*>& jobs)
+{
+	if(jobs.empty())
+	{
+		return;
+	}
+
+	if(nthreads<=1 || jobs.size()==1)
+	{
+		for(size_t i=0;i<jobs.size();++i)
+		{
+			hashFile(*jobs[i]);
+		}
+		return;
+	}
+
+	{
+		IScopedLock lock(mutex);
+		curr_jobs=&jobs;
+		curr_idx=0;
+	}
+
+	//The calling thread hashes as well
+	size_t nworkers=(std::min)(nthreads, jobs.size())-1;
+	std::vector<HashWorker*> workers;
+	std::vector<THREADPOOL_TICKET> tickets;
+	for(size_t i=0;i<nworkers;++i)
+	{
+		workers.push_back(new HashWorker(this));
+		tickets.push_back(Server->getThreadPool()->execute(workers[i]));
+	}
+
+	SHashJob* job;
+	while((job=nextJob())!=NULL)
+	{
+		hashFile(*job);
+	}
+
+	Server->getThreadPool()->waitFor(tickets);
+
+	for(size_t i=0;i<workers.size();++i)
+	{
+		delete workers[i];
+	}
+
+	IScopedLock lock(mutex);
+	curr_jobs=NULL;
+}
+
+SHashJob* ClientHashPool::nextJob(void)
+{
+	IScopedLock lock(mutex);
+	if(curr_jobs==NULL || curr_idx>=curr_jobs->size())
+	{
+		return NULL;
+	}
+	return (*curr_jobs)[curr_idx++];
+}
+
+void ClientHashPool::hashFile(SHashJob& job)
+{
+	if(!job.with_sha512 && !job.with_sha256)
+	{
+		return;
+	}
+
+	Server->Log(L"Calculating hashes for file \""+job.fn+L"\"", LL_DEBUG);
+
+	IFile * f=Server->openFile(os_file_prefix(job.fn), MODE_READ_SEQUENTIAL_BACKUP);
+
+	if(f==NULL)
+	{
+		job.has_identity=false;
+		return;
+	}
+
+	sha512_ctx ctx512;
+	sha256_ctx ctx256;
+	if(job.with_sha512)
+	{
+		sha512_init(&ctx512);
+	}
+	if(job.with_sha256)
+	{
+		sha256_init(&ctx256);
+	}
+
+	char buffer[32768];
+	unsigned int r;
+	while( (r=f->Read(buffer, 32768))>0)
+	{
+		if(job.with_sha512)
+		{
+			sha512_update(&ctx512, reinterpret_cast<const unsigned char*>(buffer), r);
+		}
+		if(job.with_sha256)
+		{
+			sha256_update(&ctx256, reinterpret_cast<const unsigned char*>(buffer), r);
+		}
+
+		if(IdleCheckerThread::getPause())
+		{
+			Server->wait(5000);
+		}
+	}
+
+	Server->destroy(f);
+
+	if(job.with_sha512)
+	{
+		job.sha512.resize(64);
+		sha512_final(&ctx512, reinterpret_cast<unsigned char*>(&job.sha512[0]));
+	}
+
+	if(job.with_sha256)
+	{
+		unsigned char dig[32];
+		sha256_final(&ctx256, dig);
+		job.sha256=bytesToHex(dig, 32);
+	}
+
+	if(job.has_identity)
+	{
+		//Only cache the hashes if the file did not change while hashing
+		SFileIdentity after;
+		if(!getFileIdentity(job.fn, after)
+			|| after.dev!=job.identity.dev
+			|| after.inode!=job.identity.inode
+			|| after.size!=job.identity.size
+			|| after.mtime!=job.identity.mtime
+			|| after.ctime!=job.identity.ctime)
+		{
+			job.has_identity=false;
+		}
+	}
+}
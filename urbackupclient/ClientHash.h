@@ -0,0 +1,90 @@
+#pragma once
+
+#include "../Interface/Types.h"
+#include <string>
+#include <vector>
+
+class IMutex;
+class IDatabase;
+class IQuery;
+
+struct SFileIdentity
+{
+	int64 dev;
+	int64 inode;
+	int64 size;
+	int64 mtime;
+	int64 ctime;
+};
+
+struct SHashJob
+{
+	SHashJob(const std::wstring& fn)
+		: fn(fn), with_sha512(false), with_sha256(false), has_identity(false), cached(false)
+	{
+	}
+
+	std::wstring fn;
+	bool with_sha512;
+	bool with_sha256;
+
+	//Binary
+	std::string sha512;
+	//Hex
+	std::string sha256;
+
+	bool has_identity;
+	SFileIdentity identity;
+	bool cached;
+};
+
+bool getFileIdentity(const std::wstring& fn, SFileIdentity& identity);
+
+/**
+* Hashes of files keyed by (device, inode). Entries are only valid if
+* size, modification and change time still match. Entries of files which
+* were removed from the index are not used any more and are removed by
+* removeUnused() after a week.
+*/
+class ClientHashCache
+{
+public:
+	ClientHashCache(IDatabase* db);
+	~ClientHashCache(void);
+
+	//needs_refresh is set if the entry should be added again, so it is not removed as unused
+	bool getHashes(const SFileIdentity& identity, std::string& sha512, std::string& sha256, bool& needs_refresh);
+	void addHashes(const SFileIdentity& identity, const std::string& sha512, const std::string& sha256);
+	void removeUnused(void);
+
+private:
+	IDatabase* db;
+	IQuery* q_get_hashes;
+	IQuery* q_add_hashes;
+	IQuery* q_remove_unused;
+};
+
+/**
+* Hashes files using several threads. Hashing throughput on file servers
+* is mostly limited by the latency of single reads, so more than one
+* outstanding read helps even on spinning disks.
+*/
+class ClientHashPool
+{
+public:
+	ClientHashPool(size_t nthreads);
+	~ClientHashPool(void);
+
+	void hashFiles(std::vector<SHashJob*>& jobs);
+
+	static void hashFile(SHashJob& job);
+
+	SHashJob* nextJob(void);
+
+private:
+	size_t nthreads;
+
+	IMutex *mutex;
+	std::vector<SHashJob*>* curr_jobs;
+	size_t curr_idx;
+};
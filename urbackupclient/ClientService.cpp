@@ -1722,9 +1722,68 @@ void ClientConnector::removeChannelpipe(IPipe *cp)
 	channel_exit.push_back(cp);
 }
 
+IFile* ClientConnector::receiveRestoreHashes(int64 hashsize)
+{
+	IFile* ret=Server->openTemporaryFile();
+	if(ret==NULL)
+	{
+		return NULL;
+	}
+
+	int64 received=0;
+	while(received<hashsize)
+	{
+		size_t packetsize;
+		char *pck=tcpstack.getPacket(&packetsize);
+		if(pck!=NULL)
+		{
+			bool ok = packetsize>0 && ret->Write(pck, (_u32)packetsize)==packetsize;
+			delete [] pck;
+			if(!ok)
+			{
+				break;
+			}
+			received+=packetsize;
+			continue;
+		}
+
+		std::string data;
+		if(pipe->Read(&data, 60000)==0)
+		{
+			break;
+		}
+		tcpstack.AddData(&data[0], data.size());
+	}
+
+	if(received!=hashsize)
+	{
+		std::wstring tmpfn=ret->getFilenameW();
+		Server->destroy(ret);
+		Server->deleteFile(tmpfn);
+		return NULL;
+	}
+
+	return ret;
+}
+
 void ClientConnector::downloadImage(str_map params)
 {
 	_i64 imgsize=-1;
+
+	IFile* restore_hashes=NULL;
+	ScopedDeleteFile restore_hashes_delete(NULL);
+	if(params.find(L"delta_hashsize")!=params.end())
+	{
+		restore_hashes=receiveRestoreHashes(watoi64(params[L"delta_hashsize"]));
+		if(restore_hashes==NULL)
+		{
+			Server->Log("Error receiving block hashes for delta restore", LL_ERROR);
+			pipe->Write((char*)&imgsize, sizeof(_i64), (int)receive_timeouttime);
+			return;
+		}
+		restore_hashes_delete.reset(restore_hashes);
+	}
+
 	if(channel_pipes.size()==0)
 	{
 		imgsize=-2;
@@ -1747,7 +1806,23 @@ void ClientConnector::downloadImage(str_map params)
 		{
 			offset="&offset="+wnarrow(params[L"offset"]);
 		}
-		tcpstack.Send(c, "DOWNLOAD IMAGE img_id="+wnarrow(params[L"img_id"])+"&time="+wnarrow(params[L"time"])+"&mbr="+wnarrow(params[L"mbr"])+offset);
+		std::string delta;
+		if(restore_hashes!=NULL && channel_pipes[i].restore_delta)
+		{
+			delta="&delta_hashsize="+nconvert(restore_hashes->Size());
+		}
+		tcpstack.Send(c, "DOWNLOAD IMAGE img_id="+wnarrow(params[L"img_id"])+"&time="+wnarrow(params[L"time"])+"&mbr="+wnarrow(params[L"mbr"])+offset+delta);
+
+		if(!delta.empty())
+		{
+			std::vector<char> hashbuf(32*1024);
+			restore_hashes->Seek(0);
+			_u32 read;
+			while((read=restore_hashes->Read(&hashbuf[0], (_u32)hashbuf.size()))>0)
+			{
+				tcpstack.Send(c, &hashbuf[0], read);
+			}
+		}
 
 		Server->Log("Downloading from channel "+nconvert((int)i), LL_DEBUG);
 
@@ -1772,9 +1847,10 @@ void ClientConnector::downloadImage(str_map params)
 			return;
 		}
 
-		const size_t c_buffer_size=32768;
+		const size_t c_buffer_size=512*1024;
 		const unsigned int c_blocksize=4096;
-		char buf[c_buffer_size];
+		std::vector<char> relay_buf(c_buffer_size);
+		char* buf=&relay_buf[0];
 		_i64 read=0;
 
 		if(params[L"mbr"]==L"true")
@@ -61,14 +61,15 @@ struct ImageInformation
 
 struct SChannel
 {
-	SChannel(IPipe *pipe, bool internet_connection, std::string endpoint_name)
-		: pipe(pipe), internet_connection(internet_connection), endpoint_name(endpoint_name) {}
+	SChannel(IPipe *pipe, bool internet_connection, std::string endpoint_name, bool restore_delta)
+		: pipe(pipe), internet_connection(internet_connection), endpoint_name(endpoint_name), restore_delta(restore_delta) {}
 	SChannel(void)
-		: pipe(NULL), internet_connection(false) {}
+		: pipe(NULL), internet_connection(false), restore_delta(false) {}
 
 	IPipe *pipe;
 	bool internet_connection;
 	std::string endpoint_name;
+	bool restore_delta;
 };
 
 struct SVolumesCache;
@@ -119,6 +120,7 @@ private:
 	bool sendMBR(std::wstring dl, std::wstring &errmsg);
 	std::string receivePacket(IPipe *p);
 	void downloadImage(str_map params);
+	IFile* receiveRestoreHashes(int64 hashsize);
 	void removeChannelpipe(IPipe *cp);
 	void waitForPings(IScopedLock *lock);
 	bool writeUpdateFile(IFile *datafile, std::string outfn);
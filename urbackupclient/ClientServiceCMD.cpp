@@ -192,6 +192,7 @@ void ClientConnector::CMD_START_INCR_FILEBACKUP(const std::string &cmd)
 	}
 
 	std::wstring resume = params[L"resume"];
+	std::string filelist_base = Server->ConvertToUTF8(params[L"filelist_base"]);
 
 	state=CCSTATE_START_FILEBACKUP;
 
@@ -203,6 +204,7 @@ void ClientConnector::CMD_START_INCR_FILEBACKUP(const std::string &cmd)
 	data.addString(server_token);
 	data.addInt(end_to_end_file_backup_verification_enabled?1:0);
 	data.addInt(calculateFilehashesOnClient()?1:0);
+	data.addString(filelist_base);
 	IndexThread::getMsgPipe()->Write(data.getDataPtr(), data.getDataSize());
 	mempipe_owner=false;
 
@@ -644,22 +646,26 @@ void ClientConnector::CMD_CHANNEL(const std::string &cmd, IScopedLock *g_lock)
 	if(!img_download_running)
 	{
 		g_lock->relock(backup_mutex);
-		channel_pipe=SChannel(pipe, internet_conn, endpoint_name);
-		channel_pipes.push_back(SChannel(pipe, internet_conn, endpoint_name));
-		is_channel=true;
-		state=CCSTATE_CHANNEL;
-		last_channel_ping=Server->getTimeMS();
-		lasttime=Server->getTimeMS();
-		Server->Log("New channel: Number of Channels: "+nconvert((int)channel_pipes.size()), LL_DEBUG);
 
 		int capa=0;
+		bool restore_delta=false;
 		if(cmd.find("1CHANNEL ")==0)
 		{
 			std::string s_params=cmd.substr(9);
 			str_map params;
 			ParseParamStrHttp(s_params, &params);
 			capa=watoi(params[L"capa"]);
+			restore_delta=params[L"restore_delta"]==L"1";
 		}
+
+		channel_pipe=SChannel(pipe, internet_conn, endpoint_name, restore_delta);
+		channel_pipes.push_back(SChannel(pipe, internet_conn, endpoint_name, restore_delta));
+		is_channel=true;
+		state=CCSTATE_CHANNEL;
+		last_channel_ping=Server->getTimeMS();
+		lasttime=Server->getTimeMS();
+		Server->Log("New channel: Number of Channels: "+nconvert((int)channel_pipes.size()), LL_DEBUG);
+
 		channel_capa.push_back(capa);
 	}
 }
@@ -1318,12 +1324,13 @@ void ClientConnector::CMD_CAPA(const std::string &cmd)
 
 	tcpstack.Send(pipe, "FILE=2&FILE2=1&IMAGE=1&UPDATE=1&MBR=1&FILESRV=3&SET_SETTINGS=1&IMAGE_VER=1&CLIENTUPDATE=1"
 		"&CLIENT_VERSION_STR="+EscapeParamString(Server->ConvertToUTF8(client_version_str))+"&OS_VERSION_STR="+EscapeParamString(os_version_str)+
-		"&ALL_VOLUMES="+EscapeParamString(win_volumes)+"&ETA=1&ALL_NONUSB_VOLUMES="+EscapeParamString(win_nonusb_volumes));
+		"&ALL_VOLUMES="+EscapeParamString(win_volumes)+"&ETA=1&ALL_NONUSB_VOLUMES="+EscapeParamString(win_nonusb_volumes)+
+		"&FILELIST_DELTA=1");
 #else
 	std::string os_version_str=get_lin_os_version();
 	tcpstack.Send(pipe, "FILE=2&FILE2=1&FILESRV=3&SET_SETTINGS=1&CLIENTUPDATE=1"
 		"&CLIENT_VERSION_STR="+EscapeParamString(Server->ConvertToUTF8(client_version_str))+"&OS_VERSION_STR="+EscapeParamString(os_version_str)
-		+"&ETA=1");
+		+"&ETA=1&FILELIST_DELTA=1");
 #endif
 }
 
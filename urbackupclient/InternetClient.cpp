@@ -621,10 +621,18 @@ void InternetClientThread::operator()(void)
 		data.addChar(ID_ISC_CAPA);
 
 		if(server_settings.internet_encrypt )
+		{
 			capa|=IPC_ENCRYPTED;
+			if(server_capa & IPC_ENCRYPTED_AEAD)
+				capa|=IPC_ENCRYPTED_AEAD;
+		}
 
 		if(server_settings.internet_compress && server_capa & IPC_COMPRESSED )
+		{
 			capa|=IPC_COMPRESSED;
+			if(server_capa & IPC_COMPRESSED_STREAM)
+				capa|=IPC_COMPRESSED_STREAM;
+		}
 
 		data.addUInt(capa);
 
@@ -635,12 +643,16 @@ void InternetClientThread::operator()(void)
 	
 	if( capa & IPC_ENCRYPTED )
 	{
+		if( capa & IPC_ENCRYPTED_AEAD )
+		{
+			ics_pipe.enableAEAD(true);
+		}
 		ics_pipe.setBackendPipe(comm_pipe);
 		comm_pipe=&ics_pipe;
 	}
 	if( capa & IPC_COMPRESSED )
 	{
-		comp_pipe=new CompressedPipe(comm_pipe, compression_level);
+		comp_pipe=new CompressedPipe(comm_pipe, compression_level, (capa & IPC_COMPRESSED_STREAM)!=0);
 		comm_pipe=comp_pipe;
 	}
 
@@ -30,7 +30,7 @@
 #include "database.h"
 #include "ServerIdentityMgr.h"
 #include "ClientService.h"
-#include "../urbackupcommon/sha2/sha2.h"
+#include "../urbackupcommon/filelist_delta.h"
 #include <algorithm>
 #include <fstream>
 #include <stdlib.h>
@@ -68,6 +68,7 @@ const size_t max_modify_file_buffer_size=500*1024;
 const size_t max_add_file_buffer_size=500*1024;
 const int64 save_filehash_limit=20*4096;
 const int64 file_buffer_commit_interval=120*1000;
+const size_t max_hash_cache_buffer_size=1000;
 
 #ifndef SERVER_ONLY
 #define ENABLE_VSS
@@ -174,6 +175,10 @@ IndexThread::IndexThread(void)
 	calculate_filehashes_on_client=0;
 	last_tmp_update_time=0;
 	last_file_buffer_commit_time=0;
+
+	hash_cache=NULL;
+	size_t hash_threads=static_cast<size_t>(atoi(Server->getServerParameter("hash_threads", "4").c_str()));
+	hash_pool=new ClientHashPool((std::max)(hash_threads, (size_t)1));
 }
 
 IndexThread::~IndexThread()
@@ -195,6 +200,8 @@ IndexThread::~IndexThread()
 	Server->destroy(filesrv_mutex);
 	cd->destroyQueries();
 	delete cd;
+	delete hash_cache;
+	delete hash_pool;
 }
 
 IMutex* IndexThread::getFilelistMutex(void)
@@ -260,6 +267,7 @@ void IndexThread::operator()(void)
 	db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_CLIENT);
 
 	cd=new ClientDAO(Server->getDatabase(Server->getThreadID(), URBACKUPDB_CLIENT));
+	hash_cache=new ClientHashCache(db);
 
 #ifdef _WIN32
 #ifdef ENABLE_VSS
@@ -300,6 +308,8 @@ void IndexThread::operator()(void)
 			data.getStr(&starttoken);
 			data.getInt(&end_to_end_file_backup_verification_enabled);
 			data.getInt(&calculate_filehashes_on_client);
+			std::string filelist_base;
+			data.getStr(&filelist_base);
 
 			//incr backup
 			readBackupDirs();
@@ -365,6 +375,7 @@ void IndexThread::operator()(void)
 				}
 				else
 				{
+					createFilelistDelta(filelist_base);
 					contractor->Write("done");
 				}
 			}
@@ -412,6 +423,7 @@ void IndexThread::operator()(void)
 			}
 			else
 			{
+				createFilelistDelta(std::string());
 				contractor->Write("done");
 			}
 		}
@@ -775,6 +787,7 @@ void IndexThread::indexDirs(void)
 
 			commitModifyFilesBuffer();
 			commitAddFilesBuffer();
+			commitHashCacheBuffer();
 
 			if(stop_index || index_error)
 			{
@@ -813,6 +826,10 @@ void IndexThread::indexDirs(void)
 
 	commitModifyFilesBuffer();
 	commitAddFilesBuffer();
+	commitHashCacheBuffer();
+
+	//All directories were indexed, so every entry still in use was refreshed
+	hash_cache->removeUnused();
 
 #ifdef _WIN32
 	if(!has_stale_shadowcopy)
@@ -860,6 +877,92 @@ void IndexThread::indexDirs(void)
 	hardlinked_changed_files.clear();
 }
 
+void IndexThread::createFilelistDelta(const std::string& filelist_base)
+{
+	const std::wstring bases_dir=L"urbackup/data/filelist_bases";
+	const size_t max_bases=3;
+
+	removeFile(L"urbackup/data/filelist_delta.ub");
+
+	if(!os_directory_exists(bases_dir) && !os_create_dir(bases_dir))
+	{
+		Server->Log(L"Error creating directory \""+bases_dir+L"\" for file list delta bases", LL_WARNING);
+		return;
+	}
+
+	std::auto_ptr<IFile> filelist(Server->openFile("urbackup/data/filelist.ub", MODE_READ));
+	if(filelist.get()==NULL)
+	{
+		return;
+	}
+
+	std::string new_hash;
+	if(!filelist_base.empty() && IsHex(filelist_base))
+	{
+		std::auto_ptr<IFile> base(Server->openFile(bases_dir+os_file_sep()+widen(filelist_base)+L".ub", MODE_READ));
+		if(base.get()!=NULL)
+		{
+			std::auto_ptr<IFile> delta(Server->openFile("urbackup/data/filelist_delta_new.ub", MODE_WRITE));
+			if(delta.get()!=NULL
+				&& create_filelist_delta(base.get(), filelist.get(), delta.get(), &new_hash))
+			{
+				Server->Log("File list delta has "+PrettyPrintBytes(delta->Size())+" (file list "+PrettyPrintBytes(filelist->Size())+")", LL_DEBUG);
+				delta.reset();
+				moveFile(L"urbackup/data/filelist_delta_new.ub", L"urbackup/data/filelist_delta.ub");
+			}
+			else
+			{
+				Server->Log("Error creating file list delta. Server will load the full file list.", LL_WARNING);
+				new_hash.clear();
+				delta.reset();
+				removeFile(L"urbackup/data/filelist_delta_new.ub");
+			}
+		}
+		else
+		{
+			Server->Log("File list delta base "+filelist_base+" not found. Server will load the full file list.", LL_INFO);
+		}
+	}
+
+	if(new_hash.empty())
+	{
+		new_hash=filelist_hash(filelist.get());
+	}
+
+	filelist.reset();
+
+	if(new_hash.empty())
+	{
+		return;
+	}
+
+	//The list is replaced by moving a new file over it, so a hard link keeps this version
+	std::wstring new_base=bases_dir+os_file_sep()+widen(new_hash)+L".ub";
+	if(!FileExists(Server->ConvertToUTF8(new_base))
+		&& !os_create_hardlink(new_base, L"urbackup/data/filelist.ub", false, NULL))
+	{
+		Server->Log(L"Error creating hard link \""+new_base+L"\" to file list", LL_WARNING);
+	}
+
+	std::vector<SFile> bases=getFiles(bases_dir);
+	std::vector<std::pair<int64, std::wstring> > old_bases;
+	for(size_t i=0;i<bases.size();++i)
+	{
+		if(!bases[i].isdir
+			&& bases[i].name!=widen(new_hash)+L".ub"
+			&& bases[i].name!=widen(filelist_base)+L".ub")
+		{
+			old_bases.push_back(std::make_pair(bases[i].last_modified, bases[i].name));
+		}
+	}
+
+	std::sort(old_bases.rbegin(), old_bases.rend());
+	for(size_t i=max_bases;i<old_bases.size();++i)
+	{
+		removeFile(bases_dir+os_file_sep()+old_bases[i].second);
+	}
+}
+
 void IndexThread::resetFileEntries(void)
 {
 	db->Write("DELETE FROM files");
@@ -934,11 +1037,40 @@ bool IndexThread::initialCheck(const std::wstring &orig_dir, const std::wstring
 		return false;
 	}
 	
+	std::vector<char> skip_files(files.size(), 0);
+	std::vector<SHashJob> sha256_jobs;
 	for(size_t i=0;i<files.size();++i)
 	{
 		if( !files[i].isdir )
 		{
 			if( skipFile(orig_dir+os_file_sep()+files[i].name, named_path+os_file_sep()+files[i].name) )
+			{
+				skip_files[i]=1;
+			}
+			else if(end_to_end_file_backup_verification_enabled)
+			{
+				sha256_jobs.push_back(SHashJob(dir+os_file_sep()+files[i].name));
+				sha256_jobs.back().with_sha256=true;
+			}
+		}
+	}
+
+	if(!sha256_jobs.empty())
+	{
+		std::vector<SHashJob*> jobs;
+		for(size_t i=0;i<sha256_jobs.size();++i)
+		{
+			jobs.push_back(&sha256_jobs[i]);
+		}
+		hashFiles(jobs);
+	}
+
+	size_t sha256_idx=0;
+	for(size_t i=0;i<files.size();++i)
+	{
+		if( !files[i].isdir )
+		{
+			if( skip_files[i] )
 			{
 				continue;
 			}
@@ -958,7 +1090,7 @@ bool IndexThread::initialCheck(const std::wstring &orig_dir, const std::wstring
 				{
 					if(calculate_filehashes_on_client) outfile << "&";
 
-					outfile << "sha256=" << getSHA256(dir+os_file_sep()+files[i].name);
+					outfile << "sha256=" << sha256_jobs[sha256_idx++].sha256;
 				}
 			}
 			
@@ -1047,7 +1179,7 @@ namespace
 
 bool IndexThread::addMissingHashes(std::vector<SFileAndHash>* dbfiles, std::vector<SFileAndHash>* fsfiles, const std::wstring &orig_path, const std::wstring& filepath, const std::wstring& namedpath)
 {
-	bool calculated_hash=false;
+	std::vector<SFileAndHash*> hash_files;
 
 	if(fsfiles!=NULL)
 	{
@@ -1083,8 +1215,7 @@ bool IndexThread::addMissingHashes(std::vector<SFileAndHash>* dbfiles, std::vect
 
 			if(needs_hashing)
 			{
-				fsfile.hash=getSHA512Binary(filepath+os_file_sep()+fsfile.name);
-				calculated_hash=true;
+				hash_files.push_back(&fsfile);
 			}
 		}
 	}
@@ -1102,12 +1233,137 @@ bool IndexThread::addMissingHashes(std::vector<SFileAndHash>* dbfiles, std::vect
 			if(skipFile(orig_path+os_file_sep()+dbfile.name, namedpath+os_file_sep()+dbfile.name))
 				continue;
 
-			dbfile.hash=getSHA512Binary(filepath+os_file_sep()+dbfile.name);
-			calculated_hash=true;
+			hash_files.push_back(&dbfile);
+		}
+	}
+
+	if(hash_files.empty())
+	{
+		return false;
+	}
+
+	std::vector<SHashJob> hash_jobs;
+	hash_jobs.reserve(hash_files.size());
+	std::vector<SHashJob*> jobs;
+	for(size_t i=0;i<hash_files.size();++i)
+	{
+		hash_jobs.push_back(SHashJob(filepath+os_file_sep()+hash_files[i]->name));
+		hash_jobs[i].with_sha512=true;
+#ifndef _WIN32
+		//Read the file only once. initialCheck gets the SHA256 from the hash cache
+		hash_jobs[i].with_sha256=end_to_end_file_backup_verification_enabled!=0;
+#endif
+		jobs.push_back(&hash_jobs[i]);
+	}
+
+	hashFiles(jobs);
+
+	for(size_t i=0;i<hash_files.size();++i)
+	{
+		hash_files[i]->hash=hash_jobs[i].sha512;
+	}
+
+	return true;
+}
+
+void IndexThread::hashFiles(std::vector<SHashJob*>& jobs)
+{
+	std::vector<SHashJob*> hash_jobs;
+	std::vector<SHashJob*> refresh_jobs;
+	for(size_t i=0;i<jobs.size();++i)
+	{
+		SHashJob& job=*jobs[i];
+		job.has_identity=getFileIdentity(job.fn, job.identity);
+
+		std::string sha512;
+		std::string sha256;
+		bool needs_refresh=false;
+		if(job.has_identity
+			&& getFileHashCache(job.identity, sha512, sha256, needs_refresh))
+		{
+			bool has_sha512=sha512.size()==64;
+			bool has_sha256=!sha256.empty();
+			if( (!job.with_sha512 || has_sha512)
+				&& (!job.with_sha256 || has_sha256) )
+			{
+				job.sha512=sha512;
+				job.sha256=sha256;
+				job.cached=true;
+				if(needs_refresh)
+				{
+					refresh_jobs.push_back(&job);
+				}
+				continue;
+			}
+
+			//Keep the cached hash that is not recalculated
+			if(!job.with_sha512) job.sha512=sha512;
+			if(!job.with_sha256) job.sha256=sha256;
+		}
+
+		hash_jobs.push_back(&job);
+	}
+
+	hash_pool->hashFiles(hash_jobs);
+
+	//Written again, so the cache entries of files still in the index are not removed as unused
+	hash_jobs.insert(hash_jobs.end(), refresh_jobs.begin(), refresh_jobs.end());
+
+	for(size_t i=0;i<hash_jobs.size();++i)
+	{
+		if(hash_jobs[i]->has_identity)
+		{
+			std::pair<std::map<std::pair<int64, int64>, SHashJob>::iterator, bool> ins=hash_cache_buffer.insert(
+				std::make_pair(std::make_pair(hash_jobs[i]->identity.dev, hash_jobs[i]->identity.inode), *hash_jobs[i]));
+			if(!ins.second)
+			{
+				ins.first->second=*hash_jobs[i];
+			}
 		}
 	}
 
-	return calculated_hash;
+	if(hash_cache_buffer.size()>=max_hash_cache_buffer_size)
+	{
+		commitHashCacheBuffer();
+	}
+}
+
+void IndexThread::commitHashCacheBuffer()
+{
+	if(hash_cache_buffer.empty())
+	{
+		return;
+	}
+
+	db->BeginWriteTransaction();
+	for(std::map<std::pair<int64, int64>, SHashJob>::iterator it=hash_cache_buffer.begin();
+		it!=hash_cache_buffer.end();++it)
+	{
+		hash_cache->addHashes(it->second.identity, it->second.sha512, it->second.sha256);
+	}
+	db->EndTransaction();
+
+	hash_cache_buffer.clear();
+}
+
+bool IndexThread::getFileHashCache(const SFileIdentity& identity, std::string& sha512, std::string& sha256, bool& needs_refresh)
+{
+	std::map<std::pair<int64, int64>, SHashJob>::iterator it=hash_cache_buffer.find(std::make_pair(identity.dev, identity.inode));
+	if(it!=hash_cache_buffer.end())
+	{
+		const SFileIdentity& cached=it->second.identity;
+		if(cached.size!=identity.size
+			|| cached.mtime!=identity.mtime
+			|| cached.ctime!=identity.ctime)
+		{
+			return false;
+		}
+		sha512=it->second.sha512;
+		sha256=it->second.sha256;
+		return true;
+	}
+
+	return hash_cache->getHashes(identity, sha512, sha256, needs_refresh);
 }
 
 std::vector<SFileAndHash> IndexThread::getFilesProxy(const std::wstring &orig_path, std::wstring path, const std::wstring& named_path, bool use_db/*=true*/)
@@ -2763,71 +3019,6 @@ std::wstring IndexThread::removeDirectorySeparatorAtEnd(const std::wstring& path
 	return path;
 }
 
-std::string IndexThread::getSHA256(const std::wstring& fn)
-{
-	sha256_ctx ctx;
-	sha256_init(&ctx);
-
-	IFile * f=Server->openFile(os_file_prefix(fn), MODE_READ_SEQUENTIAL_BACKUP);
-
-	if(f==NULL)
-	{
-		return std::string();
-	}
-
-	char buffer[32768];
-	unsigned int r;
-	while( (r=f->Read(buffer, 32768))>0)
-	{
-		sha256_update(&ctx, reinterpret_cast<const unsigned char*>(buffer), r);
-
-		if(IdleCheckerThread::getPause())
-		{
-			Server->wait(5000);
-		}
-	}
-
-	Server->destroy(f);
-
-	unsigned char dig[32];
-	sha256_final(&ctx, dig);
-
-	return bytesToHex(dig, 32);
-}
-
-std::string IndexThread::getSHA512Binary(const std::wstring& fn)
-{
-	Server->Log(L"Calculating SHA512 Hash for file \""+fn+L"\"", LL_DEBUG);
-	sha512_ctx ctx;
-	sha512_init(&ctx);
-
-	IFile * f=Server->openFile(os_file_prefix(fn), MODE_READ_SEQUENTIAL_BACKUP);
-
-	if(f==NULL)
-	{
-		return std::string();
-	}
-
-	char buffer[32768];
-	unsigned int r;
-	while( (r=f->Read(buffer, 32768))>0)
-	{
-		sha512_update(&ctx, reinterpret_cast<const unsigned char*>(buffer), r);
-
-		if(IdleCheckerThread::getPause())
-		{
-			Server->wait(5000);
-		}
-	}
-
-	Server->destroy(f);
-
-	std::string ret;
-	ret.resize(64);
-	sha512_final(&ctx, reinterpret_cast<unsigned char*>(const_cast<char*>(ret.c_str())));
-	return ret;
-}
-
 void IndexThread::VSSLog(const std::string& msg, int loglevel)
 {
 	Server->Log(msg, loglevel);
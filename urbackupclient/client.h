@@ -5,6 +5,7 @@
 #include "../Interface/ThreadPool.h"
 #include "../urbackupcommon/os_functions.h"
 #include "clientdao.h"
+#include "ClientHash.h"
 #include <map>
 
 #ifdef _WIN32
@@ -136,6 +137,8 @@ private:
 
 	void indexDirs(void);
 
+	void createFilelistDelta(const std::string& filelist_base);
+
 	void updateDirs(void);
 
 	std::wstring sanitizePattern(const std::wstring &p);
@@ -181,10 +184,12 @@ private:
 	void addFilesInt(std::wstring path, const std::vector<SFileAndHash> &data);
 	void commitAddFilesBuffer();
 
+	void hashFiles(std::vector<SHashJob*>& jobs);
+	void commitHashCacheBuffer();
+	bool getFileHashCache(const SFileIdentity& identity, std::string& sha512, std::string& sha256, bool& needs_refresh);
+
 	std::wstring removeDirectorySeparatorAtEnd(const std::wstring& path);
 
-	std::string getSHA256(const std::wstring& fn);
-	std::string getSHA512Binary(const std::wstring& fn);
 
 	void resetFileEntries(void);
 
@@ -243,6 +248,10 @@ private:
 
 	int64 last_file_buffer_commit_time;
 
+	ClientHashPool *hash_pool;
+	ClientHashCache *hash_cache;
+	std::map<std::pair<int64, int64>, SHashJob> hash_cache_buffer;
+
 	int end_to_end_file_backup_verification_enabled;
 	int calculate_filehashes_on_client;
 
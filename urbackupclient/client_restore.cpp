@@ -17,6 +17,7 @@
 #include <sys/ioctl.h>
 #endif
 #include "../urbackupcommon/mbrdata.h"
+#include "../urbackupcommon/image_restore.h"
 #include "../fileservplugin/settings.h"
 #include "../fileservplugin/packet_ids.h"
 #include <memory>
@@ -383,8 +384,6 @@ int downloadImage(int img_id, std::string img_time, std::string outfile, bool mb
 		s_offset="&offset="+nconvert(offset);
 	}
 
-	tcpstack.Send(client_pipe.get(), "DOWNLOAD IMAGE#pw="+pw+"&img_id="+nconvert(img_id)+"&time="+img_time+"&mbr="+nconvert(mbr)+s_offset);
-
 	std::string restore_out=outfile;
 	std::auto_ptr<IFile> out_file(Server->openFile(restore_out, MODE_RW_READNONE));
 	if(out_file.get()==NULL)
@@ -393,6 +392,35 @@ int downloadImage(int img_id, std::string img_time, std::string outfile, bool mb
 		return 2;
 	}
 
+	//Delta restore: Send hashes of the blocks currently on the restore target,
+	//so that the server only sends blocks which differ
+	IFile* restore_hashes=NULL;
+	ScopedDeleteFile restore_hashes_delete(NULL);
+	if(!mbr && offset==-1 && Server->getServerParameter("restore_delta")=="true")
+	{
+		restore_hashes=hashRestoreTarget(out_file.get());
+		restore_hashes_delete.reset(restore_hashes);
+	}
+
+	std::string s_delta;
+	if(restore_hashes!=NULL)
+	{
+		s_delta="&delta_hashsize="+nconvert(restore_hashes->Size());
+	}
+
+	tcpstack.Send(client_pipe.get(), "DOWNLOAD IMAGE#pw="+pw+"&img_id="+nconvert(img_id)+"&time="+img_time+"&mbr="+nconvert(mbr)+s_offset+s_delta);
+
+	if(restore_hashes!=NULL)
+	{
+		std::vector<char> hashbuf(32*1024);
+		restore_hashes->Seek(0);
+		_u32 read;
+		while((read=restore_hashes->Read(&hashbuf[0], (_u32)hashbuf.size()))>0)
+		{
+			tcpstack.Send(client_pipe.get(), &hashbuf[0], read);
+		}
+	}
+
 	_i64 imgsize=-1;
 	client_pipe->Read((char*)&imgsize, sizeof(_i64), 60000);
 	if(imgsize==-1)
@@ -407,10 +435,11 @@ int downloadImage(int img_id, std::string img_time, std::string outfile, bool mb
 		return rc;
 	}
 
-	const size_t c_buffer_size=32768;
+	const size_t c_buffer_size=512*1024;
 	const unsigned int c_block_size=4096;
 
-	char buf[c_buffer_size];
+	std::vector<char> recv_buf(c_buffer_size);
+	char* buf=&recv_buf[0];
 	if(mbr==true)
 	{
 		_i64 read=0;
@@ -436,6 +465,13 @@ int downloadImage(int img_id, std::string img_time, std::string outfile, bool mb
 		bool first=true;
 		bool has_data=false;
 		_i64 pos=0;
+		_i64 write_pos=0;
+
+		std::auto_ptr<RestoreImageWriter> writer(new RestoreImageWriter(out_file.get()));
+		THREADPOOL_TICKET writer_ticket=Server->getThreadPool()->execute(writer.get());
+		int64 starttime=Server->getTimeMS();
+		int64 last_speed_log=starttime;
+
 		while(pos<imgsize)
 		{
 			size_t r=client_pipe->Read(&buf[off], c_buffer_size-off, 180000);
@@ -445,6 +481,14 @@ int downloadImage(int img_id, std::string img_time, std::string outfile, bool mb
 			if( r==0 )
 			{
 				Server->Log("Read Timeout: Retrying", LL_WARNING);
+				writer->doExit();
+				Server->getThreadPool()->waitFor(writer_ticket);
+				if(writer->hasError())
+				{
+					//Retrying the download does not help if writing to the restore target fails
+					return 6;
+				}
+				writer.reset(NULL);
 				client_pipe.reset(NULL);
 				out_file.reset(NULL);
 				if(has_data)
@@ -469,19 +513,14 @@ int downloadImage(int img_id, std::string img_time, std::string outfile, bool mb
 						if(imgsize>=pos && imgsize-pos<c_block_size)
 							tw=(_u32)(imgsize-pos);
 
-						//Write to blockdev
-						_u32 woff=0;
-						do
+						//Queue write to blockdev
+						if(!writer->write(write_pos, blockdata, tw))
 						{
-							_u32 w=out_file->Write(&blockdata[woff], tw-woff);
-							if(w==0)
-							{
-								Server->Log("Writing to output file failed", LL_ERROR);
-								return 6;
-							}
-							woff+=w;
+							writer->doExit();
+							Server->getThreadPool()->waitFor(writer_ticket);
+							return 6;
 						}
-						while(tw-woff>0);
+						write_pos+=tw;
 
 						has_data=true;
 					}
@@ -511,7 +550,7 @@ int downloadImage(int img_id, std::string img_time, std::string outfile, bool mb
 						}
 						else
 						{
-							out_file->Seek(*s);
+							write_pos=*s;
 							pos=*s;
 						}
 						off+=sizeof(_i64);
@@ -545,8 +584,27 @@ int downloadImage(int img_id, std::string img_time, std::string outfile, bool mb
 					}
 				}
 			}
+
+			if(Server->getTimeMS()-last_speed_log>30000)
+			{
+				last_speed_log=Server->getTimeMS();
+				int64 passed_time=(std::max)(last_speed_log-starttime, (int64)1);
+				Server->Log("Restored "+PrettyPrintBytes(pos)+" of "+PrettyPrintBytes(imgsize)+" ("
+					+PrettyPrintSpeed((size_t)(writer->getWrittenBytes()*1000/passed_time))+")", LL_INFO);
+			}
+		}
+
+		writer->doExit();
+		Server->getThreadPool()->waitFor(writer_ticket);
+		if(writer->hasError())
+		{
+			return 6;
 		}
 
+		int64 passed_time=(std::max)(Server->getTimeMS()-starttime, (int64)1);
+		Server->Log("Restore done. Wrote "+PrettyPrintBytes(writer->getWrittenBytes())+" at "
+			+PrettyPrintSpeed((size_t)(writer->getWrittenBytes()*1000/passed_time)), LL_INFO);
+
 		return 0;
 	}
 	return 0;
@@ -2,5 +2,6 @@
 #define DATABASE_H
 
 const DATABASE_ID URBACKUPDB_CLIENT=19;
+const DATABASE_ID URBACKUPDB_HASH_BENCHMARK=20;
 
 #endif //DATABASE_H
\ No newline at end of file
@@ -52,8 +52,10 @@ IServer *Server;
 #include "win_sysvol.h"
 #endif
 #include "InternetClient.h"
+#include "../urbackupcommon/CompressedPipe.h"
 #include <stdlib.h>
 #include "file_permissions.h"
+#include "hash_benchmark.h"
 
 
 PLUGIN_ID filesrv_pluginid;
@@ -125,6 +127,13 @@ DLLEXPORT void LoadActions(IServer* pServer)
 		os_remove_nonempty_dir(widen(rmtest));
 		return;
 	}
+
+	std::string hash_benchmark_dir=Server->getServerParameter("hash_benchmark");
+	if(!hash_benchmark_dir.empty())
+	{
+		exit(hash_benchmark(Server->ConvertToUnicode(hash_benchmark_dir)));
+		return;
+	}
 
 #ifdef _WIN32
 	char t_lang[20];
@@ -298,6 +307,7 @@ DLLEXPORT void LoadActions(IServer* pServer)
 	bool do_leak_check=(Server->getServerParameter("leak_check")=="true");
 
 	ClientConnector::init_mutex();
+	CompressedPipe::init_mutex();
 	unsigned short urbackup_serviceport = default_urbackup_serviceport;
 	if(!Server->getServerParameter("urbackup_serviceport").empty())
 	{
@@ -345,6 +355,7 @@ DLLEXPORT void UnloadActions(void)
 		InternetClient::stop(internetclient_ticket);
 
 		ClientConnector::destroy_mutex();
+		CompressedPipe::destroy_mutex();
 
 		Server->destroyAllDatabases();
 	}
@@ -467,6 +478,17 @@ void update_client15_16(IDatabase *db)
 	db->Write("DELETE FROM files");
 }
 
+void update_client16_17(IDatabase *db)
+{
+	db->Write("CREATE TABLE filehash_cache (dev INTEGER, inode INTEGER, filesize INTEGER, modifytime INTEGER, changetime INTEGER, sha512 BLOB, sha256 TEXT)");
+	db->Write("CREATE UNIQUE INDEX filehash_cache_idx ON filehash_cache (dev ASC, inode ASC)");
+}
+
+void update_client17_18(IDatabase *db)
+{
+	db->Write("ALTER TABLE filehash_cache ADD last_used INTEGER DEFAULT 0");
+}
+
 bool upgrade_client(void)
 {
 	IDatabase *db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_CLIENT);
@@ -548,6 +570,14 @@ bool upgrade_client(void)
 				update_client15_16(db);
 				++ver;
 				break;
+			case 16:
+				update_client16_17(db);
+				++ver;
+				break;
+			case 17:
+				update_client17_18(db);
+				++ver;
+				break;
 			default:
 				break;
 		}
@@ -0,0 +1,250 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2014 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#include "hash_benchmark.h"
+#include "ClientHash.h"
+#include "database.h"
+#include "../Interface/Server.h"
+#include "../Interface/File.h"
+#include "../Interface/Database.h"
+#include "../urbackupcommon/os_functions.h"
+#include "../stringtools.h"
+#include <vector>
+#include <algorithm>
+#include <memory.h>
+
+/**
+* Benchmarks the hashing done while indexing with client side hashes and
+* end-to-end verification enabled on a synthetic tree. Run with
+* --hash_benchmark <dir> [--hash_benchmark_files n] [--hash_threads n]
+*/
+
+namespace
+{
+	struct SHashBenchmarkPass
+	{
+		SHashBenchmarkPass(const std::string& name)
+			: name(name), files(0), bytes(0), hashed(0), ms(0)
+		{
+		}
+
+		std::string name;
+		int64 files;
+		int64 bytes;
+		int64 hashed;
+		int64 ms;
+	};
+
+	bool generate_tree(const std::wstring& benchmark_dir, size_t nfiles, int64 max_file_size, std::vector<std::wstring>& files, std::vector<int64>& sizes)
+	{
+		unsigned int state=1;
+		std::vector<char> buf(32768);
+		for(size_t i=0;i<nfiles;++i)
+		{
+			std::wstring dir=benchmark_dir+os_file_sep()+L"d"+convert(i/100);
+			if(i%100==0 && !os_create_dir(os_file_prefix(dir)))
+			{
+				Server->Log(L"Error creating directory \""+dir+L"\"", LL_ERROR);
+				return false;
+			}
+
+			std::wstring fn=dir+os_file_sep()+L"f"+convert(i);
+			IFile* f=Server->openFile(os_file_prefix(fn), MODE_WRITE);
+			if(f==NULL)
+			{
+				Server->Log(L"Error creating file \""+fn+L"\"", LL_ERROR);
+				return false;
+			}
+
+			state^=state<<13;
+			state^=state>>17;
+			state^=state<<5;
+			int64 size=state%(max_file_size+1);
+			for(int64 written=0;written<size;)
+			{
+				for(size_t j=0;j+sizeof(unsigned int)<=buf.size();j+=sizeof(unsigned int))
+				{
+					state^=state<<13;
+					state^=state>>17;
+					state^=state<<5;
+					memcpy(&buf[j], &state, sizeof(unsigned int));
+				}
+				_u32 towrite=static_cast<_u32>((std::min)(static_cast<int64>(buf.size()), size-written));
+				f->Write(&buf[0], towrite);
+				written+=towrite;
+			}
+			Server->destroy(f);
+
+			files.push_back(fn);
+			sizes.push_back(size);
+		}
+		return true;
+	}
+
+	void hash_pass(ClientHashPool& pool, ClientHashCache* cache, const std::vector<std::wstring>& files, const std::vector<int64>& sizes,
+		std::vector<SHashJob>& jobs, SHashBenchmarkPass& pass)
+	{
+		int64 starttime=Server->getTimeMS();
+
+		jobs.clear();
+		jobs.reserve(files.size());
+		std::vector<SHashJob*> dir_jobs;
+		for(size_t i=0;i<files.size();++i)
+		{
+			jobs.push_back(SHashJob(files[i]));
+			SHashJob& job=jobs.back();
+			job.with_sha512=true;
+			job.with_sha256=true;
+
+			if(cache!=NULL)
+			{
+				job.has_identity=getFileIdentity(job.fn, job.identity);
+				bool needs_refresh;
+				if(job.has_identity && cache->getHashes(job.identity, job.sha512, job.sha256, needs_refresh))
+				{
+					job.cached=true;
+				}
+			}
+
+			if(!job.cached)
+			{
+				dir_jobs.push_back(&job);
+				pass.bytes+=sizes[i];
+				++pass.hashed;
+			}
+
+			//Indexing hashes one directory at a time
+			if(i%100==99 || i+1==files.size())
+			{
+				pool.hashFiles(dir_jobs);
+				dir_jobs.clear();
+			}
+		}
+
+		pass.files=static_cast<int64>(files.size());
+		pass.ms=Server->getTimeMS()-starttime;
+	}
+
+	std::string pass_summary(const SHashBenchmarkPass& pass)
+	{
+		double secs=(std::max)(pass.ms, (int64)1)/1000.0;
+		return pass.name+": "+nconvert(pass.files)+" files ("+nconvert(pass.hashed)+" hashed, "+PrettyPrintBytes(pass.bytes)+") in "+nconvert(pass.ms)+" ms ("
+			+nconvert(pass.bytes/secs/(1024*1024))+" MB/s, "+nconvert(pass.files/secs)+" files/s)";
+	}
+}
+
+int hash_benchmark(const std::wstring& benchmark_dir)
+{
+	size_t nfiles=static_cast<size_t>(watoi(widen(Server->getServerParameter("hash_benchmark_files", "2000"))));
+	int64 max_file_size=watoi64(widen(Server->getServerParameter("hash_benchmark_max_file_size", "4194304")));
+	size_t hash_threads=static_cast<size_t>(watoi(widen(Server->getServerParameter("hash_threads", "4"))));
+
+	if(os_directory_exists(os_file_prefix(benchmark_dir)))
+	{
+		os_remove_nonempty_dir(os_file_prefix(benchmark_dir));
+	}
+
+	if(!os_create_dir_recursive(os_file_prefix(benchmark_dir)))
+	{
+		Server->Log(L"Error creating benchmark directory \""+benchmark_dir+L"\"", LL_ERROR);
+		return 1;
+	}
+
+	Server->Log("Generating synthetic file tree with "+nconvert(nfiles)+" files...", LL_INFO);
+	std::vector<std::wstring> files;
+	std::vector<int64> sizes;
+	if(!generate_tree(benchmark_dir, nfiles, max_file_size, files, sizes))
+	{
+		return 1;
+	}
+
+	if(!Server->openDatabase(Server->ConvertToUTF8(benchmark_dir+os_file_sep()+L"hash_cache.db"), URBACKUPDB_HASH_BENCHMARK))
+	{
+		Server->Log("Error opening hash cache benchmark database", LL_ERROR);
+		return 1;
+	}
+	IDatabase* db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_HASH_BENCHMARK);
+	db->Write("CREATE TABLE filehash_cache (dev INTEGER, inode INTEGER, filesize INTEGER, modifytime INTEGER, changetime INTEGER, sha512 BLOB, sha256 TEXT, last_used INTEGER)");
+	db->Write("CREATE UNIQUE INDEX filehash_cache_idx ON filehash_cache (dev ASC, inode ASC)");
+
+	//Files changed in the last seconds are not cached
+	Server->wait(3000);
+
+	std::vector<SHashJob> serial_jobs;
+	std::vector<SHashJob> parallel_jobs;
+	std::vector<SHashJob> cached_jobs;
+	std::vector<SHashBenchmarkPass> passes;
+	bool ok=true;
+	{
+		ClientHashCache cache(db);
+
+		ClientHashPool serial_pool(1);
+		SHashBenchmarkPass serial_pass("index_hash_serial");
+		hash_pass(serial_pool, NULL, files, sizes, serial_jobs, serial_pass);
+		passes.push_back(serial_pass);
+
+		ClientHashPool parallel_pool(hash_threads);
+		SHashBenchmarkPass parallel_pass("index_hash_"+nconvert(hash_threads)+"_threads");
+		hash_pass(parallel_pool, &cache, files, sizes, parallel_jobs, parallel_pass);
+		passes.push_back(parallel_pass);
+
+		db->BeginWriteTransaction();
+		for(size_t i=0;i<parallel_jobs.size();++i)
+		{
+			if(parallel_jobs[i].has_identity)
+			{
+				cache.addHashes(parallel_jobs[i].identity, parallel_jobs[i].sha512, parallel_jobs[i].sha256);
+			}
+		}
+		db->EndTransaction();
+
+		SHashBenchmarkPass cached_pass("index_hash_cached");
+		hash_pass(parallel_pool, &cache, files, sizes, cached_jobs, cached_pass);
+		passes.push_back(cached_pass);
+
+		for(size_t i=0;i<files.size();++i)
+		{
+			if(serial_jobs[i].sha512!=parallel_jobs[i].sha512
+				|| serial_jobs[i].sha256!=parallel_jobs[i].sha256
+				|| serial_jobs[i].sha512!=cached_jobs[i].sha512
+				|| serial_jobs[i].sha256!=cached_jobs[i].sha256)
+			{
+				Server->Log(L"Hash mismatch for file \""+files[i]+L"\"", LL_ERROR);
+				ok=false;
+			}
+		}
+	}
+
+	Server->destroyAllDatabases();
+
+	for(size_t i=0;i<passes.size();++i)
+	{
+		Server->Log(pass_summary(passes[i]), LL_INFO);
+	}
+
+	os_remove_nonempty_dir(os_file_prefix(benchmark_dir));
+
+	if(!ok)
+	{
+		Server->Log("Hash benchmark failed", LL_ERROR);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include <string>
+
+int hash_benchmark(const std::wstring& benchmark_dir);
@@ -1,6 +1,10 @@
 #include "CompressedPipe.h"
 #include "../cryptoplugin/ICryptoFactory.h"
 #include "../Interface/Server.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
+#include "../Interface/Thread.h"
+#include "../Interface/ThreadPool.h"
 #include <limits.h>
 #include <memory.h>
 #include <string.h>
@@ -9,8 +13,109 @@
 extern ICryptoFactory *crypto_fak;
 const size_t max_send_size=20000;
 
-CompressedPipe::CompressedPipe(IPipe *cs, int compression_level)
-	: cs(cs), has_error(false)
+//Stream framing: input is compressed in chunks of stream_input_size,
+//frames are collected and sent with one write once send_buffer_size is
+//reached. The top bit of the frame length marks a flushed frame
+const size_t stream_input_size=256*1024;
+const size_t send_buffer_size=1024*1024;
+const size_t max_stream_frame_size=4*1024*1024;
+const _u32 frame_flush_flag=0x80000000;
+const size_t recv_buffer_size=64*1024;
+//Pending stream output is flushed once the writer did not write for this long
+const int64 idle_flush_ms=20;
+//The idle flusher serves all pipes, so a stalled peer may only hold it up for this long
+const int idle_flush_timeout_ms=10000;
+
+IMutex* CompressedPipe::idle_mutex=NULL;
+ICondition* CompressedPipe::idle_cond=NULL;
+std::set<CompressedPipe*> CompressedPipe::idle_pipes;
+bool CompressedPipe::idle_flusher_started=false;
+bool CompressedPipe::idle_flusher_quit=false;
+THREADPOOL_TICKET CompressedPipe::idle_flusher_ticket=ILLEGAL_THREADPOOL_TICKET;
+
+namespace
+{
+	class CompressedPipeIdleFlusher : public IThread
+	{
+	public:
+		void operator()(void)
+		{
+			while(CompressedPipe::flushIdlePipes())
+			{
+				Server->wait(static_cast<unsigned int>(idle_flush_ms));
+			}
+			delete this;
+		}
+	};
+}
+
+void CompressedPipe::init_mutex(void)
+{
+	idle_mutex=Server->createMutex();
+	idle_cond=Server->createCondition();
+}
+
+void CompressedPipe::stop_idle_flusher(void)
+{
+	THREADPOOL_TICKET ticket;
+	{
+		IScopedLock lock(idle_mutex);
+		idle_flusher_quit=true;
+		if(!idle_flusher_started)
+		{
+			return;
+		}
+		ticket=idle_flusher_ticket;
+	}
+
+	Server->getThreadPool()->waitFor(ticket);
+}
+
+void CompressedPipe::destroy_mutex(void)
+{
+	stop_idle_flusher();
+	Server->destroy(idle_cond);
+	Server->destroy(idle_mutex);
+	idle_cond=NULL;
+	idle_mutex=NULL;
+}
+
+bool CompressedPipe::flushIdlePipes(void)
+{
+	//Flushing writes to the network, so it is done without holding idle_mutex.
+	//The references keep the pipes from being deleted in the meantime
+	std::vector<CompressedPipe*> pipes;
+	{
+		IScopedLock lock(idle_mutex);
+		if(idle_flusher_quit)
+		{
+			return false;
+		}
+		pipes.assign(idle_pipes.begin(), idle_pipes.end());
+		for(size_t i=0;i<pipes.size();++i)
+		{
+			++pipes[i]->idle_flush_refs;
+		}
+	}
+
+	int64 ctime=Server->getTimeMS();
+	for(size_t i=0;i<pipes.size();++i)
+	{
+		pipes[i]->flushIfIdle(ctime);
+	}
+
+	IScopedLock lock(idle_mutex);
+	for(size_t i=0;i<pipes.size();++i)
+	{
+		--pipes[i]->idle_flush_refs;
+	}
+	idle_cond->notify_all();
+	return true;
+}
+
+CompressedPipe::CompressedPipe(IPipe *cs, int compression_level, bool stream_frames)
+	: cs(cs), stream_frames(stream_frames), has_error(false), write_pending(false),
+	  last_write_time(0), last_write_timeout(-1), idle_flush_refs(0)
 {
 	comp=crypto_fak->createZlibCompression(compression_level);
 	decomp=crypto_fak->createZlibDecompression();
@@ -18,12 +123,38 @@ CompressedPipe::CompressedPipe(IPipe *cs, int compression_level)
 	decomp_buffer_pos=0;
 	decomp_read_pos=0;
 	comp_buffer.resize(100);
+	comp_buffer_pos=0;
+	recv_buffer.resize(recv_buffer_size);
+	message_len=0;
+	message_flush=true;
 	message_len_byte=0;
 	destroy_cs=false;
+	write_mutex=Server->createMutex();
+
+	if(stream_frames)
+	{
+		IScopedLock lock(idle_mutex);
+		idle_pipes.insert(this);
+		if(!idle_flusher_started && !idle_flusher_quit)
+		{
+			idle_flusher_started=true;
+			idle_flusher_ticket=Server->getThreadPool()->execute(new CompressedPipeIdleFlusher);
+		}
+	}
 }
 
 CompressedPipe::~CompressedPipe(void)
 {
+	if(stream_frames)
+	{
+		IScopedLock lock(idle_mutex);
+		idle_pipes.erase(this);
+		while(idle_flush_refs>0)
+		{
+			idle_cond->wait(&lock);
+		}
+	}
+	Server->destroy(write_mutex);
 	decomp->Remove();
 	comp->Remove();
 	if(destroy_cs)
@@ -70,10 +201,12 @@ size_t CompressedPipe::Read(char *buffer, size_t bsize, int timeoutms)
 	size_t rc=ReadToBuffer(buffer, bsize);
 	if(rc>0) return rc;
 
+	flushPending();
+
 	if(timeoutms==0)
 	{
-		rc=cs->Read(buffer, bsize, timeoutms);
-		Process(buffer, rc);
+		rc=cs->Read(&recv_buffer[0], recv_buffer.size(), timeoutms);
+		Process(&recv_buffer[0], rc);
 		if(has_error)
 		{
 			return 0;
@@ -84,11 +217,11 @@ size_t CompressedPipe::Read(char *buffer, size_t bsize, int timeoutms)
 	{
 		do
 		{
-			rc=cs->Read(buffer, bsize, timeoutms);
+			rc=cs->Read(&recv_buffer[0], recv_buffer.size(), timeoutms);
 			if(rc==0)
 				return 0;
 
-			Process(buffer, rc);
+			Process(&recv_buffer[0], rc);
 			if(has_error)
 			{
 				return 0;
@@ -104,10 +237,10 @@ size_t CompressedPipe::Read(char *buffer, size_t bsize, int timeoutms)
 	{
 		int left=timeoutms-static_cast<int>(Server->getTimeMS()-starttime);
 
-		rc=cs->Read(buffer, bsize, left);
+		rc=cs->Read(&recv_buffer[0], recv_buffer.size(), left);
 		if(rc==0)
 			return 0;
-		Process(buffer, rc);
+		Process(&recv_buffer[0], rc);
 		if(has_error)
 		{
 			return 0;
@@ -127,13 +260,35 @@ void CompressedPipe::Process(const char *buffer, size_t bsize)
 	{
 		if(recv_state==RS_LENGTH)
 		{
-			size_t used_bytes=(std::min)(b_left, sizeof(_u16)-message_len_byte);
-			memcpy(((char*)&message_len)+message_len_byte, cptr, used_bytes);
+			size_t header_size=stream_frames ? sizeof(_u32) : sizeof(_u16);
+			size_t used_bytes=(std::min)(b_left, header_size-message_len_byte);
+			memcpy(message_header+message_len_byte, cptr, used_bytes);
 			message_len_byte+=used_bytes;
 
-			if(message_len_byte==sizeof(_u16))
+			if(message_len_byte==header_size)
 			{
-				message_len = little_endian(message_len);
+				if(stream_frames)
+				{
+					_u32 frame_header;
+					memcpy(&frame_header, message_header, sizeof(_u32));
+					frame_header=little_endian(frame_header);
+					message_flush=(frame_header & frame_flush_flag)!=0;
+					message_len=frame_header & ~frame_flush_flag;
+					if(message_len>max_stream_frame_size)
+					{
+						Server->Log("Compressed frame too large ("+nconvert(message_len)+" bytes)", LL_ERROR);
+						has_error=true;
+						return;
+					}
+				}
+				else
+				{
+					_u16 frame_len;
+					memcpy(&frame_len, message_header, sizeof(_u16));
+					message_len=little_endian(frame_len);
+					message_flush=true;
+				}
+
 				if(message_len>0)
 				{
 					recv_state=RS_CONTENT;
@@ -153,7 +308,7 @@ void CompressedPipe::Process(const char *buffer, size_t bsize)
 		{
 			if(b_left>=message_left && input_buffer_pos==0)
 			{
-				decomp_buffer_pos+=decomp->decompress(cptr, message_left, &decomp_buffer, true, decomp_buffer_pos, &has_error);
+				decomp_buffer_pos+=decomp->decompress(cptr, message_left, &decomp_buffer, message_flush, decomp_buffer_pos, &has_error);
 				recv_state=RS_LENGTH;
 				message_len_byte=0;
 				b_left-=message_left;
@@ -170,7 +325,7 @@ void CompressedPipe::Process(const char *buffer, size_t bsize)
 
 				if(message_left==0)
 				{
-					decomp_buffer_pos+=decomp->decompress(&input_buffer[0], message_len, &decomp_buffer, true, decomp_buffer_pos, &has_error);
+					decomp_buffer_pos+=decomp->decompress(&input_buffer[0], message_len, &decomp_buffer, message_flush, decomp_buffer_pos, &has_error);
 					recv_state=RS_LENGTH;
 					message_len_byte=0;
 				}
@@ -183,6 +338,43 @@ bool CompressedPipe::Write(const char *buffer, size_t bsize, int timeoutms)
 {
 	const char *ptr=buffer;
 	size_t cbsize=bsize;
+
+	if(stream_frames)
+	{
+		IScopedLock lock(write_mutex);
+		while(bsize>0)
+		{
+			cbsize=(std::min)(stream_input_size, bsize);
+
+			if(comp_buffer.size()<comp_buffer_pos+sizeof(_u32))
+			{
+				comp_buffer.resize(comp_buffer_pos+sizeof(_u32));
+			}
+
+			size_t rc=comp->compress(ptr, cbsize, &comp_buffer, false, comp_buffer_pos+sizeof(_u32));
+			if(rc>0)
+			{
+				_u32 frame_header=little_endian(static_cast<_u32>(rc));
+				memcpy(&comp_buffer[comp_buffer_pos], &frame_header, sizeof(_u32));
+				comp_buffer_pos+=sizeof(_u32)+rc;
+			}
+
+			if(comp_buffer_pos>=send_buffer_size)
+			{
+				if(!SendCompressed(timeoutms))
+					return false;
+			}
+
+			ptr+=cbsize;
+			bsize-=cbsize;
+		}
+
+		write_pending=true;
+		last_write_time=Server->getTimeMS();
+		last_write_timeout=timeoutms;
+		return true;
+	}
+
 	while(bsize>0)
 	{
 		cbsize=(std::min)(max_send_size, bsize);
@@ -200,11 +392,94 @@ bool CompressedPipe::Write(const char *buffer, size_t bsize, int timeoutms)
 	return true;
 }
 
+bool CompressedPipe::SendCompressed(int timeoutms)
+{
+	if(comp_buffer_pos==0)
+	{
+		return true;
+	}
+	bool b=cs->Write(&comp_buffer[0], comp_buffer_pos, timeoutms);
+	comp_buffer_pos=0;
+	return b;
+}
+
+bool CompressedPipe::flush(int timeoutms)
+{
+	if(!stream_frames)
+	{
+		return true;
+	}
+
+	IScopedLock lock(write_mutex);
+	return flushInt(timeoutms);
+}
+
+bool CompressedPipe::flushInt(int timeoutms)
+{
+	if(write_pending)
+	{
+		if(comp_buffer.size()<comp_buffer_pos+sizeof(_u32))
+		{
+			comp_buffer.resize(comp_buffer_pos+sizeof(_u32));
+		}
+
+		size_t rc=comp->compress(NULL, 0, &comp_buffer, true, comp_buffer_pos+sizeof(_u32));
+		_u32 frame_header=little_endian(static_cast<_u32>(rc)|frame_flush_flag);
+		memcpy(&comp_buffer[comp_buffer_pos], &frame_header, sizeof(_u32));
+		comp_buffer_pos+=sizeof(_u32)+rc;
+		write_pending=false;
+	}
+
+	return SendCompressed(timeoutms);
+}
+
+void CompressedPipe::flushPending(void)
+{
+	//The other side usually waits for what was written before it answers
+	if(stream_frames)
+	{
+		IScopedLock lock(write_mutex);
+		if(write_pending)
+		{
+			flushInt(last_write_timeout);
+		}
+	}
+}
+
+void CompressedPipe::flushIfIdle(int64 ctime)
+{
+	//A writer holding the lock is not idle
+	if(!write_mutex->TryLock())
+	{
+		return;
+	}
+
+	if(write_pending && ctime-last_write_time>=idle_flush_ms)
+	{
+		int timeoutms=idle_flush_timeout_ms;
+		if(last_write_timeout>=0 && last_write_timeout<timeoutms)
+		{
+			timeoutms=last_write_timeout;
+		}
+
+		if(!flushInt(timeoutms))
+		{
+			//Pending output was dropped, the stream cannot be continued
+			Server->Log("Flushing idle compressed pipe failed", LL_DEBUG);
+			has_error=true;
+		}
+	}
+
+	write_mutex->Unlock();
+}
+
 size_t CompressedPipe::Read(std::string *ret, int timeoutms)
 {
 	size_t rc=ReadToString(ret);
 	if(rc>0) return rc;
 
+	flushPending();
+
 	if(timeoutms==0)
 	{
 		rc=cs->Read(ret, timeoutms);
@@ -272,8 +547,9 @@ bool CompressedPipe::isReadable(int timeoutms)
 {
 	if(decomp_read_pos<decomp_buffer_pos)
 		return true;
-	else
-		return cs->isReadable(timeoutms);
+
+	flushPending();
+	return cs->isReadable(timeoutms);
 }
 
 bool CompressedPipe::hasError(void)
@@ -1,9 +1,12 @@
 #include "../Interface/Pipe.h"
 #include "../Interface/Types.h"
 #include <vector>
+#include <set>
 
 class IZlibCompression;
 class IZlibDecompression;
+class IMutex;
+class ICondition;
 
 
 enum RecvState
@@ -15,7 +18,13 @@ enum RecvState
 class CompressedPipe : public IPipe
 {
 public:
-	CompressedPipe(IPipe *cs, int compression_level);
+	/**
+	* @param stream_frames use the negotiated framing (IPC_COMPRESSED_STREAM) with
+	*        32 bit frame lengths. Written data is only flushed by flush(), before
+	*        reading from the pipe and once the writer has been idle for a while.
+	*        The backend pipe has to stay valid until this pipe is deleted
+	*/
+	CompressedPipe(IPipe *cs, int compression_level, bool stream_frames=false);
 	~CompressedPipe(void);
 
 	virtual size_t Read(char *buffer, size_t bsize, int timeoutms=-1);
@@ -46,10 +55,26 @@ public:
 	virtual _i64 getTransferedBytes(void);
 	virtual void resetTransferedBytes(void);
 
+	/**
+	* Flushes the compression stream and sends everything written so far
+	*/
+	bool flush(int timeoutms=-1);
+
+	static void init_mutex(void);
+	//Stops and waits for the idle flusher thread
+	static void stop_idle_flusher(void);
+	static void destroy_mutex(void);
+	//Returns false once the idle flusher should stop
+	static bool flushIdlePipes(void);
+
 private:
 	void Process(const char *buffer, size_t bsize);
 	size_t ReadToBuffer(char *buffer, size_t bsize);
 	size_t ReadToString(std::string *ret);
+	bool SendCompressed(int timeoutms);
+	bool flushInt(int timeoutms);
+	void flushPending(void);
+	void flushIfIdle(int64 ctime);
 
 	IPipe *cs;
 
@@ -60,14 +85,33 @@ private:
 	size_t decomp_buffer_pos;
 	size_t decomp_read_pos;
 	std::vector<char> comp_buffer;
+	size_t comp_buffer_pos;
 	std::vector<char> input_buffer;
 	size_t input_buffer_pos;
+	std::vector<char> recv_buffer;
+
+	bool stream_frames;
 
 	int recv_state;
-	_u16 message_len;
+	char message_header[sizeof(_u32)];
+	size_t message_len;
+	bool message_flush;
 	size_t message_left;
 	size_t message_len_byte;
 
 	bool destroy_cs;
 	bool has_error;
+
+	IMutex* write_mutex;
+	bool write_pending;
+	int64 last_write_time;
+	int last_write_timeout;
+	size_t idle_flush_refs;
+
+	static IMutex* idle_mutex;
+	static ICondition* idle_cond;
+	static std::set<CompressedPipe*> idle_pipes;
+	static bool idle_flusher_started;
+	static bool idle_flusher_quit;
+	static THREADPOOL_TICKET idle_flusher_ticket;
 };
\ No newline at end of file
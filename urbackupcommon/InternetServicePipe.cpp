@@ -2,19 +2,33 @@
 #include "../cryptoplugin/ICryptoFactory.h"
 
 #include "../Interface/Server.h"
+#include "../stringtools.h"
 #include <string.h>
+#include <algorithm>
 
 extern ICryptoFactory *crypto_fak;
 
+namespace
+{
+	//AEAD record: 32 bit little endian length, ciphertext, tag. The length
+	//is authenticated as additional data
+	const size_t aead_header_size=sizeof(_u32);
+	const size_t max_aead_record_size=256*1024;
+	const size_t aead_recv_size=64*1024;
+	//Appended to the key before it is hashed into the key of each direction
+	const char aead_client_to_server[]="\0urbackup aead client to server";
+	const char aead_server_to_client[]="\0urbackup aead server to client";
+}
+
 InternetServicePipe::InternetServicePipe(void)
-	: cs(NULL), destroy_cs(false)
+	: cs(NULL), aead_enc(NULL), aead_dec(NULL), destroy_cs(false)
 {
 	enc=NULL;
 	dec=NULL;
 }
 
 InternetServicePipe::InternetServicePipe(IPipe *cs, const std::string &key)
-	: cs(cs), destroy_cs(false)
+	: cs(cs), key(key), aead_enc(NULL), aead_dec(NULL), destroy_cs(false)
 {
 	enc=crypto_fak->createAESEncryption(key);
 	dec=crypto_fak->createAESDecryption(key);
@@ -24,15 +38,18 @@ InternetServicePipe::~InternetServicePipe(void)
 {
 	if(enc!=NULL) enc->Remove();
 	if(dec!=NULL) dec->Remove();
+	if(aead_enc!=NULL) aead_enc->Remove();
+	if(aead_dec!=NULL) aead_dec->Remove();
 	if(destroy_cs && cs!=NULL)
 	{
 		Server->destroy(cs);
 	}
 }
 
-void InternetServicePipe::init(IPipe *pcs, const std::string &key)
+void InternetServicePipe::init(IPipe *pcs, const std::string &pkey)
 {
 	cs=pcs;
+	key=pkey;
 	destroy_cs=false;
 	if(enc!=NULL) enc->Remove();
 	if(dec!=NULL) dec->Remove();
@@ -40,8 +57,135 @@ void InternetServicePipe::init(IPipe *pcs, const std::string &key)
 	dec=crypto_fak->createAESDecryption(key);
 }
 
+void InternetServicePipe::enableAEAD(bool is_client)
+{
+	std::string client_key=key+std::string(aead_client_to_server, sizeof(aead_client_to_server)-1);
+	std::string server_key=key+std::string(aead_server_to_client, sizeof(aead_server_to_client)-1);
+
+	if(aead_enc!=NULL) aead_enc->Remove();
+	if(aead_dec!=NULL) aead_dec->Remove();
+	aead_enc=crypto_fak->createAESGCMEncryption(is_client ? client_key : server_key);
+	aead_dec=crypto_fak->createAESGCMDecryption(is_client ? server_key : client_key);
+	aead_iv_sent=false;
+	aead_iv_received=false;
+	has_error=false;
+	recv_buf.resize(aead_recv_size);
+	recv_start=0;
+	recv_end=0;
+	plain_start=0;
+	plain_end=0;
+}
+
+bool InternetServicePipe::decryptRecord(void)
+{
+	if(!aead_iv_received)
+	{
+		if(recv_end-recv_start<aes_gcm_iv_size)
+			return false;
+
+		aead_dec->setIV(std::string(&recv_buf[recv_start], aes_gcm_iv_size));
+		recv_start+=aes_gcm_iv_size;
+		aead_iv_received=true;
+	}
+
+	if(recv_end-recv_start<aead_header_size)
+		return false;
+
+	_u32 record_size;
+	memcpy(&record_size, &recv_buf[recv_start], sizeof(_u32));
+	record_size=little_endian(record_size);
+
+	if(record_size>max_aead_record_size)
+	{
+		Server->Log("Encrypted record too large ("+nconvert(record_size)+" bytes)", LL_ERROR);
+		has_error=true;
+		return false;
+	}
+
+	size_t total=aead_header_size+record_size+aes_gcm_tag_size;
+	if(recv_end-recv_start<total)
+	{
+		if(recv_buf.size()<recv_start+total)
+		{
+			recv_buf.resize(recv_start+total);
+		}
+		return false;
+	}
+
+	char *data=&recv_buf[recv_start+aead_header_size];
+	if(!aead_dec->decrypt(data, record_size, &recv_buf[recv_start], aead_header_size, data+record_size))
+	{
+		Server->Log("Authentication of encrypted record failed", LL_ERROR);
+		has_error=true;
+		return false;
+	}
+
+	plain_start=recv_start+aead_header_size;
+	plain_end=plain_start+record_size;
+	recv_start+=total;
+	return true;
+}
+
+bool InternetServicePipe::fillPlain(int timeoutms)
+{
+	int64 starttime=Server->getTimeMS();
+	while(plain_start==plain_end)
+	{
+		if(decryptRecord())
+			continue;
+
+		if(has_error)
+			return false;
+
+		if(recv_start>0)
+		{
+			if(recv_end>recv_start)
+			{
+				memmove(&recv_buf[0], &recv_buf[recv_start], recv_end-recv_start);
+			}
+			recv_end-=recv_start;
+			recv_start=0;
+			plain_start=plain_end=0;
+		}
+
+		if(recv_buf.size()-recv_end<aead_recv_size/2)
+		{
+			recv_buf.resize(recv_end+aead_recv_size);
+		}
+
+		int left=timeoutms;
+		if(timeoutms>0)
+		{
+			left=timeoutms-static_cast<int>(Server->getTimeMS()-starttime);
+			if(left<=0)
+				return false;
+		}
+
+		size_t rc=cs->Read(&recv_buf[recv_end], recv_buf.size()-recv_end, left);
+		if(rc==0)
+			return false;
+
+		recv_end+=rc;
+
+		if(timeoutms==0 && !decryptRecord())
+			return false;
+	}
+	return true;
+}
+
 size_t InternetServicePipe::Read(char *buffer, size_t bsize, int timeoutms)
 {
+	if(aead_dec!=NULL)
+	{
+		if(!fillPlain(timeoutms))
+			return 0;
+
+		size_t toread=(std::min)(bsize, plain_end-plain_start);
+		memcpy(buffer, &recv_buf[plain_start], toread);
+		plain_start+=toread;
+		return toread;
+	}
+
 	size_t rc=cs->Read(buffer, bsize, timeoutms);
 	if(rc>0)
 	{
@@ -71,6 +215,43 @@ std::string InternetServicePipe::encrypt(const std::string &data)
 
 bool InternetServicePipe::Write(const char *buffer, size_t bsize, int timeoutms)
 {
+	if(aead_enc!=NULL)
+	{
+		size_t pos=0;
+		if(!aead_iv_sent)
+		{
+			std::string iv=aead_enc->getIV();
+			send_buf.resize(iv.size());
+			memcpy(&send_buf[0], iv.c_str(), iv.size());
+			pos=iv.size();
+			aead_iv_sent=true;
+		}
+
+		while(bsize>0)
+		{
+			size_t record_size=(std::min)(bsize, max_aead_record_size);
+			if(send_buf.size()<pos+aead_header_size+record_size+aes_gcm_tag_size)
+			{
+				send_buf.resize(pos+aead_header_size+record_size+aes_gcm_tag_size);
+			}
+
+			_u32 header=little_endian(static_cast<_u32>(record_size));
+			memcpy(&send_buf[pos], &header, sizeof(_u32));
+			char *data=&send_buf[pos+aead_header_size];
+			memcpy(data, buffer, record_size);
+			aead_enc->encrypt(data, record_size, &send_buf[pos], aead_header_size, data+record_size);
+
+			pos+=aead_header_size+record_size+aes_gcm_tag_size;
+			buffer+=record_size;
+			bsize-=record_size;
+		}
+
+		if(pos==0)
+			return true;
+
+		return cs->Write(&send_buf[0], pos, timeoutms);
+	}
+
 	std::string encbuf=enc->encrypt(buffer, bsize);
 	bool b=cs->Write(encbuf, timeoutms);
 	return b;
@@ -78,6 +259,16 @@ bool InternetServicePipe::Write(const char *buffer, size_t bsize, int timeoutms)
 
 size_t InternetServicePipe::Read(std::string *ret, int timeoutms)
 {
+	if(aead_dec!=NULL)
+	{
+		if(!fillPlain(timeoutms))
+			return 0;
+
+		ret->assign(&recv_buf[plain_start], plain_end-plain_start);
+		plain_start=plain_end;
+		return ret->size();
+	}
+
 	size_t rc=cs->Read(ret, timeoutms);
 	if(rc>0)
 	{
@@ -115,11 +306,28 @@ bool InternetServicePipe::isWritable(int timeoutms)
 
 bool InternetServicePipe::isReadable(int timeoutms)
 {
+	if(aead_dec!=NULL)
+	{
+		if(plain_start<plain_end)
+			return true;
+
+		//A complete record may already be buffered, in which case the
+		//socket has nothing more to signal
+		if(decryptRecord())
+			return true;
+
+		if(has_error)
+			return true;
+	}
+
 	return cs->isReadable(timeoutms);
 }
 
 bool InternetServicePipe::hasError(void)
 {
+	if(aead_dec!=NULL && has_error)
+		return true;
+
 	return cs->hasError();
 }
 
@@ -1,7 +1,10 @@
 #include "../Interface/Pipe.h"
+#include <vector>
 
 class IAESEncryption;
 class IAESDecryption;
+class IAESGCMEncryption;
+class IAESGCMDecryption;
 
 class InternetServicePipe : public IPipe
 {
@@ -12,6 +15,15 @@ public:
 
 	void init(IPipe *pcs, const std::string &key);
 
+	/**
+	* Switches both directions to authenticated AES-GCM records
+	* (IPC_ENCRYPTED_AEAD). Both sides have to switch at the same
+	* message boundary. Each direction uses its own key, so records
+	* sent back to their sender fail authentication
+	* @param is_client true on the client side of the connection
+	*/
+	void enableAEAD(bool is_client);
+
 	virtual size_t Read(char *buffer, size_t bsize, int timeoutms=-1);
 	virtual bool Write(const char *buffer, size_t bsize, int timeoutms=-1);
 	virtual size_t Read(std::string *ret, int timeoutms=-1);
@@ -45,10 +57,27 @@ public:
 	virtual void resetTransferedBytes(void);
 
 private:
+	bool decryptRecord(void);
+	bool fillPlain(int timeoutms);
+
 	IPipe *cs;
 
+	std::string key;
+
 	IAESEncryption *enc;
 	IAESDecryption *dec;
 
+	IAESGCMEncryption *aead_enc;
+	IAESGCMDecryption *aead_dec;
+	bool aead_iv_sent;
+	bool aead_iv_received;
+	std::vector<char> send_buf;
+	std::vector<char> recv_buf;
+	size_t recv_start;
+	size_t recv_end;
+	size_t plain_start;
+	size_t plain_end;
+	bool has_error;
+
 	bool destroy_cs;
 };
\ No newline at end of file
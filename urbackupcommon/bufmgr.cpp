@@ -19,31 +19,35 @@
 #include "bufmgr.h"
 #include "../Interface/Server.h"
 #include "os_functions.h"
+#include "../stringtools.h"
 
 CBufMgr::CBufMgr(unsigned int nbuf, unsigned int bsize)
+	: nbuf(nbuf), bsize(bsize), freebufs(nbuf), log_full(true)
 {
-	for(unsigned int i=0;i<nbuf;++i)
-	{
-		SBuffer buf;
-		buf.buffer=new char[bsize];
-		buf.used=false;
-		buffers.push_back( buf );
-	}
-	freebufs=nbuf;
+	init();
+}
 
+CBufMgr::CBufMgr(unsigned int nbuf, unsigned int bsize, bool log_full)
+	: nbuf(nbuf), bsize(bsize), freebufs(nbuf), log_full(log_full)
+{
+	init();
+}
+
+void CBufMgr::init(void)
+{
 	mutex=Server->createMutex();
 	cond=Server->createCondition();
 }
 
 CBufMgr::~CBufMgr(void)
 {
-	for(size_t i=0;i<buffers.size();++i)
+	if(!used_buffers.empty())
 	{
-		if( buffers[i].used==true )
-		{
-			Server->Log("Warning: Deleting used Buffer!", LL_DEBUG);
-		}
-		delete[] buffers[i].buffer;
+		Server->Log("Warning: Deleting buffer manager with used buffers!", LL_DEBUG);
+	}
+	for(std::set<char*>::iterator it=used_buffers.begin();it!=used_buffers.end();++it)
+	{
+		Server->releaseBuffer(*it, bsize);
 	}
 	Server->destroy(mutex);
 	Server->destroy(cond);
@@ -51,21 +55,23 @@ CBufMgr::~CBufMgr(void)
 
 char* CBufMgr::getBuffer(void)
 {
-	IScopedLock lock(mutex);
-	while(true)
 	{
-		for(size_t i=0;i<buffers.size();++i)
+		IScopedLock lock(mutex);
+		while(freebufs==0)
 		{
-			if( buffers[i].used==false )
+			if(log_full)
 			{
-				buffers[i].used=true;
-				--freebufs;
-				return buffers[i].buffer;
+				Server->Log("Buffers full... -1", LL_INFO);
 			}
+			cond->wait(&lock);
 		}
-		Server->Log("Buffers full... -1", LL_INFO);
-		cond->wait(&lock);
+		--freebufs;
 	}
+	char* ret=Server->allocateBuffer(bsize);
+
+	IScopedLock lock(mutex);
+	used_buffers.insert(ret);
+	return ret;
 }
 
 std::vector<char*> CBufMgr::getBuffers(unsigned int n)
@@ -73,101 +79,63 @@ std::vector<char*> CBufMgr::getBuffers(unsigned int n)
 	std::vector<char*> ret;
 	if(n==0)
 		return ret;
-	IScopedLock lock(mutex);
-	while(true)
 	{
-		for(size_t i=0;i<buffers.size();++i)
+		IScopedLock lock(mutex);
+		unsigned int reserved=0;
+		while(reserved<n)
 		{
-			if( buffers[i].used==false )
+			while(freebufs==0)
 			{
-				buffers[i].used=true;
-				--freebufs;
-				ret.push_back(buffers[i].buffer);
-				if(ret.size()>=n)
-					return ret;
+				if(log_full)
+				{
+					Server->Log("Buffers full... -2", LL_INFO);
+				}
+				cond->wait(&lock);
 			}
+			--freebufs;
+			++reserved;
 		}
-		Server->Log("Buffers full... -2", LL_INFO);
-		cond->wait(&lock);
 	}
-}
-
-void CBufMgr::releaseBuffer(char* buf)
-{
-	IScopedLock lock(mutex);
-	for(size_t i=0;i<buffers.size();++i)
+	ret.resize(n);
+	for(unsigned int i=0;i<n;++i)
 	{
-		if( buffers[i].buffer==buf )
-		{
-			++freebufs;
-			buffers[i].used=false;
-			cond->notify_one();
-			return;
-		}		
+		ret[i]=Server->allocateBuffer(bsize);
 	}
-	Server->Log("Warning: Buffer to free not found!", LL_WARNING);
-}
 
-unsigned int CBufMgr::nfreeBufffer(void)
-{
 	IScopedLock lock(mutex);
-	return freebufs;
+	used_buffers.insert(ret.begin(), ret.end());
+	return ret;
 }
 
-CBufMgr2::CBufMgr2(unsigned int nbuf, unsigned int bsize)
+void CBufMgr::releaseBuffer(char* buf)
 {
-	bufptr=new char[nbuf*bsize];
-	for(unsigned int i=0;i<nbuf;++i)
 	{
-		free_bufs.push(bufptr+i*bsize);
+		IScopedLock lock(mutex);
+		if(used_buffers.erase(buf)==0)
+		{
+			Server->Log("Warning: Buffer to free not found!", LL_WARNING);
+			return;
+		}
+		++freebufs;
+		cond->notify_one();
 	}
 
-	mutex=Server->createMutex();
-	cond=Server->createCondition();
-}
-
-CBufMgr2::~CBufMgr2(void)
-{
-	delete [] bufptr;
-	Server->destroy(mutex);
-	Server->destroy(cond);
+	Server->releaseBuffer(buf, bsize);
 }
 
-char* CBufMgr2::getBuffer(void)
+unsigned int CBufMgr::nfreeBufffer(void)
 {
 	IScopedLock lock(mutex);
-	while(free_bufs.empty())
-		cond->wait(&lock);
-	char *ret=free_bufs.top();
-	free_bufs.pop();
-	return ret;
+	return freebufs;
 }
 
-std::vector<char*> CBufMgr2::getBuffers(unsigned int n)
+CBufMgr2::CBufMgr2(unsigned int nbuf, unsigned int bsize, unsigned int alignment)
+	: CBufMgr(nbuf, bsize, false)
 {
-	std::vector<char*> ret;
-	IScopedLock lock(mutex);
-	while(ret.size()<n)
+	if(alignment>BUFFER_POOL_ALIGNMENT)
 	{
-		while(free_bufs.empty())
-			cond->wait(&lock);
-		ret.push_back(free_bufs.top());
-		free_bufs.pop();
+		Server->Log("Buffer alignment "+nconvert(alignment)+" is larger than the buffer pool alignment", LL_ERROR);
 	}
-	return ret;
-}
-
-void CBufMgr2::releaseBuffer(char* buf)
-{
-	IScopedLock lock(mutex);
-	free_bufs.push(buf);
-	cond->notify_one();
-}
-
-unsigned int CBufMgr2::nfreeBufffer(void)
-{
-	IScopedLock lock(mutex);
-	return (_u32)free_bufs.size();
 }
 
 CFileBufMgr::CFileBufMgr(bool pMemory)
@@ -1,56 +1,49 @@
 #include <vector>
-#include <stack>
+#include <set>
 
 #include "../Interface/Mutex.h"
 #include "../Interface/Condition.h"
 #include "../Interface/File.h"
 
-struct SBuffer
-{
-	char* buffer;
-	bool used;
-};
-
+//Hands out at most nbuf buffers of bsize bytes at a time and blocks
+//until one is released if all of them are in use. The memory itself
+//comes from the process wide buffer pool (Server->allocateBuffer) and
+//goes back to it on release. Buffers still checked out when the
+//manager is destroyed go back to the pool as well
 class CBufMgr
 {
 public:
 	CBufMgr(unsigned int nbuf, unsigned int bsize);
-	~CBufMgr(void);
+	virtual ~CBufMgr(void);
 
 	char* getBuffer(void);
 	std::vector<char*> getBuffers(unsigned int n);
 	void releaseBuffer(char* buf);
 	unsigned int nfreeBufffer(void);
 
+protected:
+	CBufMgr(unsigned int nbuf, unsigned int bsize, bool log_full);
+
 private:
+	void init(void);
 
-	std::vector<SBuffer> buffers;
+	unsigned int nbuf;
+	unsigned int bsize;
 	unsigned int freebufs;
+	bool log_full;
+	std::set<char*> used_buffers;
 
 	IMutex *mutex;
 	ICondition *cond;
 
 };
 
-class CBufMgr2
+class CBufMgr2 : public CBufMgr
 {
 public:
-	CBufMgr2(unsigned int nbuf, unsigned int bsize);
-	~CBufMgr2(void);
-
-	char* getBuffer(void);
-	std::vector<char*> getBuffers(unsigned int n);
-	void releaseBuffer(char* buf);
-	unsigned int nfreeBufffer(void);
-
-private:
-
-	std::stack<char*> free_bufs;
-	char *bufptr;
-
-	IMutex *mutex;
-	ICondition *cond;
-
+	//Buffers start at multiples of alignment. Pool buffers are aligned
+	//to BUFFER_POOL_ALIGNMENT, so alignment may not be larger than that
+	CBufMgr2(unsigned int nbuf, unsigned int bsize, unsigned int alignment=0);
 };
 
 class CFileBufMgr
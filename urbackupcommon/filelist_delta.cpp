@@ -0,0 +1,540 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2014 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "filelist_delta.h"
+#include "../Interface/File.h"
+#include "../stringtools.h"
+#include "os_functions.h"
+#include "sha2/sha2.h"
+#include <algorithm>
+#include <vector>
+#include <string.h>
+
+namespace
+{
+	const size_t c_buffer_size=512*1024;
+	//Subtrees smaller than this are sent as literals. A copy record would not be much smaller
+	const int64 c_min_subtree_size=128;
+	const char* c_delta_magic="URBACKUP FILELIST DELTA 1";
+
+	class BufferedFileReader
+	{
+	public:
+		BufferedFileReader(IFile* file)
+			: file(file), buffer(c_buffer_size), pos(0), end(0), buffer_offset(0)
+		{
+			file->Seek(0);
+		}
+
+		bool getChar(char& ch)
+		{
+			if(pos>=end && !fill())
+				return false;
+
+			ch=buffer[pos++];
+			return true;
+		}
+
+		bool readLine(std::string& line)
+		{
+			line.clear();
+			char ch;
+			while(getChar(ch))
+			{
+				if(ch=='\n')
+					return true;
+
+				line+=ch;
+			}
+			return false;
+		}
+
+		size_t read(char* buf, size_t bsize)
+		{
+			size_t read_bytes=0;
+			while(read_bytes<bsize)
+			{
+				if(pos>=end && !fill())
+					break;
+
+				size_t tocopy=(std::min)(bsize-read_bytes, end-pos);
+				memcpy(buf+read_bytes, &buffer[pos], tocopy);
+				pos+=tocopy;
+				read_bytes+=tocopy;
+			}
+			return read_bytes;
+		}
+
+		int64 tell(void)
+		{
+			return buffer_offset+pos;
+		}
+
+	private:
+		bool fill(void)
+		{
+			buffer_offset+=end;
+			pos=0;
+			end=file->Read(&buffer[0], static_cast<_u32>(buffer.size()));
+			return end>0;
+		}
+
+		IFile* file;
+		std::vector<char> buffer;
+		size_t pos;
+		size_t end;
+		int64 buffer_offset;
+	};
+
+	struct SDeltaOp
+	{
+		SDeltaOp(bool copy, int64 offset, int64 len)
+			: copy(copy), offset(offset), len(len)
+		{
+		}
+
+		bool copy;
+		int64 offset;
+		int64 len;
+	};
+
+	struct SSubtreeEntry
+	{
+		unsigned char digest[16];
+		int64 offset;
+		int64 len;
+
+		bool operator<(const SSubtreeEntry& other) const
+		{
+			return memcmp(digest, other.digest, sizeof(digest))<0;
+		}
+	};
+
+	struct SSubtreeFrame
+	{
+		sha256_ctx ctx;
+		int64 offset;
+		std::vector<SDeltaOp> ops;
+	};
+
+	void add_op(std::vector<SDeltaOp>& ops, const SDeltaOp& op)
+	{
+		if(!ops.empty() && ops.back().copy==op.copy
+			&& ops.back().offset+ops.back().len==op.offset)
+		{
+			ops.back().len+=op.len;
+		}
+		else
+		{
+			ops.push_back(op);
+		}
+	}
+
+	/**
+	* Reads one raw entry of the file list, including the terminating
+	* newline. Names are quoted and may contain escaped quotes and newlines,
+	* so this follows the same rules as the parser on the server.
+	*/
+	bool read_list_line(BufferedFileReader& reader, std::string& line, bool& isdir, bool& parent)
+	{
+		line.clear();
+		char ch;
+		if(!reader.getChar(ch))
+			return false;
+
+		line+=ch;
+		isdir=(ch=='d');
+		parent=false;
+
+		int state=0;
+		while(reader.getChar(ch))
+		{
+			line+=ch;
+			switch(state)
+			{
+			case 0:
+				//"
+				state=1;
+				break;
+			case 1:
+				if(ch=='\\')
+					state=2;
+				else if(ch=='"')
+					state=3;
+				break;
+			case 2:
+				state=1;
+				break;
+			case 3:
+				if(ch=='"')
+				{
+					state=1;
+				}
+				else if(isdir)
+				{
+					parent=(line.size()==6 && line.compare(0, 5, "d\"..\"")==0);
+					return true;
+				}
+				else if(ch=='\n')
+				{
+					return true;
+				}
+				else
+				{
+					state=4;
+				}
+				break;
+			case 4:
+				if(ch=='\n')
+					return true;
+				break;
+			}
+		}
+		return true;
+	}
+
+	/**
+	* Computes a hash per directory subtree (over the directory entry, its
+	* files, the hashes of its sub directories and the closing ".." entry).
+	* With index set the subtrees are collected, with base_index set
+	* subtrees also present in the base are turned into copy records.
+	*/
+	void scan_filelist(IFile* list, std::vector<SSubtreeEntry>* index, const std::vector<SSubtreeEntry>* base_index,
+		std::vector<SDeltaOp>* ops, std::string* hash)
+	{
+		BufferedFileReader reader(list);
+		std::vector<SSubtreeFrame> frames;
+		size_t depth=0;
+
+		sha256_ctx list_ctx;
+		sha256_init(&list_ctx);
+
+		unsigned char digest[SHA256_DIGEST_SIZE];
+		std::string line;
+		bool isdir;
+		bool parent;
+
+		while(true)
+		{
+			int64 offset=reader.tell();
+			if(!read_list_line(reader, line, isdir, parent))
+				break;
+
+			const unsigned char* ldata=reinterpret_cast<const unsigned char*>(line.data());
+			unsigned int lsize=static_cast<unsigned int>(line.size());
+			SDeltaOp literal(false, offset, line.size());
+
+			sha256_update(&list_ctx, ldata, lsize);
+
+			if(isdir && !parent)
+			{
+				if(depth==frames.size())
+				{
+					frames.push_back(SSubtreeFrame());
+				}
+
+				SSubtreeFrame& frame=frames[depth++];
+				sha256_init(&frame.ctx);
+				sha256_update(&frame.ctx, ldata, lsize);
+				frame.offset=offset;
+				frame.ops.clear();
+				if(ops!=NULL)
+				{
+					add_op(frame.ops, literal);
+				}
+			}
+			else if(isdir && depth>0)
+			{
+				SSubtreeFrame& frame=frames[--depth];
+				sha256_update(&frame.ctx, ldata, lsize);
+				sha256_final(&frame.ctx, digest);
+
+				if(ops!=NULL)
+				{
+					add_op(frame.ops, literal);
+				}
+
+				SSubtreeEntry entry;
+				memcpy(entry.digest, digest, sizeof(entry.digest));
+				entry.offset=frame.offset;
+				entry.len=offset+line.size()-frame.offset;
+
+				if(entry.len>=c_min_subtree_size)
+				{
+					if(index!=NULL)
+					{
+						index->push_back(entry);
+					}
+
+					if(base_index!=NULL)
+					{
+						std::vector<SSubtreeEntry>::const_iterator it=std::lower_bound(base_index->begin(), base_index->end(), entry);
+						if(it!=base_index->end()
+							&& memcmp(it->digest, entry.digest, sizeof(entry.digest))==0
+							&& it->len==entry.len)
+						{
+							frame.ops.clear();
+							frame.ops.push_back(SDeltaOp(true, it->offset, it->len));
+						}
+					}
+				}
+
+				if(ops!=NULL)
+				{
+					std::vector<SDeltaOp>& parent_ops = depth>0 ? frames[depth-1].ops : *ops;
+					for(size_t i=0;i<frame.ops.size();++i)
+					{
+						add_op(parent_ops, frame.ops[i]);
+					}
+				}
+
+				if(depth>0)
+				{
+					sha256_update(&frames[depth-1].ctx, digest, SHA256_DIGEST_SIZE);
+				}
+			}
+			else
+			{
+				if(depth>0)
+				{
+					sha256_update(&frames[depth-1].ctx, ldata, lsize);
+				}
+
+				if(ops!=NULL)
+				{
+					add_op(depth>0 ? frames[depth-1].ops : *ops, literal);
+				}
+			}
+		}
+
+		if(ops!=NULL)
+		{
+			while(depth>0)
+			{
+				--depth;
+				std::vector<SDeltaOp>& parent_ops = depth>0 ? frames[depth-1].ops : *ops;
+				for(size_t i=0;i<frames[depth].ops.size();++i)
+				{
+					add_op(parent_ops, frames[depth].ops[i]);
+				}
+			}
+		}
+
+		if(hash!=NULL)
+		{
+			sha256_final(&list_ctx, digest);
+			*hash=bytesToHex(digest, SHA256_DIGEST_SIZE);
+		}
+	}
+
+	bool write_all(IFile* file, const std::string& data)
+	{
+		return file->Write(data)==data.size();
+	}
+
+	bool copy_range(IFile* src, int64 offset, int64 len, IFile* dst, sha256_ctx* ctx, std::vector<char>& buffer)
+	{
+		if(!src->Seek(offset))
+			return false;
+
+		while(len>0)
+		{
+			_u32 toread=static_cast<_u32>((std::min)(len, static_cast<int64>(buffer.size())));
+			_u32 r=src->Read(&buffer[0], toread);
+			if(r!=toread)
+				return false;
+
+			if(ctx!=NULL)
+			{
+				sha256_update(ctx, reinterpret_cast<unsigned char*>(&buffer[0]), r);
+			}
+
+			if(dst->Write(&buffer[0], r)!=r)
+				return false;
+
+			len-=r;
+		}
+		return true;
+	}
+}
+
+std::string filelist_hash(IFile* list)
+{
+	if(!list->Seek(0))
+		return std::string();
+
+	sha256_ctx ctx;
+	sha256_init(&ctx);
+
+	std::vector<char> buffer(c_buffer_size);
+	_u32 r;
+	while((r=list->Read(&buffer[0], static_cast<_u32>(buffer.size())))>0)
+	{
+		sha256_update(&ctx, reinterpret_cast<unsigned char*>(&buffer[0]), r);
+	}
+
+	unsigned char digest[SHA256_DIGEST_SIZE];
+	sha256_final(&ctx, digest);
+	return bytesToHex(digest, SHA256_DIGEST_SIZE);
+}
+
+bool create_filelist_delta(IFile* base, IFile* new_list, IFile* delta, std::string* new_hash, int64* copied_bytes)
+{
+	std::vector<SSubtreeEntry> base_index;
+	std::string base_hash;
+	scan_filelist(base, &base_index, NULL, NULL, &base_hash);
+	std::sort(base_index.begin(), base_index.end());
+
+	std::vector<SDeltaOp> ops;
+	std::string hash;
+	scan_filelist(new_list, NULL, &base_index, &ops, &hash);
+
+	std::vector<SSubtreeEntry>().swap(base_index);
+
+	if(!write_all(delta, std::string(c_delta_magic)+"\n"
+			+"base "+base_hash+"\n"
+			+"new "+hash+" "+nconvert(new_list->Size())+"\n"))
+	{
+		return false;
+	}
+
+	int64 copied=0;
+	std::vector<char> buffer(c_buffer_size);
+	for(size_t i=0;i<ops.size();++i)
+	{
+		if(ops[i].copy)
+		{
+			if(!write_all(delta, "c "+nconvert(ops[i].offset)+" "+nconvert(ops[i].len)+"\n"))
+				return false;
+
+			copied+=ops[i].len;
+		}
+		else
+		{
+			if(!write_all(delta, "l "+nconvert(ops[i].len)+"\n")
+				|| !copy_range(new_list, ops[i].offset, ops[i].len, delta, NULL, buffer))
+			{
+				return false;
+			}
+		}
+	}
+
+	if(!write_all(delta, "end\n"))
+		return false;
+
+	if(new_hash!=NULL)
+	{
+		*new_hash=hash;
+	}
+
+	if(copied_bytes!=NULL)
+	{
+		*copied_bytes=copied;
+	}
+
+	return true;
+}
+
+bool apply_filelist_delta(IFile* base, const std::string& base_hash, IFile* delta, IFile* new_list, std::string* new_hash)
+{
+	BufferedFileReader reader(delta);
+
+	std::string line;
+	if(!reader.readLine(line) || line!=c_delta_magic)
+		return false;
+
+	if(!reader.readLine(line) || base_hash.empty() || line!="base "+base_hash)
+		return false;
+
+	if(!reader.readLine(line) || next(line, 0, "new ")==false)
+		return false;
+
+	std::string hash=getuntil(" ", line.substr(4));
+	int64 new_size=os_atoi64(getafter(" ", line.substr(4)));
+
+	int64 base_size=base->Size();
+	int64 written=0;
+
+	sha256_ctx ctx;
+	sha256_init(&ctx);
+
+	std::vector<char> buffer(c_buffer_size);
+
+	while(true)
+	{
+		if(!reader.readLine(line))
+			return false;
+
+		if(line=="end")
+			break;
+
+		if(next(line, 0, "c "))
+		{
+			int64 offset=os_atoi64(getuntil(" ", line.substr(2)));
+			int64 len=os_atoi64(getafter(" ", line.substr(2)));
+
+			if(offset<0 || len<0 || offset+len>base_size
+				|| !copy_range(base, offset, len, new_list, &ctx, buffer))
+			{
+				return false;
+			}
+
+			written+=len;
+		}
+		else if(next(line, 0, "l "))
+		{
+			int64 len=os_atoi64(line.substr(2));
+			if(len<0)
+				return false;
+
+			while(len>0)
+			{
+				size_t toread=static_cast<size_t>((std::min)(len, static_cast<int64>(buffer.size())));
+				if(reader.read(&buffer[0], toread)!=toread)
+					return false;
+
+				sha256_update(&ctx, reinterpret_cast<unsigned char*>(&buffer[0]), static_cast<unsigned int>(toread));
+
+				if(new_list->Write(&buffer[0], static_cast<_u32>(toread))!=toread)
+					return false;
+
+				len-=toread;
+				written+=toread;
+			}
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	if(written!=new_size)
+		return false;
+
+	unsigned char digest[SHA256_DIGEST_SIZE];
+	sha256_final(&ctx, digest);
+	if(bytesToHex(digest, SHA256_DIGEST_SIZE)!=hash)
+		return false;
+
+	if(new_hash!=NULL)
+	{
+		*new_hash=hash;
+	}
+
+	return true;
+}
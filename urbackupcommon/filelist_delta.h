@@ -0,0 +1,41 @@
+#ifndef FILELIST_DELTA_H
+#define FILELIST_DELTA_H
+
+#include <string>
+
+#include "../Interface/Types.h"
+
+class IFile;
+
+/**
+* Incremental transfer of urbackup/filelist.ub.
+*
+* The client keeps the file lists the server has acknowledged (keyed by
+* their sha256) and, if the server names one of them as base, sends a delta
+* instead of the whole list. The delta consists of copy records referencing
+* directory subtrees of the base which did not change and literal records
+* for everything else:
+*
+*   URBACKUP FILELIST DELTA 1
+*   base <sha256 of base>
+*   new <sha256 of new list> <size of new list>
+*   c <offset in base> <length>
+*   l <length>
+*   <length bytes>
+*   end
+*
+* The server rebuilds the list from its copy of the base and verifies the
+* result against the hash and size in the header. If anything does not
+* match it falls back to transferring the full list.
+*/
+
+//Returns the hex encoded sha256 of the file content or an empty string on error
+std::string filelist_hash(IFile* list);
+
+//Writes a delta transforming base into new_list. new_hash receives the hash of new_list
+bool create_filelist_delta(IFile* base, IFile* new_list, IFile* delta, std::string* new_hash, int64* copied_bytes=NULL);
+
+//Reconstructs new_list from base and delta. Fails if base_hash is not the base the delta was created against
+bool apply_filelist_delta(IFile* base, const std::string& base_hash, IFile* delta, IFile* new_list, std::string* new_hash);
+
+#endif //FILELIST_DELTA_H
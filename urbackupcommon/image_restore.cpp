@@ -0,0 +1,217 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2014 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "image_restore.h"
+#include "../Interface/Server.h"
+#include "../Interface/File.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
+#include "sha2/sha2.h"
+#include <memory.h>
+
+RestoreImageWriter::RestoreImageWriter(IFile* out_file)
+	: out_file(out_file), exit(false), has_error(false), written_bytes(0)
+{
+	mutex=Server->createMutex();
+	cond=Server->createCondition();
+
+	for(size_t i=0;i<c_ring_size;++i)
+	{
+		free_buffers.push_back(new char[c_ring_buffer_size]);
+	}
+
+	curr.buf=NULL;
+	curr.pos=0;
+	curr.size=0;
+}
+
+RestoreImageWriter::~RestoreImageWriter(void)
+{
+	if(curr.buf!=NULL)
+	{
+		free_buffers.push_back(curr.buf);
+	}
+	for(size_t i=0;i<full_buffers.size();++i)
+	{
+		free_buffers.push_back(full_buffers[i].buf);
+	}
+	for(size_t i=0;i<free_buffers.size();++i)
+	{
+		delete[] free_buffers[i];
+	}
+	Server->destroy(mutex);
+	Server->destroy(cond);
+}
+
+void RestoreImageWriter::operator()(void)
+{
+	while(true)
+	{
+		SRestoreBuffer item;
+		{
+			IScopedLock lock(mutex);
+			while(full_buffers.empty() && !exit)
+			{
+				cond->wait(&lock);
+			}
+			if(full_buffers.empty())
+			{
+				return;
+			}
+			item=full_buffers.front();
+			full_buffers.pop_front();
+		}
+
+		bool ok=writeBuffer(item);
+
+		IScopedLock lock(mutex);
+		if(!ok)
+		{
+			has_error=true;
+		}
+		else
+		{
+			written_bytes+=item.size;
+		}
+		free_buffers.push_back(item.buf);
+		cond->notify_all();
+	}
+}
+
+bool RestoreImageWriter::write(_i64 pos, const char* buf, _u32 bsize)
+{
+	if(curr.buf!=NULL && (curr.pos+curr.size!=pos || curr.size+bsize>c_ring_buffer_size) )
+	{
+		submit();
+	}
+
+	if(curr.buf==NULL)
+	{
+		IScopedLock lock(mutex);
+		while(free_buffers.empty() && !has_error)
+		{
+			cond->wait(&lock);
+		}
+		if(has_error)
+		{
+			return false;
+		}
+		curr.buf=free_buffers.back();
+		free_buffers.pop_back();
+		curr.pos=pos;
+		curr.size=0;
+	}
+
+	memcpy(curr.buf+curr.size, buf, bsize);
+	curr.size+=bsize;
+	return true;
+}
+
+void RestoreImageWriter::doExit(void)
+{
+	if(curr.buf!=NULL)
+	{
+		submit();
+	}
+	IScopedLock lock(mutex);
+	exit=true;
+	cond->notify_all();
+}
+
+bool RestoreImageWriter::hasError(void)
+{
+	IScopedLock lock(mutex);
+	return has_error;
+}
+
+_i64 RestoreImageWriter::getWrittenBytes(void)
+{
+	IScopedLock lock(mutex);
+	return written_bytes;
+}
+
+void RestoreImageWriter::submit(void)
+{
+	IScopedLock lock(mutex);
+	full_buffers.push_back(curr);
+	curr.buf=NULL;
+	cond->notify_all();
+}
+
+bool RestoreImageWriter::writeBuffer(const SRestoreBuffer& item)
+{
+	if(!out_file->Seek(item.pos))
+	{
+		Server->Log("Seeking in output file failed", LL_ERROR);
+		return false;
+	}
+
+	_u32 woff=0;
+	do
+	{
+		_u32 w=out_file->Write(&item.buf[woff], item.size-woff);
+		if(w==0)
+		{
+			Server->Log("Writing to output file failed", LL_ERROR);
+			return false;
+		}
+		woff+=w;
+	}
+	while(item.size-woff>0);
+
+	return true;
+}
+
+IFile* hashRestoreTarget(IFile* out_file)
+{
+	const _u32 c_hash_blocksize=512*1024;
+
+	IFile* ret=Server->openTemporaryFile();
+	if(ret==NULL)
+	{
+		Server->Log("Error opening temporary file for restore hashes", LL_ERROR);
+		return NULL;
+	}
+
+	Server->Log("Hashing restore target for delta restore...", LL_INFO);
+
+	std::vector<char> buf(c_hash_blocksize);
+	out_file->Seek(0);
+	_u32 read;
+	do
+	{
+		read=0;
+		_u32 r;
+		while(read<c_hash_blocksize && (r=out_file->Read(&buf[read], c_hash_blocksize-read))>0)
+		{
+			read+=r;
+		}
+
+		if(read>0)
+		{
+			unsigned char dig[SHA256_DIGEST_SIZE];
+			sha256((unsigned char*)&buf[0], read, dig);
+			ret->Write((char*)dig, SHA256_DIGEST_SIZE);
+		}
+	}
+	while(read==c_hash_blocksize);
+
+	out_file->Seek(0);
+
+	return ret;
+}
@@ -0,0 +1,67 @@
+#ifndef IMAGE_RESTORE_H
+#define IMAGE_RESTORE_H
+
+#include <vector>
+#include <deque>
+
+#include "../Interface/Types.h"
+#include "../Interface/Thread.h"
+
+class IFile;
+class IMutex;
+class ICondition;
+
+/**
+* Writes downloaded image blocks to the restore target in a separate thread.
+* Adjacent blocks are coalesced into large sequential writes and the
+* bounded buffer ring overlaps network receive with device writes.
+*/
+class RestoreImageWriter : public IThread
+{
+public:
+	RestoreImageWriter(IFile* out_file);
+	~RestoreImageWriter(void);
+
+	void operator()(void);
+
+	bool write(_i64 pos, const char* buf, _u32 bsize);
+
+	void doExit(void);
+
+	bool hasError(void);
+
+	_i64 getWrittenBytes(void);
+
+private:
+	struct SRestoreBuffer
+	{
+		char* buf;
+		_i64 pos;
+		_u32 size;
+	};
+
+	void submit(void);
+
+	bool writeBuffer(const SRestoreBuffer& item);
+
+	static const size_t c_ring_size=16;
+	static const _u32 c_ring_buffer_size=1024*1024;
+
+	IFile* out_file;
+	IMutex* mutex;
+	ICondition* cond;
+	std::vector<char*> free_buffers;
+	std::deque<SRestoreBuffer> full_buffers;
+	SRestoreBuffer curr;
+	bool exit;
+	bool has_error;
+	_i64 written_bytes;
+};
+
+/**
+* Hashes the restore target per 512KB block (SHA-256, the layout of the
+* image .hash files) into a temporary file for a delta restore
+*/
+IFile* hashRestoreTarget(IFile* out_file);
+
+#endif //IMAGE_RESTORE_H
@@ -1,5 +1,9 @@
 enum InternetPipeCapabilities
 {
 	IPC_ENCRYPTED=1,
-	IPC_COMPRESSED=2
+	IPC_COMPRESSED=2,
+	//Compressed pipe with 32 bit frames, flushed before reading, by an explicit flush or when the writer is idle
+	IPC_COMPRESSED_STREAM=4,
+	//Encrypted pipe switches to AES-GCM records after the capabilities
+	IPC_ENCRYPTED_AEAD=8
 };
\ No newline at end of file
@@ -133,5 +133,8 @@ std::vector<std::wstring> getGlobalSettingsList(void)
 	ret.push_back(L"trust_client_hashes");
 	ret.push_back(L"show_server_updates");
 	ret.push_back(L"use_incremental_symlinks");
+	ret.push_back(L"synthetic_full_images");
+	ret.push_back(L"synthetic_full_image_speed");
+	ret.push_back(L"synthetic_full_file_backups");
 	return ret;
 }
\ No newline at end of file
@@ -207,10 +207,490 @@ uint64 sha512_k[80] =
              0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
              0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL};
 
+/* Hardware accelerated implementations
+ *
+ * The transforms below are selected at runtime. SHA-256 uses the SHA
+ * extensions if available. The multi-buffer functions hash four (SHA-512)
+ * or eight (SHA-256) independent messages at once in the lanes of AVX2
+ * registers.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) \
+    || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SHA2_X86
+#define SHA2_TARGET_SHANI __attribute__((target("sha,sse4.1,ssse3")))
+#define SHA2_TARGET_AVX2 __attribute__((target("avx2")))
+#define SHA2_TARGET_AVX2_BMI2 __attribute__((target("avx2,bmi2")))
+#include <immintrin.h>
+#include <cpuid.h>
+#elif defined(_MSC_VER) && _MSC_VER >= 1900 && (defined(_M_X64) || defined(_M_IX86))
+#define SHA2_X86
+#define SHA2_TARGET_SHANI
+#define SHA2_TARGET_AVX2
+#define SHA2_TARGET_AVX2_BMI2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#define SHA256_MB_LANES 8
+#define SHA512_MB_LANES 4
+
+static int sha2_cpu_checked = 0;
+static int sha2_have_shani = 0;
+static int sha2_have_avx2 = 0;
+static int sha2_have_bmi2 = 0;
+static int sha2_accel = 1;
+
+#ifdef SHA2_X86
+
+static void sha2_cpuid(unsigned int leaf, unsigned int subleaf,
+                       unsigned int regs[4])
+{
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, (int) leaf, (int) subleaf);
+    regs[0] = (unsigned int) r[0]; regs[1] = (unsigned int) r[1];
+    regs[2] = (unsigned int) r[2]; regs[3] = (unsigned int) r[3];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64 sha2_xgetbv(void)
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    return ((uint64) edx << 32) | eax;
+#endif
+}
+
+static void sha2_check_cpu(void)
+{
+    unsigned int regs[4];
+    unsigned int max_leaf;
+    int have_sse41, have_ssse3, have_ymm;
+
+    sha2_cpuid(0, 0, regs);
+    max_leaf = regs[0];
+
+    if (max_leaf >= 7) {
+        sha2_cpuid(1, 0, regs);
+        have_ssse3 = (regs[2] & (1 << 9)) != 0;
+        have_sse41 = (regs[2] & (1 << 19)) != 0;
+        /* OSXSAVE and AVX, then check that the OS saves the YMM state */
+        have_ymm = (regs[2] & (1 << 27)) != 0 && (regs[2] & (1 << 28)) != 0
+                   && (sha2_xgetbv() & 6) == 6;
+
+        sha2_cpuid(7, 0, regs);
+        sha2_have_shani = have_ssse3 && have_sse41 && (regs[1] & (1 << 29)) != 0;
+        sha2_have_avx2 = have_ymm && (regs[1] & (1 << 5)) != 0;
+        sha2_have_bmi2 = (regs[1] & (1 << 8)) != 0;
+    }
+
+    sha2_cpu_checked = 1;
+}
+
+#else
+
+static void sha2_check_cpu(void)
+{
+    sha2_cpu_checked = 1;
+}
+
+#endif /* SHA2_X86 */
+
+static int sha2_use_shani(void)
+{
+    if (!sha2_cpu_checked) {
+        sha2_check_cpu();
+    }
+    return sha2_accel && sha2_have_shani;
+}
+
+static int sha2_use_avx2(void)
+{
+    if (!sha2_cpu_checked) {
+        sha2_check_cpu();
+    }
+    return sha2_accel && sha2_have_avx2;
+}
+
+static int sha2_use_avx2_bmi2(void)
+{
+    return sha2_use_avx2() && sha2_have_bmi2;
+}
+
+void sha2_set_accel(int enable)
+{
+    sha2_accel = enable;
+}
+
+const char *sha256_impl_name(void)
+{
+    return sha2_use_shani() ? "shani" : "c";
+}
+
+const char *sha512_impl_name(void)
+{
+    return sha2_use_avx2_bmi2() ? "avx2" : "c";
+}
+
+const char *sha256_mb_impl_name(void)
+{
+    if (sha2_use_shani()) {
+        return "shani";
+    }
+    return sha2_use_avx2() ? "avx2" : "c";
+}
+
+const char *sha512_mb_impl_name(void)
+{
+    return sha2_use_avx2() ? "avx2" : "c";
+}
+
+#ifdef SHA2_X86
+
+/* SHA-256 with the SHA extensions. State is kept as ABEF/CDGH */
+
+#define SHA256_NI_RNDS(msg, k)                                  \
+{                                                               \
+    tmp = _mm_add_epi32(msg,                                    \
+            _mm_loadu_si128((const __m128i *) &sha256_k[k]));   \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);        \
+    tmp = _mm_shuffle_epi32(tmp, 0x0E);                         \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, tmp);        \
+}
+
+#define SHA256_NI_RNDS_SCHED(cur, prev, next, k)                \
+{                                                               \
+    tmp = _mm_add_epi32(cur,                                    \
+            _mm_loadu_si128((const __m128i *) &sha256_k[k]));   \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);        \
+    tmp = _mm_shuffle_epi32(tmp, 0x0E);                         \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, tmp);        \
+    next = _mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4));  \
+    next = _mm_sha256msg2_epu32(next, cur);                     \
+    prev = _mm_sha256msg1_epu32(prev, cur);                     \
+}
+
+SHA2_TARGET_SHANI
+static void sha256_transf_shani(sha256_ctx *ctx, const unsigned char *message,
+                                unsigned int block_nb)
+{
+    __m128i state0, state1, tmp, abef, cdgh;
+    __m128i msg0, msg1, msg2, msg3;
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+
+    tmp = _mm_loadu_si128((const __m128i *) &ctx->h[0]);
+    state1 = _mm_loadu_si128((const __m128i *) &ctx->h[4]);
+
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    while (block_nb--) {
+        abef = state0;
+        cdgh = state1;
+
+        msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) message), mask);
+        msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (message + 16)), mask);
+        msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (message + 32)), mask);
+        msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (message + 48)), mask);
+
+        SHA256_NI_RNDS(msg0, 0);
+        SHA256_NI_RNDS(msg1, 4);
+        msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+        SHA256_NI_RNDS(msg2, 8);
+        msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+        SHA256_NI_RNDS_SCHED(msg3, msg2, msg0, 12);
+        SHA256_NI_RNDS_SCHED(msg0, msg3, msg1, 16);
+        SHA256_NI_RNDS_SCHED(msg1, msg0, msg2, 20);
+        SHA256_NI_RNDS_SCHED(msg2, msg1, msg3, 24);
+        SHA256_NI_RNDS_SCHED(msg3, msg2, msg0, 28);
+        SHA256_NI_RNDS_SCHED(msg0, msg3, msg1, 32);
+        SHA256_NI_RNDS_SCHED(msg1, msg0, msg2, 36);
+        SHA256_NI_RNDS_SCHED(msg2, msg1, msg3, 40);
+        SHA256_NI_RNDS_SCHED(msg3, msg2, msg0, 44);
+        SHA256_NI_RNDS_SCHED(msg0, msg3, msg1, 48);
+
+        tmp = _mm_add_epi32(msg1, _mm_loadu_si128((const __m128i *) &sha256_k[52]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        msg2 = _mm_add_epi32(msg2, _mm_alignr_epi8(msg1, msg0, 4));
+        msg2 = _mm_sha256msg2_epu32(msg2, msg1);
+        tmp = _mm_shuffle_epi32(tmp, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, tmp);
+
+        tmp = _mm_add_epi32(msg2, _mm_loadu_si128((const __m128i *) &sha256_k[56]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+        msg3 = _mm_add_epi32(msg3, _mm_alignr_epi8(msg2, msg1, 4));
+        msg3 = _mm_sha256msg2_epu32(msg3, msg2);
+        tmp = _mm_shuffle_epi32(tmp, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, tmp);
+
+        SHA256_NI_RNDS(msg3, 60);
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+
+        message += SHA256_BLOCK_SIZE;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128((__m128i *) &ctx->h[0], state0);
+    _mm_storeu_si128((__m128i *) &ctx->h[4], state1);
+}
+
+/* Single buffer SHA-512. The message schedule is computed two words at a
+   time in vector registers, the rounds use the BMI2 rotations. */
+
+#define SSE_ROTR64(x, n) _mm_or_si128(_mm_srli_epi64(x, n), \
+                                      _mm_slli_epi64(x, 64 - (n)))
+
+SHA2_TARGET_AVX2_BMI2
+static void sha512_transf_avx2(sha512_ctx *ctx, const unsigned char *message,
+                               unsigned int block_nb)
+{
+    uint64 w[80];
+    uint64 a, b, c, d, e, f, g, h;
+    uint64 t1, t2;
+    __m128i x, x2, x15, s0, s1;
+    const __m128i mask = _mm_set_epi64x(0x08090a0b0c0d0e0fULL,
+                                        0x0001020304050607ULL);
+    int j;
+
+    while (block_nb--) {
+        for (j = 0; j < 16; j += 2) {
+            x = _mm_loadu_si128((const __m128i *) (message + (j << 3)));
+            _mm_storeu_si128((__m128i *) &w[j], _mm_shuffle_epi8(x, mask));
+        }
+
+        for (j = 16; j < 80; j += 2) {
+            x2 = _mm_loadu_si128((const __m128i *) &w[j - 2]);
+            x15 = _mm_loadu_si128((const __m128i *) &w[j - 15]);
+            s1 = _mm_xor_si128(_mm_xor_si128(SSE_ROTR64(x2, 19), SSE_ROTR64(x2, 61)),
+                               _mm_srli_epi64(x2, 6));
+            s0 = _mm_xor_si128(_mm_xor_si128(SSE_ROTR64(x15, 1), SSE_ROTR64(x15, 8)),
+                               _mm_srli_epi64(x15, 7));
+            x = _mm_add_epi64(_mm_add_epi64(s1, _mm_loadu_si128((const __m128i *) &w[j - 7])),
+                              _mm_add_epi64(s0, _mm_loadu_si128((const __m128i *) &w[j - 16])));
+            _mm_storeu_si128((__m128i *) &w[j], x);
+        }
+
+        for (j = 0; j < 80; j += 2) {
+            x = _mm_add_epi64(_mm_loadu_si128((const __m128i *) &w[j]),
+                              _mm_loadu_si128((const __m128i *) &sha512_k[j]));
+            _mm_storeu_si128((__m128i *) &w[j], x);
+        }
+
+        a = ctx->h[0]; b = ctx->h[1]; c = ctx->h[2]; d = ctx->h[3];
+        e = ctx->h[4]; f = ctx->h[5]; g = ctx->h[6]; h = ctx->h[7];
+
+        for (j = 0; j < 80; j++) {
+            t1 = h + SHA512_F2(e) + CH(e, f, g) + w[j];
+            t2 = SHA512_F1(a) + MAJ(a, b, c);
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        ctx->h[0] += a; ctx->h[1] += b; ctx->h[2] += c; ctx->h[3] += d;
+        ctx->h[4] += e; ctx->h[5] += f; ctx->h[6] += g; ctx->h[7] += h;
+
+        message += SHA512_BLOCK_SIZE;
+    }
+}
+
+/* Multi-buffer SHA-256 (eight lanes) and SHA-512 (four lanes) with AVX2.
+   Lane i of every register belongs to message i. */
+
+static uint32 sha2_load32(const unsigned char *p)
+{
+    uint32 r;
+    memcpy(&r, p, sizeof(r));
+    return r;
+}
+
+static uint64 sha2_load64(const unsigned char *p)
+{
+    uint64 r;
+    memcpy(&r, p, sizeof(r));
+    return r;
+}
+
+#define AVX2_ROTR32(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), \
+                                          _mm256_slli_epi32(x, 32 - (n)))
+#define AVX2_ROTR64(x, n) _mm256_or_si256(_mm256_srli_epi64(x, n), \
+                                          _mm256_slli_epi64(x, 64 - (n)))
+#define AVX2_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define AVX2_CH(x, y, z) _mm256_xor_si256(_mm256_and_si256(x, y), \
+                                          _mm256_andnot_si256(x, z))
+#define AVX2_MAJ(x, y, z) _mm256_xor_si256(_mm256_and_si256(x, y), \
+                          _mm256_and_si256(z, _mm256_xor_si256(x, y)))
+
+#define AVX2_SHA256_F1(x) AVX2_XOR3(AVX2_ROTR32(x,  2), AVX2_ROTR32(x, 13), AVX2_ROTR32(x, 22))
+#define AVX2_SHA256_F2(x) AVX2_XOR3(AVX2_ROTR32(x,  6), AVX2_ROTR32(x, 11), AVX2_ROTR32(x, 25))
+#define AVX2_SHA256_F3(x) AVX2_XOR3(AVX2_ROTR32(x,  7), AVX2_ROTR32(x, 18), _mm256_srli_epi32(x,  3))
+#define AVX2_SHA256_F4(x) AVX2_XOR3(AVX2_ROTR32(x, 17), AVX2_ROTR32(x, 19), _mm256_srli_epi32(x, 10))
+
+#define AVX2_SHA512_F1(x) AVX2_XOR3(AVX2_ROTR64(x, 28), AVX2_ROTR64(x, 34), AVX2_ROTR64(x, 39))
+#define AVX2_SHA512_F2(x) AVX2_XOR3(AVX2_ROTR64(x, 14), AVX2_ROTR64(x, 18), AVX2_ROTR64(x, 41))
+#define AVX2_SHA512_F3(x) AVX2_XOR3(AVX2_ROTR64(x,  1), AVX2_ROTR64(x,  8), _mm256_srli_epi64(x,  7))
+#define AVX2_SHA512_F4(x) AVX2_XOR3(AVX2_ROTR64(x, 19), AVX2_ROTR64(x, 61), _mm256_srli_epi64(x,  6))
+
+SHA2_TARGET_AVX2
+static void sha256_transf_avx2_x8(uint32 *h[SHA256_MB_LANES],
+                                  const unsigned char *message[SHA256_MB_LANES],
+                                  unsigned int block_nb)
+{
+    __m256i w[16];
+    __m256i wv[8];
+    __m256i st[8];
+    __m256i t1, t2;
+    const __m256i mask = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL,
+                                           0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    unsigned int i;
+    int j;
+
+    for (j = 0; j < 8; j++) {
+        st[j] = _mm256_set_epi32((int) h[7][j], (int) h[6][j], (int) h[5][j], (int) h[4][j],
+                                 (int) h[3][j], (int) h[2][j], (int) h[1][j], (int) h[0][j]);
+    }
+
+    for (i = 0; i < block_nb; i++) {
+        size_t off = (size_t) i << 6;
+
+        for (j = 0; j < 8; j++) {
+            wv[j] = st[j];
+        }
+
+        for (j = 0; j < 64; j++) {
+            __m256i wj;
+            if (j < 16) {
+                size_t o = off + (j << 2);
+                wj = _mm256_set_epi32((int) sha2_load32(message[7] + o), (int) sha2_load32(message[6] + o),
+                                      (int) sha2_load32(message[5] + o), (int) sha2_load32(message[4] + o),
+                                      (int) sha2_load32(message[3] + o), (int) sha2_load32(message[2] + o),
+                                      (int) sha2_load32(message[1] + o), (int) sha2_load32(message[0] + o));
+                wj = _mm256_shuffle_epi8(wj, mask);
+            } else {
+                wj = _mm256_add_epi32(
+                        _mm256_add_epi32(AVX2_SHA256_F4(w[(j - 2) & 15]), w[(j - 7) & 15]),
+                        _mm256_add_epi32(AVX2_SHA256_F3(w[(j - 15) & 15]), w[j & 15]));
+            }
+            w[j & 15] = wj;
+
+            t1 = _mm256_add_epi32(_mm256_add_epi32(wv[7], AVX2_SHA256_F2(wv[4])),
+                                  _mm256_add_epi32(AVX2_CH(wv[4], wv[5], wv[6]),
+                                  _mm256_add_epi32(_mm256_set1_epi32((int) sha256_k[j]), wj)));
+            t2 = _mm256_add_epi32(AVX2_SHA256_F1(wv[0]), AVX2_MAJ(wv[0], wv[1], wv[2]));
+            wv[7] = wv[6];
+            wv[6] = wv[5];
+            wv[5] = wv[4];
+            wv[4] = _mm256_add_epi32(wv[3], t1);
+            wv[3] = wv[2];
+            wv[2] = wv[1];
+            wv[1] = wv[0];
+            wv[0] = _mm256_add_epi32(t1, t2);
+        }
+
+        for (j = 0; j < 8; j++) {
+            st[j] = _mm256_add_epi32(st[j], wv[j]);
+        }
+    }
+
+    for (j = 0; j < 8; j++) {
+        uint32 lanes[SHA256_MB_LANES];
+        int l;
+        _mm256_storeu_si256((__m256i *) lanes, st[j]);
+        for (l = 0; l < SHA256_MB_LANES; l++) {
+            h[l][j] = lanes[l];
+        }
+    }
+}
+
+SHA2_TARGET_AVX2
+static void sha512_transf_avx2_x4(uint64 *h[SHA512_MB_LANES],
+                                  const unsigned char *message[SHA512_MB_LANES],
+                                  unsigned int block_nb)
+{
+    __m256i w[16];
+    __m256i wv[8];
+    __m256i st[8];
+    __m256i t1, t2;
+    const __m256i mask = _mm256_set_epi64x(0x08090a0b0c0d0e0fULL, 0x0001020304050607ULL,
+                                           0x08090a0b0c0d0e0fULL, 0x0001020304050607ULL);
+    unsigned int i;
+    int j;
+
+    for (j = 0; j < 8; j++) {
+        st[j] = _mm256_set_epi64x((long long) h[3][j], (long long) h[2][j],
+                                  (long long) h[1][j], (long long) h[0][j]);
+    }
+
+    for (i = 0; i < block_nb; i++) {
+        size_t off = (size_t) i << 7;
+
+        for (j = 0; j < 8; j++) {
+            wv[j] = st[j];
+        }
+
+        for (j = 0; j < 80; j++) {
+            __m256i wj;
+            if (j < 16) {
+                size_t o = off + (j << 3);
+                wj = _mm256_set_epi64x((long long) sha2_load64(message[3] + o), (long long) sha2_load64(message[2] + o),
+                                       (long long) sha2_load64(message[1] + o), (long long) sha2_load64(message[0] + o));
+                wj = _mm256_shuffle_epi8(wj, mask);
+            } else {
+                wj = _mm256_add_epi64(
+                        _mm256_add_epi64(AVX2_SHA512_F4(w[(j - 2) & 15]), w[(j - 7) & 15]),
+                        _mm256_add_epi64(AVX2_SHA512_F3(w[(j - 15) & 15]), w[j & 15]));
+            }
+            w[j & 15] = wj;
+
+            t1 = _mm256_add_epi64(_mm256_add_epi64(wv[7], AVX2_SHA512_F2(wv[4])),
+                                  _mm256_add_epi64(AVX2_CH(wv[4], wv[5], wv[6]),
+                                  _mm256_add_epi64(_mm256_set1_epi64x((long long) sha512_k[j]), wj)));
+            t2 = _mm256_add_epi64(AVX2_SHA512_F1(wv[0]), AVX2_MAJ(wv[0], wv[1], wv[2]));
+            wv[7] = wv[6];
+            wv[6] = wv[5];
+            wv[5] = wv[4];
+            wv[4] = _mm256_add_epi64(wv[3], t1);
+            wv[3] = wv[2];
+            wv[2] = wv[1];
+            wv[1] = wv[0];
+            wv[0] = _mm256_add_epi64(t1, t2);
+        }
+
+        for (j = 0; j < 8; j++) {
+            st[j] = _mm256_add_epi64(st[j], wv[j]);
+        }
+    }
+
+    for (j = 0; j < 8; j++) {
+        uint64 lanes[SHA512_MB_LANES];
+        int l;
+        _mm256_storeu_si256((__m256i *) lanes, st[j]);
+        for (l = 0; l < SHA512_MB_LANES; l++) {
+            h[l][j] = lanes[l];
+        }
+    }
+}
+
+#endif /* SHA2_X86 */
+
 /* SHA-256 functions */
 
-void sha256_transf(sha256_ctx *ctx, const unsigned char *message,
-                   unsigned int block_nb)
+static void sha256_transf_c(sha256_ctx *ctx, const unsigned char *message,
+                            unsigned int block_nb)
 {
     uint32 w[64];
     uint32 wv[8];
@@ -324,6 +804,18 @@ void sha256_transf(sha256_ctx *ctx, const unsigned char *message,
     }
 }
 
+void sha256_transf(sha256_ctx *ctx, const unsigned char *message,
+                   unsigned int block_nb)
+{
+#ifdef SHA2_X86
+    if (sha2_use_shani()) {
+        sha256_transf_shani(ctx, message, block_nb);
+        return;
+    }
+#endif
+    sha256_transf_c(ctx, message, block_nb);
+}
+
 void sha256(const unsigned char *message, unsigned int len, unsigned char *digest)
 {
     sha256_ctx ctx;
@@ -423,10 +915,109 @@ void sha256_final(sha256_ctx *ctx, unsigned char *digest)
 #endif /* !UNROLL_LOOPS */
 }
 
+#ifdef SHA2_X86
+
+static void sha256_transf_mb(sha256_ctx *ctx[], const unsigned char *message[],
+                             unsigned int n, unsigned int block_nb)
+{
+    uint32 *h[SHA256_MB_LANES];
+    const unsigned char *lane_message[SHA256_MB_LANES];
+    uint32 unused_h[SHA256_MB_LANES][8];
+    unsigned int i;
+
+    if (block_nb == 0) {
+        return;
+    }
+
+    for (i = 0; i < SHA256_MB_LANES; i++) {
+        if (i < n) {
+            h[i] = ctx[i]->h;
+            lane_message[i] = message[i];
+        } else {
+            memcpy(unused_h[i], ctx[0]->h, sizeof(unused_h[i]));
+            h[i] = unused_h[i];
+            lane_message[i] = message[0];
+        }
+    }
+
+    sha256_transf_avx2_x8(h, lane_message, block_nb);
+}
+
+#endif /* SHA2_X86 */
+
+void sha256_update_mb(sha256_ctx *ctx[], const unsigned char *message[],
+                      unsigned int len, unsigned int n)
+{
+    unsigned int i;
+#ifdef SHA2_X86
+    unsigned int block_nb;
+    unsigned int new_len, rem_len, tmp_len;
+    const unsigned char *shifted_message[SHA256_MB_LANES];
+    const unsigned char *block[SHA256_MB_LANES];
+    int same_len = 1;
+
+    if (n > SHA256_MB_LANES) {
+        sha256_update_mb(ctx, message, len, SHA256_MB_LANES);
+        sha256_update_mb(ctx + SHA256_MB_LANES, message + SHA256_MB_LANES,
+                         len, n - SHA256_MB_LANES);
+        return;
+    }
+
+    for (i = 1; i < n; i++) {
+        if (ctx[i]->len != ctx[0]->len) {
+            same_len = 0;
+        }
+    }
+
+    /* The SHA extensions are faster than eight AVX2 lanes */
+    if (n > 1 && same_len && !sha2_use_shani() && sha2_use_avx2()) {
+        tmp_len = SHA256_BLOCK_SIZE - ctx[0]->len;
+        rem_len = len < tmp_len ? len : tmp_len;
+
+        for (i = 0; i < n; i++) {
+            memcpy(&ctx[i]->block[ctx[i]->len], message[i], rem_len);
+        }
+
+        if (ctx[0]->len + len < SHA256_BLOCK_SIZE) {
+            for (i = 0; i < n; i++) {
+                ctx[i]->len += len;
+            }
+            return;
+        }
+
+        new_len = len - rem_len;
+        block_nb = new_len / SHA256_BLOCK_SIZE;
+
+        for (i = 0; i < n; i++) {
+            block[i] = ctx[i]->block;
+            shifted_message[i] = message[i] + rem_len;
+        }
+
+        sha256_transf_mb(ctx, block, n, 1);
+        sha256_transf_mb(ctx, shifted_message, n, block_nb);
+
+        rem_len = new_len % SHA256_BLOCK_SIZE;
+
+        for (i = 0; i < n; i++) {
+            memcpy(ctx[i]->block, &shifted_message[i][block_nb << 6],
+                   rem_len);
+
+            ctx[i]->len = rem_len;
+            ctx[i]->tot_len += (block_nb + 1) << 6;
+        }
+        return;
+    }
+#endif /* SHA2_X86 */
+
+    for (i = 0; i < n; i++) {
+        sha256_update(ctx[i], message[i], len);
+    }
+}
+
 /* SHA-512 functions */
 
-void sha512_transf(sha512_ctx *ctx, const unsigned char *message,
-                   unsigned int block_nb)
+static void sha512_transf_c(sha512_ctx *ctx, const unsigned char *message,
+                            unsigned int block_nb)
 {
     uint64 w[80];
     uint64 wv[8];
@@ -520,6 +1111,18 @@ void sha512_transf(sha512_ctx *ctx, const unsigned char *message,
     }
 }
 
+void sha512_transf(sha512_ctx *ctx, const unsigned char *message,
+                   unsigned int block_nb)
+{
+#ifdef SHA2_X86
+    if (sha2_use_avx2_bmi2()) {
+        sha512_transf_avx2(ctx, message, block_nb);
+        return;
+    }
+#endif
+    sha512_transf_c(ctx, message, block_nb);
+}
+
 void sha512(const unsigned char *message, unsigned int len,
             unsigned char *digest)
 {
@@ -620,6 +1223,104 @@ void sha512_final(sha512_ctx *ctx, unsigned char *digest)
 #endif /* !UNROLL_LOOPS */
 }
 
+#ifdef SHA2_X86
+
+static void sha512_transf_mb(sha512_ctx *ctx[], const unsigned char *message[],
+                             unsigned int n, unsigned int block_nb)
+{
+    uint64 *h[SHA512_MB_LANES];
+    const unsigned char *lane_message[SHA512_MB_LANES];
+    uint64 unused_h[SHA512_MB_LANES][8];
+    unsigned int i;
+
+    if (block_nb == 0) {
+        return;
+    }
+
+    for (i = 0; i < SHA512_MB_LANES; i++) {
+        if (i < n) {
+            h[i] = ctx[i]->h;
+            lane_message[i] = message[i];
+        } else {
+            memcpy(unused_h[i], ctx[0]->h, sizeof(unused_h[i]));
+            h[i] = unused_h[i];
+            lane_message[i] = message[0];
+        }
+    }
+
+    sha512_transf_avx2_x4(h, lane_message, block_nb);
+}
+
+#endif /* SHA2_X86 */
+
+void sha512_update_mb(sha512_ctx *ctx[], const unsigned char *message[],
+                      unsigned int len, unsigned int n)
+{
+    unsigned int i;
+#ifdef SHA2_X86
+    unsigned int block_nb;
+    unsigned int new_len, rem_len, tmp_len;
+    const unsigned char *shifted_message[SHA512_MB_LANES];
+    const unsigned char *block[SHA512_MB_LANES];
+    int same_len = 1;
+
+    if (n > SHA512_MB_LANES) {
+        sha512_update_mb(ctx, message, len, SHA512_MB_LANES);
+        sha512_update_mb(ctx + SHA512_MB_LANES, message + SHA512_MB_LANES,
+                         len, n - SHA512_MB_LANES);
+        return;
+    }
+
+    for (i = 1; i < n; i++) {
+        if (ctx[i]->len != ctx[0]->len) {
+            same_len = 0;
+        }
+    }
+
+    if (n > 1 && same_len && sha2_use_avx2()) {
+        tmp_len = SHA512_BLOCK_SIZE - ctx[0]->len;
+        rem_len = len < tmp_len ? len : tmp_len;
+
+        for (i = 0; i < n; i++) {
+            memcpy(&ctx[i]->block[ctx[i]->len], message[i], rem_len);
+        }
+
+        if (ctx[0]->len + len < SHA512_BLOCK_SIZE) {
+            for (i = 0; i < n; i++) {
+                ctx[i]->len += len;
+            }
+            return;
+        }
+
+        new_len = len - rem_len;
+        block_nb = new_len / SHA512_BLOCK_SIZE;
+
+        for (i = 0; i < n; i++) {
+            block[i] = ctx[i]->block;
+            shifted_message[i] = message[i] + rem_len;
+        }
+
+        sha512_transf_mb(ctx, block, n, 1);
+        sha512_transf_mb(ctx, shifted_message, n, block_nb);
+
+        rem_len = new_len % SHA512_BLOCK_SIZE;
+
+        for (i = 0; i < n; i++) {
+            memcpy(ctx[i]->block, &shifted_message[i][block_nb << 7],
+                   rem_len);
+
+            ctx[i]->len = rem_len;
+            ctx[i]->tot_len += (block_nb + 1) << 7;
+        }
+        return;
+    }
+#endif /* SHA2_X86 */
+
+    for (i = 0; i < n; i++) {
+        sha512_update(ctx[i], message[i], len);
+    }
+}
+
 /* SHA-384 functions */
 
 void sha384(const unsigned char *message, unsigned int len,
@@ -847,6 +1548,122 @@ void test(const unsigned char *vector, unsigned char *digest,
     }
 }
 
+static unsigned int test_rand_state = 1;
+
+unsigned int test_rand(void)
+{
+    test_rand_state ^= test_rand_state << 13;
+    test_rand_state ^= test_rand_state >> 17;
+    test_rand_state ^= test_rand_state << 5;
+    return test_rand_state;
+}
+
+void test_compare(const unsigned char *digest, const unsigned char *ref,
+                  unsigned int digest_size, const char *what)
+{
+    if (memcmp(digest, ref, digest_size)) {
+        fprintf(stderr, "Test failed: %s\n", what);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* The accelerated implementations have to be bit-exact with the portable
+   one for every message length, update split and number of lanes */
+void test_accel(void)
+{
+    unsigned int data_len = 256 * 1024;
+    unsigned char *data;
+    unsigned int i, j, k, n, len, part, round_len;
+    unsigned int off[8];
+    sha256_ctx ctx256[8];
+    sha512_ctx ctx512[8];
+    sha256_ctx *pctx256[8];
+    sha512_ctx *pctx512[8];
+    const unsigned char *msg[8];
+    unsigned char digest[SHA512_DIGEST_SIZE];
+    unsigned char ref256[8][SHA256_DIGEST_SIZE];
+    unsigned char ref512[8][SHA512_DIGEST_SIZE];
+
+    data = malloc(data_len);
+    if (data == NULL) {
+        fprintf(stderr, "Can't allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < data_len; i++) {
+        data[i] = (unsigned char) test_rand();
+    }
+
+    printf("Implementations: SHA-256 %s, SHA-512 %s, "
+           "SHA-256 multi-buffer %s, SHA-512 multi-buffer %s\n",
+           sha256_impl_name(), sha512_impl_name(),
+           sha256_mb_impl_name(), sha512_mb_impl_name());
+
+    for (i = 0; i < 2000; i++) {
+        len = test_rand() % (i < 1000 ? 1024 : data_len / 2);
+        off[0] = test_rand() % (data_len - len);
+
+        sha2_set_accel(0);
+        sha256(data + off[0], len, ref256[0]);
+        sha512(data + off[0], len, ref512[0]);
+        sha2_set_accel(1);
+
+        sha256_init(&ctx256[0]);
+        sha512_init(&ctx512[0]);
+        for (j = 0; j < len; j += part) {
+            part = 1 + test_rand() % 300;
+            if (part > len - j) {
+                part = len - j;
+            }
+            sha256_update(&ctx256[0], data + off[0] + j, part);
+            sha512_update(&ctx512[0], data + off[0] + j, part);
+        }
+        sha256_final(&ctx256[0], digest);
+        test_compare(digest, ref256[0], SHA256_DIGEST_SIZE, "SHA-256 split update");
+        sha512_final(&ctx512[0], digest);
+        test_compare(digest, ref512[0], SHA512_DIGEST_SIZE, "SHA-512 split update");
+    }
+
+    for (i = 0; i < 500; i++) {
+        n = 1 + test_rand() % 8;
+        for (k = 0; k < n; k++) {
+            off[k] = test_rand() % (data_len - 3 * 4096);
+            sha256_init(&ctx256[k]);
+            sha512_init(&ctx512[k]);
+            pctx256[k] = &ctx256[k];
+            pctx512[k] = &ctx512[k];
+        }
+
+        len = 0;
+        for (j = 0; j < 3; j++) {
+            round_len = test_rand() % 4096;
+            for (k = 0; k < n; k++) {
+                msg[k] = data + off[k] + len;
+            }
+            sha256_update_mb(pctx256, msg, round_len, n);
+            sha512_update_mb(pctx512, msg, round_len, n);
+            len += round_len;
+        }
+
+        sha2_set_accel(0);
+        for (k = 0; k < n; k++) {
+            sha256(data + off[k], len, ref256[k]);
+            sha512(data + off[k], len, ref512[k]);
+        }
+        sha2_set_accel(1);
+
+        for (k = 0; k < n; k++) {
+            sha256_final(&ctx256[k], digest);
+            test_compare(digest, ref256[k], SHA256_DIGEST_SIZE, "SHA-256 multi-buffer");
+            sha512_final(&ctx512[k], digest);
+            test_compare(digest, ref512[k], SHA512_DIGEST_SIZE, "SHA-512 multi-buffer");
+        }
+    }
+
+    free(data);
+
+    printf("Accelerated implementations match.\n\n");
+}
+
 int main()
 {
     static const unsigned char *vectors[4][3] =
@@ -941,6 +1758,8 @@ int main()
     test(vectors[3][2], digest, SHA512_DIGEST_SIZE);
     printf("\n");
 
+    test_accel();
+
     printf("All tests passed.\n");
 
     return 0;
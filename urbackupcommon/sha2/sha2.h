@@ -100,6 +100,22 @@ void sha512_final(sha512_ctx *ctx, unsigned char *digest);
 void sha512(const unsigned char *message, unsigned int len,
             unsigned char *digest);
 
+/* Multi-buffer functions. They hash n independent messages of the same
+   length at once. Messages whose contexts were not all updated with the
+   same lengths before are hashed one after another. */
+void sha256_update_mb(sha256_ctx *ctx[], const unsigned char *message[],
+                      unsigned int len, unsigned int n);
+void sha512_update_mb(sha512_ctx *ctx[], const unsigned char *message[],
+                      unsigned int len, unsigned int n);
+
+/* The hardware accelerated implementations are selected at runtime.
+   sha2_set_accel(0) falls back to the portable implementation. */
+void sha2_set_accel(int enable);
+const char *sha256_impl_name(void);
+const char *sha512_impl_name(void);
+const char *sha256_mb_impl_name(void);
+const char *sha512_mb_impl_name(void);
+
 #ifdef __cplusplus
 }
 #endif
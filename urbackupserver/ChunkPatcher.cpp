@@ -16,14 +16,12 @@ void ChunkPatcher::setCallback(IChunkPatcherCallback *pCb)
 
 bool ChunkPatcher::ApplyPatch(IFile *file, IFile *patch)
 {
-	patch->Seek(0);
-	file->Seek(0);
 	_i64 patchf_pos=0;
 
 	const unsigned int buffer_size=32768;
 	char buf[buffer_size];
 
-	if(patch->Read((char*)&filesize, sizeof(_i64))!=sizeof(_i64))
+	if(patch->ReadAt(patchf_pos, (char*)&filesize, sizeof(_i64))!=sizeof(_i64))
 	{
 		return false;
 	}
@@ -74,15 +72,16 @@ bool ChunkPatcher::ApplyPatch(IFile *file, IFile *patch)
 
 			while(next_header.patch_size>0)
 			{
-				_u32 r=patch->Read((char*)buf, (std::min)((unsigned int)buffer_size, next_header.patch_size));
+				_u32 r=patch->ReadAt(patchf_pos, (char*)buf, (std::min)((unsigned int)buffer_size, next_header.patch_size));
+				if(r==0)
+				{
+					Server->Log("Error reading patch data at "+nconvert(patchf_pos), LL_ERROR);
+					return false;
+				}
 				patchf_pos+=r;
 				cb->next_chunk_patcher_bytes(buf, r, true);
 				next_header.patch_size-=r;
 			}
-			if(require_unchanged)
-			{
-				file->Seek(file_pos);
-			}
 			next_header.patch_off=-1;
 		}
 		else if(file_pos<size && file_pos<filesize)
@@ -96,7 +95,12 @@ bool ChunkPatcher::ApplyPatch(IFile *file, IFile *patch)
 
 				if(require_unchanged)
 				{
-					_u32 r=file->Read((char*)buf, tr);
+					_u32 r=file->ReadAt(file_pos, (char*)buf, tr);
+					if(r==0)
+					{
+						Server->Log("Error reading unchanged data at "+nconvert(file_pos), LL_ERROR);
+						return false;
+					}
 					file_pos+=r;
 					cb->next_chunk_patcher_bytes(buf, r, false);
 					tr-=r;
@@ -129,7 +133,7 @@ bool ChunkPatcher::readNextValidPatch(IFile *patchf, _i64 &patchf_pos, SPatchHea
 	const unsigned int to_read=sizeof(_i64)+sizeof(unsigned int);
 	do
 	{
-		_u32 r=patchf->Read((char*)&patch_header->patch_off, to_read);
+		_u32 r=patchf->ReadAt(patchf_pos, (char*)&patch_header->patch_off, to_read);
 		patchf_pos+=r;
 		if(r!=to_read)
 		{
@@ -146,7 +150,6 @@ bool ChunkPatcher::readNextValidPatch(IFile *patchf, _i64 &patchf_pos, SPatchHea
 		if(patch_header->patch_off==-1)
 		{
 			patchf_pos+=patch_header->patch_size;
-			patchf->Seek(patchf_pos);
 		}
 	}
 	while(patch_header->patch_off==-1);
@@ -1,5 +1,6 @@
 #include "FileCache.h"
 #include "../Interface/Server.h"
+#include "server_metrics.h"
 
 const size_t max_buffer_size=500000;
 const unsigned int max_wait_time=120000;
@@ -32,6 +33,9 @@ void FileCache::operator()(void)
 			cache_buffer.clear();
 		}
 
+		ScopedMetricsLatency latency("urbackup_filecache_flush_ms");
+		ServerMetrics::addCounter("urbackup_filecache_flushed_entries_total", local_buf.size());
+
 		start_transaction();
 
 		for(std::map<FileCache::SCacheKey, FileCache::SCacheValue>::iterator it=local_buf.begin();
@@ -80,9 +84,19 @@ FileCache::SCacheValue FileCache::get_with_cache(const FileCache::SCacheKey& key
 
 		if(it!=cache_buffer.end())
 		{
+			buffer_hits_metric.add(1);
 			return it->second;
 		}
 	}
 
-	return get(key);
+	SCacheValue ret=get(key);
+	if(ret.exists)
+	{
+		hits_metric.add(1);
+	}
+	else
+	{
+		misses_metric.add(1);
+	}
+	return ret;
 }
\ No newline at end of file
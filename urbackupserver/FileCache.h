@@ -5,6 +5,7 @@
 #include "../Interface/Mutex.h"
 #include "../Interface/Condition.h"
 #include "../Interface/Thread.h"
+#include "server_metrics.h"
 #include <memory.h>
 
 class FileCache : public IThread
@@ -70,6 +71,13 @@ public:
 		int64 filesize;
 	};
 
+	FileCache(void)
+		: buffer_hits_metric("urbackup_filecache_buffer_hits_total"),
+		  hits_metric("urbackup_filecache_hits_total"),
+		  misses_metric("urbackup_filecache_misses_total")
+	{
+	}
+
 	virtual ~FileCache(void) {};
 
 	virtual bool has_error(void)=0;
@@ -96,6 +104,11 @@ public:
 
 private:
 
+	//Each backup thread has its own file cache, so get_with_cache does not share them
+	LocalMetricsCounter buffer_hits_metric;
+	LocalMetricsCounter hits_metric;
+	LocalMetricsCounter misses_metric;
+
 	static std::map<SCacheKey, SCacheValue> cache_buffer;
 	static std::map<SCacheKey, bool> del_buffer;
 	static IMutex *mutex;
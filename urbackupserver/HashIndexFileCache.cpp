@@ -0,0 +1,1313 @@
+#include "HashIndexFileCache.h"
+#include "../Interface/Server.h"
+#include "../Interface/File.h"
+#include "../Interface/Mutex.h"
+#include "../stringtools.h"
+#include "../common/data.h"
+#include "../urbackupcommon/os_functions.h"
+#include "server_metrics.h"
+#include <memory.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+const std::string HashIndexFileCache::default_path_prefix="urbackup/cache/backup_server_files_cache";
+FileHashIndex* HashIndexFileCache::index=NULL;
+
+namespace
+{
+	const char index_magic[8]={'U','B','H','I','D','X','0','1'};
+	const char log_magic[8]={'U','B','H','L','O','G','0','1'};
+	const _u32 index_version=1;
+	const uint64 index_header_size=4096;
+	const uint64 log_header_size=16;
+	const uint64 slot_empty=0;
+	const uint64 slot_deleted=1;
+	const uint64 min_capacity=65536;
+	//Percentage of live and deleted slots at which the table is rebuilt
+	const uint64 max_load=70;
+	const size_t max_log_buffer=1024*1024;
+	const size_t replay_chunk_size=4*1024*1024;
+	const _u32 log_read_ahead=256;
+	//Number of overwritten or deleted records in the log before it is compacted
+	const uint64 min_compact_garbage=1000000;
+	//The log is the durable state. The table is only written back and marked
+	//clean in this interval, otherwise it is rebuilt from the log after a crash
+	const int64 checkpoint_interval=10*60*1000;
+	//Only this prefix of the SHA512 hash is stored in the table
+	const size_t key_hash_size=16;
+
+	const unsigned char record_put=1;
+	const unsigned char record_del=2;
+	const unsigned char record_flag_derived_hashpath=1;
+
+	struct SIndexHeader
+	{
+		char magic[8];
+		_u32 version;
+		_u32 dirty;
+		uint64 generation;
+		uint64 capacity;
+		uint64 count;
+		uint64 deleted;
+		uint64 log_size;
+		uint64 log_records;
+	};
+
+	struct SIndexSlot
+	{
+		char hash[key_hash_size];
+		int64 filesize;
+		uint64 offset;
+	};
+
+	struct SLogHeader
+	{
+		char magic[8];
+		uint64 generation;
+	};
+
+	uint64 slot_hash(const char* hash, int64 filesize)
+	{
+		uint64 h;
+		memcpy(&h, hash, sizeof(h));
+		h^=static_cast<uint64>(filesize)*0x9E3779B97F4A7C15ULL;
+		h^=h>>33;
+		h*=0xFF51AFD7ED558CCDULL;
+		h^=h>>33;
+		return h;
+	}
+
+	uint64 capacity_for(uint64 count)
+	{
+		uint64 capacity=min_capacity;
+		while(count*100*2>capacity*max_load)
+		{
+			capacity*=2;
+		}
+		return capacity;
+	}
+
+	class MappedFile
+	{
+	public:
+		MappedFile(void)
+			: data(NULL), size(0)
+#ifdef _WIN32
+			, hfile(INVALID_HANDLE_VALUE), hmap(NULL)
+#else
+			, fd(-1)
+#endif
+		{
+		}
+
+		~MappedFile(void)
+		{
+			close();
+		}
+
+		//Maps the file read-write. With fsize==0 the existing file is mapped,
+		//otherwise the file is created or extended to fsize bytes
+		bool open(const std::string& fn, uint64 fsize)
+		{
+			close();
+#ifdef _WIN32
+			hfile=CreateFileW(Server->ConvertToUnicode(fn).c_str(), GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+			if(hfile==INVALID_HANDLE_VALUE)
+			{
+				return false;
+			}
+			if(fsize==0)
+			{
+				LARGE_INTEGER li;
+				if(!GetFileSizeEx(hfile, &li))
+				{
+					close();
+					return false;
+				}
+				fsize=li.QuadPart;
+			}
+			if(fsize==0)
+			{
+				close();
+				return false;
+			}
+			hmap=CreateFileMappingW(hfile, NULL, PAGE_READWRITE, static_cast<DWORD>(fsize>>32), static_cast<DWORD>(fsize), NULL);
+			if(hmap==NULL)
+			{
+				close();
+				return false;
+			}
+			data=static_cast<char*>(MapViewOfFile(hmap, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+			if(data==NULL)
+			{
+				close();
+				return false;
+			}
+#else
+			fd=::open(fn.c_str(), O_RDWR|O_CREAT, 0664);
+			if(fd==-1)
+			{
+				return false;
+			}
+			if(fsize==0)
+			{
+				struct stat st;
+				if(fstat(fd, &st)!=0)
+				{
+					close();
+					return false;
+				}
+				fsize=st.st_size;
+			}
+			else if(ftruncate(fd, fsize)!=0)
+			{
+				close();
+				return false;
+			}
+			if(fsize==0)
+			{
+				close();
+				return false;
+			}
+			void* mem=mmap(NULL, fsize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+			if(mem==MAP_FAILED)
+			{
+				close();
+				return false;
+			}
+			madvise(mem, fsize, MADV_RANDOM);
+			data=static_cast<char*>(mem);
+#endif
+			size=fsize;
+			return true;
+		}
+
+		void close(void)
+		{
+#ifdef _WIN32
+			if(data!=NULL)
+			{
+				UnmapViewOfFile(data);
+			}
+			if(hmap!=NULL)
+			{
+				CloseHandle(hmap);
+				hmap=NULL;
+			}
+			if(hfile!=INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(hfile);
+				hfile=INVALID_HANDLE_VALUE;
+			}
+#else
+			if(data!=NULL)
+			{
+				munmap(data, size);
+			}
+			if(fd!=-1)
+			{
+				::close(fd);
+				fd=-1;
+			}
+#endif
+			data=NULL;
+			size=0;
+		}
+
+		void sync(uint64 len, bool wait)
+		{
+#ifdef _WIN32
+			FlushViewOfFile(data, static_cast<SIZE_T>(len));
+			if(wait)
+			{
+				FlushFileBuffers(hfile);
+			}
+#else
+			msync(data, len, wait?MS_SYNC:MS_ASYNC);
+#endif
+		}
+
+		char* data;
+		uint64 size;
+
+	private:
+#ifdef _WIN32
+		HANDLE hfile;
+		HANDLE hmap;
+#else
+		int fd;
+#endif
+	};
+}
+
+class FileHashIndex
+{
+public:
+	FileHashIndex(const std::string& path_prefix)
+		: path_prefix(path_prefix), mutex(Server->createMutex()), header(NULL), slots(NULL),
+		  log_file(NULL), log_size(0), log_generation(0), roots_file(NULL), roots_size(0),
+		  _has_error(false), compactions(0), last_checkpoint(0), sep(os_file_sepn()), hashes_sep(sep+".hashes"+sep)
+	{
+		roots.push_back(std::string());
+	}
+
+	~FileHashIndex(void)
+	{
+		if(log_file!=NULL)
+		{
+			if(flushLog() && header!=NULL)
+			{
+				checkpoint();
+			}
+			Server->destroy(log_file);
+		}
+		if(roots_file!=NULL)
+		{
+			Server->destroy(roots_file);
+		}
+		table.close();
+		Server->destroy(mutex);
+	}
+
+	bool open(void)
+	{
+		if(!openRoots())
+		{
+			return false;
+		}
+		return load();
+	}
+
+	bool hasError(void)
+	{
+		IScopedLock lock(mutex);
+		return _has_error || header==NULL;
+	}
+
+	bool get(const FileCache::SCacheKey& key, FileCache::SCacheValue& value)
+	{
+		IScopedLock lock(mutex);
+
+		if(header==NULL)
+		{
+			return false;
+		}
+
+		bool found;
+		uint64 idx=findSlot(key, found);
+		if(!found)
+		{
+			return false;
+		}
+
+		std::string payload;
+		unsigned char type;
+		FileCache::SCacheKey rkey;
+		if(!readRecord(slots[idx].offset, payload)
+			|| !decodeRecord(payload, type, rkey, &value)
+			|| type!=record_put )
+		{
+			Server->Log("Hash index: Error reading file entry record at offset "+nconvert(slots[idx].offset), LL_ERROR);
+			_has_error=true;
+			value=FileCache::SCacheValue();
+			return false;
+		}
+
+		return true;
+	}
+
+	void begin(void)
+	{
+		IScopedLock lock(mutex);
+
+		if(header!=NULL && header->dirty==0)
+		{
+			//Slot changes may reach the disk before the next checkpoint. Persist
+			//the flag first, so the table is rebuilt from the log after a crash
+			header->dirty=1;
+			table.sync(index_header_size, true);
+		}
+	}
+
+	void put(const FileCache::SCacheKey& key, const FileCache::SCacheValue& value)
+	{
+		IScopedLock lock(mutex);
+
+		if(header==NULL)
+		{
+			return;
+		}
+
+		CWData data;
+		encodePut(key, value, data);
+		setSlot(key, appendRecord(data));
+	}
+
+	void del(const FileCache::SCacheKey& key)
+	{
+		IScopedLock lock(mutex);
+
+		if(header==NULL)
+		{
+			return;
+		}
+
+		bool found;
+		findSlot(key, found);
+		if(!found)
+		{
+			return;
+		}
+
+		CWData data;
+		data.addUChar(record_del);
+		data.addBuffer(key.hash, key_hash_size);
+		data.addInt64(key.filesize);
+		appendRecord(data);
+		eraseSlot(key);
+	}
+
+	void commit(void)
+	{
+		bool compact_log;
+		{
+			IScopedLock lock(mutex);
+
+			if(header==NULL || !flushLog())
+			{
+				return;
+			}
+
+			if(Server->getTimeMS()-last_checkpoint>=checkpoint_interval)
+			{
+				checkpoint();
+			}
+
+			updateMetrics();
+
+			compact_log=header->log_records>header->count*2
+				&& header->log_records-header->count>min_compact_garbage;
+		}
+
+		if(compact_log)
+		{
+			compact();
+		}
+	}
+
+	SHashIndexStats getStats(void)
+	{
+		IScopedLock lock(mutex);
+
+		SHashIndexStats ret;
+		if(header!=NULL)
+		{
+			ret.entries=header->count;
+			ret.capacity=header->capacity;
+			ret.table_bytes=table.size;
+			ret.log_records=header->log_records;
+		}
+		ret.log_bytes=log_size+log_buf.size();
+		ret.compactions=compactions;
+		return ret;
+	}
+
+private:
+	void checkpoint(void)
+	{
+		header->log_size=log_size;
+		table.sync(table.size, true);
+		header->dirty=0;
+		table.sync(index_header_size, false);
+		last_checkpoint=Server->getTimeMS();
+	}
+
+	bool openRoots(void)
+	{
+		roots_file=Server->openFile(path_prefix+".hroots", MODE_RW_CREATE);
+		if(roots_file==NULL)
+		{
+			Server->Log("Hash index: Error opening root directory file \""+path_prefix+".hroots\"", LL_ERROR);
+			return false;
+		}
+
+		std::string data;
+		data.resize(static_cast<size_t>(roots_file->Size()));
+		if(!data.empty() && roots_file->ReadAt(0, &data[0], static_cast<_u32>(data.size()))!=data.size())
+		{
+			Server->Log("Hash index: Error reading root directory file", LL_ERROR);
+			return false;
+		}
+
+		size_t pos=0;
+		while(pos+sizeof(_u32)<=data.size())
+		{
+			_u32 len;
+			memcpy(&len, &data[pos], sizeof(len));
+			if(pos+sizeof(_u32)+len>data.size())
+			{
+				break;
+			}
+			roots.push_back(data.substr(pos+sizeof(_u32), len));
+			root_ids[roots[roots.size()-1]]=static_cast<unsigned int>(roots.size()-1);
+			pos+=sizeof(_u32)+len;
+		}
+		roots_size=pos;
+
+		return true;
+	}
+
+	//Opens the log and the table. The table is rebuilt from the log if it
+	//does not belong to the log or was not cleanly committed
+	bool load(void)
+	{
+		std::string log_fn=path_prefix+".hlog";
+		log_file=Server->openFile(log_fn, MODE_RW_CREATE);
+		if(log_file==NULL)
+		{
+			Server->Log("Hash index: Error opening log \""+log_fn+"\"", LL_ERROR);
+			return false;
+		}
+
+		log_size=log_file->Size();
+		if(log_size<log_header_size)
+		{
+			SLogHeader log_header;
+			memcpy(log_header.magic, log_magic, sizeof(log_magic));
+			log_header.generation=1;
+			if(log_file->WriteAt(0, reinterpret_cast<char*>(&log_header), sizeof(log_header))!=sizeof(log_header))
+			{
+				Server->Log("Hash index: Error writing log header", LL_ERROR);
+				return false;
+			}
+			log_size=log_header_size;
+			log_generation=log_header.generation;
+		}
+		else
+		{
+			SLogHeader log_header;
+			if(log_file->ReadAt(0, reinterpret_cast<char*>(&log_header), sizeof(log_header))!=sizeof(log_header)
+				|| memcmp(log_header.magic, log_magic, sizeof(log_magic))!=0 )
+			{
+				Server->Log("Hash index: \""+log_fn+"\" is not a hash index log", LL_ERROR);
+				return false;
+			}
+			log_generation=log_header.generation;
+		}
+
+		if(mapTable() && header->dirty==0
+			&& header->generation==log_generation
+			&& header->log_size==log_size )
+		{
+			return true;
+		}
+
+		Server->Log("Rebuilding file entry hash index from its log...", LL_WARNING);
+
+		table.close();
+		header=NULL;
+		slots=NULL;
+		if(!createTable(path_prefix+".hidx", min_capacity, table))
+		{
+			return false;
+		}
+		header=reinterpret_cast<SIndexHeader*>(table.data);
+		slots=reinterpret_cast<SIndexSlot*>(table.data+index_header_size);
+		header->generation=log_generation;
+		header->dirty=1;
+
+		if(!replayLog())
+		{
+			return false;
+		}
+
+		checkpoint();
+
+		Server->Log("File entry hash index contains "+nconvert(header->count)+" entries", LL_INFO);
+
+		return true;
+	}
+
+	bool mapTable(void)
+	{
+		std::string table_fn=path_prefix+".hidx";
+		header=NULL;
+		slots=NULL;
+
+		if(!FileExists(table_fn)
+			|| !table.open(table_fn, 0))
+		{
+			return false;
+		}
+
+		SIndexHeader* theader=reinterpret_cast<SIndexHeader*>(table.data);
+		if(table.size<index_header_size
+			|| memcmp(theader->magic, index_magic, sizeof(index_magic))!=0
+			|| theader->version!=index_version
+			|| theader->capacity==0
+			|| (theader->capacity & (theader->capacity-1))!=0
+			|| table.size!=index_header_size+theader->capacity*sizeof(SIndexSlot) )
+		{
+			Server->Log("Hash index: Table \""+table_fn+"\" is invalid", LL_WARNING);
+			table.close();
+			return false;
+		}
+
+		header=theader;
+		slots=reinterpret_cast<SIndexSlot*>(table.data+index_header_size);
+		return true;
+	}
+
+	bool createTable(const std::string& fn, uint64 capacity, MappedFile& mf)
+	{
+		Server->deleteFile(fn);
+		if(!mf.open(fn, index_header_size+capacity*sizeof(SIndexSlot)))
+		{
+			Server->Log("Hash index: Error creating table \""+fn+"\" with "+nconvert(capacity)+" slots", LL_ERROR);
+			return false;
+		}
+
+		SIndexHeader* theader=reinterpret_cast<SIndexHeader*>(mf.data);
+		memcpy(theader->magic, index_magic, sizeof(index_magic));
+		theader->version=index_version;
+		theader->capacity=capacity;
+		return true;
+	}
+
+	bool replayLog(void)
+	{
+		std::vector<char> chunk;
+		uint64 chunk_start=0;
+		uint64 pos=log_header_size;
+		std::string payload;
+		header->log_records=0;
+
+		while(pos+sizeof(_u32)<=log_size)
+		{
+			if(pos<chunk_start || pos+sizeof(_u32)>chunk_start+chunk.size())
+			{
+				if(!readChunk(pos, sizeof(_u32), chunk, chunk_start))
+				{
+					return false;
+				}
+			}
+
+			_u32 len;
+			memcpy(&len, &chunk[static_cast<size_t>(pos-chunk_start)], sizeof(len));
+			if(pos+sizeof(_u32)+len>log_size)
+			{
+				break;
+			}
+
+			if(pos+sizeof(_u32)+len>chunk_start+chunk.size())
+			{
+				if(!readChunk(pos, sizeof(_u32)+len, chunk, chunk_start))
+				{
+					return false;
+				}
+			}
+
+			payload.assign(&chunk[static_cast<size_t>(pos-chunk_start)+sizeof(_u32)], len);
+
+			unsigned char type;
+			FileCache::SCacheKey key;
+			if(!decodeRecord(payload, type, key, NULL))
+			{
+				break;
+			}
+
+			if(type==record_put)
+			{
+				setSlot(key, pos);
+			}
+			else
+			{
+				eraseSlot(key);
+			}
+
+			if(_has_error)
+			{
+				return false;
+			}
+
+			++header->log_records;
+			pos+=sizeof(_u32)+len;
+		}
+
+		if(pos<log_size)
+		{
+			Server->Log("Hash index: Log ends with an incomplete record at offset "+nconvert(pos)+". Truncating.", LL_WARNING);
+			if(!os_file_truncate(Server->ConvertToUnicode(path_prefix+".hlog"), pos))
+			{
+				Server->Log("Hash index: Error truncating log", LL_ERROR);
+				return false;
+			}
+			log_size=pos;
+		}
+
+		return true;
+	}
+
+	bool readChunk(uint64 pos, size_t minsize, std::vector<char>& chunk, uint64& chunk_start)
+	{
+		chunk.resize(static_cast<size_t>((std::min)(static_cast<uint64>((std::max)(replay_chunk_size, minsize)), log_size-pos)));
+		chunk_start=pos;
+		if(log_file->ReadAt(pos, &chunk[0], static_cast<_u32>(chunk.size()))!=chunk.size())
+		{
+			Server->Log("Hash index: Error reading log at offset "+nconvert(pos), LL_ERROR);
+			return false;
+		}
+		return true;
+	}
+
+	uint64 findSlot(const FileCache::SCacheKey& key, bool& found)
+	{
+		uint64 mask=header->capacity-1;
+		uint64 idx=slot_hash(key.hash, key.filesize) & mask;
+		uint64 insert_idx=header->capacity;
+
+		while(true)
+		{
+			const SIndexSlot& slot=slots[idx];
+			if(slot.offset==slot_empty)
+			{
+				found=false;
+				return insert_idx!=header->capacity ? insert_idx : idx;
+			}
+			else if(slot.offset==slot_deleted)
+			{
+				if(insert_idx==header->capacity)
+				{
+					insert_idx=idx;
+				}
+			}
+			else if(slot.filesize==key.filesize
+				&& memcmp(slot.hash, key.hash, key_hash_size)==0)
+			{
+				found=true;
+				return idx;
+			}
+			idx=(idx+1) & mask;
+		}
+	}
+
+	static void insertUnique(SIndexHeader* theader, SIndexSlot* tslots, const SIndexSlot& slot)
+	{
+		uint64 mask=theader->capacity-1;
+		uint64 idx=slot_hash(slot.hash, slot.filesize) & mask;
+		while(tslots[idx].offset!=slot_empty)
+		{
+			idx=(idx+1) & mask;
+		}
+		tslots[idx]=slot;
+		++theader->count;
+	}
+
+	void setSlot(const FileCache::SCacheKey& key, uint64 offset)
+	{
+		if((header->count+header->deleted+1)*100>header->capacity*max_load)
+		{
+			if(!resizeTable(capacity_for(header->count+1)))
+			{
+				return;
+			}
+		}
+
+		bool found;
+		SIndexSlot& slot=slots[findSlot(key, found)];
+		if(!found)
+		{
+			if(slot.offset==slot_deleted)
+			{
+				--header->deleted;
+			}
+			++header->count;
+			memcpy(slot.hash, key.hash, key_hash_size);
+			slot.filesize=key.filesize;
+		}
+		slot.offset=offset;
+	}
+
+	void eraseSlot(const FileCache::SCacheKey& key)
+	{
+		bool found;
+		uint64 idx=findSlot(key, found);
+		if(!found)
+		{
+			return;
+		}
+
+		--header->count;
+		if(slots[(idx+1) & (header->capacity-1)].offset==slot_empty)
+		{
+			//End of the probe sequence, so no tombstone is needed
+			slots[idx].offset=slot_empty;
+		}
+		else
+		{
+			slots[idx].offset=slot_deleted;
+			++header->deleted;
+		}
+	}
+
+	bool resizeTable(uint64 new_capacity)
+	{
+		std::string table_fn=path_prefix+".hidx";
+		{
+			MappedFile new_table;
+			if(!createTable(table_fn+".new", new_capacity, new_table))
+			{
+				_has_error=true;
+				return false;
+			}
+
+			SIndexHeader* new_header=reinterpret_cast<SIndexHeader*>(new_table.data);
+			SIndexSlot* new_slots=reinterpret_cast<SIndexSlot*>(new_table.data+index_header_size);
+			new_header->dirty=header->dirty;
+			new_header->generation=header->generation;
+			new_header->log_size=header->log_size;
+			new_header->log_records=header->log_records;
+
+			for(uint64 i=0;i<header->capacity;++i)
+			{
+				if(slots[i].offset>slot_deleted)
+				{
+					insertUnique(new_header, new_slots, slots[i]);
+				}
+			}
+		}
+
+		table.close();
+		header=NULL;
+		slots=NULL;
+
+		if(!os_rename_file(Server->ConvertToUnicode(table_fn+".new"), Server->ConvertToUnicode(table_fn))
+			|| !mapTable() )
+		{
+			Server->Log("Hash index: Error replacing table with resized table", LL_ERROR);
+			_has_error=true;
+			return false;
+		}
+
+		return true;
+	}
+
+	uint64 appendRecord(CWData& data)
+	{
+		uint64 offset=log_size+log_buf.size();
+		_u32 len=static_cast<_u32>(data.getDataSize());
+		log_buf.append(reinterpret_cast<char*>(&len), sizeof(len));
+		log_buf.append(data.getDataPtr(), len);
+		++header->log_records;
+
+		if(log_buf.size()>=max_log_buffer)
+		{
+			flushLog();
+		}
+
+		return offset;
+	}
+
+	bool flushLog(void)
+	{
+		if(log_buf.empty())
+		{
+			return true;
+		}
+
+		if(log_file->WriteAt(log_size, log_buf.data(), static_cast<_u32>(log_buf.size()))!=log_buf.size())
+		{
+			Server->Log("Hash index: Error writing to log", LL_ERROR);
+			_has_error=true;
+			return false;
+		}
+
+		log_size+=log_buf.size();
+		log_buf.clear();
+		return true;
+	}
+
+	bool readRecord(uint64 offset, std::string& payload)
+	{
+		if(offset>=log_size)
+		{
+			size_t boff=static_cast<size_t>(offset-log_size);
+			if(boff+sizeof(_u32)>log_buf.size())
+			{
+				return false;
+			}
+			_u32 len;
+			memcpy(&len, &log_buf[boff], sizeof(len));
+			if(boff+sizeof(_u32)+len>log_buf.size())
+			{
+				return false;
+			}
+			payload.assign(log_buf.data()+boff+sizeof(_u32), len);
+			return true;
+		}
+
+		char buf[sizeof(_u32)+log_read_ahead];
+		_u32 toread=static_cast<_u32>((std::min)(static_cast<uint64>(sizeof(buf)), log_size-offset));
+		_u32 read=log_file->ReadAt(offset, buf, toread);
+		if(read<sizeof(_u32))
+		{
+			return false;
+		}
+
+		_u32 len;
+		memcpy(&len, buf, sizeof(len));
+		if(offset+sizeof(_u32)+len>log_size)
+		{
+			return false;
+		}
+
+		_u32 have=read-sizeof(_u32);
+		if(len<=have)
+		{
+			payload.assign(buf+sizeof(_u32), len);
+			return true;
+		}
+
+		payload.resize(len);
+		memcpy(&payload[0], buf+sizeof(_u32), have);
+		return log_file->ReadAt(offset+read, &payload[have], len-have)==len-have;
+	}
+
+	unsigned int rootId(const std::string& root)
+	{
+		std::map<std::string, unsigned int>::iterator it=root_ids.find(root);
+		if(it!=root_ids.end())
+		{
+			return it->second;
+		}
+
+		std::string rec;
+		_u32 len=static_cast<_u32>(root.size());
+		rec.append(reinterpret_cast<char*>(&len), sizeof(len));
+		rec.append(root);
+		if(roots_file->WriteAt(roots_size, rec.data(), static_cast<_u32>(rec.size()))!=rec.size())
+		{
+			Server->Log("Hash index: Error writing root directory file", LL_ERROR);
+			_has_error=true;
+			return 0;
+		}
+		roots_size+=rec.size();
+
+		unsigned int id=static_cast<unsigned int>(roots.size());
+		roots.push_back(root);
+		root_ids[root]=id;
+		return id;
+	}
+
+	//Most entries are "<backup>/<path>" with hash path "<backup>/.hashes/<path>".
+	//Those only store the interned backup directory and the relative path
+	void encodePut(const FileCache::SCacheKey& key, const FileCache::SCacheValue& value, CWData& data)
+	{
+		data.addUChar(record_put);
+		data.addBuffer(key.hash, key_hash_size);
+		data.addInt64(key.filesize);
+
+		size_t p=value.hashpath.find(hashes_sep);
+		if(p!=std::string::npos && p>0
+			&& value.fullpath.size()>p+sep.size()
+			&& value.fullpath.compare(0, p+sep.size(), value.hashpath, 0, p+sep.size())==0
+			&& value.fullpath.compare(p+sep.size(), std::string::npos, value.hashpath, p+hashes_sep.size(), std::string::npos)==0 )
+		{
+			unsigned int root_id=rootId(value.fullpath.substr(0, p));
+			if(root_id!=0)
+			{
+				data.addUInt(root_id);
+				data.addUChar(record_flag_derived_hashpath);
+				data.addString(value.fullpath.substr(p+sep.size()));
+				return;
+			}
+		}
+
+		data.addUInt(0);
+		data.addUChar(0);
+		data.addString(value.fullpath);
+		data.addString(value.hashpath);
+	}
+
+	bool decodeRecord(const std::string& payload, unsigned char& type, FileCache::SCacheKey& key, FileCache::SCacheValue* value)
+	{
+		CRData data(payload.data(), payload.size());
+		if(!data.getUChar(&type)
+			|| data.getLeft()<key_hash_size)
+		{
+			return false;
+		}
+
+		memcpy(key.hash, data.getDataPtr()+data.getStreampos(), key_hash_size);
+		data.setStreampos(data.getStreampos()+key_hash_size);
+
+		if(!data.getInt64(&key.filesize))
+		{
+			return false;
+		}
+
+		if(type==record_del)
+		{
+			return true;
+		}
+		else if(type!=record_put)
+		{
+			return false;
+		}
+
+		unsigned int root_id;
+		unsigned char flags;
+		std::string relpath;
+		if(!data.getUInt(&root_id)
+			|| !data.getUChar(&flags)
+			|| !data.getStr(&relpath)
+			|| root_id>=roots.size() )
+		{
+			return false;
+		}
+
+		std::string hashpath;
+		if((flags & record_flag_derived_hashpath)==0
+			&& !data.getStr(&hashpath) )
+		{
+			return false;
+		}
+
+		if(value!=NULL)
+		{
+			value->exists=true;
+			if(flags & record_flag_derived_hashpath)
+			{
+				value->fullpath=roots[root_id]+sep+relpath;
+				value->hashpath=roots[root_id]+hashes_sep+relpath;
+			}
+			else
+			{
+				value->fullpath=relpath;
+				value->hashpath=hashpath;
+			}
+		}
+
+		return true;
+	}
+
+	//Writes the live records to a new log and table and swaps them in.
+	//Only the flushing thread modifies the index, so the old table and log
+	//can be read without holding the lock while lookups continue
+	void compact(void)
+	{
+		int64 starttime=Server->getTimeMS();
+		std::string log_fn=path_prefix+".hlog";
+		std::string table_fn=path_prefix+".hidx";
+
+		Server->Log("Compacting file entry hash index log ("+nconvert(header->log_records)+" records, "+nconvert(header->count)+" entries)...", LL_INFO);
+
+		bool ok=true;
+		{
+			IFile* new_log=Server->openFile(log_fn+".new", MODE_WRITE);
+			MappedFile new_table;
+			if(new_log==NULL
+				|| !createTable(table_fn+".new", capacity_for(header->count), new_table) )
+			{
+				Server->Log("Hash index: Error creating files for compaction", LL_ERROR);
+				ok=false;
+			}
+
+			SIndexHeader* new_header=NULL;
+			SIndexSlot* new_slots=NULL;
+			SLogHeader log_header;
+			std::string wbuf;
+			uint64 new_log_size=log_header_size;
+			if(ok)
+			{
+				new_header=reinterpret_cast<SIndexHeader*>(new_table.data);
+				new_slots=reinterpret_cast<SIndexSlot*>(new_table.data+index_header_size);
+				new_header->generation=log_generation+1;
+
+				memcpy(log_header.magic, log_magic, sizeof(log_magic));
+				log_header.generation=new_header->generation;
+				wbuf.append(reinterpret_cast<char*>(&log_header), sizeof(log_header));
+				new_log_size=0;
+			}
+
+			std::string payload;
+			for(uint64 i=0;ok && i<header->capacity;++i)
+			{
+				if(slots[i].offset<=slot_deleted)
+				{
+					continue;
+				}
+
+				if(!readRecord(slots[i].offset, payload))
+				{
+					Server->Log("Hash index: Error reading record at offset "+nconvert(slots[i].offset)+" during compaction", LL_ERROR);
+					ok=false;
+					break;
+				}
+
+				SIndexSlot new_slot=slots[i];
+				new_slot.offset=new_log_size+wbuf.size();
+				_u32 len=static_cast<_u32>(payload.size());
+				wbuf.append(reinterpret_cast<char*>(&len), sizeof(len));
+				wbuf.append(payload);
+				insertUnique(new_header, new_slots, new_slot);
+
+				if(wbuf.size()>=max_log_buffer)
+				{
+					ok=new_log->WriteAt(new_log_size, wbuf.data(), static_cast<_u32>(wbuf.size()))==wbuf.size();
+					new_log_size+=wbuf.size();
+					wbuf.clear();
+				}
+			}
+
+			if(ok && !wbuf.empty())
+			{
+				ok=new_log->WriteAt(new_log_size, wbuf.data(), static_cast<_u32>(wbuf.size()))==wbuf.size();
+				new_log_size+=wbuf.size();
+			}
+
+			if(ok)
+			{
+				new_header->log_size=new_log_size;
+				new_header->log_records=new_header->count;
+				new_table.sync(new_table.size, true);
+			}
+
+			new_table.close();
+			if(new_log!=NULL)
+			{
+				Server->destroy(new_log);
+			}
+		}
+
+		if(!ok)
+		{
+			Server->Log("Hash index: Compaction failed. Keeping the current log.", LL_ERROR);
+			Server->deleteFile(log_fn+".new");
+			Server->deleteFile(table_fn+".new");
+			return;
+		}
+
+		IScopedLock lock(mutex);
+
+		table.close();
+		header=NULL;
+		slots=NULL;
+		Server->destroy(log_file);
+		log_file=NULL;
+
+		//The log is replaced first. If the table is not replaced as well,
+		//its generation does not match and it is rebuilt from the new log
+		if(!os_rename_file(Server->ConvertToUnicode(log_fn+".new"), Server->ConvertToUnicode(log_fn))
+			|| !os_rename_file(Server->ConvertToUnicode(table_fn+".new"), Server->ConvertToUnicode(table_fn)) )
+		{
+			Server->Log("Hash index: Error replacing log and table with compacted versions", LL_ERROR);
+		}
+
+		if(!load())
+		{
+			_has_error=true;
+			return;
+		}
+
+		++compactions;
+		ServerMetrics::addCounter("urbackup_filecache_hashindex_compactions_total");
+		updateMetrics();
+
+		Server->Log("Compacted file entry hash index log to "+PrettyPrintBytes(log_size)+" in "+nconvert(Server->getTimeMS()-starttime)+" ms", LL_INFO);
+	}
+
+	void updateMetrics(void)
+	{
+		ServerMetrics::setGauge("urbackup_filecache_hashindex_entries", header->count);
+		ServerMetrics::setGauge("urbackup_filecache_hashindex_bytes{file=\"table\"}", table.size);
+		ServerMetrics::setGauge("urbackup_filecache_hashindex_bytes{file=\"log\"}", log_size);
+	}
+
+	std::string path_prefix;
+	IMutex* mutex;
+
+	MappedFile table;
+	SIndexHeader* header;
+	SIndexSlot* slots;
+
+	IFile* log_file;
+	uint64 log_size;
+	uint64 log_generation;
+	std::string log_buf;
+
+	IFile* roots_file;
+	uint64 roots_size;
+	std::vector<std::string> roots;
+	std::map<std::string, unsigned int> root_ids;
+
+	bool _has_error;
+	int64 compactions;
+	int64 last_checkpoint;
+	std::string sep;
+	std::string hashes_sep;
+};
+
+bool HashIndexFileCache::openIndex(const std::string& path_prefix)
+{
+	if(index!=NULL)
+	{
+		return true;
+	}
+
+	FileHashIndex* new_index=new FileHashIndex(path_prefix);
+	if(!new_index->open())
+	{
+		Server->Log("Error opening file entry hash index \""+path_prefix+"\"", LL_ERROR);
+		delete new_index;
+		return false;
+	}
+
+	index=new_index;
+	return true;
+}
+
+void HashIndexFileCache::closeIndex(void)
+{
+	delete index;
+	index=NULL;
+}
+
+void HashIndexFileCache::deleteIndexFiles(const std::string& path_prefix)
+{
+	Server->deleteFile(path_prefix+".hidx");
+	Server->deleteFile(path_prefix+".hidx.new");
+	Server->deleteFile(path_prefix+".hlog");
+	Server->deleteFile(path_prefix+".hlog.new");
+	Server->deleteFile(path_prefix+".hroots");
+}
+
+bool HashIndexFileCache::indexFilesExist(const std::string& path_prefix)
+{
+	return FileExists(path_prefix+".hlog");
+}
+
+SHashIndexStats HashIndexFileCache::getStats(void)
+{
+	if(index==NULL)
+	{
+		return SHashIndexStats();
+	}
+	return index->getStats();
+}
+
+void HashIndexFileCache::initFileCache(void)
+{
+	HashIndexFileCache* filecache=new HashIndexFileCache;
+	Server->createThread(filecache);
+}
+
+HashIndexFileCache::HashIndexFileCache(void)
+{
+}
+
+HashIndexFileCache::~HashIndexFileCache(void)
+{
+}
+
+bool HashIndexFileCache::has_error(void)
+{
+	return index==NULL || index->hasError();
+}
+
+void HashIndexFileCache::create(get_data_callback_t get_data_callback, void *userdata)
+{
+	if(index==NULL)
+	{
+		return;
+	}
+
+	index->begin();
+
+	size_t n_done=0;
+
+	SCacheKey last;
+	db_results res;
+	do
+	{
+		res=get_data_callback(n_done, userdata);
+
+		for(size_t i=0;i<res.size();++i)
+		{
+			const std::wstring& shahash=res[i][L"shahash"];
+			SCacheKey key(reinterpret_cast<const char*>(shahash.c_str()), watoi64(res[i][L"filesize"]));
+
+			if(key==last)
+			{
+				continue;
+			}
+
+			last=key;
+
+			++n_done;
+
+			index->put(key, SCacheValue(Server->ConvertToUTF8(res[i][L"fullpath"]), Server->ConvertToUTF8(res[i][L"hashpath"])));
+
+			if(n_done % 10000 == 0 )
+			{
+				Server->Log("File entry cache contains "+nconvert(n_done)+" entries now.", LL_INFO);
+			}
+		}
+	}
+	while(!res.empty());
+
+	index->commit();
+}
+
+FileCache::SCacheValue HashIndexFileCache::get(const SCacheKey& key)
+{
+	SCacheValue ret;
+	if(index!=NULL)
+	{
+		index->get(key, ret);
+	}
+	return ret;
+}
+
+void HashIndexFileCache::start_transaction(void)
+{
+	if(index!=NULL)
+	{
+		index->begin();
+	}
+}
+
+void HashIndexFileCache::put(const SCacheKey& key, const SCacheValue& value)
+{
+	if(index!=NULL)
+	{
+		index->put(key, value);
+	}
+}
+
+void HashIndexFileCache::del(const SCacheKey& key)
+{
+	if(index!=NULL)
+	{
+		index->del(key);
+	}
+}
+
+void HashIndexFileCache::commit_transaction(void)
+{
+	if(index!=NULL)
+	{
+		index->commit();
+	}
+}
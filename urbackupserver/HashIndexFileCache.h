@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../Interface/Types.h"
+#include "FileCache.h"
+#include <string>
+
+class FileHashIndex;
+
+struct SHashIndexStats
+{
+	SHashIndexStats(void)
+		: entries(0), capacity(0), table_bytes(0), log_bytes(0), log_records(0), compactions(0)
+	{
+	}
+
+	int64 entries;
+	int64 capacity;
+	int64 table_bytes;
+	int64 log_bytes;
+	int64 log_records;
+	int64 compactions;
+};
+
+/**
+* File entry cache backend using a memory-mapped open-addressing hash table
+* keyed by (hash prefix, filesize). Slots only reference a record in an
+* append-only log, which stores the backup directory as an interned id plus
+* the path relative to it. The log is compacted in the background once most
+* of its records are overwritten or deleted.
+*/
+class HashIndexFileCache : public FileCache
+{
+public:
+	static const std::string default_path_prefix;
+
+	static bool openIndex(const std::string& path_prefix=default_path_prefix);
+	static void closeIndex(void);
+	static void deleteIndexFiles(const std::string& path_prefix=default_path_prefix);
+	static bool indexFilesExist(const std::string& path_prefix=default_path_prefix);
+	static SHashIndexStats getStats(void);
+
+	static void initFileCache(void);
+
+	HashIndexFileCache(void);
+	~HashIndexFileCache(void);
+
+	virtual bool has_error(void);
+
+	virtual void create(get_data_callback_t get_data_callback, void *userdata);
+
+	virtual SCacheValue get(const SCacheKey& key);
+
+	virtual void start_transaction(void);
+
+	virtual void put(const SCacheKey& key, const SCacheValue& value);
+
+	virtual void del(const SCacheKey& key);
+
+	virtual void commit_transaction(void);
+
+private:
+	static FileHashIndex* index;
+};
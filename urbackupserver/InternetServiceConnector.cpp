@@ -84,9 +84,9 @@ void InternetServiceConnector::Init(THREAD_ID pTID, IPipe *pPipe, const std::str
 		ServerSettings server_settings(Server->getDatabase(pTID, URBACKUPDB_SERVER));
 		SSettings *settings=server_settings.getSettings();
 		if(settings->internet_encrypt)
-			capa|=IPC_ENCRYPTED;
+			capa|=IPC_ENCRYPTED|IPC_ENCRYPTED_AEAD;
 		if(settings->internet_compress)
-			capa|=IPC_COMPRESSED;
+			capa|=IPC_COMPRESSED|IPC_COMPRESSED_STREAM;
 
 		compression_level=settings->internet_compression_level;
 		data.addUInt(capa);
@@ -100,10 +100,11 @@ void InternetServiceConnector::Init(THREAD_ID pTID, IPipe *pPipe, const std::str
 
 void InternetServiceConnector::cleanup_pipes(bool remove_connection)
 {
-	delete is_pipe;
-	is_pipe=NULL;
+	//comp_pipe writes to is_pipe until it is deleted
 	delete comp_pipe;
 	comp_pipe=NULL;
+	delete is_pipe;
+	is_pipe=NULL;
 
 	if(remove_connection)
 	{
@@ -360,12 +361,16 @@ void InternetServiceConnector::ReceivePackets(void)
 							comm_pipe=cs;
 							if(capa & IPC_ENCRYPTED )
 							{
+								if(capa & IPC_ENCRYPTED_AEAD)
+								{
+									is_pipe->enableAEAD(false);
+								}
 								is_pipe->setBackendPipe(comm_pipe);
 								comm_pipe=is_pipe;
 							}	
 							if(capa & IPC_COMPRESSED )
 							{
-								comp_pipe=new CompressedPipe(comm_pipe, compression_level);
+								comp_pipe=new CompressedPipe(comm_pipe, compression_level, (capa & IPC_COMPRESSED_STREAM)!=0);
 								comm_pipe=comp_pipe;
 							}
 
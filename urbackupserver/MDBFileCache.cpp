@@ -13,7 +13,7 @@ void MDBFileCache::initFileCache(size_t map_size)
 	Server->createThread(filecache);
 }
 
-MDBFileCache::MDBFileCache(size_t map_size)
+MDBFileCache::MDBFileCache(size_t map_size, const std::string& db_path)
 	: _has_error(false), txn(NULL)
 {
 	int rc;
@@ -38,7 +38,7 @@ MDBFileCache::MDBFileCache(size_t map_size)
 
 		os_create_dir(L"urbackup/cache");
 
-		rc = mdb_env_open(env, "urbackup/cache/backup_server_files_cache.lmdb", MDB_NOSUBDIR|MDB_NOMETASYNC, 0664);
+		rc = mdb_env_open(env, db_path.c_str(), MDB_NOSUBDIR|MDB_NOMETASYNC, 0664);
 
 		if(rc)
 		{
@@ -8,7 +8,7 @@ class MDBFileCache : public FileCache
 public:
 	static void initFileCache(size_t map_size);
 
-	MDBFileCache(size_t map_size);
+	MDBFileCache(size_t map_size, const std::string& db_path="urbackup/cache/backup_server_files_cache.lmdb");
 	~MDBFileCache(void);
 
 	virtual bool has_error(void);
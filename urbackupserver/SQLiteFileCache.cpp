@@ -1,6 +1,7 @@
 #include "SQLiteFileCache.h"
 #include "../Interface/Server.h"
 #include "database.h"
+#include "server_metrics.h"
 #include "../stringtools.h"
 #include "../common/data.h"
 
@@ -82,7 +83,7 @@ void SQLiteFileCache::create(get_data_callback_t get_data_callback, void *userda
 	}
 	while(!res.empty());
 
-	if(!db->EndTransaction())
+	if(!timedEndTransaction(db, "filecache"))
 	{
 		Server->Log("SQLiteCache: Failed to commit transaction", LL_ERROR);
 		_has_error=true;
@@ -146,5 +147,5 @@ void SQLiteFileCache::del(const SCacheKey& key)
 
 void SQLiteFileCache::commit_transaction(void)
 {
-	db->EndTransaction();
+	timedEndTransaction(db, "filecache");
 }
\ No newline at end of file
@@ -0,0 +1,594 @@
+#include "app.h"
+#include "benchmark_cmd.h"
+#include "benchmark_common.h"
+#include "benchmark_file_backup.h"
+#include "benchmark_database.h"
+#include "benchmark_filelist.h"
+#include "benchmark_transport.h"
+#include "benchmark_image.h"
+#include "benchmark_restore.h"
+#include "benchmark_hash_pipeline.h"
+#include "../server_metrics.h"
+#include "../server_file_entry_writer.h"
+#include "../../urbackupcommon/CompressedPipe.h"
+#include "../../urbackupcommon/os_functions.h"
+#include "../../cryptoplugin/ICryptoFactory.h"
+#include "../../fileservplugin/IFileServFactory.h"
+#include "../../fileservplugin/IFileServ.h"
+#include "../../fsimageplugin/IFSImageFactory.h"
+#include "../../urbackupcommon/sha2/sha2.h"
+#include "../../stringtools.h"
+#include <vector>
+#include <algorithm>
+
+extern IFSImageFactory *image_fak;
+extern ICryptoFactory *crypto_fak;
+
+int benchmark_cmd(void)
+{
+	ServerMetrics::init_mutex();
+	CompressedPipe::init_mutex();
+	ServerFileEntryWriter::initMutex();
+
+	std::wstring benchmark_dir=Server->ConvertToUnicode(Server->getServerParameter("benchmark_dir", "urbackup/benchmark"));
+	size_t nfiles=static_cast<size_t>(watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_files", "2000"))));
+	int64 max_file_size=watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_max_file_size", "67108864")));
+	int64 image_size=watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_image_size", "1073741824")));
+	unsigned int seed=static_cast<unsigned int>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_seed", "1"))));
+	unsigned short tcpport=static_cast<unsigned short>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_port", "35721"))));
+	bool keep_files=Server->getServerParameter("benchmark_keep")=="true";
+	size_t image_chain_len=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_image_chain", "30"))));
+	size_t nthreads=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_threads", "64"))));
+	size_t thread_lookups_n=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_thread_lookups", "100000"))));
+	//e.g. 10737418240 for 10GB
+	int64 compressed_pipe_size=watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_compressed_pipe_size", "1073741824")));
+	int64 encrypted_pipe_size=watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_encrypted_pipe_size", "1073741824")));
+	size_t pipe_messages=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_pipe_messages", "1000000"))));
+	size_t throttle_transfers=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_throttle_transfers", "50"))));
+	size_t throttle_bps=static_cast<size_t>(watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_throttle_bps", "104857600"))));
+	int64 throttle_ms=watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_throttle_ms", "10000")));
+	int64 sha2_size=watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_sha2_size", "268435456")));
+	size_t link_threads=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_link_threads", "4"))));
+	size_t link_batch_size=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_link_batch_size", "64"))));
+	//"none" or "hashindex"
+	std::string hash_pipeline_filecache=Server->getServerParameter("benchmark_hash_filecache", "none");
+	//e.g. 50000000
+	int64 file_entries=watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_file_entries", "1000000")));
+	size_t file_entry_producers=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_file_entry_producers", "32"))));
+	//e.g. 20000000
+	size_t filecache_entries=static_cast<size_t>(watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_filecache_entries", "1000000"))));
+	size_t filecache_lookups=static_cast<size_t>(watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_filecache_lookups", "1000000"))));
+	//e.g. 50000000
+	int64 dedup_filter_entries=watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_dedup_filter_entries", "10000000")));
+	size_t dedup_filter_lookups=static_cast<size_t>(watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_dedup_filter_lookups", "10000000"))));
+	double dedup_filter_fpr=atof(Server->getServerParameter("benchmark_dedup_filter_fpr", "0.01").c_str());
+	size_t dir_links_n=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_dir_links", "500000"))));
+	int64 filelist_entries=watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_filelist_entries", "2000000")));
+	int64 filelist_changes=watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_filelist_changes", "100")));
+	size_t buffer_churn_n=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_buffer_churn", "20000"))));
+	size_t buffer_threads=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_buffer_threads", "4"))));
+	int64 random_io_size=watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_random_io_size", "268435456")));
+	size_t random_io_reads=static_cast<size_t>(watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_random_io_reads", "200000"))));
+	//Every n-th 512KB block of the restore target changes before the delta restore
+	unsigned int restore_change_mod=static_cast<unsigned int>(watoi(Server->ConvertToUnicode(Server->getServerParameter("benchmark_restore_change_mod", "20"))));
+	//e.g. 107374182400 for a 100GB image. Defaults to benchmark_image_size
+	int64 image_write_size=watoi64(Server->ConvertToUnicode(Server->getServerParameter("benchmark_image_write_size", "0")));
+	if(image_write_size<=0)
+	{
+		image_write_size=image_size;
+	}
+
+	if(os_directory_exists(os_file_prefix(benchmark_dir)))
+	{
+		os_remove_nonempty_dir(os_file_prefix(benchmark_dir));
+	}
+
+	std::wstring clientdir=benchmark_dir+os_file_sep()+L"client";
+	std::wstring fullbackupdir=benchmark_dir+os_file_sep()+L"backup_full";
+	std::wstring incrbackupdir=benchmark_dir+os_file_sep()+L"backup_incr";
+	if(!os_create_dir_recursive(os_file_prefix(clientdir)))
+	{
+		Server->Log(L"Error creating benchmark directory \""+clientdir+L"\"", LL_ERROR);
+		return 1;
+	}
+
+	IFileServ *filesrv=NULL;
+	IFileServFactory *filesrv_fak=NULL;
+	PLUGIN_ID filesrv_pluginid;
+	{
+		str_map params;
+		filesrv_pluginid=Server->StartPlugin("fileserv", params);
+		filesrv_fak=(IFileServFactory*)Server->getPlugin(Server->getThreadID(), filesrv_pluginid);
+	}
+	if(filesrv_fak!=NULL)
+	{
+		filesrv=filesrv_fak->createFileServ(tcpport, tcpport+1, L"urbackup_benchmark", false, false);
+		filesrv->shareDir(L"benchmark", clientdir);
+		filesrv->addIdentity(benchmark_identity);
+	}
+	else
+	{
+		Server->Log("fileserv plugin not loaded. Load the client's fileservplugin via --plugin to benchmark transfers over the file server protocol. Using local copies instead.", LL_WARNING);
+	}
+
+	if(image_fak==NULL)
+	{
+		str_map params;
+		image_fak=(IFSImageFactory *)Server->getPlugin(Server->getThreadID(), Server->StartPlugin("fsimageplugin", params));
+		if( image_fak==NULL )
+		{
+			Server->Log("Error loading fsimageplugin. Skipping image backup benchmark.", LL_WARNING);
+		}
+	}
+
+	std::vector<SBenchmarkStage> stages;
+	std::vector<SBenchmarkFile> files;
+	bool ok=true;
+
+	Server->Log("Generating synthetic file tree ("+nconvert(nfiles)+" files, seed "+nconvert(seed)+")...", LL_INFO);
+	SBenchmarkStage generate_stage("generate");
+	ok=generate_tree(clientdir, nfiles, max_file_size, seed, files, generate_stage);
+	generate_stage.finish();
+	stages.push_back(generate_stage);
+
+	if(ok)
+	{
+		Server->Log("Running full file backup...", LL_INFO);
+		SBenchmarkStage transfer_stage("full_file_transfer");
+		ok=full_file_backup(filesrv, tcpport, clientdir, fullbackupdir, files, transfer_stage);
+		transfer_stage.finish();
+		stages.push_back(transfer_stage);
+	}
+
+	if(ok)
+	{
+		SBenchmarkStage hash_stage("full_file_hash");
+		for(size_t i=0;i<files.size() && ok;++i)
+		{
+			ok=hash_backup_file(fullbackupdir+os_file_sep()+files[i].relpath, hash_stage);
+		}
+		hash_stage.finish();
+		stages.push_back(hash_stage);
+	}
+
+	if(ok)
+	{
+		SBenchmarkStage modify_stage("modify");
+		ok=modify_tree(clientdir, seed, files, modify_stage);
+		modify_stage.finish();
+		stages.push_back(modify_stage);
+	}
+
+	if(ok)
+	{
+		Server->Log("Running incremental file backup...", LL_INFO);
+		SBenchmarkStage transfer_stage("incr_file_transfer");
+		SBenchmarkStage link_stage("incr_file_link");
+		ok=incremental_file_backup(filesrv, tcpport, clientdir, fullbackupdir, incrbackupdir, files, transfer_stage, link_stage);
+		//Both stages accumulate their own per file times
+		transfer_stage.starttime=Server->getTimeMS();
+		link_stage.starttime=transfer_stage.starttime;
+		transfer_stage.finish();
+		link_stage.finish();
+		stages.push_back(transfer_stage);
+		stages.push_back(link_stage);
+	}
+
+	if(ok)
+	{
+		Server->Log("Linking files serially and via the link stage with "+nconvert(link_threads)+" threads...", LL_INFO);
+		SBenchmarkStage serial_stage("link_stage_serial");
+		ok=link_stage_throughput(fullbackupdir, benchmark_dir+os_file_sep()+L"link_serial", files, 1, 1, serial_stage);
+		serial_stage.finish();
+		stages.push_back(serial_stage);
+
+		if(ok)
+		{
+			SBenchmarkStage parallel_stage("link_stage_parallel");
+			ok=link_stage_throughput(fullbackupdir, benchmark_dir+os_file_sep()+L"link_parallel", files, link_threads, link_batch_size, parallel_stage);
+			parallel_stage.finish();
+			stages.push_back(parallel_stage);
+		}
+	}
+
+	if(ok && image_fak!=NULL)
+	{
+		Server->Log("Running full image backup...", LL_INFO);
+		SBenchmarkStage full_image_stage("full_image");
+		ok=image_backup(benchmark_dir+os_file_sep()+L"image_full.vhd", std::wstring(), image_size, seed, 1, full_image_stage);
+		full_image_stage.finish();
+		stages.push_back(full_image_stage);
+
+		if(ok)
+		{
+			Server->Log("Running incremental image backup...", LL_INFO);
+			SBenchmarkStage incr_image_stage("incr_image");
+			ok=image_backup(benchmark_dir+os_file_sep()+L"image_incr.vhd", benchmark_dir+os_file_sep()+L"image_full.vhd",
+				image_size, seed, 10, incr_image_stage);
+			incr_image_stage.finish();
+			stages.push_back(incr_image_stage);
+		}
+
+		if(ok && image_chain_len>0)
+		{
+			Server->Log("Creating incremental image chain with "+nconvert(image_chain_len)+" images...", LL_INFO);
+			SBenchmarkStage chain_stage("image_chain_create");
+			std::wstring parentfn=benchmark_dir+os_file_sep()+L"image_full.vhd";
+			for(size_t i=0;i<image_chain_len && ok;++i)
+			{
+				std::wstring imagefn=benchmark_dir+os_file_sep()+L"image_chain_"+convert(i)+L".vhd";
+				ok=image_backup(imagefn, parentfn, image_size, seed+static_cast<unsigned int>(i)+1, 50, chain_stage);
+				parentfn=imagefn;
+			}
+			chain_stage.finish();
+			stages.push_back(chain_stage);
+
+			if(ok)
+			{
+				Server->Log("Reading image chain (building block map)...", LL_INFO);
+				SBenchmarkStage read_stage("image_chain_read_build");
+				ok=image_read(parentfn, read_stage);
+				read_stage.finish();
+				stages.push_back(read_stage);
+			}
+
+			if(ok)
+			{
+				Server->Log("Reading image chain (cached block map)...", LL_INFO);
+				SBenchmarkStage read_stage("image_chain_read_cached");
+				ok=image_read(parentfn, read_stage);
+				read_stage.finish();
+				stages.push_back(read_stage);
+			}
+		}
+	}
+
+	if(ok && image_fak!=NULL && restore_change_mod>0)
+	{
+		std::wstring imagefn=benchmark_dir+os_file_sep()+L"image_full.vhd";
+		std::wstring targetfn=benchmark_dir+os_file_sep()+L"restore_target.raw";
+		ok=image_restore_prepare(imagefn, targetfn);
+
+		if(ok)
+		{
+			Server->Log("Restoring full image with synchronous block writes...", LL_INFO);
+			SBenchmarkStage serial_restore_stage("image_restore_serial");
+			ok=image_restore(imagefn, targetfn, false, false, serial_restore_stage);
+			serial_restore_stage.finish();
+			stages.push_back(serial_restore_stage);
+		}
+
+		if(ok)
+		{
+			Server->Log("Restoring full image with pipelined block writes...", LL_INFO);
+			SBenchmarkStage pipelined_restore_stage("image_restore_pipelined");
+			ok=image_restore(imagefn, targetfn, false, true, pipelined_restore_stage);
+			pipelined_restore_stage.finish();
+			stages.push_back(pipelined_restore_stage);
+		}
+
+		if(ok)
+		{
+			ok=image_restore_modify(targetfn, seed, restore_change_mod);
+		}
+
+		if(ok)
+		{
+			Server->Log("Restoring full image onto modified target (delta restore)...", LL_INFO);
+			SBenchmarkStage delta_restore_stage("image_restore_delta");
+			ok=image_restore(imagefn, targetfn, true, true, delta_restore_stage);
+			delta_restore_stage.finish();
+			stages.push_back(delta_restore_stage);
+		}
+
+		if(!keep_files)
+		{
+			Server->deleteFile(os_file_prefix(targetfn));
+		}
+	}
+
+	if(ok && image_fak!=NULL)
+	{
+		Server->Log("Writing "+nconvert(image_write_size)+" bytes image sequentially...", LL_INFO);
+		SBenchmarkStage write_stage("image_write");
+		std::wstring imagefn=benchmark_dir+os_file_sep()+L"image_write.vhd";
+		ok=image_write(imagefn, image_write_size, write_stage);
+		write_stage.finish();
+		stages.push_back(write_stage);
+
+		if(!keep_files)
+		{
+			Server->deleteFile(os_file_prefix(imagefn));
+		}
+	}
+
+	if(ok && random_io_size>0 && random_io_reads>0)
+	{
+		std::wstring fn=benchmark_dir+os_file_sep()+L"random_io.dat";
+		BenchmarkRandom rnd(seed);
+		ok=write_random_file(fn, random_io_size, rnd);
+
+		if(ok)
+		{
+			Server->Log("Running "+nconvert(random_io_reads)+" random reads with Seek+Read...", LL_INFO);
+			SBenchmarkStage seek_stage("random_io_seek_read");
+			ok=random_io(fn, link_threads, random_io_reads, false, seed, seek_stage);
+			seek_stage.finish();
+			stages.push_back(seek_stage);
+		}
+
+		if(ok)
+		{
+			Server->Log("Running "+nconvert(random_io_reads)+" random reads with ReadAt...", LL_INFO);
+			SBenchmarkStage read_at_stage("random_io_read_at");
+			ok=random_io(fn, link_threads, random_io_reads, true, seed, read_at_stage);
+			read_at_stage.finish();
+			stages.push_back(read_at_stage);
+		}
+
+		Server->deleteFile(os_file_prefix(fn));
+	}
+
+	if(ok)
+	{
+		Server->Log("Running thread local lookups with "+nconvert(nthreads)+" threads...", LL_INFO);
+		SBenchmarkStage lookup_stage("thread_lookups");
+		ok=thread_lookups(benchmark_dir+os_file_sep()+L"thread_lookups.db", nthreads, thread_lookups_n, filesrv_pluginid, lookup_stage);
+		lookup_stage.finish();
+		stages.push_back(lookup_stage);
+	}
+
+	if(ok)
+	{
+		Server->Log("Passing "+nconvert(pipe_messages)+" messages through memory pipes...", LL_INFO);
+		SBenchmarkStage copy_stage("memory_pipe_copy");
+		ok=memory_pipe_throughput(pipe_messages, 4096, false, copy_stage);
+		copy_stage.finish();
+		stages.push_back(copy_stage);
+
+		if(ok)
+		{
+			SBenchmarkStage owned_stage("memory_pipe_owned");
+			ok=memory_pipe_throughput(pipe_messages, 4096, true, owned_stage);
+			owned_stage.finish();
+			stages.push_back(owned_stage);
+		}
+	}
+
+	if(ok && sha2_size>0)
+	{
+		Server->Log("Hashing "+PrettyPrintBytes(sha2_size)+" with the portable and the accelerated SHA-2 implementations...", LL_INFO);
+		for(int accel=0;accel<2 && ok;++accel)
+		{
+			sha2_set_accel(accel);
+			for(int mode=ESha2Benchmark_Sha256;mode<=ESha2Benchmark_Sha512Mb && ok;++mode)
+			{
+				SBenchmarkStage sha2_stage(sha2_stage_name(static_cast<ESha2Benchmark>(mode)));
+				ok=sha2_throughput(sha2_size, seed, static_cast<ESha2Benchmark>(mode), sha2_stage);
+				sha2_stage.finish();
+				stages.push_back(sha2_stage);
+			}
+		}
+		sha2_set_accel(1);
+	}
+
+	if(ok && file_entries>0 && file_entry_producers>0)
+	{
+		std::wstring dbfn=benchmark_dir+os_file_sep()+L"file_entries.db";
+		if(!Server->openDatabase(Server->ConvertToUTF8(dbfn), URBACKUPDB_BENCHMARK_FILES))
+		{
+			Server->Log(L"Error opening benchmark database \""+dbfn+L"\"", LL_ERROR);
+			ok=false;
+		}
+
+		if(ok)
+		{
+			Server->Log("Inserting "+nconvert(file_entries)+" file entries from "+nconvert(file_entry_producers)+" producers...", LL_INFO);
+			SBenchmarkStage direct_stage("file_entries_direct");
+			ok=file_entry_ingest(file_entry_producers, file_entries, false, direct_stage);
+			direct_stage.finish();
+			stages.push_back(direct_stage);
+		}
+
+		if(ok)
+		{
+			SBenchmarkStage writer_stage("file_entries_writer");
+			ok=file_entry_ingest(file_entry_producers, file_entries, true, writer_stage);
+			writer_stage.finish();
+			stages.push_back(writer_stage);
+		}
+	}
+
+	if(ok && filecache_entries>0)
+	{
+		Server->Log("Creating file entry caches with "+nconvert(filecache_entries)+" entries...", LL_INFO);
+		std::vector<FileCache::SCacheKey> keys;
+		std::vector<FileCache::SCacheKey> put_keys;
+		BenchmarkRandom rnd(seed);
+		for(size_t i=0;i<filecache_entries;++i)
+		{
+			FileCache::SCacheKey key;
+			rnd.fill(key.hash, sizeof(key.hash));
+			key.filesize=rnd.next();
+			if(i%10==0)
+			{
+				put_keys.push_back(key);
+			}
+			else
+			{
+				keys.push_back(key);
+			}
+		}
+		//The LMDB backend appends during creation, so keys need to be sorted
+		std::sort(keys.begin(), keys.end());
+
+		const char* backends[]={"lmdb", "sqlite", "hashindex"};
+		for(size_t i=0;i<sizeof(backends)/sizeof(backends[0]) && ok;++i)
+		{
+			ok=filecache_backend(backends[i], benchmark_dir, keys, put_keys, filecache_lookups, seed+1, stages);
+		}
+	}
+
+	if(ok && dedup_filter_entries>0)
+	{
+		Server->Log("Adding "+nconvert(dedup_filter_entries)+" entries to a deduplication filter...", LL_INFO);
+		ok=dedup_filter(dedup_filter_entries, dedup_filter_lookups, dedup_filter_fpr, seed, stages);
+	}
+
+	if(ok && dir_links_n>0)
+	{
+		Server->Log("Creating and removing "+nconvert(dir_links_n)+" directory links...", LL_INFO);
+		ok=dir_links(benchmark_dir, dir_links_n, stages);
+	}
+
+	if(ok && filelist_entries>0)
+	{
+		Server->Log("Walking a file list with "+nconvert(filelist_entries)+" entries...", LL_INFO);
+		ok=filelist_processing(benchmark_dir, filelist_entries, seed, stages);
+	}
+
+	if(ok && filelist_entries>0 && filelist_changes>0)
+	{
+		Server->Log("Creating and applying a file list delta with "+nconvert(filelist_changes)+" changes...", LL_INFO);
+		ok=filelist_delta(benchmark_dir, filelist_entries, filelist_changes, seed, stages);
+	}
+
+	if(ok && buffer_churn_n>0 && buffer_threads>0)
+	{
+		Server->Log("Allocating and releasing block buffers in "+nconvert(buffer_threads)+" threads...", LL_INFO);
+		SBenchmarkStage new_stage("buffer_churn_new");
+		ok=buffer_churn(buffer_threads, buffer_churn_n, false, new_stage);
+		new_stage.finish();
+		stages.push_back(new_stage);
+
+		if(ok)
+		{
+			SBenchmarkStage pool_stage("buffer_churn_pool");
+			ok=buffer_churn(buffer_threads, buffer_churn_n, true, pool_stage);
+			pool_stage.finish();
+			stages.push_back(pool_stage);
+		}
+	}
+
+	if(ok && throttle_transfers>0)
+	{
+		Server->Log("Running "+nconvert(throttle_transfers)+" throttled transfers limited to "+PrettyPrintBytes(throttle_bps)+"/s...", LL_INFO);
+		SBenchmarkStage throttle_stage("throttle_fairness");
+		ok=throttle_fairness(throttle_transfers, throttle_bps, throttle_ms, throttle_stage);
+		throttle_stage.finish();
+		stages.push_back(throttle_stage);
+	}
+
+	if(ok && crypto_fak==NULL)
+	{
+		str_map params;
+		crypto_fak=(ICryptoFactory *)Server->getPlugin(Server->getThreadID(), Server->StartPlugin("cryptoplugin", params));
+		if( crypto_fak==NULL )
+		{
+			Server->Log("Error loading cryptoplugin. Skipping compressed pipe benchmark.", LL_WARNING);
+		}
+	}
+
+	if(ok && crypto_fak!=NULL)
+	{
+		Server->Log("Pushing "+PrettyPrintBytes(compressed_pipe_size)+" through compressed pipes...", LL_INFO);
+		SBenchmarkStage legacy_stage("compressed_pipe");
+		ok=compressed_pipe_throughput(compressed_pipe_size, seed, false, legacy_stage);
+		legacy_stage.finish();
+		stages.push_back(legacy_stage);
+
+		if(ok)
+		{
+			SBenchmarkStage stream_stage("compressed_pipe_stream");
+			ok=compressed_pipe_throughput(compressed_pipe_size, seed, true, stream_stage);
+			stream_stage.finish();
+			stages.push_back(stream_stage);
+		}
+	}
+
+	if(ok && crypto_fak!=NULL)
+	{
+		Server->Log("Pushing "+PrettyPrintBytes(encrypted_pipe_size)+" through encrypted pipes...", LL_INFO);
+		SBenchmarkStage cfb_stage("encrypted_pipe_cfb");
+		ok=encrypted_pipe_throughput(encrypted_pipe_size, seed, false, cfb_stage);
+		cfb_stage.finish();
+		stages.push_back(cfb_stage);
+
+		if(ok)
+		{
+			SBenchmarkStage aead_stage("encrypted_pipe_gcm");
+			ok=encrypted_pipe_throughput(encrypted_pipe_size, seed, true, aead_stage);
+			aead_stage.finish();
+			stages.push_back(aead_stage);
+		}
+	}
+
+	if(ok)
+	{
+		Server->Log("Running file backups through the hash threads (file entry cache: "+hash_pipeline_filecache+")...", LL_INFO);
+		ok=hash_pipeline_setup(benchmark_dir, hash_pipeline_filecache);
+
+		if(ok)
+		{
+			SBenchmarkStage full_stage("hash_pipeline_full");
+			ok=hash_pipeline(clientdir, benchmark_dir+os_file_sep()+L"backup_pipeline_1", benchmark_dir+os_file_sep()+L"pipeline_tmp",
+				files, 1, full_stage);
+			full_stage.finish();
+			stages.push_back(full_stage);
+		}
+
+		if(ok)
+		{
+			//Same contents again, so every file is linked to the previous backup
+			SBenchmarkStage dedup_stage("hash_pipeline_dedup");
+			ok=hash_pipeline(clientdir, benchmark_dir+os_file_sep()+L"backup_pipeline_2", benchmark_dir+os_file_sep()+L"pipeline_tmp",
+				files, 2, dedup_stage);
+			dedup_stage.finish();
+			stages.push_back(dedup_stage);
+		}
+	}
+
+	if(ok)
+	{
+		Server->Log("Creating synthetic full file backup from incremental file backup...", LL_INFO);
+		SBenchmarkStage synthetic_stage("synthetic_full_file");
+		ok=synthetic_full_file_backup(incrbackupdir, benchmark_dir+os_file_sep()+L"backup_synthetic", synthetic_stage);
+		synthetic_stage.finish();
+		stages.push_back(synthetic_stage);
+	}
+
+	if(filesrv!=NULL)
+	{
+		filesrv_fak->destroyFileServ(filesrv);
+	}
+
+	std::string results;
+	for(size_t i=0;i<stages.size();++i)
+	{
+		std::string summary=stage_summary(stages[i]);
+		Server->Log(summary, LL_INFO);
+		results+=summary+"\n";
+	}
+	std::string rss="Peak RSS: "+nconvert(peak_rss_kb())+" KB";
+	Server->Log(rss, LL_INFO);
+	results+=rss+"\n";
+
+	writestring(results, "urbackup/benchmark_results.txt");
+	writestring(ServerMetrics::getPrometheusText(), "urbackup/benchmark_metrics.txt");
+	Server->Log(L"Benchmark results have been written to \""+Server->getServerWorkingDir()+os_file_sep()+L"urbackup/benchmark_results.txt\"", LL_INFO);
+
+	CompressedPipe::stop_idle_flusher();
+
+	if(!keep_files)
+	{
+		os_remove_nonempty_dir(os_file_prefix(benchmark_dir));
+	}
+
+	if(!ok)
+	{
+		Server->Log("Benchmark failed", LL_ERROR);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+int benchmark_cmd(void);
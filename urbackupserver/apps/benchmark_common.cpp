@@ -0,0 +1,96 @@
+#include "benchmark_common.h"
+#include "../../urbackupcommon/os_functions.h"
+#include "../../Interface/File.h"
+#include "../../stringtools.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+const std::string benchmark_identity="urbackup_benchmark_identity";
+
+int64 peak_rss_kb(void)
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if(GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+	{
+		return pmc.PeakWorkingSetSize/1024;
+	}
+	return -1;
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage)==0)
+	{
+		return usage.ru_maxrss;
+	}
+	return -1;
+#endif
+}
+
+std::string stage_summary(const SBenchmarkStage& stage)
+{
+	double secs=(std::max)(stage.ms, (int64)1)/1000.0;
+	return stage.name+": "+nconvert(stage.files)+" files, "+PrettyPrintBytes(stage.bytes)+" in "+nconvert(stage.ms)+" ms ("
+		+nconvert(stage.bytes/secs/(1024*1024))+" MB/s, "+nconvert(stage.files/secs)+" files/s)";
+}
+
+bool write_random_file(const std::wstring& fn, int64 size, BenchmarkRandom& rnd)
+{
+	IFile *f=Server->openFile(os_file_prefix(fn), MODE_WRITE);
+	if(f==NULL)
+	{
+		Server->Log(L"Error opening \""+fn+L"\" for writing", LL_ERROR);
+		return false;
+	}
+
+	std::vector<char> buf(32768);
+	int64 written=0;
+	while(written<size)
+	{
+		_u32 towrite=(_u32)(std::min)((int64)buf.size(), size-written);
+		rnd.fill(&buf[0], towrite);
+		if(f->Write(&buf[0], towrite)!=towrite)
+		{
+			Server->Log(L"Error writing to \""+fn+L"\"", LL_ERROR);
+			Server->destroy(f);
+			return false;
+		}
+		written+=towrite;
+	}
+
+	Server->destroy(f);
+	return true;
+}
+
+bool copy_benchmark_file(const std::wstring& src, const std::wstring& dst)
+{
+	IFile *fsrc=Server->openFile(os_file_prefix(src), MODE_READ);
+	if(fsrc==NULL) return false;
+	IFile *fdst=Server->openFile(os_file_prefix(dst), MODE_WRITE);
+	if(fdst==NULL)
+	{
+		Server->destroy(fsrc);
+		return false;
+	}
+
+	std::vector<char> buf(32768);
+	_u32 rc;
+	bool ret=true;
+	while((rc=fsrc->Read(&buf[0], (_u32)buf.size()))>0)
+	{
+		if(fdst->Write(&buf[0], rc)!=rc)
+		{
+			ret=false;
+			break;
+		}
+	}
+
+	Server->destroy(fsrc);
+	Server->destroy(fdst);
+	return ret;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "../../Interface/Server.h"
+#include "../../Interface/Types.h"
+#include "../server_metrics.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory.h>
+
+extern const std::string benchmark_identity;
+
+class BenchmarkRandom
+{
+public:
+	BenchmarkRandom(unsigned int seed)
+		: state(seed==0?1:seed)
+	{
+	}
+
+	unsigned int next(void)
+	{
+		state^=state<<13;
+		state^=state>>17;
+		state^=state<<5;
+		return state;
+	}
+
+	void fill(char* buf, size_t bsize)
+	{
+		for(size_t i=0;i<bsize;i+=sizeof(unsigned int))
+		{
+			unsigned int r=next();
+			memcpy(buf+i, &r, (std::min)(sizeof(unsigned int), bsize-i));
+		}
+	}
+
+private:
+	unsigned int state;
+};
+
+struct SBenchmarkFile
+{
+	std::wstring relpath;
+	int64 size;
+	bool changed;
+};
+
+struct SBenchmarkStage
+{
+	SBenchmarkStage(const std::string& name)
+		: name(name), files(0), bytes(0), starttime(Server->getTimeMS()), ms(0)
+	{
+	}
+
+	void finish(void)
+	{
+		ms+=Server->getTimeMS()-starttime;
+		ServerMetrics::addLatency("urbackup_benchmark_stage_ms{stage=\""+name+"\"}", ms);
+	}
+
+	std::string name;
+	int64 files;
+	int64 bytes;
+	int64 starttime;
+	int64 ms;
+};
+
+int64 peak_rss_kb(void);
+std::string stage_summary(const SBenchmarkStage& stage);
+bool write_random_file(const std::wstring& fn, int64 size, BenchmarkRandom& rnd);
+bool copy_benchmark_file(const std::wstring& src, const std::wstring& dst);
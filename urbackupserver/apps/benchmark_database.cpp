@@ -0,0 +1,602 @@
+#include "benchmark_database.h"
+#include "../server_file_entry_writer.h"
+#include "../MDBFileCache.h"
+#include "../SQLiteFileCache.h"
+#include "../HashIndexFileCache.h"
+#include "../server_dedup_filter.h"
+#include "../server_dir_links.h"
+#include "../dao/ServerBackupDao.h"
+#include "../database.h"
+#include "../../urbackupcommon/os_functions.h"
+#include "../../Interface/File.h"
+#include "../../Interface/ThreadPool.h"
+#include "../../Interface/Thread.h"
+#include "../../stringtools.h"
+#include <memory>
+
+namespace
+{
+	class ThreadLookupWorker : public IThread
+	{
+	public:
+		ThreadLookupWorker(size_t iterations, PLUGIN_ID pluginid)
+			: iterations(iterations), pluginid(pluginid)
+		{
+		}
+
+		void operator()(void)
+		{
+			for(size_t i=0;i<iterations;++i)
+			{
+				THREAD_ID tid=Server->getThreadID();
+				Server->getDatabase(tid, URBACKUPDB_BENCHMARK);
+				if(pluginid!=ILLEGAL_PLUGIN_ID)
+				{
+					Server->getPlugin(tid, pluginid);
+				}
+			}
+			Server->destroyDatabases(Server->getThreadID());
+		}
+
+	private:
+		size_t iterations;
+		PLUGIN_ID pluginid;
+	};
+
+	//Produces file entries like a hash thread of a running backup. Either
+	//writes them itself via the files_tmp table (one write transaction per
+	//batch) or hands them to the file entry writer
+	class FileEntryProducer : public IThread
+	{
+	public:
+		FileEntryProducer(size_t nrows, size_t batch_size, int clientid, bool use_writer)
+			: nrows(nrows), batch_size(batch_size), clientid(clientid), use_writer(use_writer)
+		{
+		}
+
+		void operator()(void)
+		{
+			BenchmarkRandom rnd(static_cast<unsigned int>(clientid)+1);
+			std::vector<SFileEntry> entries;
+			int64 ticket=0;
+
+			IDatabase* db=NULL;
+			IQuery* q_add_file=NULL;
+			IQuery* q_copy_files=NULL;
+			IQuery* q_delete_all_files_tmp=NULL;
+			if(!use_writer)
+			{
+				db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_BENCHMARK_FILES);
+				db->Write("CREATE TEMPORARY TABLE files_tmp ( backupid INTEGER, fullpath TEXT, hashpath TEXT, shahash BLOB, filesize INTEGER, created DATE DEFAULT CURRENT_TIMESTAMP, rsize INTEGER, clientid INTEGER, incremental INTEGER);");
+				q_add_file=db->Prepare("INSERT INTO files_tmp (backupid, fullpath, hashpath, shahash, filesize, rsize, clientid, incremental) VALUES (?, ?, ?, ?, ?, ?, ?, ?)", false);
+				q_copy_files=db->Prepare("INSERT INTO files (backupid, fullpath, hashpath, shahash, filesize, created, rsize, did_count, clientid, incremental) SELECT backupid, fullpath, hashpath, shahash, filesize, created, rsize, 0 AS did_count, clientid, incremental FROM files_tmp", false);
+				q_delete_all_files_tmp=db->Prepare("DELETE FROM files_tmp", false);
+			}
+
+			char shahash[64];
+			for(size_t i=0;i<nrows;)
+			{
+				size_t batch_end=(std::min)(nrows, i+batch_size);
+				for(;i<batch_end;++i)
+				{
+					SFileEntry entry;
+					rnd.fill(shahash, sizeof(shahash));
+					entry.backupid=clientid;
+					entry.fullpath=L"/backups/client"+convert(clientid)+L"/file"+convert(static_cast<int64>(i));
+					entry.shahash.assign(shahash, sizeof(shahash));
+					entry.filesize=rnd.next();
+					entry.rsize=entry.filesize;
+					entry.clientid=clientid;
+					entry.incremental=1;
+					entry.to_files_new=false;
+
+					if(use_writer)
+					{
+						entries.push_back(entry);
+					}
+					else
+					{
+						q_add_file->Bind(entry.backupid);
+						q_add_file->Bind(entry.fullpath);
+						q_add_file->Bind(entry.hashpath);
+						q_add_file->Bind(entry.shahash.c_str(), static_cast<_u32>(entry.shahash.size()));
+						q_add_file->Bind(entry.filesize);
+						q_add_file->Bind(entry.rsize);
+						q_add_file->Bind(entry.clientid);
+						q_add_file->Bind(static_cast<int>(entry.incremental));
+						q_add_file->Write();
+						q_add_file->Reset();
+					}
+				}
+
+				if(use_writer)
+				{
+					ticket=ServerFileEntryWriter::queueEntries(entries);
+				}
+				else
+				{
+					q_copy_files->Write();
+					q_copy_files->Reset();
+					q_delete_all_files_tmp->Write();
+					q_delete_all_files_tmp->Reset();
+				}
+			}
+
+			if(use_writer && !ServerFileEntryWriter::waitFor(ticket))
+			{
+				Server->Log("Writing file entries failed", LL_ERROR);
+			}
+			if(!use_writer)
+			{
+				db->destroyQuery(q_add_file);
+				db->destroyQuery(q_copy_files);
+				db->destroyQuery(q_delete_all_files_tmp);
+				Server->destroyDatabases(Server->getThreadID());
+			}
+		}
+
+	private:
+		size_t nrows;
+		size_t batch_size;
+		int clientid;
+		bool use_writer;
+	};
+
+	std::wstring filecache_path(size_t idx, bool hashpath)
+	{
+		std::wstring backup=L"backups"+os_file_sep()+L"client"+os_file_sep()+L"backup_"+convert(idx%16);
+		if(hashpath)
+		{
+			backup+=os_file_sep()+L".hashes";
+		}
+		return backup+os_file_sep()+L"dir_"+convert(idx/100)+os_file_sep()+L"file_"+convert(idx)+L".dat";
+	}
+
+	struct SFileCacheCreateData
+	{
+		const std::vector<FileCache::SCacheKey>* keys;
+		size_t pos;
+	};
+
+	db_results filecache_create_callback(size_t n_done, void *userdata)
+	{
+		SFileCacheCreateData* data=static_cast<SFileCacheCreateData*>(userdata);
+
+		db_results ret;
+		for(size_t i=0;i<1000 && data->pos<data->keys->size();++i,++data->pos)
+		{
+			const FileCache::SCacheKey& key=(*data->keys)[data->pos];
+			std::wstring shahash;
+			shahash.resize(sizeof(key.hash)/sizeof(wchar_t));
+			memcpy(&shahash[0], key.hash, sizeof(key.hash));
+
+			db_single_result res;
+			res[L"shahash"]=shahash;
+			res[L"filesize"]=convert(key.filesize);
+			res[L"fullpath"]=filecache_path(data->pos, false);
+			res[L"hashpath"]=filecache_path(data->pos, true);
+			ret.push_back(res);
+		}
+		return ret;
+	}
+
+	int64 files_size(const std::vector<std::wstring>& fns)
+	{
+		int64 ret=0;
+		for(size_t i=0;i<fns.size();++i)
+		{
+			IFile *f=Server->openFile(os_file_prefix(fns[i]), MODE_READ);
+			if(f!=NULL)
+			{
+				ret+=f->Size();
+				Server->destroy(f);
+			}
+		}
+		return ret;
+	}
+
+	std::wstring dir_link_path(const std::wstring& backupdir, size_t idx)
+	{
+		return backupdir+os_file_sep()+convert(idx/1000)+os_file_sep()+convert(idx);
+	}
+}
+
+bool thread_lookups(const std::wstring& dbfn, size_t nthreads, size_t iterations, PLUGIN_ID pluginid, SBenchmarkStage& stage)
+{
+	if(!Server->openDatabase(Server->ConvertToUTF8(dbfn), URBACKUPDB_BENCHMARK))
+	{
+		Server->Log(L"Error opening benchmark database \""+dbfn+L"\"", LL_ERROR);
+		return false;
+	}
+
+	std::vector<ThreadLookupWorker*> workers;
+	std::vector<THREADPOOL_TICKET> tickets;
+	for(size_t i=0;i<nthreads;++i)
+	{
+		workers.push_back(new ThreadLookupWorker(iterations, pluginid));
+	}
+	stage.starttime=Server->getTimeMS();
+	for(size_t i=0;i<nthreads;++i)
+	{
+		tickets.push_back(Server->getThreadPool()->execute(workers[i]));
+	}
+	Server->getThreadPool()->waitFor(tickets);
+
+	for(size_t i=0;i<nthreads;++i)
+	{
+		delete workers[i];
+	}
+
+	stage.files=static_cast<int64>(nthreads*iterations);
+
+	Server->destroyAllDatabases();
+	return true;
+}
+
+bool file_entry_ingest(size_t nproducers, int64 nrows, bool use_writer, SBenchmarkStage& stage)
+{
+	IDatabase* db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_BENCHMARK_FILES);
+	if(db==NULL)
+	{
+		Server->Log("Error opening file entry benchmark database", LL_ERROR);
+		return false;
+	}
+
+	db->Write("DROP TABLE IF EXISTS files");
+	if(!db->Write("CREATE TABLE files ( backupid INTEGER, fullpath TEXT, hashpath TEXT, shahash BLOB, filesize INTEGER, created DATE DEFAULT CURRENT_TIMESTAMP, rsize INTEGER, did_count INTEGER, clientid INTEGER, incremental INTEGER)")
+		|| !db->Write("CREATE TABLE IF NOT EXISTS files_new ( backupid INTEGER, fullpath TEXT, hashpath TEXT, shahash BLOB, filesize INTEGER, created DATE DEFAULT CURRENT_TIMESTAMP, rsize INTEGER, clientid INTEGER, incremental INTEGER)") )
+	{
+		Server->Log("Error creating files table in file entry benchmark database", LL_ERROR);
+		return false;
+	}
+	db->Write("CREATE INDEX files_idx ON files (shahash, filesize, clientid)");
+	db->Write("CREATE INDEX files_backupid ON files (backupid)");
+
+	if(use_writer)
+	{
+		ServerFileEntryWriter::start(URBACKUPDB_BENCHMARK_FILES);
+	}
+
+	const size_t batch_size=1000;
+	std::vector<FileEntryProducer*> producers;
+	std::vector<THREADPOOL_TICKET> tickets;
+	for(size_t i=0;i<nproducers;++i)
+	{
+		producers.push_back(new FileEntryProducer(static_cast<size_t>(nrows/nproducers), batch_size, static_cast<int>(i), use_writer));
+	}
+	stage.starttime=Server->getTimeMS();
+	for(size_t i=0;i<nproducers;++i)
+	{
+		tickets.push_back(Server->getThreadPool()->execute(producers[i]));
+	}
+	Server->getThreadPool()->waitFor(tickets);
+
+	for(size_t i=0;i<nproducers;++i)
+	{
+		delete producers[i];
+	}
+
+	if(use_writer)
+	{
+		ServerFileEntryWriter::stop();
+	}
+
+	db_results res=db->Read("SELECT COUNT(*) AS c FROM files");
+	if(!res.empty())
+	{
+		stage.files=watoi64(res[0][L"c"]);
+	}
+
+	Server->destroyAllDatabases();
+
+	int64 expected=static_cast<int64>(nrows/nproducers)*static_cast<int64>(nproducers);
+	if(stage.files!=expected)
+	{
+		Server->Log("File entry benchmark wrote "+nconvert(stage.files)+" rows. Expected "+nconvert(expected), LL_ERROR);
+		return false;
+	}
+	return true;
+}
+
+//Bulk creates the cache from keys, adds put_keys in transactions and
+//then looks up nlookups keys, half of which are not in the cache
+bool filecache_backend(const std::string& type, const std::wstring& benchmark_dir, const std::vector<FileCache::SCacheKey>& keys,
+	const std::vector<FileCache::SCacheKey>& put_keys, size_t nlookups, unsigned int seed, std::vector<SBenchmarkStage>& stages)
+{
+	std::auto_ptr<FileCache> filecache;
+	std::vector<std::wstring> cache_files;
+	std::wstring cache_fn=benchmark_dir+os_file_sep()+L"files_cache";
+	if(type=="lmdb")
+	{
+		size_t map_size=(std::max)(static_cast<size_t>(1024*1024*1024), (keys.size()+put_keys.size())*512);
+		filecache.reset(new MDBFileCache(map_size, Server->ConvertToUTF8(cache_fn+L".lmdb")));
+		cache_files.push_back(cache_fn+L".lmdb");
+	}
+	else if(type=="sqlite")
+	{
+		if(!Server->openDatabase(Server->ConvertToUTF8(cache_fn+L".db"), URBACKUPDB_FILES_CACHE))
+		{
+			Server->Log(L"Error opening file entry cache database \""+cache_fn+L".db\"", LL_ERROR);
+			return false;
+		}
+		IDatabase *db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_FILES_CACHE);
+		db->Write("PRAGMA journal_mode=WAL");
+		db->Write("CREATE TABLE files_cache ( key BLOB, value BLOB)");
+		filecache.reset(new SQLiteFileCache);
+		cache_files.push_back(cache_fn+L".db");
+		cache_files.push_back(cache_fn+L".db-wal");
+	}
+	else
+	{
+		if(!HashIndexFileCache::openIndex(Server->ConvertToUTF8(cache_fn)))
+		{
+			return false;
+		}
+		filecache.reset(new HashIndexFileCache);
+		cache_files.push_back(cache_fn+L".hidx");
+		cache_files.push_back(cache_fn+L".hlog");
+		cache_files.push_back(cache_fn+L".hroots");
+	}
+
+	if(filecache->has_error())
+	{
+		Server->Log("Error opening "+type+" file entry cache", LL_ERROR);
+		return false;
+	}
+
+	bool ok=true;
+	{
+		SBenchmarkStage create_stage("filecache_"+type+"_create");
+		SFileCacheCreateData data;
+		data.keys=&keys;
+		data.pos=0;
+		filecache->create(filecache_create_callback, &data);
+		create_stage.files=static_cast<int64>(keys.size());
+		create_stage.finish();
+		stages.push_back(create_stage);
+		ok=!filecache->has_error();
+	}
+
+	if(ok)
+	{
+		SBenchmarkStage put_stage("filecache_"+type+"_put");
+		filecache->start_transaction();
+		for(size_t i=0;i<put_keys.size();++i)
+		{
+			filecache->put(put_keys[i], FileCache::SCacheValue(Server->ConvertToUTF8(filecache_path(keys.size()+i, false)),
+				Server->ConvertToUTF8(filecache_path(keys.size()+i, true))));
+			if(i%10000==9999)
+			{
+				filecache->commit_transaction();
+				filecache->start_transaction();
+			}
+		}
+		filecache->commit_transaction();
+		put_stage.files=static_cast<int64>(put_keys.size());
+		put_stage.finish();
+		stages.push_back(put_stage);
+		ok=!filecache->has_error();
+	}
+
+	if(ok)
+	{
+		SBenchmarkStage lookup_stage("filecache_"+type+"_lookup");
+		BenchmarkRandom rnd(seed);
+		size_t errors=0;
+		for(size_t i=0;i<nlookups;++i)
+		{
+			FileCache::SCacheKey key;
+			size_t idx=rnd.next()%keys.size();
+			bool hit=i%2==0;
+			if(hit)
+			{
+				key=keys[idx];
+			}
+			else
+			{
+				rnd.fill(key.hash, sizeof(key.hash));
+				key.filesize=rnd.next();
+			}
+
+			FileCache::SCacheValue value=filecache->get(key);
+			if(value.exists!=hit
+				|| (hit && value.fullpath!=Server->ConvertToUTF8(filecache_path(idx, false))) )
+			{
+				++errors;
+			}
+		}
+		lookup_stage.files=static_cast<int64>(nlookups);
+		lookup_stage.finish();
+		stages.push_back(lookup_stage);
+
+		if(errors>0)
+		{
+			Server->Log(type+" file entry cache returned "+nconvert(errors)+" wrong lookup results", LL_ERROR);
+			ok=false;
+		}
+
+		int64 cache_size=files_size(cache_files);
+		int64 nentries=static_cast<int64>(keys.size()+put_keys.size());
+		Server->Log(type+" file entry cache: "+PrettyPrintBytes(cache_size)+" for "+nconvert(nentries)+" entries ("
+			+nconvert(cache_size/(std::max)(nentries, static_cast<int64>(1)))+" bytes/entry), "
+			+nconvert(lookup_stage.ms*1000/(std::max)(static_cast<int64>(nlookups), static_cast<int64>(1)))+" us/lookup", LL_INFO);
+		ServerMetrics::setGauge("urbackup_benchmark_filecache_bytes{backend=\""+type+"\"}", cache_size);
+	}
+
+	filecache.reset();
+	if(type=="sqlite")
+	{
+		Server->destroyAllDatabases();
+	}
+	else if(type=="hashindex")
+	{
+		HashIndexFileCache::closeIndex();
+	}
+
+	return ok;
+}
+
+//Adds nentries random keys to a deduplication filter, looks all of them up
+//again and then looks up nlookups keys which were not added
+bool dedup_filter(int64 nentries, size_t nlookups, double fpr, unsigned int seed, std::vector<SBenchmarkStage>& stages)
+{
+	DedupBloomFilter filter(nentries, fpr);
+
+	std::string shahash(64, 0);
+	{
+		SBenchmarkStage add_stage("dedup_filter_add");
+		BenchmarkRandom rnd(seed);
+		for(int64 i=0;i<nentries;++i)
+		{
+			rnd.fill(&shahash[0], shahash.size());
+			filter.add(shahash, rnd.next());
+		}
+		add_stage.files=nentries;
+		add_stage.finish();
+		stages.push_back(add_stage);
+	}
+
+	int64 false_negatives=0;
+	{
+		SBenchmarkStage hit_stage("dedup_filter_lookup_hit");
+		BenchmarkRandom rnd(seed);
+		for(int64 i=0;i<nentries;++i)
+		{
+			rnd.fill(&shahash[0], shahash.size());
+			if(!filter.mightContain(shahash, rnd.next()))
+			{
+				++false_negatives;
+			}
+		}
+		hit_stage.files=nentries;
+		hit_stage.finish();
+		stages.push_back(hit_stage);
+	}
+
+	int64 false_positives=0;
+	SBenchmarkStage miss_stage("dedup_filter_lookup_miss");
+	BenchmarkRandom rnd(seed+1);
+	for(size_t i=0;i<nlookups;++i)
+	{
+		rnd.fill(&shahash[0], shahash.size());
+		if(filter.mightContain(shahash, rnd.next()))
+		{
+			++false_positives;
+		}
+	}
+	miss_stage.files=static_cast<int64>(nlookups);
+	miss_stage.finish();
+	stages.push_back(miss_stage);
+
+	double measured_fpr=static_cast<double>(false_positives)/(std::max)(nlookups, static_cast<size_t>(1));
+	Server->Log("Deduplication filter: "+PrettyPrintBytes(filter.getBytes())+" for "+nconvert(nentries)+" entries, false positive rate "
+		+nconvert(measured_fpr*100)+"% (configured "+nconvert(fpr*100)+"%)", LL_INFO);
+	ServerMetrics::setGauge("urbackup_benchmark_dedup_filter_false_positives_ppm", static_cast<int64>(measured_fpr*1000000));
+
+	if(false_negatives>0)
+	{
+		Server->Log("Deduplication filter did not find "+nconvert(false_negatives)+" added entries", LL_ERROR);
+		return false;
+	}
+
+	return true;
+}
+
+//Creates ndirs directories in a first backup, links them into a second
+//backup (moving them into the pool), links them again into a third
+//backup and then removes all three backups
+bool dir_links(const std::wstring& benchmark_dir, size_t ndirs, std::vector<SBenchmarkStage>& stages)
+{
+	std::wstring root=benchmark_dir+os_file_sep()+L"dir_links";
+	std::wstring pooldir=root+os_file_sep()+L".directory_pool";
+	std::wstring backupdirs[3];
+	for(size_t i=0;i<3;++i)
+	{
+		backupdirs[i]=root+os_file_sep()+L"backup_"+convert(i);
+		for(size_t j=0;j<ndirs;j+=1000)
+		{
+			std::wstring groupdir=backupdirs[i]+os_file_sep()+convert(j/1000);
+			if(!os_create_dir_recursive(os_file_prefix(groupdir)))
+			{
+				Server->Log(L"Error creating directory \""+groupdir+L"\"", LL_ERROR);
+				return false;
+			}
+		}
+	}
+
+	for(size_t i=0;i<ndirs;++i)
+	{
+		if(!os_create_dir(os_file_prefix(dir_link_path(backupdirs[0], i))))
+		{
+			Server->Log(L"Error creating directory \""+dir_link_path(backupdirs[0], i)+L"\"", LL_ERROR);
+			return false;
+		}
+	}
+
+	std::wstring dbfn=root+os_file_sep()+L"dir_links.db";
+	if(!Server->openDatabase(Server->ConvertToUTF8(dbfn), URBACKUPDB_BENCHMARK_LINKS))
+	{
+		Server->Log(L"Error opening benchmark database \""+dbfn+L"\"", LL_ERROR);
+		return false;
+	}
+
+	IDatabase* db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_BENCHMARK_LINKS);
+	db->Write("PRAGMA journal_mode=WAL");
+	if(!db->Write("CREATE TABLE directory_links (id INTEGER PRIMARY KEY, clientid INTGER, name TEXT, target TEXT)")
+		|| !db->Write("CREATE INDEX directory_links_idx ON directory_links (clientid, name)")
+		|| !db->Write("CREATE INDEX directory_links_target_idx ON directory_links (clientid, target)")
+		|| !db->Write("CREATE TABLE directory_link_journal (id INTEGER PRIMARY KEY, linkname TEXT, linktarget TEXT)") )
+	{
+		Server->Log("Error creating directory link tables", LL_ERROR);
+		Server->destroyAllDatabases();
+		return false;
+	}
+
+	bool ok=true;
+	{
+		ServerBackupDao backup_dao(db);
+
+		const char* stage_names[]={"dir_links_create", "dir_links_reference"};
+		for(size_t s=0;s<2 && ok;++s)
+		{
+			SBenchmarkStage stage(stage_names[s]);
+			DirectoryLinkBatch dir_link_batch(backup_dao, 0, pooldir, false);
+			for(size_t i=0;i<ndirs && ok;++i)
+			{
+				ok=dir_link_batch.link(dir_link_path(backupdirs[s+1], i), dir_link_path(backupdirs[s], i));
+			}
+			ok=dir_link_batch.flush() && ok;
+			stage.files=dir_link_batch.getLinkedDirs();
+			stage.finish();
+			stages.push_back(stage);
+
+			if(!ok || stage.files!=static_cast<int64>(ndirs))
+			{
+				Server->Log("Linked "+nconvert(stage.files)+" directories. Expected "+nconvert(ndirs), LL_ERROR);
+				ok=false;
+			}
+		}
+
+		if(ok)
+		{
+			SBenchmarkStage remove_stage("dir_links_remove");
+			for(size_t i=0;i<3 && ok;++i)
+			{
+				ok=remove_directory_link_dir(backupdirs[i], backup_dao, 0);
+			}
+			remove_stage.files=static_cast<int64>(ndirs*3);
+			remove_stage.finish();
+			stages.push_back(remove_stage);
+
+			db_results res=db->Read("SELECT COUNT(*) AS c FROM directory_links");
+			if(res.empty() || res[0][L"c"]!=L"0")
+			{
+				Server->Log("Directory link references left after removing all backups", LL_ERROR);
+				ok=false;
+			}
+		}
+	}
+
+	Server->destroyAllDatabases();
+	return ok;
+}
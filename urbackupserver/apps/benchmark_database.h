@@ -0,0 +1,11 @@
+#pragma once
+
+#include "benchmark_common.h"
+#include "../FileCache.h"
+
+bool thread_lookups(const std::wstring& dbfn, size_t nthreads, size_t iterations, PLUGIN_ID pluginid, SBenchmarkStage& stage);
+bool file_entry_ingest(size_t nproducers, int64 nrows, bool use_writer, SBenchmarkStage& stage);
+bool filecache_backend(const std::string& type, const std::wstring& benchmark_dir, const std::vector<FileCache::SCacheKey>& keys,
+	const std::vector<FileCache::SCacheKey>& put_keys, size_t nlookups, unsigned int seed, std::vector<SBenchmarkStage>& stages);
+bool dedup_filter(int64 nentries, size_t nlookups, double fpr, unsigned int seed, std::vector<SBenchmarkStage>& stages);
+bool dir_links(const std::wstring& benchmark_dir, size_t ndirs, std::vector<SBenchmarkStage>& stages);
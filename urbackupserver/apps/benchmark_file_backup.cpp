@@ -0,0 +1,393 @@
+#include "benchmark_file_backup.h"
+#include "../server_prepare_hash.h"
+#include "../server_synthetic_backup.h"
+#include "../server_link_stage.h"
+#include "../dao/ServerBackupDao.h"
+#include "../database.h"
+#include "../fileclient/FileClient.h"
+#include "../fileclient/FileClientChunked.h"
+#include "../../urbackupcommon/fileclient/tcpstack.h"
+#include "../../urbackupcommon/os_functions.h"
+#include "../../fileservplugin/IFileServ.h"
+#include "../../Interface/File.h"
+#include "../../stringtools.h"
+#include <memory>
+
+namespace
+{
+	//Link stage which links files of the full backup into a new directory
+	class BenchmarkLinkStage : public ServerLinkStage
+	{
+	public:
+		BenchmarkLinkStage(size_t nthreads, size_t batch_size, const std::wstring& srcdir, const std::wstring& dstdir)
+			: ServerLinkStage(nthreads, batch_size), srcdir(srcdir), dstdir(dstdir)
+		{
+		}
+
+		~BenchmarkLinkStage(void)
+		{
+			stop();
+		}
+
+	protected:
+		class LinkWorker : public IWorker
+		{
+		public:
+			LinkWorker(BenchmarkLinkStage* stage)
+				: stage(stage)
+			{
+			}
+
+			virtual size_t linkBatch(std::vector<SLinkItem>& batch, int64& linked_bytes)
+			{
+				size_t nlinked=0;
+				for(size_t i=0;i<batch.size();++i)
+				{
+					bool too_many_links;
+					if(os_create_hardlink(os_file_prefix(stage->dstdir+os_file_sep()+batch[i].fn),
+						os_file_prefix(stage->srcdir+os_file_sep()+batch[i].fn), false, &too_many_links))
+					{
+						linked_bytes+=batch[i].filesize;
+						++nlinked;
+					}
+				}
+				return nlinked;
+			}
+
+		private:
+			BenchmarkLinkStage* stage;
+		};
+
+		virtual IWorker* createWorker(void)
+		{
+			return new LinkWorker(this);
+		}
+
+	private:
+		std::wstring srcdir;
+		std::wstring dstdir;
+	};
+
+	std::string remote_fn(const SBenchmarkFile& file)
+	{
+		return "benchmark/"+Server->ConvertToUTF8(greplace(os_file_sep(), L"/", file.relpath));
+	}
+
+	IPipe* connect_fileserv(unsigned short tcpport)
+	{
+		IPipe *cp=NULL;
+		for(size_t i=0;i<10 && cp==NULL;++i)
+		{
+			cp=Server->ConnectStream("127.0.0.1", tcpport, 10000);
+			if(cp==NULL)
+			{
+				Server->wait(500);
+			}
+		}
+		return cp;
+	}
+}
+
+bool generate_tree(const std::wstring& clientdir, size_t nfiles, int64 max_file_size, unsigned int seed, std::vector<SBenchmarkFile>& files, SBenchmarkStage& stage)
+{
+	BenchmarkRandom rnd(seed);
+
+	for(size_t i=0;i<nfiles;++i)
+	{
+		SBenchmarkFile file;
+		file.relpath=L"dir"+convert(i/100)+os_file_sep()+L"file"+convert(i)+L".dat";
+		file.changed=false;
+
+		unsigned int r=rnd.next()%100;
+		if(r<70)
+		{
+			file.size=rnd.next()%(16*1024);
+		}
+		else if(r<95)
+		{
+			file.size=16*1024+rnd.next()%(1024*1024);
+		}
+		else
+		{
+			file.size=1024*1024+rnd.next()%(std::max)(max_file_size-1024*1024, (int64)1);
+		}
+
+		if(i%100==0)
+		{
+			os_create_dir_recursive(clientdir+os_file_sep()+ExtractFilePath(file.relpath));
+		}
+
+		if(!write_random_file(clientdir+os_file_sep()+file.relpath, file.size, rnd))
+		{
+			return false;
+		}
+
+		++stage.files;
+		stage.bytes+=file.size;
+		files.push_back(file);
+	}
+
+	return true;
+}
+
+bool modify_tree(const std::wstring& clientdir, unsigned int seed, std::vector<SBenchmarkFile>& files, SBenchmarkStage& stage)
+{
+	BenchmarkRandom rnd(seed+1);
+
+	for(size_t i=0;i<files.size();++i)
+	{
+		if(rnd.next()%10!=0)
+		{
+			continue;
+		}
+
+		SBenchmarkFile& file=files[i];
+		IFile *f=Server->openFile(os_file_prefix(clientdir+os_file_sep()+file.relpath), MODE_RW);
+		if(f==NULL)
+		{
+			Server->Log(L"Error opening \""+file.relpath+L"\" for modification", LL_ERROR);
+			return false;
+		}
+
+		std::vector<char> buf(static_cast<size_t>((std::min)(file.size, (int64)65536)));
+		if(!buf.empty())
+		{
+			rnd.fill(&buf[0], buf.size());
+			f->Seek((file.size-buf.size())/2);
+			f->Write(&buf[0], (_u32)buf.size());
+		}
+		Server->destroy(f);
+
+		file.changed=true;
+		++stage.files;
+		stage.bytes+=buf.size();
+	}
+
+	return true;
+}
+
+bool hash_backup_file(const std::wstring& fn, SBenchmarkStage& stage)
+{
+	IFile *f=Server->openFile(os_file_prefix(fn), MODE_READ);
+	if(f==NULL) return false;
+
+	IFile *hashoutput=Server->openFile(os_file_prefix(fn+L".hash"), MODE_WRITE);
+	if(hashoutput==NULL)
+	{
+		Server->destroy(f);
+		return false;
+	}
+
+	BackupServerPrepareHash::build_chunk_hashs(f, hashoutput, NULL, true, NULL, false);
+
+	stage.bytes+=f->Size();
+	++stage.files;
+	Server->destroy(hashoutput);
+	Server->destroy(f);
+	return true;
+}
+
+bool full_file_backup(IFileServ* filesrv, unsigned short tcpport, const std::wstring& clientdir, const std::wstring& backupdir,
+	const std::vector<SBenchmarkFile>& files, SBenchmarkStage& transfer_stage)
+{
+	FileClient fc(false, benchmark_identity, 2);
+	if(filesrv!=NULL)
+	{
+		IPipe *cp=connect_fileserv(tcpport);
+		if(cp==NULL)
+		{
+			Server->Log("Cannot connect to benchmark file server", LL_ERROR);
+			return false;
+		}
+		fc.Connect(cp);
+	}
+
+	for(size_t i=0;i<files.size();++i)
+	{
+		const SBenchmarkFile& file=files[i];
+		std::wstring dstfn=backupdir+os_file_sep()+file.relpath;
+
+		if(i%100==0)
+		{
+			os_create_dir_recursive(ExtractFilePath(dstfn));
+		}
+
+		if(filesrv!=NULL)
+		{
+			IFile *dst=Server->openFile(os_file_prefix(dstfn), MODE_WRITE);
+			if(dst==NULL)
+			{
+				Server->Log(L"Error opening \""+dstfn+L"\" for writing", LL_ERROR);
+				return false;
+			}
+
+			std::string remotefn=remote_fn(file);
+			_u32 rc=fc.GetFile(remotefn, dst, true);
+			Server->destroy(dst);
+			if(rc!=ERR_SUCCESS)
+			{
+				Server->Log("Error transferring \""+remotefn+"\": "+FileClient::getErrorString(rc), LL_ERROR);
+				return false;
+			}
+		}
+		else if(!copy_benchmark_file(clientdir+os_file_sep()+file.relpath, dstfn))
+		{
+			Server->Log(L"Error copying \""+file.relpath+L"\"", LL_ERROR);
+			return false;
+		}
+
+		++transfer_stage.files;
+		transfer_stage.bytes+=file.size;
+	}
+
+	return true;
+}
+
+bool incremental_file_backup(IFileServ* filesrv, unsigned short tcpport, const std::wstring& clientdir, const std::wstring& fullbackupdir,
+	const std::wstring& backupdir, const std::vector<SBenchmarkFile>& files, SBenchmarkStage& transfer_stage, SBenchmarkStage& link_stage)
+{
+	CTCPStack tcpstack;
+	std::auto_ptr<FileClientChunked> fc_chunked;
+	if(filesrv!=NULL)
+	{
+		IPipe *cp=connect_fileserv(tcpport);
+		if(cp==NULL)
+		{
+			Server->Log("Cannot connect to benchmark file server", LL_ERROR);
+			return false;
+		}
+		fc_chunked.reset(new FileClientChunked(cp, true, &tcpstack, NULL, NULL, benchmark_identity, NULL));
+	}
+
+	for(size_t i=0;i<files.size();++i)
+	{
+		const SBenchmarkFile& file=files[i];
+		std::wstring srcfn=fullbackupdir+os_file_sep()+file.relpath;
+		std::wstring dstfn=backupdir+os_file_sep()+file.relpath;
+
+		if(i%100==0)
+		{
+			os_create_dir_recursive(ExtractFilePath(dstfn));
+		}
+
+		if(!file.changed)
+		{
+			int64 starttime=Server->getTimeMS();
+			bool too_many_links;
+			if(!os_create_hardlink(os_file_prefix(dstfn), os_file_prefix(srcfn), false, &too_many_links)
+				&& !copy_benchmark_file(srcfn, dstfn))
+			{
+				Server->Log(L"Error linking \""+file.relpath+L"\"", LL_ERROR);
+				return false;
+			}
+			link_stage.ms+=Server->getTimeMS()-starttime;
+			++link_stage.files;
+			link_stage.bytes+=file.size;
+			continue;
+		}
+
+		int64 starttime=Server->getTimeMS();
+		if(fc_chunked.get()!=NULL)
+		{
+			if(!copy_benchmark_file(srcfn, dstfn))
+			{
+				Server->Log(L"Error copying \""+file.relpath+L"\"", LL_ERROR);
+				return false;
+			}
+
+			IFile *dst=Server->openFile(os_file_prefix(dstfn), MODE_RW);
+			IFile *chunkhashes=Server->openFile(os_file_prefix(srcfn+L".hash"), MODE_READ);
+			IFile *hashoutput=Server->openFile(os_file_prefix(dstfn+L".hash"), MODE_RW_CREATE);
+			_u32 rc=ERR_ERROR;
+			if(dst!=NULL && chunkhashes!=NULL && hashoutput!=NULL)
+			{
+				int64 predicted_filesize=file.size;
+				rc=fc_chunked->GetFileChunked(remote_fn(file), dst, chunkhashes, hashoutput, predicted_filesize);
+			}
+			if(dst!=NULL) Server->destroy(dst);
+			if(chunkhashes!=NULL) Server->destroy(chunkhashes);
+			if(hashoutput!=NULL) Server->destroy(hashoutput);
+
+			if(rc!=ERR_SUCCESS)
+			{
+				Server->Log(L"Error transferring \""+file.relpath+L"\" chunked", LL_ERROR);
+				return false;
+			}
+		}
+		else if(!copy_benchmark_file(clientdir+os_file_sep()+file.relpath, dstfn))
+		{
+			Server->Log(L"Error copying \""+file.relpath+L"\"", LL_ERROR);
+			return false;
+		}
+		transfer_stage.ms+=Server->getTimeMS()-starttime;
+		++transfer_stage.files;
+		transfer_stage.bytes+=file.size;
+	}
+
+	return true;
+}
+
+bool link_stage_throughput(const std::wstring& srcdir, const std::wstring& dstdir, const std::vector<SBenchmarkFile>& files,
+	size_t nthreads, size_t batch_size, SBenchmarkStage& stage)
+{
+	for(size_t i=0;i<files.size();i+=100)
+	{
+		if(!os_create_dir_recursive(os_file_prefix(dstdir+os_file_sep()+ExtractFilePath(files[i].relpath))))
+		{
+			Server->Log(L"Error creating link stage directory in \""+dstdir+L"\"", LL_ERROR);
+			return false;
+		}
+	}
+
+	stage.starttime=Server->getTimeMS();
+
+	BenchmarkLinkStage link_stage(nthreads, batch_size, srcdir, dstdir);
+	link_stage.start();
+	for(size_t i=0;i<files.size();++i)
+	{
+		SLinkItem item;
+		item.id=i;
+		item.fn=files[i].relpath;
+		item.filesize=files[i].size;
+		link_stage.queueLink(item);
+	}
+	link_stage.stop();
+
+	stage.files=link_stage.getLinkedFiles();
+	stage.bytes=link_stage.takeLinkedBytes();
+
+	if(stage.files!=static_cast<int64>(files.size()))
+	{
+		Server->Log("Link stage linked only "+nconvert(stage.files)+" of "+nconvert(files.size())+" files", LL_ERROR);
+		return false;
+	}
+
+	return true;
+}
+
+bool synthetic_full_file_backup(const std::wstring& srcdir, const std::wstring& dstdir, SBenchmarkStage& stage)
+{
+	IDatabase *db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_BENCHMARK);
+	if(db==NULL)
+	{
+		Server->Log("Error opening benchmark database", LL_ERROR);
+		return false;
+	}
+
+	if(!os_create_dir(os_file_prefix(dstdir)))
+	{
+		Server->Log(L"Error creating directory \""+dstdir+L"\"", LL_ERROR);
+		return false;
+	}
+
+	bool ret;
+	{
+		ServerBackupDao backup_dao(db);
+		ServerSyntheticBackup synthetic_backup(backup_dao, 0, L"", L"", false);
+		ret=synthetic_backup.linkTree(srcdir, dstdir);
+		stage.files=synthetic_backup.getLinkedFiles();
+	}
+
+	Server->destroyAllDatabases();
+	return ret;
+}
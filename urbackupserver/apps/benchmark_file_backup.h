@@ -0,0 +1,16 @@
+#pragma once
+
+#include "benchmark_common.h"
+
+class IFileServ;
+
+bool generate_tree(const std::wstring& clientdir, size_t nfiles, int64 max_file_size, unsigned int seed, std::vector<SBenchmarkFile>& files, SBenchmarkStage& stage);
+bool modify_tree(const std::wstring& clientdir, unsigned int seed, std::vector<SBenchmarkFile>& files, SBenchmarkStage& stage);
+bool hash_backup_file(const std::wstring& fn, SBenchmarkStage& stage);
+bool full_file_backup(IFileServ* filesrv, unsigned short tcpport, const std::wstring& clientdir, const std::wstring& backupdir,
+	const std::vector<SBenchmarkFile>& files, SBenchmarkStage& transfer_stage);
+bool incremental_file_backup(IFileServ* filesrv, unsigned short tcpport, const std::wstring& clientdir, const std::wstring& fullbackupdir,
+	const std::wstring& backupdir, const std::vector<SBenchmarkFile>& files, SBenchmarkStage& transfer_stage, SBenchmarkStage& link_stage);
+bool link_stage_throughput(const std::wstring& srcdir, const std::wstring& dstdir, const std::vector<SBenchmarkFile>& files,
+	size_t nthreads, size_t batch_size, SBenchmarkStage& stage);
+bool synthetic_full_file_backup(const std::wstring& srcdir, const std::wstring& dstdir, SBenchmarkStage& stage);
@@ -0,0 +1,277 @@
+#include "benchmark_filelist.h"
+#include "../server_get.h"
+#include "../server_filelist.h"
+#include "../../urbackupcommon/filelist_delta.h"
+#include "../../urbackupcommon/os_functions.h"
+#include "../../Interface/File.h"
+#include "../../stringtools.h"
+#include <memory>
+
+namespace
+{
+	//Writes a client file list with nentries entries. Every directory has
+	//100 files with client side hashes and directories are nested up to
+	//five levels deep. With change_interval set every change_interval-th
+	//file is modified and gets a new sibling, everything else is the same
+	//as the list written with the same seed and no changes.
+	bool write_filelist(const std::wstring& fn, int64 nentries, unsigned int seed, int64 change_interval=0)
+	{
+		IFile* f=Server->openFile(os_file_prefix(fn), MODE_WRITE);
+		if(f==NULL)
+		{
+			Server->Log(L"Error opening \""+fn+L"\" for writing", LL_ERROR);
+			return false;
+		}
+
+		BenchmarkRandom rnd(seed);
+		std::string shahash(64, 0);
+		std::string buf;
+		int depth=0;
+		bool ok=true;
+		for(int64 i=0;i<nentries && ok;++i)
+		{
+			if(i%100==0)
+			{
+				int new_depth=static_cast<int>(rnd.next()%5);
+				for(;depth>new_depth;--depth)
+				{
+					buf+="d\"..\"\n";
+				}
+				buf+="d\"directory "+nconvert(i)+"\"\n";
+				++depth;
+			}
+			rnd.fill(&shahash[0], shahash.size());
+			int64 last_modified=1400000000+i;
+			bool changed=change_interval>0 && i%change_interval==change_interval/2;
+			if(changed)
+			{
+				last_modified+=86400;
+			}
+			buf+="f\"file_"+nconvert(i)+".txt\" "+nconvert(rnd.next()%1000000)+" "+nconvert(last_modified)
+				+"#sha512="+base64_encode_dash(shahash)+"\n";
+			if(changed)
+			{
+				buf+="f\"file_"+nconvert(i)+"_new.txt\" 1000 "+nconvert(last_modified)
+					+"#sha512="+base64_encode_dash(shahash)+"\n";
+			}
+
+			if(buf.size()>32768)
+			{
+				ok=f->Write(buf)==buf.size();
+				buf.clear();
+			}
+		}
+		for(;depth>0;--depth)
+		{
+			buf+="d\"..\"\n";
+		}
+		ok=ok && f->Write(buf)==buf.size();
+		Server->destroy(f);
+
+		if(!ok)
+		{
+			Server->Log(L"Error writing to \""+fn+L"\"", LL_ERROR);
+		}
+		return ok;
+	}
+
+	//Walks a file list like the backup loops do. The wide variant does the
+	//per entry work of the former loops: a parameter map per entry and
+	//paths concatenated and converted per entry. The compact variant keeps
+	//names UTF-8 until needed and builds paths on a FilelistPathStack.
+	bool filelist_walk(const std::wstring& fn, bool compact, SBenchmarkStage& stage)
+	{
+		IFile* f=Server->openFile(os_file_prefix(fn), MODE_READ);
+		if(f==NULL)
+		{
+			Server->Log(L"Error opening \""+fn+L"\"", LL_ERROR);
+			return false;
+		}
+
+		FilelistParser filelist_parser(0);
+		SFilelistEntry filelist_entry;
+		FilelistPathStack path_stack;
+		std::wstring curr_path;
+		std::wstring curr_os_path;
+		SFile cf;
+		int64 hashes=0;
+
+		char buffer[4096];
+		_u32 read;
+		while( (read=f->Read(buffer, 4096))>0 )
+		{
+			stage.bytes+=read;
+			if(compact)
+			{
+				size_t i=0;
+				while(filelist_parser.nextEntry(buffer, read, i, filelist_entry))
+				{
+					filelist_entry.toSFile(cf);
+					if(cf.isdir)
+					{
+						if(filelist_entry.isParentDir())
+						{
+							path_stack.pop();
+						}
+						else
+						{
+							path_stack.push(cf.name, cf.name);
+						}
+					}
+					else
+					{
+						const std::wstring& local_path=path_stack.localOsFilePath(cf.name);
+						if(!local_path.empty() && filelist_entry.getSha512().size()==64)
+						{
+							++hashes;
+						}
+					}
+					++stage.files;
+				}
+			}
+			else
+			{
+				for(_u32 i=0;i<read;++i)
+				{
+					size_t pos=0;
+					if(filelist_parser.nextEntry(buffer+i, 1, pos, filelist_entry))
+					{
+						std::map<std::wstring, std::wstring> extra_params;
+						filelist_entry.toSFile(cf);
+						if(!filelist_entry.extra.empty())
+						{
+							ParseParamStrHttp(filelist_entry.extra, &extra_params, false);
+						}
+						if(cf.isdir)
+						{
+							if(cf.name==L"..")
+							{
+								curr_path=ExtractFilePath(curr_path, L"/");
+								curr_os_path=ExtractFilePath(curr_os_path, L"/");
+							}
+							else
+							{
+								curr_path+=L"/"+cf.name;
+								curr_os_path+=L"/"+cf.name;
+							}
+						}
+						else
+						{
+							std::wstring local_path=BackupServerGet::convertToOSPathFromFileClient(curr_os_path+L"/"+cf.name);
+							std::map<std::wstring, std::wstring>::iterator hash_it=extra_params.find(L"sha512");
+							if(!local_path.empty() && hash_it!=extra_params.end()
+								&& base64_decode_dash(wnarrow(hash_it->second)).size()==64)
+							{
+								++hashes;
+							}
+						}
+						++stage.files;
+					}
+				}
+			}
+		}
+		Server->destroy(f);
+
+		if(hashes==0)
+		{
+			Server->Log("No client side hashes found in file list", LL_ERROR);
+			return false;
+		}
+		return true;
+	}
+}
+
+bool filelist_processing(const std::wstring& benchmark_dir, int64 nentries, unsigned int seed, std::vector<SBenchmarkStage>& stages)
+{
+	std::wstring fn=benchmark_dir+os_file_sep()+L"filelist.ub";
+	if(!write_filelist(fn, nentries, seed))
+	{
+		return false;
+	}
+
+	bool ok=true;
+	const char* variants[]={"filelist_walk_wide", "filelist_walk_compact"};
+	for(size_t i=0;i<2 && ok;++i)
+	{
+		int64 rss_before=peak_rss_kb();
+		SBenchmarkStage stage(variants[i]);
+		ok=filelist_walk(fn, i==1, stage);
+		stage.finish();
+		stages.push_back(stage);
+		ServerMetrics::setGauge(std::string("urbackup_benchmark_peak_rss_growth_kb{stage=\"")+variants[i]+"\"}", peak_rss_kb()-rss_before);
+	}
+
+	Server->deleteFile(os_file_prefix(fn));
+	return ok;
+}
+
+//Creates a delta between two file lists differing in nchanges files
+//and rebuilds the new list from it, like client and server do for
+//incremental backups
+bool filelist_delta(const std::wstring& benchmark_dir, int64 nentries, int64 nchanges, unsigned int seed, std::vector<SBenchmarkStage>& stages)
+{
+	std::wstring base_fn=benchmark_dir+os_file_sep()+L"filelist_base.ub";
+	std::wstring new_fn=benchmark_dir+os_file_sep()+L"filelist_new.ub";
+	std::wstring delta_fn=benchmark_dir+os_file_sep()+L"filelist_delta.ub";
+	std::wstring rebuilt_fn=benchmark_dir+os_file_sep()+L"filelist_rebuilt.ub";
+
+	if(!write_filelist(base_fn, nentries, seed)
+		|| !write_filelist(new_fn, nentries, seed, (std::max)(nentries/nchanges, static_cast<int64>(1))))
+	{
+		return false;
+	}
+
+	std::auto_ptr<IFile> base(Server->openFile(os_file_prefix(base_fn), MODE_READ));
+	std::auto_ptr<IFile> new_list(Server->openFile(os_file_prefix(new_fn), MODE_READ));
+	std::auto_ptr<IFile> delta(Server->openFile(os_file_prefix(delta_fn), MODE_RW_CREATE));
+	std::auto_ptr<IFile> rebuilt(Server->openFile(os_file_prefix(rebuilt_fn), MODE_RW_CREATE));
+	if(base.get()==NULL || new_list.get()==NULL || delta.get()==NULL || rebuilt.get()==NULL)
+	{
+		Server->Log("Error opening file lists for delta benchmark", LL_ERROR);
+		return false;
+	}
+
+	SBenchmarkStage create_stage("filelist_delta_create");
+	std::string new_hash;
+	bool ok=create_filelist_delta(base.get(), new_list.get(), delta.get(), &new_hash);
+	create_stage.bytes=base->Size()+new_list->Size();
+	create_stage.files=nentries;
+	create_stage.finish();
+	stages.push_back(create_stage);
+
+	if(!ok)
+	{
+		Server->Log("Creating file list delta failed", LL_ERROR);
+	}
+
+	SBenchmarkStage apply_stage("filelist_delta_apply");
+	std::string rebuilt_hash;
+	ok=ok && apply_filelist_delta(base.get(), filelist_hash(base.get()), delta.get(), rebuilt.get(), &rebuilt_hash);
+	apply_stage.bytes=delta->Size();
+	apply_stage.files=nentries;
+	apply_stage.finish();
+	stages.push_back(apply_stage);
+
+	if(ok && (rebuilt_hash!=new_hash || rebuilt->Size()!=new_list->Size()
+			|| filelist_hash(rebuilt.get())!=filelist_hash(new_list.get())))
+	{
+		Server->Log("File list rebuilt from delta differs from new file list", LL_ERROR);
+		ok=false;
+	}
+
+	ServerMetrics::setGauge("urbackup_benchmark_filelist_bytes{mode=\"full\"}", new_list->Size());
+	ServerMetrics::setGauge("urbackup_benchmark_filelist_bytes{mode=\"delta\"}", delta->Size());
+	//Time from the end of indexing until the list is usable on the server, not including the transfer
+	ServerMetrics::setGauge("urbackup_benchmark_filelist_delta_overhead_ms", create_stage.ms+apply_stage.ms);
+	Server->Log("File list "+PrettyPrintBytes(new_list->Size())+", delta "+PrettyPrintBytes(delta->Size()), LL_INFO);
+
+	base.reset();
+	new_list.reset();
+	delta.reset();
+	rebuilt.reset();
+	Server->deleteFile(os_file_prefix(base_fn));
+	Server->deleteFile(os_file_prefix(new_fn));
+	Server->deleteFile(os_file_prefix(delta_fn));
+	Server->deleteFile(os_file_prefix(rebuilt_fn));
+	return ok;
+}
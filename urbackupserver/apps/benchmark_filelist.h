@@ -0,0 +1,6 @@
+#pragma once
+
+#include "benchmark_common.h"
+
+bool filelist_processing(const std::wstring& benchmark_dir, int64 nentries, unsigned int seed, std::vector<SBenchmarkStage>& stages);
+bool filelist_delta(const std::wstring& benchmark_dir, int64 nentries, int64 nchanges, unsigned int seed, std::vector<SBenchmarkStage>& stages);
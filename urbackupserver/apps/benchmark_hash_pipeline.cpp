@@ -0,0 +1,143 @@
+#include "benchmark_hash_pipeline.h"
+#include "../server_hash.h"
+#include "../server_prepare_hash.h"
+#include "../server_settings.h"
+#include "../server_dedup_filter.h"
+#include "../create_files_cache.h"
+#include "../database.h"
+#include "../../urbackupcommon/os_functions.h"
+#include "../../Interface/Database.h"
+#include "../../Interface/Pipe.h"
+#include "../../Interface/ThreadPool.h"
+#include "../../stringtools.h"
+
+namespace
+{
+	const int hash_pipeline_clientid=1;
+
+	bool pipeline_busy(BackupServerHash* bsh, BackupServerPrepareHash* bsh_prepare)
+	{
+		return bsh->getQueueSize()>0 || bsh->isWorking()
+			|| bsh_prepare->getQueueSize()>0 || bsh_prepare->isWorking();
+	}
+}
+
+//The hash threads use the server database. The benchmark runs before it
+//is opened, so this opens a scratch database with the tables they need
+bool hash_pipeline_setup(const std::wstring& benchmark_dir, const std::string& filescache_type)
+{
+	ServerSettings::init_mutex();
+	ServerDedupFilter::initMutex();
+
+	std::wstring dbfn=benchmark_dir+os_file_sep()+L"hash_pipeline.db";
+	if(!Server->openDatabase(Server->ConvertToUTF8(dbfn), URBACKUPDB_SERVER))
+	{
+		Server->Log(L"Error opening benchmark database \""+dbfn+L"\"", LL_ERROR);
+		return false;
+	}
+	Server->attachToDatabase(Server->ConvertToUTF8(benchmark_dir+os_file_sep()+L"hash_pipeline_settings.db"), "settings_db", URBACKUPDB_SERVER);
+
+	IDatabase *db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER);
+	if(db==NULL
+		|| !db->Write("CREATE TABLE settings_db.settings (key TEXT, value TEXT, clientid INTEGER)")
+		|| !db->Write("CREATE TABLE files ( backupid INTEGER, fullpath TEXT, hashpath TEXT, shahash BLOB, filesize INTEGER, created DATE DEFAULT CURRENT_TIMESTAMP, rsize INTEGER, did_count INTEGER, clientid INTEGER, incremental INTEGER)")
+		|| !db->Write("CREATE INDEX files_idx ON files (shahash, filesize, clientid)")
+		|| !db->Write("CREATE TABLE files_new ( backupid INTEGER, fullpath TEXT, hashpath TEXT, shahash BLOB, filesize INTEGER, created DATE DEFAULT CURRENT_TIMESTAMP, rsize INTEGER, clientid INTEGER, incremental INTEGER)")
+		|| !db->Write("CREATE TABLE files_del ( backupid INTEGER, fullpath TEXT, hashpath TEXT, shahash BLOB, filesize INTEGER, created DATE, rsize INTEGER, clientid INTEGER, incremental INTEGER, is_del INTEGER)") )
+	{
+		Server->Log("Error creating hash pipeline benchmark tables", LL_ERROR);
+		return false;
+	}
+
+	if(filescache_type!="none")
+	{
+		if(filescache_type!="hashindex")
+		{
+			Server->Log("Hash pipeline benchmark only supports the \"none\" and \"hashindex\" file entry caches", LL_ERROR);
+			return false;
+		}
+
+		if(!open_hashindex_files_cache(Server->ConvertToUTF8(benchmark_dir+os_file_sep()+L"hash_pipeline_cache")))
+		{
+			return false;
+		}
+	}
+
+	IQuery *q=db->Prepare("INSERT INTO settings_db.settings (key, value, clientid) VALUES ('filescache_type', ?, 0)", false);
+	q->Bind(filescache_type);
+	bool ret=q->Write();
+	db->destroyQuery(q);
+
+	Server->destroyDatabases(Server->getThreadID());
+	return ret;
+}
+
+//Backs up the client files into backupdir the way a file backup does after
+//the download. Every file is first put into a temporary file, then all of
+//them are queued to the prepare hash thread, which hashes them and hands
+//them on to the hash thread. That one links them to identical files known
+//from the database (or the file entry cache) or moves them into place and
+//writes their chunk hashes
+bool hash_pipeline(const std::wstring& clientdir, const std::wstring& backupdir, const std::wstring& tmpdir,
+	const std::vector<SBenchmarkFile>& files, int backupid, SBenchmarkStage& stage)
+{
+	os_create_dir_recursive(os_file_prefix(tmpdir));
+
+	std::vector<std::wstring> tmpfns;
+	for(size_t i=0;i<files.size();++i)
+	{
+		std::wstring tmpfn=tmpdir+os_file_sep()+convert(i);
+		if(!copy_benchmark_file(clientdir+os_file_sep()+files[i].relpath, tmpfn))
+		{
+			Server->Log(L"Error copying \""+files[i].relpath+L"\" to temporary file", LL_ERROR);
+			return false;
+		}
+		tmpfns.push_back(tmpfn);
+
+		if(i%100==0)
+		{
+			os_create_dir_recursive(os_file_prefix(ExtractFilePath(backupdir+os_file_sep()+files[i].relpath)));
+			os_create_dir_recursive(os_file_prefix(ExtractFilePath(backupdir+os_file_sep()+L".hashes"+os_file_sep()+files[i].relpath)));
+		}
+	}
+
+	//Only the hash pipeline is measured, not the preparation above
+	stage.starttime=Server->getTimeMS();
+
+	IPipe *hashpipe=Server->createMemoryPipe();
+	IPipe *hashpipe_prepare=Server->createMemoryPipe();
+	BackupServerHash *bsh=new BackupServerHash(hashpipe, hash_pipeline_clientid, false, false, false);
+	BackupServerPrepareHash *bsh_prepare=new BackupServerPrepareHash(hashpipe_prepare, hashpipe, hash_pipeline_clientid);
+	THREADPOOL_TICKET bsh_ticket=Server->getThreadPool()->execute(bsh);
+	THREADPOOL_TICKET bsh_prepare_ticket=Server->getThreadPool()->execute(bsh_prepare);
+
+	for(size_t i=0;i<files.size();++i)
+	{
+		const SBenchmarkFile& file=files[i];
+		BackupServerPrepareHash::queueFile(hashpipe_prepare, tmpfns[i], backupid, false, backupdir+os_file_sep()+file.relpath,
+			backupdir+os_file_sep()+L".hashes"+os_file_sep()+file.relpath, std::wstring(), std::string(), file.size);
+		++stage.files;
+		stage.bytes+=file.size;
+	}
+
+	hashpipe->Write("flush");
+	hashpipe_prepare->Write("flush");
+	while(pipeline_busy(bsh, bsh_prepare))
+	{
+		Server->wait(10);
+	}
+
+	bool has_error=bsh->hasError() || bsh_prepare->hasError();
+
+	//Both threads delete themselves (and their input pipes) on exit
+	hashpipe_prepare->Write("exit");
+	Server->getThreadPool()->waitFor(bsh_ticket);
+	Server->getThreadPool()->waitFor(bsh_prepare_ticket);
+
+	if(has_error)
+	{
+		Server->Log("Hash pipeline reported an error", LL_ERROR);
+	}
+
+	return !has_error;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "benchmark_common.h"
+
+bool hash_pipeline_setup(const std::wstring& benchmark_dir, const std::string& filescache_type);
+
+bool hash_pipeline(const std::wstring& clientdir, const std::wstring& backupdir, const std::wstring& tmpdir,
+	const std::vector<SBenchmarkFile>& files, int backupid, SBenchmarkStage& stage);
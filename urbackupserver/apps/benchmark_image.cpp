@@ -0,0 +1,222 @@
+#include "benchmark_image.h"
+#include "../server_writer.h"
+#include "../../urbackupcommon/os_functions.h"
+#include "../../fsimageplugin/IFSImageFactory.h"
+#include "../../fsimageplugin/IVHDFile.h"
+#include "../../Interface/File.h"
+#include "../../Interface/Mutex.h"
+#include "../../Interface/ThreadPool.h"
+#include "../../Interface/Thread.h"
+
+extern IFSImageFactory *image_fak;
+
+namespace
+{
+	const unsigned int benchmark_image_blocksize=4096;
+
+	//Random 4K reads on one shared file. Without positional I/O every
+	//thread has to serialize Seek+Read pairs on the file
+	class RandomReadWorker : public IThread
+	{
+	public:
+		RandomReadWorker(IFile* file, IMutex* mutex, size_t nreads, unsigned int seed)
+			: file(file), mutex(mutex), nreads(nreads), rnd(seed), failed(false), bytes(0)
+		{
+		}
+
+		void operator()(void)
+		{
+			std::vector<char> buf(4096);
+			int64 nblocks=file->Size()/buf.size();
+			for(size_t i=0;i<nreads && nblocks>0;++i)
+			{
+				int64 pos=(static_cast<int64>(rnd.next())%nblocks)*buf.size();
+				_u32 read;
+				if(mutex!=NULL)
+				{
+					IScopedLock lock(mutex);
+					file->Seek(pos);
+					read=file->Read(&buf[0], static_cast<_u32>(buf.size()));
+				}
+				else
+				{
+					read=file->ReadAt(pos, &buf[0], static_cast<_u32>(buf.size()));
+				}
+
+				if(read!=buf.size())
+				{
+					failed=true;
+					return;
+				}
+				bytes+=read;
+			}
+		}
+
+		bool hasFailed(void) { return failed; }
+		int64 getBytes(void) { return bytes; }
+
+	private:
+		IFile* file;
+		IMutex* mutex;
+		size_t nreads;
+		BenchmarkRandom rnd;
+		bool failed;
+		int64 bytes;
+	};
+}
+
+bool image_backup(const std::wstring& imagefn, const std::wstring& parentfn, int64 image_size, unsigned int seed,
+	unsigned int change_mod, SBenchmarkStage& stage)
+{
+	IVHDFile *vhd;
+	if(parentfn.empty())
+	{
+		vhd=image_fak->createVHDFile(os_file_prefix(imagefn), false, image_size, 2*1024*1024, true);
+	}
+	else
+	{
+		vhd=image_fak->createVHDFile(os_file_prefix(imagefn), os_file_prefix(parentfn), false, true);
+	}
+
+	if(vhd==NULL || !vhd->isOpen())
+	{
+		Server->Log(L"Error creating VHD file \""+imagefn+L"\"", LL_ERROR);
+		return false;
+	}
+
+	ServerVHDWriter *writer=new ServerVHDWriter(vhd, benchmark_image_blocksize, 5000, 0);
+	THREADPOOL_TICKET writer_ticket=Server->getThreadPool()->execute(writer);
+
+	BenchmarkRandom rnd(seed);
+	int64 nblocks=image_size/benchmark_image_blocksize;
+	for(int64 block=0;block<nblocks;++block)
+	{
+		unsigned int r=rnd.next();
+		if(r%3==0 || r%change_mod!=0)
+		{
+			//unused or unchanged block
+			continue;
+		}
+
+		char *buf=writer->getBuffer();
+		rnd.fill(buf, benchmark_image_blocksize);
+		writer->writeBuffer(block*benchmark_image_blocksize, buf, benchmark_image_blocksize);
+		++stage.files;
+		stage.bytes+=benchmark_image_blocksize;
+	}
+
+	writer->doExit();
+	Server->getThreadPool()->waitFor(writer_ticket);
+	bool has_error=writer->hasError();
+	delete writer;
+
+	return !has_error;
+}
+
+bool image_write(const std::wstring& imagefn, int64 image_size, SBenchmarkStage& stage)
+{
+	IVHDFile *vhd=image_fak->createVHDFile(os_file_prefix(imagefn), false, image_size, 2*1024*1024, true);
+	if(vhd==NULL || !vhd->isOpen())
+	{
+		Server->Log(L"Error creating VHD file \""+imagefn+L"\"", LL_ERROR);
+		return false;
+	}
+
+	ServerVHDWriter *writer=new ServerVHDWriter(vhd, benchmark_image_blocksize, 5000, 0);
+	THREADPOOL_TICKET writer_ticket=Server->getThreadPool()->execute(writer);
+
+	//Every block is written once, in order. Contents only need to be
+	//distinct, so the generator does not dominate the measurement
+	int64 nblocks=image_size/benchmark_image_blocksize;
+	for(int64 block=0;block<nblocks && !writer->hasError();++block)
+	{
+		char *buf=writer->getBuffer();
+		memset(buf, static_cast<int>(block%251)+1, benchmark_image_blocksize);
+		memcpy(buf, &block, sizeof(block));
+		writer->writeBuffer(block*benchmark_image_blocksize, buf, benchmark_image_blocksize);
+		stage.bytes+=benchmark_image_blocksize;
+	}
+	++stage.files;
+
+	writer->doExit();
+	Server->getThreadPool()->waitFor(writer_ticket);
+	bool has_error=writer->hasError();
+	delete writer;
+
+	return !has_error;
+}
+
+bool image_read(const std::wstring& imagefn, SBenchmarkStage& stage)
+{
+	IVHDFile *vhd=image_fak->createVHDFile(os_file_prefix(imagefn), true, 0);
+	if(vhd==NULL || !vhd->isOpen())
+	{
+		Server->Log(L"Error opening VHD file \""+imagefn+L"\"", LL_ERROR);
+		if(vhd!=NULL)
+		{
+			image_fak->destroyVHDFile(vhd);
+		}
+		return false;
+	}
+
+	std::vector<char> buf(1024*1024);
+	uint64 size=vhd->getSize();
+	bool ret=true;
+	vhd->Seek(0);
+	for(uint64 pos=0;pos<size;)
+	{
+		size_t read;
+		if(!vhd->Read(&buf[0], buf.size(), read) || read==0)
+		{
+			Server->Log(L"Error reading VHD file \""+imagefn+L"\"", LL_ERROR);
+			ret=false;
+			break;
+		}
+		pos+=read;
+		stage.bytes+=read;
+	}
+	++stage.files;
+
+	image_fak->destroyVHDFile(vhd);
+	return ret;
+}
+
+bool random_io(const std::wstring& fn, size_t nthreads, size_t nreads, bool positional, unsigned int seed, SBenchmarkStage& stage)
+{
+	IFile *f=Server->openFile(os_file_prefix(fn), MODE_READ);
+	if(f==NULL)
+	{
+		Server->Log(L"Error opening \""+fn+L"\"", LL_ERROR);
+		return false;
+	}
+
+	IMutex *mutex=positional?NULL:Server->createMutex();
+	std::vector<RandomReadWorker*> workers;
+	std::vector<THREADPOOL_TICKET> tickets;
+	for(size_t i=0;i<nthreads;++i)
+	{
+		workers.push_back(new RandomReadWorker(f, mutex, nreads/nthreads, seed+static_cast<unsigned int>(i)));
+		tickets.push_back(Server->getThreadPool()->execute(workers[i]));
+	}
+	Server->getThreadPool()->waitFor(tickets);
+
+	bool ret=true;
+	for(size_t i=0;i<workers.size();++i)
+	{
+		if(workers[i]->hasFailed())
+		{
+			Server->Log(L"Error reading from \""+fn+L"\"", LL_ERROR);
+			ret=false;
+		}
+		stage.bytes+=workers[i]->getBytes();
+		delete workers[i];
+	}
+	++stage.files;
+
+	if(mutex!=NULL)
+	{
+		Server->destroy(mutex);
+	}
+	Server->destroy(f);
+	return ret;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "benchmark_common.h"
+
+bool image_backup(const std::wstring& imagefn, const std::wstring& parentfn, int64 image_size, unsigned int seed,
+	unsigned int change_mod, SBenchmarkStage& stage);
+bool image_write(const std::wstring& imagefn, int64 image_size, SBenchmarkStage& stage);
+bool image_read(const std::wstring& imagefn, SBenchmarkStage& stage);
+bool random_io(const std::wstring& fn, size_t nthreads, size_t nreads, bool positional, unsigned int seed, SBenchmarkStage& stage);
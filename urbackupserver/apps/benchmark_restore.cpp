@@ -0,0 +1,292 @@
+#include "benchmark_restore.h"
+#include "../server_image_restore.h"
+#include "../../urbackupcommon/image_restore.h"
+#include "../../urbackupcommon/os_functions.h"
+#include "../../urbackupcommon/sha2/sha2.h"
+#include "../../fsimageplugin/IFSImageFactory.h"
+#include "../../fsimageplugin/IVHDFile.h"
+#include "../../Interface/File.h"
+#include "../../Interface/Pipe.h"
+#include "../../Interface/ThreadPool.h"
+#include "../../Interface/Thread.h"
+#include "../../stringtools.h"
+#include <memory>
+
+extern IFSImageFactory *image_fak;
+
+namespace
+{
+	//Images from image_backup are version 1, i.e. the volume starts after 512KB
+	const int benchmark_restore_img_version=1;
+	const int64 benchmark_restore_skip=512*1024;
+	const unsigned int benchmark_restore_hash_blocksize=512*1024;
+	const unsigned int benchmark_restore_blocksize=4096;
+
+	//Server side of the restore, i.e. the DOWNLOAD IMAGE stream
+	class RestoreStreamer : public IThread
+	{
+	public:
+		RestoreStreamer(IPipe* output, const std::wstring& imagefn, IFile* client_hashes)
+			: output(output), imagefn(imagefn), client_hashes(client_hashes), ok(false)
+		{
+		}
+
+		void operator()(void)
+		{
+			int64 lasttime=Server->getTimeMS();
+			ok=send_restore_image(output, imagefn, benchmark_restore_img_version, 0, client_hashes, lasttime, stats);
+		}
+
+		bool isOk(void) { return ok; }
+		const SImageRestoreStats& getStats(void) { return stats; }
+
+	private:
+		IPipe* output;
+		std::wstring imagefn;
+		IFile* client_hashes;
+		bool ok;
+		SImageRestoreStats stats;
+	};
+
+	//Client side of the restore: Parses position+block frames and queues
+	//the blocks to the restore writer, like downloadImage in the client.
+	//Without writer every block is written synchronously to target
+	bool receive_restore_image(IPipe* input, RestoreImageWriter* writer, IFile* target)
+	{
+		std::vector<char> buf(512*1024);
+		size_t buffered=0;
+		_i64 imgsize=-1;
+		while(true)
+		{
+			size_t r=input->Read(&buf[buffered], buf.size()-buffered, 60000);
+			if(r==0)
+			{
+				Server->Log("Timeout reading restore stream", LL_ERROR);
+				return false;
+			}
+			buffered+=r;
+
+			size_t off=0;
+			if(imgsize==-1)
+			{
+				if(buffered<sizeof(_i64))
+				{
+					continue;
+				}
+				memcpy(&imgsize, &buf[0], sizeof(_i64));
+				imgsize=little_endian(imgsize);
+				if(imgsize<0)
+				{
+					Server->Log("Error reading restore image size", LL_ERROR);
+					return false;
+				}
+				off+=sizeof(_i64);
+			}
+
+			while(buffered-off>=sizeof(_i64))
+			{
+				_i64 pos;
+				memcpy(&pos, &buf[off], sizeof(_i64));
+				pos=little_endian(pos);
+				if(pos>=imgsize)
+				{
+					return true;
+				}
+
+				if(buffered-off<sizeof(_i64)+benchmark_restore_blocksize)
+				{
+					break;
+				}
+
+				_u32 tw=static_cast<_u32>((std::min)(static_cast<_i64>(benchmark_restore_blocksize), imgsize-pos));
+				if(writer!=NULL)
+				{
+					if(!writer->write(pos, &buf[off+sizeof(_i64)], tw))
+					{
+						return false;
+					}
+				}
+				else if(!target->Seek(pos)
+					|| target->Write(&buf[off+sizeof(_i64)], tw)!=tw)
+				{
+					Server->Log("Writing to restore target failed", LL_ERROR);
+					return false;
+				}
+				off+=sizeof(_i64)+benchmark_restore_blocksize;
+			}
+
+			memmove(&buf[0], &buf[off], buffered-off);
+			buffered-=off;
+		}
+	}
+}
+
+bool image_restore_prepare(const std::wstring& imagefn, const std::wstring& targetfn)
+{
+	IVHDFile *vhd=image_fak->createVHDFile(imagefn, true, 0);
+	if(vhd==NULL || !vhd->isOpen())
+	{
+		Server->Log(L"Error opening VHD file \""+imagefn+L"\"", LL_ERROR);
+		if(vhd!=NULL)
+		{
+			image_fak->destroyVHDFile(vhd);
+		}
+		return false;
+	}
+
+	std::auto_ptr<IFile> hashfile(Server->openFile(os_file_prefix(imagefn+L".hash"), MODE_WRITE));
+	if(hashfile.get()==NULL)
+	{
+		Server->Log(L"Error creating hash file for \""+imagefn+L"\"", LL_ERROR);
+		image_fak->destroyVHDFile(vhd);
+		return false;
+	}
+
+	//Same layout as the hashes stored with image backups:
+	//SHA-256 per 512KB block of the volume
+	int64 volume_size=static_cast<int64>(vhd->getSize())-benchmark_restore_skip;
+	std::vector<char> buf(benchmark_restore_hash_blocksize);
+	bool ret=true;
+	vhd->Seek(benchmark_restore_skip);
+	for(int64 pos=0;pos<volume_size;)
+	{
+		size_t toread=static_cast<size_t>((std::min)(static_cast<int64>(buf.size()), volume_size-pos));
+		size_t read;
+		if(!vhd->Read(&buf[0], toread, read) || read!=toread)
+		{
+			Server->Log(L"Error reading VHD file \""+imagefn+L"\"", LL_ERROR);
+			ret=false;
+			break;
+		}
+
+		unsigned char dig[SHA256_DIGEST_SIZE];
+		sha256(reinterpret_cast<unsigned char*>(&buf[0]), static_cast<unsigned int>(read), dig);
+		hashfile->Write(reinterpret_cast<char*>(dig), SHA256_DIGEST_SIZE);
+		pos+=read;
+	}
+
+	image_fak->destroyVHDFile(vhd);
+
+	if(!ret)
+	{
+		return false;
+	}
+
+	//The restore target is a volume of the image's size, not a file growing
+	//with the restored blocks
+	std::auto_ptr<IFile> target(Server->openFile(os_file_prefix(targetfn), MODE_WRITE));
+	if(target.get()==NULL)
+	{
+		Server->Log(L"Error creating restore target \""+targetfn+L"\"", LL_ERROR);
+		return false;
+	}
+
+	std::vector<char> zero_block(benchmark_restore_blocksize);
+	if(target->WriteAt(volume_size-benchmark_restore_blocksize, &zero_block[0], benchmark_restore_blocksize)!=benchmark_restore_blocksize)
+	{
+		Server->Log(L"Error writing to restore target \""+targetfn+L"\"", LL_ERROR);
+		return false;
+	}
+
+	return true;
+}
+
+bool image_restore(const std::wstring& imagefn, const std::wstring& targetfn, bool delta, bool pipelined, SBenchmarkStage& stage)
+{
+	std::auto_ptr<IFile> target(Server->openFile(os_file_prefix(targetfn), MODE_RW));
+	if(target.get()==NULL)
+	{
+		Server->Log(L"Error opening restore target \""+targetfn+L"\"", LL_ERROR);
+		return false;
+	}
+
+	//Hashing the target is part of a delta restore, so it is timed
+	std::auto_ptr<IFile> client_hashes;
+	if(delta)
+	{
+		client_hashes.reset(hashRestoreTarget(target.get()));
+		if(client_hashes.get()==NULL)
+		{
+			return false;
+		}
+	}
+
+	IPipe *pipe=Server->createMemoryPipe();
+	RestoreStreamer streamer(pipe, imagefn, client_hashes.get());
+	THREADPOOL_TICKET streamer_ticket=Server->getThreadPool()->execute(&streamer);
+
+	RestoreImageWriter *writer=NULL;
+	THREADPOOL_TICKET writer_ticket=ILLEGAL_THREADPOOL_TICKET;
+	if(pipelined)
+	{
+		writer=new RestoreImageWriter(target.get());
+		writer_ticket=Server->getThreadPool()->execute(writer);
+	}
+
+	bool ret=receive_restore_image(pipe, writer, target.get());
+
+	if(writer!=NULL)
+	{
+		writer->doExit();
+		Server->getThreadPool()->waitFor(writer_ticket);
+		if(writer->hasError())
+		{
+			ret=false;
+		}
+		delete writer;
+	}
+
+	Server->getThreadPool()->waitFor(streamer_ticket);
+	if(!streamer.isOk())
+	{
+		ret=false;
+	}
+	Server->destroy(pipe);
+
+	if(client_hashes.get()!=NULL)
+	{
+		std::wstring hashfn=client_hashes->getFilenameW();
+		client_hashes.reset();
+		Server->deleteFile(hashfn);
+	}
+
+	stage.bytes+=streamer.getStats().transferred;
+	++stage.files;
+	ServerMetrics::setGauge("urbackup_benchmark_restore_skipped_bytes{stage=\""+stage.name+"\"}", streamer.getStats().skipped);
+
+	return ret;
+}
+
+bool image_restore_modify(const std::wstring& targetfn, unsigned int seed, unsigned int change_mod)
+{
+	std::auto_ptr<IFile> target(Server->openFile(os_file_prefix(targetfn), MODE_RW));
+	if(target.get()==NULL)
+	{
+		Server->Log(L"Error opening restore target \""+targetfn+L"\"", LL_ERROR);
+		return false;
+	}
+
+	//Overwrite one 4K block in every change_mod-th 512KB block on average,
+	//which makes the delta restore resend those 512KB blocks
+	BenchmarkRandom rnd(seed);
+	std::vector<char> buf(benchmark_restore_blocksize);
+	int64 nblocks=target->Size()/benchmark_restore_hash_blocksize;
+	for(int64 block=0;block<nblocks;++block)
+	{
+		if(rnd.next()%change_mod!=0)
+		{
+			continue;
+		}
+
+		int64 pos=block*benchmark_restore_hash_blocksize
+			+(rnd.next()%(benchmark_restore_hash_blocksize/benchmark_restore_blocksize))*benchmark_restore_blocksize;
+		rnd.fill(&buf[0], buf.size());
+		if(target->WriteAt(pos, &buf[0], benchmark_restore_blocksize)!=benchmark_restore_blocksize)
+		{
+			Server->Log(L"Error writing to restore target \""+targetfn+L"\"", LL_ERROR);
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "benchmark_common.h"
+
+bool image_restore_prepare(const std::wstring& imagefn, const std::wstring& targetfn);
+bool image_restore(const std::wstring& imagefn, const std::wstring& targetfn, bool delta, bool pipelined, SBenchmarkStage& stage);
+bool image_restore_modify(const std::wstring& targetfn, unsigned int seed, unsigned int change_mod);
@@ -0,0 +1,504 @@
+#include "benchmark_transport.h"
+#include "../../urbackupcommon/CompressedPipe.h"
+#include "../../urbackupcommon/InternetServicePipe.h"
+#include "../../urbackupcommon/sha2/sha2.h"
+#include "../../Interface/Pipe.h"
+#include "../../Interface/PipeThrottler.h"
+#include "../../Interface/ThreadPool.h"
+#include "../../Interface/Thread.h"
+#include "../../stringtools.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BENCHMARK_HAS_RDTSC
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCHMARK_HAS_RDTSC
+#endif
+
+namespace
+{
+	//Allocation pattern of the block buffers: a few buffers of the sizes
+	//used by the file server, chunk sender and image writer/cache are
+	//held at once, touched and given back
+	class BufferChurnWorker : public IThread
+	{
+	public:
+		BufferChurnWorker(size_t iterations, bool pooled)
+			: iterations(iterations), pooled(pooled), bytes(0)
+		{
+		}
+
+		void operator()(void)
+		{
+			const size_t sizes[]={8192, 32768, 524301, 2*1024*1024};
+			const size_t nsizes=sizeof(sizes)/sizeof(sizes[0]);
+			const size_t nheld=allocations_per_iteration;
+			char* held[nheld];
+			for(size_t i=0;i<iterations;++i)
+			{
+				size_t bsize=sizes[i%nsizes];
+				for(size_t j=0;j<nheld;++j)
+				{
+					held[j]=pooled?Server->allocateBuffer(bsize):new char[bsize];
+					held[j][0]=static_cast<char>(j);
+					held[j][bsize-1]=static_cast<char>(i);
+				}
+				for(size_t j=0;j<nheld;++j)
+				{
+					if(pooled)
+					{
+						Server->releaseBuffer(held[j], bsize);
+					}
+					else
+					{
+						delete[] held[j];
+					}
+				}
+				bytes+=nheld*bsize;
+			}
+		}
+
+		int64 getBytes(void)
+		{
+			return bytes;
+		}
+
+		static const size_t allocations_per_iteration=8;
+
+	private:
+		size_t iterations;
+		bool pooled;
+		int64 bytes;
+	};
+
+	class PipeProducer : public IThread
+	{
+	public:
+		PipeProducer(IPipe* pipe, size_t messages, size_t msg_size, bool owned)
+			: pipe(pipe), messages(messages), msg_size(msg_size), owned(owned)
+		{
+		}
+
+		void operator()(void)
+		{
+			std::vector<char> buf(msg_size, 'b');
+			std::string msg;
+			for(size_t i=0;i<messages;++i)
+			{
+				if(owned)
+				{
+					msg.assign(&buf[0], buf.size());
+					pipe->WriteOwned(msg);
+				}
+				else
+				{
+					pipe->Write(&buf[0], buf.size());
+				}
+			}
+		}
+
+	private:
+		IPipe* pipe;
+		size_t messages;
+		size_t msg_size;
+		bool owned;
+	};
+
+	class CompressedPipeProducer : public IThread
+	{
+	public:
+		CompressedPipeProducer(CompressedPipe* pipe, IPipe* transport, int64 size, unsigned int seed)
+			: pipe(pipe), transport(transport), size(size), seed(seed), ok(true)
+		{
+		}
+
+		void operator()(void)
+		{
+			//Alternates text like, compressible chunks with random ones
+			BenchmarkRandom rnd(seed);
+			std::vector<char> random_buf(1024*1024);
+			rnd.fill(&random_buf[0], random_buf.size());
+			std::string text_buf;
+			while(text_buf.size()<random_buf.size())
+			{
+				text_buf+="file_"+nconvert(rnd.next()%1000)+".txt modified 2014-01-01 size "+nconvert(rnd.next()%100000)+"\n";
+			}
+
+			int64 written=0;
+			for(size_t i=0;written<size && ok;++i)
+			{
+				while(transport->getNumElements()>64)
+				{
+					Server->wait(1);
+				}
+
+				size_t bsize=static_cast<size_t>((std::min)(static_cast<int64>(random_buf.size()), size-written));
+				if(i%2==0)
+				{
+					ok=pipe->Write(text_buf.data(), bsize);
+				}
+				else
+				{
+					ok=pipe->Write(&random_buf[0], bsize);
+				}
+				written+=bsize;
+			}
+
+			if(ok)
+			{
+				ok=pipe->flush();
+			}
+		}
+
+		bool isOk(void)
+		{
+			return ok;
+		}
+
+	private:
+		CompressedPipe* pipe;
+		IPipe* transport;
+		int64 size;
+		unsigned int seed;
+		bool ok;
+	};
+
+	class ThrottledTransfer : public IThread
+	{
+	public:
+		ThrottledTransfer(IPipeThrottler* throttler, int64 endtime)
+			: throttler(throttler), endtime(endtime), bytes(0)
+		{
+		}
+
+		void operator()(void)
+		{
+			const size_t bsize=32768;
+			while(Server->getTimeMS()<endtime)
+			{
+				throttler->addBytes(bsize, true);
+				bytes+=bsize;
+			}
+		}
+
+		int64 getBytes(void)
+		{
+			return bytes;
+		}
+
+	private:
+		IPipeThrottler* throttler;
+		int64 endtime;
+		int64 bytes;
+	};
+
+	double jain_index(const std::vector<double>& x)
+	{
+		double sum=0;
+		double sum_sq=0;
+		for(size_t i=0;i<x.size();++i)
+		{
+			sum+=x[i];
+			sum_sq+=x[i]*x[i];
+		}
+		if(sum_sq==0)
+		{
+			return 0;
+		}
+		return sum*sum/(x.size()*sum_sq);
+	}
+}
+
+bool buffer_churn(size_t nthreads, size_t iterations, bool pooled, SBenchmarkStage& stage)
+{
+	std::vector<BufferChurnWorker*> workers;
+	std::vector<THREADPOOL_TICKET> tickets;
+	for(size_t i=0;i<nthreads;++i)
+	{
+		workers.push_back(new BufferChurnWorker(iterations, pooled));
+	}
+	stage.starttime=Server->getTimeMS();
+	for(size_t i=0;i<nthreads;++i)
+	{
+		tickets.push_back(Server->getThreadPool()->execute(workers[i]));
+	}
+	Server->getThreadPool()->waitFor(tickets);
+
+	for(size_t i=0;i<nthreads;++i)
+	{
+		stage.bytes+=workers[i]->getBytes();
+		delete workers[i];
+	}
+
+	stage.files=static_cast<int64>(nthreads*iterations*BufferChurnWorker::allocations_per_iteration);
+
+	if(pooled)
+	{
+		SBufferPoolStats pool_stats=Server->getBufferPoolStats();
+		Server->Log("Buffer pool: "+PrettyPrintBytes(pool_stats.reserved_bytes)+" reserved, "+nconvert(pool_stats.os_allocations)
+			+" OS allocations, "+nconvert(pool_stats.thread_cache_hits)+" thread cache hits, "+nconvert(pool_stats.shared_hits)+" shared hits", LL_INFO);
+	}
+	return true;
+}
+
+bool memory_pipe_throughput(size_t messages, size_t msg_size, bool owned, SBenchmarkStage& stage)
+{
+	IPipe* pipe=Server->createMemoryPipe();
+	PipeProducer producer(pipe, messages, msg_size, owned);
+	THREADPOOL_TICKET ticket=Server->getThreadPool()->execute(&producer);
+
+	std::vector<char> buf(msg_size);
+	std::vector<std::string> msgs;
+	size_t received=0;
+	while(received<messages)
+	{
+		if(owned)
+		{
+			msgs.clear();
+			size_t n=pipe->ReadAll(msgs);
+			for(size_t i=0;i<n;++i)
+			{
+				stage.bytes+=msgs[i].size();
+			}
+			received+=n;
+		}
+		else
+		{
+			stage.bytes+=pipe->Read(&buf[0], buf.size());
+			++received;
+		}
+	}
+	stage.files=static_cast<int64>(received);
+
+	Server->getThreadPool()->waitFor(ticket);
+	Server->destroy(pipe);
+	return stage.bytes==static_cast<int64>(messages*msg_size);
+}
+
+bool compressed_pipe_throughput(int64 size, unsigned int seed, bool stream_frames, SBenchmarkStage& stage)
+{
+	IPipe* transport=Server->createMemoryPipe();
+	CompressedPipe* sender=new CompressedPipe(transport, 6, stream_frames);
+	CompressedPipe* receiver=new CompressedPipe(transport, 6, stream_frames);
+
+	CompressedPipeProducer producer(sender, transport, size, seed);
+	THREADPOOL_TICKET ticket=Server->getThreadPool()->execute(&producer);
+
+	std::vector<char> buf(32768);
+	while(stage.bytes<size)
+	{
+		size_t r=receiver->Read(&buf[0], buf.size(), 10000);
+		if(r==0)
+		{
+			Server->Log("Timeout or error reading from compressed pipe", LL_ERROR);
+			break;
+		}
+		stage.bytes+=r;
+	}
+	stage.files=1;
+
+	Server->getThreadPool()->waitFor(ticket);
+	bool ret=producer.isOk() && stage.bytes==size;
+
+	delete receiver;
+	delete sender;
+	Server->destroy(transport);
+	return ret;
+}
+
+bool encrypted_pipe_throughput(int64 size, unsigned int seed, bool aead, SBenchmarkStage& stage)
+{
+	//Single thread encrypts and decrypts, so this is throughput per core
+	std::string key;
+	key.resize(32);
+	Server->secureRandomFill(&key[0], key.size());
+	IPipe* transport=Server->createMemoryPipe();
+	InternetServicePipe sender(transport, key);
+	InternetServicePipe receiver(transport, key);
+	if(aead)
+	{
+		sender.enableAEAD(true);
+		receiver.enableAEAD(false);
+	}
+
+	BenchmarkRandom rnd(seed);
+	std::vector<char> buf(1024*1024);
+	rnd.fill(&buf[0], buf.size());
+	std::vector<char> rbuf(buf.size());
+
+	bool ret=true;
+	while(stage.bytes<size && ret)
+	{
+		size_t bsize=static_cast<size_t>((std::min)(static_cast<int64>(buf.size()), size-stage.bytes));
+		if(!sender.Write(&buf[0], bsize))
+		{
+			ret=false;
+			break;
+		}
+
+		size_t received=0;
+		while(received<bsize)
+		{
+			size_t r=receiver.Read(&rbuf[received], rbuf.size()-received, 0);
+			if(r==0)
+			{
+				Server->Log("Error reading from encrypted pipe", LL_ERROR);
+				ret=false;
+				break;
+			}
+			received+=r;
+		}
+
+		if(ret && memcmp(&buf[0], &rbuf[0], bsize)!=0)
+		{
+			Server->Log("Encrypted pipe returned wrong data", LL_ERROR);
+			ret=false;
+		}
+		stage.bytes+=bsize;
+	}
+	stage.files=1;
+
+	Server->destroy(transport);
+	return ret;
+}
+
+bool throttle_fairness(size_t ntransfers, size_t global_bps, int64 duration_ms, SBenchmarkStage& stage)
+{
+	//Same hierarchy as the server uses: global limit -> internet/local -> per client.
+	//The internet class is limited to a third of the global limit, so the local
+	//class has to borrow the unused bandwidth. Every fifth client has twice the weight.
+	IPipeThrottler* global_throttler=Server->createPipeThrottler(global_bps);
+	IPipeThrottler* internet_throttler=Server->createPipeThrottler(global_bps/3, global_throttler, 1);
+	IPipeThrottler* local_throttler=Server->createPipeThrottler(0, global_throttler, 1);
+
+	std::vector<IPipeThrottler*> client_throttlers;
+	std::vector<unsigned int> weights;
+	std::vector<ThrottledTransfer*> transfers;
+	std::vector<THREADPOOL_TICKET> tickets;
+	int64 endtime=Server->getTimeMS()+duration_ms;
+	for(size_t i=0;i<ntransfers;++i)
+	{
+		weights.push_back(i%5==0?2:1);
+		client_throttlers.push_back(Server->createPipeThrottler(0, i%2==0?internet_throttler:local_throttler, weights[i]));
+		transfers.push_back(new ThrottledTransfer(client_throttlers[i], endtime));
+	}
+	for(size_t i=0;i<ntransfers;++i)
+	{
+		tickets.push_back(Server->getThreadPool()->execute(transfers[i]));
+	}
+	Server->getThreadPool()->waitFor(tickets);
+
+	std::vector<double> internet_norm;
+	std::vector<double> local_norm;
+	for(size_t i=0;i<ntransfers;++i)
+	{
+		stage.bytes+=transfers[i]->getBytes();
+		double norm=static_cast<double>(transfers[i]->getBytes())/weights[i];
+		if(i%2==0)
+		{
+			internet_norm.push_back(norm);
+		}
+		else
+		{
+			local_norm.push_back(norm);
+		}
+		delete transfers[i];
+		Server->destroy(client_throttlers[i]);
+	}
+	stage.files=static_cast<int64>(ntransfers);
+
+	Server->destroy(internet_throttler);
+	Server->destroy(local_throttler);
+	Server->destroy(global_throttler);
+
+	double utilization=static_cast<double>(stage.bytes)/(static_cast<double>(global_bps)*duration_ms/1000.0);
+	double internet_fairness=jain_index(internet_norm);
+	double local_fairness=jain_index(local_norm);
+
+	Server->Log("Throttle utilization: "+nconvert(utilization*100)+"% of global limit. Weighted fairness (Jain's index): internet "
+		+nconvert(internet_fairness)+", local "+nconvert(local_fairness), LL_INFO);
+	ServerMetrics::addGauge("urbackup_benchmark_throttle_utilization_permille", static_cast<int64>(utilization*1000));
+	ServerMetrics::addGauge("urbackup_benchmark_throttle_fairness_permille{class=\"internet\"}", static_cast<int64>(internet_fairness*1000));
+	ServerMetrics::addGauge("urbackup_benchmark_throttle_fairness_permille{class=\"local\"}", static_cast<int64>(local_fairness*1000));
+
+	return utilization>0;
+}
+
+std::string sha2_stage_name(ESha2Benchmark mode)
+{
+	switch(mode)
+	{
+	case ESha2Benchmark_Sha256: return std::string("sha256_")+sha256_impl_name();
+	case ESha2Benchmark_Sha512: return std::string("sha512_")+sha512_impl_name();
+	case ESha2Benchmark_Sha256Mb: return std::string("sha256_mb_")+sha256_mb_impl_name();
+	case ESha2Benchmark_Sha512Mb: return std::string("sha512_mb_")+sha512_mb_impl_name();
+	}
+	return std::string();
+}
+
+//Hashes size bytes in one stream or in eight streams of the same length (multi-buffer)
+bool sha2_throughput(int64 size, unsigned int seed, ESha2Benchmark mode, SBenchmarkStage& stage)
+{
+	const size_t nstreams=8;
+	const size_t stream_size=65536;
+	std::vector<char> buf(nstreams*stream_size);
+	BenchmarkRandom rnd(seed);
+	rnd.fill(&buf[0], buf.size());
+
+	std::vector<sha256_ctx> ctx256(nstreams);
+	std::vector<sha512_ctx> ctx512(nstreams);
+	sha256_ctx* pctx256[nstreams];
+	sha512_ctx* pctx512[nstreams];
+	const unsigned char* msgs[nstreams];
+	for(size_t i=0;i<nstreams;++i)
+	{
+		sha256_init(&ctx256[i]);
+		sha512_init(&ctx512[i]);
+		pctx256[i]=&ctx256[i];
+		pctx512[i]=&ctx512[i];
+		msgs[i]=reinterpret_cast<const unsigned char*>(&buf[i*stream_size]);
+	}
+
+	bool multi_buffer = mode==ESha2Benchmark_Sha256Mb || mode==ESha2Benchmark_Sha512Mb;
+
+#ifdef BENCHMARK_HAS_RDTSC
+	unsigned long long start_cycles=__rdtsc();
+#endif
+	stage.starttime=Server->getTimeMS();
+	while(stage.bytes<size)
+	{
+		switch(mode)
+		{
+		case ESha2Benchmark_Sha256:
+			sha256_update(&ctx256[0], msgs[0], static_cast<unsigned int>(buf.size()));
+			break;
+		case ESha2Benchmark_Sha512:
+			sha512_update(&ctx512[0], msgs[0], static_cast<unsigned int>(buf.size()));
+			break;
+		case ESha2Benchmark_Sha256Mb:
+			sha256_update_mb(pctx256, msgs, static_cast<unsigned int>(stream_size), nstreams);
+			break;
+		case ESha2Benchmark_Sha512Mb:
+			sha512_update_mb(pctx512, msgs, static_cast<unsigned int>(stream_size), nstreams);
+			break;
+		}
+		stage.bytes+=buf.size();
+	}
+
+	unsigned char dig[SHA512_DIGEST_SIZE];
+	for(size_t i=0;i<(multi_buffer?nstreams:1);++i)
+	{
+		sha256_final(&ctx256[i], dig);
+		sha512_final(&ctx512[i], dig);
+	}
+	stage.files=multi_buffer?nstreams:1;
+
+#ifdef BENCHMARK_HAS_RDTSC
+	double cycles_per_byte=static_cast<double>(__rdtsc()-start_cycles)/stage.bytes;
+	Server->Log(stage.name+": "+nconvert(cycles_per_byte)+" cycles/byte", LL_INFO);
+	ServerMetrics::addGauge("urbackup_benchmark_sha2_cycles_per_byte_x100{stage=\""+stage.name+"\"}", static_cast<int64>(cycles_per_byte*100));
+#endif
+
+	return true;
+}
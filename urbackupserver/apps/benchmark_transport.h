@@ -0,0 +1,19 @@
+#pragma once
+
+#include "benchmark_common.h"
+
+enum ESha2Benchmark
+{
+	ESha2Benchmark_Sha256,
+	ESha2Benchmark_Sha512,
+	ESha2Benchmark_Sha256Mb,
+	ESha2Benchmark_Sha512Mb
+};
+
+bool buffer_churn(size_t nthreads, size_t iterations, bool pooled, SBenchmarkStage& stage);
+bool memory_pipe_throughput(size_t messages, size_t msg_size, bool owned, SBenchmarkStage& stage);
+bool compressed_pipe_throughput(int64 size, unsigned int seed, bool stream_frames, SBenchmarkStage& stage);
+bool encrypted_pipe_throughput(int64 size, unsigned int seed, bool aead, SBenchmarkStage& stage);
+bool throttle_fairness(size_t ntransfers, size_t global_bps, int64 duration_ms, SBenchmarkStage& stage);
+std::string sha2_stage_name(ESha2Benchmark mode);
+bool sha2_throughput(int64 size, unsigned int seed, ESha2Benchmark mode, SBenchmarkStage& stage);
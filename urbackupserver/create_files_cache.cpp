@@ -5,6 +5,7 @@
 #include "server_settings.h"
 #include "MDBFileCache.h"
 #include "SQLiteFileCache.h"
+#include "HashIndexFileCache.h"
 #include "../stringtools.h"
 #include "../urbackupcommon/os_functions.h"
 #include "serverinterface/helper.h"
@@ -131,6 +132,21 @@ bool setup_sqlite_files_cache(SStartupStatus& status)
 	}
 }
 
+bool setup_hashindex_files_cache(SStartupStatus& status)
+{
+	os_create_dir(L"urbackup/cache");
+
+	if(!HashIndexFileCache::openIndex())
+	{
+		Server->Log("Failed to open file entry hash index", LL_ERROR);
+		return false;
+	}
+
+	HashIndexFileCache filecache;
+
+	return create_files_cache_common(filecache, status);
+}
+
 bool filecache_opened_ok=false;
 
 }
@@ -142,6 +158,7 @@ void delete_file_caches(void)
 	Server->deleteFile("urbackup/cache/backup_server_files_cache.db");
 	Server->deleteFile("urbackup/cache/backup_server_files_cache.db-shm");
 	Server->deleteFile("urbackup/cache/backup_server_files_cache.db-wal");
+	HashIndexFileCache::deleteIndexFiles();
 }
 
 void create_files_cache(SStartupStatus& status)
@@ -215,6 +232,33 @@ void create_files_cache(SStartupStatus& status)
 		filecache_opened_ok=!has_error;
 		SQLiteFileCache::initFileCache();
 	}
+	else if(settings.getSettings()->filescache_type=="hashindex")
+	{
+		bool has_error=false;
+		if(get_files_cache_type()!=L"hashindex"
+			|| !HashIndexFileCache::indexFilesExist())
+		{
+			delete_file_caches();
+
+			update_files_cache_type("none");
+			if(!setup_hashindex_files_cache(status))
+			{
+				Server->Log("Setting up files cache failed", LL_ERROR);
+				has_error=true;
+			}
+		}
+		else if(!HashIndexFileCache::openIndex())
+		{
+			Server->Log("Failed to open file entry hash index", LL_ERROR);
+			has_error=true;
+		}
+		if(!has_error)
+		{
+			update_files_cache_type(settings.getSettings()->filescache_type);
+		}
+		filecache_opened_ok=!has_error;
+		HashIndexFileCache::initFileCache();
+	}
 
 	if(settings.getSettings()->filescache_type=="none")
 	{
@@ -226,6 +270,10 @@ void create_files_cache(SStartupStatus& status)
 		{
 			delete_file_caches();
 		}
+		if(HashIndexFileCache::indexFilesExist())
+		{
+			delete_file_caches();
+		}
 
 		update_files_cache_type(settings.getSettings()->filescache_type);
 	}
@@ -253,4 +301,28 @@ FileCache* create_sqlite_files_cache(void)
 	{
 		return NULL;
 	}
+}
+
+FileCache* create_hashindex_files_cache(void)
+{
+	if(filecache_opened_ok)
+	{
+		return new HashIndexFileCache();
+	}
+	else
+	{
+		return NULL;
+	}
+}
+
+bool open_hashindex_files_cache(const std::string& path_prefix)
+{
+	if(!HashIndexFileCache::openIndex(path_prefix))
+	{
+		return false;
+	}
+
+	filecache_opened_ok=true;
+	HashIndexFileCache::initFileCache();
+	return true;
 }
\ No newline at end of file
@@ -1,3 +1,5 @@
+#include <string>
+
 class FileCache;
 struct SStartupStatus;
 
@@ -5,4 +7,10 @@ void create_files_cache(SStartupStatus& status);
 
 FileCache* create_lmdb_files_cache(void);
 
-FileCache* create_sqlite_files_cache(void);
\ No newline at end of file
+FileCache* create_sqlite_files_cache(void);
+
+FileCache* create_hashindex_files_cache(void);
+
+//Opens the hash index at path_prefix as the files cache of the hash
+//threads, independent of the configured cache (used by the benchmark)
+bool open_hashindex_files_cache(const std::string& path_prefix);
\ No newline at end of file
@@ -18,6 +18,7 @@
 
 #include "ServerBackupDao.h"
 #include "../../stringtools.h"
+#include "../server_metrics.h"
 #include <assert.h>
 #include <string.h>
 
@@ -32,6 +33,18 @@
 * @sql
 *		CREATE TEMPORARY TABLE files_new_tmp ( fullpath TEXT, hashpath TEXT, shahash BLOB, filesize INTEGER, created DATE DEFAULT CURRENT_TIMESTAMP );
 */
+
+/**
+* @-SQLGenTempSetup
+* @sql
+*		CREATE TEMPORARY TABLE files_synthetic ( relpath TEXT PRIMARY KEY, hashrelpath TEXT, shahash BLOB, filesize INTEGER, created DATE );
+*/
+
+/**
+* @-SQLGenTempSetup
+* @sql
+*		CREATE TEMPORARY TABLE files_synthetic_present ( relpath TEXT );
+*/
 ServerBackupDao::ServerBackupDao( IDatabase *db )
 	: db(db)
 {
@@ -733,6 +746,243 @@ std::vector<int> ServerBackupDao::getClientIds(void)
 	return ret;
 }
 
+/**
+* @-SQLGenAccess
+* @func vector<SFileBackupPath> ServerBackupDao::getFileBackupChain
+* @return int id, string path
+* @sql
+*      SELECT id, path FROM backups
+*		WHERE clientid=:clientid(int) AND done=1
+*			AND backuptime<=(SELECT backuptime FROM backups WHERE id=:backupid(int))
+*			AND backuptime>=(SELECT MAX(backuptime) FROM backups
+*				WHERE clientid=:clientid(int) AND done=1 AND incremental=0
+*					AND backuptime<=(SELECT backuptime FROM backups WHERE id=:backupid(int)))
+*		ORDER BY backuptime DESC
+*/
+std::vector<ServerBackupDao::SFileBackupPath> ServerBackupDao::getFileBackupChain(int clientid, int backupid)
+{
+	if(q_getFileBackupChain==NULL)
+	{
+		q_getFileBackupChain=db->Prepare("SELECT id, path FROM backups WHERE clientid=? AND done=1 AND backuptime<=(SELECT backuptime FROM backups WHERE id=?) AND backuptime>=(SELECT MAX(backuptime) FROM backups WHERE clientid=? AND done=1 AND incremental=0 AND backuptime<=(SELECT backuptime FROM backups WHERE id=?)) ORDER BY backuptime DESC", false);
+	}
+	q_getFileBackupChain->Bind(clientid);
+	q_getFileBackupChain->Bind(backupid);
+	q_getFileBackupChain->Bind(clientid);
+	q_getFileBackupChain->Bind(backupid);
+	db_results res=q_getFileBackupChain->Read();
+	q_getFileBackupChain->Reset();
+	std::vector<ServerBackupDao::SFileBackupPath> ret;
+	ret.resize(res.size());
+	for(size_t i=0;i<res.size();++i)
+	{
+		ret[i].id=watoi(res[i][L"id"]);
+		ret[i].path=res[i][L"path"];
+	}
+	return ret;
+}
+
+/**
+* @-SQLGenAccess
+* @func void ServerBackupDao::newSyntheticFileBackup
+* @sql
+*      INSERT INTO backups (incremental, clientid, path, complete, running, size_bytes, done, archived, size_calculated, resumed, indexing_time_ms)
+*		VALUES (0, :clientid(int), :path(string), 0, CURRENT_TIMESTAMP, -1, 0, 0, 0, 0, 0)
+*/
+void ServerBackupDao::newSyntheticFileBackup(int clientid, const std::wstring& path)
+{
+	if(q_newSyntheticFileBackup==NULL)
+	{
+		q_newSyntheticFileBackup=db->Prepare("INSERT INTO backups (incremental, clientid, path, complete, running, size_bytes, done, archived, size_calculated, resumed, indexing_time_ms) VALUES (0, ?, ?, 0, CURRENT_TIMESTAMP, -1, 0, 0, 0, 0, 0)", false);
+	}
+	q_newSyntheticFileBackup->Bind(clientid);
+	q_newSyntheticFileBackup->Bind(path);
+	q_newSyntheticFileBackup->Write();
+	q_newSyntheticFileBackup->Reset();
+}
+
+/**
+* @-SQLGenAccess
+* @func void ServerBackupDao::setFileBackupDone
+* @sql
+*      UPDATE backups SET complete=1, done=1, running=CURRENT_TIMESTAMP WHERE id=:backupid(int)
+*/
+void ServerBackupDao::setFileBackupDone(int backupid)
+{
+	if(q_setFileBackupDone==NULL)
+	{
+		q_setFileBackupDone=db->Prepare("UPDATE backups SET complete=1, done=1, running=CURRENT_TIMESTAMP WHERE id=?", false);
+	}
+	q_setFileBackupDone->Bind(backupid);
+	q_setFileBackupDone->Write();
+	q_setFileBackupDone->Reset();
+}
+
+/**
+* @-SQLGenAccess
+* @func void ServerBackupDao::deleteFileBackup
+* @sql
+*      DELETE FROM backups WHERE id=:backupid(int)
+*/
+void ServerBackupDao::deleteFileBackup(int backupid)
+{
+	if(q_deleteFileBackup==NULL)
+	{
+		q_deleteFileBackup=db->Prepare("DELETE FROM backups WHERE id=?", false);
+	}
+	q_deleteFileBackup->Bind(backupid);
+	q_deleteFileBackup->Write();
+	q_deleteFileBackup->Reset();
+}
+
+/**
+* @-SQLGenAccessNoCheck
+* @func bool ServerBackupDao::createTemporarySyntheticFilesTable
+* @sql
+*      CREATE TEMPORARY TABLE files_synthetic ( relpath TEXT PRIMARY KEY, hashrelpath TEXT, shahash BLOB, filesize INTEGER, created DATE );
+*/
+bool ServerBackupDao::createTemporarySyntheticFilesTable(void)
+{
+	if(q_createTemporarySyntheticFilesTable==NULL)
+	{
+		q_createTemporarySyntheticFilesTable=db->Prepare("CREATE TEMPORARY TABLE files_synthetic ( relpath TEXT PRIMARY KEY, hashrelpath TEXT, shahash BLOB, filesize INTEGER, created DATE );", false);
+	}
+	bool ret = q_createTemporarySyntheticFilesTable->Write();
+	return ret;
+}
+
+/**
+* @-SQLGenAccessNoCheck
+* @func void ServerBackupDao::dropTemporarySyntheticFilesTable
+* @sql
+*      DROP TABLE files_synthetic
+*/
+void ServerBackupDao::dropTemporarySyntheticFilesTable(void)
+{
+	if(q_dropTemporarySyntheticFilesTable==NULL)
+	{
+		q_dropTemporarySyntheticFilesTable=db->Prepare("DROP TABLE files_synthetic", false);
+	}
+	q_dropTemporarySyntheticFilesTable->Write();
+}
+
+/**
+* @-SQLGenAccessNoCheck
+* @func bool ServerBackupDao::createTemporarySyntheticPresentTable
+* @sql
+*      CREATE TEMPORARY TABLE files_synthetic_present ( relpath TEXT );
+*/
+bool ServerBackupDao::createTemporarySyntheticPresentTable(void)
+{
+	if(q_createTemporarySyntheticPresentTable==NULL)
+	{
+		q_createTemporarySyntheticPresentTable=db->Prepare("CREATE TEMPORARY TABLE files_synthetic_present ( relpath TEXT );", false);
+	}
+	bool ret = q_createTemporarySyntheticPresentTable->Write();
+	return ret;
+}
+
+/**
+* @-SQLGenAccessNoCheck
+* @func void ServerBackupDao::dropTemporarySyntheticPresentTable
+* @sql
+*      DROP TABLE files_synthetic_present
+*/
+void ServerBackupDao::dropTemporarySyntheticPresentTable(void)
+{
+	if(q_dropTemporarySyntheticPresentTable==NULL)
+	{
+		q_dropTemporarySyntheticPresentTable=db->Prepare("DROP TABLE files_synthetic_present", false);
+	}
+	q_dropTemporarySyntheticPresentTable->Write();
+}
+
+/**
+* @-SQLGenAccess
+* @func void ServerBackupDao::insertIntoTemporarySyntheticPresentTable
+* @sql
+*      INSERT INTO files_synthetic_present (relpath) VALUES (:relpath(string))
+*/
+void ServerBackupDao::insertIntoTemporarySyntheticPresentTable(const std::wstring& relpath)
+{
+	if(q_insertIntoTemporarySyntheticPresentTable==NULL)
+	{
+		q_insertIntoTemporarySyntheticPresentTable=db->Prepare("INSERT INTO files_synthetic_present (relpath) VALUES (?)", false);
+	}
+	q_insertIntoTemporarySyntheticPresentTable->Bind(relpath);
+	q_insertIntoTemporarySyntheticPresentTable->Write();
+	q_insertIntoTemporarySyntheticPresentTable->Reset();
+}
+
+/**
+* @-SQLGenAccess
+* @func void ServerBackupDao::copyToTemporarySyntheticFilesTable
+* @sql
+*      INSERT OR IGNORE INTO files_synthetic (relpath, hashrelpath, shahash, filesize, created)
+*			SELECT substr(fullpath, :fullpath_start(int)),
+*				CASE WHEN hashpath IS NULL OR hashpath='' THEN '' ELSE substr(hashpath, :hashpath_start(int)) END,
+*				shahash, filesize, created
+*			FROM files WHERE backupid=:backupid(int)
+*/
+void ServerBackupDao::copyToTemporarySyntheticFilesTable(int fullpath_start, int hashpath_start, int backupid)
+{
+	if(q_copyToTemporarySyntheticFilesTable==NULL)
+	{
+		q_copyToTemporarySyntheticFilesTable=db->Prepare("INSERT OR IGNORE INTO files_synthetic (relpath, hashrelpath, shahash, filesize, created) SELECT substr(fullpath, ?), CASE WHEN hashpath IS NULL OR hashpath='' THEN '' ELSE substr(hashpath, ?) END, shahash, filesize, created FROM files WHERE backupid=?", false);
+	}
+	q_copyToTemporarySyntheticFilesTable->Bind(fullpath_start);
+	q_copyToTemporarySyntheticFilesTable->Bind(hashpath_start);
+	q_copyToTemporarySyntheticFilesTable->Bind(backupid);
+	q_copyToTemporarySyntheticFilesTable->Write();
+	q_copyToTemporarySyntheticFilesTable->Reset();
+}
+
+/**
+* @-SQLGenAccess
+* @func void ServerBackupDao::copyNewToTemporarySyntheticFilesTable
+* @sql
+*      INSERT OR IGNORE INTO files_synthetic (relpath, hashrelpath, shahash, filesize, created)
+*			SELECT substr(fullpath, :fullpath_start(int)),
+*				CASE WHEN hashpath IS NULL OR hashpath='' THEN '' ELSE substr(hashpath, :hashpath_start(int)) END,
+*				shahash, filesize, created
+*			FROM files_new WHERE backupid=:backupid(int)
+*/
+void ServerBackupDao::copyNewToTemporarySyntheticFilesTable(int fullpath_start, int hashpath_start, int backupid)
+{
+	if(q_copyNewToTemporarySyntheticFilesTable==NULL)
+	{
+		q_copyNewToTemporarySyntheticFilesTable=db->Prepare("INSERT OR IGNORE INTO files_synthetic (relpath, hashrelpath, shahash, filesize, created) SELECT substr(fullpath, ?), CASE WHEN hashpath IS NULL OR hashpath='' THEN '' ELSE substr(hashpath, ?) END, shahash, filesize, created FROM files_new WHERE backupid=?", false);
+	}
+	q_copyNewToTemporarySyntheticFilesTable->Bind(fullpath_start);
+	q_copyNewToTemporarySyntheticFilesTable->Bind(hashpath_start);
+	q_copyNewToTemporarySyntheticFilesTable->Bind(backupid);
+	q_copyNewToTemporarySyntheticFilesTable->Write();
+	q_copyNewToTemporarySyntheticFilesTable->Reset();
+}
+
+/**
+* @-SQLGenAccess
+* @func void ServerBackupDao::copyFromTemporarySyntheticFilesTableToFilesNewTable
+* @sql
+*      INSERT INTO files_new (backupid, fullpath, hashpath, shahash, filesize, created, rsize, clientid, incremental)
+*			SELECT :backupid(int) AS backupid, :fullpath_prefix(string) || s.relpath,
+*				CASE WHEN s.hashrelpath='' THEN '' ELSE :hashpath_prefix(string) || s.hashrelpath END,
+*				s.shahash, s.filesize, s.created, 0 AS rsize, :clientid(int) AS clientid, 0 AS incremental
+*			FROM files_synthetic_present p INNER JOIN files_synthetic s ON p.relpath=s.relpath
+*/
+void ServerBackupDao::copyFromTemporarySyntheticFilesTableToFilesNewTable(int backupid, const std::wstring& fullpath_prefix, const std::wstring& hashpath_prefix, int clientid)
+{
+	if(q_copyFromTemporarySyntheticFilesTableToFilesNewTable==NULL)
+	{
+		q_copyFromTemporarySyntheticFilesTableToFilesNewTable=db->Prepare("INSERT INTO files_new (backupid, fullpath, hashpath, shahash, filesize, created, rsize, clientid, incremental) SELECT ? AS backupid, ? || s.relpath, CASE WHEN s.hashrelpath='' THEN '' ELSE ? || s.hashrelpath END, s.shahash, s.filesize, s.created, 0 AS rsize, ? AS clientid, 0 AS incremental FROM files_synthetic_present p INNER JOIN files_synthetic s ON p.relpath=s.relpath", false);
+	}
+	q_copyFromTemporarySyntheticFilesTableToFilesNewTable->Bind(backupid);
+	q_copyFromTemporarySyntheticFilesTableToFilesNewTable->Bind(fullpath_prefix);
+	q_copyFromTemporarySyntheticFilesTableToFilesNewTable->Bind(hashpath_prefix);
+	q_copyFromTemporarySyntheticFilesTableToFilesNewTable->Bind(clientid);
+	q_copyFromTemporarySyntheticFilesTableToFilesNewTable->Write();
+	q_copyFromTemporarySyntheticFilesTableToFilesNewTable->Reset();
+}
+
 //@-SQLGenSetup
 void ServerBackupDao::prepareQueries( void )
 {
@@ -768,6 +1018,18 @@ void ServerBackupDao::prepareQueries( void )
 	q_getLastFullDurations=NULL;
 	q_getClientSetting=NULL;
 	q_getClientIds=NULL;
+	q_getFileBackupChain=NULL;
+	q_newSyntheticFileBackup=NULL;
+	q_setFileBackupDone=NULL;
+	q_deleteFileBackup=NULL;
+	q_createTemporarySyntheticFilesTable=NULL;
+	q_dropTemporarySyntheticFilesTable=NULL;
+	q_createTemporarySyntheticPresentTable=NULL;
+	q_dropTemporarySyntheticPresentTable=NULL;
+	q_insertIntoTemporarySyntheticPresentTable=NULL;
+	q_copyToTemporarySyntheticFilesTable=NULL;
+	q_copyNewToTemporarySyntheticFilesTable=NULL;
+	q_copyFromTemporarySyntheticFilesTableToFilesNewTable=NULL;
 }
 
 //@-SQLGenDestruction
@@ -805,6 +1067,18 @@ void ServerBackupDao::destroyQueries( void )
 	db->destroyQuery(q_getLastFullDurations);
 	db->destroyQuery(q_getClientSetting);
 	db->destroyQuery(q_getClientIds);
+	db->destroyQuery(q_getFileBackupChain);
+	db->destroyQuery(q_newSyntheticFileBackup);
+	db->destroyQuery(q_setFileBackupDone);
+	db->destroyQuery(q_deleteFileBackup);
+	db->destroyQuery(q_createTemporarySyntheticFilesTable);
+	db->destroyQuery(q_dropTemporarySyntheticFilesTable);
+	db->destroyQuery(q_createTemporarySyntheticPresentTable);
+	db->destroyQuery(q_dropTemporarySyntheticPresentTable);
+	db->destroyQuery(q_insertIntoTemporarySyntheticPresentTable);
+	db->destroyQuery(q_copyToTemporarySyntheticFilesTable);
+	db->destroyQuery(q_copyNewToTemporarySyntheticFilesTable);
+	db->destroyQuery(q_copyFromTemporarySyntheticFilesTableToFilesNewTable);
 }
 
 void ServerBackupDao::commit()
@@ -824,7 +1098,7 @@ void ServerBackupDao::BeginWriteTransaction()
 
 void ServerBackupDao::endTransaction()
 {
-	db->EndTransaction();
+	timedEndTransaction(db, "backup_dao");
 }
 
 int ServerBackupDao::getLastChanges()
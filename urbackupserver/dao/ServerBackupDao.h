@@ -44,6 +44,11 @@ public:
 		std::string shahash;
 		int64 filesize;
 	};
+	struct SFileBackupPath
+	{
+		int id;
+		std::wstring path;
+	};
 
 
 	void addDirectoryLink(int clientid, const std::wstring& name, const std::wstring& target);
@@ -78,6 +83,18 @@ public:
 	std::vector<SDuration> getLastFullDurations(int clientid);
 	CondString getClientSetting(const std::wstring& key, int clientid);
 	std::vector<int> getClientIds(void);
+	std::vector<SFileBackupPath> getFileBackupChain(int clientid, int backupid);
+	void newSyntheticFileBackup(int clientid, const std::wstring& path);
+	void setFileBackupDone(int backupid);
+	void deleteFileBackup(int backupid);
+	bool createTemporarySyntheticFilesTable(void);
+	void dropTemporarySyntheticFilesTable(void);
+	bool createTemporarySyntheticPresentTable(void);
+	void dropTemporarySyntheticPresentTable(void);
+	void insertIntoTemporarySyntheticPresentTable(const std::wstring& relpath);
+	void copyToTemporarySyntheticFilesTable(int fullpath_start, int hashpath_start, int backupid);
+	void copyNewToTemporarySyntheticFilesTable(int fullpath_start, int hashpath_start, int backupid);
+	void copyFromTemporarySyntheticFilesTableToFilesNewTable(int backupid, const std::wstring& fullpath_prefix, const std::wstring& hashpath_prefix, int clientid);
 	//@-SQLGenFunctionsEnd
 
 private:
@@ -120,6 +137,18 @@ private:
 	IQuery* q_getLastFullDurations;
 	IQuery* q_getClientSetting;
 	IQuery* q_getClientIds;
+	IQuery* q_getFileBackupChain;
+	IQuery* q_newSyntheticFileBackup;
+	IQuery* q_setFileBackupDone;
+	IQuery* q_deleteFileBackup;
+	IQuery* q_createTemporarySyntheticFilesTable;
+	IQuery* q_dropTemporarySyntheticFilesTable;
+	IQuery* q_createTemporarySyntheticPresentTable;
+	IQuery* q_dropTemporarySyntheticPresentTable;
+	IQuery* q_insertIntoTemporarySyntheticPresentTable;
+	IQuery* q_copyToTemporarySyntheticFilesTable;
+	IQuery* q_copyNewToTemporarySyntheticFilesTable;
+	IQuery* q_copyFromTemporarySyntheticFilesTableToFilesNewTable;
 	//@-SQLGenVariablesEnd
 
 	IDatabase *db;
@@ -599,6 +599,32 @@ ServerCleanupDao::CondInt ServerCleanupDao::getParentImageBackup(int assoc_id)
 	return ret;
 }
 
+/**
+* @-SQLGenAccess
+* @func int ServerCleanupDao::getOtherParentImageBackup
+* @return int img_id
+* @sql
+*	SELECT img_id FROM assoc_images WHERE assoc_id=:assoc_id(int) AND img_id!=:img_id(int)
+*/
+ServerCleanupDao::CondInt ServerCleanupDao::getOtherParentImageBackup(int assoc_id, int img_id)
+{
+	if(q_getOtherParentImageBackup==NULL)
+	{
+		q_getOtherParentImageBackup=db->Prepare("SELECT img_id FROM assoc_images WHERE assoc_id=? AND img_id!=?", false);
+	}
+	q_getOtherParentImageBackup->Bind(assoc_id);
+	q_getOtherParentImageBackup->Bind(img_id);
+	db_results res=q_getOtherParentImageBackup->Read();
+	q_getOtherParentImageBackup->Reset();
+	CondInt ret = { false, 0 };
+	if(!res.empty())
+	{
+		ret.exists=true;
+		ret.value=watoi(res[0][L"img_id"]);
+	}
+	return ret;
+}
+
 /**
 * @-SQLGenAccess
 * @func vector<int> ServerCleanupDao::getAssocImageBackups
@@ -986,6 +1012,25 @@ void ServerCleanupDao::insertClientHistoryItem(int id, const std::wstring& name,
 	q_insertClientHistoryItem->Reset();
 }
 
+/**
+* @-SQLGenAccess
+* @func void ServerCleanupDao::deleteUsageAggregates
+* @sql
+*    DELETE FROM clients_usage_agg WHERE
+*				 scale=:scale(string) AND tdate_full<date('now', :back(string))
+*/
+void ServerCleanupDao::deleteUsageAggregates(const std::wstring& scale, const std::wstring& back)
+{
+	if(q_deleteUsageAggregates==NULL)
+	{
+		q_deleteUsageAggregates=db->Prepare("DELETE FROM clients_usage_agg WHERE scale=? AND tdate_full<date('now', ?)", false);
+	}
+	q_deleteUsageAggregates->Bind(scale);
+	q_deleteUsageAggregates->Bind(back);
+	q_deleteUsageAggregates->Write();
+	q_deleteUsageAggregates->Reset();
+}
+
 
 //@-SQLGenSetup
 void ServerCleanupDao::createQueries(void)
@@ -1014,6 +1059,7 @@ void ServerCleanupDao::createQueries(void)
 	q_getClientImages=NULL;
 	q_getClientFileBackups=NULL;
 	q_getParentImageBackup=NULL;
+	q_getOtherParentImageBackup=NULL;
 	q_getAssocImageBackups=NULL;
 	q_getImageSize=NULL;
 	q_getClients=NULL;
@@ -1030,6 +1076,7 @@ void ServerCleanupDao::createQueries(void)
 	q_deleteClientHistoryItems=NULL;
 	q_insertClientHistoryId=NULL;
 	q_insertClientHistoryItem=NULL;
+	q_deleteUsageAggregates=NULL;
 }
 
 //@-SQLGenDestruction
@@ -1059,6 +1106,7 @@ void ServerCleanupDao::destroyQueries(void)
 	db->destroyQuery(q_getClientImages);
 	db->destroyQuery(q_getClientFileBackups);
 	db->destroyQuery(q_getParentImageBackup);
+	db->destroyQuery(q_getOtherParentImageBackup);
 	db->destroyQuery(q_getAssocImageBackups);
 	db->destroyQuery(q_getImageSize);
 	db->destroyQuery(q_getClients);
@@ -1075,4 +1123,5 @@ void ServerCleanupDao::destroyQueries(void)
 	db->destroyQuery(q_deleteClientHistoryItems);
 	db->destroyQuery(q_insertClientHistoryId);
 	db->destroyQuery(q_insertClientHistoryItem);
+	db->destroyQuery(q_deleteUsageAggregates);
 }
\ No newline at end of file
@@ -106,6 +106,7 @@ public:
 	std::vector<SImageBackupInfo> getClientImages(int clientid);
 	std::vector<int> getClientFileBackups(int clientid);
 	CondInt getParentImageBackup(int assoc_id);
+	CondInt getOtherParentImageBackup(int assoc_id, int img_id);
 	std::vector<int> getAssocImageBackups(int img_id);
 	CondInt64 getImageSize(int backupid);
 	std::vector<SClientInfo> getClients(void);
@@ -122,6 +123,7 @@ public:
 	void deleteClientHistoryItems(const std::wstring& back_start, const std::wstring& back_stop);
 	void insertClientHistoryId(const std::wstring& created);
 	void insertClientHistoryItem(int id, const std::wstring& name, const std::wstring& lastbackup, const std::wstring& lastseen, const std::wstring& lastbackup_image, int64 bytes_used_files, int64 bytes_used_images, const std::wstring& created, int64 hist_id);
+	void deleteUsageAggregates(const std::wstring& scale, const std::wstring& back);
 	//@-SQLGenFunctionsEnd
 
 private:
@@ -155,6 +157,7 @@ private:
 	IQuery* q_getClientImages;
 	IQuery* q_getClientFileBackups;
 	IQuery* q_getParentImageBackup;
+	IQuery* q_getOtherParentImageBackup;
 	IQuery* q_getAssocImageBackups;
 	IQuery* q_getImageSize;
 	IQuery* q_getClients;
@@ -171,5 +174,6 @@ private:
 	IQuery* q_deleteClientHistoryItems;
 	IQuery* q_insertClientHistoryId;
 	IQuery* q_insertClientHistoryItem;
+	IQuery* q_deleteUsageAggregates;
 	//@-SQLGenVariablesEnd
 };
\ No newline at end of file
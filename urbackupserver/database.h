@@ -4,6 +4,9 @@
 const DATABASE_ID URBACKUPDB_SERVER=20;
 const DATABASE_ID URBACKUPDB_SERVER_TMP=21;
 const DATABASE_ID URBACKUPDB_FILES_CACHE=22;
+const DATABASE_ID URBACKUPDB_BENCHMARK=23;
+const DATABASE_ID URBACKUPDB_BENCHMARK_FILES=24;
+const DATABASE_ID URBACKUPDB_BENCHMARK_LINKS=25;
 const DATABASE_ID URBACKUPDB_SERVER_SETTINGS=30;
 
 #endif //DATABASE_H
\ No newline at end of file
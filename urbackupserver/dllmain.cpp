@@ -52,6 +52,7 @@ SStartupStatus startup_status;
 
 #include "../stringtools.h"
 #include "server_status.h"
+#include "server_metrics.h"
 #include "server_log.h"
 #include "server_cleanup.h"
 #include "server_get.h"
@@ -60,12 +61,17 @@ SStartupStatus startup_status;
 #include "server_update_stats.h"
 #include "../urbackupcommon/os_functions.h"
 #include "InternetServiceConnector.h"
+#include "../urbackupcommon/CompressedPipe.h"
 #include "filedownload.h"
 #include "apps/cleanup_cmd.h"
 #include "apps/repair_cmd.h"
 #include "apps/export_auth_log.h"
+#include "apps/benchmark_cmd.h"
 #include "create_files_cache.h"
 #include "server_dir_links.h"
+#include "server_synthetic_image.h"
+#include "server_file_entry_writer.h"
+#include "server_dedup_filter.h"
 
 #include <stdlib.h>
 
@@ -324,10 +330,14 @@ DLLEXPORT void LoadActions(IServer* pServer)
 		{
 			rc=export_auth_log();
 		}
+		else if(app=="benchmark")
+		{
+			rc=benchmark_cmd();
+		}
 		else
 		{
 			rc=100;
-			Server->Log("App not found. Available apps: cleanup, remove_unknown, cleanup_database, repair_database, defrag_database, export_auth_log");
+			Server->Log("App not found. Available apps: cleanup, remove_unknown, cleanup_database, repair_database, defrag_database, export_auth_log, benchmark");
 		}
 		exit(rc);
 	}
@@ -394,8 +404,12 @@ DLLEXPORT void LoadActions(IServer* pServer)
 	
 
 	ServerStatus::init_mutex();
+	ServerMetrics::init_mutex();
 	ServerSettings::init_mutex();
 	BackupServerGet::init_mutex();
+	ServerSyntheticImage::init_mutex();
+	ServerFileEntryWriter::initMutex();
+	ServerDedupFilter::initMutex();
 
 	open_settings_database(use_berkeleydb);
 	open_settings_database_full(use_berkeleydb);
@@ -459,6 +473,7 @@ DLLEXPORT void LoadActions(IServer* pServer)
 
 	ServerUpdateStats::createFilesIndices();
 	create_files_cache(startup_status);
+	ServerDedupFilter::init();
 
 	{
 		IScopedLock lock(startup_status.mutex);
@@ -524,6 +539,7 @@ DLLEXPORT void LoadActions(IServer* pServer)
 	ADD_ACTION(download_client);
 	ADD_ACTION(livelog);
 	ADD_ACTION(start_backup);
+	ADD_ACTION(metrics);
 
 	if(Server->getServerParameter("allow_shutdown")=="true")
 	{
@@ -545,12 +561,18 @@ DLLEXPORT void LoadActions(IServer* pServer)
 		Server->Log("Error loading IUrlFactory", LL_INFO);
 	}
 
+	if(Server->getServerParameter("file_entry_writer", "true")!="false")
+	{
+		ServerFileEntryWriter::start(URBACKUPDB_SERVER);
+	}
+
 	server_exit_pipe=Server->createMemoryPipe();
 	BackupServer *backup_server=new BackupServer(server_exit_pipe);
 	Server->createThread(backup_server);
 	Server->wait(500);
 
 	InternetServiceConnector::init_mutex();
+	CompressedPipe::init_mutex();
 
 	{
 		ServerSettings settings(Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER));
@@ -617,6 +639,15 @@ DLLEXPORT void UnloadActions(void)
 			shutdown_ok=true;
 		}
 	}
+
+	ServerSyntheticImage::stopAll();
+	CompressedPipe::stop_idle_flusher();
+
+	if(shutdown_ok)
+	{
+		ServerFileEntryWriter::stop();
+		ServerDedupFilter::shutdown();
+	}
 	
 	ServerLogger::destroy_mutex();
 
@@ -640,13 +671,21 @@ DLLEXPORT void UnloadActions(void)
 		}
 
 		InternetServiceConnector::destroy_mutex();
+		CompressedPipe::destroy_mutex();
 		destroy_mutex1();
 		Server->destroy(startup_status.mutex);
 		Server->Log("Deleting cached server settings...", LL_INFO);
 		ServerSettings::clear_cache();
 		ServerSettings::destroy_mutex();
 		ServerStatus::destroy_mutex();
+		ServerMetrics::destroy_mutex();
 		destroy_dir_link_mutex();
+		ServerSyntheticImage::destroy_mutex();
+		if(shutdown_ok)
+		{
+			ServerFileEntryWriter::destroyMutex();
+			ServerDedupFilter::destroyMutex();
+		}
 		Server->wait(1000);
 	}
 
@@ -1127,6 +1166,29 @@ void upgrade34_35()
 	db->Write("CREATE INDEX IF NOT EXISTS clients_hist_id_created_idx ON clients_hist_id (created)");
 }
 
+void upgrade35_36()
+{
+	IDatabase *db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER);
+	db->Write("CREATE TABLE clients_usage_agg ("
+		"id INTEGER PRIMARY KEY,"
+		"clientid INTEGER,"
+		"scale TEXT,"
+		"tdate TEXT,"
+		"tdate_full TEXT,"
+		"used INTEGER)");
+	db->Write("CREATE UNIQUE INDEX clients_usage_agg_idx ON clients_usage_agg (scale, clientid, tdate)");
+
+	const char* scales[] = {"d", "m", "y"};
+	const char* date_fmts[] = {"%Y-%m-%d", "%Y-%m", "%Y"};
+	for(size_t i=0;i<3;++i)
+	{
+		db->Write(std::string("INSERT OR REPLACE INTO clients_usage_agg (clientid, scale, tdate, tdate_full, used) ")+
+			"SELECT id, '"+scales[i]+"' AS scale, strftime('"+date_fmts[i]+"', MAX(created), 'localtime') AS tdate, "
+			"strftime('%Y-%m-%d', MAX(created), 'localtime') AS tdate_full, bytes_used_files+bytes_used_images AS used "
+			"FROM clients_hist GROUP BY strftime('"+date_fmts[i]+"', created, 'localtime'), id");
+	}
+}
+
 void upgrade(void)
 {
 	Server->destroyAllDatabases();
@@ -1148,7 +1210,7 @@ void upgrade(void)
 	
 	int ver=watoi(res_v[0][L"tvalue"]);
 	int old_v;
-	int max_v=35;
+	int max_v=36;
 	{
 		IScopedLock lock(startup_status.mutex);
 		startup_status.target_db_version=max_v;
@@ -1310,6 +1372,10 @@ void upgrade(void)
 				upgrade34_35();
 				++ver;
 				break;
+			case 35:
+				upgrade35_36();
+				++ver;
+				break;
 			default:
 				break;
 		}
@@ -24,6 +24,7 @@
 #include "../../stringtools.h"
 
 #include "../../md5.h"
+#include "../server_metrics.h"
 
 #include <iostream>
 #include <memory.h>
@@ -85,7 +86,7 @@ FileClient::FileClient(bool enable_find_servers, std::string identity, int proto
 	protocol_version(protocol_version), internet_connection(internet_connection),
 	transferred_bytes(0), reconnection_callback(reconnection_callback),
 	nofreespace_callback(nofreespace_callback), reconnection_timeout(300000), retryBindToNewInterfaces(true),
-	identity(identity), received_data_bytes(0), queue_callback(NULL), dl_off(0),
+	identity(identity), received_data_bytes(0), received_bytes_metric("urbackup_fileclient_received_bytes_total"), queue_callback(NULL), dl_off(0),
 	last_transferred_bytes(0), last_progress_log(0), progress_log_callback(NULL)
 {
 	memset(buffer, 0, BUFFERSIZE_UDP);
@@ -639,6 +640,8 @@ bool FileClient::Reconnect(void)
 	if(tcpsock==NULL)
 		return ERR_ERROR;
 
+	ScopedMetricsLatency latency("urbackup_fileclient_getfile_ms");
+
 	int tries=5000;
 
 	if(!hashed && protocol_version>1)
@@ -943,6 +946,7 @@ bool FileClient::Reconnect(void)
 				{
 					IScopedLock lock(mutex);
 					received_data_bytes+=written-off;
+					received_bytes_metric.add(written-off);
 				}
 
 				if( received >= filesize && state==0)
@@ -8,6 +8,7 @@
 #include "../../Interface/Pipe.h"
 #include "../../Interface/File.h"
 #include "../../Interface/Mutex.h"
+#include "../server_metrics.h"
 
 #define TCP_PORT 35621
 #define UDP_PORT 35622
@@ -159,6 +160,7 @@ private:
 		std::string identity;
 
 		_i64 received_data_bytes;
+		LocalMetricsCounter received_bytes_metric;
 
 		IMutex* mutex;
 
@@ -10,6 +10,7 @@
 #include <memory>
 #include <algorithm>
 #include "../../common/adler32.h"
+#include "../server_metrics.h"
 
 #define VLOG(x) x
 
@@ -23,6 +24,7 @@ FileClientChunked::FileClientChunked(IPipe *pipe, bool del_pipe, CTCPStack *stac
 	, std::string identity, FileClientChunked* prev)
 	: pipe(pipe), destroy_pipe(del_pipe), stack(stack), transferred_bytes(0), reconnection_callback(reconnection_callback),
 	  nofreespace_callback(nofreespace_callback), reconnection_timeout(300000), identity(identity), received_data_bytes(0),
+	  received_bytes_metric("urbackup_fileclient_chunked_received_bytes_total"),
 	  parent(prev), queue_only(false), queue_callback(NULL), remote_filesize(-1), ofb_pipe(NULL), hashfilesize(-1), did_queue_fc(false), queued_chunks(0),
 	  last_transferred_bytes(0), last_progress_log(0), progress_log_callback(NULL)
 {
@@ -39,6 +41,7 @@ FileClientChunked::FileClientChunked(IPipe *pipe, bool del_pipe, CTCPStack *stac
 
 FileClientChunked::FileClientChunked(void)
 	: pipe(NULL), stack(NULL), destroy_pipe(false), transferred_bytes(0), reconnection_callback(NULL), reconnection_timeout(300000), received_data_bytes(0),
+	  received_bytes_metric("urbackup_fileclient_chunked_received_bytes_total"),
 	  parent(NULL), remote_filesize(-1), ofb_pipe(NULL), hashfilesize(-1), did_queue_fc(false), queued_chunks(0), last_transferred_bytes(0), last_progress_log(0),
 	  progress_log_callback(NULL)
 {
@@ -67,6 +70,7 @@ _u32 FileClientChunked::GetFilePatch(std::string remotefn, IFile *orig_file, IFi
 	m_patchfile=patchfile;
 	m_file=orig_file;
 	patchfile_pos=0;
+	hashoutput_pos=0;
 	patch_buf_pos=0;
 	remote_filesize = predicted_filesize;
 	last_transferred_bytes=0;
@@ -81,6 +85,7 @@ _u32 FileClientChunked::GetFileChunked(std::string remotefn, IFile *file, IFile
 	m_file=file;
 	m_chunkhashes=chunkhashes;
 	m_hashoutput=hashoutput;
+	hashoutput_pos=0;
 	remote_filesize = predicted_filesize;
 	last_transferred_bytes=0;
 	curr_output_fsize=0;
@@ -108,6 +113,8 @@ _u32 FileClientChunked::GetFile(std::string remotefn, _i64& filesize_out)
 	}
 
 
+	ScopedMetricsLatency latency("urbackup_fileclient_chunked_getfile_ms");
+
 	getfile_done=false;
 	retval=ERR_SUCCESS;
 	remote_filename=remotefn;
@@ -117,9 +124,8 @@ _u32 FileClientChunked::GetFile(std::string remotefn, _i64& filesize_out)
 
 	_i64 fileoffset=0;
 
-	m_chunkhashes->Seek(0);
 	hashfilesize=0;
-	if(m_chunkhashes->Read((char*)&hashfilesize, sizeof(_i64))!=sizeof(_i64) )
+	if(m_chunkhashes->ReadAt(0, (char*)&hashfilesize, sizeof(_i64))!=sizeof(_i64) )
 	{
 		Server->Log("Cannot read hashfilesize in FileClientChunked::GetFile", LL_ERROR);
 		return ERR_INT_ERROR;
@@ -197,14 +203,13 @@ _u32 FileClientChunked::GetFile(std::string remotefn, _i64& filesize_out)
 
 				bool get_whole_block = false;
 
-				if(next_chunk<num_chunks
-					&& m_chunkhashes->Seek(chunkhash_file_off+next_chunk*chunkhash_single_size))
+				if(next_chunk<num_chunks)
 				{
 					char buf[chunkhash_single_size+2*sizeof(char)+sizeof(_i64)];
 					buf[0]=ID_BLOCK_REQUEST;
 					*((_i64*)(buf+1))=little_endian(next_chunk*c_checkpoint_dist);
 					buf[1+sizeof(_i64)]=0;
-					_u32 r=m_chunkhashes->Read(&buf[2*sizeof(char)+sizeof(_i64)], chunkhash_single_size);
+					_u32 r=m_chunkhashes->ReadAt(chunkhash_file_off+next_chunk*chunkhash_single_size, &buf[2*sizeof(char)+sizeof(_i64)], chunkhash_single_size);
 					if(r==0)
 					{
 						get_whole_block=true;
@@ -591,9 +596,9 @@ void FileClientChunked::State_Acc(bool ignore_filesize)
 						return;
 					}
 
-					m_hashoutput->Seek(0);
 					_i64 endian_remote_filesize = little_endian(remote_filesize);
-					writeFileRepeat(m_hashoutput, (char*)&endian_remote_filesize, sizeof(_i64));
+					writeFileRepeat(m_hashoutput, 0, (char*)&endian_remote_filesize, sizeof(_i64));
+					hashoutput_pos=sizeof(_i64);
 				}				
 			}break;
 		case ID_BASE_DIR_LOST:
@@ -645,11 +650,6 @@ void FileClientChunked::State_Acc(bool ignore_filesize)
 				}
 
 				file_pos=block_start;
-				if(!m_file->Seek(block_start))
-				{
-					Server->Log("Chunked Transfer: Seeking failed", LL_ERROR);
-					assert(false);
-				}
 
 				block_for_chunk_start=block_start;
 
@@ -661,9 +661,10 @@ void FileClientChunked::State_Acc(bool ignore_filesize)
 				adler_remaining=c_chunk_size;
 				block_pos=0;
 
-				m_hashoutput->Seek(chunkhash_file_off+(block_start/c_checkpoint_dist)*chunkhash_single_size);
+				hashoutput_pos=chunkhash_file_off+(block_start/c_checkpoint_dist)*chunkhash_single_size;
 				char tmp[big_hash_size]={};
-				writeFileRepeat(m_hashoutput, tmp, big_hash_size);
+				writeFileRepeat(m_hashoutput, hashoutput_pos, tmp, big_hash_size);
+				hashoutput_pos+=big_hash_size;
 			}break;
 		case ID_UPDATE_CHUNK:
 			{
@@ -690,15 +691,13 @@ void FileClientChunked::State_Acc(bool ignore_filesize)
 				}
 				else if(new_block)
 				{
-					m_hashoutput->Seek(chunkhash_file_off+(chunk_start/c_checkpoint_dist)*chunkhash_single_size);
-					writeFileRepeat(m_hashoutput, it->second.big_hash, chunkhash_single_size);
+					writeFileRepeat(m_hashoutput, chunkhash_file_off+(chunk_start/c_checkpoint_dist)*chunkhash_single_size,
+						it->second.big_hash, chunkhash_single_size);
 				}
-
-				m_file->Seek(chunk_start);
 				
 				unsigned int chunknum=(chunk_start%c_checkpoint_dist)/c_chunk_size;
-				m_hashoutput->Seek(chunkhash_file_off+block*chunkhash_single_size
-					+big_hash_size+chunknum*small_hash_size);
+				hashoutput_pos=chunkhash_file_off+block*chunkhash_single_size
+					+big_hash_size+chunknum*small_hash_size;
 
 				state=CS_CHUNK;
 				adler_hash=urb_adler32(0, NULL, 0);
@@ -758,30 +757,22 @@ void FileClientChunked::Hash_upto(_i64 new_chunk_start, bool &new_block)
 	
 	if(chunk_start!=new_chunk_start)
 	{
-		if(m_file->Seek(chunk_start))
-		{
-			char buf2[BUFFERSIZE];
-			do
+		char buf2[BUFFERSIZE];
+		do
+		{
+			_u32 toread=(std::min)((_u32)BUFFERSIZE, (_u32)(new_chunk_start-chunk_start));
+			size_t r=m_file->ReadAt(chunk_start, buf2,  toread);
+			VLOG(Server->Log("Read for hash at chunk_start="+nconvert(chunk_start)+" toread="+nconvert(toread)+" n="+nconvert(r), LL_DEBUG));
+			if(r<toread)
 			{
-				_u32 toread=(std::min)((_u32)BUFFERSIZE, (_u32)(new_chunk_start-chunk_start));
-				size_t r=m_file->Read(buf2,  toread);
-				VLOG(Server->Log("Read for hash at chunk_start="+nconvert(chunk_start)+" toread="+nconvert(toread)+" n="+nconvert(r), LL_DEBUG));
-				if(r<toread)
-				{
-					Server->Log("Read error in hash calculation at position "+nconvert(chunk_start)+" toread="+nconvert(toread)+" read="+nconvert(r)+". This will cause the whole block to be loaded.", LL_WARNING);
-					chunk_start=new_chunk_start;
-					break;
-				}
-				chunk_start+=r;
-				md5_hash.update((unsigned char*)buf2, (unsigned int)r);
-			}while(chunk_start<new_chunk_start);
-		}
-		else
-		{
-			Server->Log("Error seeking in base file (to position "+nconvert(chunk_start)+"). Whole block will be loaded. (1)", LL_WARNING);
-			chunk_start=new_chunk_start;
-		}
-		
+				Server->Log("Read error in hash calculation at position "+nconvert(chunk_start)+" toread="+nconvert(toread)+" read="+nconvert(r)+". This will cause the whole block to be loaded.", LL_WARNING);
+				chunk_start=new_chunk_start;
+				break;
+			}
+			chunk_start+=r;
+			md5_hash.update((unsigned char*)buf2, (unsigned int)r);
+		}while(chunk_start<new_chunk_start);
+		
 		file_pos=new_chunk_start;
 	}
 }
@@ -801,30 +792,21 @@ void FileClientChunked::Hash_finalize(_i64 curr_pos, const char *hash_from_clien
 			VLOG(Server->Log("dest_pos="+nconvert(dest_pos)+" chunk_start="+nconvert(chunk_start), LL_DEBUG));
 		
 			char buf2[BUFFERSIZE];
-			if(m_file->Seek(chunk_start))
+			while(chunk_start<dest_pos)
 			{
-				while(chunk_start<dest_pos)
+				_u32 toread = (std::min)((_u32)BUFFERSIZE, (_u32)(dest_pos-chunk_start));
+				size_t r=m_file->ReadAt(chunk_start, buf2, toread);
+				VLOG(Server->Log("Read for hash finalize at block_start="+nconvert(chunk_start)+" n="+nconvert(r), LL_DEBUG));
+				if(r==0)
 				{
-					_u32 toread = (std::min)((_u32)BUFFERSIZE, (_u32)(dest_pos-chunk_start));
-					size_t r=m_file->Read(buf2, toread);
-					VLOG(Server->Log("Read for hash finalize at block_start="+nconvert(chunk_start)+" n="+nconvert(r), LL_DEBUG));
-					if(r==0)
-					{
-						Server->Log("Read error in hash finalization at position "+nconvert(chunk_start)+" toread="+nconvert(toread)+" read="+nconvert(r)+". This will cause the whole block to be loaded.", LL_WARNING);
-						file_pos+=dest_pos-chunk_start;
-						chunk_start=dest_pos;
-						break;
-					}
-					file_pos+=r;
-					chunk_start+=r;
-					md5_hash.update((unsigned char*)buf2, (unsigned int)r);
+					Server->Log("Read error in hash finalization at position "+nconvert(chunk_start)+" toread="+nconvert(toread)+" read="+nconvert(r)+". This will cause the whole block to be loaded.", LL_WARNING);
+					file_pos+=dest_pos-chunk_start;
+					chunk_start=dest_pos;
+					break;
 				}
-			}
-			else
-			{
-				Server->Log("Error seeking in base file (to position "+nconvert(chunk_start)+"). Whole block will be loaded. (2)", LL_WARNING);
-				file_pos+=dest_pos-chunk_start;
-				chunk_start=dest_pos;
+				file_pos+=r;
+				chunk_start+=r;
+				md5_hash.update((unsigned char*)buf2, (unsigned int)r);
 			}
 		}
 
@@ -866,8 +848,8 @@ void FileClientChunked::Hash_finalize(_i64 curr_pos, const char *hash_from_clien
 	}
 	else
 	{
-		m_hashoutput->Seek(chunkhash_file_off+(curr_pos/c_checkpoint_dist)*chunkhash_single_size);
-		writeFileRepeat(m_hashoutput, hash_from_client, big_hash_size);
+		writeFileRepeat(m_hashoutput, chunkhash_file_off+(curr_pos/c_checkpoint_dist)*chunkhash_single_size,
+			hash_from_client, big_hash_size);
 
 		curr_output_fsize = (std::max)(curr_output_fsize, curr_pos+c_checkpoint_dist);
 
@@ -895,8 +877,8 @@ void FileClientChunked::Hash_nochange(_i64 curr_pos)
 	{
 		Server->Log("Block without change. currpos="+nconvert(curr_pos), LL_DEBUG);
 		addReceivedBlock(curr_pos);
-		m_hashoutput->Seek(chunkhash_file_off+(curr_pos/c_checkpoint_dist)*chunkhash_single_size);
-		writeFileRepeat(m_hashoutput, it->second.big_hash, chunkhash_single_size);
+		writeFileRepeat(m_hashoutput, chunkhash_file_off+(curr_pos/c_checkpoint_dist)*chunkhash_single_size,
+			it->second.big_hash, chunkhash_single_size);
 		curr_output_fsize = (std::max)(curr_output_fsize, curr_pos+c_checkpoint_dist);
 		pending_chunks.erase(it);
 		decrQueuedChunks();
@@ -920,7 +902,7 @@ void FileClientChunked::State_Block(void)
 	md5_hash.update((unsigned char*)bufptr, (unsigned int)rbytes);
 	if(!patch_mode)
 	{
-		writeFileRepeat(m_file, bufptr, rbytes);
+		writeFileRepeat(m_file, file_pos, bufptr, rbytes);
 		file_pos+=rbytes;
 	}
 	else
@@ -944,7 +926,8 @@ void FileClientChunked::State_Block(void)
 		if(adler_remaining==0 || whole_block_remaining==0)
 		{
 			_u32 endian_adler_hash = little_endian(adler_hash);
-			writeFileRepeat(m_hashoutput, (char*)&endian_adler_hash, small_hash_size);
+			writeFileRepeat(m_hashoutput, hashoutput_pos, (char*)&endian_adler_hash, small_hash_size);
+			hashoutput_pos+=small_hash_size;
 			adler_hash=urb_adler32(0, NULL, 0);
 			adler_remaining=c_chunk_size;
 		}
@@ -956,21 +939,21 @@ void FileClientChunked::State_Block(void)
 	{
 		md5_hash.finalize();
 		hash_for_whole_block=true;
-		m_hashoutput->Seek(chunkhash_file_off+(block_for_chunk_start/c_checkpoint_dist)*chunkhash_single_size);
-		writeFileRepeat(m_hashoutput, (char*)md5_hash.raw_digest_int(), big_hash_size);
+		writeFileRepeat(m_hashoutput, chunkhash_file_off+(block_for_chunk_start/c_checkpoint_dist)*chunkhash_single_size,
+			(char*)md5_hash.raw_digest_int(), big_hash_size);
 
 		state=CS_ID_FIRST;
 	}
 }
 
-void FileClientChunked::writeFileRepeat(IFile *f, const char *buf, size_t bsize)
+void FileClientChunked::writeFileRepeat(IFile *f, _i64 pos, const char *buf, size_t bsize)
 {
 	_u32 written=0;
 	_u32 rc;
 	int tries=50;
 	do
 	{
-		rc=f->Write(buf+written, (_u32)(bsize-written));
+		rc=f->WriteAt(pos+written, buf+written, (_u32)(bsize-written));
 		written+=rc;
 		if(rc==0)
 		{
@@ -1005,7 +988,7 @@ void FileClientChunked::State_Chunk(void)
 
 		if(!patch_mode)
 		{
-			writeFileRepeat(m_file, bufptr, rbytes);
+			writeFileRepeat(m_file, file_pos, bufptr, rbytes);
 			file_pos+=rbytes;
 		}
 		else
@@ -1023,7 +1006,8 @@ void FileClientChunked::State_Chunk(void)
 	if(adler_remaining==0)
 	{
 		_u32 endian_adler_hash = little_endian(adler_hash);
-		writeFileRepeat(m_hashoutput, (char*)&endian_adler_hash, small_hash_size);
+		writeFileRepeat(m_hashoutput, hashoutput_pos, (char*)&endian_adler_hash, small_hash_size);
+		hashoutput_pos+=small_hash_size;
 		state=CS_ID_FIRST;
 	}
 }
@@ -1080,25 +1064,20 @@ void FileClientChunked::writePatchInt(_i64 pos, unsigned int length, char *buf)
 	memcpy(pd, &pos_tmp, sizeof(_i64));
 	unsigned int length_tmp = little_endian(length);
 	memcpy(pd+sizeof(_i64), &length_tmp, sizeof(unsigned int));
-	writeFileRepeat(m_patchfile, pd, plen);
-	writeFileRepeat(m_patchfile, buf, length);
+	writeFileRepeat(m_patchfile, patchfile_pos, pd, plen);
+	writeFileRepeat(m_patchfile, patchfile_pos+plen, buf, length);
 	last_chunk_patches.push_back(patchfile_pos);
 	patchfile_pos+=plen+length;
 }
 
 void FileClientChunked::writePatchSize(_i64 remote_fs)
 {
-	m_patchfile->Seek(0);
 	_i64 remote_fs_tmp=little_endian(remote_fs);
-	writeFileRepeat(m_patchfile, (char*)&remote_fs_tmp, sizeof(_i64));
+	writeFileRepeat(m_patchfile, 0, (char*)&remote_fs_tmp, sizeof(_i64));
 	if(patchfile_pos==0)
 	{
 		patchfile_pos=sizeof(_i64);
 	}
-	else
-	{
-		m_patchfile->Seek(patchfile_pos);
-	}
 }
 
 bool FileClientChunked::hasError(void)
@@ -1113,10 +1092,8 @@ void FileClientChunked::invalidateLastPatches(void)
 		_i64 invalid_pos=little_endian(-1);
 		for(size_t i=0;i<last_chunk_patches.size();++i)
 		{
-			m_patchfile->Seek(last_chunk_patches[i]);
-			writeFileRepeat(m_patchfile, (char*)&invalid_pos, sizeof(_i64));
+			writeFileRepeat(m_patchfile, last_chunk_patches[i], (char*)&invalid_pos, sizeof(_i64));
 		}
-		m_patchfile->Seek(patchfile_pos);
 		patch_buf_pos=0;
 	}
 	last_chunk_patches.clear();	
@@ -1179,8 +1156,7 @@ bool FileClientChunked::Reconnect(bool rerequest)
 			_i64 fileoffset=0;
 
 			_i64 hashfilesize=0;
-			m_chunkhashes->Seek(0);
-			if(m_chunkhashes->Read((char*)&hashfilesize, sizeof(_i64))!=sizeof(_i64) )
+			if(m_chunkhashes->ReadAt(0, (char*)&hashfilesize, sizeof(_i64))!=sizeof(_i64) )
 				return false;
 
 			hashfilesize = little_endian(hashfilesize);
@@ -1574,6 +1550,7 @@ void FileClientChunked::addReceivedBytes( size_t bytes )
 	{
 		IScopedLock lock(mutex);
 		received_data_bytes += bytes;
+		received_bytes_metric.add(bytes);
 	}
 }
 
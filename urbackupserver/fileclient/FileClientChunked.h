@@ -81,7 +81,7 @@ public:
 	void setProgressLogCallback(FileClient::ProgressLogCallback* cb);
 
 private:
-	FileClientChunked(const FileClientChunked& other) {};
+	FileClientChunked(const FileClientChunked& other) : received_bytes_metric(other.received_bytes_metric) {};
 	void operator=(const FileClientChunked& other) {}
 
 	void setQueueOnly(bool b);
@@ -101,7 +101,7 @@ private:
 	void Hash_upto(_i64 chunk_start, bool &new_block);
 	void Hash_nochange(_i64 curr_pos);
 
-	void writeFileRepeat(IFile *f, const char *buf, size_t bsize);
+	void writeFileRepeat(IFile *f, _i64 pos, const char *buf, size_t bsize);
 	void writePatch(_i64 pos, unsigned int length, char *buf, bool last);
 	void writePatchInt(_i64 pos, unsigned int length, char *buf);
 	void writePatchSize(_i64 remote_fs);
@@ -150,6 +150,7 @@ private:
 	_i64 patchfile_pos;
 	IFile *m_chunkhashes;
 	IFile *m_hashoutput;
+	_i64 hashoutput_pos;
 	IPipe *pipe;
 	CTCPStack *stack;
 
@@ -211,6 +212,7 @@ private:
 	std::string identity;
 
 	_i64 received_data_bytes;
+	LocalMetricsCounter received_bytes_metric;
 
 	IMutex* mutex;
 
@@ -26,6 +26,7 @@
 #include "database.h"
 #include "../Interface/SettingsReader.h"
 #include "server_status.h"
+#include "server_metrics.h"
 #include "../stringtools.h"
 #include "../urbackupcommon/os_functions.h"
 #include "InternetServiceConnector.h"
@@ -481,9 +482,7 @@ IPipeThrottler *BackupServer::getGlobalInternetThrottler(size_t speed_bps)
 {
 	IScopedLock lock(throttle_mutex);
 
-	if(global_internet_throttler==NULL && speed_bps==0 )
-		return NULL;
-
+	//Always created, as it is the parent of the client throttlers
 	if(global_internet_throttler==NULL)
 	{
 		global_internet_throttler=Server->createPipeThrottler(speed_bps);
@@ -499,9 +498,7 @@ IPipeThrottler *BackupServer::getGlobalLocalThrottler(size_t speed_bps)
 {
 	IScopedLock lock(throttle_mutex);
 
-	if(global_local_throttler==NULL && speed_bps==0 )
-		return NULL;
-
+	//Always created, as it is the parent of the client throttlers
 	if(global_local_throttler==NULL)
 	{
 		global_local_throttler=Server->createPipeThrottler(speed_bps);
@@ -515,14 +512,13 @@ IPipeThrottler *BackupServer::getGlobalLocalThrottler(size_t speed_bps)
 
 void BackupServer::cleanupThrottlers(void)
 {
-	if(global_internet_throttler!=NULL)
-	{
-		Server->destroy(global_internet_throttler);
-	}
-	if(global_local_throttler!=NULL)
-	{
-		Server->destroy(global_local_throttler);
-	}
+	IScopedLock lock(throttle_mutex);
+
+	//Client throttlers still reference them, so they are only freed with the last client throttler
+	Server->destroy(global_internet_throttler);
+	global_internet_throttler=NULL;
+	Server->destroy(global_local_throttler);
+	global_local_throttler=NULL;
 }
 
 bool BackupServer::isSnapshotsEnabled(void)
@@ -571,7 +567,7 @@ void BackupServer::testSnapshotAvailability(IDatabase *db)
 				db->BeginWriteTransaction();
 				db->Write("DELETE FROM settings_db.settings WHERE key='cow_mode' AND clientid=0");
 				db->Write("INSERT INTO settings_db.settings (key, value, clientid) VALUES ('cow_mode', 'false', 0)");
-				db->EndTransaction();
+				timedEndTransaction(db, "settings");
 				snapshots_enabled=false;
 			}
 		}
@@ -582,7 +578,7 @@ void BackupServer::testSnapshotAvailability(IDatabase *db)
 		db->BeginWriteTransaction();
 		db->Write("DELETE FROM settings_db.settings WHERE key='cow_mode' AND clientid=0");
 		db->Write("INSERT INTO settings_db.settings (key, value, clientid) VALUES ('cow_mode', 'true', 0)");
-		db->EndTransaction();
+		timedEndTransaction(db, "settings");
 	}
 
 	if(snapshots_enabled)
@@ -23,10 +23,9 @@
 #include "../Interface/Query.h"
 #include "database.h"
 #include "server_get.h"
+#include "server_image_restore.h"
 #include "../stringtools.h"
 #include "../urbackupcommon/os_functions.h"
-#include "../fsimageplugin/IFSImageFactory.h"
-#include "../fsimageplugin/IVHDFile.h"
 #include "server_status.h"
 #include "server_settings.h"
 #include "../urbackupcommon/capa_bits.h"
@@ -35,9 +34,10 @@
 #include <memory.h>
 #include <algorithm>
 #include <limits.h>
+#include <vector>
+#include <memory>
 
 const unsigned short serviceport=35623;
-extern IFSImageFactory *image_fak;
 
 namespace
 {
@@ -149,7 +149,7 @@ void ServerChannelThread::operator()(void)
 				}
 				else
 				{
-					tcpstack.Send(input, identity+"1CHANNEL capa="+nconvert(constructCapabilities()));
+					tcpstack.Send(input, identity+"1CHANNEL capa="+nconvert(constructCapabilities())+"&restore_delta=1");
 				}
 				lasttime=Server->getTimeMS();
 				lastpingtime=lasttime;
@@ -533,10 +533,69 @@ void ServerChannelThread::GET_BACKUPIMAGES(const std::wstring& clientname)
 	ServerStatus::updateActive();
 }
 
+IFile* ServerChannelThread::receiveRestoreHashes(int64 hashsize)
+{
+	IFile* ret=Server->openTemporaryFile();
+	if(ret==NULL)
+	{
+		return NULL;
+	}
+
+	int64 received=0;
+	while(received<hashsize)
+	{
+		size_t packetsize;
+		char *pck=tcpstack.getPacket(&packetsize);
+		if(pck!=NULL)
+		{
+			bool ok = packetsize>0 && ret->Write(pck, (_u32)packetsize)==packetsize;
+			delete [] pck;
+			if(!ok)
+			{
+				break;
+			}
+			received+=packetsize;
+			continue;
+		}
+
+		std::string data;
+		if(input->Read(&data, 60000)==0)
+		{
+			break;
+		}
+		tcpstack.AddData(&data[0], data.size());
+	}
+
+	if(received!=hashsize)
+	{
+		std::wstring tmpfn=ret->getFilenameW();
+		Server->destroy(ret);
+		Server->deleteFile(tmpfn);
+		return NULL;
+	}
+
+	lasttime=Server->getTimeMS();
+	return ret;
+}
+
 void ServerChannelThread::DOWNLOAD_IMAGE(str_map& params)
 {
 	int img_id=watoi(params[L"img_id"])-img_id_offset;
 
+	IFile* client_hashes=NULL;
+	ScopedDeleteFile client_hashes_delete(NULL);
+	str_map::iterator it_hashsize=params.find(L"delta_hashsize");
+	if(it_hashsize!=params.end())
+	{
+		client_hashes=receiveRestoreHashes(os_atoi64(wnarrow(it_hashsize->second)));
+		if(client_hashes==NULL)
+		{
+			Server->Log("Error receiving block hashes for delta restore", LL_ERROR);
+			return;
+		}
+		client_hashes_delete.reset(client_hashes);
+	}
+
 	IDatabase *db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER);
 	IQuery *q=db->Prepare("SELECT path, version, clientid FROM backup_images WHERE id=? AND strftime('%s', backuptime)=?");
 	q->Bind(img_id);
@@ -607,97 +666,14 @@ void ServerChannelThread::DOWNLOAD_IMAGE(str_map& params)
 
 		lasttime=Server->getTimeMS();
 
-		IVHDFile *vhdfile=image_fak->createVHDFile(res[0][L"path"], true, 0);
-		if(!vhdfile->isOpen())
+		SImageRestoreStats stats;
+		if(!send_restore_image(input, res[0][L"path"], img_version, offset, client_hashes, lasttime, stats))
 		{
-			_i64 r=-1;
-			input->Write((char*)&r, sizeof(_i64));
-		}
-		else
-		{
-			int skip=1024*512;
-
-			if(img_version==0)
-				skip=512*512;
-
-			_i64 r=little_endian((_i64)vhdfile->getSize()-skip);
-			input->Write((char*)&r, sizeof(_i64));
-			unsigned int blocksize=vhdfile->getBlocksize();
-			char buffer[4096];
-			size_t read;
-			uint64 currpos=offset;
-			_i64 currblock=(currpos+skip)%blocksize;
-
-			vhdfile->Seek(skip);
-			/*vhdfile->Read(buffer, 512, read);
-			if(read!=512)
-			{
-				Server->Log("Error: Could not read 512 bytes", LL_ERROR);
-				image_fak->destroyVHDFile(vhdfile);
-				db->destroyAllQueries();
-				return "";
-			}
-
-			input->Write(buffer, (_u32)read);*/
-
-			int64 last_update_time=Server->getTimeMS();
-
-			bool is_ok=true;
-			do
-			{
-				if(vhdfile->has_sector())
-				{
-					is_ok=vhdfile->Read(buffer, 4096, read);
-					if(read<4096)
-					{
-						Server->Log("Padding zero bytes...", LL_WARNING);
-						memset(&buffer[read], 0, 4096-read);
-						read=4096;
-					}
-						
-					uint64 currpos_endian = little_endian(currpos);
-					input->Write((char*)&currpos_endian, sizeof(uint64));
-					bool b=input->Write(buffer, (_u32)read);
-					if(!b)
-					{
-						Server->Log("Writing to output pipe failed processMsg-1", LL_ERROR);
-						image_fak->destroyVHDFile(vhdfile);
-						db->destroyAllQueries();
-						Server->destroy(input);
-						input=NULL;
-						return;
-					}
-					lasttime=Server->getTimeMS();
-				}
-				else
-				{
-					if(Server->getTimeMS()-lasttime>30000)
-					{
-						uint64 currpos_endian = little_endian(currpos);
-						input->Write((char*)&currpos_endian, sizeof(uint64));
-						memset(buffer, 0, 4096);
-						input->Write(buffer, (_u32)4096);
-						lasttime=Server->getTimeMS();
-					}
-					read=4096;
-					vhdfile->Seek(skip+currpos+4096);
-				}					
-				currpos+=read;
-
-				if(Server->getTimeMS()-last_update_time>60000)
-				{
-					last_update_time=Server->getTimeMS();
-					ServerStatus::updateActive();
-				}
-			}
-			while( is_ok && (_i64)currpos<r );
-			if((_i64)currpos>=r)
-			{
-				uint64 currpos_endian = little_endian(currpos);
-				input->Write((char*)&currpos_endian, sizeof(uint64));
-			}
+			db->destroyAllQueries();
+			Server->destroy(input);
+			input=NULL;
+			return;
 		}
-		image_fak->destroyVHDFile(vhdfile);
 	}
 	db->destroyAllQueries();
 }
@@ -5,6 +5,7 @@
 #include "../urbackupcommon/fileclient/tcpstack.h"
 
 class BackupServerGet;
+class IFile;
 
 class ServerSettings;
 namespace {
@@ -38,6 +39,8 @@ private:
 	void GET_BACKUPIMAGES(const std::wstring& clientname);
 	void DOWNLOAD_IMAGE(str_map& params);
 
+	IFile* receiveRestoreHashes(int64 hashsize);
+
 	BackupServerGet *server_get;
 	IPipe *exitpipe;
 	IPipe *input;
@@ -30,6 +30,7 @@
 #include "server_update_stats.h"
 #include "server_update.h"
 #include "server_status.h"
+#include "server_metrics.h"
 #include "server_get.h"
 #include "server.h"
 #include "snapshot_helper.h"
@@ -507,6 +508,7 @@ void ServerCleanupThread::do_remove_unknown(void)
 					{
 						Server->Log(L"Could not delete file \""+rm_file+L".hash\"", LL_ERROR);
 					}
+					Server->deleteFile(rm_file+L".chainmap");
 				}
 			}
 		}
@@ -566,6 +568,7 @@ bool ServerCleanupThread::deleteImage(std::wstring path)
 	{
 		b=false;
 	}
+	Server->deleteFile(os_file_prefix(path+L".chainmap"));
 	return b;
 }
 
@@ -760,6 +763,12 @@ bool ServerCleanupThread::removeImage(int backupid, ServerSettings* settings,
 		std::vector<int> assoc=cleanupdao->getAssocImageBackups(backupid);
 		for(size_t i=0;i<assoc.size();++i)
 		{
+			if(cleanupdao->getOtherParentImageBackup(assoc[i], backupid).exists)
+			{
+				//SYSVOL image is shared with a synthetic full image
+				continue;
+			}
+
 			int64 is=getImageSize(assoc[i]);
 			if(is>0) deleted_size_bytes+=is;
 			removeImage(assoc[i], settings, false, force_remove, remove_associated, remove_references);
@@ -785,7 +794,7 @@ bool ServerCleanupThread::removeImage(int backupid, ServerSettings* settings,
 			db->BeginWriteTransaction();
 			cleanupdao->removeImage(backupid);
 			cleanupdao->removeImageSize(backupid);
-			db->EndTransaction();
+			timedEndTransaction(db, "cleanup");
 		}
 		else
 		{
@@ -1197,6 +1206,9 @@ void ServerCleanupThread::removeClient(int clientid)
 	q=db->Prepare("DELETE FROM clients_hist WHERE id=?", false);
 	q->Bind(clientid); q->Write(); q->Reset();
 	db->destroyQuery(q);
+	q=db->Prepare("DELETE FROM clients_usage_agg WHERE clientid=?", false);
+	q->Bind(clientid); q->Write(); q->Reset();
+	db->destroyQuery(q);
 
 	//settings
 	q=db->Prepare("DELETE FROM settings_db.settings WHERE clientid=?", false);
@@ -1739,6 +1751,9 @@ void ServerCleanupThread::cleanup_client_hist()
 	rewrite_history(L"-2 month", L"-2 years", L"%Y-%m");
 	Server->Log("Rewriting yearly history...", LL_INFO);
 	rewrite_history(L"-2 years", L"-1000 years", L"%Y");
+	Server->Log("Deleting old usage aggregates...", LL_INFO);
+	cleanupdao->deleteUsageAggregates(L"d", L"-2 month");
+	cleanupdao->deleteUsageAggregates(L"m", L"-2 years");
 }
 
 void ServerCleanupThread::cleanup_other()
@@ -0,0 +1,595 @@
+#include "server_dedup_filter.h"
+#include "server_metrics.h"
+#include "../Interface/Server.h"
+#include "../Interface/Database.h"
+#include "../Interface/Query.h"
+#include "../Interface/File.h"
+#include "../stringtools.h"
+#include "../urbackupcommon/os_functions.h"
+#include "database.h"
+#include <memory.h>
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+	const char* filter_fn="urbackup/cache/dedup_filter.bloom";
+	const char filter_magic[]="UBBLOOM1";
+	const unsigned int filter_version=1;
+	const unsigned int block_words=8;
+	const int64 min_capacity=1000000;
+	const size_t scan_batch_rows=10000;
+
+	struct SFilterHeader
+	{
+		char magic[8];
+		_u32 version;
+		_u32 k;
+		uint64 nblocks;
+		int64 capacity;
+		int64 entries;
+		int64 fpr_ppm;
+		int64 files_rowid;
+	};
+
+	uint64 mix64(uint64 h)
+	{
+		h^=h>>33;
+		h*=0xff51afd7ed558ccdULL;
+		h^=h>>33;
+		h*=0xc4ceb9fe1a85ec53ULL;
+		h^=h>>33;
+		return h;
+	}
+
+	void key_hashes(const std::string& shahash, int64 filesize, uint64& h1, uint64& h2)
+	{
+		char buf[16]={};
+		memcpy(buf, shahash.data(), (std::min)(shahash.size(), sizeof(buf)));
+		memcpy(&h1, buf, sizeof(h1));
+		memcpy(&h2, buf+sizeof(h1), sizeof(h2));
+		h1=mix64(h1^static_cast<uint64>(filesize));
+		h2=mix64(h2+static_cast<uint64>(filesize));
+	}
+
+	int64 fpr_ppm(double fpr)
+	{
+		return static_cast<int64>(fpr*1000000+0.5);
+	}
+}
+
+DedupBloomFilter::DedupBloomFilter(int64 capacity, double fpr)
+{
+	init(capacity, fpr);
+}
+
+DedupBloomFilter::DedupBloomFilter(void)
+	: nblocks(0), k(0), capacity(0), entries(0), fpr(0)
+{
+}
+
+void DedupBloomFilter::init(int64 pCapacity, double pFpr)
+{
+	if(pFpr<=0 || pFpr>=1)
+	{
+		pFpr=0.01;
+	}
+	if(pCapacity<1)
+	{
+		pCapacity=1;
+	}
+
+	capacity=pCapacity;
+	fpr=pFpr;
+	entries=0;
+
+	const double ln2=0.6931471805599453;
+	double bits_per_entry=-log(fpr)/(ln2*ln2);
+	k=static_cast<unsigned int>(bits_per_entry*ln2+0.5);
+	k=(std::max)(1u, (std::min)(16u, k));
+
+	//Keys are not spread evenly over the blocks. A tenth more bits keeps
+	//the false positive rate close to the one of a standard Bloom filter
+	uint64 nbits=static_cast<uint64>(capacity*bits_per_entry*1.1)+1;
+	nblocks=(nbits+block_words*64-1)/(block_words*64);
+	bits.assign(nblocks*block_words, 0);
+}
+
+void DedupBloomFilter::add(const std::string& shahash, int64 filesize)
+{
+	uint64 h1, h2;
+	key_hashes(shahash, filesize, h1, h2);
+
+	uint64* block=&bits[(h1%nblocks)*block_words];
+	for(unsigned int i=0;i<k;++i)
+	{
+		if(i>0 && i%7==0)
+		{
+			h2=mix64(h2+i);
+		}
+		unsigned int b=static_cast<unsigned int>(h2&511);
+		h2>>=9;
+		block[b>>6]|=1ULL<<(b&63);
+	}
+	++entries;
+}
+
+bool DedupBloomFilter::mightContain(const std::string& shahash, int64 filesize) const
+{
+	uint64 h1, h2;
+	key_hashes(shahash, filesize, h1, h2);
+
+	const uint64* block=&bits[(h1%nblocks)*block_words];
+	for(unsigned int i=0;i<k;++i)
+	{
+		if(i>0 && i%7==0)
+		{
+			h2=mix64(h2+i);
+		}
+		unsigned int b=static_cast<unsigned int>(h2&511);
+		h2>>=9;
+		if((block[b>>6] & (1ULL<<(b&63)))==0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int64 DedupBloomFilter::getCapacity(void) const
+{
+	return capacity;
+}
+
+int64 DedupBloomFilter::getEntries(void) const
+{
+	return entries;
+}
+
+int64 DedupBloomFilter::getBytes(void) const
+{
+	return static_cast<int64>(bits.size()*sizeof(uint64));
+}
+
+double DedupBloomFilter::getFpr(void) const
+{
+	return fpr;
+}
+
+bool DedupBloomFilter::write(IFile* file, int64 files_rowid) const
+{
+	SFilterHeader header;
+	memcpy(header.magic, filter_magic, sizeof(header.magic));
+	header.version=filter_version;
+	header.k=k;
+	header.nblocks=nblocks;
+	header.capacity=capacity;
+	header.entries=entries;
+	header.fpr_ppm=fpr_ppm(fpr);
+	header.files_rowid=files_rowid;
+
+	if(file->Write(reinterpret_cast<const char*>(&header), sizeof(header))!=sizeof(header))
+	{
+		return false;
+	}
+
+	const char* data=reinterpret_cast<const char*>(&bits[0]);
+	size_t size=bits.size()*sizeof(uint64);
+	const size_t chunk_size=1024*1024;
+	for(size_t pos=0;pos<size;pos+=chunk_size)
+	{
+		_u32 towrite=static_cast<_u32>((std::min)(chunk_size, size-pos));
+		if(file->Write(data+pos, towrite)!=towrite)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+DedupBloomFilter* DedupBloomFilter::read(IFile* file, int64& files_rowid)
+{
+	SFilterHeader header;
+	if(file->Read(reinterpret_cast<char*>(&header), sizeof(header))!=sizeof(header)
+		|| memcmp(header.magic, filter_magic, sizeof(header.magic))!=0
+		|| header.version!=filter_version
+		|| header.k<1 || header.k>16
+		|| header.nblocks<1
+		|| file->Size()!=static_cast<_i64>(sizeof(header)+header.nblocks*block_words*sizeof(uint64)) )
+	{
+		return NULL;
+	}
+
+	DedupBloomFilter* ret=new DedupBloomFilter;
+	ret->k=header.k;
+	ret->nblocks=header.nblocks;
+	ret->capacity=header.capacity;
+	ret->entries=header.entries;
+	ret->fpr=header.fpr_ppm/1000000.0;
+	ret->bits.resize(header.nblocks*block_words);
+
+	char* data=reinterpret_cast<char*>(&ret->bits[0]);
+	size_t size=ret->bits.size()*sizeof(uint64);
+	const size_t chunk_size=1024*1024;
+	for(size_t pos=0;pos<size;pos+=chunk_size)
+	{
+		_u32 toread=static_cast<_u32>((std::min)(chunk_size, size-pos));
+		if(file->Read(data+pos, toread)!=toread)
+		{
+			delete ret;
+			return NULL;
+		}
+	}
+
+	files_rowid=header.files_rowid;
+	return ret;
+}
+
+IMutex* ServerDedupFilter::mutex=NULL;
+DedupBloomFilter* ServerDedupFilter::filter=NULL;
+DedupBloomFilter* ServerDedupFilter::grow_filter=NULL;
+std::vector<DedupBloomFilter*> ServerDedupFilter::prev_filters;
+bool ServerDedupFilter::ready=false;
+bool ServerDedupFilter::do_quit=false;
+THREADPOOL_TICKET ServerDedupFilter::thread_ticket=ILLEGAL_THREADPOOL_TICKET;
+THREADPOOL_TICKET ServerDedupFilter::grow_ticket=ILLEGAL_THREADPOOL_TICKET;
+int64 ServerDedupFilter::lookups=0;
+int64 ServerDedupFilter::negatives=0;
+int64 ServerDedupFilter::false_positives=0;
+LocalMetricsCounter* ServerDedupFilter::positive_metric=NULL;
+LocalMetricsCounter* ServerDedupFilter::negative_metric=NULL;
+
+ServerDedupFilter::ServerDedupFilter(int64 files_rowid, DedupBloomFilter* target)
+	: files_rowid(files_rowid), target(target)
+{
+}
+
+void ServerDedupFilter::initMutex(void)
+{
+	mutex=Server->createMutex();
+	positive_metric=new LocalMetricsCounter("urbackup_dedup_filter_lookups_total{result=\"positive\"}");
+	negative_metric=new LocalMetricsCounter("urbackup_dedup_filter_lookups_total{result=\"negative\"}");
+}
+
+void ServerDedupFilter::destroyMutex(void)
+{
+	delete positive_metric;
+	positive_metric=NULL;
+	delete negative_metric;
+	negative_metric=NULL;
+	Server->destroy(mutex);
+	mutex=NULL;
+}
+
+int64 ServerDedupFilter::maxRowid(IDatabase* db, const std::string& table)
+{
+	db_results res=db->Read("SELECT MAX(rowid) AS m FROM "+table);
+	if(!res.empty() && !res[0][L"m"].empty())
+	{
+		return watoi64(res[0][L"m"]);
+	}
+	return 0;
+}
+
+void ServerDedupFilter::init(void)
+{
+	if(Server->getServerParameter("dedup_filter", "true")!="true")
+	{
+		Server->deleteFile(filter_fn);
+		return;
+	}
+
+	double fpr=atof(Server->getServerParameter("dedup_filter_fpr", "0.01").c_str());
+	if(fpr<=0 || fpr>=1)
+	{
+		fpr=0.01;
+	}
+
+	IDatabase* db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER);
+	int64 curr_files_rowid=maxRowid(db, "files");
+	int64 min_entries=curr_files_rowid+maxRowid(db, "files_new");
+
+	int64 scan_from=0;
+	IFile* file=Server->openFile(filter_fn, MODE_READ);
+	if(file!=NULL)
+	{
+		int64 saved_files_rowid;
+		DedupBloomFilter* loaded=DedupBloomFilter::read(file, saved_files_rowid);
+		Server->destroy(file);
+
+		if(loaded==NULL)
+		{
+			Server->Log("Deduplication filter file is damaged. Rebuilding it...", LL_WARNING);
+		}
+		else if(fpr_ppm(loaded->getFpr())!=fpr_ppm(fpr))
+		{
+			Server->Log("Deduplication filter false positive rate changed. Rebuilding filter...", LL_INFO);
+		}
+		else if(saved_files_rowid>curr_files_rowid)
+		{
+			Server->Log("Deduplication filter is newer than the files table. Rebuilding filter...", LL_WARNING);
+		}
+		else if(loaded->getEntries()>loaded->getCapacity()
+			|| min_entries>loaded->getCapacity())
+		{
+			Server->Log("Deduplication filter is full. Rebuilding it with a larger capacity...", LL_INFO);
+		}
+		else
+		{
+			filter=loaded;
+			scan_from=saved_files_rowid;
+		}
+
+		if(filter==NULL)
+		{
+			delete loaded;
+		}
+	}
+
+	//Written again at clean shutdown. Entries added while the server runs
+	//would be missing after a crash otherwise
+	Server->deleteFile(filter_fn);
+
+	if(filter==NULL)
+	{
+		filter=new DedupBloomFilter((std::max)(min_capacity, min_entries/2*3), fpr);
+	}
+
+	updateMetrics();
+
+	thread_ticket=Server->getThreadPool()->execute(new ServerDedupFilter(scan_from, filter));
+}
+
+void ServerDedupFilter::shutdown(void)
+{
+	{
+		IScopedLock lock(mutex);
+		if(filter==NULL)
+		{
+			return;
+		}
+		do_quit=true;
+	}
+
+	Server->getThreadPool()->waitFor(thread_ticket);
+
+	THREADPOOL_TICKET curr_grow_ticket;
+	{
+		IScopedLock lock(mutex);
+		curr_grow_ticket=grow_ticket;
+	}
+
+	if(curr_grow_ticket!=ILLEGAL_THREADPOOL_TICKET)
+	{
+		Server->getThreadPool()->waitFor(curr_grow_ticket);
+	}
+
+	IScopedLock lock(mutex);
+
+	Server->Log("Deduplication filter: "+nconvert(lookups)+" lookups, "+nconvert(negatives)+" negative, "
+		+nconvert(false_positives)+" false positives", LL_INFO);
+
+	positive_metric->publish();
+	negative_metric->publish();
+
+	if(ready && !prev_filters.empty())
+	{
+		Server->Log("Deduplication filter was rebuilt while running. It will be rebuilt at next start.", LL_INFO);
+	}
+	else if(ready)
+	{
+		IDatabase* db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER);
+		int64 curr_files_rowid=maxRowid(db, "files");
+
+		std::string tmp_fn=std::string(filter_fn)+".new";
+		IFile* file=Server->openFile(tmp_fn, MODE_WRITE);
+		bool ok=false;
+		if(file!=NULL)
+		{
+			ok=filter->write(file, curr_files_rowid);
+			Server->destroy(file);
+		}
+
+		if(!ok || !os_rename_file(Server->ConvertToUnicode(tmp_fn), Server->ConvertToUnicode(filter_fn)))
+		{
+			Server->Log("Error saving deduplication filter. It will be rebuilt at next start.", LL_WARNING);
+			Server->deleteFile(tmp_fn);
+		}
+	}
+
+	delete filter;
+	filter=NULL;
+	for(size_t i=0;i<prev_filters.size();++i)
+	{
+		delete prev_filters[i];
+	}
+	prev_filters.clear();
+	ready=false;
+}
+
+void ServerDedupFilter::add(const std::string& shahash, int64 filesize)
+{
+	IScopedLock lock(mutex);
+	if(filter!=NULL)
+	{
+		filter->add(shahash, filesize);
+
+		if(grow_filter!=NULL)
+		{
+			grow_filter->add(shahash, filesize);
+		}
+		else
+		{
+			growIfFull();
+		}
+	}
+}
+
+bool ServerDedupFilter::mightContain(const std::string& shahash, int64 filesize)
+{
+	bool ret;
+	{
+		IScopedLock lock(mutex);
+		if(filter==NULL || !ready)
+		{
+			return true;
+		}
+
+		ret=filter->mightContain(shahash, filesize);
+
+		for(size_t i=0;!ret && i<prev_filters.size();++i)
+		{
+			ret=prev_filters[i]->mightContain(shahash, filesize);
+		}
+
+		++lookups;
+		if(!ret)
+		{
+			++negatives;
+			negative_metric->add(1);
+		}
+		else
+		{
+			positive_metric->add(1);
+		}
+	}
+
+	return ret;
+}
+
+void ServerDedupFilter::addFalsePositive(void)
+{
+	{
+		IScopedLock lock(mutex);
+		if(filter==NULL || !ready)
+		{
+			return;
+		}
+		++false_positives;
+	}
+
+	ServerMetrics::addCounter("urbackup_dedup_filter_false_positives_total");
+}
+
+void ServerDedupFilter::updateMetrics(void)
+{
+	ServerMetrics::setGauge("urbackup_dedup_filter_entries", filter->getEntries());
+	ServerMetrics::setGauge("urbackup_dedup_filter_capacity", filter->getCapacity());
+	int64 bytes=filter->getBytes();
+	for(size_t i=0;i<prev_filters.size();++i)
+	{
+		bytes+=prev_filters[i]->getBytes();
+	}
+	ServerMetrics::setGauge("urbackup_dedup_filter_bytes", bytes);
+}
+
+void ServerDedupFilter::growIfFull(void)
+{
+	if(!ready || do_quit || grow_filter!=NULL
+		|| filter->getEntries()<=filter->getCapacity())
+	{
+		return;
+	}
+
+	Server->Log("Deduplication filter is full ("+nconvert(filter->getEntries())+" entries, capacity "
+		+nconvert(filter->getCapacity())+"). Rebuilding it with a larger capacity in the background...", LL_INFO);
+
+	//Entries added from now on go into both filters. Lookups use the full
+	//filter, with a higher false positive rate, until the rebuild is done
+	grow_filter=new DedupBloomFilter((std::max)(min_capacity, filter->getEntries()*2), filter->getFpr());
+	grow_ticket=Server->getThreadPool()->execute(new ServerDedupFilter(0, grow_filter));
+}
+
+bool ServerDedupFilter::addRows(IDatabase* db, const std::string& table, int64 from_rowid, int64& nrows)
+{
+	IQuery* q=db->Prepare("SELECT rowid AS id, shahash, filesize FROM "+table+" WHERE rowid>? ORDER BY rowid LIMIT "+nconvert(scan_batch_rows), false);
+
+	bool ret=true;
+	while(true)
+	{
+		//Short read transactions, so the scan does not hold back WAL checkpoints
+		q->Bind(from_rowid);
+		db_results res=q->Read();
+		q->Reset();
+
+		if(res.empty())
+		{
+			break;
+		}
+
+		IScopedLock lock(mutex);
+		if(do_quit)
+		{
+			ret=false;
+			break;
+		}
+
+		for(size_t i=0;i<res.size();++i)
+		{
+			const std::wstring& shahash=res[i][L"shahash"];
+			target->add(std::string(reinterpret_cast<const char*>(shahash.c_str()), shahash.size()*sizeof(wchar_t)),
+				watoi64(res[i][L"filesize"]));
+		}
+
+		nrows+=res.size();
+		from_rowid=watoi64(res[res.size()-1][L"id"]);
+	}
+
+	db->destroyQuery(q);
+	return ret;
+}
+
+void ServerDedupFilter::operator()(void)
+{
+	int64 starttime=Server->getTimeMS();
+
+	bool grow=(target!=filter);
+
+	if(files_rowid==0 && !grow)
+	{
+		Server->Log("Building deduplication filter...", LL_INFO);
+	}
+
+	IDatabase* db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER);
+
+	//files_new first. Rows moved from files_new to files during the scan get
+	//new rowids in files and are found by the files pass
+	int64 nrows=0;
+	bool ok=addRows(db, "files_new", 0, nrows)
+		&& addRows(db, "files", files_rowid, nrows);
+
+	Server->destroyDatabases(Server->getThreadID());
+
+	if(grow)
+	{
+		IScopedLock lock(mutex);
+		if(ok)
+		{
+			//Keys added before the rebuild started whose rows were committed
+			//after the scan passed them are only in the old filter
+			prev_filters.push_back(filter);
+			filter=target;
+			updateMetrics();
+
+			Server->Log("Deduplication filter rebuilt in "+nconvert(Server->getTimeMS()-starttime)+" ms ("
+				+nconvert(filter->getEntries())+" entries, capacity "+nconvert(filter->getCapacity())+", "+PrettyPrintBytes(filter->getBytes())+")", LL_INFO);
+		}
+		else
+		{
+			delete target;
+		}
+		grow_filter=NULL;
+	}
+	else if(ok)
+	{
+		IScopedLock lock(mutex);
+		ready=true;
+		updateMetrics();
+		growIfFull();
+
+		Server->Log("Deduplication filter ready. Added "+nconvert(nrows)+" file entries in "+nconvert(Server->getTimeMS()-starttime)+" ms ("
+			+nconvert(filter->getEntries())+" entries, capacity "+nconvert(filter->getCapacity())+", "+PrettyPrintBytes(filter->getBytes())+")", LL_INFO);
+	}
+
+	delete this;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../Interface/Thread.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/ThreadPool.h"
+#include "../Interface/Types.h"
+
+class IFile;
+class IDatabase;
+class LocalMetricsCounter;
+
+/**
+* Blocked Bloom filter over (shahash, filesize). All bits of a key are in
+* one 512 bit block, so adding or looking up a key touches one cache line.
+* Not thread-safe.
+*/
+class DedupBloomFilter
+{
+public:
+	DedupBloomFilter(int64 capacity, double fpr);
+
+	void add(const std::string& shahash, int64 filesize);
+	bool mightContain(const std::string& shahash, int64 filesize) const;
+
+	int64 getCapacity(void) const;
+	int64 getEntries(void) const;
+	int64 getBytes(void) const;
+	double getFpr(void) const;
+
+	bool write(IFile* file, int64 files_rowid) const;
+	//Returns NULL if the file is not a valid filter
+	static DedupBloomFilter* read(IFile* file, int64& files_rowid);
+
+private:
+	DedupBloomFilter(void);
+	void init(int64 capacity, double fpr);
+
+	std::vector<uint64> bits;
+	uint64 nblocks;
+	unsigned int k;
+	int64 capacity;
+	int64 entries;
+	double fpr;
+};
+
+/**
+* Server wide deduplication filter. BackupServerHash::findFileHash asks it
+* before the file entry cache or the files table, so files which are
+* certainly new skip both lookups. It is loaded from the copy written at
+* the last clean shutdown and caught up with newer rows, or rebuilt from
+* the files and files_new tables in the background. Until then every
+* lookup is answered with "might contain". Once it holds more entries than
+* its capacity, a filter with twice the capacity is built in the background
+* and replaces it. The replaced filter is still asked until shutdown, as it
+* has keys whose rows were not committed when the rebuild scanned them.
+*/
+class ServerDedupFilter : public IThread
+{
+public:
+	static void initMutex(void);
+	static void destroyMutex(void);
+
+	static void init(void);
+	//Stops a running rebuild and persists the filter
+	static void shutdown(void);
+
+	static void add(const std::string& shahash, int64 filesize);
+	//False only if no file with this hash and size was added
+	static bool mightContain(const std::string& shahash, int64 filesize);
+	//A positive lookup that found no file entry
+	static void addFalsePositive(void);
+
+	void operator()(void);
+
+private:
+	ServerDedupFilter(int64 files_rowid, DedupBloomFilter* target);
+
+	bool addRows(IDatabase* db, const std::string& table, int64 from_rowid, int64& nrows);
+	static int64 maxRowid(IDatabase* db, const std::string& table);
+	static void updateMetrics(void);
+	static void growIfFull(void);
+
+	int64 files_rowid;
+	DedupBloomFilter* target;
+
+	static IMutex* mutex;
+	static DedupBloomFilter* filter;
+	static DedupBloomFilter* grow_filter;
+	static std::vector<DedupBloomFilter*> prev_filters;
+	static bool ready;
+	static bool do_quit;
+	static THREADPOOL_TICKET thread_ticket;
+	static THREADPOOL_TICKET grow_ticket;
+	static int64 lookups;
+	static int64 negatives;
+	static int64 false_positives;
+	//Only used with mutex held, so lookups do not take the metrics lock
+	static LocalMetricsCounter* positive_metric;
+	static LocalMetricsCounter* negative_metric;
+};
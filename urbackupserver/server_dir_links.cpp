@@ -1,9 +1,14 @@
 #include "server_dir_links.h"
 #include "../urbackupcommon/os_functions.h"
 #include "../Interface/Server.h"
+#include "../Interface/File.h"
 #include "../stringtools.h"
 #include "server_settings.h"
 #include "../Interface/Mutex.h"
+#include "../Interface/Thread.h"
+#include "../Interface/ThreadPool.h"
+#include "server_metrics.h"
+#include <algorithm>
 
 namespace
 {
@@ -22,6 +27,84 @@ namespace
 	}
 
 	IMutex* dir_link_mutex;
+
+	typedef void(*parallel_func_t)(size_t idx, void* userdata);
+
+	class ParallelWorker : public IThread
+	{
+	public:
+		ParallelWorker(IMutex* mutex, size_t& next_idx, size_t nitems, parallel_func_t func, void* userdata)
+			: mutex(mutex), next_idx(next_idx), nitems(nitems), func(func), userdata(userdata)
+		{
+		}
+
+		void operator()(void)
+		{
+			const size_t chunk_size=16;
+			while(true)
+			{
+				size_t start;
+				{
+					IScopedLock lock(mutex);
+					if(next_idx>=nitems)
+					{
+						break;
+					}
+					start=next_idx;
+					next_idx=(std::min)(nitems, next_idx+chunk_size);
+				}
+
+				for(size_t i=start;i<(std::min)(nitems, start+chunk_size);++i)
+				{
+					func(i, userdata);
+				}
+			}
+		}
+
+	private:
+		IMutex* mutex;
+		size_t& next_idx;
+		size_t nitems;
+		parallel_func_t func;
+		void* userdata;
+	};
+
+	//Calls func for every item on nthreads threads and waits for all of them
+	void run_parallel(size_t nitems, size_t nthreads, parallel_func_t func, void* userdata)
+	{
+		nthreads=(std::min)(nthreads, (nitems+15)/16);
+		if(nthreads<=1)
+		{
+			for(size_t i=0;i<nitems;++i)
+			{
+				func(i, userdata);
+			}
+			return;
+		}
+
+		IMutex* mutex=Server->createMutex();
+		size_t next_idx=0;
+		std::vector<ParallelWorker*> workers;
+		std::vector<THREADPOOL_TICKET> tickets;
+		for(size_t i=0;i<nthreads;++i)
+		{
+			workers.push_back(new ParallelWorker(mutex, next_idx, nitems, func, userdata));
+			tickets.push_back(Server->getThreadPool()->execute(workers[i]));
+		}
+
+		Server->getThreadPool()->waitFor(tickets);
+
+		for(size_t i=0;i<workers.size();++i)
+		{
+			delete workers[i];
+		}
+		Server->destroy(mutex);
+	}
+
+	size_t dir_link_threads(void)
+	{
+		return static_cast<size_t>((std::max)(1, watoi(Server->ConvertToUnicode(Server->getServerParameter("dir_link_threads", "4")))));
+	}
 }
 
 std::wstring escape_glob_sql(const std::wstring& glob)
@@ -180,17 +263,18 @@ bool link_directory_pool( ServerBackupDao& backup_dao, int clientid, const std::
 	return true;
 }
 
-bool replay_directory_link_journal( ServerBackupDao& backup_dao )
+namespace
 {
-	IScopedLock lock(dir_link_mutex);
-
-	std::vector<ServerBackupDao::JournalEntry> journal_entries = backup_dao.getDirectoryLinkJournalEntries();
-
-	bool has_error=false;
+	struct SReplayData
+	{
+		std::vector<ServerBackupDao::JournalEntry>* journal_entries;
+		std::vector<char>* errors;
+	};
 
-	for(size_t i=0;i<journal_entries.size();++i)
+	void replay_journal_entry(size_t idx, void* userdata)
 	{
-		const ServerBackupDao::JournalEntry& je = journal_entries[i];
+		SReplayData* data = reinterpret_cast<SReplayData*>(userdata);
+		const ServerBackupDao::JournalEntry& je = (*data->journal_entries)[idx];
 
 		std::wstring symlink_real_target;
 
@@ -203,25 +287,326 @@ bool replay_directory_link_journal( ServerBackupDao& backup_dao )
 				if(!os_link_symbolic(os_file_prefix(je.linktarget), os_file_prefix(je.linkname)))
 				{
 					Server->Log(L"Error replaying symlink journal: Could create link at \""+je.linkname+L"\" to \""+je.linktarget+L"\"", LL_ERROR);
-					has_error=true;
+					(*data->errors)[idx]=1;
 				}
 			}
 		}
 	}
+}
+
+bool replay_directory_link_journal( ServerBackupDao& backup_dao )
+{
+	IScopedLock lock(dir_link_mutex);
+
+	std::vector<ServerBackupDao::JournalEntry> journal_entries = backup_dao.getDirectoryLinkJournalEntries();
+
+	std::vector<char> errors(journal_entries.size(), 0);
+	SReplayData data = { &journal_entries, &errors };
+	run_parallel(journal_entries.size(), dir_link_threads(), replay_journal_entry, &data);
 
 	backup_dao.removeDirectoryLinkJournalEntries();
 
-	return has_error;
+	return std::find(errors.begin(), errors.end(), 1)!=errors.end();
+}
+
+DirectoryLinkBatch::DirectoryLinkBatch( ServerBackupDao& backup_dao, int clientid, const std::wstring& pooldir, bool with_transaction )
+	: backup_dao(backup_dao), clientid(clientid), pooldir(pooldir), with_transaction(with_transaction),
+	  has_error(false), linked_dirs(0)
+{
+	nthreads=dir_link_threads();
+	batch_size=static_cast<size_t>((std::max)(1, watoi(Server->ConvertToUnicode(Server->getServerParameter("dir_link_batch_size", "1000")))));
+}
+
+DirectoryLinkBatch::~DirectoryLinkBatch(void)
+{
+	flushBatch();
+}
+
+bool DirectoryLinkBatch::link( const std::wstring& target_dir, const std::wstring& src_dir )
+{
+	if(with_transaction)
+	{
+		bool ret = link_directory_pool(backup_dao, clientid, target_dir, src_dir, pooldir, true);
+		if(ret)
+		{
+			++linked_dirs;
+		}
+		return ret;
+	}
+
+	IScopedLock lock(dir_link_mutex);
+
+	SDirLink dir_link;
+	dir_link.target_dir=target_dir;
+	dir_link.src_dir=src_dir;
+	dir_link.move_src=false;
+	dir_link.move_link=std::string::npos;
+	dir_link.journal_id=0;
+	dir_link.src_ok=false;
+	dir_link.ok=false;
+
+	std::map<std::wstring, size_t>::iterator it_move=pending_moves.find(src_dir);
+	if(it_move!=pending_moves.end())
+	{
+		dir_link.move_link=it_move->second;
+		dir_link.link_src_dir=links[it_move->second].link_src_dir;
+		dir_link.pool_name=links[it_move->second].pool_name;
+	}
+	else if(os_is_symlink(os_file_prefix(src_dir)))
+	{
+		if(!os_get_symlink_target(os_file_prefix(src_dir), dir_link.link_src_dir))
+		{
+			Server->Log(L"Could not get symlink target of source directory \""+src_dir+L"\".", LL_ERROR);
+			return false;
+		}
+
+		dir_link.pool_name = ExtractFileName(dir_link.link_src_dir);
+
+		if(dir_link.pool_name.empty())
+		{
+			Server->Log(L"Error extracting pool name from link source \""+dir_link.link_src_dir+L"\"", LL_ERROR);
+			return false;
+		}
+	}
+	else if(os_directory_exists(os_file_prefix(src_dir)))
+	{
+		std::wstring parent_src_dir;
+		do 
+		{
+			dir_link.pool_name = widen(ServerSettings::generateRandomAuthKey(10))+convert(Server->getTimeSeconds())+convert(Server->getTimeMS());
+			parent_src_dir = pooldir + os_file_sep() + dir_link.pool_name.substr(0, 2);
+			dir_link.link_src_dir = parent_src_dir + os_file_sep() + dir_link.pool_name;
+		} while (os_directory_exists(os_file_prefix(dir_link.link_src_dir)));
+
+		if(!os_directory_exists(os_file_prefix(parent_src_dir)) && !os_create_dir_recursive(os_file_prefix(parent_src_dir)))
+		{
+			Server->Log(L"Could not create directory for pool directory: \""+parent_src_dir+L"\"", LL_ERROR);
+			return false;
+		}
+
+		dir_link.move_src=true;
+		backup_dao.addDirectoryLink(clientid, dir_link.pool_name, src_dir);
+		backup_dao.addDirectoryLinkJournalEntry(src_dir, dir_link.link_src_dir);
+		dir_link.journal_id = backup_dao.getLastId();
+		pending_moves[src_dir]=links.size();
+	}
+	else
+	{
+		return false;
+	}
+
+	reference_all_sublinks(backup_dao, clientid, src_dir, target_dir);
+	backup_dao.addDirectoryLink(clientid, dir_link.pool_name, target_dir);
+
+	links.push_back(dir_link);
+
+	if(links.size()>=batch_size
+		&& !flushBatch())
+	{
+		has_error=true;
+	}
+
+	return true;
+}
+
+bool DirectoryLinkBatch::flush(std::vector<std::pair<std::wstring, std::wstring> >* p_failed_links)
+{
+	bool ret = flushBatch() && !has_error;
+	has_error=false;
+	if(p_failed_links!=NULL)
+	{
+		p_failed_links->swap(failed_links);
+	}
+	failed_links.clear();
+	return ret;
+}
+
+int64 DirectoryLinkBatch::getLinkedDirs(void)
+{
+	return linked_dirs;
+}
+
+void DirectoryLinkBatch::createDirLink(size_t idx, void* userdata)
+{
+	SDirLink& dir_link = (*reinterpret_cast<std::vector<SDirLink>*>(userdata))[idx];
+
+	if(dir_link.move_src)
+	{
+		if(!os_rename_file(os_file_prefix(dir_link.src_dir), os_file_prefix(dir_link.link_src_dir)))
+		{
+			Server->Log(L"Could not rename folder \""+dir_link.src_dir+L"\" to \""+dir_link.link_src_dir+L"\"", LL_ERROR);
+			return;
+		}
+
+		if(!os_link_symbolic(os_file_prefix(dir_link.link_src_dir), os_file_prefix(dir_link.src_dir)))
+		{
+			Server->Log(L"Could not create a symbolic link at \""+dir_link.src_dir+L"\" to \""+dir_link.link_src_dir+L"\"", LL_ERROR);
+			os_rename_file(os_file_prefix(dir_link.link_src_dir), os_file_prefix(dir_link.src_dir));
+			return;
+		}
+
+		dir_link.src_ok=true;
+	}
+
+	if(!os_link_symbolic(os_file_prefix(dir_link.link_src_dir), os_file_prefix(dir_link.target_dir)))
+	{
+		Server->Log(L"Error creating symbolic link from \"" + dir_link.link_src_dir +L"\" to \"" +
+			dir_link.target_dir+L"\" -2", LL_ERROR);
+		return;
+	}
+
+	dir_link.ok=true;
+}
+
+bool DirectoryLinkBatch::flushBatch(void)
+{
+	if(links.empty())
+	{
+		return true;
+	}
+
+	IScopedLock lock(dir_link_mutex);
+
+	int64 starttime=Server->getTimeMS();
+
+	//The references have to be durable before the links exist
+	backup_dao.commit();
+
+	run_parallel(links.size(), nthreads, createDirLink, &links);
+
+	size_t failed=0;
+	backup_dao.BeginWriteTransaction();
+	for(size_t i=0;i<links.size();++i)
+	{
+		SDirLink& dir_link = links[i];
+
+		if(dir_link.journal_id!=0)
+		{
+			backup_dao.removeDirectoryLinkJournalEntry(dir_link.journal_id);
+		}
+
+		if(dir_link.move_link!=std::string::npos
+			&& !links[dir_link.move_link].src_ok
+			&& dir_link.ok)
+		{
+			//The pool directory does not exist
+			os_remove_symlink_dir(os_file_prefix(dir_link.target_dir));
+			dir_link.ok=false;
+		}
+
+		if(dir_link.move_src && !dir_link.src_ok)
+		{
+			backup_dao.removeDirectoryLink(clientid, dir_link.src_dir);
+		}
+
+		if(!dir_link.ok)
+		{
+			backup_dao.removeDirectoryLink(clientid, dir_link.target_dir);
+			backup_dao.removeDirectoryLinkGlob(clientid, escape_glob_sql(dir_link.target_dir)+os_file_sep()+L"*");
+			failed_links.push_back(std::make_pair(dir_link.target_dir, dir_link.src_dir));
+			++failed;
+		}
+	}
+	backup_dao.endTransaction();
+
+	linked_dirs+=links.size()-failed;
+
+	ServerMetrics::addCounter("urbackup_dir_links_created_total", static_cast<int64>(links.size()-failed));
+	ServerMetrics::addLatency("urbackup_dir_link_batch_ms", Server->getTimeMS()-starttime);
+
+	links.clear();
+	pending_moves.clear();
+
+	if(failed>0)
+	{
+		Server->Log("Creating "+nconvert(failed)+" directory links failed", LL_ERROR);
+		return false;
+	}
+
+	return true;
+}
+
+bool copy_directory_tree(const std::wstring& src_dir, const std::wstring& target_dir)
+{
+	if(!os_create_dir(os_file_prefix(target_dir))
+		&& !os_directory_exists(os_file_prefix(target_dir)))
+	{
+		Server->Log(L"Error creating directory \""+target_dir+L"\"", LL_ERROR);
+		return false;
+	}
+
+	bool has_error=false;
+	std::vector<SFile> files=getFiles(os_file_prefix(src_dir), &has_error, true, false);
+	if(has_error)
+	{
+		Server->Log(L"Error listing directory \""+src_dir+L"\"", LL_ERROR);
+		return false;
+	}
+
+	for(size_t i=0;i<files.size();++i)
+	{
+		std::wstring curr_src=src_dir+os_file_sep()+files[i].name;
+		std::wstring curr_dst=target_dir+os_file_sep()+files[i].name;
+
+		if(files[i].isdir)
+		{
+			if(!copy_directory_tree(curr_src, curr_dst))
+			{
+				return false;
+			}
+			continue;
+		}
+
+		bool too_many_hardlinks;
+		if(os_create_hardlink(os_file_prefix(curr_dst), os_file_prefix(curr_src), false, &too_many_hardlinks))
+		{
+			continue;
+		}
+
+		if(!too_many_hardlinks)
+		{
+			Server->Log(L"Error creating hardlink from \""+curr_src+L"\" to \""+curr_dst+L"\"", LL_ERROR);
+			return false;
+		}
+
+		IFile* fsrc=Server->openFile(os_file_prefix(curr_src), MODE_READ_SEQUENTIAL);
+		IFile* fdst=Server->openFile(os_file_prefix(curr_dst), MODE_WRITE);
+		bool ok=fsrc!=NULL && fdst!=NULL;
+		std::vector<char> buf(ok?512*1024:0);
+		_u32 read;
+		while(ok && (read=fsrc->Read(&buf[0], static_cast<_u32>(buf.size())))>0)
+		{
+			ok=fdst->Write(&buf[0], read)==read;
+		}
+		if(fsrc!=NULL) Server->destroy(fsrc);
+		if(fdst!=NULL) Server->destroy(fdst);
+
+		if(!ok)
+		{
+			Server->Log(L"Error copying \""+curr_src+L"\" to \""+curr_dst+L"\"", LL_ERROR);
+			return false;
+		}
+	}
+
+	return true;
 }
 
 namespace
 {
+	//Removing directory links shares a write transaction up to this many
+	//links or milliseconds
+	const size_t c_remove_transaction_links=1000;
+	const int64 c_remove_transaction_ms=1000;
+	const size_t c_max_cached_refcounts=100000;
+
 	struct SSymlinkCallbackData
 	{
 		SSymlinkCallbackData(ServerBackupDao* backup_dao,
 			int clientid, bool with_transaction)
 			: backup_dao(backup_dao), clientid(clientid),
-			with_transaction(with_transaction)
+			with_transaction(with_transaction), depth(0),
+			transaction_links(0), transaction_starttime(0),
+			removed_links(0)
 		{
 
 		}
@@ -229,8 +614,82 @@ namespace
 		ServerBackupDao* backup_dao;
 		int clientid;
 		bool with_transaction;
+		//Number of pool directories being removed
+		size_t depth;
+		size_t transaction_links;
+		int64 transaction_starttime;
+		int64 removed_links;
+		//Reference counts of pool directories seen during this removal.
+		//Only this removal changes them while it holds dir_link_mutex
+		std::map<std::wstring, int> refcounts;
 	};
 
+	void begin_remove_transaction(SSymlinkCallbackData* data)
+	{
+		if(data->with_transaction && data->transaction_links==0)
+		{
+			data->backup_dao->BeginWriteTransaction();
+			data->transaction_starttime=Server->getTimeMS();
+		}
+		++data->transaction_links;
+	}
+
+	void end_remove_transaction(SSymlinkCallbackData* data, bool force)
+	{
+		//A pool directory is removed in the transaction which removed its last reference
+		if(data->transaction_links>0 && data->depth==0
+			&& (force || data->transaction_links>=c_remove_transaction_links
+				|| Server->getTimeMS()-data->transaction_starttime>=c_remove_transaction_ms) )
+		{
+			if(data->with_transaction)
+			{
+				data->backup_dao->endTransaction();
+			}
+			data->transaction_links=0;
+		}
+	}
+
+	int remaining_refcount(SSymlinkCallbackData* data, const std::wstring& pool_name, int removed)
+	{
+		std::map<std::wstring, int>::iterator it=data->refcounts.find(pool_name);
+		if(it==data->refcounts.end())
+		{
+			int refcount = data->backup_dao->getDirectoryRefcount(data->clientid, pool_name);
+			if(refcount>0)
+			{
+				if(data->refcounts.size()>=c_max_cached_refcounts)
+				{
+					data->refcounts.clear();
+				}
+				data->refcounts[pool_name]=refcount;
+			}
+			return refcount;
+		}
+
+		it->second-=removed;
+		return it->second;
+	}
+
+	void remove_sublinks(SSymlinkCallbackData* data, const std::wstring& target_raw)
+	{
+		std::wstring glob = escape_glob_sql(target_raw)+os_file_sep()+L"*";
+
+		if(!data->refcounts.empty())
+		{
+			std::vector<ServerBackupDao::DirectoryLinkEntry> entries = data->backup_dao->getLinksInDirectory(data->clientid, glob);
+			for(size_t i=0;i<entries.size();++i)
+			{
+				std::map<std::wstring, int>::iterator it=data->refcounts.find(entries[i].name);
+				if(it!=data->refcounts.end())
+				{
+					--it->second;
+				}
+			}
+		}
+
+		data->backup_dao->removeDirectoryLinkGlob(data->clientid, glob);
+	}
+
 	bool symlink_callback(const std::wstring &path, void* userdata)
 	{
 		SSymlinkCallbackData* data = reinterpret_cast<SSymlinkCallbackData*>(userdata);
@@ -260,19 +719,22 @@ namespace
 			target_raw = path;
 		}
 
-		if(data->with_transaction)
-		{
-			data->backup_dao->BeginWriteTransaction();
-		}		
+		end_remove_transaction(data, false);
+		begin_remove_transaction(data);
 
 		data->backup_dao->removeDirectoryLink(data->clientid, target_raw);
 
-		if(data->backup_dao->getLastChanges()>0)
+		int removed = data->backup_dao->getLastChanges();
+		if(removed>0)
 		{
+			++data->removed_links;
+
 			bool ret = true;
-			if(data->backup_dao->getDirectoryRefcount(data->clientid, pool_name)==0)
+			if(remaining_refcount(data, pool_name, removed)<=0)
 			{
-				ret = remove_directory_link_dir(path, *data->backup_dao, data->clientid, false, false);
+				++data->depth;
+				ret = os_remove_nonempty_dir(os_file_prefix(path), symlink_callback, data, false);
+				--data->depth;
 				ret = ret && os_remove_dir(os_file_prefix(pool_path));
 
 				if(!ret)
@@ -282,7 +744,7 @@ namespace
 			}
 			else
 			{
-				data->backup_dao->removeDirectoryLinkGlob(data->clientid, escape_glob_sql(target_raw)+os_file_sep()+L"*");
+				remove_sublinks(data, target_raw);
 			}
 		}
 		else
@@ -296,11 +758,6 @@ namespace
 			Server->Log(L"Error removing symlink dir \""+path+L"\"", LL_ERROR);
 		}
 
-		if(data->with_transaction)
-		{
-			data->backup_dao->endTransaction();
-		}
-
 		return true;
 	}
 }
@@ -310,7 +767,15 @@ bool remove_directory_link_dir(const std::wstring &path, ServerBackupDao& backup
 	IScopedLock lock(dir_link_mutex);
 
 	SSymlinkCallbackData userdata(&backup_dao, clientid, with_transaction);
-	return os_remove_nonempty_dir(os_file_prefix(path), symlink_callback, &userdata, delete_root);
+	bool ret = os_remove_nonempty_dir(os_file_prefix(path), symlink_callback, &userdata, delete_root);
+	end_remove_transaction(&userdata, true);
+
+	if(userdata.removed_links>0)
+	{
+		ServerMetrics::addCounter("urbackup_dir_links_removed_total", userdata.removed_links);
+	}
+
+	return ret;
 }
 
 void init_dir_link_mutex()
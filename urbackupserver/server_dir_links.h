@@ -2,6 +2,8 @@
 
 #include "dao/ServerBackupDao.h"
 #include <string>
+#include <vector>
+#include <map>
 
 void init_dir_link_mutex();
 
@@ -13,4 +15,69 @@ bool link_directory_pool(ServerBackupDao& backup_dao, int clientid, const std::w
 
 bool replay_directory_link_journal(ServerBackupDao& backup_dao);
 
-bool remove_directory_link_dir(const std::wstring &path, ServerBackupDao& backup_dao, int clientid, bool delete_root=true, bool with_transaction=true);
\ No newline at end of file
+bool remove_directory_link_dir(const std::wstring &path, ServerBackupDao& backup_dao, int clientid, bool delete_root=true, bool with_transaction=true);
+
+//Creates target_dir with hard links (or copies) of all files below src_dir.
+//Directory links below src_dir are followed. Used if a directory link
+//could not be created
+bool copy_directory_tree(const std::wstring& src_dir, const std::wstring& target_dir);
+
+/**
+* Creates directory links like link_directory_pool, but in batches.
+* link() adds the references to the database right away and queues the
+* filesystem operations. flush() makes the references of the whole batch
+* durable with one checkpoint and then moves and links the queued
+* directories on worker threads. Directories moved into the pool are
+* recorded in the directory link journal until their symlink exists.
+* With filesystem transactions every link is created by
+* link_directory_pool instead.
+*/
+class DirectoryLinkBatch
+{
+public:
+	DirectoryLinkBatch(ServerBackupDao& backup_dao, int clientid, const std::wstring& pooldir, bool with_transaction);
+	~DirectoryLinkBatch(void);
+
+	//Returns false if src_dir cannot be linked. Otherwise the link exists
+	//after the next flush
+	bool link(const std::wstring& target_dir, const std::wstring& src_dir);
+
+	//Creates all queued links. Returns false if creating one of the links
+	//queued since the last call failed. Their (target_dir, src_dir) pairs
+	//are returned in failed_links. Nothing exists at target_dir for those
+	bool flush(std::vector<std::pair<std::wstring, std::wstring> >* failed_links=NULL);
+
+	int64 getLinkedDirs(void);
+
+private:
+	struct SDirLink
+	{
+		std::wstring target_dir;
+		std::wstring src_dir;
+		std::wstring link_src_dir;
+		std::wstring pool_name;
+		//src_dir is moved into the pool by this link
+		bool move_src;
+		//Link moving src_dir into the pool, if that is queued in the same batch
+		size_t move_link;
+		int64 journal_id;
+		bool src_ok;
+		bool ok;
+	};
+
+	bool flushBatch(void);
+	static void createDirLink(size_t idx, void* userdata);
+
+	ServerBackupDao& backup_dao;
+	int clientid;
+	std::wstring pooldir;
+	bool with_transaction;
+	size_t nthreads;
+	size_t batch_size;
+
+	std::vector<SDirLink> links;
+	std::map<std::wstring, size_t> pending_moves;
+	std::vector<std::pair<std::wstring, std::wstring> > failed_links;
+	bool has_error;
+	int64 linked_dirs;
+};
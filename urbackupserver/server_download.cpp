@@ -23,6 +23,7 @@
 #include "../Interface/Server.h"
 #include "server_log.h"
 #include "server_get.h"
+#include "server_prepare_hash.h"
 #include "../stringtools.h"
 #include "../common/data.h"
 
@@ -548,26 +549,13 @@ bool ServerDownloadThread::load_file_patch(SQueueItem todl)
 
 void ServerDownloadThread::hashFile(std::wstring dstpath, std::wstring hashpath, IFile *fd, IFile *hashoutput, std::string old_file, int64 t_filesize)
 {
-	int l_backup_id=backupid;
-
-	CWData data;
-	data.addString(Server->ConvertToUTF8(fd->getFilenameW()));
-	data.addInt(l_backup_id);
-	data.addChar(r_incremental==true?1:0);
-	data.addString(Server->ConvertToUTF8(dstpath));
-	data.addString(Server->ConvertToUTF8(hashpath));
+	std::wstring temp_fn=fd->getFilenameW();
+	std::wstring hashoutput_fn;
 	if(hashoutput!=NULL)
 	{
-		data.addString(Server->ConvertToUTF8(hashoutput->getFilenameW()));
-	}
-	else
-	{
-		data.addString("");
+		hashoutput_fn=hashoutput->getFilenameW();
 	}
 
-	data.addString(old_file);
-	data.addInt64(t_filesize);
-
 	ServerLogger::Log(clientid, "GT: Loaded file \""+ExtractFileName(Server->ConvertToUTF8(dstpath))+"\"", LL_DEBUG);
 
 	Server->destroy(fd);
@@ -575,7 +563,8 @@ void ServerDownloadThread::hashFile(std::wstring dstpath, std::wstring hashpath,
 	{
 		Server->destroy(hashoutput);
 	}
-	hashpipe_prepare->Write(data.getDataPtr(), data.getDataSize() );
+
+	BackupServerPrepareHash::queueFile(hashpipe_prepare, temp_fn, backupid, r_incremental, dstpath, hashpath, hashoutput_fn, old_file, t_filesize);
 }
 
 bool ServerDownloadThread::isOffline()
@@ -0,0 +1,330 @@
+#include "server_file_entry_writer.h"
+#include "server_metrics.h"
+#include "../Interface/Server.h"
+#include "../Interface/Database.h"
+#include "../Interface/Query.h"
+#include "../Interface/ThreadPool.h"
+#include "../stringtools.h"
+#include <algorithm>
+
+namespace
+{
+	//Rows per multi-row INSERT. Eight bound columns each, so this stays
+	//below SQLite's default limit of 999 variables
+	const size_t c_rows_per_insert=64;
+
+	//did_count has no default. Rows with 0 are picked up by ServerUpdateStats
+	const char* c_files_columns="(backupid, fullpath, hashpath, shahash, filesize, rsize, clientid, incremental, did_count)";
+	const char* c_files_new_columns="(backupid, fullpath, hashpath, shahash, filesize, rsize, clientid, incremental)";
+
+	std::string multiRowValues(size_t nrows, bool with_did_count)
+	{
+		std::string ret=" VALUES ";
+		for(size_t i=0;i<nrows;++i)
+		{
+			if(i>0) ret+=", ";
+			ret+=with_did_count ? "(?, ?, ?, ?, ?, ?, ?, ?, 0)" : "(?, ?, ?, ?, ?, ?, ?, ?)";
+		}
+		return ret;
+	}
+
+	bool entryLess(const SFileEntry* a, const SFileEntry* b)
+	{
+		if(a->to_files_new!=b->to_files_new)
+			return a->to_files_new<b->to_files_new;
+		int c=a->shahash.compare(b->shahash);
+		if(c!=0)
+			return c<0;
+		return a->filesize<b->filesize;
+	}
+}
+
+IMutex* ServerFileEntryWriter::mutex=NULL;
+ICondition* ServerFileEntryWriter::cond=NULL;
+ICondition* ServerFileEntryWriter::done_cond=NULL;
+std::deque<ServerFileEntryWriter::SQueueItem*> ServerFileEntryWriter::queue;
+size_t ServerFileEntryWriter::queued_rows=0;
+size_t ServerFileEntryWriter::max_queued_rows=200000;
+size_t ServerFileEntryWriter::max_transaction_rows=50000;
+int64 ServerFileEntryWriter::next_ticket=1;
+int64 ServerFileEntryWriter::committed_ticket=0;
+std::set<int64> ServerFileEntryWriter::failed_tickets;
+bool ServerFileEntryWriter::running=false;
+bool ServerFileEntryWriter::do_quit=false;
+THREADPOOL_TICKET ServerFileEntryWriter::thread_ticket=ILLEGAL_THREADPOOL_TICKET;
+
+ServerFileEntryWriter::ServerFileEntryWriter(DATABASE_ID db_id)
+	: db_id(db_id), db(NULL)
+{
+}
+
+void ServerFileEntryWriter::initMutex(void)
+{
+	mutex=Server->createMutex();
+	cond=Server->createCondition();
+	done_cond=Server->createCondition();
+}
+
+void ServerFileEntryWriter::destroyMutex(void)
+{
+	Server->destroy(mutex);
+	Server->destroy(cond);
+	Server->destroy(done_cond);
+}
+
+void ServerFileEntryWriter::start(DATABASE_ID db_id)
+{
+	IScopedLock lock(mutex);
+	if(running)
+	{
+		return;
+	}
+
+	max_queued_rows=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("file_entry_writer_queue", "200000"))));
+	max_transaction_rows=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("file_entry_writer_transaction_rows", "50000"))));
+	if(max_transaction_rows==0)
+	{
+		max_transaction_rows=1;
+	}
+
+	do_quit=false;
+	running=true;
+	thread_ticket=Server->getThreadPool()->execute(new ServerFileEntryWriter(db_id));
+}
+
+void ServerFileEntryWriter::stop(void)
+{
+	{
+		IScopedLock lock(mutex);
+		if(!running)
+		{
+			return;
+		}
+		do_quit=true;
+		cond->notify_all();
+	}
+
+	Server->getThreadPool()->waitFor(thread_ticket);
+}
+
+bool ServerFileEntryWriter::isRunning(void)
+{
+	IScopedLock lock(mutex);
+	return running && !do_quit;
+}
+
+int64 ServerFileEntryWriter::queueEntries(std::vector<SFileEntry>& entries)
+{
+	IScopedLock lock(mutex);
+
+	while(running && max_queued_rows>0 && queued_rows>0
+		&& queued_rows+entries.size()>max_queued_rows)
+	{
+		done_cond->wait(&lock);
+	}
+
+	SQueueItem* item=new SQueueItem;
+	item->ticket=next_ticket++;
+	item->entries.swap(entries);
+	queued_rows+=item->entries.size();
+	queue.push_back(item);
+
+	ServerMetrics::setGauge("urbackup_file_entry_writer_queue_size", static_cast<int64>(queued_rows));
+
+	cond->notify_all();
+
+	return item->ticket;
+}
+
+bool ServerFileEntryWriter::waitFor(int64 ticket)
+{
+	IScopedLock lock(mutex);
+	while(running && committed_ticket<ticket)
+	{
+		done_cond->wait(&lock);
+	}
+
+	if(committed_ticket<ticket)
+	{
+		return false;
+	}
+
+	std::set<int64>::iterator it=failed_tickets.find(ticket);
+	if(it!=failed_tickets.end())
+	{
+		failed_tickets.erase(it);
+		return false;
+	}
+
+	return true;
+}
+
+size_t ServerFileEntryWriter::getQueueSize(void)
+{
+	IScopedLock lock(mutex);
+	return queued_rows;
+}
+
+void ServerFileEntryWriter::operator()(void)
+{
+	db=Server->getDatabase(Server->getThreadID(), db_id);
+	prepareQueries();
+
+	DBScopedDetach detachDbs(db);
+
+	while(true)
+	{
+		std::vector<SQueueItem*> items;
+		size_t nrows=0;
+		{
+			IScopedLock lock(mutex);
+			while(queue.empty() && !do_quit)
+			{
+				cond->wait(&lock);
+			}
+
+			if(queue.empty())
+			{
+				break;
+			}
+
+			while(!queue.empty()
+				&& (items.empty() || nrows+queue.front()->entries.size()<=max_transaction_rows))
+			{
+				nrows+=queue.front()->entries.size();
+				items.push_back(queue.front());
+				queue.pop_front();
+			}
+		}
+
+		std::vector<SFileEntry*> entries;
+		entries.reserve(nrows);
+		for(size_t i=0;i<items.size();++i)
+		{
+			for(size_t j=0;j<items[i]->entries.size();++j)
+			{
+				entries.push_back(&items[i]->entries[j]);
+			}
+		}
+
+		int64 starttime=Server->getTimeMS();
+		bool ok=writeEntries(entries);
+		int64 duration=Server->getTimeMS()-starttime;
+
+		ServerMetrics::addCounter("urbackup_file_entry_writer_rows_total", static_cast<int64>(nrows));
+		ServerMetrics::addLatency("urbackup_file_entry_writer_transaction_ms", duration);
+		if(duration>0)
+		{
+			ServerMetrics::setGauge("urbackup_file_entry_writer_rows_per_second", static_cast<int64>(nrows)*1000/duration);
+		}
+
+		{
+			IScopedLock lock(mutex);
+			queued_rows-=nrows;
+			committed_ticket=items[items.size()-1]->ticket;
+			if(!ok)
+			{
+				for(size_t i=0;i<items.size();++i)
+				{
+					failed_tickets.insert(items[i]->ticket);
+				}
+			}
+			ServerMetrics::setGauge("urbackup_file_entry_writer_queue_size", static_cast<int64>(queued_rows));
+			done_cond->notify_all();
+		}
+
+		for(size_t i=0;i<items.size();++i)
+		{
+			delete items[i];
+		}
+	}
+
+	destroyQueries();
+	detachDbs.attach();
+	Server->destroyDatabases(Server->getThreadID());
+
+	{
+		IScopedLock lock(mutex);
+		running=false;
+		done_cond->notify_all();
+	}
+
+	delete this;
+}
+
+void ServerFileEntryWriter::prepareQueries(void)
+{
+	q_insert_files_multi=db->Prepare(std::string("INSERT INTO files ")+c_files_columns+multiRowValues(c_rows_per_insert, true), false);
+	q_insert_files=db->Prepare(std::string("INSERT INTO files ")+c_files_columns+multiRowValues(1, true), false);
+	q_insert_files_new_multi=db->Prepare(std::string("INSERT INTO files_new ")+c_files_new_columns+multiRowValues(c_rows_per_insert, false), false);
+	q_insert_files_new=db->Prepare(std::string("INSERT INTO files_new ")+c_files_new_columns+multiRowValues(1, false), false);
+}
+
+void ServerFileEntryWriter::destroyQueries(void)
+{
+	db->destroyQuery(q_insert_files_multi);
+	db->destroyQuery(q_insert_files);
+	db->destroyQuery(q_insert_files_new_multi);
+	db->destroyQuery(q_insert_files_new);
+}
+
+bool ServerFileEntryWriter::writeEntries(std::vector<SFileEntry*>& entries)
+{
+	std::sort(entries.begin(), entries.end(), entryLess);
+
+	DBScopedWriteTransaction trans(db);
+
+	bool ok=true;
+	size_t start=0;
+	while(start<entries.size())
+	{
+		size_t end=start;
+		while(end<entries.size() && entries[end]->to_files_new==entries[start]->to_files_new)
+		{
+			++end;
+		}
+		if(!insertRows(entries, start, end, entries[start]->to_files_new))
+		{
+			ok=false;
+		}
+		start=end;
+	}
+	return ok;
+}
+
+bool ServerFileEntryWriter::insertRows(std::vector<SFileEntry*>& entries, size_t start, size_t end, bool to_files_new)
+{
+	IQuery* q_multi=to_files_new?q_insert_files_new_multi:q_insert_files_multi;
+	IQuery* q_single=to_files_new?q_insert_files_new:q_insert_files;
+
+	bool ok=true;
+	for(size_t i=start;i<end;)
+	{
+		bool multi=end-i>=c_rows_per_insert;
+		size_t nrows=multi?c_rows_per_insert:1;
+		IQuery* q=multi?q_multi:q_single;
+
+		for(size_t j=i;j<i+nrows;++j)
+		{
+			SFileEntry* entry=entries[j];
+			q->Bind(entry->backupid);
+			q->Bind(entry->fullpath);
+			q->Bind(entry->hashpath);
+			q->Bind(entry->shahash.c_str(), static_cast<_u32>(entry->shahash.size()));
+			q->Bind(entry->filesize);
+			q->Bind(entry->rsize);
+			q->Bind(entry->clientid);
+			q->Bind(static_cast<int>(entry->incremental));
+		}
+
+		if(!q->Write())
+		{
+			Server->Log("Error writing "+nconvert(nrows)+" file entries to the database", LL_ERROR);
+			ok=false;
+		}
+		q->Reset();
+
+		i+=nrows;
+	}
+	return ok;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+
+#include "../Interface/Thread.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
+#include "../Interface/Types.h"
+
+class IDatabase;
+class IQuery;
+
+struct SFileEntry
+{
+	int backupid;
+	std::wstring fullpath;
+	std::wstring hashpath;
+	std::string shahash;
+	int64 filesize;
+	int64 rsize;
+	int clientid;
+	char incremental;
+	//Insert into files_new (used with the file entry cache) instead of files
+	bool to_files_new;
+};
+
+/**
+* Single thread writing the file entries of all running backups into the
+* files table. The hash threads hand over their entries in batches and
+* the writer inserts everything queued since its last round in one write
+* transaction with multi-row INSERT statements. Rows are sorted by
+* (shahash, filesize) first, so consecutive inserts hit neighbouring pages
+* of files_idx. Entries for files_new (file entry cache active) go there
+* unindexed and are moved with suspended indices by ServerUpdateStats.
+*/
+class ServerFileEntryWriter : public IThread
+{
+public:
+	static void initMutex(void);
+	static void destroyMutex(void);
+
+	static void start(DATABASE_ID db_id);
+	//Writes everything still queued and stops the writer thread. Nothing
+	//may be queued afterwards
+	static void stop(void);
+	static bool isRunning(void);
+
+	//Takes the entries (entries is empty afterwards) and returns a ticket
+	//for waitFor. Blocks while the queue is full
+	static int64 queueEntries(std::vector<SFileEntry>& entries);
+	//Waits until the entries of ticket and all before it are committed.
+	//Returns false if the entries of ticket could not be written
+	static bool waitFor(int64 ticket);
+
+	static size_t getQueueSize(void);
+
+	void operator()(void);
+
+private:
+	ServerFileEntryWriter(DATABASE_ID db_id);
+
+	struct SQueueItem
+	{
+		int64 ticket;
+		std::vector<SFileEntry> entries;
+	};
+
+	void prepareQueries(void);
+	void destroyQueries(void);
+	bool writeEntries(std::vector<SFileEntry*>& entries);
+	bool insertRows(std::vector<SFileEntry*>& entries, size_t start, size_t end, bool to_files_new);
+
+	DATABASE_ID db_id;
+	IDatabase* db;
+	IQuery* q_insert_files_multi;
+	IQuery* q_insert_files;
+	IQuery* q_insert_files_new_multi;
+	IQuery* q_insert_files_new;
+
+	static IMutex* mutex;
+	static ICondition* cond;
+	static ICondition* done_cond;
+	static std::deque<SQueueItem*> queue;
+	static size_t queued_rows;
+	static size_t max_queued_rows;
+	static size_t max_transaction_rows;
+	static int64 next_ticket;
+	static int64 committed_ticket;
+	static std::set<int64> failed_tickets;
+	static bool running;
+	static bool do_quit;
+	static THREADPOOL_TICKET thread_ticket;
+};
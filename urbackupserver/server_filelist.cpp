@@ -0,0 +1,372 @@
+#include "server_filelist.h"
+#include "server_log.h"
+#include "../Interface/Server.h"
+#include "../urbackupcommon/os_functions.h"
+#include "../stringtools.h"
+#include "../utf8/utf8.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+	const char* extra_names[EFilelistExtra_Count] = { "sha512", "sha256" };
+
+	//Next parameter of a "key=value&..." string, split like ParseParamStrHttp
+	bool next_param(const std::string& str, size_t& i, size_t& key_start, size_t& key_len, size_t& val_start, size_t& val_len)
+	{
+		if(i>=str.size())
+		{
+			return false;
+		}
+
+		key_start=i;
+		key_len=0;
+		val_start=std::string::npos;
+		val_len=0;
+
+		for(;i<str.size();++i)
+		{
+			char ch=str[i];
+			if(val_start==std::string::npos)
+			{
+				if(ch=='=')
+				{
+					key_len=i-key_start;
+					val_start=i+1;
+				}
+			}
+			else if(ch=='&' || ch=='$')
+			{
+				val_len=i-val_start;
+				++i;
+				return true;
+			}
+		}
+
+		if(val_start==std::string::npos)
+		{
+			key_len=i-key_start;
+			val_start=i;
+		}
+		else
+		{
+			val_len=i-val_start;
+		}
+		return true;
+	}
+
+	void decode_param(const std::string& str, size_t start, size_t len, std::string& value)
+	{
+		value.clear();
+		for(size_t i=start;i<start+len;++i)
+		{
+			if(str[i]=='%' && i+2<start+len)
+			{
+				char hex[3] = { str[i+1], str[i+2], 0 };
+				char ch=static_cast<char>(strtoul(hex, NULL, 16));
+				if(ch!=0)
+				{
+					value+=ch;
+				}
+				i+=2;
+			}
+			else if(str[i]=='+')
+			{
+				value+=' ';
+			}
+			else
+			{
+				value+=str[i];
+			}
+		}
+	}
+}
+
+SFilelistEntry::SFilelistEntry(void)
+	: isdir(false), size(0), last_modified(0)
+{
+	for(size_t i=0;i<EFilelistExtra_Count;++i)
+	{
+		extra_start[i]=std::string::npos;
+		extra_len[i]=0;
+	}
+}
+
+bool SFilelistEntry::isParentDir(void) const
+{
+	return isdir && name.size()==2 && name[0]=='.' && name[1]=='.';
+}
+
+void SFilelistEntry::toSFile(SFile& file) const
+{
+	file.isdir=isdir;
+	file.size=size;
+	file.last_modified=last_modified;
+	file.name.clear();
+	try
+	{
+		if(sizeof(wchar_t)==2)
+			utf8::utf8to16(name.begin(), name.end(), back_inserter(file.name));
+		else
+			utf8::utf8to32(name.begin(), name.end(), back_inserter(file.name));
+	}
+	catch(...){}
+}
+
+bool SFilelistEntry::hasExtra(EFilelistExtra key) const
+{
+	return extra_start[key]!=std::string::npos;
+}
+
+bool SFilelistEntry::getExtra(EFilelistExtra key, std::string& value) const
+{
+	if(extra_start[key]==std::string::npos)
+	{
+		return false;
+	}
+
+	decode_param(extra, extra_start[key], extra_len[key], value);
+	return true;
+}
+
+bool SFilelistEntry::getExtra(const std::string& key, std::string& value) const
+{
+	size_t i=0;
+	size_t key_start, key_len, val_start, val_len;
+	while(next_param(extra, i, key_start, key_len, val_start, val_len))
+	{
+		if(key_len==key.size() && extra.compare(key_start, key_len, key)==0)
+		{
+			decode_param(extra, val_start, val_len, value);
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string SFilelistEntry::getSha512(void) const
+{
+	std::string value;
+	if(getExtra(EFilelistExtra_Sha512, value))
+	{
+		return base64_decode_dash(value);
+	}
+	return std::string();
+}
+
+FilelistParser::FilelistParser(int clientid)
+	: clientid(clientid), state(0)
+{
+}
+
+void FilelistParser::reset(void)
+{
+	state=0;
+	num.clear();
+}
+
+bool FilelistParser::nextEntry(const char* buf, size_t bsize, size_t& pos, SFilelistEntry& entry)
+{
+	while(pos<bsize)
+	{
+		char ch=buf[pos++];
+		switch(state)
+		{
+		case 0:
+			if(ch=='f')
+				entry.isdir=false;
+			else if(ch=='d')
+				entry.isdir=true;
+			else
+				ServerLogger::Log(clientid, "Error parsing file FilelistParser::nextEntry - 1", LL_ERROR);
+			entry.name.clear();
+			entry.extra.clear();
+			for(size_t i=0;i<EFilelistExtra_Count;++i)
+			{
+				entry.extra_start[i]=std::string::npos;
+			}
+			state=1;
+			break;
+		case 1:
+			//"
+			state=2;
+			break;
+		case 2:
+			{
+				size_t start=pos-1;
+				while(ch!='"' && ch!='\\' && pos<bsize)
+				{
+					ch=buf[pos++];
+				}
+				if(ch=='"')
+				{
+					entry.name.append(buf+start, pos-1-start);
+					state=3;
+				}
+				else if(ch=='\\')
+				{
+					entry.name.append(buf+start, pos-1-start);
+					state=7;
+				}
+				else
+				{
+					entry.name.append(buf+start, pos-start);
+				}
+			}
+			break;
+		case 3:
+			if(ch=='"')
+			{
+				//Unescaped quote
+				entry.name+="\"\"";
+				state=2;
+			}
+			else if(entry.isdir)
+			{
+				state=0;
+				return true;
+			}
+			else
+			{
+				num.assign(1, ch);
+				state=4;
+			}
+			break;
+		case 7:
+			if(ch!='"' && ch!='\\')
+			{
+				entry.name+='\\';
+			}
+			entry.name+=ch;
+			state=2;
+			break;
+		case 4:
+			if(ch!=' ')
+			{
+				num+=ch;
+			}
+			else
+			{
+				entry.size=os_atoi64(num);
+				num.clear();
+				state=5;
+			}
+			break;
+		case 5:
+			if(ch!='\n' && ch!='#')
+			{
+				num+=ch;
+			}
+			else
+			{
+				entry.last_modified=os_atoi64(num);
+				num.clear();
+				if(ch=='\n')
+				{
+					state=0;
+					return true;
+				}
+				state=6;
+			}
+			break;
+		case 6:
+			{
+				const char* end=static_cast<const char*>(memchr(buf+pos-1, '\n', bsize-(pos-1)));
+				if(end==NULL)
+				{
+					entry.extra.append(buf+pos-1, bsize-(pos-1));
+					pos=bsize;
+				}
+				else
+				{
+					entry.extra.append(buf+pos-1, end-(buf+pos-1));
+					pos=(end-buf)+1;
+					indexExtras(entry);
+					state=0;
+					return true;
+				}
+			}
+			break;
+		}
+	}
+	return false;
+}
+
+void FilelistParser::indexExtras(SFilelistEntry& entry)
+{
+	size_t i=0;
+	size_t key_start, key_len, val_start, val_len;
+	while(next_param(entry.extra, i, key_start, key_len, val_start, val_len))
+	{
+		for(size_t k=0;k<EFilelistExtra_Count;++k)
+		{
+			if(entry.extra_start[k]==std::string::npos
+				&& entry.extra.compare(key_start, key_len, extra_names[k])==0)
+			{
+				entry.extra_start[k]=val_start;
+				entry.extra_len[k]=val_len;
+				break;
+			}
+		}
+	}
+}
+
+FilelistPathStack::FilelistPathStack(void)
+	: sep(os_file_sep())
+{
+}
+
+void FilelistPathStack::push(const std::wstring& name, const std::wstring& os_name)
+{
+	SOffsets off = { curr_path.size(), curr_os_path.size(), local_os_path.size() };
+	offsets.push_back(off);
+
+	curr_path+=L'/';
+	curr_path+=name;
+	curr_os_path+=L'/';
+	curr_os_path+=os_name;
+	local_os_path+=sep;
+	local_os_path+=os_name;
+}
+
+void FilelistPathStack::pop(void)
+{
+	if(offsets.empty())
+	{
+		return;
+	}
+
+	const SOffsets& off=offsets.back();
+	curr_path.resize(off.path);
+	curr_os_path.resize(off.os_path);
+	local_os_path.resize(off.local_os_path);
+	offsets.pop_back();
+}
+
+size_t FilelistPathStack::depth(void) const
+{
+	return offsets.size();
+}
+
+const std::wstring& FilelistPathStack::path(void) const
+{
+	return curr_path;
+}
+
+const std::wstring& FilelistPathStack::osPath(void) const
+{
+	return curr_os_path;
+}
+
+const std::wstring& FilelistPathStack::localOsPath(void) const
+{
+	return local_os_path;
+}
+
+const std::wstring& FilelistPathStack::localOsFilePath(const std::wstring& os_name)
+{
+	local_file_path.assign(local_os_path);
+	local_file_path+=sep;
+	local_file_path+=os_name;
+	return local_file_path;
+}
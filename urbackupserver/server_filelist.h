@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../Interface/Types.h"
+
+struct SFile;
+
+enum EFilelistExtra
+{
+	EFilelistExtra_Sha512=0,
+	EFilelistExtra_Sha256=1,
+	EFilelistExtra_Count=2
+};
+
+/**
+* One entry of a client file list (urbackup/filelist.ub). The name and the
+* extra parameters stay UTF-8 and their storage is reused for the next
+* entry, so parsing a list allocates only while the longest name grows.
+* Size and last modification time are only set for files.
+*/
+struct SFilelistEntry
+{
+	SFilelistEntry(void);
+
+	bool isParentDir(void) const;
+
+	//Converts the name to a wide string without reallocating file.name
+	void toSFile(SFile& file) const;
+
+	bool hasExtra(EFilelistExtra key) const;
+	//Percent decoded value of a known extra parameter
+	bool getExtra(EFilelistExtra key, std::string& value) const;
+	bool getExtra(const std::string& key, std::string& value) const;
+
+	//Binary client side hash from the sha512 parameter or an empty string
+	std::string getSha512(void) const;
+
+	bool isdir;
+	int64 size;
+	int64 last_modified;
+	std::string name;
+	//Raw "key=value&..." parameters after '#'
+	std::string extra;
+
+	size_t extra_start[EFilelistExtra_Count];
+	size_t extra_len[EFilelistExtra_Count];
+};
+
+/**
+* Incremental parser for the client file list format. Feed it the list in
+* arbitrary chunks and it returns each entry as soon as it is complete.
+* The same SFilelistEntry has to be passed until an entry is returned.
+*/
+class FilelistParser
+{
+public:
+	FilelistParser(int clientid);
+
+	//Parses buf from pos on. Returns true and advances pos past the
+	//entry once one is complete, otherwise consumes the whole buffer.
+	bool nextEntry(const char* buf, size_t bsize, size_t& pos, SFilelistEntry& entry);
+
+	void reset(void);
+
+private:
+	void indexExtras(SFilelistEntry& entry);
+
+	int clientid;
+	int state;
+	std::string num;
+};
+
+/**
+* Current directory of a file list walk. The client path, the path with
+* names fixed for the local OS and the local OS path below the backup
+* directory are kept as one string each, with the offsets of the parent
+* directories, so every directory prefix is built once and shared by all
+* entries in it, and leaving a directory only truncates the strings.
+*/
+class FilelistPathStack
+{
+public:
+	FilelistPathStack(void);
+
+	void push(const std::wstring& name, const std::wstring& os_name);
+	void pop(void);
+	size_t depth(void) const;
+
+	//Client path of the current directory, e.g. "/C/Users"
+	const std::wstring& path(void) const;
+	//Path with names fixed for the local OS, separated by '/'
+	const std::wstring& osPath(void) const;
+	//osPath() with the local path separator
+	const std::wstring& localOsPath(void) const;
+	//localOsPath() plus os_name. Valid until the next call.
+	const std::wstring& localOsFilePath(const std::wstring& os_name);
+
+private:
+	std::wstring curr_path;
+	std::wstring curr_os_path;
+	std::wstring local_os_path;
+	std::wstring local_file_path;
+	std::wstring sep;
+
+	struct SOffsets
+	{
+		size_t path;
+		size_t os_path;
+		size_t local_os_path;
+	};
+	std::vector<SOffsets> offsets;
+};
@@ -41,8 +41,15 @@
 #include "snapshot_helper.h"
 #include "../cryptoplugin/ICryptoFactory.h"
 #include "server_hash_existing.h"
+#include "server_link_stage.h"
 #include "server_dir_links.h"
+#include "server_synthetic_image.h"
+#include "server_synthetic_backup.h"
+#include "server_dedup_filter.h"
+#include "server_filelist.h"
+#include "server_metrics.h"
 #include "server.h"
+#include "../urbackupcommon/filelist_delta.h"
 #include <algorithm>
 #include <memory.h>
 #include <time.h>
@@ -102,12 +109,14 @@ BackupServerGet::BackupServerGet(IPipe *pPipe, sockaddr_in pAddr, const std::wst
 	clientaddr_mutex=Server->createMutex();
 	clientname=pName;
 	clientid=0;
+	resetEntryState();
 
 	hashpipe=NULL;
 	hashpipe_prepare=NULL;
 
 	do_full_backup_now=false;
 	do_incr_backup_now=false;
+	synthetic_full_file_failed=false;
 	do_update_settings=false;
 	do_full_image_now=false;
 	do_incr_image_now=false;
@@ -120,6 +129,7 @@ BackupServerGet::BackupServerGet(IPipe *pPipe, sockaddr_in pAddr, const std::wst
 	image_protocol_version=0;
 	update_version=0;
 	eta_version=0;
+	filelist_delta_version=0;
 
 	set_settings_version=0;
 	tcpstack.setAddChecksum(internet_connection);
@@ -220,6 +230,18 @@ namespace
 		}
 	}
 
+	void writeFileItem(IFile* f, const SFilelistEntry& entry)
+	{
+		if(entry.isdir)
+		{
+			writeFileRepeat(f, "d\""+escapeListName(entry.name)+"\"\n");
+		}
+		else
+		{
+			writeFileRepeat(f, "f\""+escapeListName(entry.name)+"\" "+nconvert(entry.size)+" "+nconvert(entry.last_modified)+"\n");
+		}
+	}
+
 	std::string systemErrorInfo()
 	{
 #ifndef _WIN32
@@ -463,7 +485,6 @@ void BackupServerGet::operator ()(void)
 		use_reflink=true;
 #endif
 	use_tmpfiles=server_settings->getSettings()->use_tmpfiles;
-	use_tmpfiles_images=server_settings->getSettings()->use_tmpfiles_images;
 	if(!use_tmpfiles)
 	{
 		tmpfile_path=server_settings->getSettings()->backupfolder+os_file_sep()+L"urbackup_tmp_files";
@@ -634,7 +655,17 @@ void BackupServerGet::operator ()(void)
 			if( server_settings->getSettings()->local_incr_file_transfer_mode=="blockhash")
 				with_hashes=true;
 
-			if( !server_settings->getSettings()->no_file_backups && !internet_no_full_file &&
+			bool synthetic_full_file=false;
+			if( server_settings->getSettings()->synthetic_full_file_backups && !synthetic_full_file_failed
+				&& !server_settings->getSettings()->no_file_backups && !do_full_backup_now
+				&& isUpdateFull() && isInBackupWindow(server_settings->getBackupWindowFullFile())
+				&& exponentialBackoffFile() )
+			{
+				SBackup last=getLastIncremental();
+				synthetic_full_file = last.incremental!=-2 && last.is_complete;
+			}
+
+			if( !server_settings->getSettings()->no_file_backups && !internet_no_full_file && !synthetic_full_file &&
 				( (isUpdateFull() && isInBackupWindow(server_settings->getBackupWindowFullFile())
 					&& exponentialBackoffFile() ) || do_full_backup_now )
 				&& isBackupsRunningOkay(true, true) && !do_full_image_now && !do_full_image_now && !do_incr_backup_now )
@@ -649,6 +680,8 @@ void BackupServerGet::operator ()(void)
 
 				ServerLogger::Log(clientid, "Starting full file backup...", LL_INFO);
 
+				synthetic_full_file_failed=false;
+
 				if(!constructBackupPath(with_hashes, use_snapshots, true))
 				{
 					ServerLogger::Log(clientid, "Cannot create Directory for backup (Server error)", LL_ERROR);
@@ -675,7 +708,7 @@ void BackupServerGet::operator ()(void)
 			}
 			else if( !server_settings->getSettings()->no_file_backups
 				&& ( (isUpdateIncr() && isInBackupWindow(server_settings->getBackupWindowIncrFile())
-					  && exponentialBackoffFile() ) || do_incr_backup_now )
+					  && exponentialBackoffFile() ) || do_incr_backup_now || synthetic_full_file )
 				&& isBackupsRunningOkay(true, true) && !do_full_image_now && !do_full_image_now)
 			{
 				hbu=true;
@@ -686,7 +719,14 @@ void BackupServerGet::operator ()(void)
 
 				createDirectoryForClient();
 
-				ServerLogger::Log(clientid, "Starting incremental file backup...", LL_INFO);
+				if(synthetic_full_file)
+				{
+					ServerLogger::Log(clientid, "Starting incremental file backup for synthetic full file backup...", LL_INFO);
+				}
+				else
+				{
+					ServerLogger::Log(clientid, "Starting incremental file backup...", LL_INFO);
+				}
 				
 				r_incremental=true;
 				if(!constructBackupPath(with_hashes, use_snapshots, false))
@@ -750,6 +790,20 @@ void BackupServerGet::operator ()(void)
 				{
 					if(isUpdateFullImage(vols[i]+":") || do_full_image_now)
 					{
+						bool synthetic=server_settings->getSettings()->synthetic_full_images && !do_full_image_now;
+						bool merge_running=synthetic && ServerSyntheticImage::isRunning(clientid, vols[i]+":");
+						if(merge_running)
+						{
+							ServerLogger::Log(clientid, "Synthetic full image backup of volume "+vols[i]+": is still being created. Doing an incremental image backup instead.", LL_INFO);
+						}
+
+						SBackup last;
+						last.incremental=-2;
+						if(synthetic)
+						{
+							last=getLastIncrementalImage(vols[i]+":");
+						}
+
 						int sysvol_id=-1;
 						if(strlower(vols[i])=="c")
 						{
@@ -761,7 +815,20 @@ void BackupServerGet::operator ()(void)
 							}
 							ServerLogger::Log(clientid, "Backing up SYSVOL done.", LL_DEBUG);
 						}
-						bool b=doImage(vols[i]+":", L"", 0, 0, image_protocol_version>0, server_settings->getSettings()->image_file_format);
+						bool b;
+						if(last.incremental!=-2)
+						{
+							if(!merge_running)
+							{
+								ServerLogger::Log(clientid, "Creating synthetic full image backup of volume "+vols[i]+": from an incremental image backup...", LL_INFO);
+							}
+							b=doImage(vols[i]+":", last.path, last.incremental+1,
+								last.incremental_ref, image_hashed_transfer, server_settings->getSettings()->image_file_format);
+						}
+						else
+						{
+							b=doImage(vols[i]+":", L"", 0, 0, image_protocol_version>0, server_settings->getSettings()->image_file_format);
+						}
 						if(!b)
 						{
 							r_success=false;
@@ -771,6 +838,11 @@ void BackupServerGet::operator ()(void)
 						{
 							saveImageAssociation(backupid, sysvol_id);
 						}
+
+						if(last.incremental!=-2 && !merge_running)
+						{
+							ServerSyntheticImage::start(clientid, backupid, vols[i]+":", server_settings->getSettings()->synthetic_full_image_speed);
+						}
 					}
 				}
 
@@ -911,6 +983,17 @@ void BackupServerGet::operator ()(void)
 					setBackupComplete();
 					ServerLogger::Log(clientid, "Backup succeeded", LL_INFO);
 					count_file_backup_try=0;
+
+					if(synthetic_full_file && r_incremental)
+					{
+						ServerSyntheticBackup synthetic_backup(*backup_dao, clientid, clientname,
+							server_settings->getSettings()->backupfolder, use_snapshots);
+						if(synthetic_backup.create(backupid, backuppath_single)==-1)
+						{
+							ServerLogger::Log(clientid, "Creating synthetic full file backup failed. Next full file backup will be transferred from the client.", LL_WARNING);
+							synthetic_full_file_failed=true;
+						}
+					}
 				}
 				status.pcdone=100;
 				ServerStatus::setServerStatus(status, true);
@@ -1363,115 +1446,118 @@ void BackupServerGet::saveImageAssociation(int image_id, int assoc_id)
 
 bool BackupServerGet::getNextEntry(char ch, SFile &data, std::map<std::wstring, std::wstring>* extra)
 {
-	switch(state)
+	size_t pos=0;
+	if(!list_parser->nextEntry(&ch, 1, pos, list_entry))
 	{
-	case 0:
-		if(ch=='f')
-			data.isdir=false;
-		else if(ch=='d')
-			data.isdir=true;
-		else
-			ServerLogger::Log(clientid, "Error parsing file BackupServerGet::getNextEntry - 1", LL_ERROR);
-		state=1;
-		break;
-	case 1:
-		//"
-		state=2;
-		break;
-	case 3:
-		if(ch!='"')
-		{
-			t_name.erase(t_name.size()-1,1);
-			data.name=Server->ConvertToUnicode(t_name);
-			t_name="";
-			if(data.isdir)
-			{
-				resetEntryState();
-				return true;
-			}
-			else
-				state=4;
-		}
-	case 2:
-		if(state==2 && ch=='"')
-		{
-			state=3;
-		}
-		else if(state==2 && ch=='\\')
-		{
-			state=7;
-			break;
-		}
-		else if(state==3)
-		{
-			state=2;
-		}
-		
-		t_name+=ch;
-		break;
-	case 7:
-		if(ch!='"' && ch!='\\')
-		{
-			t_name+='\\';
-		}
-		t_name+=ch;
-		state=2;
-		break;
-	case 4:
-		if(ch!=' ')
-		{
-			t_name+=ch;
-		}
-		else
-		{
-			data.size=os_atoi64(t_name);
-			t_name="";
-			state=5;
-		}
-		break;
-	case 5:
-		if(ch!='\n' && ch!='#')
-		{
-			t_name+=ch;
-		}
-		else
-		{
-			data.last_modified=os_atoi64(t_name);
-			if(ch=='\n')
-			{
-				resetEntryState();
-				return true;
-			}
-			else
-			{
-				t_name="";
-				state=6;
-			}
-		}
-		break;
-	case 6:
-		if(ch!='\n')
-		{
-			t_name+=ch;
-		}
-		else
-		{
-			if(extra!=NULL)
-			{
-				ParseParamStrHttp(t_name, extra, false);
-			}
-			resetEntryState();
-			return true;
-		}
-		break;
+		return false;
 	}
-	return false;
+
+	list_entry.toSFile(data);
+	if(extra!=NULL && !list_entry.extra.empty())
+	{
+		ParseParamStrHttp(list_entry.extra, extra, false);
+	}
+	return true;
+}
+
+std::string BackupServerGet::getFilelistBaseHash(void)
+{
+	if(!FileExists("urbackup/filelist_base_"+nconvert(clientid)+".ub"))
+	{
+		return std::string();
+	}
+
+	std::string hash=trim(getFile("urbackup/filelist_base_"+nconvert(clientid)+".hash"));
+	if(!IsHex(hash))
+	{
+		return std::string();
+	}
+	return hash;
+}
+
+void BackupServerGet::saveFilelistBase(IFile* filelist, std::string hash)
+{
+	if(filelist_delta_version<1)
+	{
+		return;
+	}
+
+	std::string base_fn="urbackup/filelist_base_"+nconvert(clientid);
+	Server->deleteFile(base_fn+".hash");
+
+	if(hash.empty())
+	{
+		hash=filelist_hash(filelist);
+	}
+
+	IFile* base=Server->openFile(base_fn+"_new.ub", MODE_WRITE);
+	if(base==NULL || hash.empty())
+	{
+		ServerLogger::Log(clientid, "Error saving file list delta base of client", LL_WARNING);
+		if(base!=NULL) Server->destroy(base);
+		return;
+	}
+
+	std::vector<char> buffer(32768);
+	bool ok=filelist->Seek(0);
+	_u32 read;
+	while(ok && (read=filelist->Read(&buffer[0], static_cast<_u32>(buffer.size())))>0)
+	{
+		ok=base->Write(&buffer[0], read)==read;
+	}
+	Server->destroy(base);
+
+	if(!ok || !os_rename_file(widen(base_fn+"_new.ub"), widen(base_fn+".ub")))
+	{
+		ServerLogger::Log(clientid, "Error saving file list delta base of client", LL_WARNING);
+		Server->deleteFile(base_fn+"_new.ub");
+		return;
+	}
+
+	writestring(hash, base_fn+".hash");
+}
+
+bool BackupServerGet::loadFilelistDelta(FileClient& fc, IFile* filelist, bool hashed_transfer)
+{
+	IFile* delta=getTemporaryFileRetry(use_tmpfiles, tmpfile_path, clientid);
+	if(delta==NULL)
+	{
+		return false;
+	}
+
+	_u32 rc=fc.GetFile("urbackup/filelist_delta.ub", delta, hashed_transfer);
+	if(rc!=ERR_SUCCESS)
+	{
+		ServerLogger::Log(clientid, L"Error getting file list delta of "+clientname+L". Errorcode: "+widen(fc.getErrorString(rc))+L" ("+convert(rc)+L")", LL_DEBUG);
+		destroyTemporaryFile(delta);
+		return false;
+	}
+
+	IFile* base=Server->openFile("urbackup/filelist_base_"+nconvert(clientid)+".ub", MODE_READ);
+	if(base==NULL)
+	{
+		destroyTemporaryFile(delta);
+		return false;
+	}
+
+	std::string new_hash;
+	bool ok=apply_filelist_delta(base, filelist_delta_base, delta, filelist, &new_hash);
+	Server->destroy(base);
+
+	if(ok)
+	{
+		ServerLogger::Log(clientid, clientname+L": Loaded file list delta with "+widen(PrettyPrintBytes(delta->Size()))+L" (file list "+widen(PrettyPrintBytes(filelist->Size()))+L")", LL_DEBUG);
+		ServerMetrics::addCounter("urbackup_filelist_bytes_total{mode=\"delta\"}", delta->Size());
+		saveFilelistBase(filelist, new_hash);
+	}
+
+	destroyTemporaryFile(delta);
+	return ok;
 }
 
 void BackupServerGet::resetEntryState(void)
 {
-	t_name="";
-	state=0;
+	list_parser.reset(new FilelistParser(clientid));
 }
 
 bool BackupServerGet::request_filelist_construct(bool full, bool resume, bool with_token, bool& no_backup_dirs, bool& connect_fail)
@@ -1532,6 +1618,17 @@ bool BackupServerGet::request_filelist_construct(bool full, bool resume, bool wi
 			start_backup_cmd+="incr";
 	}
 
+	filelist_delta_base.clear();
+	if(!full && file_protocol_version_v2>=1 && filelist_delta_version>=1)
+	{
+		filelist_delta_base=getFilelistBaseHash();
+		if(!filelist_delta_base.empty())
+		{
+			start_backup_cmd+=resume ? "&" : " ";
+			start_backup_cmd+="filelist_base="+filelist_delta_base;
+		}
+	}
+
 	if(with_token)
 	{
 		start_backup_cmd+="#token="+server_token;
@@ -1693,11 +1790,13 @@ bool BackupServerGet::doFullBackup(bool with_hashes, bool &disk_error, bool &log
 		return false;
 	}
 
+	ServerMetrics::addCounter("urbackup_filelist_bytes_total{mode=\"full\"}", tmp->Size());
+	ServerMetrics::addLatency("urbackup_filelist_transfer_ms", Server->getTimeMS()-full_backup_starttime);
+	saveFilelistBase(tmp, std::string());
+
 	backupid=createBackupSQL(0, clientid, backuppath_single, false, Server->getTimeMS()-indexing_start_time);
 	
 	tmp->Seek(0);
-	
-	resetEntryState();
 
 	IFile *clientlist=Server->openFile("urbackup/clientlist_"+nconvert(clientid)+"_new.ub", MODE_WRITE);
 
@@ -1719,8 +1818,9 @@ bool BackupServerGet::doFullBackup(bool with_hashes, bool &disk_error, bool &log
 
 	char buffer[4096];
 	_u32 read;
-	std::wstring curr_path;
-	std::wstring curr_os_path;
+	FilelistPathStack path_stack;
+	FilelistParser filelist_parser(clientid);
+	SFilelistEntry filelist_entry;
 	SFile cf;
 	int depth=0;
 	bool r_done=false;
@@ -1770,111 +1870,104 @@ bool BackupServerGet::doFullBackup(bool with_hashes, bool &disk_error, bool &log
 			break;
 		}
 
-		for(size_t i=0;i<read;++i)
+		size_t i=0;
+		while(filelist_parser.nextEntry(buffer, read, i, filelist_entry))
 		{
-			std::map<std::wstring, std::wstring> extra_params;
-			bool b=getNextEntry(buffer[i], cf, &extra_params);
-			if(b)
+			filelist_entry.toSFile(cf);
+
+			int64 ctime=Server->getTimeMS();
+			if(ctime-laststatsupdate>status_update_intervall)
 			{
-				int64 ctime=Server->getTimeMS();
-				if(ctime-laststatsupdate>status_update_intervall)
+				laststatsupdate=ctime;
+				if(files_size==0)
 				{
-					laststatsupdate=ctime;
-					if(files_size==0)
-					{
-						status.pcdone=100;
-					}
-					else
-					{
-						status.pcdone=(std::min)(100,(int)(((float)fc.getReceivedDataBytes() + linked_bytes)/((float)files_size/100.f)+0.5f));
-					}
-					status.hashqueuesize=(_u32)hashpipe->getNumElements();
-					status.prepare_hashqueuesize=(_u32)hashpipe_prepare->getNumElements();
-					ServerStatus::setServerStatus(status, true);
+					status.pcdone=100;
 				}
-
-				if(ctime-last_eta_update>eta_update_intervall)
+				else
 				{
-					calculateEtaFileBackup(last_eta_update, ctime, fc, NULL, linked_bytes, last_eta_received_bytes, eta_estimated_speed, files_size);
+					status.pcdone=(std::min)(100,(int)(((float)fc.getReceivedDataBytes() + linked_bytes)/((float)files_size/100.f)+0.5f));
 				}
+				status.hashqueuesize=(_u32)bsh->getQueueSize();
+				status.prepare_hashqueuesize=(_u32)bsh_prepare->getQueueSize();
+				ServerStatus::setServerStatus(status, true);
+			}
 
-				if(server_download->isOffline())
-				{
-					ServerLogger::Log(clientid, L"Client "+clientname+L" went offline.", LL_ERROR);
-					is_offline = true;
-					r_done=true;
-					break;
-				}
+			if(ctime-last_eta_update>eta_update_intervall)
+			{
+				calculateEtaFileBackup(last_eta_update, ctime, fc, NULL, linked_bytes, last_eta_received_bytes, eta_estimated_speed, files_size);
+			}
 
-				std::wstring osspecific_name=fixFilenameForOS(cf.name);
-				if(cf.isdir)
+			if(server_download->isOffline())
+			{
+				ServerLogger::Log(clientid, L"Client "+clientname+L" went offline.", LL_ERROR);
+				is_offline = true;
+				r_done=true;
+				break;
+			}
+
+			std::wstring osspecific_name=fixFilenameForOS(cf.name);
+			if(cf.isdir)
+			{
+				if(!filelist_entry.isParentDir())
 				{
-					if(cf.name!=L"..")
-					{
-						curr_path+=L"/"+cf.name;
-						curr_os_path+=L"/"+osspecific_name;
-						std::wstring local_curr_os_path=convertToOSPathFromFileClient(curr_os_path);
+					path_stack.push(cf.name, osspecific_name);
+					const std::wstring& local_curr_os_path=path_stack.localOsPath();
 
-						if(!os_create_dir(os_file_prefix(backuppath+local_curr_os_path)))
-						{
-							ServerLogger::Log(clientid, L"Creating directory  \""+backuppath+local_curr_os_path+L"\" failed. - " + widen(systemErrorInfo()), LL_ERROR);
-							c_has_error=true;
-							break;
-						}
-						if(with_hashes && !os_create_dir(os_file_prefix(backuppath_hashes+local_curr_os_path)))
-						{
-							ServerLogger::Log(clientid, L"Creating directory  \""+backuppath_hashes+local_curr_os_path+L"\" failed. - " + widen(systemErrorInfo()), LL_ERROR);
-							c_has_error=true;
-							break;
-						}
-						++depth;
-						if(depth==1)
-						{
-							std::wstring t=curr_path;
-							t.erase(0,1);
-							ServerLogger::Log(clientid, L"Starting shadowcopy \""+t+L"\".", LL_DEBUG);
-							server_download->addToQueueStartShadowcopy(t);
-							Server->wait(10000);
-						}
+					if(!os_create_dir(os_file_prefix(backuppath+local_curr_os_path)))
+					{
+						ServerLogger::Log(clientid, L"Creating directory  \""+backuppath+local_curr_os_path+L"\" failed. - " + widen(systemErrorInfo()), LL_ERROR);
+						c_has_error=true;
+						break;
 					}
-					else
+					if(with_hashes && !os_create_dir(os_file_prefix(backuppath_hashes+local_curr_os_path)))
 					{
-						--depth;
-						if(depth==0)
-						{
-							std::wstring t=curr_path;
-							t.erase(0,1);
-							ServerLogger::Log(clientid, L"Stoping shadowcopy \""+t+L"\".", LL_DEBUG);
-							server_download->addToQueueStopShadowcopy(t);
-						}
-						curr_path=ExtractFilePath(curr_path, L"/");
-						curr_os_path=ExtractFilePath(curr_os_path, L"/");
+						ServerLogger::Log(clientid, L"Creating directory  \""+backuppath_hashes+local_curr_os_path+L"\" failed. - " + widen(systemErrorInfo()), LL_ERROR);
+						c_has_error=true;
+						break;
+					}
+					++depth;
+					if(depth==1)
+					{
+						std::wstring t=path_stack.path().substr(1);
+						ServerLogger::Log(clientid, L"Starting shadowcopy \""+t+L"\".", LL_DEBUG);
+						server_download->addToQueueStartShadowcopy(t);
+						Server->wait(10000);
 					}
 				}
 				else
 				{
-					bool file_ok=false;
-					std::map<std::wstring, std::wstring>::iterator hash_it=( (local_hash==NULL)?extra_params.end():extra_params.find(L"sha512") );
-					if( hash_it!=extra_params.end())
+					--depth;
+					if(depth==0)
 					{
-						if(link_file(cf.name, osspecific_name, curr_path, curr_os_path, with_hashes, base64_decode_dash(wnarrow(hash_it->second)), cf.size, true))
-						{
-							file_ok=true;
-							linked_bytes+=cf.size;
-							if(line>max_ok_id)
-							{
-								max_ok_id=line;
-							}
-						}
+						std::wstring t=path_stack.path().substr(1);
+						ServerLogger::Log(clientid, L"Stoping shadowcopy \""+t+L"\".", LL_DEBUG);
+						server_download->addToQueueStopShadowcopy(t);
 					}
-					if(!file_ok)
+					path_stack.pop();
+				}
+			}
+			else
+			{
+				bool file_ok=false;
+				if(local_hash!=NULL && filelist_entry.hasExtra(EFilelistExtra_Sha512))
+				{
+					if(link_file(cf.name, osspecific_name, path_stack.path(), path_stack.osPath(), with_hashes, filelist_entry.getSha512(), cf.size, true))
 					{
-						server_download->addToQueueFull(line, cf.name, osspecific_name, curr_path, curr_os_path, queue_downloads?cf.size:-1);
+						file_ok=true;
+						linked_bytes+=cf.size;
+						if(line>max_ok_id)
+						{
+							max_ok_id=line;
+						}
 					}
 				}
-
-				++line;
+				if(!file_ok)
+				{
+					server_download->addToQueueFull(line, cf.name, osspecific_name, path_stack.path(), path_stack.osPath(), queue_downloads?cf.size:-1);
+				}
 			}
+
+			++line;
 		}
 
 		if(read<4096)
@@ -1895,8 +1988,8 @@ bool BackupServerGet::doFullBackup(bool with_hashes, bool &disk_error, bool &log
 		{
 			status.pcdone=(std::min)(100,(int)(((float)fc.getReceivedDataBytes())/((float)files_size/100.f)+0.5f));
 		}
-		status.hashqueuesize=(_u32)hashpipe->getNumElements();
-		status.prepare_hashqueuesize=(_u32)hashpipe_prepare->getNumElements();
+		status.hashqueuesize=(_u32)bsh->getQueueSize();
+		status.prepare_hashqueuesize=(_u32)bsh_prepare->getQueueSize();
 		ServerStatus::setServerStatus(status, true);
 
 		int64 ctime = Server->getTimeMS();
@@ -1930,30 +2023,27 @@ bool BackupServerGet::doFullBackup(bool with_hashes, bool &disk_error, bool &log
 
 	tmp->Seek(0);
 	line = 0;
-	resetEntryState();
+	filelist_parser.reset();
 	while( (read=tmp->Read(buffer, 4096))>0 )
 	{
-		for(size_t i=0;i<read;++i)
+		size_t i=0;
+		while(filelist_parser.nextEntry(buffer, read, i, filelist_entry))
 		{
-			bool b=getNextEntry(buffer[i], cf, NULL);
-			if(b)
+			if(filelist_entry.isdir && line<max_line)
+			{
+				writeFileItem(clientlist, filelist_entry);
+			}
+			else if(!filelist_entry.isdir && 
+				line <= (std::max)(server_download->getMaxOkId(), max_ok_id) &&
+				server_download->isDownloadOk(line) )
 			{
-				if(cf.isdir && line<max_line)
+				if(server_download->isDownloadPartial(line))
 				{
-					writeFileItem(clientlist, cf);
+					filelist_entry.last_modified *= Server->getRandomNumber();
 				}
-				else if(!cf.isdir && 
-					line <= (std::max)(server_download->getMaxOkId(), max_ok_id) &&
-					server_download->isDownloadOk(line) )
-				{
-					if(server_download->isDownloadPartial(line))
-					{
-						cf.last_modified *= Server->getRandomNumber();
-					}
-					writeFileItem(clientlist, cf);
-				}				
-				++line;
-			}
+				writeFileItem(clientlist, filelist_entry);
+			}				
+			++line;
 		}
 	}
 	
@@ -1995,7 +2085,7 @@ bool BackupServerGet::doFullBackup(bool with_hashes, bool &disk_error, bool &log
 			ServerLogger::Log(clientid, "Renaming new client file list to destination failed", LL_ERROR);
 		}
 		setBackupDone();
-		db->EndTransaction();
+		timedEndTransaction(db, "backup");
 	}
 
 	if( r_done==false && c_has_error==false && disk_error==false) 
@@ -2078,8 +2168,8 @@ _i64 BackupServerGet::getIncrementalSize(IFile *f, const std::vector<size_t> &di
 {
 	f->Seek(0);
 	_i64 rsize=0;
-	resetEntryState();
-	SFile cf;
+	FilelistParser filelist_parser(clientid);
+	SFilelistEntry filelist_entry;
 	bool indirchange=false;
 	size_t read;
 	size_t line=0;
@@ -2096,57 +2186,54 @@ _i64 BackupServerGet::getIncrementalSize(IFile *f, const std::vector<size_t> &di
 
 	while( (read=f->Read(buffer, 4096))>0 )
 	{
-		for(size_t i=0;i<read;++i)
+		size_t i=0;
+		while(filelist_parser.nextEntry(buffer, read, i, filelist_entry))
 		{
-			bool b=getNextEntry(buffer[i], cf, NULL);
-			if(b)
+			if(filelist_entry.isdir==true)
 			{
-				if(cf.isdir==true)
+				if(indirchange==false && hasChange(line, diffs) )
 				{
-					if(indirchange==false && hasChange(line, diffs) )
-					{
-						indirchange=true;
-						changelevel=depth;
-						indir_currdepth=0;
-					}
-					else if(indirchange==true)
-					{
-						if(cf.name!=L"..")
-							++indir_currdepth;
-						else
-							--indir_currdepth;
-					}
-
-					if(cf.name==L".." && indir_currdepth>0)
-					{
+					indirchange=true;
+					changelevel=depth;
+					indir_currdepth=0;
+				}
+				else if(indirchange==true)
+				{
+					if(!filelist_entry.isParentDir())
+						++indir_currdepth;
+					else
 						--indir_currdepth;
-					}
+				}
 
-					if(cf.name!=L"..")
-					{
-						++depth;
-					}
-					else
+				if(filelist_entry.isParentDir() && indir_currdepth>0)
+				{
+					--indir_currdepth;
+				}
+
+				if(!filelist_entry.isParentDir())
+				{
+					++depth;
+				}
+				else
+				{
+					--depth;
+					if(indirchange==true && depth==changelevel)
 					{
-						--depth;
-						if(indirchange==true && depth==changelevel)
+						if(!all)
 						{
-							if(!all)
-							{
-								indirchange=false;
-							}
+							indirchange=false;
 						}
 					}
 				}
-				else
+			}
+			else
+			{
+				if(indirchange==true || hasChange(line, diffs))
 				{
-					if(indirchange==true || hasChange(line, diffs))
-					{
-						rsize+=cf.size;
-					}
+					rsize+=filelist_entry.size;
 				}
-				++line;
 			}
+			++line;
 		}
 
 		if(read<4096)
@@ -2305,13 +2392,38 @@ bool BackupServerGet::doIncrBackup(bool with_hashes, bool intra_file_diffs, bool
 	int64 incr_backup_starttime=Server->getTimeMS();
 	int64 incr_backup_stoptime=0;
 
-	rc=fc.GetFile("urbackup/filelist.ub", tmp, hashed_transfer);
-	if(rc!=ERR_SUCCESS)
+	bool filelist_loaded=false;
+	if(!filelist_delta_base.empty())
 	{
-		ServerLogger::Log(clientid, L"Error getting filelist of "+clientname+L". Errorcode: "+widen(fc.getErrorString(rc))+L" ("+convert(rc)+L")", LL_ERROR);
-		has_error=true;
-		return false;
+		filelist_loaded=loadFilelistDelta(fc, tmp, hashed_transfer);
+		if(!filelist_loaded)
+		{
+			ServerLogger::Log(clientid, clientname+L": Loading file list delta failed. Loading full file list...", LL_INFO);
+			destroyTemporaryFile(tmp);
+			tmp=getTemporaryFileRetry(use_tmpfiles, tmpfile_path, clientid);
+			if(tmp==NULL)
+			{
+				ServerLogger::Log(clientid, L"Error creating temporary file in ::doIncrBackup", LL_ERROR);
+				return false;
+			}
+		}
 	}
+
+	if(!filelist_loaded)
+	{
+		rc=fc.GetFile("urbackup/filelist.ub", tmp, hashed_transfer);
+		if(rc!=ERR_SUCCESS)
+		{
+			ServerLogger::Log(clientid, L"Error getting filelist of "+clientname+L". Errorcode: "+widen(fc.getErrorString(rc))+L" ("+convert(rc)+L")", LL_ERROR);
+			has_error=true;
+			return false;
+		}
+
+		ServerMetrics::addCounter("urbackup_filelist_bytes_total{mode=\"full\"}", tmp->Size());
+		saveFilelistBase(tmp, std::string());
+	}
+
+	ServerMetrics::addLatency("urbackup_filelist_transfer_ms", Server->getTimeMS()-incr_backup_starttime);
 	
 	ServerLogger::Log(clientid, clientname+L" Starting incremental backup...", LL_DEBUG);
 
@@ -2458,12 +2570,25 @@ bool BackupServerGet::doIncrBackup(bool with_hashes, bool intra_file_diffs, bool
 		server_hash_existing_ticket =
 			Server->getThreadPool()->execute(server_hash_existing.get());
 	}
+
+	std::auto_ptr<ServerHashLinkStage> server_link_stage;
+	size_t link_threads=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("link_threads", "4"))));
+	if(local_hash!=NULL && link_threads>0)
+	{
+		size_t link_batch_size=static_cast<size_t>(watoi(Server->ConvertToUnicode(Server->getServerParameter("link_batch_size", "64"))));
+		server_link_stage.reset(new ServerHashLinkStage(link_threads, link_batch_size, clientid, backupid, with_hashes,
+			backuppath, backuppath_hashes, use_snapshots, use_reflink, use_tmpfiles, server_download.get(),
+			intra_file_diffs, queue_downloads));
+		server_link_stage->start();
+	}
+
+	DirectoryLinkBatch dir_link_batch(*backup_dao, clientid, dir_pool_path, BackupServer::isFilesystemTransactionEnabled());
 	
 	char buffer[4096];
 	_u32 read;
-	std::wstring curr_path;
-	std::wstring curr_os_path;
-	std::wstring curr_hash_path;
+	FilelistPathStack path_stack;
+	FilelistParser filelist_parser(clientid);
+	SFilelistEntry filelist_entry;
 	SFile cf;
 	int depth=0;
 	int line=0;
@@ -2496,8 +2621,6 @@ bool BackupServerGet::doIncrBackup(bool with_hashes, bool intra_file_diffs, bool
 	
 	ServerLogger::Log(clientid, clientname+L": Linking unchanged and loading new files...", LL_INFO);
 
-	resetEntryState();
-	
 	bool c_has_error=false;
 	bool backup_stopped=false;
 	size_t skip_dir_completely=0;
@@ -2521,360 +2644,362 @@ bool BackupServerGet::doIncrBackup(bool with_hashes, bool intra_file_diffs, bool
 		}
 
 		filelist_currpos+=read;
-
-		for(size_t i=0;i<read;++i)
-		{
-			std::map<std::wstring, std::wstring> extra_params;
-			bool b=getNextEntry(buffer[i], cf, &extra_params);
-			if(b)
-			{
-				std::wstring osspecific_name=fixFilenameForOS(cf.name);		
-
-				if(skip_dir_completely>0)
-				{
-					if(cf.isdir)
-					{						
-						if(cf.name==L"..")
-						{
-							--skip_dir_completely;
-							if(skip_dir_completely>0)
-							{
-								curr_os_path=ExtractFilePath(curr_os_path, L"/");
-								curr_path=ExtractFilePath(curr_path, L"/");
-							}
-						}
-						else
-						{
-							curr_os_path+=L"/"+osspecific_name;
-							curr_path+=L"/"+cf.name;
-							++skip_dir_completely;
-						}
-					}
-					else if(skip_dir_copy_sparse)
+
+		size_t i=0;
+		while(filelist_parser.nextEntry(buffer, read, i, filelist_entry))
+		{
+			filelist_entry.toSFile(cf);
+			std::wstring osspecific_name=fixFilenameForOS(cf.name);		
+
+			if(skip_dir_completely>0)
+			{
+				if(cf.isdir)
+				{						
+					if(filelist_entry.isParentDir())
 					{
-						std::string curr_sha2;
+						--skip_dir_completely;
+						if(skip_dir_completely>0)
 						{
-							std::map<std::wstring, std::wstring>::iterator hash_it = 
-								( (local_hash==NULL)?extra_params.end():extra_params.find(L"sha512") );					
-							if(hash_it!=extra_params.end())
-							{
-								curr_sha2 = base64_decode_dash(wnarrow(hash_it->second));
-							}
+							path_stack.pop();
 						}
-						std::wstring local_curr_os_path=convertToOSPathFromFileClient(curr_os_path+L"/"+osspecific_name);
-						addSparseFileEntry(curr_path, cf, copy_file_entries_sparse_modulo, incremental_num, trust_client_hashes,
-							curr_sha2, local_curr_os_path, with_hashes, server_hash_existing, num_readded_entries);
 					}
-
-
-					if(skip_dir_completely>0)
+					else
 					{
-						++line;
-						continue;
+						path_stack.push(cf.name, osspecific_name);
+						++skip_dir_completely;
 					}
 				}
-
-				int64 ctime=Server->getTimeMS();
-				if(ctime-laststatsupdate>status_update_intervall)
+				else if(skip_dir_copy_sparse)
 				{
-					laststatsupdate=ctime;
-					if(files_size==0)
-					{
-						status.pcdone=100;
-					}
-					else
+					std::string curr_sha2;
+					if(local_hash!=NULL)
 					{
-						status.pcdone=(std::min)(100,(int)(((float)(fc.getReceivedDataBytes() + (fc_chunked.get()?fc_chunked->getReceivedDataBytes():0) + linked_bytes))/((float)files_size/100.f)+0.5f));
+						curr_sha2 = filelist_entry.getSha512();
 					}
-					status.hashqueuesize=(_u32)hashpipe->getNumElements();
-					status.prepare_hashqueuesize=(_u32)hashpipe_prepare->getNumElements();
-					ServerStatus::setServerStatus(status, true);
+					const std::wstring& local_curr_os_path=path_stack.localOsFilePath(osspecific_name);
+					addSparseFileEntry(path_stack.path(), cf, copy_file_entries_sparse_modulo, incremental_num, trust_client_hashes,
+						curr_sha2, local_curr_os_path, with_hashes, server_hash_existing, num_readded_entries);
 				}
 
-				if(ctime-last_eta_update>eta_update_intervall)
+
+				if(skip_dir_completely>0)
 				{
-					calculateEtaFileBackup(last_eta_update, ctime, fc, fc_chunked.get(), linked_bytes, last_eta_received_bytes, eta_estimated_speed, files_size);
+					++line;
+					continue;
 				}
+			}
 
-				if(server_download->isOffline() && !r_offline)
+			int64 ctime=Server->getTimeMS();
+			if(ctime-laststatsupdate>status_update_intervall)
+			{
+				laststatsupdate=ctime;
+				if(server_link_stage.get()!=NULL)
+				{
+					linked_bytes+=server_link_stage->takeLinkedBytes();
+				}
+				if(files_size==0)
+				{
+					status.pcdone=100;
+				}
+				else
 				{
-					ServerLogger::Log(clientid, L"Client "+clientname+L" went offline.", LL_ERROR);
-					r_offline=true;
-					incr_backup_stoptime=Server->getTimeMS();
+					status.pcdone=(std::min)(100,(int)(((float)(fc.getReceivedDataBytes() + (fc_chunked.get()?fc_chunked->getReceivedDataBytes():0) + linked_bytes))/((float)files_size/100.f)+0.5f));
 				}
+				status.hashqueuesize=(_u32)bsh->getQueueSize();
+				status.prepare_hashqueuesize=(_u32)bsh_prepare->getQueueSize();
+				ServerStatus::setServerStatus(status, true);
+			}
 
-				
-				if(cf.isdir==true)
+			if(ctime-last_eta_update>eta_update_intervall)
+			{
+				calculateEtaFileBackup(last_eta_update, ctime, fc, fc_chunked.get(), linked_bytes, last_eta_received_bytes, eta_estimated_speed, files_size);
+			}
+
+			if(server_download->isOffline() && !r_offline)
+			{
+				ServerLogger::Log(clientid, L"Client "+clientname+L" went offline.", LL_ERROR);
+				r_offline=true;
+				incr_backup_stoptime=Server->getTimeMS();
+			}
+
+			
+			if(cf.isdir==true)
+			{
+				if(!indirchange && hasChange(line, diffs) )
 				{
-					if(!indirchange && hasChange(line, diffs) )
-					{
-						indirchange=true;
-						changelevel=depth;
-						indir_currdepth=0;
+					indirchange=true;
+					changelevel=depth;
+					indir_currdepth=0;
 
-						if(cf.name!=L"..")
-						{
-							indir_currdepth=1;
-						}
-						else
-						{
-							--changelevel;
-						}
+					if(!filelist_entry.isParentDir())
+					{
+						indir_currdepth=1;
 					}
-					else if(indirchange)
+					else
 					{
-						if(cf.name!=L"..")
-							++indir_currdepth;
-						else
-							--indir_currdepth;
+						--changelevel;
 					}
+				}
+				else if(indirchange)
+				{
+					if(!filelist_entry.isParentDir())
+						++indir_currdepth;
+					else
+						--indir_currdepth;
+				}
 
-					if(cf.name!=L"..")
-					{
-						curr_path+=L"/"+cf.name;
-						curr_os_path+=L"/"+osspecific_name;
-						std::wstring local_curr_os_path=convertToOSPathFromFileClient(curr_os_path);
+				if(!filelist_entry.isParentDir())
+				{
+					path_stack.push(cf.name, osspecific_name);
+					const std::wstring& local_curr_os_path=path_stack.localOsPath();
 
-						bool dir_linked=false;
-						if(use_directory_links && hasChange(line, large_unchanged_subtrees) )
+					bool dir_linked=false;
+					if(use_directory_links && hasChange(line, large_unchanged_subtrees) )
+					{
+						std::wstring srcpath=last_backuppath+local_curr_os_path;
+						if(dir_link_batch.link(backuppath+local_curr_os_path, srcpath) )
 						{
-							std::wstring srcpath=last_backuppath+local_curr_os_path;
-							if(link_directory_pool(*backup_dao, clientid, backuppath+local_curr_os_path,
-								                   srcpath, dir_pool_path, BackupServer::isFilesystemTransactionEnabled()) )
-							{
-								skip_dir_completely=1;
-								dir_linked=true;
-								bool curr_has_hashes = false;
+							skip_dir_completely=1;
+							dir_linked=true;
+							bool curr_has_hashes = false;
 
-								std::wstring src_hashpath = last_backuppath_hashes+local_curr_os_path;
+							std::wstring src_hashpath = last_backuppath_hashes+local_curr_os_path;
 
-								if(with_hashes)
-								{
-									curr_has_hashes = link_directory_pool(*backup_dao, clientid, backuppath_hashes+local_curr_os_path,
-										src_hashpath, dir_pool_path, BackupServer::isFilesystemTransactionEnabled());
-								}
+							if(with_hashes)
+							{
+								curr_has_hashes = dir_link_batch.link(backuppath_hashes+local_curr_os_path, src_hashpath);
+							}
 
-								if(copy_last_file_entries)
+							if(copy_last_file_entries)
+							{
+								std::vector<ServerBackupDao::SFileEntry> file_entries = backup_dao->getFileEntriesFromTemporaryTableGlob(escape_glob_sql(srcpath)+os_file_sep()+L"*");
+								for(size_t i=0;i<file_entries.size();++i)
 								{
-									std::vector<ServerBackupDao::SFileEntry> file_entries = backup_dao->getFileEntriesFromTemporaryTableGlob(escape_glob_sql(srcpath)+os_file_sep()+L"*");
-									for(size_t i=0;i<file_entries.size();++i)
+									if(file_entries[i].fullpath.size()>srcpath.size())
 									{
-										if(file_entries[i].fullpath.size()>srcpath.size())
+										std::wstring entry_hashpath;
+										if( curr_has_hashes && next(file_entries[i].hashpath, 0, src_hashpath))
 										{
-											std::wstring entry_hashpath;
-											if( curr_has_hashes && next(file_entries[i].hashpath, 0, src_hashpath))
-											{
-												entry_hashpath = backuppath_hashes+local_curr_os_path + file_entries[i].hashpath.substr(src_hashpath.size());
-											}
+											entry_hashpath = backuppath_hashes+local_curr_os_path + file_entries[i].hashpath.substr(src_hashpath.size());
+										}
 
-											backup_dao->insertIntoTemporaryNewFilesTable(backuppath + local_curr_os_path + file_entries[i].fullpath.substr(srcpath.size()), entry_hashpath,
-												file_entries[i].shahash, file_entries[i].filesize);
+										backup_dao->insertIntoTemporaryNewFilesTable(backuppath + local_curr_os_path + file_entries[i].fullpath.substr(srcpath.size()), entry_hashpath,
+											file_entries[i].shahash, file_entries[i].filesize);
 
-											++num_copied_file_entries;
-										}
+										++num_copied_file_entries;
 									}
-
-									skip_dir_copy_sparse = false;
-								}
-								else
-								{
-									skip_dir_copy_sparse = readd_file_entries_sparse;
 								}
+
+								skip_dir_copy_sparse = false;
+							}
+							else
+							{
+								skip_dir_copy_sparse = readd_file_entries_sparse;
 							}
 						}
-						if(!dir_linked && (!on_snapshot || indirchange) )
+					}
+					if(!dir_linked && (!on_snapshot || indirchange) )
+					{
+						if(!os_create_dir(os_file_prefix(backuppath+local_curr_os_path)))
 						{
-							if(!os_create_dir(os_file_prefix(backuppath+local_curr_os_path)))
+							if(!os_directory_exists(os_file_prefix(backuppath+local_curr_os_path)))
 							{
-								if(!os_directory_exists(os_file_prefix(backuppath+local_curr_os_path)))
-								{
-									ServerLogger::Log(clientid, L"Creating directory  \""+backuppath+local_curr_os_path+L"\" failed. - " + widen(systemErrorInfo()), LL_ERROR);
-									c_has_error=true;
-									break;
-								}
-								else
-								{
-									ServerLogger::Log(clientid, L"Directory \""+backuppath+local_curr_os_path+L"\" does already exist.", LL_WARNING);
-								}
+								ServerLogger::Log(clientid, L"Creating directory  \""+backuppath+local_curr_os_path+L"\" failed. - " + widen(systemErrorInfo()), LL_ERROR);
+								c_has_error=true;
+								break;
 							}
-							if(with_hashes && !os_create_dir(os_file_prefix(backuppath_hashes+local_curr_os_path)))
+							else
 							{
-								if(!os_directory_exists(os_file_prefix(backuppath_hashes+local_curr_os_path)))
-								{
-									ServerLogger::Log(clientid, L"Creating directory  \""+backuppath_hashes+local_curr_os_path+L"\" failed. - " + widen(systemErrorInfo()), LL_ERROR);
-									c_has_error=true;
-									break;
-								}
-								else
-								{
-									ServerLogger::Log(clientid, L"Directory  \""+backuppath_hashes+local_curr_os_path+L"\" does already exist. - " + widen(systemErrorInfo()), LL_WARNING);
-								}
+								ServerLogger::Log(clientid, L"Directory \""+backuppath+local_curr_os_path+L"\" does already exist.", LL_WARNING);
 							}
 						}
-						++depth;
-						if(depth==1)
+						if(with_hashes && !os_create_dir(os_file_prefix(backuppath_hashes+local_curr_os_path)))
 						{
-							std::wstring t=curr_path;
-							t.erase(0,1);
-							server_download->addToQueueStartShadowcopy(t);
+							if(!os_directory_exists(os_file_prefix(backuppath_hashes+local_curr_os_path)))
+							{
+								ServerLogger::Log(clientid, L"Creating directory  \""+backuppath_hashes+local_curr_os_path+L"\" failed. - " + widen(systemErrorInfo()), LL_ERROR);
+								c_has_error=true;
+								break;
+							}
+							else
+							{
+								ServerLogger::Log(clientid, L"Directory  \""+backuppath_hashes+local_curr_os_path+L"\" does already exist. - " + widen(systemErrorInfo()), LL_WARNING);
+							}
 						}
 					}
-					else
+					++depth;
+					if(depth==1)
 					{
-						--depth;
-						if(indirchange==true && depth==changelevel)
-						{
-							indirchange=false;
-						}
-						if(depth==0)
+						server_download->addToQueueStartShadowcopy(path_stack.path().substr(1));
+					}
+				}
+				else
+				{
+					--depth;
+					if(indirchange==true && depth==changelevel)
+					{
+						indirchange=false;
+					}
+					if(depth==0)
+					{
+						if(server_link_stage.get()!=NULL)
 						{
-							std::wstring t=curr_path;
-							t.erase(0,1);
-							server_download->addToQueueStopShadowcopy(t);
+							//Files which cannot be linked are downloaded and need the shadow copy
+							server_link_stage->flush();
 						}
-						curr_path=ExtractFilePath(curr_path, L"/");
-						curr_os_path=ExtractFilePath(curr_os_path, L"/");
+						server_download->addToQueueStopShadowcopy(path_stack.path().substr(1));
 					}
+					path_stack.pop();
+				}
+			}
+			else //is file
+			{
+				const std::wstring& local_curr_os_path=path_stack.localOsFilePath(osspecific_name);
+				std::wstring srcpath=last_backuppath+local_curr_os_path;
+				
+				
+				bool copy_curr_file_entry=false;
+				bool curr_has_hash = false;
+				bool readd_curr_file_entry_sparse=false;
+				std::string curr_sha2;
+				if(local_hash!=NULL)
+				{
+					curr_sha2 = filelist_entry.getSha512();
 				}
-				else //is file
+				
+				if(indirchange || hasChange(line, diffs)) //is changed
 				{
-					std::wstring local_curr_os_path=convertToOSPathFromFileClient(curr_os_path+L"/"+osspecific_name);
-					std::wstring srcpath=last_backuppath+local_curr_os_path;
-					
-					
-					bool copy_curr_file_entry=false;
-					bool curr_has_hash = false;
-					bool readd_curr_file_entry_sparse=false;
-					std::string curr_sha2;
+					bool f_ok=false;
+					if(!curr_sha2.empty() && server_link_stage.get()!=NULL)
+					{
+						//The link stage queues the download if the file cannot be linked
+						SLinkItem link_item;
+						link_item.id=line;
+						link_item.fn=cf.name;
+						link_item.short_fn=osspecific_name;
+						link_item.curr_path=path_stack.path();
+						link_item.os_path=path_stack.osPath();
+						link_item.sha2=curr_sha2;
+						link_item.filesize=cf.size;
+						server_link_stage->queueLink(link_item);
+						f_ok=true;
+					}
+					else if(!curr_sha2.empty())
 					{
-						std::map<std::wstring, std::wstring>::iterator hash_it = 
-							( (local_hash==NULL)?extra_params.end():extra_params.find(L"sha512") );					
-						if(hash_it!=extra_params.end())
+						if(link_file(cf.name, osspecific_name, path_stack.path(), path_stack.osPath(), with_hashes, curr_sha2 , cf.size, true))
 						{
-							curr_sha2 = base64_decode_dash(wnarrow(hash_it->second));
+							f_ok=true;
+							linked_bytes+=cf.size;
 						}
 					}
-					
-					if(indirchange || hasChange(line, diffs)) //is changed
+
+					if(!f_ok)
 					{
-						bool f_ok=false;
-						if(!curr_sha2.empty())
+						if(intra_file_diffs)
 						{
-							if(link_file(cf.name, osspecific_name, curr_path, curr_os_path, with_hashes, curr_sha2 , cf.size, true))
-							{
-								f_ok=true;
-								linked_bytes+=cf.size;
-							}
+							server_download->addToQueueChunked(line, cf.name, osspecific_name, path_stack.path(), path_stack.osPath(), queue_downloads?cf.size:-1);
 						}
+						else
+						{
+							server_download->addToQueueFull(line, cf.name, osspecific_name, path_stack.path(), path_stack.osPath(), queue_downloads?cf.size:-1);
+						}							
+					}
+				}
+				else if(!on_snapshot) //is not changed
+				{						
+					bool too_many_hardlinks;
+					bool b=os_create_hardlink(os_file_prefix(backuppath+local_curr_os_path), os_file_prefix(srcpath), use_snapshots, &too_many_hardlinks);
+					bool f_ok = false;
+					if(b)
+					{
+						f_ok=true;
+					}
+					else if(!b && too_many_hardlinks)
+					{
+						ServerLogger::Log(clientid, L"Creating hardlink from \""+srcpath+L"\" to \""+backuppath+local_curr_os_path+L"\" failed. Hardlink limit was reached. Copying file...", LL_DEBUG);
+						copyFile(srcpath, backuppath+local_curr_os_path);
+						f_ok=true;
+					}
 
-						if(!f_ok)
+					if(!f_ok) //creating hard link failed and not because of too many hard links per inode
+					{
+						if(link_logcnt<5)
 						{
-							if(intra_file_diffs)
-							{
-								server_download->addToQueueChunked(line, cf.name, osspecific_name, curr_path, curr_os_path, queue_downloads?cf.size:-1);
-							}
-							else
-							{
-								server_download->addToQueueFull(line, cf.name, osspecific_name, curr_path, curr_os_path, queue_downloads?cf.size:-1);
-							}							
+							ServerLogger::Log(clientid, L"Creating hardlink from \""+srcpath+L"\" to \""+backuppath+local_curr_os_path+L"\" failed. Loading file...", LL_WARNING);
 						}
-					}
-					else if(!on_snapshot) //is not changed
-					{						
-						bool too_many_hardlinks;
-						bool b=os_create_hardlink(os_file_prefix(backuppath+local_curr_os_path), os_file_prefix(srcpath), use_snapshots, &too_many_hardlinks);
-						bool f_ok = false;
-						if(b)
+						else if(link_logcnt==5)
 						{
-							f_ok=true;
+							ServerLogger::Log(clientid, L"More warnings of kind: Creating hardlink from \""+srcpath+L"\" to \""+backuppath+local_curr_os_path+L"\" failed. Loading file... Skipping.", LL_WARNING);
 						}
-						else if(!b && too_many_hardlinks)
+						else
 						{
-							ServerLogger::Log(clientid, L"Creating hardlink from \""+srcpath+L"\" to \""+backuppath+local_curr_os_path+L"\" failed. Hardlink limit was reached. Copying file...", LL_DEBUG);
-							copyFile(srcpath, backuppath+local_curr_os_path);
-							f_ok=true;
+							Server->Log(L"Creating hardlink from \""+srcpath+L"\" to \""+backuppath+local_curr_os_path+L"\" failed. Loading file...", LL_WARNING);
 						}
+						++link_logcnt;
 
-						if(!f_ok) //creating hard link failed and not because of too many hard links per inode
+						if(!curr_sha2.empty())
 						{
-							if(link_logcnt<5)
-							{
-								ServerLogger::Log(clientid, L"Creating hardlink from \""+srcpath+L"\" to \""+backuppath+local_curr_os_path+L"\" failed. Loading file...", LL_WARNING);
-							}
-							else if(link_logcnt==5)
+							if(link_file(cf.name, osspecific_name, path_stack.path(), path_stack.osPath(), with_hashes, curr_sha2, cf.size, false))
 							{
-								ServerLogger::Log(clientid, L"More warnings of kind: Creating hardlink from \""+srcpath+L"\" to \""+backuppath+local_curr_os_path+L"\" failed. Loading file... Skipping.", LL_WARNING);
-							}
-							else
-							{
-								Server->Log(L"Creating hardlink from \""+srcpath+L"\" to \""+backuppath+local_curr_os_path+L"\" failed. Loading file...", LL_WARNING);
-							}
-							++link_logcnt;
-
-							if(!curr_sha2.empty())
-							{
-								if(link_file(cf.name, osspecific_name, curr_path, curr_os_path, with_hashes, curr_sha2, cf.size, false))
-								{
-									f_ok=true;
-									copy_curr_file_entry=copy_last_file_entries;						
-									readd_curr_file_entry_sparse = readd_file_entries_sparse;
-									linked_bytes+=cf.size;
-								}
+								f_ok=true;
+								copy_curr_file_entry=copy_last_file_entries;						
+								readd_curr_file_entry_sparse = readd_file_entries_sparse;
+								linked_bytes+=cf.size;
 							}
+						}
 
-							if(!f_ok)
+						if(!f_ok)
+						{
+							if(intra_file_diffs)
 							{
-								if(intra_file_diffs)
-								{
-									server_download->addToQueueChunked(line, cf.name, osspecific_name, curr_path, curr_os_path, queue_downloads?cf.size:-1);
-								}
-								else
-								{
-									server_download->addToQueueFull(line, cf.name, osspecific_name, curr_path, curr_os_path, queue_downloads?cf.size:-1);
-								}
+								server_download->addToQueueChunked(line, cf.name, osspecific_name, path_stack.path(), path_stack.osPath(), queue_downloads?cf.size:-1);
 							}
-						}
-						else //created hard link successfully
-						{
-							copy_curr_file_entry=copy_last_file_entries;						
-							readd_curr_file_entry_sparse = readd_file_entries_sparse;
-
-							if(with_hashes)
+							else
 							{
-								curr_has_hash = os_create_hardlink(os_file_prefix(backuppath_hashes+local_curr_os_path), os_file_prefix(last_backuppath_hashes+local_curr_os_path), use_snapshots, NULL);
+								server_download->addToQueueFull(line, cf.name, osspecific_name, path_stack.path(), path_stack.osPath(), queue_downloads?cf.size:-1);
 							}
 						}
 					}
-					else
+					else //created hard link successfully
 					{
-						copy_curr_file_entry=copy_last_file_entries;
+						copy_curr_file_entry=copy_last_file_entries;						
 						readd_curr_file_entry_sparse = readd_file_entries_sparse;
-						curr_has_hash = with_hashes;
-					}
-
-					if(copy_curr_file_entry)
-					{
-						ServerBackupDao::SFileEntry fileEntry = backup_dao->getFileEntryFromTemporaryTable(srcpath);
 
-						if(fileEntry.exists)
+						if(with_hashes)
 						{
-							backup_dao->insertIntoTemporaryNewFilesTable(backuppath+local_curr_os_path, curr_has_hash?(backuppath_hashes+local_curr_os_path):std::wstring(),
-								fileEntry.shahash, fileEntry.filesize);
-							++num_copied_file_entries;
-
-							readd_curr_file_entry_sparse=false;
+							curr_has_hash = os_create_hardlink(os_file_prefix(backuppath_hashes+local_curr_os_path), os_file_prefix(last_backuppath_hashes+local_curr_os_path), use_snapshots, NULL);
 						}
 					}
+				}
+				else
+				{
+					copy_curr_file_entry=copy_last_file_entries;
+					readd_curr_file_entry_sparse = readd_file_entries_sparse;
+					curr_has_hash = with_hashes;
+				}
 
-					if(readd_curr_file_entry_sparse)
+				if(copy_curr_file_entry)
+				{
+					ServerBackupDao::SFileEntry fileEntry = backup_dao->getFileEntryFromTemporaryTable(srcpath);
+
+					if(fileEntry.exists)
 					{
-						addSparseFileEntry(curr_path, cf, copy_file_entries_sparse_modulo, incremental_num,
-							trust_client_hashes, curr_sha2, local_curr_os_path, curr_has_hash, server_hash_existing,
-							num_readded_entries);
+						backup_dao->insertIntoTemporaryNewFilesTable(backuppath+local_curr_os_path, curr_has_hash?(backuppath_hashes+local_curr_os_path):std::wstring(),
+							fileEntry.shahash, fileEntry.filesize);
+						++num_copied_file_entries;
+
+						readd_curr_file_entry_sparse=false;
 					}
 				}
-				++line;
+
+				if(readd_curr_file_entry_sparse)
+				{
+					addSparseFileEntry(path_stack.path(), cf, copy_file_entries_sparse_modulo, incremental_num,
+						trust_client_hashes, curr_sha2, local_curr_os_path, curr_has_hash, server_hash_existing,
+						num_readded_entries);
+				}
 			}
+			++line;
 		}
 		
 		if(c_has_error)
@@ -2884,6 +3009,33 @@ bool BackupServerGet::doIncrBackup(bool with_hashes, bool intra_file_diffs, bool
 			break;
 	}
 
+	std::vector<std::pair<std::wstring, std::wstring> > failed_dir_links;
+	if(!dir_link_batch.flush(&failed_dir_links))
+	{
+		ServerLogger::Log(clientid, L"Creating "+convert(failed_dir_links.size())+L" directory links failed. Copying the directories instead...", LL_WARNING);
+		for(size_t i=0;i<failed_dir_links.size();++i)
+		{
+			if(!copy_directory_tree(failed_dir_links[i].second, failed_dir_links[i].first))
+			{
+				ServerLogger::Log(clientid, L"Error copying directory \""+failed_dir_links[i].second+L"\" to \""+failed_dir_links[i].first+L"\"", LL_ERROR);
+				c_has_error=true;
+			}
+		}
+	}
+
+	if(dir_link_batch.getLinkedDirs()>0)
+	{
+		ServerLogger::Log(clientid, L"Linked "+convert(dir_link_batch.getLinkedDirs())+L" unchanged directories", LL_DEBUG);
+	}
+
+	if(server_link_stage.get()!=NULL)
+	{
+		ServerLogger::Log(clientid, L"Waiting for file link stage...", LL_DEBUG);
+		server_link_stage->stop();
+		linked_bytes+=server_link_stage->takeLinkedBytes();
+		ServerLogger::Log(clientid, L"Linked "+convert(server_link_stage->getLinkedFiles())+L" files via the link stage", LL_DEBUG);
+	}
+
 	server_download->queueStop(false);
 	if(server_hash_existing.get())
 	{
@@ -2902,8 +3054,8 @@ bool BackupServerGet::doIncrBackup(bool with_hashes, bool intra_file_diffs, bool
 		{
 			status.pcdone=(std::min)(100,(int)(((float)(fc.getReceivedDataBytes() + (fc_chunked.get()?fc_chunked->getReceivedDataBytes():0) + linked_bytes))/((float)files_size/100.f)+0.5f));
 		}
-		status.hashqueuesize=(_u32)hashpipe->getNumElements();
-		status.prepare_hashqueuesize=(_u32)hashpipe_prepare->getNumElements();
+		status.hashqueuesize=(_u32)bsh->getQueueSize();
+		status.prepare_hashqueuesize=(_u32)bsh_prepare->getQueueSize();
 		ServerStatus::setServerStatus(status, true);
 
 		int64 ctime = Server->getTimeMS();
@@ -2925,28 +3077,25 @@ bool BackupServerGet::doIncrBackup(bool with_hashes, bool intra_file_diffs, bool
 
 	tmp->Seek(0);
 	line = 0;
-	resetEntryState();
+	filelist_parser.reset();
 	while( (read=tmp->Read(buffer, 4096))>0 )
 	{
-		for(size_t i=0;i<read;++i)
+		size_t i=0;
+		while(filelist_parser.nextEntry(buffer, read, i, filelist_entry))
 		{
-			bool b=getNextEntry(buffer[i], cf, NULL);
-			if(b)
+			if(filelist_entry.isdir)
 			{
-				if(cf.isdir)
-				{
-					writeFileItem(clientlist, cf);
-				}
-				else if( server_download->isDownloadOk(line) )
+				writeFileItem(clientlist, filelist_entry);
+			}
+			else if( server_download->isDownloadOk(line) )
+			{
+				if(server_download->isDownloadPartial(line))
 				{
-					if(server_download->isDownloadPartial(line))
-					{
-						cf.last_modified *= Server->getRandomNumber();
-					}
-					writeFileItem(clientlist, cf);
+					filelist_entry.last_modified *= Server->getRandomNumber();
 				}
-				++line;
+				writeFileItem(clientlist, filelist_entry);
 			}
+			++line;
 		}
 	}
 
@@ -3035,7 +3184,7 @@ bool BackupServerGet::doIncrBackup(bool with_hashes, bool intra_file_diffs, bool
 			{
 				setBackupDone();
 			}
-			db->EndTransaction();
+			timedEndTransaction(db, "backup");
 		}
 
 		if(b)
@@ -3073,7 +3222,7 @@ bool BackupServerGet::doIncrBackup(bool with_hashes, bool intra_file_diffs, bool
 		db->BeginWriteTransaction();
 		moveFile(L"urbackup/clientlist_"+convert(clientid)+L"_new.ub", L"urbackup/clientlist_"+convert(clientid)+L".ub");
 		setBackupDone();
-		db->EndTransaction();
+		timedEndTransaction(db, "backup");
 	}
 	else
 	{
@@ -3124,14 +3273,14 @@ void BackupServerGet::waitForFileThreads(void)
 	SStatus status=ServerStatus::getStatus(clientname);
 	hashpipe->Write("flush");
 	hashpipe_prepare->Write("flush");
-	status.hashqueuesize=(_u32)hashpipe->getNumElements()+(bsh->isWorking()?1:0);
-	status.prepare_hashqueuesize=(_u32)hashpipe_prepare->getNumElements()+(bsh_prepare->isWorking()?1:0);
+	status.hashqueuesize=(_u32)bsh->getQueueSize()+(bsh->isWorking()?1:0);
+	status.prepare_hashqueuesize=(_u32)bsh_prepare->getQueueSize()+(bsh_prepare->isWorking()?1:0);
 	while(status.hashqueuesize>0 || status.prepare_hashqueuesize>0)
 	{
 		ServerStatus::setServerStatus(status, true);
 		Server->wait(1000);
-		status.hashqueuesize=(_u32)hashpipe->getNumElements()+(bsh->isWorking()?1:0);
-		status.prepare_hashqueuesize=(_u32)hashpipe_prepare->getNumElements()+(bsh_prepare->isWorking()?1:0);
+		status.hashqueuesize=(_u32)bsh->getQueueSize()+(bsh->isWorking()?1:0);
+		status.prepare_hashqueuesize=(_u32)bsh_prepare->getQueueSize()+(bsh_prepare->isWorking()?1:0);
 	}
 	{
 		Server->wait(10);
@@ -3312,6 +3461,7 @@ void BackupServerGet::updateLastBackup(void)
 	q_set_last_backup->Bind(clientid);
 	q_set_last_backup->Write();
 	q_set_last_backup->Reset();
+	ServerStatus::invalidateClientStatusSnapshots(clientname);
 }
 
 void BackupServerGet::updateLastImageBackup(void)
@@ -3320,6 +3470,7 @@ void BackupServerGet::updateLastImageBackup(void)
 	q_set_last_image_backup->Bind(clientid);
 	q_set_last_image_backup->Write();
 	q_set_last_image_backup->Reset();
+	ServerStatus::invalidateClientStatusSnapshots(clientname);
 }
 
 std::string BackupServerGet::sendClientMessageRetry(const std::string &msg, const std::wstring &errmsg, unsigned int timeout, size_t retry, bool logerr, int max_loglevel)
@@ -3612,6 +3763,11 @@ bool BackupServerGet::updateCapabilities(void)
 		{
 			eta_version=watoi(it->second);
 		}
+		it=params.find(L"FILELIST_DELTA");
+		if(it!=params.end())
+		{
+			filelist_delta_version=watoi(it->second);
+		}
 	}
 
 	return !cap.empty();
@@ -4452,15 +4608,43 @@ int BackupServerGet::getNumberOfRunningFileBackups(void)
 	return running_file_backups;
 }
 
-IPipeThrottler *BackupServerGet::getThrottler(size_t speed_bps)
+IPipeThrottler *BackupServerGet::getThrottler(void)
 {
+	if(server_settings==NULL)
+	{
+		return NULL;
+	}
+
+	int speed_bps;
+	int global_speed_bps;
+	IPipeThrottler *parent;
+	if(internet_connection)
+	{
+		speed_bps=server_settings->getSettings()->internet_speed;
+		global_speed_bps=server_settings->getSettings()->global_internet_speed;
+		parent=BackupServer::getGlobalInternetThrottler((std::max)(global_speed_bps, 0));
+	}
+	else
+	{
+		speed_bps=server_settings->getSettings()->local_speed;
+		global_speed_bps=server_settings->getSettings()->global_local_speed;
+		parent=BackupServer::getGlobalLocalThrottler((std::max)(global_speed_bps, 0));
+	}
+
 	if(client_throttler==NULL)
 	{
-		client_throttler=Server->createPipeThrottler(speed_bps);
+		client_throttler=Server->createPipeThrottler((std::max)(speed_bps, 0), parent, 1);
 	}
 	else
 	{
-		client_throttler->changeThrottleLimit(speed_bps);
+		client_throttler->changeThrottleLimit((std::max)(speed_bps, 0));
+		//internet_connection may have changed since it was created
+		client_throttler->changeParent(parent, 1);
+	}
+
+	if(speed_bps<=0 && global_speed_bps<=0)
+	{
+		return NULL;
 	}
 
 	return client_throttler;
@@ -4477,36 +4661,20 @@ IPipe *BackupServerGet::getClientCommandConnection(int timeoutms, std::string* c
 	if(internet_connection)
 	{
 		IPipe *ret=InternetServiceConnector::getConnection(Server->ConvertToUTF8(clientname), SERVICE_COMMANDS, timeoutms);
-		if(server_settings!=NULL && ret!=NULL)
+		IPipeThrottler *throttler=getThrottler();
+		if(throttler!=NULL && ret!=NULL)
 		{
-			int internet_speed=server_settings->getSettings()->internet_speed;
-			if(internet_speed>0)
-			{
-				ret->addThrottler(getThrottler(internet_speed));
-			}
-			int global_internet_speed=server_settings->getSettings()->global_internet_speed;
-			if(global_internet_speed>0)
-			{
-				ret->addThrottler(BackupServer::getGlobalInternetThrottler(global_internet_speed));
-			}
+			ret->addThrottler(throttler);
 		}
 		return ret;
 	}
 	else
 	{
 		IPipe *ret=Server->ConnectStream(inet_ntoa(getClientaddr().sin_addr), serviceport, timeoutms);
-		if(server_settings!=NULL && ret!=NULL)
+		IPipeThrottler *throttler=getThrottler();
+		if(throttler!=NULL && ret!=NULL)
 		{
-			int local_speed=server_settings->getSettings()->local_speed;
-			if(local_speed>0)
-			{
-				ret->addThrottler(getThrottler(local_speed));
-			}
-			int global_local_speed=server_settings->getSettings()->global_local_speed;
-			if(global_local_speed>0)
-			{
-				ret->addThrottler(BackupServer::getGlobalLocalThrottler(global_local_speed));
-			}
+			ret->addThrottler(throttler);
 		}
 		return ret;
 	}
@@ -4521,18 +4689,10 @@ _u32 BackupServerGet::getClientFilesrvConnection(FileClient *fc, int timeoutms)
 
 		_u32 ret=fc->Connect(cp);
 
-		if(server_settings!=NULL)
+		IPipeThrottler *throttler=getThrottler();
+		if(throttler!=NULL)
 		{
-			int internet_speed=server_settings->getSettings()->internet_speed;
-			if(internet_speed>0)
-			{
-				fc->addThrottler(getThrottler(internet_speed));
-			}
-			int global_internet_speed=server_settings->getSettings()->global_internet_speed;
-			if(global_internet_speed>0)
-			{
-				fc->addThrottler(BackupServer::getGlobalInternetThrottler(global_internet_speed));
-			}
+			fc->addThrottler(throttler);
 		}
 
 		fc->setReconnectionTimeout(c_internet_fileclient_timeout);
@@ -4544,18 +4704,10 @@ _u32 BackupServerGet::getClientFilesrvConnection(FileClient *fc, int timeoutms)
 		sockaddr_in addr=getClientaddr();
 		_u32 ret=fc->Connect(&addr);
 
-		if(server_settings!=NULL)
+		IPipeThrottler *throttler=getThrottler();
+		if(throttler!=NULL)
 		{
-			int local_speed=server_settings->getSettings()->local_speed;
-			if(local_speed>0)
-			{
-				fc->addThrottler(getThrottler(local_speed));
-			}
-			int global_local_speed=server_settings->getSettings()->global_local_speed;
-			if(global_local_speed>0)
-			{
-				fc->addThrottler(BackupServer::getGlobalLocalThrottler(global_local_speed));
-			}
+			fc->addThrottler(throttler);
 		}
 
 		return ret;
@@ -4594,37 +4746,12 @@ bool BackupServerGet::getClientChunkedFilesrvConnection(std::auto_ptr<FileClient
 
 	fc_chunked->setProgressLogCallback(this);
 
-	if(fc_chunked->getPipe()!=NULL && server_settings!=NULL)
+	if(fc_chunked->getPipe()!=NULL)
 	{
-		int speed;
-		if(internet_connection)
+		IPipeThrottler *throttler=getThrottler();
+		if(throttler!=NULL)
 		{
-			speed=server_settings->getSettings()->internet_speed;
-		}
-		else
-		{
-			speed=server_settings->getSettings()->local_speed;
-		}
-		if(speed>0)
-		{
-			fc_chunked->addThrottler(getThrottler(speed));
-		}
-
-		if(internet_connection)
-		{
-			int global_speed=server_settings->getSettings()->global_internet_speed;
-			if(global_speed>0)
-			{
-				fc_chunked->addThrottler(BackupServer::getGlobalInternetThrottler(global_speed));
-			}
-		}
-		else
-		{
-			int global_speed=server_settings->getSettings()->global_local_speed;
-			if(global_speed>0)
-			{
-				fc_chunked->addThrottler(BackupServer::getGlobalLocalThrottler(global_speed));
-			}
+			fc_chunked->addThrottler(throttler);
 		}
 	}
 
@@ -4734,7 +4861,8 @@ std::wstring BackupServerGet::fixFilenameForOS(const std::wstring& fn)
 		modified_filename=true;
 	}
 #else
-	if(Server->ConvertToUTF8(fn).size()>=NAME_MAX-11)
+	//A character needs at most four bytes in UTF-8
+	if(fn.size()*4>=NAME_MAX-11 && Server->ConvertToUTF8(fn).size()>=NAME_MAX-11)
 	{
 		ret=fn;
 		bool log_msg=true;
@@ -5018,7 +5146,8 @@ void BackupServerGet::copyFile(const std::wstring& source, const std::wstring& d
 	data.addString(Server->ConvertToUTF8(source));
 	data.addString(Server->ConvertToUTF8(dest));
 
-	hashpipe->Write(data.getDataPtr(), data.getDataSize());
+	std::string msg(data.getDataPtr(), data.getDataSize());
+	hashpipe->WriteOwned(msg);
 }
 
 
@@ -5166,6 +5295,8 @@ void BackupServerGet::addExistingHash( const std::wstring& fullpath, const std::
 	file_entry.shahash = shahash;
 	file_entry.filesize = filesize;
 
+	ServerDedupFilter::add(shahash, filesize);
+
 	IScopedLock lock(hash_existing_mutex);
 	hash_existing.push_back(file_entry);
 }
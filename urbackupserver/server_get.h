@@ -16,6 +16,7 @@
 #include "../urbackupcommon/sha2/sha2.h"
 #include "../urbackupcommon/fileclient/tcpstack.h"
 #include "server_settings.h"
+#include "server_filelist.h"
 
 #include <memory>
 
@@ -103,6 +104,9 @@ private:
 	
 	void notifyClientBackupSuccessfull(void);
 	bool request_filelist_construct(bool full, bool resume, bool with_token, bool& no_backup_dirs, bool& connect_fail);
+	std::string getFilelistBaseHash(void);
+	void saveFilelistBase(IFile* filelist, std::string hash);
+	bool loadFilelistDelta(FileClient& fc, IFile* filelist, bool hashed_transfer);
 	bool link_file(const std::wstring &fn, const std::wstring &short_fn, const std::wstring &curr_path, const std::wstring &os_path, bool with_hashes, const std::string& sha2, _i64 filesize, bool add_sql);
 	bool doIncrBackup(bool with_hashes, bool intra_file_diffs, bool on_snapshot, bool use_directory_links, bool &disk_error, bool &log_backup, bool& r_incremental, bool& r_resumed);
 
@@ -164,7 +168,7 @@ private:
 
 	int64 updateNextblock(int64 nextblock, int64 currblock, sha256_ctx *shactx, unsigned char *zeroblockdata, bool parent_fn, ServerVHDWriter *parentfile, IFile *hashfile, IFile *parenthashfile, unsigned int blocksize, int64 mbr_offset, int64 vhd_blocksize, bool &warned_about_parenthashfile_error);
 
-	IPipeThrottler *getThrottler(size_t speed_bps);
+	IPipeThrottler *getThrottler(void);
 
 	void update_sql_intervals(bool update_sql);
 
@@ -253,8 +257,8 @@ private:
 	IQuery *q_get_last_incremental_complete;
 
 
-	int state;
-	std::string t_name;
+	std::auto_ptr<FilelistParser> list_parser;
+	SFilelistEntry list_entry;
 
 	int link_logcnt;
 
@@ -273,6 +277,7 @@ private:
 
 	bool do_full_backup_now;
 	bool do_incr_backup_now;
+	bool synthetic_full_file_failed;
 	bool do_update_settings;
 	bool do_full_image_now;
 	bool do_incr_image_now;
@@ -291,11 +296,12 @@ private:
 	std::string all_volumes;
 	std::string all_nonusb_volumes;
 	int eta_version;
+	int filelist_delta_version;
+	std::string filelist_delta_base;
 
 	bool use_snapshots;
 	bool use_reflink;
 	bool use_tmpfiles;
-	bool use_tmpfiles_images;
 
 	CTCPStack tcpstack;
 
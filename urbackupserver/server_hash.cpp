@@ -29,8 +29,10 @@
 #include "../urbackupcommon/sha2/sha2.h"
 #include "../stringtools.h"
 #include "server_log.h"
+#include "server_metrics.h"
 #include "server_cleanup.h"
 #include "create_files_cache.h"
+#include "server_dedup_filter.h"
 #include <algorithm>
 #include <memory.h>
 #include <assert.h>
@@ -51,8 +53,8 @@ void destroy_mutex1(void)
 }
 
 BackupServerHash::BackupServerHash(IPipe *pPipe, int pClientid, bool use_snapshots, bool use_reflink, bool use_tmpfiles)
-	: use_snapshots(use_snapshots), use_reflink(use_reflink), use_tmpfiles(use_tmpfiles), copy_limit(1000), backupdao(NULL), old_backupfolders_loaded(false),
-	  detached_db(false)
+	: use_entry_writer(false), entries_ticket(0), use_snapshots(use_snapshots), use_reflink(use_reflink), use_tmpfiles(use_tmpfiles), copy_limit(1000), backupdao(NULL),
+	  old_backupfolders_loaded(false), detached_db(false)
 {
 	pipe=pPipe;
 	clientid=pClientid;
@@ -60,6 +62,7 @@ BackupServerHash::BackupServerHash(IPipe *pPipe, int pClientid, bool use_snapsho
 	tmp_count=0;
 	space_logcnt=0;
 	working=false;
+	batch_pending=0;
 	has_error=false;
 	chunk_patcher.setCallback(this);
 	filecache=NULL;
@@ -94,6 +97,7 @@ void BackupServerHash::setupDatabase(void)
 
 	prepareSQL();
 	backupdao = new ServerBackupDao(db);
+	use_entry_writer=ServerFileEntryWriter::isRunning();
 	copyFilesFromTmp();
 
 	{
@@ -109,6 +113,10 @@ void BackupServerHash::setupDatabase(void)
 		{
 			filecache=create_sqlite_files_cache();
 		}
+		else if(server_settings.getSettings()->filescache_type=="hashindex")
+		{
+			filecache=create_hashindex_files_cache();
+		}
 	}
 }
 
@@ -153,17 +161,32 @@ void BackupServerHash::operator()(void)
 	DBScopedDetach detachDbs(db);
 	detached_db=true;
 
+	std::vector<std::string> msgs;
+	size_t msg_idx=0;
 	while(true)
 	{
-		working=false;
+		if(msg_idx>=msgs.size())
+		{
+			working=false;
+			batch_pending=0;
+			msgs.clear();
+			msg_idx=0;
+			pipe->ReadAll(msgs, static_cast<int>(timeoutms));
+		}
+
 		std::string data;
-		size_t rc=pipe->Read(&data, static_cast<int>(timeoutms) );
+		if(msg_idx<msgs.size())
+		{
+			data.swap(msgs[msg_idx++]);
+			batch_pending=msgs.size()-msg_idx;
+		}
+		size_t rc=data.size();
 		if(rc==0)
 		{
 			tmp_count=0;
 			int c=countFilesInTmp();
 			if(c==-1) Server->Log("Counting files in tmp table failed", LL_ERROR);
-			if(c>0)
+			if(c>0 || !pending_entries.empty())
 			{
 			        Server->Log("Copying files from tmp table...",LL_DEBUG);
 					copyFilesFromTmp();
@@ -311,7 +334,14 @@ void BackupServerHash::copyFromTmpTable(bool force)
 	{
 		Server->Log("Copying "+nconvert(tmp_count)+" files from tmp table...",LL_DEBUG);
 		tmp_count=0;
-		copyFilesFromTmp();
+		if(use_entry_writer && !force)
+		{
+			queueFileEntries();
+		}
+		else
+		{
+			copyFilesFromTmp();
+		}
 		Server->Log("done.", LL_DEBUG);
 	}
 }
@@ -334,6 +364,8 @@ void BackupServerHash::addFileSQL(int backupid, char incremental, const std::wst
 {
 	++tmp_count;
 
+	ServerDedupFilter::add(shahash, filesize);
+
 	if(filecache==NULL)
 	{
 		addFileTmp(backupid, fp, hash_path, shahash, filesize);
@@ -343,6 +375,22 @@ void BackupServerHash::addFileSQL(int backupid, char incremental, const std::wst
 		filecache->put_delayed(FileCache::SCacheKey(shahash.c_str(), filesize), FileCache::SCacheValue(Server->ConvertToUTF8(fp), Server->ConvertToUTF8(hash_path)));
 	}
 
+	if(use_entry_writer)
+	{
+		SFileEntry entry;
+		entry.backupid=backupid;
+		entry.fullpath=fp;
+		entry.hashpath=hash_path;
+		entry.shahash=shahash;
+		entry.filesize=filesize;
+		entry.rsize=rsize;
+		entry.clientid=clientid;
+		entry.incremental=incremental;
+		entry.to_files_new=filecache!=NULL;
+		pending_entries.push_back(entry);
+		return;
+	}
+
 	q_add_file->Bind(backupid);
 	q_add_file->Bind(fp);
 	q_add_file->Bind(hash_path);
@@ -362,6 +410,12 @@ void BackupServerHash::addFileTmp(int backupid, const std::wstring &fp, const st
 
 void BackupServerHash::deleteFileSQL(const std::string &pHash, const std::wstring &fp, _i64 filesize, int backupid)
 {
+	if(use_entry_writer)
+	{
+		//The entry may still be on its way to the files table
+		copyFilesFromTmp();
+	}
+
 	db->BeginWriteTransaction();
 	q_move_del_file->Bind(pHash.c_str(), (_u32)pHash.size());
 	q_move_del_file->Bind(filesize);
@@ -375,7 +429,7 @@ void BackupServerHash::deleteFileSQL(const std::string &pHash, const std::wstrin
 	q_del_file->Bind(backupid);
 	q_del_file->Write();
 	q_del_file->Reset();
-	db->EndTransaction();
+	timedEndTransaction(db, "hash");
 
 	q_del_file_tmp->Bind(pHash.c_str(), (_u32)pHash.size());
 	q_del_file_tmp->Bind(filesize);
@@ -583,6 +637,7 @@ void BackupServerHash::addFile(int backupid, char incremental, IFile *tf, const
 		false, tries_once, ff_last, hardlink_limit, copied_file))
 	{
 		ServerLogger::Log(clientid, L"HT: Linked file: \""+tfn+L"\"", LL_DEBUG);
+		ServerMetrics::addCounter("urbackup_hash_linked_files_total");
 		copy=false;
 		std::wstring temp_fn=tf->getFilenameW();
 		Server->destroy(tf);
@@ -611,6 +666,7 @@ void BackupServerHash::addFile(int backupid, char incremental, IFile *tf, const
 	if(copy)
 	{
 		ServerLogger::Log(clientid, L"HT: Copying file: \""+tfn+L"\"", LL_DEBUG);
+		ServerMetrics::addCounter("urbackup_hash_copied_files_total");
 		int64 fs=tf->Size();
 		if(!use_reflink)
 		{
@@ -778,6 +834,12 @@ bool BackupServerHash::freeSpace(int64 fs, const std::wstring &fp)
 
 std::wstring BackupServerHash::findFileHash(const std::string &pHash, _i64 filesize, int &backupid, std::wstring &hashpath, bool& cache_hit)
 {
+	if(!cache_hit && !ServerDedupFilter::mightContain(pHash, filesize))
+	{
+		backupid=-1;
+		return L"";
+	}
+
 	if(filecache==NULL)
 	{
 		std::wstring ret=findFileHashTmp(pHash, filesize, backupid, hashpath);
@@ -796,10 +858,12 @@ std::wstring BackupServerHash::findFileHash(const std::string &pHash, _i64 files
 		}
 		else
 		{
+			ServerDedupFilter::addFalsePositive();
 			return std::wstring();
 		}
 	}
 
+	ScopedMetricsLatency latency("urbackup_db_find_file_hash_ms");
 	q_find_file_hash->Bind(pHash.c_str(), (_u32)pHash.size());
 	q_find_file_hash->Bind(filesize);
 	db_results res=q_find_file_hash->Read();
@@ -813,6 +877,10 @@ std::wstring BackupServerHash::findFileHash(const std::string &pHash, _i64 files
 	}
 	else
 	{
+		if(!cache_hit)
+		{
+			ServerDedupFilter::addFalsePositive();
+		}
 		backupid=-1;
 		return L"";
 	}
@@ -820,15 +888,20 @@ std::wstring BackupServerHash::findFileHash(const std::string &pHash, _i64 files
 
 std::wstring BackupServerHash::findFileHashTmp(const std::string &pHash, _i64 filesize, int &backupid, std::wstring &hashpath)
 {
-	std::map<std::pair<std::string, _i64>, std::vector<STmpFile > >::iterator iter=files_tmp.find(std::pair<std::string, _i64>(pHash, filesize));
+	std::map<std::pair<std::string, _i64>, std::vector<STmpFile > >* tmp_maps[]={&files_tmp, &files_tmp_queued};
 
-	if(iter!=files_tmp.end())
+	for(size_t m=0;m<2;++m)
 	{
-		if(!iter->second.empty())
+		std::map<std::pair<std::string, _i64>, std::vector<STmpFile > >::iterator iter=tmp_maps[m]->find(std::pair<std::string, _i64>(pHash, filesize));
+
+		if(iter!=tmp_maps[m]->end())
 		{
-			backupid=iter->second[iter->second.size()-1].backupid;
-			hashpath=iter->second[iter->second.size()-1].hashpath;
-			return iter->second[iter->second.size()-1].fp;
+			if(!iter->second.empty())
+			{
+				backupid=iter->second[iter->second.size()-1].backupid;
+				hashpath=iter->second[iter->second.size()-1].hashpath;
+				return iter->second[iter->second.size()-1].fp;
+			}
 		}
 	}
 
@@ -837,16 +910,21 @@ std::wstring BackupServerHash::findFileHashTmp(const std::string &pHash, _i64 fi
 
 void BackupServerHash::deleteFileTmp(const std::string &pHash, const std::wstring &fp, _i64 filesize, int backupid)
 {
-	std::map<std::pair<std::string, _i64>, std::vector<STmpFile > >::iterator iter=files_tmp.find(std::pair<std::string, _i64>(pHash, filesize));
+	std::map<std::pair<std::string, _i64>, std::vector<STmpFile > >* tmp_maps[]={&files_tmp, &files_tmp_queued};
 
-	if(iter!=files_tmp.end())
+	for(size_t m=0;m<2;++m)
 	{
-		for(size_t i=0;i<iter->second.size();++i)
+		std::map<std::pair<std::string, _i64>, std::vector<STmpFile > >::iterator iter=tmp_maps[m]->find(std::pair<std::string, _i64>(pHash, filesize));
+
+		if(iter!=tmp_maps[m]->end())
 		{
-			if(iter->second[i].backupid==backupid && iter->second[i].fp==fp)
+			for(size_t i=0;i<iter->second.size();++i)
 			{
-				iter->second.erase(iter->second.begin()+i);
-				--i;
+				if(iter->second[i].backupid==backupid && iter->second[i].fp==fp)
+				{
+					iter->second.erase(iter->second.begin()+i);
+					--i;
+				}
 			}
 		}
 	}
@@ -926,6 +1004,21 @@ bool BackupServerHash::copyFileWithHashoutput(IFile *tf, const std::wstring &des
 
 void BackupServerHash::copyFilesFromTmp(void)
 {
+	ScopedMetricsLatency latency("urbackup_db_copy_files_from_tmp_ms");
+
+	if(use_entry_writer)
+	{
+		queueFileEntries();
+		if(!ServerFileEntryWriter::waitFor(entries_ticket))
+		{
+			ServerLogger::Log(clientid, "Writing file entries to the database failed", LL_ERROR);
+			has_error=true;
+		}
+		files_tmp.clear();
+		files_tmp_queued.clear();
+		return;
+	}
+
 	if(filecache==NULL)
 	{
 		q_copy_files->Write();
@@ -942,6 +1035,27 @@ void BackupServerHash::copyFilesFromTmp(void)
 	files_tmp.clear();
 }
 
+void BackupServerHash::queueFileEntries(void)
+{
+	if(pending_entries.empty())
+	{
+		return;
+	}
+
+	int64 ticket=ServerFileEntryWriter::queueEntries(pending_entries);
+
+	//Keep the previous batch visible to findFileHashTmp until it is
+	//committed. Usually it already is
+	if(!ServerFileEntryWriter::waitFor(entries_ticket))
+	{
+		ServerLogger::Log(clientid, "Writing file entries to the database failed", LL_ERROR);
+		has_error=true;
+	}
+	files_tmp_queued.swap(files_tmp);
+	files_tmp.clear();
+	entries_ticket=ticket;
+}
+
 int BackupServerHash::countFilesInTmp(void)
 {
 	db_results res=q_count_files_tmp->Read();
@@ -956,6 +1070,21 @@ bool BackupServerHash::isWorking(void)
 	return working;
 }
 
+size_t BackupServerHash::getQueueSize(void)
+{
+	return pipe->getNumElements()+batch_pending;
+}
+
+IDatabase* BackupServerHash::getDatabase(void)
+{
+	return db;
+}
+
+bool BackupServerHash::usesFileEntryWriter(void)
+{
+	return use_entry_writer;
+}
+
 bool BackupServerHash::hasError(void)
 {
 	volatile bool r=has_error;
@@ -1014,8 +1143,7 @@ void BackupServerHash::next_chunk_patcher_bytes(const char *buf, size_t bsize, b
 {
 	if(!has_reflink || changed )
 	{
-		chunk_output_fn->Seek(chunk_patch_pos);
-		bool b=BackupServerPrepareHash::writeRepeatFreeSpace(chunk_output_fn, buf, bsize, this);
+		bool b=BackupServerPrepareHash::writeRepeatFreeSpaceAt(chunk_output_fn, chunk_patch_pos, buf, bsize, this);
 		if(!b)
 		{
 			Server->Log(L"Error writing to file \""+chunk_output_fn->getFilenameW()+L"\" -3", LL_ERROR);
@@ -1106,7 +1234,6 @@ bool BackupServerHash::replaceFile(IFile *tf, const std::wstring &dest, const st
 	IFile *dst=openFileRetry(dest, MODE_RW);
 	if(dst==NULL) return false;
 
-	tf->Seek(0);
 	_u32 read1;
 	_u32 read2;
 	char buf1[RP_COPY_BLOCKSIZE];
@@ -1115,10 +1242,10 @@ bool BackupServerHash::replaceFile(IFile *tf, const std::wstring &dest, const st
 	bool dst_eof=false;
 	do
 	{
-		read1=tf->Read(buf1, RP_COPY_BLOCKSIZE);
+		read1=tf->ReadAt(dst_pos, buf1, RP_COPY_BLOCKSIZE);
 		if(!dst_eof)
 		{
-			read2=dst->Read(buf2, RP_COPY_BLOCKSIZE);
+			read2=dst->ReadAt(dst_pos, buf2, RP_COPY_BLOCKSIZE);
 		}
 		else
 		{
@@ -1130,8 +1257,7 @@ bool BackupServerHash::replaceFile(IFile *tf, const std::wstring &dest, const st
 
 		if(read1!=read2 || memcmp(buf1, buf2, read1)!=0)
 		{
-			dst->Seek(dst_pos);
-			bool b=BackupServerPrepareHash::writeRepeatFreeSpace(dst, buf1, read1, this);
+			bool b=BackupServerPrepareHash::writeRepeatFreeSpaceAt(dst, dst_pos, buf1, read1, this);
 			if(!b)
 			{
 				Server->Log(L"Error writing to file \""+dest+L"\" -2", LL_ERROR);
@@ -10,6 +10,7 @@
 #include "server_prepare_hash.h"
 #include "FileCache.h"
 #include "dao/ServerBackupDao.h"
+#include "server_file_entry_writer.h"
 #include <vector>
 
 struct STmpFile
@@ -42,6 +43,10 @@ public:
 	
 	bool isWorking(void);
 
+	//Number of messages in the input pipe plus the ones
+	//already taken out of it but not processed yet
+	size_t getQueueSize(void);
+
 	bool hasError(void);
 
 	virtual bool handle_not_enough_space(const std::wstring &path);
@@ -58,6 +63,10 @@ public:
 
 	void copyFromTmpTable(bool force);
 
+	IDatabase* getDatabase(void);
+
+	bool usesFileEntryWriter(void);
+
 private:
 	void prepareSQL(void);
 	void addFile(int backupid, char incremental, IFile *tf, const std::wstring &tfn,
@@ -72,6 +81,7 @@ private:
 	void deleteFileSQL(const std::string &pHash, const std::wstring &fp, _i64 filesize, int backupid);
 	void deleteFileTmp(const std::string &pHash, const std::wstring &fp, _i64 filesize, int backupid);
 	void copyFilesFromTmp(void);
+	void queueFileEntries(void);
 	int countFilesInTmp(void);
 	IFile* openFileRetry(const std::wstring &dest, int mode);
 	bool patchFile(IFile *patch, const std::wstring &source, const std::wstring &dest, const std::wstring hash_output, const std::wstring hash_dest, _i64 tfilesize);
@@ -87,6 +97,12 @@ private:
 	bool correctPath(std::wstring& ff, std::wstring& f_hashpath);
 
 	std::map<std::pair<std::string, _i64>, std::vector<STmpFile> > files_tmp;
+	//Entries handed to the file entry writer, but maybe not committed yet
+	std::map<std::pair<std::string, _i64>, std::vector<STmpFile> > files_tmp_queued;
+
+	bool use_entry_writer;
+	std::vector<SFileEntry> pending_entries;
+	int64 entries_ticket;
 
 	IQuery *q_find_file_hash;
 	IQuery *q_delete_files_tmp;
@@ -113,6 +129,7 @@ private:
 	int clientid;
 
 	volatile bool working;
+	volatile size_t batch_pending;
 	volatile bool has_error;
 
 	IFile *chunk_output_fn;
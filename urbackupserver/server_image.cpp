@@ -29,6 +29,7 @@
 #include "server_writer.h"
 #include "zero_hash.h"
 #include "server_running.h"
+#include "server_metrics.h"
 #include "../md5.h"
 
 #include <memory.h>
@@ -479,7 +480,7 @@ bool BackupServerGet::doImage(const std::string &pLetter, const std::wstring &pP
 						goto do_image_cleanup;
 					}
 
-					vhdfile=new ServerVHDWriter(r_vhdfile, blocksize, 5000, clientid, server_settings->getSettings()->use_tmpfiles_images);
+					vhdfile=new ServerVHDWriter(r_vhdfile, blocksize, 5000, clientid);
 					vhdfile_ticket=Server->getThreadPool()->execute(vhdfile);
 
 					blockdata=vhdfile->getBuffer();
@@ -760,7 +761,7 @@ bool BackupServerGet::doImage(const std::string &pLetter, const std::wstring &pP
 								{
 									setBackupImageComplete();
 								}
-								db->EndTransaction();
+								timedEndTransaction(db, "image");
 								Server->destroy(t_file);
 							}
 
@@ -0,0 +1,181 @@
+#include "server_image_restore.h"
+#include "server_status.h"
+#include "../Interface/Server.h"
+#include "../Interface/File.h"
+#include "../Interface/Pipe.h"
+#include "../fsimageplugin/IFSImageFactory.h"
+#include "../fsimageplugin/IVHDFile.h"
+#include "../urbackupcommon/os_functions.h"
+#include "../stringtools.h"
+#include <memory.h>
+#include <algorithm>
+#include <vector>
+#include <memory>
+
+extern IFSImageFactory *image_fak;
+
+namespace
+{
+	const size_t c_image_restore_readahead=128*4096;
+	const int64 c_image_hash_blocksize=512*1024;
+	const size_t c_image_hash_size=32;
+
+	bool sameRestoreHash(IFile* image_hashes, IFile* client_hashes, int64 idx)
+	{
+		char image_hash[c_image_hash_size];
+		char client_hash[c_image_hash_size];
+
+		if(!image_hashes->Seek(idx*c_image_hash_size)
+			|| image_hashes->Read(image_hash, c_image_hash_size)!=c_image_hash_size)
+		{
+			return false;
+		}
+
+		if(!client_hashes->Seek(idx*c_image_hash_size)
+			|| client_hashes->Read(client_hash, c_image_hash_size)!=c_image_hash_size)
+		{
+			return false;
+		}
+
+		return memcmp(image_hash, client_hash, c_image_hash_size)==0;
+	}
+}
+
+bool send_restore_image(IPipe* output, const std::wstring& image_path, int img_version, uint64 offset,
+	IFile* client_hashes, int64& lasttime, SImageRestoreStats& stats)
+{
+	IVHDFile *vhdfile=image_fak->createVHDFile(image_path, true, 0);
+	if(!vhdfile->isOpen())
+	{
+		_i64 r=-1;
+		output->Write((char*)&r, sizeof(_i64));
+		image_fak->destroyVHDFile(vhdfile);
+		return true;
+	}
+
+	int skip=1024*512;
+
+	if(img_version==0)
+		skip=512*512;
+
+	_i64 r=little_endian((_i64)vhdfile->getSize()-skip);
+	output->Write((char*)&r, sizeof(_i64));
+	unsigned int blocksize=vhdfile->getBlocksize();
+	std::vector<char> buffer(c_image_restore_readahead);
+	std::vector<char> outbuf(c_image_restore_readahead/4096*(sizeof(uint64)+4096));
+	size_t read;
+	uint64 currpos=offset;
+	int64 starttime=Server->getTimeMS();
+
+	//Delta restore: Skip 512KB blocks whose stored image hash equals
+	//the hash of the block currently on the restore target
+	std::auto_ptr<IFile> image_hashes;
+	if(client_hashes!=NULL)
+	{
+		image_hashes.reset(Server->openFile(os_file_prefix(image_path+L".hash"), MODE_READ));
+		if(image_hashes.get()!=NULL
+			&& image_hashes->Size()<(r+c_image_hash_blocksize-1)/c_image_hash_blocksize*(int64)c_image_hash_size)
+		{
+			Server->Log(L"Hash file of image \""+image_path+L"\" is incomplete. Doing full restore.", LL_WARNING);
+			image_hashes.reset();
+		}
+		else if(image_hashes.get()==NULL)
+		{
+			Server->Log(L"Hash file of image \""+image_path+L"\" not found. Doing full restore.", LL_WARNING);
+		}
+	}
+
+	vhdfile->Seek(skip+currpos);
+
+	int64 last_update_time=Server->getTimeMS();
+
+	bool is_ok=true;
+	do
+	{
+		//Read up to the end of the current VHD block in one go.
+		//Unallocated VHD blocks are skipped as a whole.
+		size_t toread=(std::min)(c_image_restore_readahead, (size_t)(blocksize-(skip+currpos)%blocksize));
+		bool same_hash=false;
+		if(image_hashes.get()!=NULL)
+		{
+			toread=(std::min)(toread, (size_t)(c_image_hash_blocksize-currpos%c_image_hash_blocksize));
+			same_hash = currpos%c_image_hash_blocksize==0
+				&& sameRestoreHash(image_hashes.get(), client_hashes, currpos/c_image_hash_blocksize);
+		}
+
+		if(same_hash)
+		{
+			read=toread;
+			stats.skipped+=read;
+			vhdfile->Seek(skip+currpos+read);
+		}
+		else if(vhdfile->has_sector())
+		{
+			if((_i64)(currpos+toread)>r)
+			{
+				toread=(size_t)((r-currpos+4095)/4096*4096);
+			}
+
+			is_ok=vhdfile->Read(&buffer[0], toread, read);
+			if(read<toread)
+			{
+				Server->Log("Padding zero bytes...", LL_WARNING);
+				memset(&buffer[read], 0, toread-read);
+				read=toread;
+			}
+
+			size_t outpos=0;
+			for(size_t i=0;i<read;i+=4096)
+			{
+				uint64 currpos_endian = little_endian(currpos+i);
+				memcpy(&outbuf[outpos], &currpos_endian, sizeof(uint64));
+				outpos+=sizeof(uint64);
+				memcpy(&outbuf[outpos], &buffer[i], 4096);
+				outpos+=4096;
+			}
+
+			bool b=output->Write(&outbuf[0], (_u32)outpos);
+			if(!b)
+			{
+				Server->Log("Writing to output pipe failed processMsg-1", LL_ERROR);
+				image_fak->destroyVHDFile(vhdfile);
+				return false;
+			}
+			lasttime=Server->getTimeMS();
+			stats.transferred+=read;
+		}
+		else
+		{
+			if(Server->getTimeMS()-lasttime>30000)
+			{
+				uint64 currpos_endian = little_endian(currpos);
+				output->Write((char*)&currpos_endian, sizeof(uint64));
+				memset(&buffer[0], 0, 4096);
+				output->Write(&buffer[0], (_u32)4096);
+				lasttime=Server->getTimeMS();
+			}
+			read=toread;
+			vhdfile->Seek(skip+currpos+read);
+		}
+		currpos+=read;
+
+		if(Server->getTimeMS()-last_update_time>60000)
+		{
+			last_update_time=Server->getTimeMS();
+			ServerStatus::updateActive();
+		}
+	}
+	while( is_ok && (_i64)currpos<r );
+	if((_i64)currpos>=r)
+	{
+		uint64 currpos_endian = little_endian(currpos);
+		output->Write((char*)&currpos_endian, sizeof(uint64));
+	}
+
+	int64 passed_time=(std::max)(Server->getTimeMS()-starttime, (int64)1);
+	Server->Log("Image download finished. Sent "+PrettyPrintBytes(stats.transferred)+" at "+PrettyPrintSpeed((size_t)(stats.transferred*1000/passed_time))
+		+(image_hashes.get()!=NULL?". Skipped "+PrettyPrintBytes(stats.skipped)+" already present on restore target":""), LL_INFO);
+
+	image_fak->destroyVHDFile(vhdfile);
+	return true;
+}
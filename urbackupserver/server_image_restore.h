@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../Interface/Types.h"
+#include <string>
+
+class IPipe;
+class IFile;
+
+struct SImageRestoreStats
+{
+	SImageRestoreStats(void)
+		: transferred(0), skipped(0)
+	{}
+
+	int64 transferred;
+	int64 skipped;
+};
+
+/**
+* Sends the image at image_path to a restore client starting at offset: the
+* image size followed by every allocated 4096 byte block, each prefixed with
+* its position. If client_hashes (SHA-256 per 512KB block of the restore
+* target) are given, blocks whose hash matches the image's .hash file are
+* skipped (delta restore).
+* Returns false if writing to output failed.
+*/
+bool send_restore_image(IPipe* output, const std::wstring& image_path, int img_version, uint64 offset,
+	IFile* client_hashes, int64& lasttime, SImageRestoreStats& stats);
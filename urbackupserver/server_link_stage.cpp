@@ -0,0 +1,270 @@
+#include "server_link_stage.h"
+#include "server_hash.h"
+#include "server_download.h"
+#include "server_get.h"
+#include "server_log.h"
+#include "server_metrics.h"
+#include "../Interface/Server.h"
+#include "../Interface/ThreadPool.h"
+#include "../Interface/Database.h"
+#include <memory>
+
+ServerLinkStage::ServerLinkStage(size_t nthreads, size_t batch_size)
+	: nthreads(nthreads==0?1:nthreads), batch_size(batch_size==0?1:batch_size),
+	  in_flight(0), linked_bytes(0), linked_files(0)
+{
+	mutex=Server->createMutex();
+	cond=Server->createCondition();
+	done_cond=Server->createCondition();
+}
+
+ServerLinkStage::~ServerLinkStage(void)
+{
+	stop();
+
+	Server->destroy(mutex);
+	Server->destroy(cond);
+	Server->destroy(done_cond);
+}
+
+void ServerLinkStage::start(void)
+{
+	for(size_t i=0;i<nthreads;++i)
+	{
+		WorkerThread* worker=new WorkerThread(this);
+		workers.push_back(worker);
+		tickets.push_back(Server->getThreadPool()->execute(worker));
+	}
+}
+
+void ServerLinkStage::queueLink(const SLinkItem& item)
+{
+	curr_batch.push_back(item);
+
+	if(curr_batch.size()>=batch_size)
+	{
+		submitBatch();
+	}
+}
+
+void ServerLinkStage::submitBatch(void)
+{
+	if(curr_batch.empty())
+	{
+		return;
+	}
+
+	IScopedLock lock(mutex);
+	in_flight+=curr_batch.size();
+	queue.push_back(SBatch());
+	queue.back().items.swap(curr_batch);
+	cond->notify_one();
+}
+
+void ServerLinkStage::flush(void)
+{
+	submitBatch();
+
+	IScopedLock lock(mutex);
+	while(in_flight>0)
+	{
+		done_cond->wait(&lock);
+	}
+}
+
+void ServerLinkStage::stop(void)
+{
+	if(workers.empty())
+	{
+		return;
+	}
+
+	flush();
+
+	{
+		IScopedLock lock(mutex);
+		for(size_t i=0;i<workers.size();++i)
+		{
+			SBatch stop_batch;
+			stop_batch.do_stop=true;
+			queue.push_back(stop_batch);
+		}
+		cond->notify_all();
+	}
+
+	Server->getThreadPool()->waitFor(tickets);
+
+	for(size_t i=0;i<workers.size();++i)
+	{
+		delete workers[i];
+	}
+	workers.clear();
+	tickets.clear();
+}
+
+int64 ServerLinkStage::takeLinkedBytes(void)
+{
+	IScopedLock lock(mutex);
+	int64 ret=linked_bytes;
+	linked_bytes=0;
+	return ret;
+}
+
+int64 ServerLinkStage::getLinkedFiles(void)
+{
+	IScopedLock lock(mutex);
+	return linked_files;
+}
+
+bool ServerLinkStage::nextBatch(SBatch& batch)
+{
+	IScopedLock lock(mutex);
+	while(queue.empty())
+	{
+		cond->wait(&lock);
+	}
+
+	batch.items.swap(queue.front().items);
+	batch.do_stop=queue.front().do_stop;
+	queue.pop_front();
+
+	return !batch.do_stop;
+}
+
+void ServerLinkStage::batchDone(size_t nitems, size_t nlinked, int64 batch_linked_bytes)
+{
+	IScopedLock lock(mutex);
+	in_flight-=nitems;
+	linked_bytes+=batch_linked_bytes;
+	linked_files+=nlinked;
+	if(in_flight==0)
+	{
+		done_cond->notify_all();
+	}
+}
+
+void ServerLinkStage::WorkerThread::operator()(void)
+{
+	IWorker* worker=stage->createWorker();
+
+	SBatch batch;
+	while(stage->nextBatch(batch))
+	{
+		int64 batch_linked_bytes=0;
+		size_t nlinked=worker->linkBatch(batch.items, batch_linked_bytes);
+		stage->batchDone(batch.items.size(), nlinked, batch_linked_bytes);
+		batch.items.clear();
+	}
+
+	delete worker;
+}
+
+ServerHashLinkStage::ServerHashLinkStage(size_t nthreads, size_t batch_size, int clientid, int backupid, bool with_hashes,
+	const std::wstring& backuppath, const std::wstring& backuppath_hashes, bool use_snapshots, bool use_reflink,
+	bool use_tmpfiles, ServerDownloadThread* server_download, bool intra_file_diffs, bool queue_downloads)
+	: ServerLinkStage(nthreads, batch_size), clientid(clientid), backupid(backupid), with_hashes(with_hashes),
+	  backuppath(backuppath), backuppath_hashes(backuppath_hashes), use_snapshots(use_snapshots), use_reflink(use_reflink),
+	  use_tmpfiles(use_tmpfiles), server_download(server_download), intra_file_diffs(intra_file_diffs), queue_downloads(queue_downloads)
+{
+}
+
+ServerHashLinkStage::~ServerHashLinkStage(void)
+{
+	stop();
+}
+
+ServerLinkStage::IWorker* ServerHashLinkStage::createWorker(void)
+{
+	return new HashLinkWorker(this);
+}
+
+ServerHashLinkStage::HashLinkWorker::HashLinkWorker(ServerHashLinkStage* stage)
+	: stage(stage)
+{
+	local_hash=new BackupServerHash(NULL, stage->clientid, stage->use_snapshots, stage->use_reflink, stage->use_tmpfiles);
+	local_hash->setupDatabase();
+}
+
+ServerHashLinkStage::HashLinkWorker::~HashLinkWorker(void)
+{
+	local_hash->copyFromTmpTable(true);
+	local_hash->deinitDatabase();
+	delete local_hash;
+	Server->destroyDatabases(Server->getThreadID());
+}
+
+size_t ServerHashLinkStage::HashLinkWorker::linkBatch(std::vector<SLinkItem>& batch, int64& linked_bytes)
+{
+	ScopedMetricsLatency latency("urbackup_link_batch_ms");
+
+	std::vector<std::wstring> dstpaths(batch.size());
+	std::vector<std::wstring> hashpaths(batch.size());
+	std::vector<char> linked(batch.size());
+	std::vector<char> copied(batch.size());
+
+	size_t nlinked=0;
+	for(size_t i=0;i<batch.size();++i)
+	{
+		SLinkItem& item=batch[i];
+		std::wstring os_curr_path=BackupServerGet::convertToOSPathFromFileClient(item.os_path+L"/"+item.short_fn);
+		dstpaths[i]=stage->backuppath+os_curr_path;
+		if(stage->with_hashes)
+		{
+			hashpaths[i]=stage->backuppath_hashes+os_curr_path;
+		}
+
+		bool tries_once;
+		std::wstring ff_last;
+		bool hardlink_limit;
+		bool copied_file;
+		linked[i]=local_hash->findFileAndLink(dstpaths[i], NULL, hashpaths[i], item.sha2, true, item.filesize, std::string(), true,
+			tries_once, ff_last, hardlink_limit, copied_file);
+		copied[i]=copied_file;
+
+		if(linked[i])
+		{
+			ServerLogger::Log(stage->clientid, L"GT: Linked file \""+item.fn+L"\"", LL_DEBUG);
+			linked_bytes+=item.filesize;
+			++nlinked;
+		}
+		else
+		{
+			if(item.filesize!=0)
+			{
+				ServerLogger::Log(stage->clientid, L"GT: File \""+item.fn+L"\" not found via hash. Loading file...", LL_DEBUG);
+			}
+
+			if(stage->intra_file_diffs)
+			{
+				stage->server_download->addToQueueChunked(item.id, item.fn, item.short_fn, item.curr_path, item.os_path, stage->queue_downloads?item.filesize:-1);
+			}
+			else
+			{
+				stage->server_download->addToQueueFull(item.id, item.fn, item.short_fn, item.curr_path, item.os_path, stage->queue_downloads?item.filesize:-1);
+			}
+		}
+	}
+
+	ServerMetrics::addCounter("urbackup_link_stage_files_total", static_cast<int64>(nlinked));
+
+	if(nlinked>0)
+	{
+		//The file entry writer batches on its own and holding a write
+		//transaction while handing entries to it would block it
+		std::auto_ptr<DBScopedWriteTransaction> trans;
+		if(!local_hash->usesFileEntryWriter())
+		{
+			trans.reset(new DBScopedWriteTransaction(local_hash->getDatabase()));
+		}
+		for(size_t i=0;i<batch.size();++i)
+		{
+			if(linked[i])
+			{
+				local_hash->addFileSQL(stage->backupid, 0, dstpaths[i], hashpaths[i], batch[i].sha2, batch[i].filesize, copied[i]?batch[i].filesize:0);
+			}
+		}
+		local_hash->copyFromTmpTable(false);
+	}
+
+	return nlinked;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
+#include "../Interface/Thread.h"
+#include "../Interface/Types.h"
+#include <string>
+#include <vector>
+#include <deque>
+
+class BackupServerHash;
+class ServerDownloadThread;
+
+struct SLinkItem
+{
+	SLinkItem()
+		: id(0), filesize(0)
+	{}
+
+	size_t id;
+	std::wstring fn;
+	std::wstring short_fn;
+	std::wstring curr_path;
+	std::wstring os_path;
+	std::string sha2;
+	_i64 filesize;
+};
+
+/**
+* Links files already present on the server on a set of worker threads while
+* the backup thread continues with the file list. Items are handed to the
+* workers in batches.
+*/
+class ServerLinkStage
+{
+public:
+	class IWorker
+	{
+	public:
+		virtual ~IWorker(void) {}
+
+		//Handles all items of the batch and returns the number of linked files
+		virtual size_t linkBatch(std::vector<SLinkItem>& batch, int64& linked_bytes)=0;
+	};
+
+	ServerLinkStage(size_t nthreads, size_t batch_size);
+	virtual ~ServerLinkStage(void);
+
+	void start(void);
+
+	void queueLink(const SLinkItem& item);
+
+	//Waits till all queued items are handled
+	void flush(void);
+
+	//Flushes and stops the worker threads
+	void stop(void);
+
+	//Returns the bytes linked since the last call
+	int64 takeLinkedBytes(void);
+
+	int64 getLinkedFiles(void);
+
+protected:
+	//Called on the worker thread. Workers may keep thread bound resources
+	//(e.g. database connections) till they are deleted on the same thread
+	virtual IWorker* createWorker(void)=0;
+
+private:
+	class WorkerThread : public IThread
+	{
+	public:
+		WorkerThread(ServerLinkStage* stage)
+			: stage(stage)
+		{}
+
+		void operator()(void);
+
+	private:
+		ServerLinkStage* stage;
+	};
+
+	struct SBatch
+	{
+		SBatch()
+			: do_stop(false)
+		{}
+
+		std::vector<SLinkItem> items;
+		bool do_stop;
+	};
+
+	void submitBatch(void);
+	bool nextBatch(SBatch& batch);
+	void batchDone(size_t nitems, size_t nlinked, int64 batch_linked_bytes);
+
+	size_t nthreads;
+	size_t batch_size;
+
+	IMutex* mutex;
+	ICondition* cond;
+	ICondition* done_cond;
+	std::deque<SBatch> queue;
+	std::vector<SLinkItem> curr_batch;
+	size_t in_flight;
+	int64 linked_bytes;
+	int64 linked_files;
+
+	std::vector<WorkerThread*> workers;
+	std::vector<THREADPOOL_TICKET> tickets;
+};
+
+/**
+* Link stage used by incremental file backups. Each worker links via its own
+* BackupServerHash and queues the file for download if it cannot be linked.
+*/
+class ServerHashLinkStage : public ServerLinkStage
+{
+public:
+	ServerHashLinkStage(size_t nthreads, size_t batch_size, int clientid, int backupid, bool with_hashes,
+		const std::wstring& backuppath, const std::wstring& backuppath_hashes, bool use_snapshots, bool use_reflink,
+		bool use_tmpfiles, ServerDownloadThread* server_download, bool intra_file_diffs, bool queue_downloads);
+	~ServerHashLinkStage(void);
+
+protected:
+	virtual IWorker* createWorker(void);
+
+private:
+	class HashLinkWorker : public IWorker
+	{
+	public:
+		HashLinkWorker(ServerHashLinkStage* stage);
+		~HashLinkWorker(void);
+
+		virtual size_t linkBatch(std::vector<SLinkItem>& batch, int64& linked_bytes);
+
+	private:
+		ServerHashLinkStage* stage;
+		BackupServerHash* local_hash;
+	};
+
+	int clientid;
+	int backupid;
+	bool with_hashes;
+	std::wstring backuppath;
+	std::wstring backuppath_hashes;
+	bool use_snapshots;
+	bool use_reflink;
+	bool use_tmpfiles;
+	ServerDownloadThread* server_download;
+	bool intra_file_diffs;
+	bool queue_downloads;
+};
@@ -0,0 +1,206 @@
+#ifndef CLIENT_ONLY
+
+#include "server_metrics.h"
+#include "server_status.h"
+#include "../Interface/Database.h"
+#include "../stringtools.h"
+
+IMutex *ServerMetrics::mutex=NULL;
+std::map<std::string, int64> ServerMetrics::counters;
+std::map<std::string, int64> ServerMetrics::gauges;
+std::map<std::string, ServerMetrics::SHistogram> ServerMetrics::histograms;
+
+namespace
+{
+	const int64 latency_buckets_ms[] = {1, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 60000};
+	const size_t n_latency_buckets = sizeof(latency_buckets_ms)/sizeof(latency_buckets_ms[0]);
+
+	std::string escapeLabel(const std::string& val)
+	{
+		std::string ret;
+		for(size_t i=0;i<val.size();++i)
+		{
+			if(val[i]=='\\' || val[i]=='"')
+			{
+				ret+='\\';
+				ret+=val[i];
+			}
+			else if(val[i]=='\n')
+			{
+				ret+="\\n";
+			}
+			else
+			{
+				ret+=val[i];
+			}
+		}
+		return ret;
+	}
+}
+
+void ServerMetrics::init_mutex(void)
+{
+	mutex=Server->createMutex();
+}
+
+void ServerMetrics::destroy_mutex(void)
+{
+	Server->destroy(mutex);
+}
+
+void ServerMetrics::addCounter(const std::string& name, int64 amount)
+{
+	IScopedLock lock(mutex);
+	counters[name]+=amount;
+}
+
+void ServerMetrics::addGauge(const std::string& name, int64 amount)
+{
+	IScopedLock lock(mutex);
+	gauges[name]+=amount;
+}
+
+void ServerMetrics::setGauge(const std::string& name, int64 value)
+{
+	IScopedLock lock(mutex);
+	gauges[name]=value;
+}
+
+void ServerMetrics::addLatency(const std::string& name, int64 ms)
+{
+	IScopedLock lock(mutex);
+	SHistogram& histogram=histograms[name];
+	if(histogram.buckets.empty())
+	{
+		histogram.buckets.resize(n_latency_buckets);
+	}
+
+	for(size_t i=0;i<n_latency_buckets;++i)
+	{
+		if(ms<=latency_buckets_ms[i])
+		{
+			++histogram.buckets[i];
+		}
+	}
+	histogram.sum+=ms;
+	++histogram.count;
+}
+
+std::string ServerMetrics::metricName(const std::string& name)
+{
+	size_t lpos=name.find("{");
+	if(lpos==std::string::npos)
+	{
+		return name;
+	}
+	return name.substr(0, lpos);
+}
+
+std::string ServerMetrics::metricLabels(const std::string& name)
+{
+	size_t lpos=name.find("{");
+	if(lpos==std::string::npos || name.empty() || name[name.size()-1]!='}')
+	{
+		return std::string();
+	}
+	return name.substr(lpos+1, name.size()-lpos-2);
+}
+
+std::string ServerMetrics::getPrometheusText(void)
+{
+	std::string ret;
+
+	{
+		IScopedLock lock(mutex);
+
+		std::string last_name;
+		for(std::map<std::string, int64>::iterator it=counters.begin();it!=counters.end();++it)
+		{
+			std::string mname=metricName(it->first);
+			if(mname!=last_name)
+			{
+				ret+="# TYPE "+mname+" counter\n";
+				last_name=mname;
+			}
+			ret+=it->first+" "+nconvert(it->second)+"\n";
+		}
+
+		last_name.clear();
+		for(std::map<std::string, int64>::iterator it=gauges.begin();it!=gauges.end();++it)
+		{
+			std::string mname=metricName(it->first);
+			if(mname!=last_name)
+			{
+				ret+="# TYPE "+mname+" gauge\n";
+				last_name=mname;
+			}
+			ret+=it->first+" "+nconvert(it->second)+"\n";
+		}
+
+		last_name.clear();
+		for(std::map<std::string, SHistogram>::iterator it=histograms.begin();it!=histograms.end();++it)
+		{
+			std::string mname=metricName(it->first);
+			if(mname!=last_name)
+			{
+				ret+="# TYPE "+mname+" histogram\n";
+				last_name=mname;
+			}
+
+			//Labels of e.g. name{site="x"} go in front of the bucket label
+			std::string labels=metricLabels(it->first);
+			std::string bucket_labels=labels.empty() ? std::string() : labels+",";
+			std::string sum_labels=labels.empty() ? std::string() : "{"+labels+"}";
+			for(size_t i=0;i<n_latency_buckets;++i)
+			{
+				ret+=mname+"_bucket{"+bucket_labels+"le=\""+nconvert(latency_buckets_ms[i])+"\"} "+nconvert(it->second.buckets[i])+"\n";
+			}
+			ret+=mname+"_bucket{"+bucket_labels+"le=\"+Inf\"} "+nconvert(it->second.count)+"\n";
+			ret+=mname+"_sum"+sum_labels+" "+nconvert(it->second.sum)+"\n";
+			ret+=mname+"_count"+sum_labels+" "+nconvert(it->second.count)+"\n";
+		}
+	}
+
+	SBufferPoolStats pool_stats=Server->getBufferPoolStats();
+	ret+="# TYPE urbackup_buffer_pool_bytes gauge\n";
+	ret+="urbackup_buffer_pool_bytes{state=\"reserved\"} "+nconvert(pool_stats.reserved_bytes)+"\n";
+	ret+="urbackup_buffer_pool_bytes{state=\"huge_pages\"} "+nconvert(pool_stats.huge_page_bytes)+"\n";
+	ret+="urbackup_buffer_pool_bytes{state=\"free\"} "+nconvert(pool_stats.free_bytes)+"\n";
+	ret+="urbackup_buffer_pool_bytes{state=\"thread_cached\"} "+nconvert(pool_stats.thread_cached_bytes)+"\n";
+	ret+="# TYPE urbackup_buffer_pool_allocations_total counter\n";
+	ret+="urbackup_buffer_pool_allocations_total{source=\"thread_cache\"} "+nconvert(pool_stats.thread_cache_hits)+"\n";
+	ret+="urbackup_buffer_pool_allocations_total{source=\"shared\"} "+nconvert(pool_stats.shared_hits)+"\n";
+	ret+="urbackup_buffer_pool_allocations_total{source=\"os\"} "+nconvert(pool_stats.os_allocations)+"\n";
+	ret+="# TYPE urbackup_buffer_pool_os_frees_total counter\n";
+	ret+="urbackup_buffer_pool_os_frees_total "+nconvert(pool_stats.os_frees)+"\n";
+
+	std::vector<SStatus> status=ServerStatus::getStatus();
+
+	ret+="# TYPE urbackup_prepare_hash_queue_size gauge\n";
+	for(size_t i=0;i<status.size();++i)
+	{
+		if(status[i].has_status && !status[i].done)
+		{
+			ret+="urbackup_prepare_hash_queue_size{client=\""+escapeLabel(Server->ConvertToUTF8(status[i].client))+"\"} "+nconvert(status[i].prepare_hashqueuesize)+"\n";
+		}
+	}
+
+	ret+="# TYPE urbackup_hash_queue_size gauge\n";
+	for(size_t i=0;i<status.size();++i)
+	{
+		if(status[i].has_status && !status[i].done)
+		{
+			ret+="urbackup_hash_queue_size{client=\""+escapeLabel(Server->ConvertToUTF8(status[i].client))+"\"} "+nconvert(status[i].hashqueuesize)+"\n";
+		}
+	}
+
+	return ret;
+}
+
+bool timedEndTransaction(IDatabase* db, const std::string& site)
+{
+	ScopedMetricsLatency latency("urbackup_db_commit_ms{site=\""+site+"\"}");
+	return db->EndTransaction();
+}
+
+#endif //CLIENT_ONLY
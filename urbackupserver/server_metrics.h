@@ -0,0 +1,116 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../Interface/Mutex.h"
+#include "../Interface/Server.h"
+
+class IDatabase;
+
+/**
+* Process wide registry of counters, gauges and latency histograms.
+* Exported in the Prometheus text format via the "metrics" action.
+*/
+class ServerMetrics
+{
+public:
+	static void init_mutex(void);
+	static void destroy_mutex(void);
+
+	static void addCounter(const std::string& name, int64 amount=1);
+	static void addGauge(const std::string& name, int64 amount);
+	static void setGauge(const std::string& name, int64 value);
+	static void addLatency(const std::string& name, int64 ms);
+
+	static std::string getPrometheusText(void);
+
+private:
+	struct SHistogram
+	{
+		SHistogram(void)
+			: sum(0), count(0) {}
+
+		std::vector<int64> buckets;
+		int64 sum;
+		int64 count;
+	};
+
+	static std::string metricName(const std::string& name);
+	static std::string metricLabels(const std::string& name);
+
+	static IMutex *mutex;
+	static std::map<std::string, int64> counters;
+	static std::map<std::string, int64> gauges;
+	static std::map<std::string, SHistogram> histograms;
+};
+
+class ScopedMetricsLatency
+{
+public:
+	ScopedMetricsLatency(const std::string& name)
+		: name(name), starttime(Server->getTimeMS())
+	{
+	}
+
+	~ScopedMetricsLatency(void)
+	{
+		ServerMetrics::addLatency(name, Server->getTimeMS()-starttime);
+	}
+
+private:
+	std::string name;
+	int64 starttime;
+};
+
+/**
+* Counter for per buffer hot paths. Sums locally and publishes to
+* ServerMetrics every c_publish_adds calls and on destruction, instead of
+* taking the registry lock on every call. Not thread safe.
+*/
+class LocalMetricsCounter
+{
+public:
+	LocalMetricsCounter(const std::string& name)
+		: name(name), pending(0), pending_adds(0)
+	{
+	}
+
+	~LocalMetricsCounter(void)
+	{
+		publish();
+	}
+
+	void add(int64 amount)
+	{
+		pending+=amount;
+		if(++pending_adds>=c_publish_adds)
+		{
+			publish();
+		}
+	}
+
+	void publish(void)
+	{
+		if(pending_adds>0)
+		{
+			ServerMetrics::addCounter(name, pending);
+			pending=0;
+			pending_adds=0;
+		}
+	}
+
+private:
+	static const unsigned int c_publish_adds=256;
+
+	std::string name;
+	int64 pending;
+	unsigned int pending_adds;
+};
+
+/**
+* Commits the current transaction of db and records the commit latency
+* as urbackup_db_commit_ms{site="<site>"}
+*/
+bool timedEndTransaction(IDatabase* db, const std::string& site);
@@ -24,6 +24,7 @@
 #include "../Interface/Server.h"
 #include "../stringtools.h"
 #include "server_log.h"
+#include "server_metrics.h"
 #include "../urbackupcommon/os_functions.h"
 #include "../fileservplugin/chunk_settings.h"
 #include "../md5.h"
@@ -36,6 +37,7 @@ BackupServerPrepareHash::BackupServerPrepareHash(IPipe *pPipe, IPipe *pOutput, i
 	output=pOutput;
 	clientid=pClientid;
 	working=false;
+	batch_pending=0;
 	chunk_patcher.setCallback(this);
 	has_error=false;
 }
@@ -47,11 +49,27 @@ BackupServerPrepareHash::~BackupServerPrepareHash(void)
 
 void BackupServerPrepareHash::operator()(void)
 {
+	std::vector<std::string> msgs;
+	size_t msg_idx=0;
 	while(true)
 	{
-		working=false;
+		if(msg_idx>=msgs.size())
+		{
+			working=false;
+			batch_pending=0;
+			msgs.clear();
+			msg_idx=0;
+			pipe->ReadAll(msgs);
+			if(msgs.empty())
+			{
+				continue;
+			}
+		}
+
 		std::string data;
-		size_t rc=pipe->Read(&data);
+		data.swap(msgs[msg_idx++]);
+		batch_pending=msgs.size()-msg_idx;
+		size_t rc=data.size();
 		if(data=="exit")
 		{
 			output->Write("exit");
@@ -123,14 +141,19 @@ void BackupServerPrepareHash::operator()(void)
 			{
 				ServerLogger::Log(clientid, "PT: Hashing file \""+ExtractFileName(tfn)+"\"", LL_DEBUG);
 				std::string h;
-				if(!diff_file)
-				{
-					h=hash_sha512(tf);
-				}
-				else
 				{
-					h=hash_with_patch(old_file, tf);
+					ScopedMetricsLatency latency("urbackup_prepare_hash_file_ms");
+					if(!diff_file)
+					{
+						h=hash_sha512(tf);
+					}
+					else
+					{
+						h=hash_with_patch(old_file, tf);
+					}
 				}
+				ServerMetrics::addCounter("urbackup_prepare_hash_files_total");
+				ServerMetrics::addCounter("urbackup_prepare_hash_bytes_total", t_filesize);
 
 				Server->destroy(tf);
 				if(old_file!=NULL)
@@ -150,12 +173,30 @@ void BackupServerPrepareHash::operator()(void)
 				data.addString(old_file_fn);
 				data.addInt64(t_filesize);
 
-				output->Write(data.getDataPtr(), data.getDataSize() );
+				std::string msg(data.getDataPtr(), data.getDataSize());
+				output->WriteOwned(msg);
 			}
 		}
 	}
 }
 
+void BackupServerPrepareHash::queueFile(IPipe *pipe, const std::wstring &temp_fn, int backupid, bool incremental, const std::wstring &dstpath,
+	const std::wstring &hashpath, const std::wstring &hashoutput_fn, const std::string &old_file, int64 filesize)
+{
+	CWData data;
+	data.addString(Server->ConvertToUTF8(temp_fn));
+	data.addInt(backupid);
+	data.addChar(incremental?1:0);
+	data.addString(Server->ConvertToUTF8(dstpath));
+	data.addString(Server->ConvertToUTF8(hashpath));
+	data.addString(Server->ConvertToUTF8(hashoutput_fn));
+	data.addString(old_file);
+	data.addInt64(filesize);
+
+	std::string msg(data.getDataPtr(), data.getDataSize());
+	pipe->WriteOwned(msg);
+}
+
 std::string BackupServerPrepareHash::hash_sha512(IFile *f)
 {
 	f->Seek(0);
@@ -200,6 +241,11 @@ bool BackupServerPrepareHash::isWorking(void)
 	return working;
 }
 
+size_t BackupServerPrepareHash::getQueueSize(void)
+{
+	return pipe->getNumElements()+batch_pending;
+}
+
 std::string BackupServerPrepareHash::build_chunk_hashs(IFile *f, IFile *hashoutput, INotEnoughSpaceCallback *cb, bool ret_sha2, IFile *copy, bool modify_inplace)
 {
 	f->Seek(0);
@@ -338,6 +384,59 @@ bool BackupServerPrepareHash::writeFileRepeat(IFile *f, const char *buf, size_t
 	return true;
 }
 
+bool BackupServerPrepareHash::writeRepeatFreeSpaceAt(IFile *f, _i64 pos, const char *buf, size_t bsize, INotEnoughSpaceCallback *cb)
+{
+	if( cb==NULL)
+		return writeFileRepeatAt(f, pos, buf, bsize);
+
+	_u32 rc=f->WriteAt(pos, buf, (_u32)bsize);
+	if(rc!=bsize)
+	{
+		if(cb->handle_not_enough_space(f->getFilenameW()) )
+		{
+			_u32 written=rc;
+			do
+			{
+				rc=f->WriteAt(pos+written, buf+written, (_u32)bsize-written);
+				written+=rc;
+			}
+			while(written<bsize && rc>0);
+
+			if(rc==0) return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool BackupServerPrepareHash::writeFileRepeatAt(IFile *f, _i64 pos, const char *buf, size_t bsize)
+{
+	_u32 written=0;
+	_u32 rc;
+	int tries=50;
+	do
+	{
+		rc=f->WriteAt(pos+written, buf+written, (_u32)(bsize-written));
+		written+=rc;
+		if(rc==0)
+		{
+			Server->wait(10000);
+			--tries;
+		}
+	}
+	while(written<bsize && (rc>0 || tries>0) );
+
+	if(rc==0)
+	{
+		return false;
+	}
+
+	return true;
+}
+
 bool BackupServerPrepareHash::hasError(void)
 {
 	volatile bool r=has_error;
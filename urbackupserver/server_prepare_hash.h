@@ -25,9 +25,20 @@ public:
 	
 	bool isWorking(void);
 
+	//Number of messages in the input pipe plus the ones
+	//already taken out of it but not processed yet
+	size_t getQueueSize(void);
+
 	static std::string build_chunk_hashs(IFile *f, IFile *hashoutput, INotEnoughSpaceCallback *cb, bool ret_sha2, IFile *copy, bool modify_inplace);
 	static bool writeRepeatFreeSpace(IFile *f, const char *buf, size_t bsize, INotEnoughSpaceCallback *cb);
 	static bool writeFileRepeat(IFile *f, const char *buf, size_t bsize);
+	//Same as above, but writes at pos without using the file pointer
+	static bool writeRepeatFreeSpaceAt(IFile *f, _i64 pos, const char *buf, size_t bsize, INotEnoughSpaceCallback *cb);
+	static bool writeFileRepeatAt(IFile *f, _i64 pos, const char *buf, size_t bsize);
+
+	//Queues a downloaded file (stored in temp_fn) for hashing into pipe
+	static void queueFile(IPipe *pipe, const std::wstring &temp_fn, int backupid, bool incremental, const std::wstring &dstpath,
+		const std::wstring &hashpath, const std::wstring &hashoutput_fn, const std::string &old_file, int64 filesize);
 
 	void next_chunk_patcher_bytes(const char *buf, size_t bsize, bool changed);
 
@@ -49,6 +60,7 @@ private:
 	ChunkPatcher chunk_patcher;
 	
 	volatile bool working;
+	volatile size_t batch_pending;
 	volatile bool has_error;
 };
 
@@ -318,6 +318,9 @@ void ServerSettings::readSettingsDefault(void)
 	settings->internet_readd_file_entries=(settings_default->getValue("internet_readd_file_entries", "true")=="true");
 	settings->background_backups=(settings_default->getValue("background_backups", "true")=="true");
 	settings->follow_symlinks=(settings_default->getValue("follow_symlinks", "true")=="true");
+	settings->synthetic_full_images=(settings_default->getValue("synthetic_full_images", "false")=="true");
+	settings->synthetic_full_file_backups=(settings_default->getValue("synthetic_full_file_backups", "false")=="true");
+	settings->synthetic_full_image_speed=atoi(settings_default->getValue("synthetic_full_image_speed", "-1").c_str());
 }
 
 void ServerSettings::readSettingsClient(void)
@@ -101,6 +101,9 @@ struct SSettings
 	bool internet_readd_file_entries;
 	bool background_backups;
 	bool follow_symlinks;
+	bool synthetic_full_images;
+	bool synthetic_full_file_backups;
+	int synthetic_full_image_speed;
 };
 
 struct STimeSpan
@@ -29,8 +29,10 @@ int64 ServerStatus::last_status_update;
 
 int ServerStatus::server_nospc_stalled=0;
 bool ServerStatus::server_nospc_fatal=false;
+std::map<std::string, SClientStatusSnapshot> ServerStatus::client_status_snapshots;
 
 const unsigned int inactive_time_const=30*60*1000;
+const unsigned int client_status_snapshot_max_age=60*1000;
 
 void ServerStatus::init_mutex(void)
 {
@@ -85,6 +87,7 @@ void ServerStatus::setOnline(const std::wstring &clientname, bool bonline)
 	{
 		last_status_update=Server->getTimeMS();
 	}
+	markClientStatusDirty(clientname);
 }
 
 void ServerStatus::setROnline(const std::wstring &clientname, bool bonline)
@@ -103,6 +106,7 @@ void ServerStatus::setDone(const std::wstring &clientname, bool bdone)
 	IScopedLock lock(mutex);
 	SStatus *s=&status[clientname];
 	s->done=bdone;
+	markClientStatusDirty(clientname);
 }
 
 void ServerStatus::setIP(const std::wstring &clientname, unsigned int ip)
@@ -212,6 +216,72 @@ void ServerStatus::setOSVersionString(const std::wstring &clientname, const std:
 	s->os_version_string=os_version_string;
 }
 
+bool ServerStatus::getClientStatusSnapshot(const std::string& key, std::vector<SClientStatusSnapshotItem>& items, std::vector<std::wstring>& dirty_clients)
+{
+	IScopedLock lock(mutex);
+	std::map<std::string, SClientStatusSnapshot>::iterator it=client_status_snapshots.find(key);
+	if(it==client_status_snapshots.end())
+	{
+		return false;
+	}
+
+	if(Server->getTimeMS()-it->second.created>client_status_snapshot_max_age)
+	{
+		client_status_snapshots.erase(it);
+		return false;
+	}
+
+	items=it->second.items;
+	dirty_clients.assign(it->second.dirty_clients.begin(), it->second.dirty_clients.end());
+	return true;
+}
+
+void ServerStatus::setClientStatusSnapshot(const std::string& key, const std::vector<SClientStatusSnapshotItem>& items)
+{
+	IScopedLock lock(mutex);
+	SClientStatusSnapshot& snapshot=client_status_snapshots[key];
+	snapshot.created=Server->getTimeMS();
+	snapshot.items=items;
+	snapshot.dirty_clients.clear();
+}
+
+void ServerStatus::updateClientStatusSnapshot(const std::string& key, const std::vector<SClientStatusSnapshotItem>& items, const std::vector<std::wstring>& refreshed_clients)
+{
+	IScopedLock lock(mutex);
+	std::map<std::string, SClientStatusSnapshot>::iterator it=client_status_snapshots.find(key);
+	if(it==client_status_snapshots.end())
+	{
+		return;
+	}
+
+	it->second.items=items;
+	for(size_t i=0;i<refreshed_clients.size();++i)
+	{
+		it->second.dirty_clients.erase(refreshed_clients[i]);
+	}
+}
+
+void ServerStatus::invalidateClientStatusSnapshots(void)
+{
+	IScopedLock lock(mutex);
+	client_status_snapshots.clear();
+}
+
+void ServerStatus::invalidateClientStatusSnapshots(const std::wstring& clientname)
+{
+	IScopedLock lock(mutex);
+	markClientStatusDirty(clientname);
+}
+
+void ServerStatus::markClientStatusDirty(const std::wstring& clientname)
+{
+	for(std::map<std::string, SClientStatusSnapshot>::iterator it=client_status_snapshots.begin();
+		it!=client_status_snapshots.end();++it)
+	{
+		it->second.dirty_clients.insert(clientname);
+	}
+}
+
 ACTION_IMPL(server_status)
 {
 #ifndef _DEBUG
@@ -2,6 +2,7 @@
 #define SERVERSTATUS_H
 
 #include <map>
+#include <set>
 #include <vector>
 
 #include "../Interface/Mutex.h"
@@ -58,6 +59,29 @@ struct SStatus
 	std::string os_version_string;
 };
 
+struct SClientStatusSnapshotItem
+{
+	int clientid;
+	std::wstring name;
+	std::wstring lastbackup;
+	std::wstring lastseen;
+	std::wstring lastbackup_image;
+	std::wstring delete_pending;
+	bool file_ok;
+	bool image_ok;
+};
+
+struct SClientStatusSnapshot
+{
+	SClientStatusSnapshot(void)
+		: created(0) {}
+
+	int64 created;
+	std::vector<SClientStatusSnapshotItem> items;
+	//Clients whose items have to be read again
+	std::set<std::wstring> dirty_clients;
+};
+
 class ServerStatus
 {
 public:
@@ -88,13 +112,25 @@ public:
 	static int getServerNospcStalled(void);
 	static bool getServerNospcFatal(void);
 
+	static bool getClientStatusSnapshot(const std::string& key, std::vector<SClientStatusSnapshotItem>& items, std::vector<std::wstring>& dirty_clients);
+	static void setClientStatusSnapshot(const std::string& key, const std::vector<SClientStatusSnapshotItem>& items);
+	//Replaces the items after the dirty clients were read again. Keeps the age of the snapshot
+	static void updateClientStatusSnapshot(const std::string& key, const std::vector<SClientStatusSnapshotItem>& items, const std::vector<std::wstring>& refreshed_clients);
+	static void invalidateClientStatusSnapshots(void);
+	static void invalidateClientStatusSnapshots(const std::wstring& clientname);
+
 private:
+	//mutex has to be held
+	static void markClientStatusDirty(const std::wstring& clientname);
+
 	static std::map<std::wstring, SStatus> status;
 	static IMutex *mutex;
 	static int64 last_status_update;
 
 	static int server_nospc_stalled;
 	static bool server_nospc_fatal;
+
+	static std::map<std::string, SClientStatusSnapshot> client_status_snapshots;
 };
 
 class ActiveThread : public IThread
@@ -0,0 +1,357 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2014 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef CLIENT_ONLY
+
+#include "server_synthetic_backup.h"
+#include "server_dir_links.h"
+#include "server_running.h"
+#include "server_log.h"
+#include "server.h"
+#include "snapshot_helper.h"
+#include "../Interface/Server.h"
+#include "../Interface/File.h"
+#include "../Interface/ThreadPool.h"
+#include "../urbackupcommon/os_functions.h"
+#include "../stringtools.h"
+#include <memory>
+#include <vector>
+
+namespace
+{
+	const size_t c_present_transaction_size=10000;
+	const size_t c_copy_blocksize=512*1024;
+}
+
+ServerSyntheticBackup::ServerSyntheticBackup(ServerBackupDao& backup_dao, int clientid, const std::wstring& clientname,
+	const std::wstring& backupfolder, bool use_snapshots)
+	: backup_dao(backup_dao), clientid(clientid), clientname(clientname), backupfolder(backupfolder),
+	  use_snapshots(use_snapshots), pooldir(backupfolder+os_file_sep()+clientname+os_file_sep()+L".directory_pool"),
+	  dir_link_batch(backup_dao, clientid, pooldir, BackupServer::isFilesystemTransactionEnabled()),
+	  has_present_table(false), transaction_entries(0), linked_files(0), linked_dirs(0)
+{
+}
+
+ServerSyntheticBackup::~ServerSyntheticBackup(void)
+{
+	endPresentTransaction();
+
+	if(has_present_table)
+	{
+		backup_dao.dropTemporarySyntheticPresentTable();
+	}
+}
+
+int ServerSyntheticBackup::create(int src_backupid, const std::wstring& src_path)
+{
+	std::wstring src_root=backupfolder+os_file_sep()+clientname+os_file_sep()+src_path;
+	std::wstring dst_path=src_path+L"_Synthetic";
+	std::wstring dst_root=backupfolder+os_file_sep()+clientname+os_file_sep()+dst_path;
+
+	if(os_directory_exists(os_file_prefix(dst_root)))
+	{
+		ServerLogger::Log(clientid, L"Synthetic full file backup directory \""+dst_root+L"\" already exists", LL_ERROR);
+		return -1;
+	}
+
+	ServerLogger::Log(clientid, L"Creating synthetic full file backup from \""+src_path+L"\"...", LL_INFO);
+
+	int64 starttime=Server->getTimeMS();
+
+	backup_dao.newSyntheticFileBackup(clientid, dst_path);
+	int backupid=static_cast<int>(backup_dao.getLastId());
+
+	ServerRunningUpdater *running_updater=new ServerRunningUpdater(backupid, false);
+	Server->getThreadPool()->execute(running_updater);
+
+	bool ok;
+	if(use_snapshots)
+	{
+		ok=SnapshotHelper::snapshotFileSystem(clientname, src_path, dst_path);
+		if(!ok)
+		{
+			ServerLogger::Log(clientid, L"Error snapshotting \""+src_path+L"\" to \""+dst_path+L"\"", LL_ERROR);
+		}
+	}
+	else
+	{
+		ok=os_create_dir(os_file_prefix(dst_root));
+		if(!ok)
+		{
+			ServerLogger::Log(clientid, L"Error creating directory \""+dst_root+L"\"", LL_ERROR);
+		}
+	}
+
+	ok = ok && linkTree(src_root, dst_root);
+
+	int64 link_time=Server->getTimeMS()-starttime;
+
+	ok = ok && copyFileEntries(backupid, src_backupid, src_path, dst_root);
+
+	running_updater->stop();
+
+	if(!ok)
+	{
+		ServerLogger::Log(clientid, "Creating synthetic full file backup failed. Removing it...", LL_ERROR);
+
+		if(!use_snapshots || !SnapshotHelper::removeFilesystem(clientname, dst_path))
+		{
+			remove_directory_link_dir(dst_root, backup_dao, clientid);
+		}
+		backup_dao.deleteFileBackup(backupid);
+		return -1;
+	}
+
+	backup_dao.setFileBackupDone(backupid);
+
+	ServerLogger::Log(clientid, "Synthetic full file backup done. Linked "+nconvert(linked_files)+" files and "+nconvert(linked_dirs)+
+		" directory links in "+PrettyPrintTime(link_time)+". Total time: "+PrettyPrintTime(Server->getTimeMS()-starttime), LL_INFO);
+
+	return backupid;
+}
+
+bool ServerSyntheticBackup::linkTree(const std::wstring& src_root, const std::wstring& dst_root)
+{
+	if(!has_present_table)
+	{
+		if(!backup_dao.createTemporarySyntheticPresentTable())
+		{
+			ServerLogger::Log(clientid, "Error creating temporary file table", LL_ERROR);
+			return false;
+		}
+		has_present_table=true;
+	}
+
+	bool ret=linkDirectory(src_root, dst_root, std::wstring(), true);
+
+	endPresentTransaction();
+
+	std::vector<std::pair<std::wstring, std::wstring> > failed_links;
+	if(!dir_link_batch.flush(&failed_links))
+	{
+		ServerLogger::Log(clientid, L"Error creating "+convert(failed_links.size())+L" directory links in \""+dst_root+L"\". Copying the directories instead...", LL_WARNING);
+		for(size_t i=0;i<failed_links.size();++i)
+		{
+			if(!copy_directory_tree(failed_links[i].second, failed_links[i].first))
+			{
+				ServerLogger::Log(clientid, L"Error copying directory \""+failed_links[i].second+L"\" to \""+failed_links[i].first+L"\"", LL_ERROR);
+				ret=false;
+			}
+		}
+	}
+
+	return ret;
+}
+
+int64 ServerSyntheticBackup::getLinkedFiles(void)
+{
+	return linked_files;
+}
+
+int64 ServerSyntheticBackup::getLinkedDirectories(void)
+{
+	return linked_dirs;
+}
+
+bool ServerSyntheticBackup::linkDirectory(const std::wstring& src, const std::wstring& dst, const std::wstring& relpath, bool record)
+{
+	bool has_error;
+	std::vector<SFile> files=getFiles(os_file_prefix(src), &has_error, true, false);
+	if(has_error)
+	{
+		ServerLogger::Log(clientid, L"Error listing directory \""+src+L"\"", LL_ERROR);
+		return false;
+	}
+
+	for(size_t i=0;i<files.size();++i)
+	{
+		const SFile& cf=files[i];
+		std::wstring curr_src=src+os_file_sep()+cf.name;
+		std::wstring curr_dst=dst.empty()?std::wstring():(dst+os_file_sep()+cf.name);
+		std::wstring curr_relpath=relpath+os_file_sep()+cf.name;
+
+		if(cf.isdir)
+		{
+			bool curr_record = record && !(relpath.empty() && cf.name==L".hashes");
+
+			if(!curr_dst.empty() && os_is_symlink(os_file_prefix(curr_src)))
+			{
+				endPresentTransaction();
+
+				if(use_snapshots)
+				{
+					//The snapshot contains the symlink, but the link is not referenced yet
+					os_remove_symlink_dir(os_file_prefix(curr_dst));
+				}
+
+				if(!dir_link_batch.link(curr_dst, curr_src))
+				{
+					ServerLogger::Log(clientid, L"Error linking directory \""+curr_src+L"\" to \""+curr_dst+L"\"", LL_ERROR);
+					return false;
+				}
+				++linked_dirs;
+
+				//Only record the files in the linked directory
+				curr_dst.clear();
+			}
+			else if(!curr_dst.empty() && !use_snapshots)
+			{
+				if(!os_create_dir(os_file_prefix(curr_dst)))
+				{
+					ServerLogger::Log(clientid, L"Error creating directory \""+curr_dst+L"\"", LL_ERROR);
+					return false;
+				}
+			}
+
+			if( (curr_record || !curr_dst.empty())
+				&& !linkDirectory(curr_src, curr_dst, curr_relpath, curr_record) )
+			{
+				return false;
+			}
+		}
+		else
+		{
+			if(!curr_dst.empty() && !use_snapshots)
+			{
+				bool too_many_hardlinks;
+				if(!os_create_hardlink(os_file_prefix(curr_dst), os_file_prefix(curr_src), false, &too_many_hardlinks))
+				{
+					if(!too_many_hardlinks)
+					{
+						ServerLogger::Log(clientid, L"Error creating hardlink from \""+curr_src+L"\" to \""+curr_dst+L"\"", LL_ERROR);
+						return false;
+					}
+
+					if(!copyFile(curr_src, curr_dst))
+					{
+						return false;
+					}
+				}
+				++linked_files;
+			}
+
+			if(record)
+			{
+				addPresentFile(curr_relpath);
+			}
+		}
+	}
+
+	return true;
+}
+
+bool ServerSyntheticBackup::copyFileEntries(int backupid, int src_backupid, const std::wstring& src_path, const std::wstring& dst_root)
+{
+	std::vector<ServerBackupDao::SFileBackupPath> chain=backup_dao.getFileBackupChain(clientid, src_backupid);
+	if(chain.empty())
+	{
+		ServerBackupDao::SFileBackupPath src = { src_backupid, src_path };
+		chain.push_back(src);
+	}
+
+	if(!backup_dao.createTemporarySyntheticFilesTable())
+	{
+		ServerLogger::Log(clientid, "Error creating temporary file entry table", LL_ERROR);
+		return false;
+	}
+
+	ServerLogger::Log(clientid, "Copying file entries of "+nconvert(chain.size())+" file backups...", LL_DEBUG);
+
+	backup_dao.BeginWriteTransaction();
+
+	//Newest entry for each path wins
+	for(size_t i=0;i<chain.size();++i)
+	{
+		std::wstring root=backupfolder+os_file_sep()+clientname+os_file_sep()+chain[i].path;
+		int fullpath_start=static_cast<int>(root.size())+1;
+		int hashpath_start=static_cast<int>((root+os_file_sep()+L".hashes").size())+1;
+
+		backup_dao.copyNewToTemporarySyntheticFilesTable(fullpath_start, hashpath_start, chain[i].id);
+		backup_dao.copyToTemporarySyntheticFilesTable(fullpath_start, hashpath_start, chain[i].id);
+	}
+
+	backup_dao.copyFromTemporarySyntheticFilesTableToFilesNewTable(backupid, dst_root, dst_root+os_file_sep()+L".hashes", clientid);
+
+	int copied_entries=backup_dao.getLastChanges();
+
+	backup_dao.endTransaction();
+
+	backup_dao.dropTemporarySyntheticFilesTable();
+
+	ServerLogger::Log(clientid, "Copied "+nconvert(copied_entries)+" file entries", LL_DEBUG);
+
+	return true;
+}
+
+bool ServerSyntheticBackup::copyFile(const std::wstring& src, const std::wstring& dst)
+{
+	std::auto_ptr<IFile> fsrc(Server->openFile(os_file_prefix(src), MODE_READ_SEQUENTIAL));
+	if(fsrc.get()==NULL)
+	{
+		ServerLogger::Log(clientid, L"Error opening \""+src+L"\"", LL_ERROR);
+		return false;
+	}
+
+	std::auto_ptr<IFile> fdst(Server->openFile(os_file_prefix(dst), MODE_WRITE));
+	if(fdst.get()==NULL)
+	{
+		ServerLogger::Log(clientid, L"Error creating \""+dst+L"\"", LL_ERROR);
+		return false;
+	}
+
+	std::vector<char> buf(c_copy_blocksize);
+	_u32 read;
+	do
+	{
+		read=fsrc->Read(&buf[0], static_cast<_u32>(buf.size()));
+		if(read>0 && fdst->Write(&buf[0], read)!=read)
+		{
+			ServerLogger::Log(clientid, L"Error writing to \""+dst+L"\"", LL_ERROR);
+			return false;
+		}
+	}
+	while(read>0);
+
+	return true;
+}
+
+void ServerSyntheticBackup::addPresentFile(const std::wstring& relpath)
+{
+	if(transaction_entries==0)
+	{
+		backup_dao.BeginWriteTransaction();
+	}
+
+	backup_dao.insertIntoTemporarySyntheticPresentTable(relpath);
+
+	if(++transaction_entries>=c_present_transaction_size)
+	{
+		endPresentTransaction();
+	}
+}
+
+void ServerSyntheticBackup::endPresentTransaction(void)
+{
+	if(transaction_entries>0)
+	{
+		backup_dao.endTransaction();
+		transaction_entries=0;
+	}
+}
+
+#endif //CLIENT_ONLY
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "dao/ServerBackupDao.h"
+#include "server_dir_links.h"
+#include "../Interface/Types.h"
+#include <string>
+
+/**
+* Creates a full file backup from an existing file backup on the server
+* (synthetic full file backup). Files are hardlinked, directory links are
+* referenced again and the file entries are copied in bulk from the
+* backups the source is based on.
+*/
+class ServerSyntheticBackup
+{
+public:
+	ServerSyntheticBackup(ServerBackupDao& backup_dao, int clientid, const std::wstring& clientname,
+		const std::wstring& backupfolder, bool use_snapshots);
+	~ServerSyntheticBackup(void);
+
+	//Returns the id of the new file backup or -1 on error
+	int create(int src_backupid, const std::wstring& src_path);
+
+	//Recreates the tree at src_root in dst_root (if dst_root is not empty) and
+	//records the relative path of every file
+	bool linkTree(const std::wstring& src_root, const std::wstring& dst_root);
+
+	int64 getLinkedFiles(void);
+	int64 getLinkedDirectories(void);
+
+private:
+	bool linkDirectory(const std::wstring& src, const std::wstring& dst, const std::wstring& relpath, bool record);
+	bool copyFileEntries(int backupid, int src_backupid, const std::wstring& src_path, const std::wstring& dst_root);
+	bool copyFile(const std::wstring& src, const std::wstring& dst);
+	void addPresentFile(const std::wstring& relpath);
+	void endPresentTransaction(void);
+
+	ServerBackupDao& backup_dao;
+	int clientid;
+	std::wstring clientname;
+	std::wstring backupfolder;
+	bool use_snapshots;
+	std::wstring pooldir;
+	DirectoryLinkBatch dir_link_batch;
+
+	bool has_present_table;
+	size_t transaction_entries;
+	int64 linked_files;
+	int64 linked_dirs;
+};
@@ -0,0 +1,386 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2014 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifndef CLIENT_ONLY
+
+#include "server_synthetic_image.h"
+#include "server_running.h"
+#include "server_log.h"
+#include "database.h"
+#include "../Interface/Server.h"
+#include "../Interface/Database.h"
+#include "../Interface/Query.h"
+#include "../Interface/File.h"
+#include "../Interface/ThreadPool.h"
+#include "../Interface/PipeThrottler.h"
+#include "../fsimageplugin/IFSImageFactory.h"
+#include "../fsimageplugin/IVHDFile.h"
+#include "../urbackupcommon/os_functions.h"
+#include "../stringtools.h"
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+extern IFSImageFactory *image_fak;
+
+IMutex* ServerSyntheticImage::mutex=NULL;
+std::set<std::pair<int, std::string> > ServerSyntheticImage::running;
+volatile bool ServerSyntheticImage::do_stop=false;
+
+namespace
+{
+	const size_t c_merge_blocksize=512*1024;
+}
+
+ServerSyntheticImage::ServerSyntheticImage(int clientid, int backupid, const std::string& letter, int speed_bps)
+	: clientid(clientid), backupid(backupid), letter(letter), throttler(NULL)
+{
+	if(speed_bps>0)
+	{
+		throttler=Server->createPipeThrottler(speed_bps);
+	}
+}
+
+void ServerSyntheticImage::init_mutex(void)
+{
+	mutex=Server->createMutex();
+}
+
+void ServerSyntheticImage::destroy_mutex(void)
+{
+	Server->destroy(mutex);
+}
+
+bool ServerSyntheticImage::start(int clientid, int backupid, const std::string& letter, int speed_bps)
+{
+	IScopedLock lock(mutex);
+
+	if(!running.insert(std::make_pair(clientid, letter)).second)
+	{
+		return false;
+	}
+
+	Server->getThreadPool()->execute(new ServerSyntheticImage(clientid, backupid, letter, speed_bps));
+	return true;
+}
+
+bool ServerSyntheticImage::isRunning(int clientid, const std::string& letter)
+{
+	IScopedLock lock(mutex);
+	return running.find(std::make_pair(clientid, letter))!=running.end();
+}
+
+void ServerSyntheticImage::stopAll(void)
+{
+	do_stop=true;
+
+	int64 starttime=Server->getTimeMS();
+	while(Server->getTimeMS()-starttime<10000)
+	{
+		{
+			IScopedLock lock(mutex);
+			if(running.empty())
+			{
+				return;
+			}
+		}
+		Server->wait(100);
+	}
+}
+
+void ServerSyntheticImage::operator()(void)
+{
+	IDatabase *db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER);
+
+	if(image_fak==NULL)
+	{
+		ServerLogger::Log(clientid, "Image plugin not loaded. Cannot create synthetic full image backup.", LL_ERROR);
+	}
+	else
+	{
+		ServerLogger::Log(clientid, "Creating synthetic full image backup of "+letter+"...", LL_INFO);
+
+		int64 starttime=Server->getTimeMS();
+		int new_backupid=mergeImage(db, backupid);
+		if(new_backupid!=-1)
+		{
+			IQuery *q_assoc=db->Prepare("SELECT assoc_id, letter FROM assoc_images INNER JOIN backup_images ON assoc_id=id WHERE img_id=?", false);
+			q_assoc->Bind(backupid);
+			db_results res_assoc=q_assoc->Read();
+			q_assoc->Reset();
+			db->destroyQuery(q_assoc);
+
+			IQuery *q_save_assoc=db->Prepare("INSERT INTO assoc_images (img_id, assoc_id) VALUES (?, ?)", false);
+			for(size_t i=0;i<res_assoc.size();++i)
+			{
+				int assoc_id;
+				if(res_assoc[i][L"letter"]==L"SYSVOL")
+				{
+					//SYSVOL is always backed up as a full image, so the synthetic
+					//image can share it with the incremental image
+					assoc_id=watoi(res_assoc[i][L"assoc_id"]);
+				}
+				else
+				{
+					assoc_id=mergeImage(db, watoi(res_assoc[i][L"assoc_id"]));
+				}
+				if(assoc_id!=-1)
+				{
+					q_save_assoc->Bind(new_backupid);
+					q_save_assoc->Bind(assoc_id);
+					q_save_assoc->Write();
+					q_save_assoc->Reset();
+				}
+			}
+			db->destroyQuery(q_save_assoc);
+
+			ServerLogger::Log(clientid, "Synthetic full image backup of "+letter+" done in "+PrettyPrintTime(Server->getTimeMS()-starttime), LL_INFO);
+		}
+		else
+		{
+			ServerLogger::Log(clientid, "Creating synthetic full image backup of "+letter+" failed", LL_ERROR);
+		}
+	}
+
+	db->destroyAllQueries();
+
+	if(throttler!=NULL)
+	{
+		Server->destroy(throttler);
+	}
+
+	{
+		IScopedLock lock(mutex);
+		running.erase(std::make_pair(clientid, letter));
+	}
+
+	delete this;
+}
+
+int ServerSyntheticImage::mergeImage(IDatabase* db, int src_backupid)
+{
+	IQuery *q=db->Prepare("SELECT path, letter, version, backuptime FROM backup_images WHERE id=? AND complete=1", false);
+	q->Bind(src_backupid);
+	db_results res=q->Read();
+	q->Reset();
+	db->destroyQuery(q);
+
+	if(res.empty())
+	{
+		ServerLogger::Log(clientid, "Image backup "+nconvert(src_backupid)+" not found", LL_ERROR);
+		return -1;
+	}
+
+	std::wstring src_path=res[0][L"path"];
+	std::wstring ext=findextension(src_path);
+	std::wstring dst_path=src_path.substr(0, src_path.size()-ext.size()-1)+L"_Synthetic."+ext;
+
+	q=db->Prepare("INSERT INTO backup_images (clientid, path, incremental, incremental_ref, complete, running, size_bytes, version, letter, backuptime) "
+		"VALUES (?, ?, 0, 0, 0, CURRENT_TIMESTAMP, 0, ?, ?, ?)", false);
+	q->Bind(clientid);
+	q->Bind(dst_path);
+	q->Bind(watoi(res[0][L"version"]));
+	q->Bind(res[0][L"letter"]);
+	q->Bind(res[0][L"backuptime"]);
+	q->Write();
+	q->Reset();
+	db->destroyQuery(q);
+	int new_backupid=static_cast<int>(db->getLastInsertID());
+
+	ServerRunningUpdater *running_updater=new ServerRunningUpdater(new_backupid, true);
+	Server->getThreadPool()->execute(running_updater);
+
+	bool ok=copyImage(src_path, dst_path)
+		&& copyFile(src_path+L".hash", dst_path+L".hash");
+
+	if(ok)
+	{
+		std::auto_ptr<IFile> mbr_file(Server->openFile(os_file_prefix(src_path+L".mbr"), MODE_READ));
+		if(mbr_file.get()!=NULL)
+		{
+			mbr_file.reset();
+			ok=copyFile(src_path+L".mbr", dst_path+L".mbr");
+		}
+	}
+
+	running_updater->stop();
+
+	if(!ok)
+	{
+		removeImage(db, new_backupid, dst_path);
+		return -1;
+	}
+
+	std::auto_ptr<IFile> dst_file(Server->openFile(os_file_prefix(dst_path), MODE_READ));
+	int64 size_bytes=dst_file.get()!=NULL?dst_file->Size():0;
+	dst_file.reset();
+
+	q=db->Prepare("UPDATE backup_images SET complete=1, size_bytes=? WHERE id=?", false);
+	q->Bind(size_bytes);
+	q->Bind(new_backupid);
+	q->Write();
+	q->Reset();
+	db->destroyQuery(q);
+
+	return new_backupid;
+}
+
+bool ServerSyntheticImage::copyImage(const std::wstring& src_path, const std::wstring& dst_path)
+{
+	IVHDFile *src=image_fak->createVHDFile(os_file_prefix(src_path), true, 0);
+	if(src==NULL || !src->isOpen())
+	{
+		ServerLogger::Log(clientid, L"Error opening VHD file \""+src_path+L"\"", LL_ERROR);
+		if(src!=NULL) image_fak->destroyVHDFile(src);
+		return false;
+	}
+
+	IFSImageFactory::CompressionSetting compression=IFSImageFactory::CompressionSetting_None;
+	if(findextension(dst_path)==L"vhdz")
+	{
+		compression=IFSImageFactory::CompressionSetting_Zlib;
+	}
+
+	uint64 size=src->getSize();
+	unsigned int blocksize=src->getBlocksize();
+
+	IVHDFile *dst=image_fak->createVHDFile(os_file_prefix(dst_path), false, size, blocksize, true, compression);
+	if(dst==NULL || !dst->isOpen())
+	{
+		ServerLogger::Log(clientid, L"Error creating VHD file \""+dst_path+L"\"", LL_ERROR);
+		if(dst!=NULL) image_fak->destroyVHDFile(dst);
+		image_fak->destroyVHDFile(src);
+		return false;
+	}
+
+	std::vector<char> buf(c_merge_blocksize);
+	bool ok=true;
+	int64 copied=0;
+	for(uint64 pos=0;pos<size;)
+	{
+		if(do_stop)
+		{
+			ServerLogger::Log(clientid, "Creating synthetic full image backup was interrupted", LL_WARNING);
+			ok=false;
+			break;
+		}
+
+		uint64 block_end=(pos/blocksize+1)*blocksize;
+
+		//Only blocks allocated somewhere in the chain are copied
+		src->Seek(pos);
+		if(!src->has_sector())
+		{
+			pos=block_end;
+			continue;
+		}
+
+		size_t toread=static_cast<size_t>((std::min)((uint64)c_merge_blocksize, (std::min)(block_end, size)-pos));
+		size_t read;
+		if(!src->Read(&buf[0], toread, read) || read!=toread)
+		{
+			ServerLogger::Log(clientid, L"Error reading from VHD file \""+src_path+L"\"", LL_ERROR);
+			ok=false;
+			break;
+		}
+
+		dst->Seek(pos);
+		if(dst->Write(&buf[0], static_cast<_u32>(read))!=read)
+		{
+			ServerLogger::Log(clientid, L"Error writing to VHD file \""+dst_path+L"\"", LL_ERROR);
+			ok=false;
+			break;
+		}
+
+		if(throttler!=NULL)
+		{
+			throttler->addBytes(read, true);
+		}
+
+		pos+=read;
+		copied+=read;
+	}
+
+	if(ok && !dst->finish())
+	{
+		ServerLogger::Log(clientid, L"Error finishing VHD file \""+dst_path+L"\"", LL_ERROR);
+		ok=false;
+	}
+
+	image_fak->destroyVHDFile(dst);
+	image_fak->destroyVHDFile(src);
+
+	if(ok)
+	{
+		ServerLogger::Log(clientid, L"Merged "+convert(copied/(1024*1024))+L" MB of image \""+src_path+L"\" into \""+dst_path+L"\"", LL_DEBUG);
+	}
+
+	return ok;
+}
+
+bool ServerSyntheticImage::copyFile(const std::wstring& src_path, const std::wstring& dst_path)
+{
+	std::auto_ptr<IFile> src(Server->openFile(os_file_prefix(src_path), MODE_READ));
+	if(src.get()==NULL)
+	{
+		ServerLogger::Log(clientid, L"Error opening \""+src_path+L"\"", LL_ERROR);
+		return false;
+	}
+
+	std::auto_ptr<IFile> dst(Server->openFile(os_file_prefix(dst_path), MODE_WRITE));
+	if(dst.get()==NULL)
+	{
+		ServerLogger::Log(clientid, L"Error creating \""+dst_path+L"\"", LL_ERROR);
+		return false;
+	}
+
+	std::vector<char> buf(c_merge_blocksize);
+	_u32 read;
+	do
+	{
+		if(do_stop)
+		{
+			return false;
+		}
+
+		read=src->Read(&buf[0], static_cast<_u32>(buf.size()));
+		if(read>0 && dst->Write(&buf[0], read)!=read)
+		{
+			ServerLogger::Log(clientid, L"Error writing to \""+dst_path+L"\"", LL_ERROR);
+			return false;
+		}
+	}
+	while(read>0);
+
+	return true;
+}
+
+void ServerSyntheticImage::removeImage(IDatabase* db, int backupid, const std::wstring& path)
+{
+	Server->deleteFile(os_file_prefix(path));
+	Server->deleteFile(os_file_prefix(path+L".hash"));
+	Server->deleteFile(os_file_prefix(path+L".mbr"));
+
+	IQuery *q=db->Prepare("DELETE FROM backup_images WHERE id=?", false);
+	q->Bind(backupid);
+	q->Write();
+	q->Reset();
+	db->destroyQuery(q);
+}
+
+#endif //CLIENT_ONLY
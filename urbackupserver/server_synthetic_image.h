@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../Interface/Thread.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Types.h"
+#include <string>
+#include <set>
+
+class IDatabase;
+class IPipeThrottler;
+
+/**
+* Merges an incremental image backup with its parent into a new
+* standalone full image backup on the server (synthetic full image).
+* Associated images (SYSVOL) are copied as well. Runs in the background,
+* rate-limited to the configured speed and can be interrupted.
+*/
+class ServerSyntheticImage : public IThread
+{
+public:
+	ServerSyntheticImage(int clientid, int backupid, const std::string& letter, int speed_bps);
+
+	void operator()(void);
+
+	static bool start(int clientid, int backupid, const std::string& letter, int speed_bps);
+	static bool isRunning(int clientid, const std::string& letter);
+	//Stops and waits for running merges (up to 10s)
+	static void stopAll(void);
+
+	static void init_mutex(void);
+	static void destroy_mutex(void);
+
+private:
+	int mergeImage(IDatabase* db, int src_backupid);
+	bool copyImage(const std::wstring& src_path, const std::wstring& dst_path);
+	bool copyFile(const std::wstring& src_path, const std::wstring& dst_path);
+	void removeImage(IDatabase* db, int backupid, const std::wstring& path);
+
+	int clientid;
+	int backupid;
+	std::string letter;
+	IPipeThrottler* throttler;
+
+	static IMutex* mutex;
+	static std::set<std::pair<int, std::string> > running;
+	static volatile bool do_stop;
+};
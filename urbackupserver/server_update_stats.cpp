@@ -10,6 +10,7 @@
 #include "../stringtools.h"
 #include "server_settings.h"
 #include "server_status.h"
+#include "server_metrics.h"
 #include "server_get.h"
 
 bool update_stats_use_transactions_del=true;
@@ -55,6 +56,9 @@ void ServerUpdateStats::createQueries(void)
 	q_get_all_clients=db->Prepare("SELECT id FROM clients", false);
 	q_mark_done_bulk_files=db->Prepare("UPDATE files SET did_count=1 WHERE rowid IN ( SELECT rowid FROM files WHERE did_count=0 LIMIT 10000 )", false);
 	q_del_delfile_bulk=db->Prepare("DELETE FROM files_del WHERE rowid IN ( SELECT rowid FROM files_del LIMIT ? )", false);
+	q_save_usage_agg=db->Prepare("INSERT OR REPLACE INTO clients_usage_agg (clientid, scale, tdate, tdate_full, used) "
+		"SELECT id, ? AS scale, strftime(?, 'now', 'localtime') AS tdate, strftime('%Y-%m-%d', 'now', 'localtime') AS tdate_full, "
+		"bytes_used_files+bytes_used_images AS used FROM clients", false);
 }
 
 void ServerUpdateStats::destroyQueries(void)
@@ -86,6 +90,7 @@ void ServerUpdateStats::destroyQueries(void)
 	db->destroyQuery(q_del_delfile_bulk);
 	db->destroyQuery(q_has_client_del);
 	db->destroyQuery(q_get_clients_del);
+	db->destroyQuery(q_save_usage_agg);
 }
 
 void ServerUpdateStats::operator()(void)
@@ -138,6 +143,8 @@ void ServerUpdateStats::operator()(void)
 		q_save_client_hist->Bind(db->getLastInsertID());
 		q_save_client_hist->Write();
 		q_save_client_hist->Reset();
+
+		saveUsageAggregates();
 	}
 
 	update_images();
@@ -153,6 +160,8 @@ void ServerUpdateStats::operator()(void)
 		q_save_client_hist->Write();
 		q_save_client_hist->Reset();
 
+		saveUsageAggregates();
+
 		q_set_file_backup_null->Write();
 		q_set_file_backup_null->Reset();
 	}
@@ -165,6 +174,20 @@ void ServerUpdateStats::operator()(void)
 	}
 }
 
+void ServerUpdateStats::saveUsageAggregates(void)
+{
+	const char* scales[] = {"d", "m", "y"};
+	const char* date_fmts[] = {"%Y-%m-%d", "%Y-%m", "%Y"};
+
+	for(size_t i=0;i<3;++i)
+	{
+		q_save_usage_agg->Bind(std::string(scales[i]));
+		q_save_usage_agg->Bind(std::string(date_fmts[i]));
+		q_save_usage_agg->Write();
+		q_save_usage_agg->Reset();
+	}
+}
+
 void ServerUpdateStats::repairImages(void)
 {
 	ServerUpdateStats sus(true);
@@ -306,7 +329,7 @@ void ServerUpdateStats::update_files(void)
 
 		if(update_stats_use_transactions_del)
 		{
-			db->EndTransaction();
+			timedEndTransaction(db, "update_stats");
 		}
 		res=q_get_delfiles->Read();
 		q_get_delfiles->Reset();
@@ -326,7 +349,7 @@ void ServerUpdateStats::update_files(void)
 
 			if(update_stats_use_transactions_del && Server->getTimeMS()-last_commit_time>1000)
 			{
-				db->EndTransaction();
+				timedEndTransaction(db, "update_stats");
 				db->BeginWriteTransaction();
 				last_commit_time=Server->getTimeMS();
 			}
@@ -471,7 +494,7 @@ void ServerUpdateStats::update_files(void)
 		{
 			if(update_stats_use_transactions_del)
 			{
-				db->EndTransaction();
+				timedEndTransaction(db, "update_stats");
 			}
 			Server->Log("Running wal checkpoint...", LL_DEBUG);
 			db->Write("PRAGMA wal_checkpoint");
@@ -491,7 +514,7 @@ void ServerUpdateStats::update_files(void)
 
 	if(update_stats_use_transactions_del)
 	{
-		db->EndTransaction();
+		timedEndTransaction(db, "update_stats");
 		db->AttachDBs();
 	}
 
@@ -530,7 +553,7 @@ void ServerUpdateStats::update_files(void)
 
 		if(update_stats_use_transactions_done)
 		{
-			db->EndTransaction();
+			timedEndTransaction(db, "update_stats");
 		}
 		res=q_get_ncount_files->Read();
 		q_get_ncount_files->Reset();
@@ -550,7 +573,7 @@ void ServerUpdateStats::update_files(void)
 
 			if(update_stats_use_transactions_done && Server->getTimeMS()-last_commit_time>300)
 			{
-				db->EndTransaction();
+				timedEndTransaction(db, "update_stats");
 				db->BeginWriteTransaction();
 				last_commit_time=Server->getTimeMS();
 			}
@@ -626,7 +649,7 @@ void ServerUpdateStats::update_files(void)
 		{
 			if(update_stats_use_transactions_done)
 			{
-				db->EndTransaction();
+				timedEndTransaction(db, "update_stats");
 			}
 			Server->Log("Running wal checkpoint...", LL_DEBUG);
 			db->Write("PRAGMA wal_checkpoint");
@@ -641,7 +664,7 @@ void ServerUpdateStats::update_files(void)
 		{
 			if(update_stats_use_transactions_done)
 			{
-				db->EndTransaction();
+				timedEndTransaction(db, "update_stats");
 			}
 
 			db->BeginWriteTransaction();
@@ -651,7 +674,7 @@ void ServerUpdateStats::update_files(void)
 			updateSizes(size_data);
 			updateBackups(backup_sizes);
 
-			db->EndTransaction();
+			timedEndTransaction(db, "update_stats");
 
 			if(update_stats_use_transactions_done)
 			{
@@ -666,7 +689,7 @@ void ServerUpdateStats::update_files(void)
 
 	if(update_stats_use_transactions_done)
 	{
-		db->EndTransaction();
+		timedEndTransaction(db, "update_stats");
 		db->AttachDBs();
 	}
 
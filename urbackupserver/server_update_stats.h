@@ -70,6 +70,8 @@ private:
 
 	void measureSpeed(void);
 
+	void saveUsageAggregates(void);
+
 	bool image_repair_mode;
 	bool interruptible;
 
@@ -100,6 +102,7 @@ private:
 	IQuery *q_create_hist;
 	IQuery *q_get_all_clients;
 	IQuery *q_get_clients_del;
+	IQuery *q_save_usage_agg;
 
 	IDatabase *db;
 
@@ -27,36 +27,20 @@
 #include "../stringtools.h"
 #include "../urbackupcommon/os_functions.h"
 #include "server_log.h"
+#include "server_metrics.h"
 #include "server_cleanup.h"
 #include "server_get.h"
+#include <algorithm>
 
 extern IFSImageFactory *image_fak;
 const size_t free_space_lim=1000*1024*1024; //1000MB
-const uint64 filebuf_lim=1000*1024*1024; //1000MB
+const size_t max_write_batch=1024;
 
-ServerVHDWriter::ServerVHDWriter(IVHDFile *pVHD, unsigned int blocksize, unsigned int nbufs, int pClientid, bool use_tmpfiles)
+ServerVHDWriter::ServerVHDWriter(IVHDFile *pVHD, unsigned int blocksize, unsigned int nbufs, int pClientid)
 {
-	filebuffer=use_tmpfiles;
-
 	clientid=pClientid;
 	vhd=pVHD;
-	if(filebuffer)
-	{
-		bufmgr=new CBufMgr2(nbufs, sizeof(FileBufferVHDItem)+blocksize);
-	}
-	else
-	{
-		bufmgr=new CBufMgr2(nbufs, blocksize);
-	}
-
-	if(filebuffer)
-	{
-		filebuf=new CFileBufMgr(false);
-		filebuf_writer=new ServerFileBufferWriter(this, blocksize);
-		filebuf_writer_ticket=Server->getThreadPool()->execute(filebuf_writer);
-		currfile=filebuf->getBuffer();
-		currfile_size=0;
-	}
+	bufmgr=new CBufMgr2(nbufs, blocksize, FILE_DIRECT_ALIGNMENT);
 
 	mutex=Server->createMutex();
 	vhd_mutex=Server->createMutex();
@@ -71,12 +55,6 @@ ServerVHDWriter::~ServerVHDWriter(void)
 {
 	delete bufmgr;
 
-	if(filebuffer)
-	{
-		delete filebuf_writer;
-		delete filebuf;
-	}
-
 	Server->destroy(mutex);
 	Server->destroy(vhd_mutex);
 	Server->destroy(cond);
@@ -84,75 +62,39 @@ ServerVHDWriter::~ServerVHDWriter(void)
 
 void ServerVHDWriter::operator()(void)
 {
+	std::vector<BufferVHDItem> batch;
+	while(!exit_now)
 	{
-		while(!exit_now)
+		bool do_exit;
 		{
-			BufferVHDItem item;
-			bool has_item=false;
-			bool do_exit;
-			{
-				IScopedLock lock(mutex);
-				if(tqueue.empty() && exit==false)
-				{
-					cond->wait(&lock);
-				}
-				do_exit=exit;
-				if(!tqueue.empty())
-				{
-					item=tqueue.front();
-					tqueue.pop();
-					has_item=true;
-				}
-			}
-			if(has_item)
-			{
-				if(!has_error)
-				{
-					if(!filebuffer)
-					{
-						writeVHD(item.pos, item.buf, item.bsize);
-					}
-					else
-					{
-						FileBufferVHDItem *fbi=(FileBufferVHDItem*)(item.buf-sizeof(FileBufferVHDItem));
-						fbi->pos=item.pos;
-						fbi->bsize=item.bsize;
-						writeRetry(currfile, (char*)fbi, sizeof(FileBufferVHDItem)+item.bsize);
-						currfile_size+=item.bsize+sizeof(FileBufferVHDItem);
-
-						if(currfile_size>filebuf_lim)
-						{
-							filebuf_writer->writeBuffer(currfile);
-							currfile=filebuf->getBuffer();
-							currfile_size=0;
-						}
-					}
-				}
-
-				freeBuffer(item.buf);
-			}
-			else if(do_exit)
+			IScopedLock lock(mutex);
+			if(tqueue.empty() && exit==false)
 			{
-				break;
+				cond->wait(&lock);
 			}
-
-			if(!filebuffer && written>=free_space_lim/2)
+			do_exit=exit;
+			while(!tqueue.empty() && batch.size()<max_write_batch)
 			{
-				written=0;
-				checkFreeSpaceAndCleanup();
+				batch.push_back(tqueue.front());
+				tqueue.pop();
 			}
 		}
-	}
-	if(filebuffer)
-	{
-		filebuf_writer->writeBuffer(currfile);
-
-		if(!exit_now)
-			filebuf_writer->doExit();
-		else
-			filebuf_writer->doExitNow();
+		if(!batch.empty())
+		{
+			ServerMetrics::addGauge("urbackup_vhd_writer_queue_size", -static_cast<int64>(batch.size()));
+			writeBatch(batch);
+			batch.clear();
+		}
+		else if(do_exit)
+		{
+			break;
+		}
 
-		Server->getThreadPool()->waitFor(filebuf_writer_ticket);
+		if(written>=free_space_lim/2)
+		{
+			written=0;
+			checkFreeSpaceAndCleanup();
+		}
 	}
 
 	if(!vhd->finish())
@@ -186,11 +128,56 @@ void ServerVHDWriter::checkFreeSpaceAndCleanup(void)
 	}
 }
 
+void ServerVHDWriter::writeBatch(std::vector<BufferVHDItem>& batch)
+{
+	std::stable_sort(batch.begin(), batch.end());
+
+	std::vector<SFileSegment> segments;
+	size_t run_start=0;
+	for(size_t i=0;i<batch.size();++i)
+	{
+		segments.push_back(SFileSegment(batch[i].buf, batch[i].bsize));
+
+		if(i+1<batch.size()
+			&& batch[i].pos+batch[i].bsize==batch[i+1].pos)
+		{
+			continue;
+		}
+
+		if(!has_error)
+		{
+			writeVHD(batch[run_start].pos, &segments[0], segments.size());
+		}
+
+		for(size_t j=run_start;j<=i;++j)
+		{
+			freeBuffer(batch[j].buf);
+		}
+
+		segments.clear();
+		run_start=i+1;
+	}
+}
+
 void ServerVHDWriter::writeVHD(uint64 pos, char *buf, unsigned int bsize)
 {
+	SFileSegment segment(buf, bsize);
+	writeVHD(pos, &segment, 1);
+}
+
+void ServerVHDWriter::writeVHD(uint64 pos, const SFileSegment* segments, size_t nsegments)
+{
+	unsigned int bsize=0;
+	for(size_t i=0;i<nsegments;++i)
+	{
+		bsize+=segments[i].bsize;
+	}
+
+	ScopedMetricsLatency latency("urbackup_vhd_write_ms");
+	ServerMetrics::addCounter("urbackup_vhd_written_bytes_total", bsize);
 	IScopedLock lock(vhd_mutex);
 	vhd->Seek(pos);
-	bool b=vhd->Write(buf, bsize)!=0;
+	bool b=vhd->WriteV(segments, nsegments)!=0;
 	written+=bsize;
 	if(!b)
 	{
@@ -200,7 +187,7 @@ void ServerVHDWriter::writeVHD(uint64 pos, char *buf, unsigned int bsize)
 			Server->wait(100);
 			Server->Log("Retrying writing to VHD file...");
 			vhd->Seek(pos);
-			if(vhd->Write(buf, bsize)==0)
+			if(vhd->WriteV(segments, nsegments)==0)
 			{
 				Server->Log("Writing to VHD file failed");
 			}
@@ -218,7 +205,7 @@ void ServerVHDWriter::writeVHD(uint64 pos, char *buf, unsigned int bsize)
 			if(cleanupSpace())
 			{
 				vhd->Seek(pos);
-				if(vhd->Write(buf, bsize)==0)
+				if(vhd->WriteV(segments, nsegments)==0)
 				{
 					retry=3;
 					for(int i=0;i<retry;++i)
@@ -226,7 +213,7 @@ void ServerVHDWriter::writeVHD(uint64 pos, char *buf, unsigned int bsize)
 						Server->wait(100);
 						Server->Log("Retrying writing to VHD file...");
 						vhd->Seek(pos);
-						if(vhd->Write(buf, bsize)==0)
+						if(vhd->WriteV(segments, nsegments)==0)
 						{
 							Server->Log("Writing to VHD file failed");
 						}
@@ -269,22 +256,7 @@ void ServerVHDWriter::writeVHD(uint64 pos, char *buf, unsigned int bsize)
 
 char *ServerVHDWriter::getBuffer(void)
 {
-	if(filebuffer)
-	{
-		char *buf=bufmgr->getBuffer();
-		if(buf!=NULL)
-		{
-			return buf+sizeof(FileBufferVHDItem);
-		}
-		else
-		{
-			return buf;
-		}
-	}
-	else
-	{
-		return bufmgr->getBuffer();
-	}
+	return bufmgr->getBuffer();
 }
 
 void ServerVHDWriter::writeBuffer(uint64 pos, char *buf, unsigned int bsize)
@@ -296,14 +268,12 @@ void ServerVHDWriter::writeBuffer(uint64 pos, char *buf, unsigned int bsize)
 	item.bsize=bsize;
 	tqueue.push(item);
 	cond->notify_all();
+	ServerMetrics::addGauge("urbackup_vhd_writer_queue_size", 1);
 }
 
 void ServerVHDWriter::freeBuffer(char *buf)
 {
-	if(filebuffer)
-		bufmgr->releaseBuffer(buf-sizeof(FileBufferVHDItem));
-	else
-		bufmgr->releaseBuffer(buf);
+	bufmgr->releaseBuffer(buf);
 }
 
 void ServerVHDWriter::doExit(void)
@@ -367,186 +337,4 @@ bool ServerVHDWriter::cleanupSpace(void)
 	return true;
 }
 
-void ServerVHDWriter::freeFile(IFile *buf)
-{
-	filebuf->releaseBuffer(buf);
-}
-
-void ServerVHDWriter::writeRetry(IFile *f, char *buf, unsigned int bsize)
-{
-	unsigned int off=0;
-	while( off<bsize && !has_error)
-	{
-		unsigned int r=f->Write(buf+off, bsize-off);
-		off+=r;
-		if(off<bsize)
-		{
-			Server->Log("Error writing to file \""+f->getFilename()+"\". Retrying", LL_WARNING);
-			Server->wait(10000);
-		}
-	}
-}
-
-//-------------FilebufferWriter-----------------
-
-ServerFileBufferWriter::ServerFileBufferWriter(ServerVHDWriter *pParent, unsigned int pBlocksize) : parent(pParent), blocksize(pBlocksize)
-{
-	mutex=Server->createMutex();
-	cond=Server->createCondition();
-	exit=false;
-	exit_now=false;
-	written=free_space_lim;
-}
-
-ServerFileBufferWriter::~ServerFileBufferWriter(void)
-{
-	while(!fb_queue.empty())
-	{
-		parent->freeFile(fb_queue.front());
-		fb_queue.pop();
-	}
-	Server->destroy(mutex);
-	Server->destroy(cond);
-}
-
-void ServerFileBufferWriter::operator()(void)
-{
-	char *blockbuf=new char[blocksize+sizeof(FileBufferVHDItem)];
-	unsigned int blockbuf_size=blocksize+sizeof(FileBufferVHDItem);
-
-	while(!exit_now)
-	{
-		IFile* tmp;
-		bool do_exit;
-		bool has_item=false;
-		{
-			IScopedLock lock(mutex);
-			while(fb_queue.empty() && exit==false)
-			{
-				cond->wait(&lock);
-			}
-			do_exit=exit;
-			if(!fb_queue.empty())
-			{
-				has_item=true;
-				tmp=fb_queue.front();
-				fb_queue.pop();
-			}
-		}
-
-		if(has_item)
-		{
-			tmp->Seek(0);
-			uint64 tpos=0;
-			uint64 tsize=tmp->Size();
-			while(tpos<tsize)
-			{
-				if(exit_now)
-					break;
-
-				if(!parent->hasError())
-				{
-					unsigned int tw=blockbuf_size;
-					bool old_method=false;
-					if(tw<sizeof(FileBufferVHDItem) || tmp->Read(blockbuf, tw)!=tw)
-					{
-						old_method=true;
-					}
-					else
-					{
-						FileBufferVHDItem *item=(FileBufferVHDItem*)blockbuf;
-						if(tw==item->bsize+sizeof(FileBufferVHDItem) )
-						{
-							parent->writeVHD(item->pos, blockbuf+sizeof(FileBufferVHDItem), item->bsize);
-							written+=item->bsize;
-							tpos+=item->bsize+sizeof(FileBufferVHDItem);
-						}
-						else
-						{
-							old_method=true;
-						}
-					}
-
-					if(old_method==true)
-					{
-						tmp->Seek(tpos);
-						FileBufferVHDItem item;
-						if(tmp->Read((char*)&item, sizeof(FileBufferVHDItem))!=sizeof(FileBufferVHDItem))
-						{
-							Server->Log("Error reading FileBufferVHDItem", LL_ERROR);
-							exit_now=true;
-							parent->setHasError(true);
-							break;
-						}
-						tpos+=sizeof(FileBufferVHDItem);
-						unsigned int tw=item.bsize;
-						if(tpos+tw>tsize)
-						{
-							Server->Log("Size field is wrong", LL_ERROR);
-							exit_now=true;
-							parent->setHasError(true);
-							break;
-						}
-						if(tw>blockbuf_size)
-						{
-							delete []blockbuf;
-							blockbuf=new char[tw+sizeof(FileBufferVHDItem)];
-							blockbuf_size=tw+sizeof(FileBufferVHDItem);
-						}
-						if(tmp->Read(blockbuf, tw)!=tw)
-						{
-							Server->Log("Error reading from tmp.f", LL_ERROR);
-							exit_now=true;
-							parent->setHasError(true);
-							break;
-						}
-						parent->writeVHD(item.pos, blockbuf, tw);
-						written+=tw;
-						tpos+=item.bsize;
-					}
-
-					if( written>=free_space_lim/2)
-					{
-						written=0;
-						parent->checkFreeSpaceAndCleanup();
-					}
-				}
-				else
-				{
-					break;
-				}
-			}
-			parent->freeFile(tmp);
-		}
-		else if(do_exit)
-		{
-			break;
-		}
-	}
-
-	delete []blockbuf;
-}
-
-void ServerFileBufferWriter::doExit(void)
-{
-	IScopedLock lock(mutex);
-	exit=true;
-	cond->notify_all();
-}
-
-void ServerFileBufferWriter::doExitNow(void)
-{
-	IScopedLock lock(mutex);
-	exit_now=true;
-	exit=true;
-	cond->notify_all();
-}
-
-void ServerFileBufferWriter::writeBuffer(IFile *buf)
-{
-	IScopedLock lock(mutex);
-	fb_queue.push(buf);
-	cond->notify_all();
-}
-
 #endif //CLIENT_ONLY
@@ -4,6 +4,7 @@
 #include "../urbackupcommon/bufmgr.h"
 
 #include <queue>
+#include <vector>
 
 class IVHDFile;
 
@@ -12,20 +13,17 @@ struct BufferVHDItem
 	char *buf;
 	uint64 pos;
 	unsigned int bsize;
-};
 
-struct FileBufferVHDItem
-{
-	uint64 pos;
-	unsigned int bsize;
+	bool operator<(const BufferVHDItem& other) const
+	{
+		return pos<other.pos;
+	}
 };
 
-class ServerFileBufferWriter;
-
 class ServerVHDWriter : public IThread
 {
 public:
-	ServerVHDWriter(IVHDFile *pVHD, unsigned int blocksize, unsigned int nbufs, int pClientid, bool use_tmpfiles);
+	ServerVHDWriter(IVHDFile *pVHD, unsigned int blocksize, unsigned int nbufs, int pClientid);
 	~ServerVHDWriter(void);
 
 	void operator()(void);
@@ -51,19 +49,14 @@ public:
 	size_t getQueueSize(void);
 
 	void writeVHD(uint64 pos, char *buf, unsigned int bsize);
-	void freeFile(IFile *buf);
-
-	void writeRetry(IFile *f, char *buf, unsigned int bsize);
+	void writeVHD(uint64 pos, const SFileSegment* segments, size_t nsegments);
 
 private:
+	void writeBatch(std::vector<BufferVHDItem>& batch);
+
 	IVHDFile *vhd;
 
 	CBufMgr2 *bufmgr;
-	CFileBufMgr *filebuf;
-	ServerFileBufferWriter *filebuf_writer;
-	THREADPOOL_TICKET filebuf_writer_ticket;
-	IFile *currfile;
-	uint64 currfile_size;
 
 	IMutex *mutex;
 	IMutex *vhd_mutex;
@@ -77,33 +70,4 @@ private:
 	volatile bool exit_now;
 	volatile bool has_error;
 	volatile bool finish;
-
-	bool filebuffer;
-};
-
-class ServerFileBufferWriter : public IThread
-{
-public:
-	ServerFileBufferWriter(ServerVHDWriter *pParent, unsigned int pBlocksize);
-	~ServerFileBufferWriter(void);
-
-	void operator()(void);
-
-	void writeBuffer(IFile *buf);
-
-	void doExit(void);
-	void doExitNow(void);
-
-private:
-	ServerVHDWriter *parent;
-	unsigned int blocksize;
-
-	std::queue<IFile*> fb_queue;
-	IMutex *mutex;
-	ICondition *cond;
-
-	volatile bool exit;
-	volatile bool exit_now;
-
-	unsigned int written;
 };
\ No newline at end of file
@@ -19,4 +19,5 @@ namespace Actions
 	ACTION(download_client);
 	ACTION(livelog);
 	ACTION(start_backup);
+	ACTION(metrics);
 }
@@ -0,0 +1,32 @@
+#ifndef CLIENT_ONLY
+
+#include "action_header.h"
+#include "../server_metrics.h"
+
+ACTION_IMPL(metrics)
+{
+	Helper helper(tid, &GET, &PARAMS);
+
+	//Off by default. Behind a local reverse proxy every request comes from loopback
+	bool local_request=false;
+	if(Server->getServerParameter("metrics_allow_local")=="true")
+	{
+		std::string remote_addr=PARAMS["REMOTE_ADDR"];
+		local_request = remote_addr=="127.0.0.1" || remote_addr=="::1";
+	}
+
+	SUser *session=helper.getSession();
+	if( local_request || (session!=NULL && session->id!=-1 && helper.getRights("status")=="all") )
+	{
+		Server->setContentType(tid, "text/plain; version=0.0.4");
+		helper.Write(ServerMetrics::getPrometheusText());
+	}
+	else
+	{
+		JSON::Object ret;
+		ret.set("error", 1);
+		helper.Write(ret.get(false));
+	}
+}
+
+#endif //CLIENT_ONLY
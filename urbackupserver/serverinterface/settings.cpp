@@ -189,6 +189,9 @@ void getGeneralSettings(JSON::Object& obj, IDatabase *db, ServerSettings &settin
 	SET_SETTING(use_incremental_symlinks);
 	SET_SETTING(trust_client_hashes);
 	SET_SETTING(show_server_updates);
+	SET_SETTING(synthetic_full_images);
+	SET_SETTING(synthetic_full_image_speed);
+	SET_SETTING(synthetic_full_file_backups);
 
 #undef SET_SETTING
 }
@@ -76,6 +76,71 @@ bool client_download(Helper& helper, JSON::Array &client_downloads)
 	return has_client;
 }
 
+std::vector<SClientStatusSnapshotItem> readClientStatusItems(IDatabase* db, Helper& helper, const std::string& filter)
+{
+	db_results res=db->Read("SELECT id, delete_pending, name, strftime('"+helper.getTimeFormatString()+"', lastbackup, 'localtime') AS lastbackup, strftime('"+helper.getTimeFormatString()+"', lastseen, 'localtime') AS lastseen,"
+		"strftime('"+helper.getTimeFormatString()+"', lastbackup_image, 'localtime') AS lastbackup_image FROM clients"+filter+" ORDER BY name");
+
+	double backup_ok_mod_file=3.;
+	db_results res_t=db->Read("SELECT value FROM settings_db.settings WHERE key='backup_ok_mod_file' AND clientid=0");
+	if(res_t.size()>0)
+	{
+		backup_ok_mod_file=atof(Server->ConvertToUTF8(res_t[0][L"value"]).c_str());
+	}
+
+	double backup_ok_mod_image=3.;
+	res_t=db->Read("SELECT value FROM settings_db.settings WHERE key='backup_ok_mod_image' AND clientid=0");
+	if(res_t.size()>0)
+	{
+		backup_ok_mod_image=atof(Server->ConvertToUTF8(res_t[0][L"value"]).c_str());
+	}
+
+	std::vector<SClientStatusSnapshotItem> ret;
+	ret.resize(res.size());
+	for(size_t i=0;i<res.size();++i)
+	{
+		SClientStatusSnapshotItem& item=ret[i];
+		item.clientid=watoi(res[i][L"id"]);
+		item.name=res[i][L"name"];
+		item.lastbackup=res[i][L"lastbackup"];
+		item.lastseen=res[i][L"lastseen"];
+		item.lastbackup_image=res[i][L"lastbackup_image"];
+		item.delete_pending=res[i][L"delete_pending"];
+
+		ServerSettings settings(db, item.clientid);
+
+		int time_filebackup=settings.getUpdateFreqFileIncr();
+		int time_filebackup_full=settings.getUpdateFreqFileFull();
+		if( time_filebackup_full>=0 &&
+			(time_filebackup<0 || time_filebackup_full<time_filebackup) )
+		{
+			time_filebackup=time_filebackup_full;
+		}
+		
+		IQuery *q=db->Prepare("SELECT id FROM clients WHERE lastbackup IS NOT NULL AND datetime('now','-"+nconvert((int)(time_filebackup*backup_ok_mod_file+0.5))+" seconds')<lastbackup AND id=?");
+		q->Bind(item.clientid);
+		db_results res_file_ok=q->Read();
+		q->Reset();
+		item.file_ok=!res_file_ok.empty();
+
+		int time_imagebackup=settings.getUpdateFreqImageIncr();
+		int time_imagebackup_full=settings.getUpdateFreqImageFull();
+		if( time_imagebackup_full>=0 &&
+			(time_imagebackup<0 || time_imagebackup_full<time_imagebackup) )
+		{
+			time_imagebackup=time_imagebackup_full;
+		}
+
+		q=db->Prepare("SELECT id FROM clients WHERE lastbackup_image IS NOT NULL AND datetime('now','-"+nconvert((int)(time_imagebackup*backup_ok_mod_image+0.5))+" seconds')<lastbackup_image AND id=?");
+		q->Bind(item.clientid);
+		res_file_ok=q->Read();
+		q->Reset();
+		item.image_ok=!res_file_ok.empty();
+	}
+
+	return ret;
+}
+
 void set_server_version_info(JSON::Object& ret)
 {
 	std::auto_ptr<ISettingsReader> infoProperties(Server->createFileSettingsReader("urbackup/server_version_info.properties"));
@@ -201,6 +266,7 @@ ACTION_IMPL(status)
 			if(new_client)
 			{
 				ret.set("added_new_client", true);
+				ServerStatus::invalidateClientStatusSnapshots();
 			}
 		}
 		std::wstring s_remove_client=GET[L"remove_client"];
@@ -229,6 +295,7 @@ ACTION_IMPL(status)
 				}
 			}
 			BackupServer::updateDeletePending();
+			ServerStatus::invalidateClientStatusSnapshots();
 		}		
 
 		JSON::Array status;
@@ -244,36 +311,59 @@ ACTION_IMPL(status)
 					filter+=" OR ";
 			}
 		}
-		db_results res=db->Read("SELECT id, delete_pending, name, strftime('"+helper.getTimeFormatString()+"', lastbackup, 'localtime') AS lastbackup, strftime('"+helper.getTimeFormatString()+"', lastseen, 'localtime') AS lastseen,"
-			"strftime('"+helper.getTimeFormatString()+"', lastbackup_image, 'localtime') AS lastbackup_image FROM clients"+filter+" ORDER BY name");
-
-		double backup_ok_mod_file=3.;
-		db_results res_t=db->Read("SELECT value FROM settings_db.settings WHERE key='backup_ok_mod_file' AND clientid=0");
-		if(res_t.size()>0)
+		std::vector<SClientStatusSnapshotItem> client_items;
+		std::vector<std::wstring> dirty_clients;
+		std::string snapshot_key=filter+"|"+helper.getTimeFormatString();
+		if(!ServerStatus::getClientStatusSnapshot(snapshot_key, client_items, dirty_clients))
 		{
-			backup_ok_mod_file=atof(Server->ConvertToUTF8(res_t[0][L"value"]).c_str());
+			client_items=readClientStatusItems(db, helper, filter);
+			ServerStatus::setClientStatusSnapshot(snapshot_key, client_items);
 		}
-
-		double backup_ok_mod_image=3.;
-		res_t=db->Read("SELECT value FROM settings_db.settings WHERE key='backup_ok_mod_image' AND clientid=0");
-		if(res_t.size()>0)
+		else if(!dirty_clients.empty())
 		{
-			backup_ok_mod_image=atof(Server->ConvertToUTF8(res_t[0][L"value"]).c_str());
+			//Only read the clients again whose status changed
+			std::sort(dirty_clients.begin(), dirty_clients.end());
+			std::string dirty_filter;
+			for(size_t i=0;i<client_items.size();++i)
+			{
+				if(std::binary_search(dirty_clients.begin(), dirty_clients.end(), client_items[i].name))
+				{
+					dirty_filter+=(dirty_filter.empty() ? " WHERE " : " OR ");
+					dirty_filter+="id="+nconvert(client_items[i].clientid);
+				}
+			}
+
+			if(!dirty_filter.empty())
+			{
+				std::vector<SClientStatusSnapshotItem> dirty_items=readClientStatusItems(db, helper, dirty_filter);
+				for(size_t i=0;i<dirty_items.size();++i)
+				{
+					for(size_t j=0;j<client_items.size();++j)
+					{
+						if(client_items[j].clientid==dirty_items[i].clientid)
+						{
+							client_items[j]=dirty_items[i];
+							break;
+						}
+					}
+				}
+			}
+
+			ServerStatus::updateClientStatusSnapshot(snapshot_key, client_items, dirty_clients);
 		}
 
 		std::vector<SStatus> client_status=ServerStatus::getStatus();
 
-		for(size_t i=0;i<res.size();++i)
+		for(size_t i=0;i<client_items.size();++i)
 		{
+			const SClientStatusSnapshotItem& item=client_items[i];
 			JSON::Object stat;
-			int clientid=watoi(res[i][L"id"]);
-			std::wstring clientname=res[i][L"name"];
-			stat.set("id", clientid);
-			stat.set("name", clientname);
-			stat.set("lastbackup", res[i][L"lastbackup"]);
-			stat.set("lastseen", res[i][L"lastseen"]);
-			stat.set("lastbackup_image", res[i][L"lastbackup_image"]);
-			stat.set("delete_pending", res[i][L"delete_pending"] );
+			stat.set("id", item.clientid);
+			stat.set("name", item.name);
+			stat.set("lastbackup", item.lastbackup);
+			stat.set("lastseen", item.lastseen);
+			stat.set("lastbackup_image", item.lastbackup_image);
+			stat.set("delete_pending", item.delete_pending );
 
 			std::string ip="-";
 			std::string client_version_string;
@@ -284,7 +374,7 @@ ACTION_IMPL(status)
 			SStatus *curr_status=NULL;
 			for(size_t j=0;j<client_status.size();++j)
 			{
-				if(client_status[j].client==clientname)
+				if(client_status[j].client==item.name)
 				{
 					if(client_status[j].r_online==true)
 					{
@@ -318,37 +408,8 @@ ACTION_IMPL(status)
 			stat.set("os_version_string", os_version_string);
 			stat.set("status", i_status);
 			stat.set("done_pc", done_pc);
-			
-
-			ServerSettings settings(db, clientid);
-
-			int time_filebackup=settings.getUpdateFreqFileIncr();
-			int time_filebackup_full=settings.getUpdateFreqFileFull();
-			if( time_filebackup_full>=0 &&
-				(time_filebackup<0 || time_filebackup_full<time_filebackup) )
-			{
-				time_filebackup=time_filebackup_full;
-			}
-			
-			IQuery *q=db->Prepare("SELECT id FROM clients WHERE lastbackup IS NOT NULL AND datetime('now','-"+nconvert((int)(time_filebackup*backup_ok_mod_file+0.5))+" seconds')<lastbackup AND id=?");
-			q->Bind(clientid);
-			db_results res_file_ok=q->Read();
-			q->Reset();
-			stat.set("file_ok", !res_file_ok.empty());
-
-			int time_imagebackup=settings.getUpdateFreqImageIncr();
-			int time_imagebackup_full=settings.getUpdateFreqImageFull();
-			if( time_imagebackup_full>=0 &&
-				(time_imagebackup<0 || time_imagebackup_full<time_imagebackup) )
-			{
-				time_imagebackup=time_imagebackup_full;
-			}
-
-			q=db->Prepare("SELECT id FROM clients WHERE lastbackup_image IS NOT NULL AND datetime('now','-"+nconvert((int)(time_imagebackup*backup_ok_mod_image+0.5))+" seconds')<lastbackup_image AND id=?");
-			q->Bind(clientid);
-			res_file_ok=q->Read();
-			q->Reset();
-			stat.set("image_ok", !res_file_ok.empty());
+			stat.set("file_ok", item.file_ok);
+			stat.set("image_ok", item.image_ok);
 
 			status.add(stat);
 		}
@@ -358,9 +419,9 @@ ACTION_IMPL(status)
 			for(size_t i=0;i<client_status.size();++i)
 			{
 				bool found=false;
-				for(size_t j=0;j<res.size();++j)
+				for(size_t j=0;j<client_items.size();++j)
 				{
-					if(res[j][L"name"]==client_status[i].client)
+					if(client_items[j].name==client_status[i].client)
 					{
 						found=true;
 						break;
@@ -405,7 +466,7 @@ ACTION_IMPL(status)
 
 		if(rights=="all")
 		{
-			res=db->Read("SELECT id, hostname, lastip FROM settings_db.extra_clients");
+			db_results res=db->Read("SELECT id, hostname, lastip FROM settings_db.extra_clients");
 			for(size_t i=0;i<res.size();++i)
 			{
 				JSON::Object extra_client;
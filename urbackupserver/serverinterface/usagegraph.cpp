@@ -92,88 +92,42 @@ ACTION_IMPL(usagegraph)
 			scale="d";
 		}
 
-		std::string t_where=" 0=0";
-		if(clientid!=-1)
-		{
-			t_where+=" AND id="+nconvert(clientid)+" ";
-		}
-		
-		int c_lim=1;
-		if(clientid==-1)
-		{
-			IQuery *q_count_clients=db->Prepare("SELECT count(*) AS c FROM clients");
-			db_results res_c=q_count_clients->Read();
-			q_count_clients->Reset();
-			if(!res_c.empty())
-				c_lim=watoi(res_c[0][L"c"]);
-		}
-
 		unsigned int n_items;
 		std::string back;
-		std::string date_fmt;
 		if(scale=="y")
 		{
 			back="-10 year";
 			n_items=10;
-			date_fmt="%Y";
 		}
 		else if(scale=="m")
 		{
 			back="-1 year";
 			n_items=12;
-			date_fmt="%Y-%m";
 		}
 		else
 		{
+			scale="d";
 			back="-1 month";
 			n_items=31;
-			date_fmt="%Y-%m-%d";
 		}
 
-		db_results cache_res;
-		if(db->getEngineName()=="sqlite")
+		std::string c_where;
+		if(clientid!=-1)
 		{
-			cache_res=db->Read("PRAGMA cache_size");
-			db->Write("PRAGMA cache_size = -51200"); //50MB
+			c_where=" AND clientid="+nconvert(clientid);
 		}
-			
-		IQuery *q=db->Prepare("SELECT id, (MAX(b.bytes_used_files)+MAX(b.bytes_used_images)) AS used, strftime('"+date_fmt+"', MAX(b.created), 'localtime') AS tdate, strftime('%Y-%m-%d', MAX(b.created), 'localtime') AS tdate_full "
-				    "FROM "
-				    "("
-				    "SELECT MAX(created) AS mcreated "
-					"FROM "
-					"(SELECT * FROM clients_hist WHERE "+t_where+" AND created>date('now','"+back+"') ) "
-				    "GROUP BY strftime('"+date_fmt+"', created, 'localtime'), id "
-					"HAVING mcreated>date('now','"+back+"') "
-				    "ORDER BY mcreated DESC "
-				    "LIMIT "+nconvert(c_lim*(n_items*2))+" "
-				    ") a "
-				    "INNER JOIN clients_hist b ON a.mcreated=b.created WHERE "+t_where+" AND b.created>date('now','"+back+"') "
-				    "GROUP BY strftime('"+date_fmt+"', b.created, 'localtime'), id "
-				    "ORDER BY b.created DESC");
-				    
+
+		IQuery *q=db->Prepare("SELECT tdate, MAX(tdate_full) AS tdate_full, SUM(used) AS used FROM clients_usage_agg "
+			"WHERE scale=? AND tdate_full>date('now','"+back+"')"+c_where+" "
+			"GROUP BY tdate ORDER BY tdate DESC LIMIT "+nconvert(n_items));
+		q->Bind(scale);
 		db_results res=q->Read();
+		q->Reset();
+
 		std::vector<SUsed > used;
 		for(size_t i=0;i<res.size();++i)
 		{
-			bool found=false;
-			for(size_t j=0;j<used.size();++j)
-			{
-				if(used[j].tdate==res[i][L"tdate"])
-				{
-					found=true;
-					used[j].used+=atof(wnarrow(res[i][L"used"]).c_str());
-				}
-			}
-			if(!found && used.size()<n_items)
-			{
-				used.push_back(SUsed(res[i][L"tdate_full"], res[i][L"tdate"], atof(wnarrow(res[i][L"used"]).c_str()) ) );
-			}
-		}
-
-		if(!cache_res.empty())
-		{
-			db->Write("PRAGMA cache_size = "+wnarrow(cache_res[0][L"cache_size"]));
+			used.push_back(SUsed(res[i][L"tdate_full"], res[i][L"tdate"], atof(wnarrow(res[i][L"used"]).c_str()) ) );
 		}
 
 		bool size_gb=false;
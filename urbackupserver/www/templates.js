@@ -35,7 +35,7 @@
 (function(){dust.register("progress_table",body_0);function body_0(chk,ctx){return chk.write("<h1>").reference(ctx._get(false, ["tActivities"]),ctx,"h").write("</h1><table cellspacing=\"0\" cellpadding=\"0\"><tr>\t\t\t<th style=\"width: 150px\" class=\"tabHeader\">").reference(ctx._get(false, ["tComputer name"]),ctx,"h").write("</th><th style=\"width: 200px\" class=\"tabHeader\">").reference(ctx._get(false, ["tAction"]),ctx,"h").write("</th><th style=\"width: 420px\" class=\"tabHeader\">").reference(ctx._get(false, ["tProgress"]),ctx,"h").write("</th><th style=\"width: 100px\" class=\"tabHeader\">").reference(ctx._get(false, ["tFiles in queue"]),ctx,"h").write("</th><th style=\"width: 80px\" class=\"tabHeaderRight\">&nbsp;</th></tr>").reference(ctx._get(false, ["rows"]),ctx,"h",["s"]).write("</table>");}return body_0;})();
 (function(){dust.register("settings_general",body_0);function body_0(chk,ctx){return chk.write("<br /><div class=\"tabber\" id=\"settings_tabber\"><div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tServer"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\"><tr><td>").reference(ctx._get(false, ["tBackup storage path"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"40\" id=\"backupfolder\" value=\"").reference(ctx._get(false, ["backupfolder"]),ctx,"h",["s"]).write("\"/> </td></tr><tr><td>").reference(ctx._get(false, ["tDo not do image backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"no_images\" value=\"true\" ").reference(ctx._get(false, ["no_images"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tDo not do file backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"no_file_backups\" value=\"true\" ").reference(ctx._get(false, ["no_file_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAutomatically shut down server"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"autoshutdown\" value=\"true\" ").reference(ctx._get(false, ["autoshutdown"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tDownload client from update server"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"download_client\" value=\"true\" ").reference(ctx._get(false, ["download_client"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tShow when a new server version is available"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"show_server_updates\" value=\"true\" ").reference(ctx._get(false, ["show_server_updates"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAutoupdate clients"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"autoupdate_clients\" value=\"true\" ").reference(ctx._get(false, ["autoupdate_clients"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tMax number of simultaneous backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"max_sim_backups\" value=\"").reference(ctx._get(false, ["max_sim_backups"]),ctx,"h").write("\" /></td></tr><tr><td>").reference(ctx._get(false, ["tMax number of recently active clients"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"max_active_clients\" value=\"").reference(ctx._get(false, ["max_active_clients"]),ctx,"h").write("\" /></td></tr>").reference(ctx._get(false, ["ONLY_WIN32_BEGIN"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tNondefault temporary file directory"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"tmpdir\" value=\"").reference(ctx._get(false, ["tmpdir"]),ctx,"h",["s"]).write("\" /></td></tr>").reference(ctx._get(false, ["ONLY_WIN32_END"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tCleanup time window"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"cleanup_window\" value=\"").reference(ctx._get(false, ["cleanup_window"]),ctx,"h",["s"]).write("\" /><a href=\"http://www.urbackup.org/FAQ.php#cleanup_window\" target=\"_blank\">?</a></td></td></tr><tr><td>").reference(ctx._get(false, ["tAutomatically backup UrBackup database"]),ctx,"h").write(":</td><td><input type=\"checkbox\" size=\"40\" id=\"backup_database\" ").reference(ctx._get(false, ["backup_database"]),ctx,"h").write("/> </td></tr><tr><td>").reference(ctx._get(false, ["tTotal max backup speed for local network"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"global_local_speed\" value=\"").reference(ctx._get(false, ["global_local_speed"]),ctx,"h").write("\"/> MBit/s</td></tr><tr><td>").reference(ctx._get(false, ["tGlobal soft filesystem quota"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"global_soft_fs_quota\" value=\"").reference(ctx._get(false, ["global_soft_fs_quota"]),ctx,"h").write("\"/><a href=\"http://www.urbackup.org/FAQ.php#global_soft_fs_quota\" target=\"_blank\">?</a></td></tr></table></div>").reference(ctx._get(false, ["settings_inv"]),ctx,"h",["s"]).write("</div><br /><br /><input type=\"button\" value=\"").reference(ctx._get(false, ["tSave"]),ctx,"h").write("\" onClick=\"saveGeneralSettings()\" />");}return body_0;})();
 (function(){dust.register("database_error",body_0);function body_0(chk,ctx){return chk.write("<table cellspacing=\"0\" cellpadding=\"0\"><tr>\t\t\t<th style=\"border: 3px solid red; padding: 3px;width: 500px\">").reference(ctx._get(false, ["database_error_text"]),ctx,"h").write("</th></tr></table><br><br>");}return body_0;})();
-(function(){dust.register("settings_inv_row",body_0);function body_0(chk,ctx){return chk.write("<div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tFile backups"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\"><tr><td>").reference(ctx._get(false, ["tInterval for incremental file backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"update_freq_incr\" value=\"").reference(ctx._get(false, ["update_freq_incr"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["thours"]),ctx,"h").write("&nbsp;&nbsp;</td><td><input type=\"checkbox\" id=\"update_freq_incr_disable\" onchange=\"settingsCheckboxChange()\"/> ").reference(ctx._get(false, ["tDisable"]),ctx,"h").write("</td></tr><tr><td>").reference(ctx._get(false, ["tInterval for full file backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"update_freq_full\" value=\"").reference(ctx._get(false, ["update_freq_full"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tdays"]),ctx,"h").write("&nbsp;&nbsp;</td><td><input type=\"checkbox\" id=\"update_freq_full_disable\" onchange=\"settingsCheckboxChange()\"/> ").reference(ctx._get(false, ["tDisable"]),ctx,"h").write("</td></tr><tr><td>").reference(ctx._get(false, ["tMaximal number of incremental file backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"max_file_incr\" value=\"").reference(ctx._get(false, ["max_file_incr"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tMinimal number of incremental file backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"min_file_incr\" value=\"").reference(ctx._get(false, ["min_file_incr"]),ctx,"h").write("\"/></td></tr><td>").reference(ctx._get(false, ["tMaximal number of full file backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"max_file_full\" value=\"").reference(ctx._get(false, ["max_file_full"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tMinimal number of full file backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"min_file_full\" value=\"").reference(ctx._get(false, ["min_file_full"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tExcluded files (with wildcards)"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"exclude_files\" value=\"").reference(ctx._get(false, ["exclude_files"]),ctx,"h",["s"]).write("\"/> <a href=\"http://www.urbackup.org/FAQ.php#exclude_files\" target=\"_blank\">?</a></td></tr><tr><td>").reference(ctx._get(false, ["tIncluded files (with wildcards)"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"include_files\" value=\"").reference(ctx._get(false, ["include_files"]),ctx,"h",["s"]).write("\"/> <a href=\"http://www.urbackup.org/FAQ.php#include_files\" target=\"_blank\">?</a></td></tr><tr><td>").reference(ctx._get(false, ["tDefault directories to backup"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"default_dirs\" value=\"").reference(ctx._get(false, ["default_dirs"]),ctx,"h",["s"]).write("\"/> <a href=\"http://www.urbackup.org/FAQ.php#default_dirs\" target=\"_blank\">?</a></td></tr><tr></table></div><div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tImage backups"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\"><tr><td>").reference(ctx._get(false, ["tInterval for incremental image backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"update_freq_image_incr\" value=\"").reference(ctx._get(false, ["update_freq_image_incr"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tdays"]),ctx,"h").write("&nbsp;&nbsp;</td><td><input type=\"checkbox\" id=\"update_freq_image_incr_disable\" onchange=\"settingsCheckboxChange()\"/> ").reference(ctx._get(false, ["tDisable"]),ctx,"h").write("</td></tr><tr><td>").reference(ctx._get(false, ["tInterval for full image backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"update_freq_image_full\" value=\"").reference(ctx._get(false, ["update_freq_image_full"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tdays"]),ctx,"h").write("&nbsp;&nbsp;</td><td><input type=\"checkbox\" id=\"update_freq_image_full_disable\" onchange=\"settingsCheckboxChange()\"/> ").reference(ctx._get(false, ["tDisable"]),ctx,"h").write("</td></tr><td>").reference(ctx._get(false, ["tMaximal number of incremental image backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"max_image_incr\" value=\"").reference(ctx._get(false, ["max_image_incr"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tMinimal number of incremental image backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"min_image_incr\" value=\"").reference(ctx._get(false, ["min_image_incr"]),ctx,"h").write("\"/></td></tr><td>").reference(ctx._get(false, ["tMaximal number of full image backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"max_image_full\" value=\"").reference(ctx._get(false, ["max_image_full"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tMinimal number of full image backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"min_image_full\" value=\"").reference(ctx._get(false, ["min_image_full"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tVolumes to backup"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"image_letters\" value=\"").reference(ctx._get(false, ["image_letters"]),ctx,"h",["s","h"]).write("\"/> <a href=\"http://www.urbackup.org/FAQ.php#image_letters\" target=\"_blank\">?</a></td></tr><tr><td>").reference(ctx._get(false, ["tImage backup file format"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"image_file_format\"><option value=\"vhdz\" ").reference(ctx._get(false, ["image_file_format_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tCompressed VHD (Compressed non-standard Virtual HardDisk)"]),ctx,"h").write("</option><option value=\"vhd\" ").reference(ctx._get(false, ["image_file_format_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tVHD (Virtual HardDisk)"]),ctx,"h").write("</option></select></td></tr></table></div><div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tPermissions"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\"><tr><td>").reference(ctx._get(false, ["tAllow client-side changing of the directories to backup"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_config_paths\" ").reference(ctx._get(false, ["allow_config_paths"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side starting of full file backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_starting_full_file_backups\" ").reference(ctx._get(false, ["allow_starting_full_file_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side starting of incremental file backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_starting_incr_file_backups\" ").reference(ctx._get(false, ["allow_starting_incr_file_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side starting of full image backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_starting_full_image_backups\" ").reference(ctx._get(false, ["allow_starting_full_image_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side starting of incremental image backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_starting_incr_image_backups\" ").reference(ctx._get(false, ["allow_starting_incr_image_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side viewing of backup logs"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_log_view\" ").reference(ctx._get(false, ["allow_log_view"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side pausing of backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_pause\" ").reference(ctx._get(false, ["allow_pause"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side changing of settings"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_overwrite\" ").reference(ctx._get(false, ["allow_overwrite"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow clients to quit the tray icon"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_tray_exit\" ").reference(ctx._get(false, ["allow_tray_exit"]),ctx,"h").write("/></td></tr></table></div><div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tClient"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\"><tr><td>").reference(ctx._get(false, ["tDelay after system startup"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"startup_backup_delay\" value=\"").reference(ctx._get(false, ["startup_backup_delay"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tmin"]),ctx,"h").write("</td></tr><tr id=\"backup_window_row\"><td>").reference(ctx._get(false, ["tBackup window"]),ctx,"h").write("</td><td><input type=\"text\" id=\"backup_window\" value=\"").reference(ctx._get(false, ["backup_window"]),ctx,"h",["s"]).write("\" onchange=\"backupWindowChange()\"/>&nbsp;<a href=\"javascript: showBackupWindowDetails()\">").reference(ctx._get(false, ["tShow details"]),ctx,"h").write("</a>&nbsp;&nbsp;<a href=\"http://www.urbackup.org/FAQ.php#backup_window\" target=\"_blank\">?</a></td></tr><tr id=\"backup_window_incr_file_row\"><td>").reference(ctx._get(false, ["tBackup window for incremental file backups"]),ctx,"h").write("</td><td><input type=\"text\" id=\"backup_window_incr_file\" value=\"").reference(ctx._get(false, ["backup_window_incr_file"]),ctx,"h",["s"]).write("\"/><a href=\"http://www.urbackup.org/FAQ.php#backup_window\" target=\"_blank\">?</a></td></tr><tr id=\"backup_window_full_file_row\"><td>").reference(ctx._get(false, ["tBackup window for full file backups"]),ctx,"h").write("</td><td><input type=\"text\" id=\"backup_window_full_file\" value=\"").reference(ctx._get(false, ["backup_window_full_file"]),ctx,"h",["s"]).write("\"/><a href=\"http://www.urbackup.org/FAQ.php#backup_window\" target=\"_blank\">?</a></td></tr><tr id=\"backup_window_incr_image_row\"><td>").reference(ctx._get(false, ["tBackup window for incremental image backups"]),ctx,"h").write("</td><td><input type=\"text\" id=\"backup_window_incr_image\" value=\"").reference(ctx._get(false, ["backup_window_incr_image"]),ctx,"h",["s"]).write("\"/><a href=\"http://www.urbackup.org/FAQ.php#backup_window\" target=\"_blank\">?</a></td></tr><tr id=\"backup_window_full_image_row\"><td>").reference(ctx._get(false, ["tBackup window for full image backups"]),ctx,"h").write("</td><td><input type=\"text\" id=\"backup_window_full_image\" value=\"").reference(ctx._get(false, ["backup_window_full_image"]),ctx,"h",["s"]).write("\"/><a href=\"http://www.urbackup.org/FAQ.php#backup_window\" target=\"_blank\">?</a></td></tr>").reference(ctx._get(false, ["no_compname_start"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tComputer name"]),ctx,"h").write("</td><td><input type=\"text\" id=\"computername\" value=\"").reference(ctx._get(false, ["computername"]),ctx,"h",["s"]).write("\"/></td></tr>").reference(ctx._get(false, ["no_compname_end"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tMax backup speed for local network"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"local_speed\" value=\"").reference(ctx._get(false, ["local_speed"]),ctx,"h").write("\"/> MBit/s</td></tr><tr><td>").reference(ctx._get(false, ["tPerform autoupdates silently"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"silent_update\" ").reference(ctx._get(false, ["silent_update"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tSoft client quota"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"client_quota\" value=\"").reference(ctx._get(false, ["client_quota"]),ctx,"h").write("\"/></td></tr></table></div><div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tArchival"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" id=\"archive_table\"><tr><th style=\"width: 200px\" class=\"tabHeader\">").reference(ctx._get(false, ["tArchive every"]),ctx,"h").write("</th><th style=\"width: 200px\" class=\"tabHeader\">").reference(ctx._get(false, ["tArchive for"]),ctx,"h").write("</th><th style=\"width: 80px\" class=\"tabHeader\">").reference(ctx._get(false, ["tArchive window"]),ctx,"h").write("<a href=\"http://www.urbackup.org/FAQ.php#archive_window\" target=\"_blank\" title=\"h;dom;mon;dow\">?</a></th><th style=\"width: 150px\" class=\"tabHeader\">").reference(ctx._get(false, ["tBackup type"]),ctx,"h").write("</th>").reference(ctx._get(false, ["no_compname_start"]),ctx,"h",["s"]).write("<th style=\"width: 100px\" class=\"tabHeader\">").reference(ctx._get(false, ["tNext archival"]),ctx,"h").write("</th>").reference(ctx._get(false, ["no_compname_end"]),ctx,"h",["s"]).write("<th style=\"width: 100px\" class=\"tabHeaderRight\">&nbsp;</th></tr><tr>").reference(ctx._get(false, ["global_settings_start"]),ctx,"h",["s"]).write("<td class=\"tabFRight\" colspan=\"5\" style=\"height:1px\"></td>").reference(ctx._get(false, ["global_settings_end"]),ctx,"h",["s"]).reference(ctx._get(false, ["no_compname_start"]),ctx,"h",["s"]).write("<td class=\"tabFRight\" colspan=\"6\" style=\"height:1px\"></td>").reference(ctx._get(false, ["no_compname_end"]),ctx,"h",["s"]).write("</tr><tr><td class=\"tabFLeft\"><input type=\"text\" style=\"width: 50px\" id=\"archive_every\"> <select size=\"1\" style=\"width: 80px;\" id=\"archive_every_unit\"><option value=\"h\">").reference(ctx._get(false, ["thours"]),ctx,"h").write("</option><option value=\"d\" selected=\"selected\">").reference(ctx._get(false, ["tdays"]),ctx,"h").write("</option><option value=\"w\">").reference(ctx._get(false, ["tweeks"]),ctx,"h").write("</option><option value=\"m\">").reference(ctx._get(false, ["tmonth"]),ctx,"h").write("</option><option value=\"y\">").reference(ctx._get(false, ["tyears"]),ctx,"h").write("</option></select></td><td class=\"tabFLeft\"><input type=\"text\" style=\"width: 50px\" id=\"archive_for\"> <select size=\"1\" style=\"width: 80px;\" onchange=\"changeArchiveForUnit()\" id=\"archive_for_unit\"><option value=\"h\">").reference(ctx._get(false, ["thours"]),ctx,"h").write("</option><option value=\"d\" selected=\"selected\">").reference(ctx._get(false, ["tdays"]),ctx,"h").write("</option><option value=\"w\">").reference(ctx._get(false, ["tweeks"]),ctx,"h").write("</option><option value=\"m\">").reference(ctx._get(false, ["tmonth"]),ctx,"h").write("</option><option value=\"y\">").reference(ctx._get(false, ["tyears"]),ctx,"h").write("</option><option value=\"i\">").reference(ctx._get(false, ["tforever"]),ctx,"h").write("</option></select></td><td class=\"tabFLeft\"><input type=\"text\" style=\"width:70px\" id=\"archive_window\" value=\"*;*;*;*\"></td><td class=\"tabFLeft\"><select size=\"1\" style=\"width: 150px;\" id=\"archive_backup_type\"><option value=\"file\">").reference(ctx._get(false, ["tFile backup"]),ctx,"h").write("</option><option value=\"incr_file\">").reference(ctx._get(false, ["tIncremental file backup"]),ctx,"h").write("</option><option value=\"full_file\">").reference(ctx._get(false, ["tFull file backup"]),ctx,"h").write("</option></select></td>").reference(ctx._get(false, ["no_compname_start"]),ctx,"h",["s"]).write("<td class=\"tabFLeft\">&nbsp;</td>").reference(ctx._get(false, ["no_compname_end"]),ctx,"h",["s"]).write("<td class=\"tabFRight\">").reference(ctx._get(false, ["global_settings_start"]),ctx,"h",["s"]).write("<input type=\"button\" value=\"").reference(ctx._get(false, ["tAdd"]),ctx,"h").write("\" id=\"archive_add\" onclick=\"addArchiveItem(true)\" />").reference(ctx._get(false, ["global_settings_end"]),ctx,"h",["s"]).reference(ctx._get(false, ["no_compname_start"]),ctx,"h",["s"]).write("<input type=\"button\" value=\"").reference(ctx._get(false, ["tAdd"]),ctx,"h").write("\" id=\"archive_add\" onclick=\"addArchiveItem(false)\" />").reference(ctx._get(false, ["no_compname_end"]),ctx,"h",["s"]).write("\t\t</td></tr></table></div>").reference(ctx._get(false, ["internet_settings_start"]),ctx,"h",["s"]).write("<div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tInternet"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\">").reference(ctx._get(false, ["global_settings_start_inet"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tEnable internet mode (requires server restart)"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_mode_enabled\" value=\"false\" ").reference(ctx._get(false, ["internet_mode_enabled"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tInternet server name/IP"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"40\" id=\"internet_server\" value=\"").reference(ctx._get(false, ["internet_server"]),ctx,"h",["s"]).write("\"/> </td></tr><tr><td>").reference(ctx._get(false, ["tInternet server port"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"40\" id=\"internet_server_port\" value=\"").reference(ctx._get(false, ["internet_server_port"]),ctx,"h").write("\"/> </td></tr>").reference(ctx._get(false, ["global_settings_end_inet"]),ctx,"h",["s"]).reference(ctx._get(false, ["no_compname_start_inet"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tEnable internet mode"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_mode_enabled\" value=\"false\" ").reference(ctx._get(false, ["internet_mode_enabled"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tInternet auth key"]),ctx,"h").write("</td><td><input type=\"text\" id=\"internet_authkey\" value=\"").reference(ctx._get(false, ["internet_authkey"]),ctx,"h",["s"]).write("\"/></td></tr>").reference(ctx._get(false, ["no_compname_end_inet"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tDo image backups over internet"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_image_backups\" value=\"false\" ").reference(ctx._get(false, ["internet_image_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tDo full file backups over internet"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_full_file_backups\" value=\"false\" ").reference(ctx._get(false, ["internet_full_file_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tMax backup speed for internet connection"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"internet_speed\" value=\"").reference(ctx._get(false, ["internet_speed"]),ctx,"h").write("\"/> KBit/s</td></tr>").reference(ctx._get(false, ["global_settings_start_inet"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tTotal max backup speed for internet connection"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"global_internet_speed\" value=\"").reference(ctx._get(false, ["global_internet_speed"]),ctx,"h").write("\"/> KBit/s</td></tr>").reference(ctx._get(false, ["global_settings_end_inet"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tEncrypted transfer"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_encrypt\" value=\"false\" ").reference(ctx._get(false, ["internet_encrypt"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tCompressed transfer"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_compress\" value=\"false\" ").reference(ctx._get(false, ["internet_compress"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tCalculate file-hashes on the client"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_calculate_filehashes_on_client\" value=\"false\" ").reference(ctx._get(false, ["internet_calculate_filehashes_on_client"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tConnect to Internet backup server if connected to local backup server"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_connect_always\" value=\"false\" ").reference(ctx._get(false, ["internet_connect_always"]),ctx,"h").write("/></td></tr></table></div>").reference(ctx._get(false, ["internet_settings_end"]),ctx,"h",["s"]).write("<div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tAdvanced"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\">").reference(ctx._get(false, ["global_settings_start"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tTemporary files as file backup buffer"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"use_tmpfiles\" value=\"false\" ").reference(ctx._get(false, ["use_tmpfiles"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tTemporary files as image backup buffer"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"use_tmpfiles_images\" value=\"false\" ").reference(ctx._get(false, ["use_tmpfiles_images"]),ctx,"h").write("/></td></tr>").reference(ctx._get(false, ["global_settings_end"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tLocal full file backup transfer mode"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"local_full_file_transfer_mode\"><option value=\"raw\" ").reference(ctx._get(false, ["local_full_file_transfer_mode_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tRaw"]),ctx,"h").write("</option><option value=\"hashed\" ").reference(ctx._get(false, ["local_full_file_transfer_mode_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tHashed"]),ctx,"h").write("</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tInternet full file backup transfer mode"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"internet_full_file_transfer_mode\"><option value=\"raw\" ").reference(ctx._get(false, ["internet_full_file_transfer_mode_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tRaw"]),ctx,"h").write("</option><option value=\"hashed\" ").reference(ctx._get(false, ["internet_full_file_transfer_mode_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tHashed"]),ctx,"h").write("</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tLocal incremental file backup transfer mode"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"local_incr_file_transfer_mode\"><option value=\"raw\" ").reference(ctx._get(false, ["local_incr_file_transfer_mode_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tRaw"]),ctx,"h").write("</option><option value=\"hashed\" ").reference(ctx._get(false, ["local_incr_file_transfer_mode_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tHashed"]),ctx,"h").write("</option><option value=\"blockhash\" ").reference(ctx._get(false, ["local_incr_file_transfer_mode_2"]),ctx,"h").write(">").reference(ctx._get(false, ["tBlock differences - hashed"]),ctx,"h").write("</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tInternet incremental file backup transfer mode"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"internet_incr_file_transfer_mode\"><option value=\"raw\" ").reference(ctx._get(false, ["internet_incr_file_transfer_mode_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tRaw"]),ctx,"h").write("</option><option value=\"hashed\" ").reference(ctx._get(false, ["internet_incr_file_transfer_mode_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tHashed"]),ctx,"h").write("</option><option value=\"blockhash\" ").reference(ctx._get(false, ["internet_incr_file_transfer_mode_2"]),ctx,"h").write(">").reference(ctx._get(false, ["tBlock differences - hashed"]),ctx,"h").write("</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tLocal image backup transfer mode"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"local_image_transfer_mode\"><option value=\"raw\" ").reference(ctx._get(false, ["local_image_transfer_mode_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tRaw"]),ctx,"h").write("</option><option value=\"hashed\" ").reference(ctx._get(false, ["local_image_transfer_mode_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tHashed"]),ctx,"h").write("</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tInternet image backup transfer mode"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"internet_image_transfer_mode\"><option value=\"raw\" ").reference(ctx._get(false, ["internet_image_transfer_mode_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tRaw"]),ctx,"h").write("</option><option value=\"hashed\" ").reference(ctx._get(false, ["internet_image_transfer_mode_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tHashed"]),ctx,"h").write("</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tFile hash collection amount"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"10\" id=\"file_hash_collect_amount\" value=\"").reference(ctx._get(false, ["file_hash_collect_amount"]),ctx,"h").write("\"/> </td></tr><tr><td>").reference(ctx._get(false, ["tFile hash collection timeout"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"10\" id=\"file_hash_collect_timeout\" value=\"").reference(ctx._get(false, ["file_hash_collect_timeout"]),ctx,"h").write("\"/> </td></tr><tr><td>").reference(ctx._get(false, ["tFile hash collection database cachesize"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"10\" id=\"file_hash_collect_cachesize\" value=\"").reference(ctx._get(false, ["file_hash_collect_cachesize"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tMB"]),ctx,"h").write("</td></tr>").reference(ctx._get(false, ["global_settings_start"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tUpdate stats database cachesize"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"10\" id=\"update_stats_cachesize\" value=\"").reference(ctx._get(false, ["update_stats_cachesize"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tMB"]),ctx,"h").write("</td></tr><tr><td>").reference(ctx._get(false, ["tCache database type for file entries"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"filescache_type\"><option value=\"none\" ").reference(ctx._get(false, ["filescache_type_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tNone"]),ctx,"h").write("</option><option value=\"lmdb\" ").reference(ctx._get(false, ["filescache_type_1"]),ctx,"h").write(">LMDB</option><option value=\"sqlite\" ").reference(ctx._get(false, ["filescache_type_2"]),ctx,"h").write(">SQLite</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tCache database size for file entries"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"10\" id=\"filescache_size\" value=\"").reference(ctx._get(false, ["filescache_size"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tMB"]),ctx,"h").write("</td></tr><tr><td>").reference(ctx._get(false, ["tSuspend index limit"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"10\" id=\"suspend_index_limit\" value=\"").reference(ctx._get(false, ["suspend_index_limit"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tUse symlinks during incremental file backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"use_incremental_symlinks\" value=\"false\" ").reference(ctx._get(false, ["use_incremental_symlinks"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tTrust client hashes during incremental file backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"trust_client_hashes\" value=\"false\" ").reference(ctx._get(false, ["trust_client_hashes"]),ctx,"h").write("/></td></tr>").reference(ctx._get(false, ["global_settings_end"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tEnd-to-end verification of all file backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"end_to_end_file_backup_verification\" value=\"false\" ").reference(ctx._get(false, ["end_to_end_file_backup_verification"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tVerify file backups using client side hashes"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"verify_using_client_hashes\" value=\"false\" ").reference(ctx._get(false, ["verify_using_client_hashes"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tPeriodically readd file entries of internet clients to database (disable only if you do not run fulls)"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_readd_file_entries\" value=\"true\" ").reference(ctx._get(false, ["internet_readd_file_entries"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tRun backups with background priority on Windows"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"background_backups\" value=\"true\" ").reference(ctx._get(false, ["background_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tFollow symbolic links on Linux"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"follow_symlinks\" value=\"true\" ").reference(ctx._get(false, ["follow_symlinks"]),ctx,"h").write("/></td></tr></table></div>");}return body_0;})();
+(function(){dust.register("settings_inv_row",body_0);function body_0(chk,ctx){return chk.write("<div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tFile backups"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\"><tr><td>").reference(ctx._get(false, ["tInterval for incremental file backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"update_freq_incr\" value=\"").reference(ctx._get(false, ["update_freq_incr"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["thours"]),ctx,"h").write("&nbsp;&nbsp;</td><td><input type=\"checkbox\" id=\"update_freq_incr_disable\" onchange=\"settingsCheckboxChange()\"/> ").reference(ctx._get(false, ["tDisable"]),ctx,"h").write("</td></tr><tr><td>").reference(ctx._get(false, ["tInterval for full file backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"update_freq_full\" value=\"").reference(ctx._get(false, ["update_freq_full"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tdays"]),ctx,"h").write("&nbsp;&nbsp;</td><td><input type=\"checkbox\" id=\"update_freq_full_disable\" onchange=\"settingsCheckboxChange()\"/> ").reference(ctx._get(false, ["tDisable"]),ctx,"h").write("</td></tr><tr><td>").reference(ctx._get(false, ["tMaximal number of incremental file backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"max_file_incr\" value=\"").reference(ctx._get(false, ["max_file_incr"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tMinimal number of incremental file backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"min_file_incr\" value=\"").reference(ctx._get(false, ["min_file_incr"]),ctx,"h").write("\"/></td></tr><td>").reference(ctx._get(false, ["tMaximal number of full file backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"max_file_full\" value=\"").reference(ctx._get(false, ["max_file_full"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tMinimal number of full file backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"min_file_full\" value=\"").reference(ctx._get(false, ["min_file_full"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tExcluded files (with wildcards)"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"exclude_files\" value=\"").reference(ctx._get(false, ["exclude_files"]),ctx,"h",["s"]).write("\"/> <a href=\"http://www.urbackup.org/FAQ.php#exclude_files\" target=\"_blank\">?</a></td></tr><tr><td>").reference(ctx._get(false, ["tIncluded files (with wildcards)"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"include_files\" value=\"").reference(ctx._get(false, ["include_files"]),ctx,"h",["s"]).write("\"/> <a href=\"http://www.urbackup.org/FAQ.php#include_files\" target=\"_blank\">?</a></td></tr><tr><td>").reference(ctx._get(false, ["tDefault directories to backup"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"default_dirs\" value=\"").reference(ctx._get(false, ["default_dirs"]),ctx,"h",["s"]).write("\"/> <a href=\"http://www.urbackup.org/FAQ.php#default_dirs\" target=\"_blank\">?</a></td></tr><tr></table></div><div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tImage backups"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\"><tr><td>").reference(ctx._get(false, ["tInterval for incremental image backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"update_freq_image_incr\" value=\"").reference(ctx._get(false, ["update_freq_image_incr"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tdays"]),ctx,"h").write("&nbsp;&nbsp;</td><td><input type=\"checkbox\" id=\"update_freq_image_incr_disable\" onchange=\"settingsCheckboxChange()\"/> ").reference(ctx._get(false, ["tDisable"]),ctx,"h").write("</td></tr><tr><td>").reference(ctx._get(false, ["tInterval for full image backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"update_freq_image_full\" value=\"").reference(ctx._get(false, ["update_freq_image_full"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tdays"]),ctx,"h").write("&nbsp;&nbsp;</td><td><input type=\"checkbox\" id=\"update_freq_image_full_disable\" onchange=\"settingsCheckboxChange()\"/> ").reference(ctx._get(false, ["tDisable"]),ctx,"h").write("</td></tr><td>").reference(ctx._get(false, ["tMaximal number of incremental image backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"max_image_incr\" value=\"").reference(ctx._get(false, ["max_image_incr"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tMinimal number of incremental image backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"min_image_incr\" value=\"").reference(ctx._get(false, ["min_image_incr"]),ctx,"h").write("\"/></td></tr><td>").reference(ctx._get(false, ["tMaximal number of full image backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"max_image_full\" value=\"").reference(ctx._get(false, ["max_image_full"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tMinimal number of full image backups"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"min_image_full\" value=\"").reference(ctx._get(false, ["min_image_full"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tVolumes to backup"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"image_letters\" value=\"").reference(ctx._get(false, ["image_letters"]),ctx,"h",["s","h"]).write("\"/> <a href=\"http://www.urbackup.org/FAQ.php#image_letters\" target=\"_blank\">?</a></td></tr><tr><td>").reference(ctx._get(false, ["tImage backup file format"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"image_file_format\"><option value=\"vhdz\" ").reference(ctx._get(false, ["image_file_format_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tCompressed VHD (Compressed non-standard Virtual HardDisk)"]),ctx,"h").write("</option><option value=\"vhd\" ").reference(ctx._get(false, ["image_file_format_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tVHD (Virtual HardDisk)"]),ctx,"h").write("</option></select></td></tr></table></div><div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tPermissions"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\"><tr><td>").reference(ctx._get(false, ["tAllow client-side changing of the directories to backup"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_config_paths\" ").reference(ctx._get(false, ["allow_config_paths"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side starting of full file backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_starting_full_file_backups\" ").reference(ctx._get(false, ["allow_starting_full_file_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side starting of incremental file backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_starting_incr_file_backups\" ").reference(ctx._get(false, ["allow_starting_incr_file_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side starting of full image backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_starting_full_image_backups\" ").reference(ctx._get(false, ["allow_starting_full_image_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side starting of incremental image backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_starting_incr_image_backups\" ").reference(ctx._get(false, ["allow_starting_incr_image_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side viewing of backup logs"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_log_view\" ").reference(ctx._get(false, ["allow_log_view"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side pausing of backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_pause\" ").reference(ctx._get(false, ["allow_pause"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow client-side changing of settings"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_overwrite\" ").reference(ctx._get(false, ["allow_overwrite"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tAllow clients to quit the tray icon"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"allow_tray_exit\" ").reference(ctx._get(false, ["allow_tray_exit"]),ctx,"h").write("/></td></tr></table></div><div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tClient"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\"><tr><td>").reference(ctx._get(false, ["tDelay after system startup"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"startup_backup_delay\" value=\"").reference(ctx._get(false, ["startup_backup_delay"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tmin"]),ctx,"h").write("</td></tr><tr id=\"backup_window_row\"><td>").reference(ctx._get(false, ["tBackup window"]),ctx,"h").write("</td><td><input type=\"text\" id=\"backup_window\" value=\"").reference(ctx._get(false, ["backup_window"]),ctx,"h",["s"]).write("\" onchange=\"backupWindowChange()\"/>&nbsp;<a href=\"javascript: showBackupWindowDetails()\">").reference(ctx._get(false, ["tShow details"]),ctx,"h").write("</a>&nbsp;&nbsp;<a href=\"http://www.urbackup.org/FAQ.php#backup_window\" target=\"_blank\">?</a></td></tr><tr id=\"backup_window_incr_file_row\"><td>").reference(ctx._get(false, ["tBackup window for incremental file backups"]),ctx,"h").write("</td><td><input type=\"text\" id=\"backup_window_incr_file\" value=\"").reference(ctx._get(false, ["backup_window_incr_file"]),ctx,"h",["s"]).write("\"/><a href=\"http://www.urbackup.org/FAQ.php#backup_window\" target=\"_blank\">?</a></td></tr><tr id=\"backup_window_full_file_row\"><td>").reference(ctx._get(false, ["tBackup window for full file backups"]),ctx,"h").write("</td><td><input type=\"text\" id=\"backup_window_full_file\" value=\"").reference(ctx._get(false, ["backup_window_full_file"]),ctx,"h",["s"]).write("\"/><a href=\"http://www.urbackup.org/FAQ.php#backup_window\" target=\"_blank\">?</a></td></tr><tr id=\"backup_window_incr_image_row\"><td>").reference(ctx._get(false, ["tBackup window for incremental image backups"]),ctx,"h").write("</td><td><input type=\"text\" id=\"backup_window_incr_image\" value=\"").reference(ctx._get(false, ["backup_window_incr_image"]),ctx,"h",["s"]).write("\"/><a href=\"http://www.urbackup.org/FAQ.php#backup_window\" target=\"_blank\">?</a></td></tr><tr id=\"backup_window_full_image_row\"><td>").reference(ctx._get(false, ["tBackup window for full image backups"]),ctx,"h").write("</td><td><input type=\"text\" id=\"backup_window_full_image\" value=\"").reference(ctx._get(false, ["backup_window_full_image"]),ctx,"h",["s"]).write("\"/><a href=\"http://www.urbackup.org/FAQ.php#backup_window\" target=\"_blank\">?</a></td></tr>").reference(ctx._get(false, ["no_compname_start"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tComputer name"]),ctx,"h").write("</td><td><input type=\"text\" id=\"computername\" value=\"").reference(ctx._get(false, ["computername"]),ctx,"h",["s"]).write("\"/></td></tr>").reference(ctx._get(false, ["no_compname_end"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tMax backup speed for local network"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"local_speed\" value=\"").reference(ctx._get(false, ["local_speed"]),ctx,"h").write("\"/> MBit/s</td></tr><tr><td>").reference(ctx._get(false, ["tPerform autoupdates silently"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"silent_update\" ").reference(ctx._get(false, ["silent_update"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tSoft client quota"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"client_quota\" value=\"").reference(ctx._get(false, ["client_quota"]),ctx,"h").write("\"/></td></tr></table></div><div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tArchival"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" id=\"archive_table\"><tr><th style=\"width: 200px\" class=\"tabHeader\">").reference(ctx._get(false, ["tArchive every"]),ctx,"h").write("</th><th style=\"width: 200px\" class=\"tabHeader\">").reference(ctx._get(false, ["tArchive for"]),ctx,"h").write("</th><th style=\"width: 80px\" class=\"tabHeader\">").reference(ctx._get(false, ["tArchive window"]),ctx,"h").write("<a href=\"http://www.urbackup.org/FAQ.php#archive_window\" target=\"_blank\" title=\"h;dom;mon;dow\">?</a></th><th style=\"width: 150px\" class=\"tabHeader\">").reference(ctx._get(false, ["tBackup type"]),ctx,"h").write("</th>").reference(ctx._get(false, ["no_compname_start"]),ctx,"h",["s"]).write("<th style=\"width: 100px\" class=\"tabHeader\">").reference(ctx._get(false, ["tNext archival"]),ctx,"h").write("</th>").reference(ctx._get(false, ["no_compname_end"]),ctx,"h",["s"]).write("<th style=\"width: 100px\" class=\"tabHeaderRight\">&nbsp;</th></tr><tr>").reference(ctx._get(false, ["global_settings_start"]),ctx,"h",["s"]).write("<td class=\"tabFRight\" colspan=\"5\" style=\"height:1px\"></td>").reference(ctx._get(false, ["global_settings_end"]),ctx,"h",["s"]).reference(ctx._get(false, ["no_compname_start"]),ctx,"h",["s"]).write("<td class=\"tabFRight\" colspan=\"6\" style=\"height:1px\"></td>").reference(ctx._get(false, ["no_compname_end"]),ctx,"h",["s"]).write("</tr><tr><td class=\"tabFLeft\"><input type=\"text\" style=\"width: 50px\" id=\"archive_every\"> <select size=\"1\" style=\"width: 80px;\" id=\"archive_every_unit\"><option value=\"h\">").reference(ctx._get(false, ["thours"]),ctx,"h").write("</option><option value=\"d\" selected=\"selected\">").reference(ctx._get(false, ["tdays"]),ctx,"h").write("</option><option value=\"w\">").reference(ctx._get(false, ["tweeks"]),ctx,"h").write("</option><option value=\"m\">").reference(ctx._get(false, ["tmonth"]),ctx,"h").write("</option><option value=\"y\">").reference(ctx._get(false, ["tyears"]),ctx,"h").write("</option></select></td><td class=\"tabFLeft\"><input type=\"text\" style=\"width: 50px\" id=\"archive_for\"> <select size=\"1\" style=\"width: 80px;\" onchange=\"changeArchiveForUnit()\" id=\"archive_for_unit\"><option value=\"h\">").reference(ctx._get(false, ["thours"]),ctx,"h").write("</option><option value=\"d\" selected=\"selected\">").reference(ctx._get(false, ["tdays"]),ctx,"h").write("</option><option value=\"w\">").reference(ctx._get(false, ["tweeks"]),ctx,"h").write("</option><option value=\"m\">").reference(ctx._get(false, ["tmonth"]),ctx,"h").write("</option><option value=\"y\">").reference(ctx._get(false, ["tyears"]),ctx,"h").write("</option><option value=\"i\">").reference(ctx._get(false, ["tforever"]),ctx,"h").write("</option></select></td><td class=\"tabFLeft\"><input type=\"text\" style=\"width:70px\" id=\"archive_window\" value=\"*;*;*;*\"></td><td class=\"tabFLeft\"><select size=\"1\" style=\"width: 150px;\" id=\"archive_backup_type\"><option value=\"file\">").reference(ctx._get(false, ["tFile backup"]),ctx,"h").write("</option><option value=\"incr_file\">").reference(ctx._get(false, ["tIncremental file backup"]),ctx,"h").write("</option><option value=\"full_file\">").reference(ctx._get(false, ["tFull file backup"]),ctx,"h").write("</option></select></td>").reference(ctx._get(false, ["no_compname_start"]),ctx,"h",["s"]).write("<td class=\"tabFLeft\">&nbsp;</td>").reference(ctx._get(false, ["no_compname_end"]),ctx,"h",["s"]).write("<td class=\"tabFRight\">").reference(ctx._get(false, ["global_settings_start"]),ctx,"h",["s"]).write("<input type=\"button\" value=\"").reference(ctx._get(false, ["tAdd"]),ctx,"h").write("\" id=\"archive_add\" onclick=\"addArchiveItem(true)\" />").reference(ctx._get(false, ["global_settings_end"]),ctx,"h",["s"]).reference(ctx._get(false, ["no_compname_start"]),ctx,"h",["s"]).write("<input type=\"button\" value=\"").reference(ctx._get(false, ["tAdd"]),ctx,"h").write("\" id=\"archive_add\" onclick=\"addArchiveItem(false)\" />").reference(ctx._get(false, ["no_compname_end"]),ctx,"h",["s"]).write("\t\t</td></tr></table></div>").reference(ctx._get(false, ["internet_settings_start"]),ctx,"h",["s"]).write("<div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tInternet"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\">").reference(ctx._get(false, ["global_settings_start_inet"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tEnable internet mode (requires server restart)"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_mode_enabled\" value=\"false\" ").reference(ctx._get(false, ["internet_mode_enabled"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tInternet server name/IP"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"40\" id=\"internet_server\" value=\"").reference(ctx._get(false, ["internet_server"]),ctx,"h",["s"]).write("\"/> </td></tr><tr><td>").reference(ctx._get(false, ["tInternet server port"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"40\" id=\"internet_server_port\" value=\"").reference(ctx._get(false, ["internet_server_port"]),ctx,"h").write("\"/> </td></tr>").reference(ctx._get(false, ["global_settings_end_inet"]),ctx,"h",["s"]).reference(ctx._get(false, ["no_compname_start_inet"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tEnable internet mode"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_mode_enabled\" value=\"false\" ").reference(ctx._get(false, ["internet_mode_enabled"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tInternet auth key"]),ctx,"h").write("</td><td><input type=\"text\" id=\"internet_authkey\" value=\"").reference(ctx._get(false, ["internet_authkey"]),ctx,"h",["s"]).write("\"/></td></tr>").reference(ctx._get(false, ["no_compname_end_inet"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tDo image backups over internet"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_image_backups\" value=\"false\" ").reference(ctx._get(false, ["internet_image_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tDo full file backups over internet"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_full_file_backups\" value=\"false\" ").reference(ctx._get(false, ["internet_full_file_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tMax backup speed for internet connection"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"internet_speed\" value=\"").reference(ctx._get(false, ["internet_speed"]),ctx,"h").write("\"/> KBit/s</td></tr>").reference(ctx._get(false, ["global_settings_start_inet"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tTotal max backup speed for internet connection"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"global_internet_speed\" value=\"").reference(ctx._get(false, ["global_internet_speed"]),ctx,"h").write("\"/> KBit/s</td></tr>").reference(ctx._get(false, ["global_settings_end_inet"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tEncrypted transfer"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_encrypt\" value=\"false\" ").reference(ctx._get(false, ["internet_encrypt"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tCompressed transfer"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_compress\" value=\"false\" ").reference(ctx._get(false, ["internet_compress"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tCalculate file-hashes on the client"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_calculate_filehashes_on_client\" value=\"false\" ").reference(ctx._get(false, ["internet_calculate_filehashes_on_client"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tConnect to Internet backup server if connected to local backup server"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_connect_always\" value=\"false\" ").reference(ctx._get(false, ["internet_connect_always"]),ctx,"h").write("/></td></tr></table></div>").reference(ctx._get(false, ["internet_settings_end"]),ctx,"h",["s"]).write("<div class=\"tabbertab\" title=\"").reference(ctx._get(false, ["tAdvanced"]),ctx,"h").write("\"><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\">").reference(ctx._get(false, ["global_settings_start"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tTemporary files as file backup buffer"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"use_tmpfiles\" value=\"false\" ").reference(ctx._get(false, ["use_tmpfiles"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tTemporary files as image backup buffer"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"use_tmpfiles_images\" value=\"false\" ").reference(ctx._get(false, ["use_tmpfiles_images"]),ctx,"h").write("/></td></tr>").reference(ctx._get(false, ["global_settings_end"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tLocal full file backup transfer mode"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"local_full_file_transfer_mode\"><option value=\"raw\" ").reference(ctx._get(false, ["local_full_file_transfer_mode_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tRaw"]),ctx,"h").write("</option><option value=\"hashed\" ").reference(ctx._get(false, ["local_full_file_transfer_mode_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tHashed"]),ctx,"h").write("</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tInternet full file backup transfer mode"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"internet_full_file_transfer_mode\"><option value=\"raw\" ").reference(ctx._get(false, ["internet_full_file_transfer_mode_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tRaw"]),ctx,"h").write("</option><option value=\"hashed\" ").reference(ctx._get(false, ["internet_full_file_transfer_mode_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tHashed"]),ctx,"h").write("</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tLocal incremental file backup transfer mode"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"local_incr_file_transfer_mode\"><option value=\"raw\" ").reference(ctx._get(false, ["local_incr_file_transfer_mode_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tRaw"]),ctx,"h").write("</option><option value=\"hashed\" ").reference(ctx._get(false, ["local_incr_file_transfer_mode_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tHashed"]),ctx,"h").write("</option><option value=\"blockhash\" ").reference(ctx._get(false, ["local_incr_file_transfer_mode_2"]),ctx,"h").write(">").reference(ctx._get(false, ["tBlock differences - hashed"]),ctx,"h").write("</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tInternet incremental file backup transfer mode"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"internet_incr_file_transfer_mode\"><option value=\"raw\" ").reference(ctx._get(false, ["internet_incr_file_transfer_mode_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tRaw"]),ctx,"h").write("</option><option value=\"hashed\" ").reference(ctx._get(false, ["internet_incr_file_transfer_mode_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tHashed"]),ctx,"h").write("</option><option value=\"blockhash\" ").reference(ctx._get(false, ["internet_incr_file_transfer_mode_2"]),ctx,"h").write(">").reference(ctx._get(false, ["tBlock differences - hashed"]),ctx,"h").write("</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tLocal image backup transfer mode"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"local_image_transfer_mode\"><option value=\"raw\" ").reference(ctx._get(false, ["local_image_transfer_mode_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tRaw"]),ctx,"h").write("</option><option value=\"hashed\" ").reference(ctx._get(false, ["local_image_transfer_mode_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tHashed"]),ctx,"h").write("</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tInternet image backup transfer mode"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"internet_image_transfer_mode\"><option value=\"raw\" ").reference(ctx._get(false, ["internet_image_transfer_mode_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tRaw"]),ctx,"h").write("</option><option value=\"hashed\" ").reference(ctx._get(false, ["internet_image_transfer_mode_1"]),ctx,"h").write(">").reference(ctx._get(false, ["tHashed"]),ctx,"h").write("</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tFile hash collection amount"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"10\" id=\"file_hash_collect_amount\" value=\"").reference(ctx._get(false, ["file_hash_collect_amount"]),ctx,"h").write("\"/> </td></tr><tr><td>").reference(ctx._get(false, ["tFile hash collection timeout"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"10\" id=\"file_hash_collect_timeout\" value=\"").reference(ctx._get(false, ["file_hash_collect_timeout"]),ctx,"h").write("\"/> </td></tr><tr><td>").reference(ctx._get(false, ["tFile hash collection database cachesize"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"10\" id=\"file_hash_collect_cachesize\" value=\"").reference(ctx._get(false, ["file_hash_collect_cachesize"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tMB"]),ctx,"h").write("</td></tr>").reference(ctx._get(false, ["global_settings_start"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tUpdate stats database cachesize"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"10\" id=\"update_stats_cachesize\" value=\"").reference(ctx._get(false, ["update_stats_cachesize"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tMB"]),ctx,"h").write("</td></tr><tr><td>").reference(ctx._get(false, ["tCache database type for file entries"]),ctx,"h").write(":</td><td><select size=\"1\" style=\"width: 150px;\" id=\"filescache_type\"><option value=\"none\" ").reference(ctx._get(false, ["filescache_type_0"]),ctx,"h").write(">").reference(ctx._get(false, ["tNone"]),ctx,"h").write("</option><option value=\"lmdb\" ").reference(ctx._get(false, ["filescache_type_1"]),ctx,"h").write(">LMDB</option><option value=\"sqlite\" ").reference(ctx._get(false, ["filescache_type_2"]),ctx,"h").write(">SQLite</option><option value=\"hashindex\" ").reference(ctx._get(false, ["filescache_type_3"]),ctx,"h").write(">Hash index</option></select></td></tr><tr><td>").reference(ctx._get(false, ["tCache database size for file entries"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"10\" id=\"filescache_size\" value=\"").reference(ctx._get(false, ["filescache_size"]),ctx,"h").write("\"/> ").reference(ctx._get(false, ["tMB"]),ctx,"h").write("</td></tr><tr><td>").reference(ctx._get(false, ["tSuspend index limit"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"10\" id=\"suspend_index_limit\" value=\"").reference(ctx._get(false, ["suspend_index_limit"]),ctx,"h").write("\"/></td></tr><tr><td>").reference(ctx._get(false, ["tUse symlinks during incremental file backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"use_incremental_symlinks\" value=\"false\" ").reference(ctx._get(false, ["use_incremental_symlinks"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tTrust client hashes during incremental file backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"trust_client_hashes\" value=\"false\" ").reference(ctx._get(false, ["trust_client_hashes"]),ctx,"h").write("/></td></tr>").reference(ctx._get(false, ["global_settings_end"]),ctx,"h",["s"]).write("<tr><td>").reference(ctx._get(false, ["tEnd-to-end verification of all file backups"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"end_to_end_file_backup_verification\" value=\"false\" ").reference(ctx._get(false, ["end_to_end_file_backup_verification"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tVerify file backups using client side hashes"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"verify_using_client_hashes\" value=\"false\" ").reference(ctx._get(false, ["verify_using_client_hashes"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tPeriodically readd file entries of internet clients to database (disable only if you do not run fulls)"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"internet_readd_file_entries\" value=\"true\" ").reference(ctx._get(false, ["internet_readd_file_entries"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tRun backups with background priority on Windows"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"background_backups\" value=\"true\" ").reference(ctx._get(false, ["background_backups"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tFollow symbolic links on Linux"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"follow_symlinks\" value=\"true\" ").reference(ctx._get(false, ["follow_symlinks"]),ctx,"h").write("/></td></tr></table></div>");}return body_0;})();
 (function(){dust.register("settings_mail",body_0);function body_0(chk,ctx){return chk.write("<br /><table cellspacing=\"0\" cellpadding=\"0\" border=\"0\" class=\"formtable\"><tr><td>").reference(ctx._get(false, ["tMail server name"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"40\" id=\"mail_servername\" value=\"").reference(ctx._get(false, ["mail_servername"]),ctx,"h",["s"]).write("\"/> </td></tr><tr><td>").reference(ctx._get(false, ["tMail server port"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"40\" id=\"mail_serverport\" value=\"").reference(ctx._get(false, ["mail_serverport"]),ctx,"h").write("\"/> </td></tr><tr><td>").reference(ctx._get(false, ["tMail server username (empty for none)"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"40\" id=\"mail_username\" value=\"").reference(ctx._get(false, ["mail_username"]),ctx,"h",["s"]).write("\"/> </td></tr><tr><td>").reference(ctx._get(false, ["tMail server password"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"40\" id=\"mail_password\" value=\"").reference(ctx._get(false, ["mail_password"]),ctx,"h",["s"]).write("\"/> </td></tr><tr><td>").reference(ctx._get(false, ["tSender E-Mail Address"]),ctx,"h").write(":</td><td><input type=\"text\" id=\"mail_from\" value=\"").reference(ctx._get(false, ["mail_from"]),ctx,"h",["s"]).write("\" /></td></tr><tr><td>").reference(ctx._get(false, ["tSend mails only with SSL/TLS"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"mail_ssl_only\" value=\"false\" ").reference(ctx._get(false, ["mail_ssl_only"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tCheck SSL/TLS certificate"]),ctx,"h").write(":</td><td><input type=\"checkbox\" id=\"mail_check_certificate\" value=\"false\" ").reference(ctx._get(false, ["mail_check_certificate"]),ctx,"h").write("/></td></tr><tr><td>").reference(ctx._get(false, ["tServer admin mail address"]),ctx,"h").write(":</td><td><input type=\"text\" size=\"40\" id=\"mail_admin_addrs\" value=\"").reference(ctx._get(false, ["mail_admin_addrs"]),ctx,"h",["s"]).write("\"/> </td></tr></table><br /><br /><input type=\"button\" value=\"").reference(ctx._get(false, ["tSave"]),ctx,"h").write("\" onClick=\"saveMailSettings()\" /><br />").reference(ctx._get(false, ["tSend test mail to this email address after saving the settings (leave empty to not send a test mail)"]),ctx,"h").write(":<br /><input type=\"text\" size=\"40\" id=\"testmailaddr\" value=\"\"/>");}return body_0;})();
 (function(){dust.register("settings_mail_test_failed",body_0);function body_0(chk,ctx){return chk.write("<br /><br /><strong>").reference(ctx._get(false, ["tSending test mail failed. Error:"]),ctx,"h").write("</strong> ").reference(ctx._get(false, ["mail_err"]),ctx,"h");}return body_0;})();
 (function(){dust.register("settings_mail_test_ok",body_0);function body_0(chk,ctx){return chk.write("<br /><br /><strong>").reference(ctx._get(false, ["tTest Mail sent successfully"]),ctx,"h").write(".</strong>");}return body_0;})();
@@ -1502,7 +1502,7 @@ function show_settings2(data)
 			data.settings=addSelectSelected(transfer_mode_params1, "local_image_transfer_mode", data.settings);
 			data.settings=addSelectSelected(transfer_mode_params1, "internet_image_transfer_mode", data.settings);
 			
-			var filescache_type_params=["none", "lmdb", "sqlite"];
+			var filescache_type_params=["none", "lmdb", "sqlite", "hashindex"];
 			data.settings=addSelectSelected(filescache_type_params, "filescache_type", data.settings);
 			data.settings.filescache_size/=1024.0*1024.0;
 			